@@ -80,6 +80,17 @@ public:
         return true;
     }
     
+    /// Printf без vsnprintf: формат разбирается при сборке (usb_fmt.h)
+    /// @code g_usb_debug.Format(USB_FMT("adc={} v={:.3}\r\n"), raw, millivolts); @endcode
+    template <typename Fmt, typename... Args>
+    bool Format(Fmt format, const Args&... args) {
+        if (!usb_ || !usb_->CdcTerminalOpened()) {
+            return false;
+        }
+        usb_->CdcFormat(format, args...);
+        return true;
+    }
+    
     bool Write(const uint8_t* data, size_t length) override {
         if (!usb_ || !usb_->CdcTerminalOpened()) {
             return false;
@@ -116,6 +127,9 @@ private:
  * usb::BlockDeviceAdapter<MySdDriver> g_sd_adapter(&g_sd);
  * g_usb.MscAttach(&g_sd_adapter);
  * ```
+ * 
+ * Только для MSC адаптер не нужен: g_usb.MscAttach(g_sd) привязывает драйвер
+ * напрямую, без второго слоя виртуальных вызовов (usb_msc_binding.h).
  */
 template<typename T>
 class BlockDeviceAdapter : public IBlockDevice {
@@ -132,7 +146,11 @@ public:
     }
     
     uint32_t GetBlockSize() const override {
-        return 512;  // Стандартный размер блока
+        if constexpr (StaticBlockSize<T>::value != 0) {
+            return StaticBlockSize<T>::value;
+        } else {
+            return device_ ? device_->GetBlockSize() : 0;
+        }
     }
     
     bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override {
@@ -0,0 +1,196 @@
+/**
+ * @file usb_arbiter.h
+ * @brief Совместный доступ прошивки и хоста MSC к одному блочному устройству
+ *
+ * BlockArbiter стоит между IBlockDevice и двумя клиентами: Host() подключается
+ * к MSC (MscAttach), Firmware() — к коду прошивки. Операции чередуются по
+ * очереди читателей/писателей вместо MscEject()/MscDetach(): хост не теряет
+ * диск, прошивке не нужно ждать отключения.
+ *
+ * Очередь:
+ * - запись и Sync() — монопольно, чтения — вместе (если concurrent_reads)
+ * - вход строго по порядку прихода: новый читатель не обгоняет ждущего
+ *   писателя, поэтому ожидание ограничено операциями впереди в очереди
+ * - ожидание дольше таймаута клиента — операция возвращает false
+ *
+ * Смена носителя: блоки, которые хост читал или писал (области по
+ * 2^region_shift блоков), отмечаются. Запись прошивки в отмеченную область
+ * вызывает ChangeFn — UsbDevice::MscMediaChanged() отвечает на следующий
+ * TEST UNIT READY сенсом UNIT ATTENTION 28h, и хост сбрасывает кэш. Запись
+ * в блоки, которых хост не видел, хосту не сообщается.
+ *
+ * Без RTOS (SetRtos() не вызван) все вызовы идут из одного контекста,
+ * очередь не нужна. Активация: USB_ARBITER_ENABLED.
+ *
+ * @code
+ * usb::BlockArbiter g_arbiter(g_sd);
+ * g_arbiter.SetRtos(g_rtos, g_clock);
+ * g_arbiter.SetChangeCallback(
+ *     [](void* usb) { static_cast<usb::UsbDevice*>(usb)->MscMediaChanged(); }, &g_usb);
+ * g_usb.MscAttach(g_arbiter.Host());
+ *
+ * // Задача прошивки
+ * g_arbiter.Firmware().Write(lba, data, count);
+ * @endcode
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "ports/IBlockDevice.hpp"
+#include "ports/IClock.hpp"
+#include "ports/IRtos.hpp"
+
+// Областей в карте блоков хоста (бит на область)
+#ifndef USB_ARBITER_REGIONS
+#define USB_ARBITER_REGIONS 1024
+#endif
+
+// Одновременно ждущих операций (по сигналу RTOS на каждую)
+#ifndef USB_ARBITER_WAITERS
+#define USB_ARBITER_WAITERS 3
+#endif
+
+namespace usb {
+
+/// Клиент арбитра
+enum class ArbiterClient : uint8_t {
+    Host,      ///< MSC
+    Firmware,
+};
+
+/// Таймауты и режим очереди
+struct ArbiterConfig {
+    uint32_t host_timeout_ms = 250;       ///< Хост получит ошибку и повторит команду
+    uint32_t firmware_timeout_ms = 1000;
+    bool concurrent_reads = false;        ///< Устройство допускает параллельные Read()
+};
+
+/// Счётчики (снимок, POD)
+struct ArbiterStats {
+    uint32_t host_ops = 0;
+    uint32_t firmware_ops = 0;
+    uint32_t contended = 0;               ///< Операций, ждавших очереди
+    uint32_t timeouts = 0;                ///< Не дождались (или нет свободного места ожидания)
+    uint32_t max_wait_ms = 0;
+    uint32_t firmware_writes_unseen = 0;  ///< Записей прошивки в блоки, не виденные хостом
+    uint32_t media_changes = 0;           ///< Вызовов ChangeFn
+};
+
+class BlockArbiter;
+
+/**
+ * @brief Клиент арбитра как блочное устройство
+ *
+ * Геометрия и готовность — напрямую от устройства, Read()/Write()/Sync() —
+ * через очередь арбитра.
+ */
+class ArbitratedBlockDevice final : public ports::IBlockDevice {
+public:
+    ArbitratedBlockDevice(BlockArbiter& arbiter, ArbiterClient client)
+        : arbiter_(arbiter), client_(client) {}
+
+    [[nodiscard]] bool IsReady() const override;
+    [[nodiscard]] uint32_t GetBlockCount() const override;
+    [[nodiscard]] uint32_t GetBlockSize() const override;
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override;
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override;
+    bool Sync() override;
+
+private:
+    BlockArbiter& arbiter_;
+    ArbiterClient client_;
+};
+
+/**
+ * @brief Очередь читателей/писателей над IBlockDevice и учёт блоков хоста
+ */
+class BlockArbiter {
+public:
+    using ChangeFn = void (*)(void* context);
+
+    explicit BlockArbiter(ports::IBlockDevice& device,
+                          const ArbiterConfig& config = ArbiterConfig{});
+
+    BlockArbiter(const BlockArbiter&) = delete;
+    BlockArbiter& operator=(const BlockArbiter&) = delete;
+
+    /**
+     * @brief Очередь для нескольких задач
+     * @return false — пул RTOS исчерпан (нужны 1 мьютекс и USB_ARBITER_WAITERS сигналов)
+     */
+    bool SetRtos(ports::IRtos& rtos, const ports::IClock& clock);
+
+    /// Клиент для MscAttach()
+    ArbitratedBlockDevice& Host() { return host_; }
+
+    /// Клиент прошивки
+    ArbitratedBlockDevice& Firmware() { return firmware_; }
+
+    /// Прошивка изменила блоки, которые хост мог кэшировать (вызывается вне очереди)
+    void SetChangeCallback(ChangeFn callback, void* context = nullptr) {
+        change_callback_ = callback;
+        change_context_ = context;
+    }
+
+    /// Забыть блоки хоста (хост перечитал носитель, MscAttach())
+    void ForgetHostBlocks();
+
+    ArbiterStats GetStats() const;
+    void ResetStats();
+
+private:
+    friend class ArbitratedBlockDevice;
+
+    enum class Op : uint8_t { Read, Write, Sync };
+
+    struct Waiter {
+        ports::ISignal* signal = nullptr;
+        uint32_t ticket = 0;
+        bool waiting = false;
+        bool exclusive = false;
+    };
+
+    bool Transfer(ArbiterClient client, Op op, uint32_t lba, uint8_t* buffer, uint32_t count);
+
+    bool Acquire(bool exclusive, uint32_t timeout_ms);
+    /// Вход без ожидания: совместимо с владельцами и никто не ждёт раньше
+    bool CanEnter(bool exclusive, uint32_t ticket, bool queued) const;
+    void Enter(bool exclusive);
+    /// Выход и учёт блоков под мьютексом
+    /// @return Нужно вызвать ChangeFn
+    bool Leave(bool exclusive, ArbiterClient client, Op op, uint32_t lba, uint32_t count, bool ok);
+    void WakeWaiters();
+
+    bool MarkHost(uint32_t lba, uint32_t count);
+    bool HostSaw(uint32_t lba, uint32_t count) const;
+
+    void Lock() const;
+    void Unlock() const;
+
+    ports::IBlockDevice& device_;
+    ArbiterConfig config_;
+    ArbitratedBlockDevice host_;
+    ArbitratedBlockDevice firmware_;
+
+    ports::IMutex* mutex_ = nullptr;
+    const ports::IClock* clock_ = nullptr;
+
+    // Очередь
+    uint32_t readers_ = 0;
+    bool writer_ = false;
+    uint32_t next_ticket_ = 0;
+    Waiter waiters_[USB_ARBITER_WAITERS];
+
+    // Области, которые видел хост
+    uint32_t region_shift_ = 0;
+    uint32_t host_regions_[(USB_ARBITER_REGIONS + 31) / 32] = {};
+    bool host_any_ = false;
+
+    ChangeFn change_callback_ = nullptr;
+    void* change_context_ = nullptr;
+    ArbiterStats stats_{};
+};
+
+}  // namespace usb
@@ -0,0 +1,136 @@
+/**
+ * @file usb_cache.h
+ * @brief Когерентность D-cache Cortex-M7 для DMA буферов и настройка MPU
+ *
+ * С включённым D-cache (SCB_EnableDCache) CPU и DMA видят память по-разному:
+ * - перед передачей память → периферия строки кэша нужно записать (Clean);
+ * - перед приёмом периферия → память — записать и выбросить (CleanInvalidate),
+ *   чтобы вытеснение грязной строки не затёрло принятые данные;
+ * - после приёма — выбросить (Invalidate), чтобы CPU прочитал данные DMA.
+ *
+ * Операции работают строками по 32 байта: диапазон расширяется до границ
+ * строк. Буфер DMA должен занимать целые строки — иначе Invalidate выбросит
+ * соседние данные. Для этого DmaBuffer<N> (alignas(32), N кратно 32).
+ *
+ * Альтернатива — секция .dma_buffer вне кэша: ConfigureNonCacheable() делает
+ * регион MPU Normal non-cacheable (см. linker/stm32h7_dma_section.ld), тогда
+ * обслуживание кэша для буферов в ней не нужно.
+ *
+ * Без D-cache (native, Cortex-M4, кэш выключен) операции ничего не делают,
+ * но учитываются в GetCacheStats().
+ *
+ * @code
+ * usb::cache::DmaBuffer<512> rx;
+ * usb::cache::PrepareRx(rx.data, sizeof(rx.data));
+ * StartDmaRead(rx.data);
+ * WaitDmaDone();
+ * usb::cache::CompleteRx(rx.data, sizeof(rx.data));
+ * @endcode
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace usb {
+namespace cache {
+
+/// Строка D-cache Cortex-M7, байт
+static constexpr uint32_t kLineSize = 32;
+
+/// Размер, округлённый вверх до целых строк кэша
+constexpr uint32_t LineAlignUp(uint32_t size) {
+    return (size + kLineSize - 1) & ~(kLineSize - 1);
+}
+
+/// Диапазон занимает целые строки (начало и размер кратны kLineSize)
+inline bool IsLineAligned(const void* addr, uint32_t size) {
+    return (reinterpret_cast<uintptr_t>(addr) % kLineSize) == 0 && (size % kLineSize) == 0;
+}
+
+/**
+ * @brief Буфер DMA целыми строками кэша
+ * @tparam kSize Размер, байт (кратен kLineSize)
+ */
+template <uint32_t kSize>
+struct alignas(kLineSize) DmaBuffer {
+    static_assert(kSize > 0 && kSize % kLineSize == 0,
+                  "DmaBuffer size must be a multiple of the cache line");
+
+    uint8_t data[kSize];
+
+    static constexpr uint32_t Size() { return kSize; }
+};
+
+/// Счётчики операций (диагностика и тесты)
+struct CacheStats {
+    uint32_t clean = 0;             ///< Clean / PrepareTx
+    uint32_t invalidate = 0;        ///< Invalidate / CompleteRx
+    uint32_t clean_invalidate = 0;  ///< CleanInvalidate / PrepareRx
+    uint32_t bytes = 0;             ///< Байт по границам строк, всего
+};
+
+// ============ Обслуживание по диапазону ============
+
+/// D-cache включён (SCB->CCR.DC); без D-cache — false
+bool IsEnabled();
+
+/// Записать грязные строки диапазона в память
+void Clean(const void* addr, uint32_t size);
+
+/// Выбросить строки диапазона (данные в кэше теряются)
+void Invalidate(void* addr, uint32_t size);
+
+/// Записать и выбросить строки диапазона
+void CleanInvalidate(void* addr, uint32_t size);
+
+/// Перед передачей память → периферия
+inline void PrepareTx(const void* addr, uint32_t size) {
+    Clean(addr, size);
+}
+
+/// Перед приёмом периферия → память
+inline void PrepareRx(void* addr, uint32_t size) {
+    CleanInvalidate(addr, size);
+}
+
+/// После приёма, до чтения буфера CPU
+inline void CompleteRx(void* addr, uint32_t size) {
+    Invalidate(addr, size);
+}
+
+CacheStats GetCacheStats();
+void ResetCacheStats();
+
+// ============ MPU ============
+
+/**
+ * @brief Поле SIZE региона MPU для размера в байтах
+ * @return log2(size) - 1; 0 если size не степень двойки или меньше 32
+ */
+constexpr uint8_t MpuRegionSizeField(uint32_t size) {
+    if (size < 32 || (size & (size - 1)) != 0) {
+        return 0;
+    }
+    uint8_t log2 = 0;
+    while ((1ULL << log2) < size) {
+        log2++;
+    }
+    return static_cast<uint8_t>(log2 - 1);
+}
+
+/**
+ * @brief Регион MPU: Normal, non-cacheable, non-shareable, без исполнения
+ *
+ * Вызывать до SCB_EnableDCache(). MPU включается с PRIVDEFENA — остальная
+ * память остаётся с атрибутами по умолчанию.
+ *
+ * @param region Номер региона (0..15; старшие номера имеют приоритет)
+ * @param base Начало, выровнено на size
+ * @param size Степень двойки от 32 байт
+ * @return false если base/size недопустимы (MPU не трогается)
+ */
+bool ConfigureNonCacheable(uint8_t region, uintptr_t base, uint32_t size);
+
+}  // namespace cache
+}  // namespace usb
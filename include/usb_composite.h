@@ -9,6 +9,10 @@
  * Активация через флаги компиляции:
  * - USB_CDC_ENABLED: включает CDC (COM порт)
  * - USB_MSC_ENABLED: включает MSC (флешка)
+ * - USB_VENDOR_ENABLED: vendor bulk интерфейс для WinUSB / libusb (см. usb_vendor.h)
+ * - USB_DFU_ENABLED: DFU runtime и режим DFU с записью во flash (см. usb_dfu.h)
+ * - USB_PROFILE_ENABLED: пробы латентности горячего пути (см. usb_profile.h)
+ * - USB_RTOS_ENABLED: задачи USB и хранилища на RTOS (см. UsbDevice::StartTasks())
  * 
  * @note Требует TinyUSB (подключается отдельно)
  * @note Для некоторых плат требуется toggle D+ пина для запуска USB
@@ -45,14 +49,39 @@
 #include <cstdint>
 #include <cstddef>
 
+#include "usb_descriptors.h"
+#include "usb_profile.h"
+
+#ifdef USB_RTOS_ENABLED
+#include "ports/IRtos.hpp"
+#endif
+
 // Используем единый интерфейс IBlockDevice из ports
+#ifdef USB_CDC_ENABLED
+#include "usb_fmt.h"
+#endif
+
 #ifdef USB_MSC_ENABLED
 #include "ports/IBlockDevice.hpp"
+#include "usb_msc_binding.h"
+#include "usb_msc_trace.h"
+#endif
+
+#ifdef USB_VENDOR_ENABLED
+#include "usb_vendor.h"
+#endif
+
+#ifdef USB_RPC_ENABLED
+#include "usb_rpc.h"
+#endif
+
+#ifdef USB_DFU_ENABLED
+#include "usb_dfu.h"
 #endif
 
 // Проверка что хотя бы один модуль включён
-#if !defined(USB_CDC_ENABLED) && !defined(USB_MSC_ENABLED)
-#warning "USB Composite: ни CDC, ни MSC не включены. Определите USB_CDC_ENABLED и/или USB_MSC_ENABLED"
+#if !defined(USB_CDC_ENABLED) && !defined(USB_MSC_ENABLED) && !defined(USB_VENDOR_ENABLED)
+#warning "USB Composite: ни CDC, ни MSC, ни vendor не включены. Определите USB_CDC_ENABLED и/или USB_MSC_ENABLED"
 #endif
 
 namespace usb {
@@ -86,6 +115,9 @@ constexpr uint8_t PORT_F = 5;
 constexpr uint8_t PORT_G = 6;
 constexpr uint8_t PORT_H = 7;
 
+/// Число ядер USB OTG (rhport 0 = OTG_FS, 1 = OTG_HS — нумерация TinyUSB dwc2)
+constexpr uint8_t kMaxRhports = 2;
+
 #ifdef USB_MSC_ENABLED
 /// Алиас для совместимости: используем единый IBlockDevice из ports
 using IBlockDevice = ports::IBlockDevice;
@@ -97,8 +129,54 @@ struct UsbDiagnostics {
     uint32_t usb_base_addr = 0;    ///< Базовый адрес USB OTG
     uint32_t gccfg = 0;            ///< Регистр GCCFG после инициализации
     uint32_t gotgctl = 0;          ///< Регистр GOTGCTL после инициализации
+    uint32_t string_arena_used = 0;  ///< Слов арены строк (USB_DESC_STRING_ARENA)
 };
 
+#ifdef USB_MSC_ENABLED
+/// Число LUN MSC (TinyUSB по умолчанию — один диск)
+static constexpr uint8_t kMscLunCount = 1;
+
+/**
+ * @brief Статистика MSC одной LUN (снимок, POD)
+ * 
+ * Счётчики обновляются из TinyUSB callbacks relaxed-атомиками,
+ * снимок можно брать из любого контекста. Поля снимка между собой
+ * не синхронизированы (допустимо для диагностики).
+ */
+struct MscStats {
+    uint32_t commands = 0;           ///< Завершённых SCSI команд (CSW)
+    uint32_t read_commands = 0;      ///< READ10
+    uint32_t write_commands = 0;     ///< WRITE10
+    uint32_t blocks_read = 0;
+    uint32_t blocks_written = 0;
+    uint32_t sequential_reads = 0;   ///< READ10 с LBA сразу за предыдущим READ10
+    uint32_t random_reads = 0;
+    uint32_t sequential_writes = 0;  ///< WRITE10 с LBA сразу за предыдущим WRITE10
+    uint32_t random_writes = 0;
+    uint32_t read_errors = 0;        ///< read10 callback вернул ошибку
+    uint32_t write_errors = 0;       ///< write10 callback вернул ошибку
+    uint32_t not_ready = 0;          ///< TEST UNIT READY → не готов
+    uint32_t sense_count[16] = {};   ///< Выставленные sense, по sense key
+    uint8_t last_sense_key = 0;
+    uint8_t last_sense_asc = 0;
+    uint8_t last_sense_ascq = 0;
+    LatencyHistogram read_latency;   ///< READ10 от первого callback до CSW, мкс
+    LatencyHistogram write_latency;  ///< WRITE10 от первого callback до CSW, мкс
+};
+#endif
+
+#ifdef USB_VENDOR_ENABLED
+/// Статистика vendor интерфейса (снимок, POD)
+struct VendorStats {
+    uint32_t rx_bytes = 0;       ///< Принято в кольцо RX
+    uint32_t rx_buffers = 0;     ///< Заполнено буферов RX
+    uint32_t rx_ring_full = 0;   ///< Кольцо RX заполнено — данные ждали в FIFO (NAK хосту)
+    uint32_t tx_bytes = 0;       ///< Передано из кольца TX в FIFO TinyUSB
+    uint32_t tx_buffers = 0;     ///< Поставлено буферов TX
+    uint32_t tx_ring_full = 0;   ///< VendorAcquireTx() без свободного буфера
+};
+#endif
+
 /// Конфигурация USB устройства
 struct Config {
     /// Пин D+ для ручного переподключения (опционально)
@@ -108,26 +186,76 @@ struct Config {
     /// Длительность toggle D+ в мс (0 = не делать toggle)
     uint32_t dp_toggle_ms = 10;
     
-    /// VID устройства (по умолчанию ST Microelectronics)
-    uint16_t vid = 0x0483;
+    /// VID устройства (по умолчанию USB_VID, ST Microelectronics)
+    uint16_t vid = USB_VID;
     
-    /// PID устройства (0x5743 = CDC+MSC Composite)
-    uint16_t pid = 0x5743;
+    /// PID устройства (по умолчанию USB_PID, 0x5743 = CDC+MSC Composite)
+    uint16_t pid = USB_PID;
     
-    /// Строка производителя
-    const char* manufacturer = "STM32";
+    /// Строка производителя, UTF-8 (копируется в Init())
+    const char* manufacturer = USB_STR_MANUFACTURER;
     
-    /// Строка продукта
-    const char* product = "USB Composite";
+    /// Строка продукта, UTF-8 (копируется в Init())
+    const char* product = USB_STR_PRODUCT;
     
-    /// Серийный номер (nullptr = использовать UID чипа)
+    /// Серийный номер (nullptr = UID чипа в hex, без UID — USB_STR_SERIAL)
     const char* serial = nullptr;
+    
+    /// Ядро USB: 0 = OTG_FS (PA11/PA12), 1 = OTG_HS со встроенным FS PHY (PB14/PB15)
+    /// Должно совпадать с BOARD_TUD_RHPORT: device стек TinyUSB 0.16 один на сборку
+    uint8_t rhport = 0;
 };
 
+/**
+ * @brief Счётчики цикла событий (снимок, POD)
+ * 
+ * По ним видно, сколько вызовов Process() прошли вхолостую и сколько
+ * времени main loop провёл во сне в WaitForEvent().
+ */
+struct EventLoopStats {
+    uint32_t interrupts = 0;      ///< Вызовов HandleInterrupt() (прерываний USB)
+    uint32_t process_calls = 0;   ///< Вызовов Process()
+    uint32_t task_runs = 0;       ///< Из них с tud_task() (были события)
+    uint32_t wait_calls = 0;      ///< Вызовов WaitForEvent()
+    uint32_t wait_timeouts = 0;   ///< Из них завершились по таймауту
+    uint32_t user_events = 0;     ///< Вызовов NotifyEvent()
+    uint32_t suspends = 0;        ///< Suspend шины хостом (tud_suspend_cb)
+    uint32_t resumes = 0;         ///< Resume шины (tud_resume_cb)
+    uint64_t sleep_ms = 0;        ///< Суммарное время в WaitForEvent(), мс
+};
+
+#ifdef USB_RTOS_ENABLED
+/**
+ * @brief Конфигурация задач RTOS режима
+ * 
+ * Задача USB блокируется на очереди событий TinyUSB (tud_task_ext),
+ * задача хранилища выполняет READ10/WRITE10 на IBlockDevice. Пока
+ * идёт медленная запись на SD, задача USB продолжает обслуживать CDC.
+ */
+struct RtosConfig {
+    /// Задача стека TinyUSB (приоритет выше хранилища)
+    ports::TaskParams usb_task = {"usb", 4096, 3};
+    
+    /// Задача ввода-вывода MSC
+    ports::TaskParams storage_task = {"usb_msc", 2048, 2};
+    
+    /// Ожидание задачи хранилища внутри read10/write10 callback, мс
+    /// (затем callback возвращает 0 и TinyUSB повторяет его)
+    uint32_t msc_wait_ms = 2;
+    
+    /// Пробуждение задачи USB без событий, мс (реакция на StopTasks)
+    uint32_t usb_poll_ms = 100;
+};
+#endif
+
 //--------------------------------------------------------------------+
 // Callback типы
 //--------------------------------------------------------------------+
 
+/// Callback suspend/resume шины (контекст tud_task: Process() или задача USB)
+/// @param suspended true — хост приостановил шину, false — возобновил
+using SuspendCallback = void(*)(bool suspended, void* context);
+
 #ifdef USB_CDC_ENABLED
 /// Callback при получении данных CDC
 /// @param data Указатель на данные
@@ -146,6 +274,12 @@ using DfuJumpCallback = void(*)(void* context);
 static constexpr uint32_t kDfuBaudrate = 1200;
 #endif
 
+#ifdef USB_MSC_ENABLED
+/// Callback START STOP UNIT с битом LoEj (из контекста TinyUSB)
+/// @param loaded true — хост загрузил носитель, false — извлёк (eject)
+using MscEjectCallback = void(*)(bool loaded, void* context);
+#endif
+
 //--------------------------------------------------------------------+
 // Основной класс USB устройства
 //--------------------------------------------------------------------+
@@ -154,14 +288,21 @@ static constexpr uint32_t kDfuBaudrate = 1200;
  * @brief USB Composite Device
  * 
  * Контракты:
- * - Init() вызывается один раз при старте
+ * - Init() вызывается один раз при старте; один экземпляр на rhport
+ *   (таблица экземпляров, см. Instance()), callbacks TinyUSB идут
+ *   в экземпляр порта device стека
  * - Start() после Init() для запуска USB
- * - Process() вызывать в main loop
+ * - Process() вызывать в main loop; без событий USB он сразу возвращается,
+ *   между вызовами можно спать в WaitForEvent()
+ * - RTOS (USB_RTOS_ENABLED): вместо Process() — StartTasks(); CDC методы
+ *   можно вызывать из любой задачи, callbacks — из задачи USB
  */
 class UsbDevice {
 public:
     UsbDevice() = default;
-    ~UsbDevice() = default;
+    
+    /// Освобождает rhport в таблице экземпляров (задачи RTOS останавливаются)
+    ~UsbDevice();
     
     // Запрет копирования
     UsbDevice(const UsbDevice&) = delete;
@@ -172,8 +313,8 @@ public:
     //----------------------------------------------------------------+
     
     /// Инициализация USB
-    /// @param config Конфигурация устройства
-    /// @return true если успешно
+    /// @param config Конфигурация устройства (VID/PID и строки дескрипторов)
+    /// @return true если успешно; false и при строках, не влезших в USB_DESC_STRING_ARENA
     bool Init(const Config& config = Config{});
     
     /// Запуск USB (подключение к хосту)
@@ -183,12 +324,53 @@ public:
     /// Остановка USB
     void Stop();
     
-    /// Обработка USB (вызывать в main loop)
+    /// Обработка USB (вызывать в main loop; при запущенных задачах RTOS — пусто)
+    /// Если с прошлого вызова не было прерываний и очередь TinyUSB пуста,
+    /// tud_task() не вызывается
     void Process();
     
+    /// Спать (WFI) до события USB, NotifyEvent() или таймаута
+    /// @param timeout_ms Предел ожидания (0 — только проверить)
+    /// @return true если есть событие (затем вызвать Process()), false по таймауту
+    /// @note Таймаут отсчитывается по SysTick (HAL_GetTick) — он же будит WFI
+    bool WaitForEvent(uint32_t timeout_ms);
+    
+    /// Пользовательское событие: разбудить WaitForEvent() (можно из прерывания)
+    void NotifyEvent();
+    
+    /// Обработчик прерывания USB: tud_int_handler(rhport) + отметка события
+    /// Вызывать из своего IRQ handler при USB_COMPOSITE_OWN_IRQ_HANDLERS
+    static void HandleInterrupt(uint8_t rhport = 0);
+    
+    /// Экземпляр, инициализированный на rhport (nullptr — нет)
+    static UsbDevice* Instance(uint8_t rhport);
+    
+    /// Снимок счётчиков цикла событий
+    EventLoopStats GetEventLoopStats() const;
+    
+    /// Сбросить счётчики цикла событий
+    void ResetEventLoopStats();
+    
+#ifdef USB_RTOS_ENABLED
+    /// Запустить задачи USB и хранилища (после Init(), вместо Process())
+    /// @param rtos Реализация RTOS (должна жить до StopTasks())
+    /// @return false если не инициализировано, уже запущено или RTOS не создала объекты
+    bool StartTasks(ports::IRtos& rtos, const RtosConfig& config = RtosConfig{});
+    
+    /// Остановить задачи и дождаться их выхода
+    /// @note Другие задачи не должны в это время обращаться к UsbDevice
+    void StopTasks();
+    
+    /// Задачи RTOS запущены
+    bool TasksRunning() const;
+#endif
+    
     /// Проверить инициализацию
     bool IsInitialized() const { return initialized_; }
     
+    /// Ядро USB экземпляра (Config::rhport)
+    uint8_t GetRhport() const { return config_.rhport; }
+    
     /// Проверить подключение к хосту
     bool IsConnected() const;
     
@@ -198,6 +380,16 @@ public:
     /// Получить диагностику инициализации (для отладки)
     UsbDiagnostics GetDiagnostics() const;
     
+    /**
+     * @brief Callback на suspend/resume шины, nullptr — отключить
+     *
+     * Вызывается из tud_suspend_cb / tud_resume_cb. В suspend устройство
+     * должно уложиться в ток 2.5 mA: погасить SD карту и тактирование
+     * периферии (SdmmcBlockDevice::UsbSuspendHook). В режиме RTOS callback
+     * вызывается под мьютексом MSC — операция задачи хранилища завершена.
+     */
+    void SetSuspendCallback(SuspendCallback callback, void* context = nullptr);
+    
     //----------------------------------------------------------------+
     // CDC методы (только если USB_CDC_ENABLED)
     //----------------------------------------------------------------+
@@ -215,8 +407,26 @@ public:
     /// Записать строку в CDC
     uint32_t CdcWrite(const char* str);
     
-    /// Записать с форматированием (printf-style)
+    /// Записать с форматированием (printf-style, vsnprintf, до 255 байт)
     uint32_t CdcPrintf(const char* fmt, ...);
+
+    /**
+     * @brief Форматированный вывод без vsnprintf и буфера строки (usb_fmt.h)
+     *
+     * Строка формата разбирается при сборке, куски пишутся прямо в TX FIFO
+     * под тем же мьютексом, что CdcWrite(), flush — в конце.
+     * @code
+     * g_usb.CdcFormat(USB_FMT("t={} v={:.3}\r\n"), HAL_GetTick(), millivolts);
+     * @endcode
+     * @return Количество записанных байт (FIFO заполнен — остаток строки отброшен,
+     *         выведено только её начало)
+     */
+    template <typename Format, typename... Args>
+    uint32_t CdcFormat(Format format, const Args&... args) {
+        CdcSink sink(*this);
+        fmt::Format(sink, format, args...);
+        return sink.Written();
+    }
     
     /// Прочитать данные из CDC
     /// @param buffer Буфер для данных
@@ -246,6 +456,27 @@ public:
     
     /// Сброс флага терминала (при переподключении USB)
     void CdcResetTerminalFlag();
+
+#ifdef USB_RPC_ENABLED
+    /**
+     * @brief Подключить RPC сервер к CDC
+     *
+     * Принятые данные остаются в RX FIFO (CdcSetRxCallback не вызывается)
+     * до RpcPoll(); ответы пишутся в CDC с ожиданием места в TX FIFO.
+     */
+    void RpcAttach(rpc::Server& server);
+
+    /// Отключить RPC сервер (CDC снова отдаёт данные в CdcSetRxCallback)
+    void RpcDetach();
+
+    /**
+     * @brief Выполнить запросы из RX FIFO (main loop или задача приложения)
+     * @return Байт передано серверу
+     *
+     * Не вызывать из callbacks TinyUSB: ответ может ждать TX FIFO через tud_task().
+     */
+    uint32_t RpcPoll();
+#endif
 #endif
 
     //----------------------------------------------------------------+
@@ -253,10 +484,17 @@ public:
     //----------------------------------------------------------------+
     
 #ifdef USB_MSC_ENABLED
-    /// Подключить блочное устройство к MSC
-    /// @param device Указатель на устройство (должен жить пока подключён)
+    /// Подключить блочное устройство к MSC через IBlockDevice (vtable)
+    /// @param device Указатель на устройство (должен жить пока подключён), nullptr — отключить
     void MscAttach(IBlockDevice* device);
     
+    /// Подключить устройство конкретного типа: вызовы без vtable, геометрия в кэше
+    /// @param device Устройство (должно жить пока подключено), см. usb_msc_binding.h
+    template <typename Device>
+    void MscAttach(Device& device) {
+        MscAttachBinding(MscBinding<Device>::Bind(device));
+    }
+    
     /// Отключить блочное устройство
     void MscDetach();
     
@@ -268,15 +506,136 @@ public:
     
     /// Эмулировать извлечение диска (eject)
     void MscEject();
+    
+    /**
+     * @brief Вернуть извлечённый носитель хосту
+     *
+     * Снимает MscEject() или eject хоста и сообщает UNIT ATTENTION 28h: хост
+     * перечитает том без переподключения устройства. Можно вызывать из любого
+     * контекста (SnapshotBlockDevice::SetRotateCallback()).
+     */
+    void MscInsert();
+    
+    /// Callback на eject/load от хоста (START STOP UNIT), nullptr — отключить
+    void MscSetEjectCallback(MscEjectCallback callback, void* context = nullptr);
+    
+    /**
+     * @brief Содержимое носителя изменилось в обход хоста
+     *
+     * Следующий TEST UNIT READY завершится UNIT ATTENTION (28h/00h, носитель
+     * мог смениться): хост сбросит кэш и перечитает том. Можно вызывать из
+     * любого контекста (BlockArbiter::SetChangeCallback()).
+     */
+    void MscMediaChanged();
+    
+    /// Снимок статистики MSC
+    /// @param lun Номер LUN (< kMscLunCount)
+    MscStats MscGetStats(uint8_t lun = 0) const;
+    
+    /// Сбросить статистику MSC (всех LUN)
+    void MscResetStats();
+    
+    /// Копия трассы SCSI команд (от старых к новым, требует USB_MSC_TRACE_ENABLED)
+    /// @return Число скопированных записей
+    uint32_t MscTraceSnapshot(MscTraceEntry* out, uint32_t max_entries) const;
+    
+    /// Всего команд, прошедших через трассу (включая затёртые)
+    uint32_t MscTraceTotal() const;
+    
+    /// Очистить трассу
+    void MscTraceClear();
+    
+    /// Выгрузить трассу в CSV (заголовок + строки от старых к новым)
+    /// @param write Приёмник текста (CDC, виртуальный файл, ...)
+    /// @return false если трасса выключена или приёмник прервал выгрузку
+    bool MscTraceDump(MscTraceWriteFn write, void* context) const;
+#ifdef USB_CDC_ENABLED
+    /// Выгрузить трассу в CSV через CDC
+    bool MscTraceDumpCdc();
+#endif
+#endif
+
+    //----------------------------------------------------------------+
+    // Vendor методы (только если USB_VENDOR_ENABLED)
+    //----------------------------------------------------------------+
+    
+#ifdef USB_VENDOR_ENABLED
+    /// Vendor интерфейс сконфигурирован хостом
+    bool VendorIsConnected() const;
+    
+    /// Свободный буфер кольца TX для заполнения на месте
+    /// @param capacity Размер буфера (USB_VENDOR_BUFFER_SIZE)
+    /// @return nullptr — все буферы ждут отправки
+    uint8_t* VendorAcquireTx(uint32_t* capacity);
+    
+    /// Поставить буфер из VendorAcquireTx() в очередь на отправку
+    /// @param len Заполнено байт (1..capacity)
+    bool VendorCommitTx(uint32_t len);
+    
+    /// Самый старый принятый буфер (читать на месте)
+    /// @param len Байт в буфере
+    /// @return nullptr — принятых данных нет
+    const uint8_t* VendorPeekRx(uint32_t* len);
+    
+    /// Вернуть буфер из VendorPeekRx() в кольцо RX
+    void VendorReleaseRx();
+    
+    /// Снимок статистики vendor интерфейса
+    VendorStats VendorGetStats() const;
+    
+    /// Сбросить статистику vendor интерфейса
+    void VendorResetStats();
+#endif
+
+    //----------------------------------------------------------------+
+    // DFU методы (только если USB_DFU_ENABLED)
+    //----------------------------------------------------------------+
+    
+#ifdef USB_DFU_ENABLED
+    /// Подключить приёмник образа (должен жить пока подключён); без него DNLOAD — errTARGET
+    void DfuAttach(DfuFlash& target);
+    
+    /// Отключить приёмник образа
+    void DfuDetach();
+    
+    /// Flash приёмника и отложенное переключение режима (main loop)
+    /// Переподключение выполняется здесь, а не в callback: ответ на DETACH успевает уйти
+    void DfuPoll();
+    
+    /// Переподключиться в режиме DFU (как по DFU_DETACH или 1200 bps)
+    void DfuEnterMode();
+    
+    /// Вернуться в рабочую конфигурацию (DETACH в режиме DFU, после манифестации)
+    void DfuLeaveMode();
+    
+    /// Устройство в режиме DFU (или переключается в него)
+    bool DfuIsActive() const;
 #endif
 
+    //----------------------------------------------------------------+
+    // Профилирование (пробы активны только с USB_PROFILE_ENABLED)
+    //----------------------------------------------------------------+
+    
+    /// Гистограмма латентности точки измерения (мкс, корзины log2)
+    const LatencyHistogram& GetLatencyHistogram(ProbePoint point) const;
+    
+    /// Сбросить все гистограммы
+    void ResetLatencyHistograms();
+    
+    /// Источник времени для проб
+    /// @param clock Часы с GetTickUs() (nullptr = DWT CYCCNT / std::chrono)
+    void SetProfileClock(const ports::IClock* clock);
+
 private:
     bool initialized_ = false;
     Config config_{};
     UsbDiagnostics diagnostics_{};
     
 #ifdef USB_MSC_ENABLED
-    IBlockDevice* msc_device_ = nullptr;
+    const void* msc_device_ = nullptr;
+    
+    /// Общая часть MscAttach(): геометрия и публикация для callbacks под MscMutex
+    void MscAttachBinding(const MscBindingState& binding);
 #endif
 
 #ifdef USB_CDC_ENABLED
@@ -286,6 +645,44 @@ private:
     void* cdc_lc_context_ = nullptr;
     DfuJumpCallback dfu_callback_ = nullptr;
     void* dfu_context_ = nullptr;
+
+    /// Приёмник CdcFormat(): куски в TX FIFO под CdcMutex, flush при разрушении
+    class CdcSink {
+    public:
+        explicit CdcSink(UsbDevice& usb) : usb_(usb), open_(usb.CdcBeginWrite()) {}
+        ~CdcSink() {
+            if (open_) {
+                usb_.CdcEndWrite();
+            }
+        }
+        CdcSink(const CdcSink&) = delete;
+        CdcSink& operator=(const CdcSink&) = delete;
+
+        void Put(const char* text, uint32_t len) {
+            if (!open_ || full_) {
+                return;
+            }
+            const uint32_t put = usb_.CdcPut(text, len);
+            written_ += put;
+            // FIFO освобождается передачей IN посреди вывода: после первого
+            // неполного куска — ничего, иначе хост получит строку с дырой
+            full_ = put < len;
+        }
+        uint32_t Written() const { return written_; }
+
+    private:
+        UsbDevice& usb_;
+        bool open_;
+        bool full_ = false;
+        uint32_t written_ = 0;
+    };
+
+    /// Захватить CdcMutex (false — не инициализирован, мьютекс не захвачен)
+    bool CdcBeginWrite();
+    /// Кусок в TX FIFO без flush (мьютекс захвачен)
+    uint32_t CdcPut(const char* data, uint32_t len);
+    /// Flush и освободить CdcMutex
+    void CdcEndWrite();
 #endif
 
     /// Toggle D+ пин для перезапуска USB
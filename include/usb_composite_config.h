@@ -8,6 +8,9 @@
  * Флаги управления:
  * - USB_CDC_ENABLED: включает CDC (Virtual COM Port)
  * - USB_MSC_ENABLED: включает MSC (Mass Storage)
+ * - USB_VENDOR_ENABLED: включает vendor bulk интерфейс (WinUSB / libusb)
+ * - USB_DFU_ENABLED: DFU runtime + DFU mode (обновление прошивки, см. usb_dfu.h)
+ * - USB_RTOS_ENABLED: RTOS режим (по умолчанию CFG_TUSB_OS = OPT_OS_FREERTOS)
  */
 
 #ifndef USB_COMPOSITE_CONFIG_H_
@@ -21,8 +24,8 @@ extern "C" {
 // Определение флагов по умолчанию
 //--------------------------------------------------------------------+
 
-// Если ничего не определено — включаем оба
-#if !defined(USB_CDC_ENABLED) && !defined(USB_MSC_ENABLED)
+// Если ничего не определено — включаем CDC и MSC
+#if !defined(USB_CDC_ENABLED) && !defined(USB_MSC_ENABLED) && !defined(USB_VENDOR_ENABLED)
 #define USB_CDC_ENABLED 1
 #define USB_MSC_ENABLED 1
 #endif
@@ -45,18 +48,23 @@ extern "C" {
 // Board Configuration
 //--------------------------------------------------------------------+
 
-// RHPort: 0 = OTG_FS (PA11/PA12 на STM32H7)
+// RHPort: 0 = OTG_FS (PA11/PA12 на STM32H7), 1 = OTG_HS (встроенный FS PHY, PB14/PB15)
+// Должен совпадать с usb::Config::rhport
 #ifndef BOARD_TUD_RHPORT
 #define BOARD_TUD_RHPORT      0
 #endif
 
-// Скорость: Full Speed для OTG_FS
+// Скорость: Full Speed (встроенный PHY; High Speed требует внешний ULPI)
 #ifndef BOARD_TUD_MAX_SPEED
 #define BOARD_TUD_MAX_SPEED   OPT_MODE_FULL_SPEED
 #endif
 
-// RHPort0 mode: Device Full Speed
+// Режим device на выбранном RHPort
+#if BOARD_TUD_RHPORT == 1
+#define CFG_TUSB_RHPORT1_MODE (OPT_MODE_DEVICE | BOARD_TUD_MAX_SPEED)
+#else
 #define CFG_TUSB_RHPORT0_MODE (OPT_MODE_DEVICE | OPT_MODE_FULL_SPEED)
+#endif
 
 //--------------------------------------------------------------------+
 // Common Configuration
@@ -67,10 +75,15 @@ extern "C" {
 #define CFG_TUSB_MCU          OPT_MCU_STM32H7
 #endif
 
-// OS: без RTOS
+// OS: без RTOS, либо FreeRTOS в режиме USB_RTOS_ENABLED
+// (tud_task() блокируется на очереди событий, tud_int_handler() — *FromISR)
 #ifndef CFG_TUSB_OS
+#ifdef USB_RTOS_ENABLED
+#define CFG_TUSB_OS           OPT_OS_FREERTOS
+#else
 #define CFG_TUSB_OS           OPT_OS_NONE
 #endif
+#endif
 
 // Debug level (0 = off)
 #ifndef CFG_TUSB_DEBUG
@@ -89,14 +102,21 @@ extern "C" {
 // Это позволяет работать без модификации linker script.
 // Буферы могут быть в любой RAM, т.к. USB контроллер работает через CPU.
 
+// Строка кэша Cortex-M7: EP буфер MSC целыми строками — SDMMC IDMA пишет в него
+// без промежуточной копии (SdmmcConfig::use_dma, usb_cache.h)
 #ifndef CFG_TUSB_MEM_ALIGN
-#define CFG_TUSB_MEM_ALIGN    __attribute__((aligned(4)))
+#define CFG_TUSB_MEM_ALIGN    __attribute__((aligned(32)))
 #endif
 
-// Не используем специальную секцию — slave mode не требует DMA-памяти
+// Slave mode не требует DMA-памяти; USB_ARENA_SECTION собирает буферы TinyUSB
+// в одну секцию с ареной библиотеки (usb_memory.h)
 #ifndef CFG_TUSB_MEM_SECTION
+#ifdef USB_ARENA_SECTION
+#define CFG_TUSB_MEM_SECTION  __attribute__((section(USB_ARENA_SECTION)))
+#else
 #define CFG_TUSB_MEM_SECTION
 #endif
+#endif
 
 // DWC2: ОБЯЗАТЕЛЬНО slave mode (без DMA) для работы без linker script
 // Slave mode работает медленнее, но не требует буферов в RAM_D2
@@ -124,6 +144,10 @@ extern "C" {
 #ifndef CFG_TUD_CDC_TX_BUFSIZE
 #define CFG_TUD_CDC_TX_BUFSIZE    512
 #endif
+// EP буферы CDC (как по умолчанию TinyUSB для Full Speed; явно — для usb_memory.h)
+#ifndef CFG_TUD_CDC_EP_BUFSIZE
+#define CFG_TUD_CDC_EP_BUFSIZE    64
+#endif
 #else
 #define CFG_TUD_CDC               0
 #endif
@@ -134,13 +158,57 @@ extern "C" {
 
 #ifdef USB_MSC_ENABLED
 #define CFG_TUD_MSC               1
+// Кусок READ10/WRITE10 на один callback (и один Read()/Write() устройства).
+// 512 — блок за вызов; 4096..65024 — несколько блоков одной командой SD.
+// Предел 65024: длина передачи usbd_edpt_xfer() в TinyUSB 0.16 — uint16_t
 #ifndef CFG_TUD_MSC_EP_BUFSIZE
 #define CFG_TUD_MSC_EP_BUFSIZE    512
 #endif
+#if (CFG_TUD_MSC_EP_BUFSIZE % 512) != 0 || CFG_TUD_MSC_EP_BUFSIZE < 512 || \
+    CFG_TUD_MSC_EP_BUFSIZE > 65024
+#error "CFG_TUD_MSC_EP_BUFSIZE must be a multiple of 512 in [512, 65024]"
+#endif
 #else
 #define CFG_TUD_MSC               0
 #endif
 
+//--------------------------------------------------------------------+
+// Vendor Configuration
+//--------------------------------------------------------------------+
+
+// FIFO vendor класса TinyUSB (между endpoint'ом и кольцом UsbDevice)
+#ifdef USB_VENDOR_ENABLED
+#define CFG_TUD_VENDOR            1
+#ifndef CFG_TUD_VENDOR_RX_BUFSIZE
+#define CFG_TUD_VENDOR_RX_BUFSIZE 512
+#endif
+#ifndef CFG_TUD_VENDOR_TX_BUFSIZE
+#define CFG_TUD_VENDOR_TX_BUFSIZE 512
+#endif
+#ifndef CFG_TUD_VENDOR_EPSIZE
+#define CFG_TUD_VENDOR_EPSIZE     64
+#endif
+#else
+#define CFG_TUD_VENDOR            0
+#endif
+
+//--------------------------------------------------------------------+
+// DFU Configuration
+//--------------------------------------------------------------------+
+
+// Runtime — интерфейс в рабочей конфигурации, DFU — в конфигурации режима DFU
+#ifdef USB_DFU_ENABLED
+#define CFG_TUD_DFU_RUNTIME       1
+#define CFG_TUD_DFU               1
+#ifndef USB_DFU_TRANSFER_SIZE
+#define USB_DFU_TRANSFER_SIZE     1024
+#endif
+#define CFG_TUD_DFU_XFER_BUFSIZE  USB_DFU_TRANSFER_SIZE
+#else
+#define CFG_TUD_DFU_RUNTIME       0
+#define CFG_TUD_DFU               0
+#endif
+
 //--------------------------------------------------------------------+
 // Неиспользуемые классы
 //--------------------------------------------------------------------+
@@ -153,10 +221,6 @@ extern "C" {
 #define CFG_TUD_MIDI              0
 #endif
 
-#ifndef CFG_TUD_VENDOR
-#define CFG_TUD_VENDOR            0
-#endif
-
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,833 @@
+/**
+ * @file usb_descriptors.h
+ * @brief Сборка USB дескрипторов на этапе компиляции (C++17 constexpr)
+ *
+ * Функции перечисляются списком типов, билдер сам назначает номера
+ * интерфейсов и endpoint'ов, считает длины и выдаёт std::array для flash:
+ *
+ * ```cpp
+ * using Composite = usb::desc::Configuration<usb::desc::Cdc<4>, usb::desc::Msc<5>>;
+ * static constexpr auto kConfig = Composite::Build();   // 9 + 66 + 23 байт
+ * static_assert(Composite::Interface<1>() == 2);        // MSC после двух интерфейсов CDC
+ * ```
+ *
+ * Порядок назначения (совпадает с прежними ручными номерами):
+ * - интерфейсы — подряд с 0
+ * - endpoint'ы — номера подряд с 1; CDC занимает два номера
+ *   (notification IN n, data OUT/IN n+1), MSC и vendor — один (OUT/IN n)
+ *
+ * Бюджет проверяется static_assert при сборке:
+ * - USB_DESC_EP_MAX: endpoint'ов ядра, включая EP0 (по умолчанию 9, OTG_FS STM32H7)
+ * - USB_DESC_FIFO_BYTES: FIFO ядра (по умолчанию 4096); расход считается
+ *   как в TinyUSB dwc2: общий RX FIFO + по TX FIFO на каждый IN endpoint
+ *
+ * Для vendor интерфейса (USB_VENDOR_ENABLED) собираются BOS и набор
+ * Microsoft OS 2.0 (MsOs20Set): Windows 8.1+ привязывает интерфейс к WinUSB
+ * без INF, libusb работает поверх WinUSB без Zadig.
+ *
+ * Строковые дескрипторы кодируются в UTF-16 один раз: строки из макросов
+ * (USB_STR_*) — при компиляции, строки из usb::Config и серийный номер из UID
+ * чипа — в UsbDevice::Init() в арену StringTable (USB_DESC_STRING_ARENA слов).
+ *
+ * Без зависимостей от TinyUSB — тестируется в native окружении.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+#ifndef USB_DESC_EP_MAX
+#define USB_DESC_EP_MAX 9
+#endif
+
+#ifndef USB_DESC_FIFO_BYTES
+#define USB_DESC_FIFO_BYTES 4096
+#endif
+
+#ifndef USB_DESC_STRING_ARENA
+#define USB_DESC_STRING_ARENA 128  // Слов UTF-16 для строк из Config и UID
+#endif
+
+// VID/PID и строки по умолчанию (можно переопределить через build_flags)
+#ifndef USB_VID
+#define USB_VID   0x0483  // ST Microelectronics
+#endif
+
+#ifndef USB_PID
+#define USB_PID   0x5743  // CDC + MSC Composite
+#endif
+
+#ifndef USB_BCD
+#ifdef USB_VENDOR_ENABLED
+#define USB_BCD   0x0210  // USB 2.1: хост запрашивает BOS (MS OS 2.0)
+#else
+#define USB_BCD   0x0200  // USB 2.0
+#endif
+#endif
+
+#ifndef USB_STR_MANUFACTURER
+#define USB_STR_MANUFACTURER "STM32"
+#endif
+
+#ifndef USB_STR_PRODUCT
+#define USB_STR_PRODUCT "USB Composite"
+#endif
+
+#ifndef USB_STR_SERIAL
+#define USB_STR_SERIAL "123456"  // Если UID чипа недоступен
+#endif
+
+#ifndef USB_STR_CDC
+#define USB_STR_CDC "CDC Port"
+#endif
+
+#ifndef USB_STR_MSC
+#define USB_STR_MSC "Storage"
+#endif
+
+#ifndef USB_STR_VENDOR
+#define USB_STR_VENDOR "Stream"
+#endif
+
+#ifndef USB_STR_DFU
+#define USB_STR_DFU "Firmware Update"
+#endif
+
+// PID в режиме DFU (другой состав интерфейсов — другой PID, иначе Windows берёт старый драйвер)
+#ifndef USB_DFU_PID
+#define USB_DFU_PID 0x5744
+#endif
+
+// DeviceInterfaceGUID vendor интерфейса (по нему хост находит устройство через WinUSB)
+#ifndef USB_VENDOR_GUID
+#define USB_VENDOR_GUID "{7A1C3E52-9B4D-4F08-A6E3-2D5B8C901F47}"
+#endif
+
+// bRequest запроса набора MS OS 2.0 (любое значение, не занятое своими запросами)
+#ifndef USB_MS_VENDOR_CODE
+#define USB_MS_VENDOR_CODE 0x01
+#endif
+
+namespace usb::desc {
+
+static constexpr uint8_t kEndpointMax = USB_DESC_EP_MAX;
+static constexpr uint32_t kFifoBytes = USB_DESC_FIFO_BYTES;
+
+// Типы дескрипторов и коды классов (USB 2.0, CDC 1.2, MSC BOT)
+static constexpr uint8_t kTypeDevice = 0x01;
+static constexpr uint8_t kTypeConfiguration = 0x02;
+static constexpr uint8_t kTypeString = 0x03;
+static constexpr uint8_t kTypeInterface = 0x04;
+static constexpr uint8_t kTypeEndpoint = 0x05;
+static constexpr uint8_t kTypeIad = 0x0B;
+static constexpr uint8_t kTypeBos = 0x0F;
+static constexpr uint8_t kTypeDeviceCapability = 0x10;
+static constexpr uint8_t kTypeCsInterface = 0x24;
+static constexpr uint8_t kTypeDfuFunctional = 0x21;
+
+static constexpr uint8_t kClassCdc = 0x02;
+static constexpr uint8_t kClassCdcData = 0x0A;
+static constexpr uint8_t kClassMsc = 0x08;
+static constexpr uint8_t kClassMisc = 0xEF;
+static constexpr uint8_t kClassApplication = 0xFE;
+static constexpr uint8_t kClassVendor = 0xFF;
+
+static constexpr uint8_t kXferBulk = 0x02;
+static constexpr uint8_t kXferInterrupt = 0x03;
+static constexpr uint8_t kDirIn = 0x80;
+
+static constexpr size_t kDeviceLength = 18;
+static constexpr size_t kConfigHeaderLength = 9;
+
+/// Размер пакета bulk endpoint: 8..64 (Full Speed) или 512 (High Speed)
+constexpr bool IsBulkPacketSize(uint16_t size) {
+    return size == 8 || size == 16 || size == 32 || size == 64 || size == 512;
+}
+
+/// Последовательная запись байтов в массив (constexpr)
+class Writer {
+public:
+    constexpr explicit Writer(uint8_t* out) : out_(out) {}
+
+    constexpr void U8(uint8_t value) { out_[pos_++] = value; }
+
+    constexpr void U16(uint16_t value) {
+        U8(static_cast<uint8_t>(value & 0xFF));
+        U8(static_cast<uint8_t>(value >> 8));
+    }
+
+    constexpr void Interface(uint8_t number, uint8_t endpoints, uint8_t cls, uint8_t subclass,
+                             uint8_t protocol, uint8_t string_index) {
+        U8(9);
+        U8(kTypeInterface);
+        U8(number);
+        U8(0);  // bAlternateSetting
+        U8(endpoints);
+        U8(cls);
+        U8(subclass);
+        U8(protocol);
+        U8(string_index);
+    }
+
+    constexpr void Endpoint(uint8_t address, uint8_t attributes, uint16_t size, uint8_t interval) {
+        U8(7);
+        U8(kTypeEndpoint);
+        U8(address);
+        U8(attributes);
+        U16(size);
+        U8(interval);
+    }
+
+    constexpr size_t Position() const { return pos_; }
+
+private:
+    uint8_t* out_;
+    size_t pos_ = 0;
+};
+
+//--------------------------------------------------------------------+
+// Функции (классы)
+//--------------------------------------------------------------------+
+
+/**
+ * @brief Описание функции для Configuration
+ *
+ * Каждый тип задаёт:
+ * - kInterfaces, kEndpointNumbers — сколько номеров занимает
+ * - kInEndpoints, kMaxOutPacket, kInFifoBytes — для проверки FIFO
+ * - kLength — длина дескрипторов функции
+ * - kUsesIad — функция из нескольких интерфейсов (устройство — Misc/IAD)
+ * - Emit(writer, interface, endpoint) — запись дескрипторов
+ */
+
+/// Пустая функция (заглушка для выключенного флагом класса)
+struct None {
+    static constexpr uint8_t kInterfaces = 0;
+    static constexpr uint8_t kEndpointNumbers = 0;
+    static constexpr uint8_t kInEndpoints = 0;
+    static constexpr uint16_t kMaxOutPacket = 0;
+    static constexpr uint32_t kInFifoBytes = 0;
+    static constexpr size_t kLength = 0;
+    static constexpr bool kUsesIad = false;
+
+    static constexpr void Emit(Writer&, uint8_t, uint8_t) {}
+};
+
+/**
+ * @brief CDC ACM (IAD + control + data интерфейсы)
+ * @tparam kString Индекс строки интерфейса
+ * @tparam kPacket Размер пакета data endpoint'ов
+ * @tparam kNotifyPacket Размер пакета notification endpoint
+ */
+template <uint8_t kString, uint16_t kPacket = 64, uint16_t kNotifyPacket = 8>
+struct Cdc {
+    static_assert(IsBulkPacketSize(kPacket), "CDC data endpoint: invalid bulk packet size");
+    static_assert(kNotifyPacket > 0 && kNotifyPacket <= 64, "CDC notification packet size");
+
+    static constexpr uint8_t kInterfaces = 2;
+    static constexpr uint8_t kEndpointNumbers = 2;
+    static constexpr uint8_t kInEndpoints = 2;
+    static constexpr uint16_t kMaxOutPacket = kPacket;
+    static constexpr uint32_t kInFifoBytes = kPacket + kNotifyPacket;
+    static constexpr size_t kLength = 66;
+    static constexpr bool kUsesIad = true;
+
+    static constexpr void Emit(Writer& w, uint8_t itf, uint8_t ep) {
+        const uint8_t notify_ep = static_cast<uint8_t>(kDirIn | ep);
+        const uint8_t data_ep = static_cast<uint8_t>(ep + 1);
+
+        // Interface Association
+        w.U8(8);
+        w.U8(kTypeIad);
+        w.U8(itf);
+        w.U8(2);
+        w.U8(kClassCdc);
+        w.U8(0x02);  // Abstract Control Model
+        w.U8(0x00);
+        w.U8(0);
+        // Control интерфейс
+        w.Interface(itf, 1, kClassCdc, 0x02, 0x00, kString);
+        // Header, Call Management, ACM (line coding + break), Union
+        w.U8(5);
+        w.U8(kTypeCsInterface);
+        w.U8(0x00);
+        w.U16(0x0120);
+        w.U8(5);
+        w.U8(kTypeCsInterface);
+        w.U8(0x01);
+        w.U8(0);
+        w.U8(static_cast<uint8_t>(itf + 1));
+        w.U8(4);
+        w.U8(kTypeCsInterface);
+        w.U8(0x02);
+        w.U8(6);
+        w.U8(5);
+        w.U8(kTypeCsInterface);
+        w.U8(0x06);
+        w.U8(itf);
+        w.U8(static_cast<uint8_t>(itf + 1));
+        w.Endpoint(notify_ep, kXferInterrupt, kNotifyPacket, 16);
+        // Data интерфейс
+        w.Interface(static_cast<uint8_t>(itf + 1), 2, kClassCdcData, 0, 0, 0);
+        w.Endpoint(data_ep, kXferBulk, kPacket, 0);
+        w.Endpoint(static_cast<uint8_t>(kDirIn | data_ep), kXferBulk, kPacket, 0);
+    }
+};
+
+/// Bulk функция из одного интерфейса с парой OUT/IN endpoint'ов
+template <uint8_t kClass, uint8_t kSubclass, uint8_t kProtocol, uint8_t kString,
+          uint16_t kPacket>
+struct BulkPair {
+    static_assert(IsBulkPacketSize(kPacket), "Bulk endpoint: invalid packet size");
+
+    static constexpr uint8_t kInterfaces = 1;
+    static constexpr uint8_t kEndpointNumbers = 1;
+    static constexpr uint8_t kInEndpoints = 1;
+    static constexpr uint16_t kMaxOutPacket = kPacket;
+    static constexpr uint32_t kInFifoBytes = kPacket;
+    static constexpr size_t kLength = 23;
+    static constexpr bool kUsesIad = false;
+
+    static constexpr void Emit(Writer& w, uint8_t itf, uint8_t ep) {
+        w.Interface(itf, 2, kClass, kSubclass, kProtocol, kString);
+        w.Endpoint(ep, kXferBulk, kPacket, 0);
+        w.Endpoint(static_cast<uint8_t>(kDirIn | ep), kXferBulk, kPacket, 0);
+    }
+};
+
+/// MSC Bulk-Only Transport, SCSI transparent
+template <uint8_t kString, uint16_t kPacket = 64>
+using Msc = BulkPair<kClassMsc, 0x06, 0x50, kString, kPacket>;
+
+/// Vendor-specific интерфейс (WinUSB / libusb)
+template <uint8_t kString, uint16_t kPacket = 64>
+using Vendor = BulkPair<kClassVendor, 0x00, 0x00, kString, kPacket>;
+
+// Протокол интерфейса DFU (DFU 1.1, 4.1 и 4.2)
+static constexpr uint8_t kDfuProtocolRuntime = 0x01;
+static constexpr uint8_t kDfuProtocolMode = 0x02;
+
+/**
+ * @brief DFU 1.1: интерфейс без endpoint'ов (всё через EP0) + функциональный дескриптор
+ * @tparam kString Индекс строки интерфейса
+ * @tparam kProtocol kDfuProtocolRuntime (в составе приложения) или kDfuProtocolMode
+ * @tparam kAttributes bmAttributes (bitCanDnload, bitCanUpload, bitManifestationTolerant,
+ *         bitWillDetach)
+ * @tparam kTransferSize wTransferSize — наибольший блок DNLOAD/UPLOAD
+ * @tparam kDetachTimeoutMs wDetachTimeOut
+ */
+template <uint8_t kString, uint8_t kProtocol, uint8_t kAttributes, uint16_t kTransferSize,
+          uint16_t kDetachTimeoutMs = 1000>
+struct Dfu {
+    static_assert(kProtocol == kDfuProtocolRuntime || kProtocol == kDfuProtocolMode,
+                  "DFU protocol: runtime (1) or DFU mode (2)");
+    static_assert(kTransferSize >= 64, "DFU wTransferSize below EP0 packet");
+
+    static constexpr uint8_t kInterfaces = 1;
+    static constexpr uint8_t kEndpointNumbers = 0;
+    static constexpr uint8_t kInEndpoints = 0;
+    static constexpr uint16_t kMaxOutPacket = 0;
+    static constexpr uint32_t kInFifoBytes = 0;
+    static constexpr size_t kLength = 18;
+    static constexpr bool kUsesIad = false;
+
+    static constexpr void Emit(Writer& w, uint8_t itf, uint8_t) {
+        w.Interface(itf, 0, kClassApplication, 0x01, kProtocol, kString);
+        w.U8(9);
+        w.U8(kTypeDfuFunctional);
+        w.U8(kAttributes);
+        w.U16(kDetachTimeoutMs);
+        w.U16(kTransferSize);
+        w.U16(0x0110);  // bcdDFUVersion
+    }
+};
+
+//--------------------------------------------------------------------+
+// Конфигурация
+//--------------------------------------------------------------------+
+
+/**
+ * @brief Оценка расхода FIFO ядра, байты (модель TinyUSB dwc2)
+ *
+ * RX FIFO — общий: 15 + 2 * (max OUT пакет / 4) + 2 * число endpoint'ов (слова),
+ * TX FIFO — по пакету на каждый IN endpoint, включая EP0.
+ */
+template <typename... Functions>
+constexpr uint32_t FifoUsage() {
+    uint16_t max_out = 64;  // EP0
+    for (uint16_t packet : {Functions::kMaxOutPacket...}) {
+        max_out = packet > max_out ? packet : max_out;
+    }
+    const uint32_t ep_count = 1u + (0u + ... + Functions::kEndpointNumbers);
+    const uint32_t rx_words = 15 + 2 * (max_out / 4u) + 2 * ep_count;
+    const uint32_t tx_bytes = 64 + (0u + ... + Functions::kInFifoBytes);
+    return rx_words * 4 + tx_bytes;
+}
+
+/// Параметры конфигурационного дескриптора
+struct ConfigParams {
+    uint8_t attributes = 0x00;  ///< Self powered (0x40) / remote wakeup (0x20)
+    uint16_t power_ma = 100;
+    uint8_t string_index = 0;
+};
+
+/**
+ * @brief Конфигурация из списка функций
+ * @tparam Functions Cdc<>, Msc<>, Vendor<>, Dfu<>, None
+ */
+template <typename... Functions>
+struct Configuration {
+    static_assert(sizeof...(Functions) > 0, "Configuration needs at least one function");
+
+    static constexpr size_t kFunctionCount = sizeof...(Functions);
+    static constexpr uint8_t kInterfaceCount = (0 + ... + Functions::kInterfaces);
+    static constexpr uint8_t kEndpointNumbers = (0 + ... + Functions::kEndpointNumbers);
+    static constexpr size_t kLength = kConfigHeaderLength + (0 + ... + Functions::kLength);
+    static constexpr bool kUsesIad = (false || ... || Functions::kUsesIad);
+
+    static constexpr uint32_t kFifoUsage = FifoUsage<Functions...>();
+
+    static_assert(kLength <= 0xFFFF, "Configuration descriptor too long");
+    static_assert(1 + kEndpointNumbers <= kEndpointMax,
+                  "Endpoint budget exceeded (USB_DESC_EP_MAX, EP0 included)");
+    static_assert(kFifoUsage <= kFifoBytes, "FIFO budget exceeded (USB_DESC_FIFO_BYTES)");
+
+    using Array = std::array<uint8_t, kLength>;
+
+    /// Первый интерфейс функции с индексом kIndex
+    template <size_t kIndex>
+    static constexpr uint8_t Interface() {
+        static_assert(kIndex < kFunctionCount, "Function index out of range");
+        return Prefix({Functions::kInterfaces...}, kIndex);
+    }
+
+    /// Первый номер endpoint'а функции с индексом kIndex (без бита направления)
+    template <size_t kIndex>
+    static constexpr uint8_t Endpoint() {
+        static_assert(kIndex < kFunctionCount, "Function index out of range");
+        return static_cast<uint8_t>(1 + Prefix({Functions::kEndpointNumbers...}, kIndex));
+    }
+
+    /// Дескриптор конфигурации со всеми функциями
+    static constexpr Array Build(const ConfigParams& params = ConfigParams{}) {
+        Array out{};
+        Writer w(out.data());
+        w.U8(kConfigHeaderLength);
+        w.U8(kTypeConfiguration);
+        w.U16(static_cast<uint16_t>(kLength));
+        w.U8(kInterfaceCount);
+        w.U8(1);  // bConfigurationValue
+        w.U8(params.string_index);
+        w.U8(static_cast<uint8_t>(0x80 | params.attributes));
+        w.U8(static_cast<uint8_t>(params.power_ma / 2));
+
+        uint8_t itf = 0;
+        uint8_t ep = 1;
+        ((Functions::Emit(w, itf, ep), itf += Functions::kInterfaces,
+          ep += Functions::kEndpointNumbers), ...);
+        return out;
+    }
+
+private:
+    static constexpr uint8_t Prefix(std::initializer_list<uint8_t> counts, size_t index) {
+        uint8_t sum = 0;
+        size_t i = 0;
+        for (uint8_t count : counts) {
+            if (i++ == index) {
+                break;
+            }
+            sum = static_cast<uint8_t>(sum + count);
+        }
+        return sum;
+    }
+};
+
+//--------------------------------------------------------------------+
+// Device дескриптор
+//--------------------------------------------------------------------+
+
+/// Параметры device дескриптора
+struct DeviceParams {
+    uint16_t vid = 0x0483;
+    uint16_t pid = 0x5743;
+    uint16_t bcd_usb = 0x0200;
+    uint16_t bcd_device = 0x0100;
+    uint8_t ep0_size = 64;
+    uint8_t manufacturer_index = 1;
+    uint8_t product_index = 2;
+    uint8_t serial_index = 3;
+};
+
+/**
+ * @brief Device дескриптор для конфигурации
+ *
+ * Больше одного интерфейса или функция с IAD — класс Misc/IAD
+ * (0xEF/0x02/0x01), иначе класс задают интерфейсы (0/0/0).
+ */
+template <typename Config>
+constexpr std::array<uint8_t, kDeviceLength> BuildDevice(const DeviceParams& params) {
+    const bool composite = Config::kInterfaceCount > 1 || Config::kUsesIad;
+    std::array<uint8_t, kDeviceLength> out{};
+    Writer w(out.data());
+    w.U8(kDeviceLength);
+    w.U8(kTypeDevice);
+    w.U16(params.bcd_usb);
+    w.U8(composite ? kClassMisc : 0);
+    w.U8(composite ? 0x02 : 0);
+    w.U8(composite ? 0x01 : 0);
+    w.U8(params.ep0_size);
+    w.U16(params.vid);
+    w.U16(params.pid);
+    w.U16(params.bcd_device);
+    w.U8(params.manufacturer_index);
+    w.U8(params.product_index);
+    w.U8(params.serial_index);
+    w.U8(1);  // bNumConfigurations
+    return out;
+}
+
+/// Device дескриптор с другими VID/PID (остальные поля без изменений)
+constexpr std::array<uint8_t, kDeviceLength> WithIds(std::array<uint8_t, kDeviceLength> device,
+                                                     uint16_t vid, uint16_t pid) {
+    Writer w(device.data() + 8);
+    w.U16(vid);
+    w.U16(pid);
+    return device;
+}
+
+//--------------------------------------------------------------------+
+// BOS и Microsoft OS 2.0
+//--------------------------------------------------------------------+
+
+static constexpr size_t kBosLength = 5 + 28;  // Заголовок + Platform Capability
+
+/// wIndex запроса набора MS OS 2.0 (MS_OS_20_DESCRIPTOR_INDEX)
+static constexpr uint16_t kMsOs20DescriptorIndex = 7;
+
+/// dwWindowsVersion: Windows 8.1 (первая с MS OS 2.0)
+static constexpr uint32_t kMsOs20WindowsVersion = 0x06030000;
+
+/// Символов в строке GUID вида {XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}
+static constexpr size_t kGuidChars = 38;
+
+/// Строка GUID в фигурных скобках с дефисами на своих местах
+constexpr bool IsGuidString(const char* text) {
+    for (size_t i = 0; i < kGuidChars; i++) {
+        const char c = text[i];
+        const bool hex = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') ||
+                         (c >= 'a' && c <= 'f');
+        bool ok = hex;
+        if (i == 0) {
+            ok = c == '{';
+        } else if (i == kGuidChars - 1) {
+            ok = c == '}';
+        } else if (i == 9 || i == 14 || i == 19 || i == 24) {
+            ok = c == '-';
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return text[kGuidChars] == '\0';
+}
+
+/**
+ * @brief BOS дескриптор с Platform Capability MS OS 2.0
+ * @param set_length wTotalLength набора MS OS 2.0
+ * @param vendor_code bRequest, которым хост запросит набор
+ */
+constexpr std::array<uint8_t, kBosLength> BuildBos(uint16_t set_length, uint8_t vendor_code) {
+    // {D8DD60DF-4589-4CC7-9CD2-659D9E648A9F}, первые три поля little-endian
+    constexpr uint8_t kPlatformUuid[16] = {0xDF, 0x60, 0xDD, 0xD8, 0x89, 0x45, 0xC7, 0x4C,
+                                           0x9C, 0xD2, 0x65, 0x9D, 0x9E, 0x64, 0x8A, 0x9F};
+    std::array<uint8_t, kBosLength> out{};
+    Writer w(out.data());
+    w.U8(5);
+    w.U8(kTypeBos);
+    w.U16(static_cast<uint16_t>(kBosLength));
+    w.U8(1);  // bNumDeviceCaps
+    w.U8(28);
+    w.U8(kTypeDeviceCapability);
+    w.U8(0x05);  // Platform
+    w.U8(0);
+    for (uint8_t byte : kPlatformUuid) {
+        w.U8(byte);
+    }
+    w.U16(static_cast<uint16_t>(kMsOs20WindowsVersion & 0xFFFF));
+    w.U16(static_cast<uint16_t>(kMsOs20WindowsVersion >> 16));
+    w.U16(set_length);
+    w.U8(vendor_code);
+    w.U8(0);  // bAltEnumCode
+    return out;
+}
+
+/**
+ * @brief Набор дескрипторов Microsoft OS 2.0 для одной функции WinUSB
+ * @tparam Config Configuration<...>
+ * @tparam kFunction Индекс vendor функции в Config
+ *
+ * Состав: заголовок набора, для составного устройства — подмножества
+ * конфигурации и функции (первый интерфейс vendor функции), Compatible ID
+ * "WINUSB" и свойство реестра DeviceInterfaceGUIDs (REG_MULTI_SZ).
+ */
+template <typename Config, size_t kFunction>
+struct MsOs20Set {
+    /// Подмножества нужны, если Windows видит устройство составным (usbccgp)
+    static constexpr bool kSubsets = Config::kInterfaceCount > 1 || Config::kUsesIad;
+
+    static constexpr size_t kHeaderLength = 10;
+    static constexpr size_t kSubsetHeaderLength = 8;
+    static constexpr size_t kCompatibleIdLength = 20;
+    static constexpr size_t kPropertyNameBytes = 42;  // "DeviceInterfaceGUIDs\0" в UTF-16
+    static constexpr size_t kPropertyDataBytes = 2 * (kGuidChars + 2);  // GUID + "\0\0"
+    static constexpr size_t kPropertyLength = 10 + kPropertyNameBytes + kPropertyDataBytes;
+    static constexpr size_t kFunctionLength =
+        (kSubsets ? kSubsetHeaderLength : 0) + kCompatibleIdLength + kPropertyLength;
+    static constexpr size_t kLength =
+        kHeaderLength + (kSubsets ? kSubsetHeaderLength : 0) + kFunctionLength;
+
+    static_assert(kLength <= 0xFFFF, "MS OS 2.0 set too long");
+
+    using Array = std::array<uint8_t, kLength>;
+
+    /// Набор с DeviceInterfaceGUID guid (USB_VENDOR_GUID)
+    template <size_t N>
+    static constexpr Array Build(const char (&guid)[N]) {
+        static_assert(N == kGuidChars + 1, "GUID must look like {XXXXXXXX-XXXX-...}");
+        constexpr char kName[] = "DeviceInterfaceGUIDs";
+        static_assert(2 * sizeof(kName) == kPropertyNameBytes, "Property name length");
+
+        Array out{};
+        Writer w(out.data());
+        w.U16(kHeaderLength);
+        w.U16(0x0000);  // MS_OS_20_SET_HEADER_DESCRIPTOR
+        w.U16(static_cast<uint16_t>(kMsOs20WindowsVersion & 0xFFFF));
+        w.U16(static_cast<uint16_t>(kMsOs20WindowsVersion >> 16));
+        w.U16(static_cast<uint16_t>(kLength));
+
+        if constexpr (kSubsets) {
+            w.U16(kSubsetHeaderLength);
+            w.U16(0x0001);  // MS_OS_20_SUBSET_HEADER_CONFIGURATION
+            w.U8(0);        // Индекс конфигурации
+            w.U8(0);
+            w.U16(static_cast<uint16_t>(kSubsetHeaderLength + kFunctionLength));
+
+            w.U16(kSubsetHeaderLength);
+            w.U16(0x0002);  // MS_OS_20_SUBSET_HEADER_FUNCTION
+            w.U8(Config::template Interface<kFunction>());
+            w.U8(0);
+            w.U16(static_cast<uint16_t>(kFunctionLength));
+        }
+
+        w.U16(kCompatibleIdLength);
+        w.U16(0x0003);  // MS_OS_20_FEATURE_COMPATBLE_ID
+        const char kCompatibleId[8] = {'W', 'I', 'N', 'U', 'S', 'B', 0, 0};
+        for (char c : kCompatibleId) {
+            w.U8(static_cast<uint8_t>(c));
+        }
+        for (int i = 0; i < 8; i++) {
+            w.U8(0);  // SubCompatibleID
+        }
+
+        w.U16(kPropertyLength);
+        w.U16(0x0004);  // MS_OS_20_FEATURE_REG_PROPERTY
+        w.U16(0x0007);  // REG_MULTI_SZ
+        w.U16(kPropertyNameBytes);
+        for (size_t i = 0; i < sizeof(kName); i++) {
+            w.U16(static_cast<uint8_t>(kName[i]));
+        }
+        w.U16(kPropertyDataBytes);
+        for (size_t i = 0; i < kGuidChars; i++) {
+            w.U16(static_cast<uint8_t>(guid[i]));
+        }
+        w.U16(0);
+        w.U16(0);
+        return out;
+    }
+};
+
+//--------------------------------------------------------------------+
+// Строковые дескрипторы
+//--------------------------------------------------------------------+
+
+/// Символов в строковом дескрипторе (bLength = 2 + 2 * n <= 254)
+static constexpr size_t kMaxStringChars = 126;
+
+/// Индексов строк в StringTable: 0 (язык), 1-3 (device), 4+ (интерфейсы)
+static constexpr uint8_t kStringSlots = 8;
+
+// Индексы строк device дескриптора и интерфейсов
+static constexpr uint8_t kStrLanguage = 0;
+static constexpr uint8_t kStrManufacturer = 1;
+static constexpr uint8_t kStrProduct = 2;
+static constexpr uint8_t kStrSerial = 3;
+static constexpr uint8_t kStrCdc = 4;
+static constexpr uint8_t kStrMsc = 5;
+static constexpr uint8_t kStrVendor = 6;
+static constexpr uint8_t kStrDfu = 7;
+
+/**
+ * @brief UTF-8 → UTF-16 (только BMP), не более max_chars символов
+ * @param out Буфер символов или nullptr (только подсчёт)
+ * @return Число символов UTF-16
+ *
+ * Некорректные последовательности и символы вне BMP заменяются на '?'.
+ */
+constexpr size_t EncodeUtf16(const char* text, uint16_t* out, size_t max_chars) {
+    size_t count = 0;
+    size_t i = 0;
+    while (text[i] != '\0' && count < max_chars) {
+        const uint8_t lead = static_cast<uint8_t>(text[i]);
+        uint16_t code = '?';
+        size_t tail = 0;
+        if (lead < 0x80) {
+            code = lead;
+        } else if ((lead & 0xE0) == 0xC0) {
+            code = lead & 0x1F;
+            tail = 1;
+        } else if ((lead & 0xF0) == 0xE0) {
+            code = lead & 0x0F;
+            tail = 2;
+        }
+        i++;
+        for (size_t k = 0; k < tail; k++) {
+            const uint8_t next = static_cast<uint8_t>(text[i]);
+            if ((next & 0xC0) != 0x80) {
+                code = '?';  // Оборванная последовательность: начать с этого байта
+                break;
+            }
+            code = static_cast<uint16_t>((code << 6) | (next & 0x3F));
+            i++;
+        }
+        if (lead >= 0x80 && tail == 0) {
+            while ((static_cast<uint8_t>(text[i]) & 0xC0) == 0x80) {
+                i++;  // Пропустить продолжение 4-байтной последовательности
+            }
+        }
+        if (out != nullptr) {
+            out[count] = code;
+        }
+        count++;
+    }
+    return count;
+}
+
+/// Заголовок строкового дескриптора (bLength | bDescriptorType << 8)
+constexpr uint16_t StringHeader(size_t chars) {
+    return static_cast<uint16_t>((kTypeString << 8) | (2 * chars + 2));
+}
+
+/**
+ * @brief Строковый дескриптор из литерала (при компиляции)
+ *
+ * Размер массива — по байтам литерала (UTF-8 не короче UTF-16),
+ * bLength — по фактическому числу символов.
+ */
+template <size_t N>
+constexpr std::array<uint16_t, N> StringDescriptor(const char (&text)[N]) {
+    static_assert(N - 1 <= kMaxStringChars, "USB string too long");
+    std::array<uint16_t, N> out{};
+    const size_t chars = EncodeUtf16(text, out.data() + 1, N - 1);
+    out[0] = StringHeader(chars);
+    return out;
+}
+
+/// Дескриптор 0: список языков (English US)
+static constexpr std::array<uint16_t, 2> kLanguageDescriptor = {StringHeader(1), 0x0409};
+
+/// Серийный номер из UID чипа (96 бит) — 24 hex символа
+constexpr void UidToSerial(const uint32_t uid[3], char out[25]) {
+    constexpr char kHex[] = "0123456789ABCDEF";
+    size_t pos = 0;
+    for (size_t word = 0; word < 3; word++) {
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            out[pos++] = kHex[(uid[word] >> shift) & 0xF];
+        }
+    }
+    out[pos] = '\0';
+}
+
+/**
+ * @brief Таблица строковых дескрипторов по индексу
+ * @tparam kArenaWords Арена для строк, закодированных при выполнении (слова UTF-16)
+ *
+ * Слот указывает либо на constexpr дескриптор во flash (SetStatic),
+ * либо на дескриптор в арене (Set). Get() ничего не кодирует —
+ * tud_descriptor_string_cb возвращает готовый указатель.
+ */
+template <size_t kArenaWords = USB_DESC_STRING_ARENA>
+class StringTable {
+public:
+    /// Очистить слоты и арену
+    void Clear() {
+        for (auto& slot : slots_) {
+            slot = nullptr;
+        }
+        used_ = 0;
+    }
+
+    /// Слот на готовый дескриптор (время жизни — не меньше таблицы)
+    bool SetStatic(uint8_t index, const uint16_t* descriptor) {
+        if (index >= kStringSlots) {
+            return false;
+        }
+        slots_[index] = descriptor;
+        return true;
+    }
+
+    /**
+     * @brief Закодировать строку UTF-8 в арену
+     * @return false, если индекс вне таблицы или арена заполнена (слот не меняется)
+     *
+     * Строка длиннее kMaxStringChars обрезается.
+     */
+    bool Set(uint8_t index, const char* text) {
+        if (index >= kStringSlots || text == nullptr) {
+            return false;
+        }
+        const size_t chars = EncodeUtf16(text, nullptr, kMaxStringChars);
+        if (used_ + chars + 1 > kArenaWords) {
+            return false;
+        }
+        uint16_t* descriptor = arena_ + used_;
+        EncodeUtf16(text, descriptor + 1, chars);
+        descriptor[0] = StringHeader(chars);
+        used_ += chars + 1;
+        slots_[index] = descriptor;
+        return true;
+    }
+
+    /// Дескриптор по индексу или nullptr (STALL)
+    const uint16_t* Get(uint8_t index) const {
+        return index < kStringSlots ? slots_[index] : nullptr;
+    }
+
+    /// Занято слов арены
+    size_t ArenaUsed() const { return used_; }
+
+private:
+    const uint16_t* slots_[kStringSlots] = {};
+    uint16_t arena_[kArenaWords] = {};
+    size_t used_ = 0;
+};
+
+/**
+ * @brief Дескрипторы, зависящие от usb::Config
+ *
+ * Заполняет UsbDevice::Init() (до tusb_init()), читают callbacks
+ * usb_descriptors.cpp. Один экземпляр — device стек TinyUSB один на сборку.
+ */
+struct RuntimeDescriptors {
+    uint16_t vid = USB_VID;
+    uint16_t pid = USB_PID;
+    bool dfu_mode = false;  ///< Конфигурация DFU mode вместо рабочей (USB_DFU_ENABLED)
+    StringTable<> strings;
+};
+
+/// Экземпляр дескрипторов device стека (usb_composite.cpp)
+RuntimeDescriptors& Runtime();
+
+}  // namespace usb::desc
@@ -0,0 +1,263 @@
+/**
+ * @file usb_dfu.h
+ * @brief DFU 1.1 внутри composite устройства: приём образа и запись во flash
+ *
+ * Вместо ухода в системный загрузчик по 1200 bps устройство само обслуживает
+ * DFU: в рабочем режиме в конфигурации есть интерфейс DFU runtime, по
+ * DFU_DETACH (или 1200 bps) устройство переподключается с конфигурацией
+ * DFU mode (только интерфейс DFU, свой PID) и принимает образ dfu-util.
+ *
+ * DfuFlash — приёмник блоков DFU_DNLOAD (tud_dfu_download_cb) поверх IFlash:
+ * - блок копируется в один из двух буферов, и tud_dfu_finish_flashing()
+ *   вызывается сразу — хост передаёт следующий блок, пока flash пишет этот
+ * - перед первым блоком сектора сектор стирается (один раз за сессию)
+ * - оба буфера заняты — блок ждёт (буфер TinyUSB действителен до finish),
+ *   bwPollTimeout в ответе GETSTATUS отражает занятость flash
+ * - ошибка flash запоминается и возвращается следующим блоком (dfuERROR)
+ *
+ * Программирование полностью скрыто за передачей; шину задерживает только
+ * стирание (на время сверх двух буферов). Стирания наперёд, как в Uf2Disk,
+ * нет: размер образа DFU заранее неизвестен, а лишний сектор за концом
+ * образа стирался бы впустую. Конвейер общий с Uf2Disk — FlashWriter
+ * (usb_flash_writer.h).
+ *
+ * Активация: USB_DFU_ENABLED.
+ *
+ * @code
+ * usb::adapters::Stm32Flash g_flash;
+ * usb::DfuConfig dfu_config;
+ * dfu_config.app_address = 0x08020000;  // За загрузчиком (сектор 0)
+ * usb::DfuFlash g_dfu(g_flash, dfu_config);
+ *
+ * g_dfu.SetCompleteCallback([](void*) { g_jump_to_app = true; });
+ * g_usb.DfuAttach(g_dfu);
+ * while (true) {
+ *     g_usb.Process();
+ *     g_usb.DfuPoll();  // Flash и переключение режима DFU
+ * }
+ * @endcode
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "ports/IFlash.hpp"
+#include "ports/IRtos.hpp"
+#include "usb_flash_writer.h"
+
+// wTransferSize: наибольший блок DFU_DNLOAD / DFU_UPLOAD (буфер TinyUSB и два буфера DfuFlash)
+#ifndef USB_DFU_TRANSFER_SIZE
+#define USB_DFU_TRANSFER_SIZE 1024
+#endif
+
+// Наибольшее число секторов flash (битовая карта стёртых)
+#ifndef USB_DFU_MAX_SECTORS
+#define USB_DFU_MAX_SECTORS 256
+#endif
+
+namespace usb {
+
+//--------------------------------------------------------------------+
+// Протокол DFU 1.1
+//--------------------------------------------------------------------+
+
+namespace dfu {
+
+/// bStatus (совпадает с dfu_status_t TinyUSB)
+enum class Status : uint8_t {
+    Ok = 0x00,
+    ErrTarget = 0x01,
+    ErrFile = 0x02,
+    ErrWrite = 0x03,
+    ErrErase = 0x04,
+    ErrCheckErased = 0x05,
+    ErrProg = 0x06,
+    ErrVerify = 0x07,
+    ErrAddress = 0x08,
+    ErrNotDone = 0x09,
+    ErrFirmware = 0x0A,
+    ErrVendor = 0x0B,
+    ErrUsbReset = 0x0C,
+    ErrPowerOnReset = 0x0D,
+    ErrUnknown = 0x0E,
+    ErrStalledPacket = 0x0F,
+};
+
+/// bState (совпадает с dfu_state_t TinyUSB)
+enum class State : uint8_t {
+    AppIdle = 0,
+    AppDetach = 1,
+    Idle = 2,
+    DnloadSync = 3,
+    DnBusy = 4,
+    DnloadIdle = 5,
+    ManifestSync = 6,
+    Manifest = 7,
+    ManifestWaitReset = 8,
+    UploadIdle = 9,
+    Error = 10,
+};
+
+// bRequest
+static constexpr uint8_t kRequestDetach = 0;
+static constexpr uint8_t kRequestDnload = 1;
+static constexpr uint8_t kRequestUpload = 2;
+static constexpr uint8_t kRequestGetStatus = 3;
+static constexpr uint8_t kRequestClrStatus = 4;
+static constexpr uint8_t kRequestGetState = 5;
+static constexpr uint8_t kRequestAbort = 6;
+
+// bmAttributes функционального дескриптора
+static constexpr uint8_t kAttrCanDownload = 0x01;
+static constexpr uint8_t kAttrCanUpload = 0x02;
+static constexpr uint8_t kAttrManifestationTolerant = 0x04;
+static constexpr uint8_t kAttrWillDetach = 0x08;
+
+}  // namespace dfu
+
+//--------------------------------------------------------------------+
+// DfuFlash
+//--------------------------------------------------------------------+
+
+/// Область прошивки и подсказки bwPollTimeout
+struct DfuConfig {
+    uint32_t app_address = 0;      ///< Начало области прошивки (0 — начало flash)
+    uint32_t app_size = 0;         ///< Размер области, целые секторы (0 — до конца flash)
+    uint32_t poll_timeout_ms = 0;  ///< bwPollTimeout, пока есть свободный буфер
+    uint32_t busy_timeout_ms = 1;  ///< bwPollTimeout, когда блок будет ждать flash
+};
+
+/// Счётчики сессии (снимок, POD)
+struct DfuStats {
+    uint32_t blocks = 0;           ///< Принятых блоков DFU_DNLOAD
+    uint32_t bytes = 0;
+    uint32_t buffer_waits = 0;     ///< Блок ждал свободный буфер (flash не успевает)
+    uint32_t sectors_erased = 0;
+    uint32_t programs = 0;         ///< Записанных во flash буферов
+    uint32_t flash_errors = 0;
+    uint32_t sequence_errors = 0;  ///< Номер блока не по порядку, выход за область
+    uint32_t uploads = 0;          ///< Блоков DFU_UPLOAD
+    uint32_t aborts = 0;
+};
+
+/**
+ * @brief Запись образа DFU во flash с двойной буферизацией
+ *
+ * Download(), Manifest(), Upload(), Abort() вызываются из callbacks TinyUSB
+ * (tud_dfu_*_cb), Poll() — из main loop (UsbDevice::DfuPoll()). Завершение
+ * блока и манифестации сообщается через FinishFn (tud_dfu_finish_flashing).
+ * В RTOS режиме задайте SetMutex().
+ */
+class DfuFlash {
+public:
+    static constexpr uint32_t kTransferSize = USB_DFU_TRANSFER_SIZE;
+
+    using FinishFn = void (*)(dfu::Status status, void* context);
+    using CompleteFn = void (*)(void* context);
+
+    explicit DfuFlash(ports::IFlash& flash, const DfuConfig& config = DfuConfig{});
+
+    DfuFlash(const DfuFlash&) = delete;
+    DfuFlash& operator=(const DfuFlash&) = delete;
+
+    /// Геометрия flash и область прошивки допустимы
+    bool IsReady() const { return ready_; }
+
+    /// Завершение блока / манифестации (UsbDevice::DfuAttach() ставит tud_dfu_finish_flashing)
+    void SetFinishCallback(FinishFn callback, void* context = nullptr) {
+        finish_callback_ = callback;
+        finish_context_ = context;
+    }
+
+    /// Вызывается после успешной манифестации (образ записан целиком)
+    void SetCompleteCallback(CompleteFn callback, void* context = nullptr) {
+        complete_callback_ = callback;
+        complete_context_ = context;
+    }
+
+    /**
+     * @brief Блок DFU_DNLOAD
+     *
+     * Блок 0 начинает сессию, далее номера подряд; данные ложатся подряд
+     * с app_address. data должен оставаться действительным до FinishFn
+     * (буфер TinyUSB не меняется, пока устройство в dfuDNBUSY).
+     */
+    void Download(uint16_t block, const uint8_t* data, uint16_t len);
+
+    /// Конец образа (DFU_DNLOAD нулевой длины): дописать буферы, затем FinishFn
+    void Manifest();
+
+    /// Блок DFU_UPLOAD: чтение области прошивки, короткий блок — конец
+    uint16_t Upload(uint16_t block, uint8_t* data, uint16_t len);
+
+    /// DFU_ABORT / CLRSTATUS: дождаться операции flash, сбросить сессию
+    void Abort();
+
+    /// Продвинуть конвейер без ожидания, завершить ждущий блок
+    void Poll();
+
+    /// bwPollTimeout ответа GETSTATUS (state — следующее состояние: dfuDNBUSY, dfuMANIFEST)
+    uint32_t GetPollTimeoutMs(dfu::State state) const;
+
+    /// Буферы или операция flash ещё не завершены
+    bool IsBusy() const { return pending_ != Pending::None || !writer_.IsIdle(); }
+
+    /// Ошибка flash в текущей сессии (до Abort() или нового блока 0)
+    bool HasFailed() const { return writer_.HasFailed(); }
+
+    /// Принято байт в текущей сессии
+    uint32_t GetImageSize() const { return offset_; }
+
+    /// Мьютекс для Poll() из другой задачи (nullptr — без RTOS)
+    void SetMutex(ports::IMutex* mutex) { mutex_ = mutex; }
+
+    DfuStats GetStats() const;
+    void ResetStats();
+
+private:
+    enum class Pending : uint8_t { None, Block, Manifest };
+
+    bool Accept(uint16_t block, const uint8_t* data, uint16_t len, dfu::Status* status);
+    void TryPending();
+    void StartSession();
+    dfu::Status Failure() const;
+    void Finish(dfu::Status status);
+    void Deliver();
+
+    void Lock();
+    void Unlock();
+
+    ports::IFlash& flash_;
+    DfuConfig config_;
+    ports::IMutex* mutex_ = nullptr;
+    bool ready_ = false;
+
+    // Сессия
+    bool session_ = false;
+    bool tail_ = false;            ///< Принят блок не кратный единице программирования
+    uint16_t next_block_ = 0;
+    uint32_t offset_ = 0;
+
+    // Буферы (кольцо из двух, блок дополнен 0xFF до единицы программирования) и flash
+    StaticFlashWriter<kTransferSize, 2, USB_DFU_MAX_SECTORS> writer_;
+
+    // Блок или манифестация, ждущие flash
+    Pending pending_ = Pending::None;
+    uint16_t pending_block_ = 0;
+    const uint8_t* pending_data_ = nullptr;
+    uint16_t pending_len_ = 0;
+
+    // Завершение для FinishFn (вызывается вне мьютекса)
+    bool finished_ = false;
+    dfu::Status finished_status_ = dfu::Status::Ok;
+    bool manifest_done_ = false;
+
+    FinishFn finish_callback_ = nullptr;
+    void* finish_context_ = nullptr;
+    CompleteFn complete_callback_ = nullptr;
+    void* complete_context_ = nullptr;
+    DfuStats stats_{};
+};
+
+}  // namespace usb
@@ -0,0 +1,166 @@
+/**
+ * @file usb_flash_writer.h
+ * @brief Конвейер записи во flash: очередь кусков, стирание по требованию
+ *
+ * Общая часть загрузчиков Uf2Disk и DfuFlash. Кусок ставится в очередь
+ * (Push()), Pump() продвигает flash без ожидания:
+ * - перед первой записью в сектор он стирается (один раз за сессию)
+ * - стёртый кусок программируется, слот очереди освобождается
+ * - очередь пуста — стирается следующий сектор из диапазона наперёд
+ *   (SetEraseAhead(), если владелец знает размер образа)
+ * - ошибка flash запоминается (GetFailure()) и сбрасывает очередь
+ *
+ * Область прошивки проверяет CheckRegion(): целые секторы, иначе стирание
+ * первого или последнего сектора задело бы загрузчик или данные за областью.
+ *
+ * Синхронизация — у владельца (его мьютекс вокруг всех вызовов).
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "ports/IFlash.hpp"
+
+namespace usb {
+
+/// Счётчики конвейера (снимок, POD)
+struct FlashWriterStats {
+    uint32_t sectors_erased = 0;
+    uint32_t erase_ahead = 0;   ///< Из них стёрто наперёд
+    uint32_t programs = 0;      ///< Записанных кусков
+    uint32_t flash_errors = 0;
+};
+
+/**
+ * @brief Очередь кусков и операция flash (без хранилища)
+ *
+ * Буферы и битовую карту стёртых секторов даёт StaticFlashWriter.
+ */
+class FlashWriter {
+public:
+    /// Операция flash
+    enum class Op : uint8_t { None, Erase, Program };
+
+    FlashWriter(const FlashWriter&) = delete;
+    FlashWriter& operator=(const FlashWriter&) = delete;
+
+    /**
+     * @brief Проверить и дополнить область прошивки
+     * @param address Начало (0 — начало flash)
+     * @param size Размер (0 — до конца flash)
+     * @return false — геометрия flash не подходит или область не из целых секторов
+     */
+    bool CheckRegion(uint32_t* address, uint32_t* size) const;
+
+    uint32_t GetProgramUnit() const { return program_unit_; }
+    uint32_t SectorOf(uint32_t address) const { return (address - flash_base_) / sector_size_; }
+
+    /**
+     * @brief Занять слот очереди
+     * @param size Байт к записи (кратно единице программирования, не больше куска)
+     * @return Буфер слота для заполнения; nullptr — очередь полна или была ошибка
+     */
+    uint8_t* Push(uint32_t address, uint32_t size);
+
+    /// Стирать секторы [first, last] наперёд, пока очередь пуста
+    void SetEraseAhead(uint32_t first, uint32_t last);
+    void StopEraseAhead() { ahead_ = false; }
+
+    /// Продвинуть конвейер без ожидания
+    void Pump();
+
+    /// Дождаться одной операции (запустив её, если flash свободна)
+    /// @return false — ошибка flash или ждать нечего
+    bool Step();
+
+    /// Дописать очередь
+    /// @return false — ошибка flash
+    bool Drain();
+
+    /// Новая сессия: стёртые секторы и ошибка забываются (очередь — нет)
+    void NewSession();
+
+    /// Дождаться операции flash, сбросить очередь, начать сессию заново
+    void Reset();
+
+    bool IsFull() const { return count_ == depth_; }
+    bool IsIdle() const { return count_ == 0 && op_ == Op::None; }
+    uint32_t GetQueued() const { return count_; }
+
+    /// Операция, на которой flash отказала (None — ошибок нет)
+    Op GetFailure() const { return failure_; }
+    bool HasFailed() const { return failure_ != Op::None; }
+
+    FlashWriterStats GetStats() const { return stats_; }
+    void ResetStats() { stats_ = FlashWriterStats{}; }
+
+protected:
+    struct Chunk {
+        uint32_t address;
+        uint32_t size;
+        uint8_t* data;
+    };
+
+    FlashWriter(ports::IFlash& flash, uint32_t chunk_size, Chunk* ring, uint32_t depth,
+                uint32_t* erased, uint32_t max_sectors);
+
+private:
+    bool StartNext();
+    void CompleteOp(ports::FlashStatus status);
+    void Fail(Op op);
+
+    bool SectorErased(uint32_t sector) const {
+        return (erased_[sector / 32] >> (sector % 32)) & 1;
+    }
+
+    ports::IFlash& flash_;
+    uint32_t flash_base_ = 0;
+    uint32_t sector_size_ = 0;
+    uint32_t program_unit_ = 0;
+    const uint32_t chunk_size_;
+    const uint32_t max_sectors_;
+
+    Chunk* const ring_;
+    const uint32_t depth_;
+    uint32_t* const erased_;
+    uint32_t head_ = 0;
+    uint32_t count_ = 0;
+
+    Op op_ = Op::None;
+    uint32_t op_sector_ = 0;
+    bool op_ahead_ = false;
+    Op failure_ = Op::None;
+
+    bool ahead_ = false;
+    uint32_t ahead_first_ = 0;
+    uint32_t ahead_last_ = 0;
+
+    FlashWriterStats stats_{};
+};
+
+/**
+ * @brief FlashWriter с хранилищем
+ * @tparam kChunkSize Наибольший кусок, байт
+ * @tparam kDepth Кусков в очереди
+ * @tparam kMaxSectors Наибольшее число секторов flash
+ */
+template <uint32_t kChunkSize, uint32_t kDepth, uint32_t kMaxSectors>
+class StaticFlashWriter final : public FlashWriter {
+public:
+    explicit StaticFlashWriter(ports::IFlash& flash)
+        : FlashWriter(flash, kChunkSize, ring_, kDepth, erased_, kMaxSectors) {
+        for (uint32_t i = 0; i < kDepth; i++) {
+            ring_[i].data = data_[i];
+        }
+    }
+
+private:
+    static_assert(kDepth != 0 && kMaxSectors != 0, "empty flash writer");
+
+    Chunk ring_[kDepth] = {};
+    alignas(4) uint8_t data_[kDepth][kChunkSize];
+    uint32_t erased_[(kMaxSectors + 31) / 32] = {};
+};
+
+}  // namespace usb
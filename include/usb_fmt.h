@@ -0,0 +1,549 @@
+/**
+ * @file usb_fmt.h
+ * @brief Форматирование без vsnprintf: строка формата разбирается при сборке
+ *
+ * USB_FMT("...") превращает литерал в тип; Format() разбирает его constexpr
+ * и раскрывает в цепочку вызовов приёмника — литералы и аргументы по очереди,
+ * без промежуточного буфера строки. Число {} и типы аргументов проверяются
+ * static_assert. Приёмник — любой тип с методом Put(const char*, uint32_t):
+ * SpanSink (буфер), TX FIFO CDC (UsbDevice::CdcFormat()).
+ *
+ * Спецификация: {[:[<][0][ширина][.точность][тип]]}
+ * - тип: d — десятичный, x / X — hex, b — двоичный, c — символ, s — строка;
+ *   без типа — по типу аргумента (целое, char, bool, const char*, float/double)
+ * - .N у целого — фиксированная точка: {:.3} для 3300 даёт "3.300"
+ * - .N у float/double — N знаков после точки (без точности — 6), до 9
+ * - 0 — дополнять нулями после знака, < — выравнивание влево
+ * - {{ и }} — фигурные скобки
+ *
+ * @code
+ * char line[64];
+ * usb::fmt::FormatTo(line, sizeof(line), USB_FMT("{:<8} {:08b}"), "status", reg);
+ * g_usb.CdcFormat(USB_FMT("t={} adc={:04x} v={:.3}\r\n"), HAL_GetTick(), raw, millivolts);
+ * @endcode
+ *
+ * Целые до 32 бит — без 64-битного деления (Cortex-M7 делит его программно).
+ * float/double масштабируются в 64-битное целое: |v| · 10^N ≥ 2^64 — "ovf".
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/// Строка формата как тип (литерал доступен в constexpr разборе)
+#define USB_FMT(str)                                                      \
+    ([] {                                                                 \
+        struct UsbFmtString {                                             \
+            static constexpr const char* Get() { return str; }            \
+            static constexpr size_t Size() { return sizeof(str) - 1; }    \
+        };                                                                \
+        return UsbFmtString{};                                            \
+    }())
+
+namespace usb {
+namespace fmt {
+
+//--------------------------------------------------------------------+
+// Разбор строки формата (constexpr)
+//--------------------------------------------------------------------+
+
+/// Часть строки формата: литерал или аргумент со спецификацией
+struct Segment {
+    bool is_arg = false;
+    uint16_t offset = 0;     ///< Литерал: начало в строке
+    uint16_t length = 0;     ///< Литерал: длина
+    uint8_t arg = 0;         ///< Номер аргумента
+    char type = 0;           ///< 'd', 'x', 'X', 'b', 'c', 's' или 0 — по типу
+    uint8_t width = 0;
+    int8_t precision = -1;   ///< Знаков после точки, -1 — не задано
+    bool zero = false;       ///< Дополнять нулями
+    bool left = false;       ///< Выравнивание влево
+};
+
+enum class ParseError : uint8_t {
+    None,
+    UnmatchedBrace,  ///< Одиночная } или незакрытая {
+    BadSpec,         ///< Неизвестный тип, ширина > 255 или точность > 9
+};
+
+static constexpr int8_t kMaxPrecision = 9;
+
+template <size_t N>
+struct Parsed {
+    Segment segments[N];
+    uint32_t count = 0;
+    uint32_t args = 0;
+    ParseError error = ParseError::None;
+};
+
+/// Верхняя граница числа частей: литерал вокруг каждой скобки
+constexpr size_t MaxSegments(const char* str, size_t size) {
+    size_t braces = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (str[i] == '{' || str[i] == '}') {
+            braces++;
+        }
+    }
+    return 2 * braces + 1;
+}
+
+template <size_t N>
+constexpr void AddLiteral(Parsed<N>& out, size_t offset, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    Segment& seg = out.segments[out.count++];
+    seg.offset = static_cast<uint16_t>(offset);
+    seg.length = static_cast<uint16_t>(length);
+}
+
+template <size_t N>
+constexpr Parsed<N> Parse(const char* str, size_t size) {
+    Parsed<N> out{};
+    size_t literal = 0;
+    size_t i = 0;
+    while (i < size) {
+        const char c = str[i];
+        if (c == '}') {
+            if (i + 1 < size && str[i + 1] == '}') {
+                AddLiteral(out, literal, i + 1 - literal);  // Одна } из пары
+                i += 2;
+                literal = i;
+                continue;
+            }
+            out.error = ParseError::UnmatchedBrace;
+            return out;
+        }
+        if (c != '{') {
+            i++;
+            continue;
+        }
+        if (i + 1 < size && str[i + 1] == '{') {
+            AddLiteral(out, literal, i + 1 - literal);
+            i += 2;
+            literal = i;
+            continue;
+        }
+        AddLiteral(out, literal, i - literal);
+        i++;
+
+        Segment seg{};
+        seg.is_arg = true;
+        seg.arg = static_cast<uint8_t>(out.args++);
+        if (i < size && str[i] == ':') {
+            i++;
+            if (i < size && str[i] == '<') {
+                seg.left = true;
+                i++;
+            }
+            if (i < size && str[i] == '0') {
+                seg.zero = true;
+                i++;
+            }
+            uint32_t width = 0;
+            while (i < size && str[i] >= '0' && str[i] <= '9') {
+                width = width * 10 + static_cast<uint32_t>(str[i++] - '0');
+                if (width > 255) {
+                    out.error = ParseError::BadSpec;
+                    return out;
+                }
+            }
+            seg.width = static_cast<uint8_t>(width);
+            if (i < size && str[i] == '.') {
+                i++;
+                if (i >= size || str[i] < '0' || str[i] > '9') {
+                    out.error = ParseError::BadSpec;
+                    return out;
+                }
+                int32_t precision = 0;
+                while (i < size && str[i] >= '0' && str[i] <= '9') {
+                    precision = precision * 10 + (str[i++] - '0');
+                    if (precision > kMaxPrecision) {
+                        out.error = ParseError::BadSpec;
+                        return out;
+                    }
+                }
+                seg.precision = static_cast<int8_t>(precision);
+            }
+            if (i < size && str[i] != '}') {
+                const char type = str[i++];
+                if (type != 'd' && type != 'x' && type != 'X' && type != 'b' && type != 'c' &&
+                    type != 's') {
+                    out.error = ParseError::BadSpec;
+                    return out;
+                }
+                seg.type = type;
+            }
+        }
+        if (i >= size || str[i] != '}') {
+            out.error = i >= size ? ParseError::UnmatchedBrace : ParseError::BadSpec;
+            return out;
+        }
+        i++;
+        out.segments[out.count++] = seg;
+        literal = i;
+    }
+    AddLiteral(out, literal, size - literal);
+    return out;
+}
+
+/// Разобранная строка формата — одна на тип USB_FMT
+template <typename S>
+struct Compiled {
+    static constexpr size_t kMax = MaxSegments(S::Get(), S::Size());
+    static constexpr Parsed<kMax> kParsed = Parse<kMax>(S::Get(), S::Size());
+};
+
+//--------------------------------------------------------------------+
+// Проверка типов (constexpr)
+//--------------------------------------------------------------------+
+
+enum class ArgKind : uint8_t { Invalid, Integer, Char, Bool, Float, String };
+
+template <typename T>
+constexpr ArgKind KindOf() {
+    using U = std::remove_cv_t<std::decay_t<T>>;
+    if constexpr (std::is_same_v<U, bool>) {
+        return ArgKind::Bool;
+    } else if constexpr (std::is_same_v<U, char>) {
+        return ArgKind::Char;
+    } else if constexpr (std::is_integral_v<U>) {
+        return ArgKind::Integer;
+    } else if constexpr (std::is_floating_point_v<U>) {
+        return ArgKind::Float;
+    } else if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>) {
+        return ArgKind::String;
+    } else {
+        return ArgKind::Invalid;
+    }
+}
+
+constexpr bool Accepts(const Segment& seg, ArgKind kind) {
+    if (kind == ArgKind::Invalid) {
+        return false;
+    }
+    const bool number = kind == ArgKind::Integer || kind == ArgKind::Float;
+    if (seg.precision >= 0 && !number) {
+        return false;
+    }
+    if (seg.zero && !number && kind != ArgKind::Char) {
+        return false;
+    }
+    switch (seg.type) {
+        case 'd':
+        case 'c':
+            return kind == ArgKind::Integer || kind == ArgKind::Char;
+        case 'x':
+        case 'X':
+        case 'b':
+            return (kind == ArgKind::Integer || kind == ArgKind::Char) && seg.precision < 0;
+        case 's':
+            return kind == ArgKind::String;
+        default:
+            return true;
+    }
+}
+
+template <size_t N>
+constexpr const Segment* FindArg(const Parsed<N>& parsed, uint32_t index) {
+    for (uint32_t i = 0; i < parsed.count; i++) {
+        if (parsed.segments[i].is_arg && parsed.segments[i].arg == index) {
+            return &parsed.segments[i];
+        }
+    }
+    return nullptr;
+}
+
+template <typename S, typename... Args, size_t... I>
+constexpr bool ArgsMatch(std::index_sequence<I...>) {
+    constexpr auto& parsed = Compiled<S>::kParsed;
+    return (Accepts(*FindArg(parsed, I), KindOf<Args>()) && ...);
+}
+
+//--------------------------------------------------------------------+
+// Вывод
+//--------------------------------------------------------------------+
+
+/// Приёмник в буфер: обрезает по размеру, считает полную длину
+class SpanSink {
+public:
+    SpanSink(char* data, uint32_t size) : data_(data), size_(size) {}
+
+    void Put(const char* text, uint32_t len) {
+        for (uint32_t i = 0; i < len && length_ + i < size_; i++) {
+            data_[length_ + i] = text[i];
+        }
+        length_ += len;
+    }
+
+    /// Записано в буфер
+    uint32_t Size() const { return length_ < size_ ? length_ : size_; }
+    /// Полная длина результата
+    uint32_t Length() const { return length_; }
+    bool Truncated() const { return length_ > size_; }
+
+private:
+    char* data_;
+    uint32_t size_;
+    uint32_t length_ = 0;
+};
+
+namespace detail {
+
+/// Запас под 64 двоичные цифры, знак и точку
+static constexpr uint32_t kScratch = 72;
+
+inline constexpr char kDigitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+inline constexpr uint32_t kPow10[] = {1,      10,      100,      1000,      10000,
+                                      100000, 1000000, 10000000, 100000000, 1000000000};
+
+template <typename Sink>
+inline void PutFill(Sink& sink, char fill, uint32_t count) {
+    static constexpr char kSpaces[] = "                ";
+    static constexpr char kZeros[] = "0000000000000000";
+    const char* run = fill == '0' ? kZeros : kSpaces;
+    while (count > 0) {
+        const uint32_t n = count < 16 ? count : 16;
+        sink.Put(run, n);
+        count -= n;
+    }
+}
+
+/// Текст с выравниванием; знак перед нулями
+template <typename Sink>
+inline void PutAligned(Sink& sink, const Segment& seg, bool negative, const char* text,
+                       uint32_t len) {
+    const uint32_t total = len + (negative ? 1 : 0);
+    const uint32_t pad = seg.width > total ? seg.width - total : 0;
+    if (!seg.left && !seg.zero) {
+        PutFill(sink, ' ', pad);
+    }
+    if (negative) {
+        sink.Put("-", 1);
+    }
+    if (!seg.left && seg.zero) {
+        PutFill(sink, '0', pad);
+    }
+    sink.Put(text, len);
+    if (seg.left) {
+        PutFill(sink, ' ', pad);
+    }
+}
+
+/// Десятичные цифры справа налево от end, по две за деление
+inline char* FormatDec32(uint32_t value, char* end) {
+    while (value >= 100) {
+        const uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        *--end = kDigitPairs[pair + 1];
+        *--end = kDigitPairs[pair];
+    }
+    if (value >= 10) {
+        *--end = kDigitPairs[value * 2 + 1];
+        *--end = kDigitPairs[value * 2];
+    } else {
+        *--end = static_cast<char>('0' + value);
+    }
+    return end;
+}
+
+inline char* FormatDec(uint64_t value, char* end) {
+    // Старшая часть — по 9 цифр 64-битным делением, остальное 32-битное
+    while (value > 0xFFFFFFFFu) {
+        uint32_t low = static_cast<uint32_t>(value % 1000000000u);
+        value /= 1000000000u;
+        for (int i = 0; i < 9; i++) {
+            *--end = static_cast<char>('0' + low % 10);
+            low /= 10;
+        }
+    }
+    return FormatDec32(static_cast<uint32_t>(value), end);
+}
+
+inline char* FormatRadix(uint64_t value, char* end, uint32_t shift, bool upper) {
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    const uint32_t mask = (1u << shift) - 1;
+    do {
+        *--end = digits[value & mask];
+        value >>= shift;
+    } while (value != 0);
+    return end;
+}
+
+/// Модуль как фиксированная точка: precision младших десятичных цифр — дробь
+inline char* FormatFixed(uint64_t magnitude, int8_t precision, char* end) {
+    if (precision <= 0) {
+        return FormatDec(magnitude, end);
+    }
+    if (magnitude <= 0xFFFFFFFFu) {
+        uint32_t value = static_cast<uint32_t>(magnitude);
+        for (int8_t i = 0; i < precision; i++) {
+            *--end = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        *--end = '.';
+        return FormatDec32(value, end);
+    }
+    for (int8_t i = 0; i < precision; i++) {
+        *--end = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    }
+    *--end = '.';
+    return FormatDec(magnitude, end);
+}
+
+template <typename Sink, typename T>
+inline void WriteInteger(Sink& sink, const Segment& seg, T value) {
+    using Unsigned = std::make_unsigned_t<T>;
+    bool negative = false;
+    uint64_t magnitude;
+    if constexpr (std::is_signed_v<T>) {
+        negative = value < 0;
+        magnitude = negative ? static_cast<uint64_t>(0) - static_cast<uint64_t>(value)
+                             : static_cast<uint64_t>(value);
+    } else {
+        magnitude = value;
+    }
+
+    char scratch[kScratch];
+    char* const end = scratch + kScratch;
+    char* begin;
+    switch (seg.type) {
+        case 'x':
+        case 'X':
+            // Отрицательное в hex — дополнительный код своей ширины, как printf
+            begin = FormatRadix(static_cast<Unsigned>(value), end, 4, seg.type == 'X');
+            negative = false;
+            break;
+        case 'b':
+            begin = FormatRadix(static_cast<Unsigned>(value), end, 1, false);
+            negative = false;
+            break;
+        case 'c':
+            scratch[0] = static_cast<char>(value);
+            PutAligned(sink, seg, false, scratch, 1);
+            return;
+        default:
+            begin = FormatFixed(magnitude, seg.precision, end);
+            break;
+    }
+    PutAligned(sink, seg, negative, begin, static_cast<uint32_t>(end - begin));
+}
+
+template <typename Sink>
+inline void WriteFloat(Sink& sink, const Segment& seg, double value) {
+    if (value != value) {
+        PutAligned(sink, seg, false, "nan", 3);
+        return;
+    }
+    const bool negative = value < 0;
+    const double magnitude = negative ? -value : value;
+    const int8_t precision = seg.precision >= 0 ? seg.precision : 6;
+    const double scaled = magnitude * static_cast<double>(kPow10[precision]) + 0.5;
+    if (!(scaled < 18446744073709551616.0)) {
+        const bool inf = magnitude > 1.7976931348623157e308;
+        PutAligned(sink, seg, negative, inf ? "inf" : "ovf", 3);
+        return;
+    }
+    char scratch[kScratch];
+    char* const end = scratch + kScratch;
+    char* begin = FormatFixed(static_cast<uint64_t>(scaled), precision, end);
+    PutAligned(sink, seg, negative, begin, static_cast<uint32_t>(end - begin));
+}
+
+template <typename Sink>
+inline void WriteString(Sink& sink, const Segment& seg, const char* text) {
+    if (text == nullptr) {
+        text = "(null)";
+    }
+    uint32_t len = 0;
+    while (text[len] != '\0') {
+        len++;
+    }
+    PutAligned(sink, seg, false, text, len);
+}
+
+template <typename Sink, typename T>
+inline void WriteArg(Sink& sink, const Segment& seg, const T& value) {
+    constexpr ArgKind kind = KindOf<T>();
+    if constexpr (kind == ArgKind::Bool) {
+        PutAligned(sink, seg, false, value ? "true" : "false", value ? 4 : 5);
+    } else if constexpr (kind == ArgKind::Char) {
+        if (seg.type == 0 || seg.type == 'c') {
+            PutAligned(sink, seg, false, &value, 1);
+        } else {
+            WriteInteger(sink, seg, static_cast<unsigned char>(value));
+        }
+    } else if constexpr (kind == ArgKind::Integer) {
+        WriteInteger(sink, seg, value);
+    } else if constexpr (kind == ArgKind::Float) {
+        WriteFloat(sink, seg, static_cast<double>(value));
+    } else {
+        WriteString(sink, seg, value);
+    }
+}
+
+template <typename S, size_t I, typename Sink, typename Tuple>
+inline void WriteSegment(Sink& sink, const Tuple& args) {
+    constexpr Segment seg = Compiled<S>::kParsed.segments[I];
+    if constexpr (seg.is_arg) {
+        WriteArg(sink, seg, std::get<seg.arg>(args));
+    } else {
+        sink.Put(S::Get() + seg.offset, seg.length);
+    }
+}
+
+template <typename S, typename Sink, typename Tuple, size_t... I>
+inline void WriteAll(Sink& sink, const Tuple& args, std::index_sequence<I...>) {
+    (WriteSegment<S, I>(sink, args), ...);
+}
+
+}  // namespace detail
+
+/**
+ * @brief Форматировать в приёмник
+ * @param format USB_FMT("...")
+ */
+template <typename Sink, typename S, typename... Args>
+inline void Format(Sink& sink, S /*format*/, const Args&... args) {
+    constexpr auto& parsed = Compiled<S>::kParsed;
+    static_assert(parsed.error != ParseError::UnmatchedBrace,
+                  "USB_FMT: unmatched '{' or '}' (use {{ and }} for literal braces)");
+    static_assert(parsed.error != ParseError::BadSpec,
+                  "USB_FMT: bad spec, expected {[:[<][0][width][.precision][d|x|X|b|c|s]]}");
+    if constexpr (parsed.error == ParseError::None) {
+        static_assert(parsed.args == sizeof...(Args),
+                      "USB_FMT: argument count does not match {} placeholders");
+        if constexpr (parsed.args == sizeof...(Args)) {
+            static_assert(ArgsMatch<S, Args...>(std::index_sequence_for<Args...>{}),
+                          "USB_FMT: argument type does not match its {} spec");
+            detail::WriteAll<S>(sink, std::forward_as_tuple(args...),
+                                std::make_index_sequence<parsed.count>{});
+        }
+    }
+}
+
+/**
+ * @brief Форматировать в буфер с завершающим нулём (как snprintf)
+ * @return Полная длина результата; >= size — вывод обрезан
+ */
+template <typename S, typename... Args>
+inline uint32_t FormatTo(char* out, uint32_t size, S format, const Args&... args) {
+    SpanSink sink(out, size > 0 ? size - 1 : 0);
+    Format(sink, format, args...);
+    if (size > 0) {
+        out[sink.Size()] = '\0';
+    }
+    return sink.Length();
+}
+
+}  // namespace fmt
+}  // namespace usb
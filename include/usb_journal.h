@@ -0,0 +1,218 @@
+/**
+ * @file usb_journal.h
+ * @brief Журнал записи: мелкие случайные записи хоста — последовательно в журнал
+ *
+ * JournalBlockDevice стоит под MSC и отдаёт устройство без хвоста из
+ * journal_blocks + 1 блоков — там кольцевой журнал и заголовок разметки
+ * (последний блок). Format() размечает хвост, Open() открывает журнал только
+ * при совпадающем заголовке: карта с чужой разметкой не затирается.
+ * Том (MBR, FAT) создаётся через журнальный вид, иначе он займёт хвост. Запись короче direct_blocks
+ * дописывается в голову журнала (для FTL карты — дозапись открытого блока
+ * стирания вместо слияния), таблица "блок → слот" в RAM отвечает на чтения.
+ * Длинные записи уже последовательны и идут сразу на место; их старые копии
+ * в журнале перед этим переносятся.
+ *
+ * Poll() из main loop переносит хвост журнала на место порциями по
+ * compact_blocks: живые слоты сортируются по LBA, соседние блоки пишутся
+ * одной командой, перезаписанные копии (FAT, каталоги) отбрасываются.
+ * Журнал заполнен — перенос выполняется внутри записи.
+ *
+ * Каждая запись в журнале — описатель (LBA, число блоков, номер, хвост
+ * журнала, контрольные суммы) и данные, одной командой. Open() находит
+ * описатель с наибольшим номером, проходит записи от его хвоста и
+ * восстанавливает таблицу: записи, подтверждённые хосту, переживают сброс
+ * питания, недописанная отбрасывается. Перенос хвост на носитель не пишет —
+ * его несёт следующая запись; перед записью на место поверх перенесённой
+ * копии и в Sync() дописывается пустая запись-отметка. Дозапись журнала не
+ * прерывается. Sync() переносит весь журнал (MSC вызывает его по SYNCHRONIZE
+ * CACHE и eject). Активация: USB_JOURNAL_ENABLED.
+ *
+ * @code
+ * usb::JournalConfig cfg;
+ * cfg.journal_blocks = 512;              // 256 KB в конце карты
+ * usb::JournalBlockDevice g_journal(g_sd, cfg);
+ * if (!g_journal.Open()) {
+ *     // Новая карта: разметить хвост, затем форматировать том через g_journal
+ *     g_journal.Format();
+ * }
+ * g_usb.MscAttach(g_journal);
+ *
+ * // Main loop
+ * g_usb.Process();
+ * if (!g_usb.MscIsBusy()) {
+ *     g_journal.Poll();
+ * }
+ * @endcode
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "ports/IBlockDevice.hpp"
+#include "ports/IRtos.hpp"
+#include "usb_slot_map.h"
+
+// Записей в таблице "блок → слот" (степень двойки); слотов журнала — до 3/4 от неё
+#ifndef USB_JOURNAL_MAP_SIZE
+#define USB_JOURNAL_MAP_SIZE 1024
+#endif
+
+// Слотов за один перенос (сортировка по LBA внутри порции)
+#ifndef USB_JOURNAL_BATCH
+#define USB_JOURNAL_BATCH 64
+#endif
+
+// Буфер переноса: наибольшая запись на место одной командой
+#ifndef USB_JOURNAL_COPY_BLOCKS
+#define USB_JOURNAL_COPY_BLOCKS 16
+#endif
+
+namespace usb {
+
+/// Размер журнала и порогов
+struct JournalConfig {
+    uint32_t journal_blocks = 512;  ///< Блоков журнала в конце устройства (≤ kMaxSlots)
+    uint32_t direct_blocks = 16;    ///< Запись от стольких блоков — на место (≤ journal_blocks / 2)
+    uint32_t compact_blocks = USB_JOURNAL_BATCH;  ///< Слотов за Poll() (≤ USB_JOURNAL_BATCH)
+    uint8_t compact_percent = 0;    ///< Poll() переносит от этого заполнения (%), 0 — всегда
+};
+
+/// Счётчики (снимок, POD)
+struct JournalStats {
+    uint32_t journal_writes = 0;     ///< Записей в журнал
+    uint32_t journal_blocks = 0;     ///< Блоков данных в журнал (без описателей)
+    uint32_t direct_writes = 0;      ///< Записей сразу на место
+    uint32_t compacted_blocks = 0;   ///< Перенесено на место
+    uint32_t superseded_blocks = 0;  ///< Слотов с перезаписанными копиями (не переносились)
+    uint32_t compactions = 0;        ///< Порций переноса
+    uint32_t foreground_compactions = 0;  ///< Порций внутри записи (журнал полон, запись на место)
+    uint32_t errors = 0;
+};
+
+/**
+ * @brief Журналируемое блочное устройство
+ */
+class JournalBlockDevice final : public ports::IBlockDevice {
+public:
+    static_assert(USB_JOURNAL_COPY_BLOCKS >= 2, "USB_JOURNAL_COPY_BLOCKS too small");
+    static_assert(USB_JOURNAL_COPY_BLOCKS - 1 <= USB_JOURNAL_BATCH,
+                  "USB_JOURNAL_BATCH must hold one journal record");
+
+    static constexpr uint32_t kBlockSize = 512;
+
+    /// Слотов не больше 3/4 таблицы (SlotMap)
+    static constexpr uint32_t kMaxSlots = SlotMap<USB_JOURNAL_MAP_SIZE>::kMaxSlots;
+
+    explicit JournalBlockDevice(ports::IBlockDevice& device,
+                                const JournalConfig& config = JournalConfig{})
+        : device_(device), config_(config) {}
+
+    /**
+     * @brief Открыть журнал, размеченный Format(), и восстановить таблицу
+     *
+     * Читает весь журнал: описатель с наибольшим номером даёт хвост, записи
+     * от него — до первой неполной (номер, контрольные суммы). Таблица — как
+     * до сброса.
+     * @return false — устройство не готово или ошибка чтения, блок не 512
+     *         байт, меньше журнала, в последнем блоке нет заголовка (чужая
+     *         разметка) или он от другой геометрии (размер устройства,
+     *         journal_blocks)
+     */
+    bool Open();
+
+    /**
+     * @brief Разметить хвост устройства под журнал и открыть его
+     *
+     * Записывает заголовок в последний блок. Данные последних
+     * journal_blocks + 1 блоков теряются — вызывайте для новой карты,
+     * до создания тома через журнальный вид. Слоты журнала обнуляются:
+     * записи прежней разметки Open() не восстановит.
+     */
+    bool Format();
+
+    /// Мьютекс для вызовов из нескольких задач (MSC и Poll())
+    void SetMutex(ports::IMutex* mutex) { mutex_ = mutex; }
+
+    /// Main loop: одна порция переноса
+    /// @return Журнал пуст
+    bool Poll();
+
+    [[nodiscard]] bool IsReady() const override { return opened_ && device_.IsReady(); }
+    [[nodiscard]] uint32_t GetBlockCount() const override { return opened_ ? data_count_ : 0; }
+    [[nodiscard]] uint32_t GetBlockSize() const override { return kBlockSize; }
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override;
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override;
+    /// Перенести весь журнал и синхронизировать устройство
+    bool Sync() override;
+
+    /// Занято слотов (описатели, живые и перезаписанные копии)
+    uint32_t GetJournalUsed() const;
+
+    /// Первый блок журнала на устройстве (заголовок — за последним слотом)
+    uint32_t GetJournalLba() const { return data_count_; }
+
+    JournalStats GetStats() const;
+    void ResetStats();
+
+private:
+    using Map = SlotMap<USB_JOURNAL_MAP_SIZE>;
+    using Entry = Map::Entry;
+    static constexpr uint32_t kNone = Map::kNone;
+    /// Слот описателя записи в slot_lba_
+    static constexpr uint32_t kDescriptor = 0xFFFFFFFE;
+
+    /// Геометрия журнала по конфигурации, таблица пуста
+    bool Layout();
+    /// Заголовок разметки в copy_
+    void BuildHeader();
+    /// Восстановить таблицу по записям журнала (Open)
+    bool Replay();
+
+    /// Слоты подряд через конец кольца — одной или двумя командами
+    bool ReadSlots(uint32_t slot, uint8_t* buffer, uint32_t count);
+    bool WriteSlots(uint32_t slot, const uint8_t* buffer, uint32_t count);
+    /// Блоки [lba, lba + count) теперь в слотах подряд от slot
+    void Commit(uint32_t lba, uint32_t count, uint32_t slot);
+    /// Хотя бы один блок диапазона в журнале
+    bool Journaled(uint32_t lba, uint32_t count);
+    /// Хотя бы один блок диапазона в перенесённых слотах, которые Open() повторит
+    bool Replayable(uint32_t lba, uint32_t count) const;
+
+    /// Одна запись в голову: описатель и count (≤ kRecordBlocks) блоков
+    bool WriteRecord(uint32_t lba, const uint8_t* data, uint32_t count);
+    /// Пустая запись-отметка: текущий хвост для Open()
+    bool Checkpoint();
+    bool Append(uint32_t lba, const uint8_t* buffer, uint32_t count);
+    bool WriteDirect(uint32_t lba, const uint8_t* buffer, uint32_t count);
+    /// Перенести целые записи с хвоста журнала: до max_slots слотов, хотя бы одну
+    bool Compact(uint32_t max_slots);
+    bool WriteBack(const Entry* batch, uint32_t count);
+
+    void Lock() const;
+    void Unlock() const;
+
+    ports::IBlockDevice& device_;
+    JournalConfig config_;
+    ports::IMutex* mutex_ = nullptr;
+    bool opened_ = false;
+
+    uint32_t data_count_ = 0;   ///< Блоков до журнала (GetBlockCount)
+    uint32_t capacity_ = 0;     ///< Слотов журнала
+    uint32_t head_ = 0;         ///< Следующий слот записи
+    uint32_t tail_ = 0;         ///< Старейший слот
+    uint32_t used_ = 0;
+    uint32_t seq_ = 0;          ///< Номер следующей записи
+    uint32_t tail_seq_ = 0;     ///< Номер записи на хвосте
+    uint32_t stale_ = 0;        ///< Слотов перенесено после последней записи (Open() их повторит)
+    bool head_unsure_ = false;  ///< Запись в голову не удалась: описатель мог остаться на носителе
+
+    Map map_;
+    uint32_t slot_lba_[kMaxSlots];  ///< Слот → блок (kNone — перезаписан, kDescriptor)
+    Entry batch_[USB_JOURNAL_BATCH];
+    alignas(4) uint8_t copy_[USB_JOURNAL_COPY_BLOCKS * kBlockSize];
+
+    JournalStats stats_{};
+};
+
+}  // namespace usb
@@ -0,0 +1,175 @@
+/**
+ * @file usb_memory.h
+ * @brief Статическая память библиотеки: арена буферов и отчёт о размере
+ *
+ * Куча не используется. Буферы библиотеки (кольца vendor, трасса MSC)
+ * собраны в одну статическую арену, буферы TinyUSB (FIFO CDC и vendor,
+ * EP буфер MSC, буфер DFU) объявлены с CFG_TUSB_MEM_SECTION. Объекты
+ * приложения (SdmmcBlockDevice, журналы, разделы) держат буферы в себе и
+ * размещаются там, где их объявили.
+ *
+ * - USB_ARENA_SECTION: имя секции для арены и буферов TinyUSB, например
+ *   ".dma_buffer" (см. linker/stm32h7_dma_section.ld). Секция NOLOAD не
+ *   обнуляется — кольца очищает UsbDevice::Init().
+ * - USB_RAM_BUDGET и USB_RAM_BUDGET_<функция>: предел байт, превышение —
+ *   ошибка сборки (static_assert). 0 — без проверки.
+ *
+ * Отчёт — constexpr, по включённым флагам:
+ * @code
+ * static_assert(usb::memory::kTotalBytes < 16 * 1024, "USB RAM");
+ * for (const usb::memory::Footprint& f : usb::memory::kFootprint) {
+ *     printf("%-10s %6u\n", f.name, static_cast<unsigned>(f.bytes));
+ * }
+ * @endcode
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "tusb_config.h"
+#include "usb_composite.h"
+#include "usb_sdmmc.h"
+
+// Секция арены (и CFG_TUSB_MEM_SECTION по умолчанию, см. usb_composite_config.h).
+// USB_VENDOR_DMA_SECTION без USB_ARENA_SECTION — арена в .dma_buffer, как раньше кольца
+#if defined(USB_ARENA_SECTION)
+#define USB_ARENA_ATTR __attribute__((section(USB_ARENA_SECTION), aligned(32)))
+#elif defined(USB_VENDOR_DMA_SECTION)
+#define USB_ARENA_ATTR __attribute__((section(".dma_buffer"), aligned(32)))
+#else
+#define USB_ARENA_ATTR __attribute__((aligned(32)))
+#endif
+
+#ifndef USB_RAM_BUDGET
+#define USB_RAM_BUDGET 0
+#endif
+#ifndef USB_RAM_BUDGET_CDC
+#define USB_RAM_BUDGET_CDC 0
+#endif
+#ifndef USB_RAM_BUDGET_MSC
+#define USB_RAM_BUDGET_MSC 0
+#endif
+#ifndef USB_RAM_BUDGET_VENDOR
+#define USB_RAM_BUDGET_VENDOR 0
+#endif
+#ifndef USB_RAM_BUDGET_DFU
+#define USB_RAM_BUDGET_DFU 0
+#endif
+#ifndef USB_RAM_BUDGET_SDMMC
+#define USB_RAM_BUDGET_SDMMC 0
+#endif
+
+namespace usb {
+namespace memory {
+
+/**
+ * @brief Арена: все статические буферы библиотеки одним объектом
+ *
+ * Единственный экземпляр — в usb_composite.cpp (USB_ARENA_ATTR).
+ */
+struct Arena {
+#ifdef USB_VENDOR_ENABLED
+    StreamRing<USB_VENDOR_RING_BUFFERS, USB_VENDOR_BUFFER_SIZE> vendor_tx;
+    StreamRing<USB_VENDOR_RING_BUFFERS, USB_VENDOR_BUFFER_SIZE> vendor_rx;
+#endif
+#if defined(USB_MSC_ENABLED) && defined(USB_MSC_TRACE_ENABLED)
+    MscTraceRing msc_trace;
+#endif
+};
+
+/// Строка отчёта: функция и её статические байты
+struct Footprint {
+    const char* name;
+    uint32_t bytes;
+};
+
+// ============ TinyUSB (CFG_TUSB_MEM_SECTION) ============
+
+#if CFG_TUD_CDC
+/// FIFO RX/TX и EP буферы CDC
+inline constexpr uint32_t kCdcBytes =
+    CFG_TUD_CDC_RX_BUFSIZE + CFG_TUD_CDC_TX_BUFSIZE + 2 * CFG_TUD_CDC_EP_BUFSIZE;
+#else
+inline constexpr uint32_t kCdcBytes = 0;
+#endif
+
+#if CFG_TUD_MSC
+/// EP буфер MSC: наибольший кусок READ10/WRITE10 за один callback
+inline constexpr uint32_t kMscBytes = CFG_TUD_MSC_EP_BUFSIZE;
+#else
+inline constexpr uint32_t kMscBytes = 0;
+#endif
+
+#if CFG_TUD_VENDOR
+/// FIFO и EP буферы vendor класса
+inline constexpr uint32_t kVendorFifoBytes =
+    CFG_TUD_VENDOR_RX_BUFSIZE + CFG_TUD_VENDOR_TX_BUFSIZE + 2 * CFG_TUD_VENDOR_EPSIZE;
+#else
+inline constexpr uint32_t kVendorFifoBytes = 0;
+#endif
+
+#if CFG_TUD_DFU
+inline constexpr uint32_t kDfuBytes = CFG_TUD_DFU_XFER_BUFSIZE;
+#else
+inline constexpr uint32_t kDfuBytes = 0;
+#endif
+
+// ============ Арена ============
+
+#ifdef USB_VENDOR_ENABLED
+inline constexpr uint32_t kVendorRingBytes =
+    2 * sizeof(StreamRing<USB_VENDOR_RING_BUFFERS, USB_VENDOR_BUFFER_SIZE>);
+#else
+inline constexpr uint32_t kVendorRingBytes = 0;
+#endif
+
+#if defined(USB_MSC_ENABLED) && defined(USB_MSC_TRACE_ENABLED)
+inline constexpr uint32_t kMscTraceBytes = sizeof(MscTraceRing);
+#else
+inline constexpr uint32_t kMscTraceBytes = 0;
+#endif
+
+inline constexpr uint32_t kArenaBytes = kVendorRingBytes + kMscTraceBytes;
+
+// ============ Объекты приложения ============
+
+#if defined(USB_MSC_ENABLED) && defined(USB_SDMMC_ENABLED)
+/// Один SdmmcBlockDevice (pImpl и буферы внутри объекта)
+inline constexpr uint32_t kSdmmcBytes = sizeof(SdmmcBlockDevice);
+#else
+inline constexpr uint32_t kSdmmcBytes = 0;
+#endif
+
+/// Статические байты библиотеки: TinyUSB, арена и один SdmmcBlockDevice
+inline constexpr uint32_t kTotalBytes =
+    kCdcBytes + kMscBytes + kVendorFifoBytes + kDfuBytes + kArenaBytes + kSdmmcBytes;
+
+/// Отчёт по функциям (выключенные — 0 байт)
+inline constexpr Footprint kFootprint[] = {
+    {"cdc", kCdcBytes},
+    {"msc", kMscBytes},
+    {"vendor", kVendorFifoBytes + kVendorRingBytes},
+    {"dfu", kDfuBytes},
+    {"msc_trace", kMscTraceBytes},
+    {"sdmmc", kSdmmcBytes},
+};
+
+// ============ Бюджеты ============
+
+static_assert(USB_RAM_BUDGET == 0 || kTotalBytes <= USB_RAM_BUDGET,
+              "USB library RAM exceeds USB_RAM_BUDGET");
+static_assert(USB_RAM_BUDGET_CDC == 0 || kCdcBytes <= USB_RAM_BUDGET_CDC,
+              "CDC buffers exceed USB_RAM_BUDGET_CDC");
+static_assert(USB_RAM_BUDGET_MSC == 0 || kMscBytes + kMscTraceBytes <= USB_RAM_BUDGET_MSC,
+              "MSC buffers exceed USB_RAM_BUDGET_MSC");
+static_assert(USB_RAM_BUDGET_VENDOR == 0 ||
+                  kVendorFifoBytes + kVendorRingBytes <= USB_RAM_BUDGET_VENDOR,
+              "Vendor buffers exceed USB_RAM_BUDGET_VENDOR");
+static_assert(USB_RAM_BUDGET_DFU == 0 || kDfuBytes <= USB_RAM_BUDGET_DFU,
+              "DFU buffer exceeds USB_RAM_BUDGET_DFU");
+static_assert(USB_RAM_BUDGET_SDMMC == 0 || kSdmmcBytes <= USB_RAM_BUDGET_SDMMC,
+              "SdmmcBlockDevice exceeds USB_RAM_BUDGET_SDMMC");
+
+}  // namespace memory
+}  // namespace usb
@@ -0,0 +1,244 @@
+/**
+ * @file usb_msc_binding.h
+ * @brief Привязка MSC к конкретному типу блочного устройства (без виртуальных вызовов)
+ *
+ * UsbDevice::MscAttach(device) по ссылке на конкретный тип создаёт
+ * MscBinding<Device>: callbacks MSC вызывают одну функцию-переходник на кусок
+ * EP буфера, а внутри неё IsReady()/Read()/Write() устройства вызываются
+ * напрямую (Device::Read) и встраиваются компилятором. Геометрия кэшируется
+ * при подключении и в READ CAPACITY; если у типа есть
+ * `static constexpr uint32_t kBlockSize`, размер блока известен при компиляции.
+ *
+ * MscAttach(IBlockDevice*) — прежний путь через vtable (MscBinding<IBlockDevice>),
+ * например для декораторов, выбираемых при выполнении.
+ *
+ * Требования к Device:
+ * - bool IsReady() const
+ * - uint32_t GetBlockCount() const
+ * - uint32_t GetBlockSize() const или static constexpr uint32_t kBlockSize
+ * - bool Read(uint32_t lba, uint8_t* buffer, uint32_t count)
+ * - bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count)
+ * - необязательно: bool IsWriteProtected() const (нет — носитель записываемый)
+ * - необязательно: bool Sync() — SYNCHRONIZE CACHE и eject (нет — нечего сбрасывать)
+ *
+ * @note Методы вызываются как Device::Read — привязывайте объект по его
+ *       настоящему типу, а не по базовому классу с переопределёнными методами.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace usb {
+
+/// Размер блока типа при компиляции (0 — только GetBlockSize())
+template <typename Device, typename = void>
+struct StaticBlockSize : std::integral_constant<uint32_t, 0> {};
+
+template <typename Device>
+struct StaticBlockSize<Device, std::void_t<decltype(Device::kBlockSize)>>
+    : std::integral_constant<uint32_t, Device::kBlockSize> {};
+
+/// Тип сообщает защиту от записи (IsWriteProtected())
+template <typename Device, typename = void>
+struct HasWriteProtect : std::false_type {};
+
+template <typename Device>
+struct HasWriteProtect<
+    Device, std::void_t<decltype(std::declval<const Device&>().IsWriteProtected())>>
+    : std::true_type {};
+
+/// Тип сбрасывает отложенные записи (Sync())
+template <typename Device, typename = void>
+struct HasSync : std::false_type {};
+
+template <typename Device>
+struct HasSync<Device, std::void_t<decltype(std::declval<Device&>().Sync())>>
+    : std::true_type {};
+
+/// Переходники MSC для одного типа устройства (одна таблица на тип, во flash)
+struct MscOps {
+    /// Готовность устройства
+    bool (*is_ready)(const void* device);
+    /// Хост может писать (false — MODE SENSE с битом WP, WRITE10 → DATA PROTECT)
+    bool (*is_writable)(const void* device);
+    /// Геометрия: false — устройство не готово
+    bool (*geometry)(const void* device, uint32_t* block_count, uint32_t* block_size);
+    /**
+     * Кусок READ10/WRITE10
+     * @return Обработано блоков (0 — кусок меньше блока), -1 — ошибка
+     */
+    int32_t (*transfer)(void* device, bool write, uint32_t lba, uint8_t* buffer,
+                        uint32_t bufsize, uint32_t block_size);
+    /// Сбросить отложенные записи на носитель (SYNCHRONIZE CACHE, eject)
+    bool (*sync)(void* device);
+    /// Размер блока при компиляции (0 — из кэша геометрии)
+    uint32_t static_block_size;
+};
+
+/// Подключённое устройство MSC: переходники + кэш геометрии
+struct MscBindingState {
+    const MscOps* ops = nullptr;
+    void* device = nullptr;
+    uint32_t block_count = 0;   ///< Кэш GetBlockCount() (0 — не готово при подключении)
+    uint32_t block_size = 0;    ///< Кэш размера блока
+
+    bool IsBound() const { return ops != nullptr; }
+
+    bool IsReady() const { return ops->is_ready(device); }
+
+    bool IsWritable() const { return ops->is_writable(device); }
+
+    /// Размер блока: при компиляции или из кэша геометрии
+    uint32_t BlockSize() const {
+        return ops->static_block_size != 0 ? ops->static_block_size : block_size;
+    }
+
+    /// Перечитать геометрию (подключение, READ CAPACITY)
+    bool RefreshGeometry() {
+        uint32_t count = 0;
+        uint32_t size = 0;
+        if (!ops->geometry(device, &count, &size)) {
+            return false;
+        }
+        block_count = count;
+        block_size = size;
+        return true;
+    }
+
+    /// Кусок EP буфера; размер блока — из кэша (перечитывается, если кэш пуст)
+    int32_t Transfer(bool write, uint32_t lba, uint8_t* buffer, uint32_t bufsize) {
+        if (ops->static_block_size == 0 && block_size == 0 && !RefreshGeometry()) {
+            return -1;
+        }
+        return ops->transfer(device, write, lba, buffer, bufsize, block_size);
+    }
+
+    bool Sync() { return ops->sync(device); }
+};
+
+/**
+ * @brief Переходники MSC для типа Device
+ *
+ * Для абстрактного Device (IBlockDevice) вызовы идут через vtable,
+ * для конкретного — напрямую.
+ */
+template <typename Device>
+class MscBinding {
+public:
+    static constexpr uint32_t kBlockSize = StaticBlockSize<Device>::value;
+
+    /// Таблица переходников (константная инициализация — во flash)
+    static const MscOps kOps;
+
+    /// Привязка без геометрии (её читает MscAttach() под MscMutex)
+    static MscBindingState Bind(Device& device) {
+        MscBindingState state;
+        state.ops = &kOps;
+        state.device = &device;
+        return state;
+    }
+
+private:
+    static constexpr bool kDirect = !std::is_abstract_v<Device>;
+
+    static bool DeviceReady(const Device& device) {
+        if constexpr (kDirect) {
+            return device.Device::IsReady();
+        } else {
+            return device.IsReady();
+        }
+    }
+
+    static uint32_t DeviceBlockSize(const Device& device) {
+        if constexpr (kBlockSize != 0) {
+            (void)device;
+            return kBlockSize;
+        } else if constexpr (kDirect) {
+            return device.Device::GetBlockSize();
+        } else {
+            return device.GetBlockSize();
+        }
+    }
+
+    static bool IsReady(const void* device) {
+        return DeviceReady(*static_cast<const Device*>(device));
+    }
+
+    static bool IsWritable(const void* context) {
+        if constexpr (!HasWriteProtect<Device>::value) {
+            (void)context;
+            return true;
+        } else if constexpr (kDirect) {
+            return !static_cast<const Device*>(context)->Device::IsWriteProtected();
+        } else {
+            return !static_cast<const Device*>(context)->IsWriteProtected();
+        }
+    }
+
+    static bool Geometry(const void* context, uint32_t* block_count, uint32_t* block_size) {
+        const Device& device = *static_cast<const Device*>(context);
+        if (!DeviceReady(device)) {
+            return false;
+        }
+        if constexpr (kDirect) {
+            *block_count = device.Device::GetBlockCount();
+        } else {
+            *block_count = device.GetBlockCount();
+        }
+        *block_size = DeviceBlockSize(device);
+        return true;
+    }
+
+    static int32_t Transfer(void* context, bool write, uint32_t lba, uint8_t* buffer,
+                            uint32_t bufsize, uint32_t block_size) {
+        Device& device = *static_cast<Device*>(context);
+        if (!DeviceReady(device)) {
+            return -1;
+        }
+        uint32_t block_count;
+        if constexpr (kBlockSize != 0) {
+            (void)block_size;
+            block_count = bufsize / kBlockSize;  // Константа — сдвиг вместо деления
+        } else {
+            block_count = bufsize / block_size;
+        }
+        if (block_count == 0) {
+            return 0;
+        }
+        bool ok;
+        if constexpr (kDirect) {
+            ok = write ? device.Device::Write(lba, buffer, block_count)
+                       : device.Device::Read(lba, buffer, block_count);
+        } else {
+            ok = write ? device.Write(lba, buffer, block_count)
+                       : device.Read(lba, buffer, block_count);
+        }
+        return ok ? static_cast<int32_t>(block_count) : -1;
+    }
+
+    static bool Sync(void* context) {
+        if constexpr (!HasSync<Device>::value) {
+            (void)context;
+            return true;
+        } else if constexpr (kDirect) {
+            return static_cast<Device*>(context)->Device::Sync();
+        } else {
+            return static_cast<Device*>(context)->Sync();
+        }
+    }
+};
+
+template <typename Device>
+const MscOps MscBinding<Device>::kOps = {
+    MscBinding<Device>::IsReady,
+    MscBinding<Device>::IsWritable,
+    MscBinding<Device>::Geometry,
+    MscBinding<Device>::Transfer,
+    MscBinding<Device>::Sync,
+    MscBinding<Device>::kBlockSize,
+};
+
+}  // namespace usb
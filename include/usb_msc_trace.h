@@ -0,0 +1,122 @@
+/**
+ * @file usb_msc_trace.h
+ * @brief Трасса SCSI команд MSC (кольцевой буфер)
+ *
+ * Каждая завершённая команда (по CSW) пишет запись: время, opcode, LBA,
+ * длина, латентность и результат. Трассу можно выгрузить текстом (CSV)
+ * через CDC или в любой приёмник (например, виртуальный файл) и
+ * воспроизвести на host против любого IBlockDevice (libs/bench TraceReplay.hpp).
+ *
+ * Активация через флаги компиляции:
+ * - USB_MSC_TRACE_ENABLED: запись трассы в MSC callbacks
+ * - USB_MSC_TRACE_DEPTH: глубина кольца, степень двойки (по умолчанию 256 записей, 4 KB)
+ *
+ * Время берётся из источника проб (usb_profile.h): DWT / std::chrono / ProfileSetClock().
+ * Метка времени накапливается между командами, поэтому хост должен слать
+ * команды чаще переполнения счётчика (~8.9 с для DWT на 480 МГц) — TUR опрос
+ * всех ОС укладывается.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#ifndef USB_MSC_TRACE_DEPTH
+#define USB_MSC_TRACE_DEPTH 256
+#endif
+
+namespace usb {
+
+static constexpr uint32_t kMscTraceDepth = USB_MSC_TRACE_DEPTH;
+static_assert((kMscTraceDepth & (kMscTraceDepth - 1)) == 0,
+              "USB_MSC_TRACE_DEPTH must be a power of two");
+
+/// Результат команды в трассе
+enum class MscTraceStatus : uint8_t {
+    Passed = 0,
+    Failed = 1,
+};
+
+/// Запись трассы (16 байт)
+struct MscTraceEntry {
+    uint32_t timestamp_us = 0;  ///< Начало команды
+    uint32_t lba = 0;           ///< READ10/WRITE10: начальный LBA
+    uint32_t latency_us = 0;    ///< От первого callback до CSW
+    uint16_t blocks = 0;        ///< READ10/WRITE10: число блоков
+    uint8_t opcode = 0;         ///< SCSI opcode
+    MscTraceStatus status = MscTraceStatus::Passed;
+};
+
+static_assert(sizeof(MscTraceEntry) == 16, "MscTraceEntry layout");
+
+/// Заголовок CSV выгрузки
+static constexpr const char kMscTraceCsvHeader[] = "t_us,op,lba,blocks,status,latency_us\n";
+
+/// Приёмник текстовой выгрузки (CDC, виртуальный файл, ...)
+/// @return false — прервать выгрузку
+using MscTraceWriteFn = bool (*)(const char* data, uint32_t len, void* context);
+
+/// Строка CSV для записи
+/// @return Длина строки (без '\0'), 0 если буфер мал
+uint32_t MscTraceFormatCsv(const MscTraceEntry& entry, char* out, size_t out_size);
+
+/**
+ * @brief Кольцо записей трассы
+ *
+ * Один писатель (контекст tud_task), читатели — снимком из любого контекста.
+ * При переполнении затираются самые старые записи.
+ */
+class MscTraceRing {
+public:
+    void Push(const MscTraceEntry& entry) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        entries_[head & (kMscTraceDepth - 1)] = entry;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    /// Всего записано команд (включая затёртые)
+    uint32_t TotalCount() const { return head_.load(std::memory_order_acquire); }
+
+    /// Записей в кольце
+    uint32_t Count() const {
+        uint32_t total = TotalCount();
+        return total < kMscTraceDepth ? total : kMscTraceDepth;
+    }
+
+    /// Копия записей от старых к новым
+    /// @return Число скопированных записей
+    uint32_t Snapshot(MscTraceEntry* out, uint32_t max_entries) const {
+        uint32_t head = TotalCount();
+        uint32_t count = head < kMscTraceDepth ? head : kMscTraceDepth;
+        if (count > max_entries) {
+            count = max_entries;
+        }
+        uint32_t first = head - count;
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = entries_[(first + i) & (kMscTraceDepth - 1)];
+        }
+        return count;
+    }
+
+    /// Запись по абсолютному номеру команды
+    /// @return false если запись ещё не сделана или уже затёрта
+    bool At(uint32_t seq, MscTraceEntry* out) const {
+        uint32_t head = TotalCount();
+        if (seq >= head || head - seq > kMscTraceDepth) {
+            return false;
+        }
+        *out = entries_[seq & (kMscTraceDepth - 1)];
+        // Писатель мог затереть запись во время копирования
+        return TotalCount() - seq <= kMscTraceDepth;
+    }
+
+    void Clear() { head_.store(0, std::memory_order_release); }
+
+private:
+    MscTraceEntry entries_[kMscTraceDepth];
+    std::atomic<uint32_t> head_{0};
+};
+
+}  // namespace usb
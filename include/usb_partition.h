@@ -0,0 +1,216 @@
+/**
+ * @file usb_partition.h
+ * @brief Один раздел MBR/GPT как отдельное блочное устройство
+ *
+ * PartitionBlockDevice — вид на раздел нижнего IBlockDevice. Таблица
+ * разделов разбирается один раз в Open(), дальше Read()/Write() только
+ * проверяют диапазон и прибавляют смещение к LBA. Так хосту по MSC
+ * отдаётся раздел пользователя, а прошивка пишет в свой раздел (второй
+ * вид над той же картой) без посредников.
+ *
+ * Виды:
+ * - PartitionView::Mbr — LBA 0 вида — синтезированный MBR с одной записью,
+ *   раздел начинается с view_offset (1 MiB, как у разметчиков ОС), блоки
+ *   между ними читаются нулями. Таблица карты (в том числе GPT с разделами,
+ *   недоступными хосту) не видна.
+ * - PartitionView::Volume — раздел с LBA 0 ("superfloppy", без таблицы):
+ *   загрузочный сектор тома в LBA 0, чистое смещение без синтеза.
+ *
+ * Запись хоста в синтезированную область принимается, только если совпадает
+ * с ней (ОС перезаписывает MBR без изменений), иначе — ошибка записи.
+ *
+ * Поддерживаются блоки 512 байт (SD, eMMC). Активация: USB_PARTITION_ENABLED.
+ *
+ * @code
+ * usb::SdmmcBlockDevice g_sd;
+ * usb::PartitionConfig user_config;
+ * user_config.index = 1;                    // Раздел 0 — журнал прошивки
+ * usb::PartitionBlockDevice g_user(g_sd, user_config);
+ *
+ * usb::PartitionConfig log_config;
+ * log_config.index = 0;
+ * log_config.view = usb::PartitionView::Volume;
+ * usb::PartitionBlockDevice g_log(g_sd, log_config);
+ *
+ * g_sd.Init();
+ * g_user.Open();
+ * g_log.Open();
+ * g_usb.MscAttach(g_user);                  // Хост видит только раздел 1
+ * @endcode
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "ports/IBlockDevice.hpp"
+
+namespace usb {
+
+//--------------------------------------------------------------------+
+// Таблицы разделов
+//--------------------------------------------------------------------+
+
+namespace part {
+
+static constexpr uint32_t kSectorSize = 512;
+
+// MBR
+static constexpr uint32_t kMbrDiskSignatureOffset = 440;
+static constexpr uint32_t kMbrEntriesOffset = 446;
+static constexpr uint32_t kMbrEntrySize = 16;
+static constexpr uint32_t kMbrEntryCount = 4;
+static constexpr uint32_t kMbrBootSignatureOffset = 510;
+
+// Типы записей MBR
+static constexpr uint8_t kTypeEmpty = 0x00;
+static constexpr uint8_t kTypeFat12 = 0x01;
+static constexpr uint8_t kTypeFat16Lba = 0x0E;
+static constexpr uint8_t kTypeFat32Lba = 0x0C;
+static constexpr uint8_t kTypeExfat = 0x07;  ///< Также NTFS
+static constexpr uint8_t kTypeGptProtective = 0xEE;
+
+// GPT
+static constexpr uint32_t kGptHeaderLba = 1;
+static constexpr uint32_t kGptHeaderMinSize = 92;
+static constexpr uint32_t kGptEntryMinSize = 128;
+
+}  // namespace part
+
+/// Разметка нижнего устройства
+enum class PartitionScheme : uint8_t {
+    None,      ///< Таблица не найдена (или границы заданы явно)
+    Mbr,
+    Gpt,
+};
+
+/// Что видит пользователь вида (хост MSC)
+enum class PartitionView : uint8_t {
+    Mbr,       ///< Синтезированный MBR с одной записью, раздел с view_offset
+    Volume,    ///< Раздел с LBA 0, без таблицы
+};
+
+/// Выбор раздела и вид
+struct PartitionConfig {
+    uint8_t index = 0;                    ///< MBR: первичная запись 0..3, GPT: запись массива
+    PartitionView view = PartitionView::Mbr;
+    uint32_t view_offset = 2048;          ///< Начало раздела в виде Mbr, блоков (1 MiB)
+    uint8_t mbr_type = 0;                 ///< Тип записи вида Mbr (0 — из MBR / по тому)
+    uint32_t disk_signature = 0x55534243; ///< Подпись диска в синтезированном MBR (не 0)
+
+    /// Явные границы (block_count != 0 — таблица не читается)
+    uint32_t first_lba = 0;
+    uint32_t block_count = 0;
+};
+
+/// Найденный раздел (снимок, POD)
+struct PartitionInfo {
+    PartitionScheme scheme = PartitionScheme::None;
+    uint32_t first_lba = 0;               ///< Начало на нижнем устройстве
+    uint32_t block_count = 0;
+    uint8_t mbr_type = 0;                 ///< Тип записи вида Mbr
+};
+
+/// Счётчики вида (снимок, POD)
+struct PartitionStats {
+    uint32_t header_reads = 0;            ///< Чтений синтезированной области
+    uint32_t header_writes = 0;           ///< Записей в неё без изменений
+    uint32_t rejected_writes = 0;         ///< Записей, меняющих синтезированную область
+    uint32_t range_errors = 0;            ///< Обращений за границу вида
+};
+
+/**
+ * @brief Раздел нижнего IBlockDevice как самостоятельное блочное устройство
+ *
+ * Open() — из того же контекста, что и ввод-вывод (до MscAttach() или при
+ * смене карты). Read()/Write() потокобезопасны настолько, насколько нижнее
+ * устройство: состояние вида после Open() не меняется.
+ */
+class PartitionBlockDevice final : public ports::IBlockDevice {
+public:
+    static constexpr uint32_t kBlockSize = part::kSectorSize;
+
+    explicit PartitionBlockDevice(ports::IBlockDevice& device,
+                                  const PartitionConfig& config = PartitionConfig{})
+        : device_(device), config_(config) {}
+
+    /**
+     * @brief Разобрать таблицу и найти раздел
+     *
+     * MBR с защитной записью 0xEE — GPT (заголовок проверяется по CRC32).
+     * @return false — устройство не готово, таблицы или записи нет,
+     *         раздел выходит за устройство
+     */
+    bool Open();
+
+    /// Закрыть вид (IsReady() == false до следующего Open())
+    void Close() {
+        opened_ = false;
+        view_count_ = 0;
+    }
+
+    bool IsOpen() const { return opened_; }
+
+    // IBlockDevice
+    [[nodiscard]] bool IsReady() const override { return opened_ && device_.IsReady(); }
+    [[nodiscard]] uint32_t GetBlockCount() const override { return view_count_; }
+    [[nodiscard]] uint32_t GetBlockSize() const override { return kBlockSize; }
+
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override {
+        if (count > view_count_ || lba > view_count_ - count) {
+            stats_.range_errors++;
+            return false;
+        }
+        if (lba >= data_lba_) {
+            return device_.Read(lba + delta_, buffer, count);  // Смещение по модулю 2^32
+        }
+        return ReadHeader(lba, buffer, count);
+    }
+
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override {
+        if (count > view_count_ || lba > view_count_ - count) {
+            stats_.range_errors++;
+            return false;
+        }
+        if (lba >= data_lba_) {
+            return device_.Write(lba + delta_, buffer, count);
+        }
+        return WriteHeader(lba, buffer, count);
+    }
+
+    bool Sync() override { return device_.Sync(); }
+
+    /// Раздел на нижнем устройстве (после Open())
+    PartitionInfo GetInfo() const { return info_; }
+
+    /// Первый блок раздела в виде (view_offset для Mbr, 0 для Volume)
+    uint32_t GetDataLba() const { return data_lba_; }
+
+    PartitionStats GetStats() const { return stats_; }
+    void ResetStats() { stats_ = PartitionStats{}; }
+
+private:
+    bool FindPartition(uint8_t* sector);
+    bool ParseMbr(const uint8_t* sector);
+    bool ParseGpt(uint8_t* sector);
+    uint8_t DetectType(uint8_t* sector);
+
+    /// Блок синтезированной области (MBR или нули)
+    void HeaderSector(uint32_t lba, uint8_t* out) const;
+    bool ReadHeader(uint32_t lba, uint8_t* buffer, uint32_t count);
+    bool WriteHeader(uint32_t lba, const uint8_t* buffer, uint32_t count);
+
+    ports::IBlockDevice& device_;
+    PartitionConfig config_;
+    PartitionInfo info_{};
+    bool opened_ = false;
+
+    // Горячий путь: LBA вида >= data_lba_ → LBA устройства = LBA + delta_
+    uint32_t view_count_ = 0;
+    uint32_t data_lba_ = 0;
+    uint32_t delta_ = 0;
+
+    PartitionStats stats_{};
+};
+
+}  // namespace usb
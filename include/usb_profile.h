@@ -0,0 +1,167 @@
+/**
+ * @file usb_profile.h
+ * @brief Профилирование горячего пути USB (латентность в микросекундах)
+ *
+ * Пробы USB_PROBE() расставлены вокруг:
+ * - tud_msc_read10_cb / tud_msc_write10_cb
+ * - передач SdmmcBlockDevice (ReadDirect / WriteDirect)
+ * - tud_task() в UsbDevice::Process()
+ * - tud_cdc_write / tud_cdc_write_flush в UsbDevice::CdcWrite()
+ * - от прерывания USB (UsbDevice::HandleInterrupt) до tud_task() в Process()
+ *
+ * Каждая точка пишет в гистограмму log2 фиксированного размера (без аллокаций).
+ *
+ * Активация через флаг компиляции:
+ * - USB_PROFILE_ENABLED: пробы включены; без флага USB_PROBE() не генерирует кода,
+ *   а гистограммы остаются пустыми
+ *
+ * Источник времени:
+ * - STM32H7: DWT CYCCNT (разрешение 1 такт ядра)
+ * - native: std::chrono::steady_clock
+ * - либо любой ports::IClock через ProfileSetClock() (например, SimClock в тестах)
+ *
+ * @note Не потокобезопасно: пробы и чтение гистограмм — из контекста main loop
+ */
+
+#pragma once
+
+#include "ports/IClock.hpp"
+#include <cstdint>
+
+namespace usb {
+
+/// Точки измерения
+enum class ProbePoint : uint8_t {
+    MscRead = 0,    ///< tud_msc_read10_cb
+    MscWrite,       ///< tud_msc_write10_cb
+    SdRead,         ///< SdmmcBlockDevice: чтение с карты
+    SdWrite,        ///< SdmmcBlockDevice: запись на карту (включая ожидание busy)
+    TudTask,        ///< tud_task()
+    CdcWrite,       ///< tud_cdc_write()
+    CdcFlush,       ///< tud_cdc_write_flush()
+    UsbWakeup,      ///< Прерывание USB → обслуживание в Process()
+    Count
+};
+
+constexpr uint32_t kProbePointCount = static_cast<uint32_t>(ProbePoint::Count);
+
+/// Имя точки измерения (для отчётов)
+const char* ProbePointName(ProbePoint point);
+
+/**
+ * @brief Гистограмма латентности с корзинами по степеням двойки
+ *
+ * Корзина 0 — 0 мкс, корзина k — [2^(k-1), 2^k - 1] мкс,
+ * последняя корзина собирает всё от 2^(kBuckets-2) мкс (~262 мс) и выше.
+ */
+struct LatencyHistogram {
+    static constexpr uint32_t kBuckets = 20;
+
+    uint32_t buckets[kBuckets] = {};
+    uint32_t count = 0;
+    uint32_t min_us = 0;
+    uint32_t max_us = 0;
+    uint64_t total_us = 0;
+
+    /// Индекс корзины для значения
+    static constexpr uint32_t BucketOf(uint32_t us) {
+        uint32_t bucket = (us == 0) ? 0 : 32U - static_cast<uint32_t>(__builtin_clz(us));
+        return bucket < kBuckets ? bucket : kBuckets - 1;
+    }
+
+    /// Верхняя граница корзины в мкс
+    static constexpr uint32_t BucketUpperUs(uint32_t bucket) {
+        return bucket == 0 ? 0 : (1U << bucket) - 1U;
+    }
+
+    void Record(uint32_t us) {
+        buckets[BucketOf(us)]++;
+        if (count == 0 || us < min_us) {
+            min_us = us;
+        }
+        if (us > max_us) {
+            max_us = us;
+        }
+        count++;
+        total_us += us;
+    }
+
+    /// Среднее значение в мкс
+    uint32_t MeanUs() const {
+        return count == 0 ? 0 : static_cast<uint32_t>(total_us / count);
+    }
+
+    /// Оценка перцентиля сверху (граница корзины, не больше max_us)
+    /// @param permille Перцентиль в промилле (500 = p50, 990 = p99)
+    uint32_t PercentileUs(uint32_t permille) const {
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t target = (static_cast<uint64_t>(count) * permille + 999) / 1000;
+        if (target == 0) {
+            target = 1;
+        }
+        uint64_t seen = 0;
+        for (uint32_t b = 0; b < kBuckets; b++) {
+            seen += buckets[b];
+            if (seen >= target) {
+                uint32_t upper = BucketUpperUs(b);
+                return (b == kBuckets - 1 || upper > max_us) ? max_us : upper;
+            }
+        }
+        return max_us;
+    }
+
+    void Reset() { *this = LatencyHistogram{}; }
+};
+
+//--------------------------------------------------------------------+
+// Глобальный профилировщик
+//--------------------------------------------------------------------+
+
+/// Источник времени для проб (nullptr = встроенный DWT / std::chrono)
+void ProfileSetClock(const ports::IClock* clock);
+
+/// Текущее значение счётчика проб (такты DWT или мкс)
+uint32_t ProfileNowTicks();
+
+/// Перевод разницы счётчика в мкс
+uint32_t ProfileTicksToUs(uint32_t ticks);
+
+/// Добавить измерение
+void ProfileRecord(ProbePoint point, uint32_t us);
+
+/// Гистограмма точки измерения
+const LatencyHistogram& ProfileGet(ProbePoint point);
+
+/// Сбросить все гистограммы
+void ProfileReset();
+
+/**
+ * @brief RAII проба: измеряет время жизни области видимости
+ */
+class ProbeScope {
+public:
+    explicit ProbeScope(ProbePoint point) : point_(point), start_(ProfileNowTicks()) {}
+    ~ProbeScope() { ProfileRecord(point_, ProfileTicksToUs(ProfileNowTicks() - start_)); }
+
+    ProbeScope(const ProbeScope&) = delete;
+    ProbeScope& operator=(const ProbeScope&) = delete;
+
+private:
+    ProbePoint point_;
+    uint32_t start_;
+};
+
+}  // namespace usb
+
+#define USB_PROBE_CONCAT_(a, b) a##b
+#define USB_PROBE_CONCAT(a, b)  USB_PROBE_CONCAT_(a, b)
+
+/// Проба до конца текущей области видимости: USB_PROBE(MscRead);
+#ifdef USB_PROFILE_ENABLED
+#define USB_PROBE(point) \
+    ::usb::ProbeScope USB_PROBE_CONCAT(usb_probe_, __LINE__)(::usb::ProbePoint::point)
+#else
+#define USB_PROBE(point) do {} while (0)
+#endif
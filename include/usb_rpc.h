@@ -0,0 +1,339 @@
+/**
+ * @file usb_rpc.h
+ * @brief Бинарный RPC поверх потока байт (CDC): кадры COBS, CRC-16, таблица обработчиков
+ *
+ * Кадр до COBS кодирования:
+ *
+ * | Поле       | Байт | Описание                                       |
+ * |------------|------|------------------------------------------------|
+ * | id         | 2    | Номер запроса (LE), ответ повторяет его        |
+ * | method     | 1    | Метод                                          |
+ * | status     | 1    | Запрос — 0, ответ — rpc::Status                |
+ * | payload    | N    | Данные                                         |
+ * | crc        | 2    | CRC-16/CCITT-FALSE всего предыдущего (BE)      |
+ *
+ * Кадр кодируется COBS и завершается байтом 0x00 — по нему приёмник
+ * синхронизируется после мусора или потерянных байт.
+ *
+ * Приём — FrameDecoder: байты FIFO раскодируются по одному прямо в буфер
+ * кадра, CRC считается на лету; закодированный кадр нигде не копится.
+ * Передача — FrameWriter: COBS блоками по 254 байта, CRC на лету,
+ * большой ответ уходит в TX FIFO по мере записи (память — один блок).
+ *
+ * Конвейер: хост может послать несколько запросов, не дожидаясь ответов.
+ * Обработчик отвечает сразу или возвращает Status::Deferred и отвечает
+ * позже (Server::BeginDeferred) — ответы сопоставляются по id.
+ *
+ * Активация: USB_RPC_ENABLED (UsbDevice::RpcAttach() / RpcPoll(), требует CDC).
+ * Сам протокол от USB не зависит и тестируется через любой транспорт.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "ports/IRtos.hpp"
+
+#ifndef USB_RPC_MAX_FRAME
+#define USB_RPC_MAX_FRAME 512  // Заголовок + данные + CRC принимаемого кадра, байт
+#endif
+
+#ifndef USB_RPC_MAX_METHODS
+#define USB_RPC_MAX_METHODS 16
+#endif
+
+#ifndef USB_RPC_MAX_PENDING
+#define USB_RPC_MAX_PENDING 4  // Отложенных ответов одновременно
+#endif
+
+namespace usb::rpc {
+
+static constexpr uint32_t kHeaderSize = 4;
+static constexpr uint32_t kCrcSize = 2;
+static constexpr uint32_t kOverhead = kHeaderSize + kCrcSize;
+static constexpr uint32_t kMaxFrame = USB_RPC_MAX_FRAME;
+static constexpr uint32_t kMaxPayload = kMaxFrame - kOverhead;
+
+static_assert(kMaxFrame > kOverhead, "USB_RPC_MAX_FRAME too small");
+
+/// Встроенный метод: ответ — эхо данных запроса (проверка связи, замер скорости)
+static constexpr uint8_t kMethodPing = 0x00;
+
+/// Статус ответа
+enum class Status : uint8_t {
+    Ok = 0,
+    UnknownMethod = 1,  ///< Метод не зарегистрирован
+    TooLarge = 2,       ///< Запрос длиннее USB_RPC_MAX_FRAME
+    Failed = 3,         ///< Обработчик вернул ошибку
+    Busy = 4,           ///< Таблица отложенных ответов заполнена
+    BadRequest = 5,     ///< Неверные данные запроса (на усмотрение обработчика)
+    Deferred = 0xFF,    ///< Только из обработчика: ответ будет позже (не передаётся)
+};
+
+/// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), продолжение с crc
+uint16_t Crc16(uint16_t crc, const uint8_t* data, size_t len);
+
+/// Приёмник закодированных байт (CDC, loopback, ...)
+/// @return false — транспорт отказал, кадр обрывается
+using WriteFn = bool (*)(const uint8_t* data, uint32_t len, void* context);
+
+//--------------------------------------------------------------------+
+// Кадры
+//--------------------------------------------------------------------+
+
+/// Раскодированный кадр (указатели — в буфер FrameDecoder, до следующего Feed)
+struct Frame {
+    uint16_t id = 0;
+    uint8_t method = 0;
+    uint8_t status = 0;
+    const uint8_t* payload = nullptr;
+    uint32_t length = 0;  ///< Байт данных
+};
+
+/// Итог приёма кадра
+enum class FrameResult : uint8_t {
+    Ok,
+    CrcError,  ///< CRC не сошёлся или кадр короче заголовка (id не доверять)
+    TooLarge,  ///< Длиннее буфера; заголовок (id, method) прочитан, данных нет
+};
+
+/**
+ * @brief Потоковый приём кадров COBS
+ *
+ * Feed() принимает произвольные куски потока; на каждый 0x00 вызывается
+ * обработчик с итогом кадра. Пустые кадры (0x00 подряд) пропускаются.
+ */
+class FrameDecoder {
+public:
+    using FrameFn = void (*)(const Frame& frame, FrameResult result, void* context);
+
+    FrameDecoder(uint8_t* buffer, uint32_t capacity) : buffer_(buffer), capacity_(capacity) {}
+
+    /// Раскодировать кусок потока
+    void Feed(const uint8_t* data, uint32_t len, FrameFn on_frame, void* context);
+
+    /// Сбросить недопринятый кадр
+    void Reset();
+
+private:
+    void Emit(uint8_t byte);
+    void Finish(FrameFn on_frame, void* context);
+
+    uint8_t* buffer_;
+    uint32_t capacity_;
+    uint32_t length_ = 0;
+    uint16_t crc_ = 0xFFFF;
+    uint8_t block_left_ = 0;     ///< Байт до конца блока COBS
+    bool zero_pending_ = false;  ///< Блок короче 254 — за ним ноль
+    bool started_ = false;       ///< Получен хотя бы один байт кадра
+};
+
+/**
+ * @brief Потоковая запись кадра: COBS + CRC на лету
+ *
+ * Begin() → Write()... → End(). Данные уходят в WriteFn блоками до 255 байт,
+ * полный кадр в памяти не собирается.
+ */
+class FrameWriter {
+public:
+    FrameWriter() = default;
+    FrameWriter(WriteFn write, void* context) : write_(write), context_(context) {}
+
+    void SetSink(WriteFn write, void* context) {
+        write_ = write;
+        context_ = context;
+    }
+
+    /// Начать кадр (заголовок)
+    bool Begin(uint16_t id, uint8_t method, uint8_t status);
+
+    /// Данные кадра
+    bool Write(const void* data, uint32_t len);
+
+    /// CRC и разделитель 0x00
+    bool End();
+
+    /// Оборвать кадр: разделитель без CRC (приёмник отбросит кадр)
+    void Abort();
+
+    bool Active() const { return active_; }
+    uint32_t BytesWritten() const { return bytes_out_; }
+
+private:
+    void Put(uint8_t byte);
+    void Flush(bool delimiter);
+
+    WriteFn write_ = nullptr;
+    void* context_ = nullptr;
+    uint8_t block_[256] = {};  ///< Код блока + до 254 байт + разделитель
+    uint32_t count_ = 0;       ///< Байт данных в блоке
+    uint16_t crc_ = 0xFFFF;
+    bool active_ = false;
+    bool ok_ = true;
+    uint32_t bytes_out_ = 0;   ///< Закодированных байт с создания
+};
+
+//--------------------------------------------------------------------+
+// Сервер
+//--------------------------------------------------------------------+
+
+/// Запрос для обработчика (payload — в буфере приёма, до возврата из обработчика)
+struct Request {
+    uint16_t id = 0;
+    uint8_t method = 0;
+    const uint8_t* payload = nullptr;
+    uint32_t length = 0;
+};
+
+class Server;
+
+/**
+ * @brief Ответ на запрос: заголовок уходит при первой записи или в End()
+ */
+class Responder {
+public:
+    /// Данные ответа (статус Ok); можно вызывать многократно — поток в TX
+    bool Write(const void* data, uint32_t len);
+
+    /// Завершить ответ (для ответов из BeginDeferred; обработчику не нужен)
+    bool End();
+
+    uint16_t Id() const { return id_; }
+
+private:
+    friend class Server;
+
+    void Reset(uint16_t id, uint8_t method);
+    bool Open(Status status);
+    bool Finish(Status status);
+
+    Server* server_ = nullptr;
+    uint16_t id_ = 0;
+    uint8_t method_ = 0;
+    bool started_ = false;  ///< TX захвачен, заголовок записан
+    bool done_ = false;     ///< Ответ завершён
+};
+
+/**
+ * @brief Обработчик метода
+ * @return Ok — ответ (записанное через response) отправляется;
+ *         ошибка — ответ с этим статусом (если данные уже ушли, кадр обрывается);
+ *         Deferred — ответить позже через Server::BeginDeferred(request.id)
+ *
+ * После первой записи в response TX занят собственным ответом до возврата:
+ * BeginDeferred()/RespondDeferred() из обработчика тогда вернут nullptr/false
+ * (ждать мьютекс TX — взаимоблокировка). Отвечать на отложенные запросы
+ * нужно до первой записи или из другой задачи. PendingCount() TX не трогает.
+ */
+using Handler = Status (*)(const Request& request, Responder& response, void* context);
+
+/// Счётчики сервера (снимок, POD)
+struct RpcStats {
+    uint32_t requests = 0;        ///< Принятых кадров с верным CRC
+    uint32_t responses = 0;       ///< Завершённых ответов
+    uint32_t crc_errors = 0;      ///< Отброшено: CRC или обрыв кадра
+    uint32_t too_large = 0;       ///< Ответ TooLarge
+    uint32_t unknown_method = 0;
+    uint32_t deferred = 0;        ///< Обработчик вернул Deferred
+    uint32_t busy = 0;            ///< Ответ Busy: отложенных слишком много
+    uint32_t tx_errors = 0;       ///< Транспорт отказал при записи ответа
+    uint32_t aborted = 0;         ///< Ответ оборван (ошибка после начала данных)
+};
+
+/**
+ * @brief RPC сервер: приём кадров, таблица обработчиков, отложенные ответы
+ *
+ * В TX одновременно пишется один ответ: он захватывает мьютекс (SetMutex,
+ * nullptr — без RTOS) от первой записи до End(). Feed() и BeginDeferred()
+ * можно вызывать из разных задач, если задан мьютекс. Таблица отложенных
+ * запросов от мьютекса не зависит (слоты с атомарным состоянием), поэтому
+ * PendingCount() не ждёт пишущийся ответ.
+ */
+class Server {
+public:
+    Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    /// Зарегистрировать обработчик (повторная регистрация заменяет)
+    /// @return false — таблица заполнена или метод зарезервирован (kMethodPing)
+    bool Register(uint8_t method, Handler handler, void* context = nullptr);
+
+    /// Куда писать ответы
+    void SetWriter(WriteFn write, void* context);
+
+    /// Мьютекс ответов (RTOS: ответы из нескольких задач)
+    void SetMutex(ports::IMutex* mutex) { mutex_ = mutex; }
+
+    /// Принять кусок потока: раскодировать и выполнить готовые запросы
+    void Feed(const uint8_t* data, uint32_t len);
+
+    /**
+     * @brief Начать отложенный ответ
+     * @param id Запрос, обработчик которого вернул Deferred
+     * @param status Статус ответа
+     * @return nullptr — id не ожидает ответа, TX занят другим ответом или
+     *         ответом обработчика, который сейчас выполняется (см. Handler)
+     *
+     * Ответ завершается Responder::End(); до этого TX занят.
+     */
+    Responder* BeginDeferred(uint16_t id, Status status = Status::Ok);
+
+    /// Отложенный ответ одним куском
+    bool RespondDeferred(uint16_t id, Status status, const void* data, uint32_t len);
+
+    /// Запросов ждут отложенного ответа
+    uint32_t PendingCount();
+
+    RpcStats GetStats() const { return stats_; }
+    void ResetStats() { stats_ = RpcStats{}; }
+
+private:
+    friend class Responder;
+
+    struct Entry {
+        uint8_t method = 0;
+        Handler handler = nullptr;
+        void* context = nullptr;
+    };
+
+    /// Состояние слота отложенного запроса
+    enum class Slot : uint8_t {
+        Free,
+        Claimed,  ///< Слот заполняется или забран под ответ
+        Queued,   ///< Запрос ждёт ответа
+    };
+
+    struct Pending {
+        uint16_t id = 0;
+        uint8_t method = 0;
+        std::atomic<Slot> slot{Slot::Free};
+    };
+
+    static void OnFrame(const Frame& frame, FrameResult result, void* context);
+    void Dispatch(const Frame& frame);
+    void Reply(uint16_t id, uint8_t method, Status status);
+    const Entry* Find(uint8_t method) const;
+    bool Enqueue(uint16_t id, uint8_t method);
+
+    bool LockTx();
+    void UnlockTx();
+
+    uint8_t frame_[kMaxFrame];
+    FrameDecoder decoder_;
+    FrameWriter writer_;
+    Responder responder_;
+    Responder deferred_responder_;
+    Entry entries_[USB_RPC_MAX_METHODS] = {};
+    Pending pending_[USB_RPC_MAX_PENDING];
+    ports::IMutex* mutex_ = nullptr;
+    bool tx_busy_ = false;                 ///< Ответ пишется (под mutex_)
+    bool in_handler_ = false;              ///< Dispatch() внутри обработчика
+    std::atomic<bool> handler_tx_{false};  ///< TX держит ответ обработчика
+    RpcStats stats_{};
+};
+
+}  // namespace usb::rpc
@@ -5,6 +5,8 @@
  * Реализация IBlockDevice для SD/SDHC/SDXC карт через SDMMC1 STM32H7.
  * 
  * @note Публичный API не содержит HAL зависимостей (v3.0.0+)
+ * @note Без кучи: pImpl с буферами внутри объекта — объект размещает приложение
+ *       (статический, в нужной секции RAM, см. usb_memory.h)
  * 
  * Использование:
  * ```cpp
@@ -20,6 +22,7 @@
 
 #if defined(USB_MSC_ENABLED) && defined(USB_SDMMC_ENABLED)
 
+#include <cstddef>
 #include <cstdint>
 
 namespace usb {
@@ -61,6 +64,18 @@ struct SdmmcConfig {
     uint32_t init_timeout_ms = 2000;
     uint32_t rw_timeout_ms = 2000;
     uint32_t ready_timeout_ms = 500;
+
+    /**
+     * IDMA вместо чтения FIFO процессором. Требует вызова HandleInterrupt()
+     * из SDMMCx_IRQHandler; объект SdmmcBlockDevice — в памяти, доступной
+     * IDMA: AXI SRAM (0x24000000) для SDMMC1, AXI SRAM или SRAM D2
+     * (0x30000000) для SDMMC2. D-cache обслуживается usb::cache
+     * (usb_cache.h). Буферы Read()/Write() в такой памяти, выровненные на
+     * 32 байта, идут в IDMA без копии; остальные (DTCM, SRAM D2/D3 для
+     * SDMMC1) — через буфер драйвера.
+     */
+    bool use_dma = false;
+    uint32_t dma_irq_priority = 5;   ///< Приоритет прерывания SDMMC (NVIC)
 };
 
 /**
@@ -83,6 +98,7 @@ enum class SdmmcState : uint8_t {
     Ready,            ///< Готов к операциям
     Busy,             ///< Занят операцией
     Error,            ///< Ошибка
+    Suspended,        ///< Карта в standby, SDMMC без тактирования (Suspend)
 };
 
 /**
@@ -117,6 +133,13 @@ public:
     
     /// Размер логического блока (всегда 512)
     static constexpr uint32_t kBlockSize = 512;
+
+    /// Наибольший физический блок карты (буферы чтения-изменения-записи)
+    static constexpr uint32_t kMaxPhysBlockSize = 2048;
+
+    /// Место под pImpl: два буфера физического блока + HAL handle и состояние
+    static constexpr size_t kImplStorageSize = 2 * kMaxPhysBlockSize + 512;
+    static constexpr size_t kImplAlign = 32;  ///< Строка кэша Cortex-M7: буферы для DMA
     
     // ============ Инициализация ============
     
@@ -155,12 +178,52 @@ public:
      */
     SdmmcDiagnostics GetDiagnostics() const;
     
+    /**
+     * @brief Обработчик прерывания SDMMC (режим use_dma)
+     *
+     * Вызывать из SDMMC1_IRQHandler / SDMMC2_IRQHandler.
+     */
+    void HandleInterrupt();
+    
     /**
      * @brief Синхронизация (сброс кэша на диск)
      * @return true если успешно
      */
     bool Sync();
     
+    // ============ Энергосбережение ============
+    
+    /**
+     * @brief Усыпить карту и SDMMC (USB suspend)
+     *
+     * Сбрасывает кэш, ждёт конца программирования, снимает выбор карты
+     * (CMD7 → standby) и отключает тактирование SDMMC. RCA, ширина шины и
+     * делитель остаются в объекте — Resume() не идентифицирует карту заново.
+     * @return false если кэш не записан или карта не вышла из busy за
+     *         ready_timeout_ms (состояние не меняется, карта выбрана)
+     */
+    bool Suspend();
+    
+    /**
+     * @brief Разбудить после Suspend()
+     *
+     * Включает тактирование, восстанавливает ширину шины и делитель из
+     * сохранённого состояния и выбирает карту (CMD7) без HAL_SD_Init.
+     * Карта не ответила (заменена или теряла питание) — полная
+     * инициализация. Read()/Write() в Suspended будят карту сами.
+     * @return true если карта готова
+     */
+    bool Resume();
+    
+    /**
+     * @brief Callback для UsbDevice::SetSuspendCallback()
+     * @code
+     * g_usb.SetSuspendCallback(usb::SdmmcBlockDevice::UsbSuspendHook, &g_sd);
+     * @endcode
+     * @param context SdmmcBlockDevice*
+     */
+    static void UsbSuspendHook(bool suspended, void* context);
+    
     // ============ IBlockDevice ============
     
     bool IsReady() const override;
@@ -170,7 +233,8 @@ public:
     bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override;
 
 private:
-    SdmmcImpl* impl_;  ///< pImpl для скрытия HAL деталей
+    SdmmcImpl* impl_;  ///< pImpl для скрытия HAL деталей (в impl_storage_)
+    alignas(kImplAlign) unsigned char impl_storage_[kImplStorageSize];
 };
 
 // ============ Пресеты для плат ============
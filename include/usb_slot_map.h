@@ -0,0 +1,121 @@
+/**
+ * @file usb_slot_map.h
+ * @brief Таблица "блок → слот" в RAM: открытая адресация, линейное пробирование
+ *
+ * Общая часть JournalBlockDevice и SnapshotOverlay: блоки устройства,
+ * копии которых лежат в слотах (журнал, область переадресации), и чтение
+ * запроса сериями из одного источника.
+ *
+ * Слотов не больше kMaxSlots (3/4 таблицы): цепочки проб короткие и
+ * свободная запись всегда найдётся. Удаление — со сдвигом цепочки, без
+ * меток. Синхронизация — у владельца.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace usb {
+
+/**
+ * @brief Таблица "блок → слот"
+ * @tparam kSize Записей (степень двойки)
+ */
+template <uint32_t kSize>
+class SlotMap {
+public:
+    static_assert(kSize != 0 && (kSize & (kSize - 1)) == 0, "SlotMap size must be a power of two");
+
+    static constexpr uint32_t kNone = 0xFFFFFFFF;
+
+    /// Слотов не больше 3/4 таблицы: короткие цепочки проб
+    static constexpr uint32_t kMaxSlots = kSize / 4 * 3;
+
+    /// Запись таблицы; lba == kNone — свободна
+    struct Entry {
+        uint32_t lba = kNone;
+        uint32_t slot = kNone;
+    };
+
+    void Clear() {
+        for (Entry& entry : map_) {
+            entry = Entry{};
+        }
+    }
+
+    /// Запись блока или свободная запись, куда его вставить
+    Entry* Find(uint32_t lba) {
+        uint32_t index = Index(lba);
+        while (map_[index].lba != lba && map_[index].lba != kNone) {
+            index = (index + 1) & kMask;
+        }
+        return &map_[index];
+    }
+
+    /// Слот блока (kNone — блока нет в таблице или у него нет слота)
+    uint32_t SlotOf(uint32_t lba) {
+        const Entry* entry = Find(lba);
+        return entry->lba == lba ? entry->slot : kNone;
+    }
+
+    /// Удалить запись со сдвигом цепочки (линейное пробирование без меток)
+    void Erase(Entry* entry) {
+        uint32_t hole = static_cast<uint32_t>(entry - map_);
+        uint32_t next = hole;
+        for (;;) {
+            next = (next + 1) & kMask;
+            if (map_[next].lba == kNone) {
+                break;
+            }
+            // Запись остаётся, если её домашний индекс лежит между дыркой и ней
+            const uint32_t home = Index(map_[next].lba);
+            const bool stays = hole <= next ? (hole < home && home <= next)
+                                            : (hole < home || home <= next);
+            if (!stays) {
+                map_[hole] = map_[next];
+                hole = next;
+            }
+        }
+        map_[hole] = Entry{};
+    }
+
+    /**
+     * @brief Разбить чтение [lba, lba + count) на серии из одного источника
+     * @param read bool(uint32_t offset, uint32_t slot, uint32_t run): блоки
+     *        запроса [offset, offset + run) — с устройства (slot == kNone)
+     *        или из слотов подряд начиная со slot
+     * @return false — read вернул ошибку
+     */
+    template <typename ReadRun>
+    bool ReadRuns(uint32_t lba, uint32_t count, ReadRun&& read) {
+        uint32_t i = 0;
+        while (i < count) {
+            const uint32_t slot = SlotOf(lba + i);
+            uint32_t run = 1;
+            if (slot == kNone) {
+                while (i + run < count && SlotOf(lba + i + run) == kNone) {
+                    run++;
+                }
+            } else {
+                while (i + run < count && SlotOf(lba + i + run) == slot + run) {
+                    run++;
+                }
+            }
+            if (!read(i, slot, run)) {
+                return false;
+            }
+            i += run;
+        }
+        return true;
+    }
+
+private:
+    static constexpr uint32_t kMask = kSize - 1;
+
+    /// Домашний индекс (мультипликативный хэш Фибоначчи)
+    static uint32_t Index(uint32_t lba) { return ((lba * 2654435761u) >> 16) & kMask; }
+
+    Entry map_[kSize];
+};
+
+}  // namespace usb
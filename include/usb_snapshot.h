@@ -0,0 +1,212 @@
+/**
+ * @file usb_snapshot.h
+ * @brief Снимок носителя для хоста MSC с переадресацией записей прошивки
+ *
+ * SnapshotOverlay даёт два вида одного IBlockDevice: Host() — замороженный
+ * снимок для MscAttach(), Firmware() — живое содержимое для кода прошивки.
+ * Пока хост держит снимок (Frozen), записи прошивки уходят в область
+ * переадресации (резерв на карте через PartitionBlockDevice или RAM-диск),
+ * а таблица "блок → слот" в RAM отвечает на чтения прошивки. Хост читает
+ * носитель напрямую и изменений прошивки не видит.
+ *
+ * Жизненный цикл:
+ * - Freeze(): снимок для хоста (Live → Frozen)
+ * - eject хоста (START STOP UNIT, UsbDevice::MscSetEjectCallback → OnEject):
+ *   Poll() переносит слоты на носитель порциями по commit_blocks
+ *   (Frozen → Committing), хост в это время получает NOT READY
+ * - перенос завершён: при rotate — новый снимок и RotateFn
+ *   (UsbDevice::MscInsert(): UNIT ATTENTION 28h, хост перечитывает том без
+ *   переподключения), иначе Live — прошивка пишет на носитель напрямую
+ *
+ * Хост видит снимок только для чтения: его запись завершается ошибкой.
+ * Область переадресации заполнена — запись прошивки возвращает false до
+ * следующего eject. Активация: USB_SNAPSHOT_ENABLED.
+ *
+ * @code
+ * usb::SnapshotOverlay g_snapshot(g_sd, g_redirect);  // g_redirect — резерв на карте
+ * g_snapshot.SetRotateCallback(
+ *     [](void* usb) { static_cast<usb::UsbDevice*>(usb)->MscInsert(); }, &g_usb);
+ * g_usb.MscSetEjectCallback(
+ *     [](bool loaded, void* s) { static_cast<usb::SnapshotOverlay*>(s)->OnEject(loaded); },
+ *     &g_snapshot);
+ * g_snapshot.Freeze();
+ * g_usb.MscAttach(g_snapshot.Host());
+ *
+ * // Main loop
+ * g_snapshot.Poll();
+ * g_snapshot.Firmware().Write(lba, log, count);
+ * @endcode
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "ports/IBlockDevice.hpp"
+#include "ports/IRtos.hpp"
+#include "usb_slot_map.h"
+
+// Записей в таблице переадресации (степень двойки); слотов — 3/4 от неё
+#ifndef USB_SNAPSHOT_MAP_SIZE
+#define USB_SNAPSHOT_MAP_SIZE 1024
+#endif
+
+// Буфер переноса слотов на носитель в Poll()
+#ifndef USB_SNAPSHOT_COPY_BYTES
+#define USB_SNAPSHOT_COPY_BYTES 4096
+#endif
+
+namespace usb {
+
+/// Состояние снимка
+enum class SnapshotState : uint8_t {
+    Live,        ///< Снимка нет, прошивка пишет на носитель, хосту — NOT READY
+    Frozen,      ///< Хост читает снимок, записи прошивки переадресуются
+    Committing,  ///< Хост извлёк носитель, Poll() переносит слоты
+};
+
+/// Режим переноса
+struct SnapshotConfig {
+    bool rotate = true;            ///< После переноса — новый снимок и RotateFn
+    uint32_t commit_blocks = 64;   ///< Блоков переноса за один Poll()
+};
+
+/// Счётчики (снимок, POD)
+struct SnapshotStats {
+    uint32_t redirected_blocks = 0;  ///< Блоков записи прошивки в слоты
+    uint32_t redirect_full = 0;      ///< Записей прошивки, не поместившихся в область
+    uint32_t host_write_rejects = 0;
+    uint32_t committed_blocks = 0;   ///< Перенесено слотов на носитель
+    uint32_t commits = 0;            ///< Завершённых переносов
+    uint32_t commit_errors = 0;      ///< Ошибок переноса (повтор в следующем Poll())
+};
+
+class SnapshotOverlay;
+
+/**
+ * @brief Вид снимка как блочное устройство
+ *
+ * Геометрия — от носителя. Хост: Read() напрямую с носителя, носитель
+ * защищён от записи (IsWriteProtected(), Write() — ошибка).
+ * Прошивка: через таблицу переадресации.
+ */
+class SnapshotBlockDevice final : public ports::IBlockDevice {
+public:
+    SnapshotBlockDevice(SnapshotOverlay& overlay, bool host) : overlay_(overlay), host_(host) {}
+
+    [[nodiscard]] bool IsReady() const override;
+    [[nodiscard]] uint32_t GetBlockCount() const override;
+    [[nodiscard]] uint32_t GetBlockSize() const override;
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override;
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override;
+    bool Sync() override;
+    [[nodiscard]] bool IsWriteProtected() const override { return host_; }
+
+private:
+    SnapshotOverlay& overlay_;
+    bool host_;
+};
+
+/**
+ * @brief Копирование при записи поверх IBlockDevice
+ */
+class SnapshotOverlay {
+public:
+    using RotateFn = void (*)(void* context);
+
+    /// Слотов не больше 3/4 таблицы (SlotMap)
+    static constexpr uint32_t kMaxSlots = SlotMap<USB_SNAPSHOT_MAP_SIZE>::kMaxSlots;
+
+    /**
+     * @param device Носитель
+     * @param redirect Область переадресации (тот же размер блока), слот — блок области
+     */
+    SnapshotOverlay(ports::IBlockDevice& device, ports::IBlockDevice& redirect,
+                    const SnapshotConfig& config = SnapshotConfig{});
+
+    SnapshotOverlay(const SnapshotOverlay&) = delete;
+    SnapshotOverlay& operator=(const SnapshotOverlay&) = delete;
+
+    /// Мьютекс для вызовов из нескольких задач (MSC и прошивка)
+    void SetMutex(ports::IMutex* mutex) { mutex_ = mutex; }
+
+    /// Снимок перенесён и заново заморожен (вызывается из Poll() вне мьютекса)
+    void SetRotateCallback(RotateFn callback, void* context = nullptr) {
+        rotate_callback_ = callback;
+        rotate_context_ = context;
+    }
+
+    /**
+     * @brief Заморозить снимок для хоста (Live → Frozen)
+     * @return false — идёт перенос, носитель не готов или размеры блоков не подходят
+     */
+    bool Freeze();
+
+    /// START STOP UNIT с LoEj (любой контекст), обрабатывает Poll()
+    void OnEject(bool loaded);
+
+    /// Main loop: события eject/load и порция переноса
+    void Poll();
+
+    /// Вид для MscAttach()
+    SnapshotBlockDevice& Host() { return host_; }
+
+    /// Вид прошивки
+    SnapshotBlockDevice& Firmware() { return firmware_; }
+
+    SnapshotState GetState() const { return state_.load(std::memory_order_acquire); }
+
+    /// Занято слотов (включая ещё не перенесённые)
+    uint32_t GetRedirectedCount() const;
+
+    /// Доступно слотов в области
+    uint32_t GetCapacity() const;
+
+    SnapshotStats GetStats() const;
+    void ResetStats();
+
+private:
+    friend class SnapshotBlockDevice;
+
+    /// Запись таблицы; slot == kNone — блок снова на носителе (перезаписан при переносе)
+    using Map = SlotMap<USB_SNAPSHOT_MAP_SIZE>;
+    using Entry = Map::Entry;
+    static constexpr uint32_t kNone = Map::kNone;
+
+    bool ReadFirmware(uint32_t lba, uint8_t* buffer, uint32_t count);
+    bool WriteFirmware(uint32_t lba, const uint8_t* buffer, uint32_t count);
+    bool WriteRedirected(uint32_t lba, const uint8_t* buffer, uint32_t count);
+    bool WriteThrough(uint32_t lba, const uint8_t* buffer, uint32_t count);
+
+    /// @return Перенос завершён и снимок заморожен заново
+    bool CommitStep();
+    void ClearMap();
+
+    void Lock() const;
+    void Unlock() const;
+
+    ports::IBlockDevice& device_;
+    ports::IBlockDevice& redirect_;
+    SnapshotConfig config_;
+    SnapshotBlockDevice host_;
+    SnapshotBlockDevice firmware_;
+    ports::IMutex* mutex_ = nullptr;
+
+    std::atomic<SnapshotState> state_{SnapshotState::Live};
+    std::atomic<bool> eject_pending_{false};
+    std::atomic<bool> load_pending_{false};
+
+    Map map_;
+    uint32_t slot_lba_[kMaxSlots];   ///< Слот → блок носителя (kNone — перезаписан)
+    uint32_t capacity_ = 0;
+    uint32_t used_slots_ = 0;
+    uint32_t commit_slot_ = 0;       ///< Следующий слот переноса
+    alignas(4) uint8_t copy_[USB_SNAPSHOT_COPY_BYTES];
+
+    RotateFn rotate_callback_ = nullptr;
+    void* rotate_context_ = nullptr;
+    SnapshotStats stats_{};
+};
+
+}  // namespace usb
@@ -0,0 +1,249 @@
+/**
+ * @file usb_uf2.h
+ * @brief Обновление прошивки перетаскиванием UF2 файла на виртуальный MSC диск
+ *
+ * Uf2Disk — блочное устройство для MscAttach(): том FAT16 собирается на лету
+ * при чтении (INFO_UF2.TXT, INDEX.HTM, CURRENT.UF2 с текущей прошивкой),
+ * записи разбираются как блоки UF2 (512 байт, до 256 байт данных с адресом).
+ * Записи FAT и каталога игнорируются: хост пишет файл в любые свободные
+ * кластеры, блоки узнаются по сигнатурам.
+ *
+ * Конвейер записи во flash (IFlash, операции неблокирующие):
+ * - данные блока копируются в очередь (USB_UF2_QUEUE_BLOCKS), Write() возвращается,
+ *   не дожидаясь flash — хост передаёт следующие блоки, пока flash занята
+ * - перед первым блоком сектора сектор стирается (один раз за сессию)
+ * - пока очередь пуста, стирается следующий сектор образа (erase_ahead):
+ *   стирание идёт, пока хост передаёт данные
+ * - Write() ждёт flash, только если очередь заполнена
+ * Конвейер общий с DfuFlash — FlashWriter (usb_flash_writer.h).
+ *
+ * Границы образа берутся из первого блока: targetAddr - blockNo * payloadSize
+ * и numBlocks. Блоки вне области приложения, чужого familyID или с флагом
+ * "not main flash" пропускаются. Когда приняты все numBlocks блоков, очередь
+ * дописывается и вызывается callback завершения (переход в приложение).
+ *
+ * Активация: USB_UF2_ENABLED (требует USB_MSC_ENABLED).
+ *
+ * @code
+ * usb::adapters::Stm32Flash g_flash;
+ * usb::Uf2Config uf2_config;
+ * uf2_config.app_address = 0x08020000;  // За загрузчиком (сектор 0)
+ * usb::Uf2Disk g_uf2(g_flash, uf2_config);
+ *
+ * g_uf2.SetCompleteCallback([](void*) { g_jump_to_app = true; });
+ * g_usb.MscAttach(g_uf2);
+ * while (true) {
+ *     g_usb.Process();
+ *     g_uf2.Poll();  // Стирание наперёд между передачами
+ * }
+ * @endcode
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "ports/IBlockDevice.hpp"
+#include "ports/IFlash.hpp"
+#include "ports/IRtos.hpp"
+#include "usb_flash_writer.h"
+
+#ifndef USB_UF2_FAMILY_ID
+#define USB_UF2_FAMILY_ID 0x6DB66082  // STM32H7 (uf2families.json)
+#endif
+
+#ifndef USB_UF2_BOARD_ID
+#define USB_UF2_BOARD_ID "STM32H7-USB-Composite"
+#endif
+
+#ifndef USB_UF2_MODEL
+#define USB_UF2_MODEL "USB Composite"
+#endif
+
+#ifndef USB_UF2_INDEX_URL
+#define USB_UF2_INDEX_URL "https://microsoft.github.io/uf2/"
+#endif
+
+// Очередь блоков между MSC и flash (по 256 байт данных + адрес)
+#ifndef USB_UF2_QUEUE_BLOCKS
+#define USB_UF2_QUEUE_BLOCKS 8
+#endif
+
+// Наибольший numBlocks (битовая карта принятых блоков: USB_UF2_MAX_BLOCKS / 8 байт)
+#ifndef USB_UF2_MAX_BLOCKS
+#define USB_UF2_MAX_BLOCKS 8192
+#endif
+
+// Наибольшее число секторов flash (битовая карта стёртых)
+#ifndef USB_UF2_MAX_SECTORS
+#define USB_UF2_MAX_SECTORS 256
+#endif
+
+namespace usb {
+
+//--------------------------------------------------------------------+
+// Формат UF2
+//--------------------------------------------------------------------+
+
+namespace uf2 {
+
+static constexpr uint32_t kMagicStart0 = 0x0A324655;  // "UF2\n"
+static constexpr uint32_t kMagicStart1 = 0x9E5D5157;
+static constexpr uint32_t kMagicEnd = 0x0AB16F30;
+
+static constexpr uint32_t kFlagNotMainFlash = 0x00000001;
+static constexpr uint32_t kFlagFileContainer = 0x00001000;
+static constexpr uint32_t kFlagFamilyId = 0x00002000;
+
+static constexpr uint32_t kBlockSize = 512;
+static constexpr uint32_t kDataSize = 476;     ///< Поле данных блока
+static constexpr uint32_t kPayloadSize = 256;  ///< Данных в блоке (принимается до 256)
+
+/// Блок UF2 (512 байт, little-endian)
+struct Block {
+    uint32_t magic_start0;
+    uint32_t magic_start1;
+    uint32_t flags;
+    uint32_t target_addr;
+    uint32_t payload_size;
+    uint32_t block_no;
+    uint32_t num_blocks;
+    uint32_t family_id;  ///< Или размер файла (kFlagFileContainer)
+    uint8_t data[kDataSize];
+    uint32_t magic_end;
+};
+
+static_assert(sizeof(Block) == kBlockSize, "UF2 block must be 512 bytes");
+
+/// Сигнатуры блока на месте
+bool IsBlock(const uint8_t* sector);
+
+}  // namespace uf2
+
+//--------------------------------------------------------------------+
+// Uf2Disk
+//--------------------------------------------------------------------+
+
+/// Параметры тома и области прошивки
+struct Uf2Config {
+    uint32_t app_address = 0;  ///< Начало области прошивки (0 — начало flash)
+    uint32_t app_size = 0;     ///< Размер области, целые секторы (0 — до конца flash)
+    uint32_t family_id = USB_UF2_FAMILY_ID;
+    const char* board_id = USB_UF2_BOARD_ID;
+    const char* model = USB_UF2_MODEL;
+    const char* index_url = USB_UF2_INDEX_URL;
+    bool erase_ahead = true;   ///< Стирать следующий сектор, пока очередь пуста
+};
+
+/// Счётчики сессии (снимок, POD)
+struct Uf2Stats {
+    uint32_t blocks_received = 0;   ///< Новых блоков образа
+    uint32_t blocks_duplicate = 0;  ///< Повторная запись уже принятого блока
+    uint32_t blocks_skipped = 0;    ///< Чужой familyID, "not main flash", контейнер файла
+    uint32_t blocks_invalid = 0;    ///< Адрес вне области, невыровненные данные, numBlocks
+    uint32_t other_writes = 0;      ///< Секторы не UF2 (FAT, каталог)
+    uint32_t sectors_erased = 0;
+    uint32_t erase_ahead = 0;       ///< Из них стёрто наперёд
+    uint32_t blocks_programmed = 0;
+    uint32_t queue_full_waits = 0;  ///< Write() ждал flash: очередь заполнена
+    uint32_t flash_errors = 0;
+};
+
+/**
+ * @brief Виртуальный FAT16 том UF2 загрузчика
+ *
+ * Write()/Read() вызываются из MSC (tud_msc_*_cb или задача хранилища в RTOS),
+ * Poll() — из main loop. В RTOS режиме задайте SetMutex().
+ */
+class Uf2Disk final : public ports::IBlockDevice {
+public:
+    static constexpr uint32_t kBlockSize = 512;
+
+    using CompleteFn = void (*)(void* context);
+
+    explicit Uf2Disk(ports::IFlash& flash, const Uf2Config& config = Uf2Config{});
+
+    // IBlockDevice
+    [[nodiscard]] bool IsReady() const override { return ready_; }
+    [[nodiscard]] uint32_t GetBlockCount() const override { return total_sectors_; }
+    [[nodiscard]] uint32_t GetBlockSize() const override { return kBlockSize; }
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override;
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override;
+
+    /// Дописать очередь во flash
+    bool Sync() override;
+
+    /// Продвинуть конвейер без ожидания (стирание наперёд между передачами)
+    void Poll();
+
+    /// Все блоки образа записаны
+    bool IsComplete() const { return complete_; }
+
+    /// Ошибка flash в текущей сессии (записи отклоняются до Reset())
+    bool HasFailed() const { return writer_.HasFailed(); }
+
+    /// Вызывается один раз, когда образ записан целиком
+    void SetCompleteCallback(CompleteFn callback, void* context = nullptr) {
+        complete_callback_ = callback;
+        complete_context_ = context;
+    }
+
+    /// Мьютекс для Poll() из другой задачи (nullptr — без RTOS)
+    void SetMutex(ports::IMutex* mutex) { mutex_ = mutex; }
+
+    /// Новая сессия (сброс принятых блоков и стёртых секторов)
+    void Reset();
+
+    Uf2Stats GetStats() const;
+
+    /// Кластеров данных в томе (FAT16: не меньше 4085)
+    uint32_t GetClusterCount() const { return clusters_; }
+
+private:
+    // Том
+    void ReadSector(uint32_t lba, uint8_t* out);
+    void BootSector(uint8_t* out) const;
+    void FatSector(uint32_t index, uint8_t* out) const;
+    void RootSector(uint32_t index, uint8_t* out) const;
+    void DataSector(uint32_t cluster, uint8_t* out);
+    uint32_t InfoText(char* out, uint32_t size) const;
+    uint32_t IndexText(char* out, uint32_t size) const;
+
+    // Конвейер
+    bool HandleBlock(const uint8_t* sector);
+    bool StartSession(const uf2::Block& header);
+    void UpdateEraseAhead();
+    void CheckComplete();
+
+    void Lock();
+    void Unlock();
+
+    ports::IFlash& flash_;
+    Uf2Config config_;
+    ports::IMutex* mutex_ = nullptr;
+    bool ready_ = false;
+
+    // Геометрия тома
+    uint32_t app_blocks_ = 0;     ///< Блоков в CURRENT.UF2
+    uint32_t clusters_ = 0;
+    uint32_t fat_sectors_ = 0;
+    uint32_t total_sectors_ = 0;
+
+    // Сессия
+    bool session_ = false;
+    bool complete_ = false;
+    uint32_t num_blocks_ = 0;
+    uint32_t blocks_seen_ = 0;
+    uint32_t first_sector_ = 0;   ///< Секторы образа [first_sector_, last_sector_]
+    uint32_t last_sector_ = 0;
+    uint32_t received_[USB_UF2_MAX_BLOCKS / 32] = {};
+
+    // Очередь и операция flash
+    StaticFlashWriter<uf2::kPayloadSize, USB_UF2_QUEUE_BLOCKS, USB_UF2_MAX_SECTORS> writer_;
+
+    CompleteFn complete_callback_ = nullptr;
+    void* complete_context_ = nullptr;
+    Uf2Stats stats_{};
+};
+
+}  // namespace usb
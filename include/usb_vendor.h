@@ -0,0 +1,166 @@
+/**
+ * @file usb_vendor.h
+ * @brief Кольцо буферов для потокового vendor интерфейса (WinUSB / libusb)
+ *
+ * Буферы выдаются на заполнение по указателю и возвращаются целиком:
+ * производитель пишет прямо в буфер кольца (Acquire → Commit), потребитель
+ * читает из него же (Peek → Consume). Копирование остаётся одно — между
+ * кольцом и FIFO endpoint'а TinyUSB (vendor класс владеет EP буферами).
+ *
+ * Один производитель и один потребитель (SPSC): индексы — атомики
+ * acquire/release, блокировок нет.
+ *
+ * Буферы выровнены на строку кэша (32 байта, Cortex-M7) и кратны ей —
+ * кольцо можно разместить в DMA-доступной памяти (.dma_buffer в RAM_D2)
+ * и чистить кэш по буферу без захвата соседних.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Кольца vendor интерфейса в UsbDevice: по USB_VENDOR_RING_BUFFERS буферов
+// USB_VENDOR_BUFFER_SIZE байт на приём и на передачу
+#ifndef USB_VENDOR_RING_BUFFERS
+#define USB_VENDOR_RING_BUFFERS 4
+#endif
+
+#ifndef USB_VENDOR_BUFFER_SIZE
+#define USB_VENDOR_BUFFER_SIZE 512
+#endif
+
+// USB_VENDOR_DMA_SECTION: кольца в .dma_buffer (см. linker/stm32h7_dma_section.ld)
+#ifdef USB_VENDOR_DMA_SECTION
+#define USB_VENDOR_BUFFER_ATTR __attribute__((section(".dma_buffer")))
+#else
+#define USB_VENDOR_BUFFER_ATTR
+#endif
+
+namespace usb {
+
+/// Строка кэша D-cache Cortex-M7
+static constexpr uint32_t kCacheLineSize = 32;
+
+/**
+ * @brief Кольцо буферов фиксированного размера (SPSC)
+ * @tparam kBuffers Число буферов (степень двойки)
+ * @tparam kBufferSize Размер буфера, байт (кратен kCacheLineSize)
+ */
+template <uint32_t kBuffers, uint32_t kBufferSize>
+class StreamRing {
+public:
+    static_assert(kBuffers >= 2 && (kBuffers & (kBuffers - 1)) == 0,
+                  "kBuffers must be a power of two >= 2");
+    static_assert(kBufferSize > 0 && kBufferSize % kCacheLineSize == 0,
+                  "kBufferSize must be a multiple of the cache line");
+
+    static constexpr uint32_t kBufferCount = kBuffers;
+    static constexpr uint32_t kCapacity = kBufferSize;
+
+    //----------------------------------------------------------------+
+    // Производитель
+    //----------------------------------------------------------------+
+
+    /// Свободный буфер для заполнения (nullptr — кольцо заполнено)
+    uint8_t* Acquire() {
+        const uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= kBuffers) {
+            return nullptr;
+        }
+        return slots_[head & kMask].data;
+    }
+
+    /**
+     * @brief Отдать заполненный буфер потребителю
+     * @param len Байт в буфере (1..kBufferSize)
+     * @return false — кольцо заполнено или неверная длина
+     */
+    bool Commit(uint32_t len) {
+        const uint32_t head = head_.load(std::memory_order_relaxed);
+        if (len == 0 || len > kBufferSize ||
+            head - tail_.load(std::memory_order_acquire) >= kBuffers) {
+            return false;
+        }
+        Slot& slot = slots_[head & kMask];
+        slot.length = len;
+        slot.offset = 0;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    //----------------------------------------------------------------+
+    // Потребитель
+    //----------------------------------------------------------------+
+
+    /**
+     * @brief Непрочитанная часть самого старого буфера
+     * @param len Байт доступно
+     * @return nullptr — кольцо пусто
+     */
+    const uint8_t* Peek(uint32_t* len) const {
+        const uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            *len = 0;
+            return nullptr;
+        }
+        const Slot& slot = slots_[tail & kMask];
+        *len = slot.length - slot.offset;
+        return slot.data + slot.offset;
+    }
+
+    /// Отметить прочитанными bytes байт; буфер освобождается, когда прочитан целиком
+    void Consume(uint32_t bytes) {
+        const uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return;
+        }
+        Slot& slot = slots_[tail & kMask];
+        slot.offset += bytes < slot.length - slot.offset ? bytes : slot.length - slot.offset;
+        if (slot.offset == slot.length) {
+            tail_.store(tail + 1, std::memory_order_release);
+        }
+    }
+
+    /// Освободить самый старый буфер целиком
+    void Release() {
+        const uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail != head_.load(std::memory_order_acquire)) {
+            tail_.store(tail + 1, std::memory_order_release);
+        }
+    }
+
+    //----------------------------------------------------------------+
+    // Состояние
+    //----------------------------------------------------------------+
+
+    /// Буферов ждут потребителя
+    uint32_t Pending() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    bool Empty() const { return Pending() == 0; }
+    bool Full() const { return Pending() >= kBuffers; }
+
+    /// Сброс (без конкурентных Acquire/Peek; в NOLOAD секции — обязателен до работы)
+    void Clear() {
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint32_t kMask = kBuffers - 1;
+
+    struct Slot {
+        alignas(kCacheLineSize) uint8_t data[kBufferSize];
+        uint32_t length = 0;
+        uint32_t offset = 0;
+    };
+
+    Slot slots_[kBuffers];
+    std::atomic<uint32_t> head_{0};  ///< Пишет производитель
+    std::atomic<uint32_t> tail_{0};  ///< Пишет потребитель
+};
+
+}  // namespace usb
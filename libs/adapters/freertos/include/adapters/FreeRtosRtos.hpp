@@ -0,0 +1,148 @@
+/**
+ * @file FreeRtosRtos.hpp
+ * @brief FreeRTOS реализация IRtos
+ *
+ * Все объекты создаются статически (configSUPPORT_STATIC_ALLOCATION = 1),
+ * пулы рассчитаны на UsbDevice::StartTasks(): 2 задачи, 3 мьютекса, 4 сигнала.
+ * Объектам приложения (SetMutex(), BlockArbiter::SetRtos()) добавьте места
+ * через USB_FREERTOS_EXTRA_MUTEXES / USB_FREERTOS_EXTRA_SIGNALS.
+ * Приоритет задачи — tskIDLE_PRIORITY + TaskParams::priority.
+ *
+ * Прерывание USB (OTG_FS_IRQn, приоритет 5 в InitUsbNvic()) обращается к
+ * очереди TinyUSB через *FromISR — configMAX_SYSCALL_INTERRUPT_PRIORITY
+ * должен быть не выше (численно не больше) этого приоритета.
+ */
+
+#pragma once
+
+#include "ports/IRtos.hpp"
+
+#include <new>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+// Мьютексы и сигналы сверх нужных UsbDevice::StartTasks()
+#ifndef USB_FREERTOS_EXTRA_MUTEXES
+#define USB_FREERTOS_EXTRA_MUTEXES 0
+#endif
+
+#ifndef USB_FREERTOS_EXTRA_SIGNALS
+#define USB_FREERTOS_EXTRA_SIGNALS 0
+#endif
+
+namespace usb::adapters {
+
+class FreeRtosMutex final : public ports::IMutex {
+public:
+    FreeRtosMutex() : handle_(xSemaphoreCreateMutexStatic(&storage_)) {}
+
+    void Lock() override { xSemaphoreTake(handle_, portMAX_DELAY); }
+    void Unlock() override { xSemaphoreGive(handle_); }
+
+private:
+    StaticSemaphore_t storage_;
+    SemaphoreHandle_t handle_;
+};
+
+class FreeRtosSignal final : public ports::ISignal {
+public:
+    FreeRtosSignal() : handle_(xSemaphoreCreateBinaryStatic(&storage_)) {}
+
+    void Give() override { xSemaphoreGive(handle_); }
+
+    void GiveFromIsr() override {
+        BaseType_t woken = pdFALSE;
+        xSemaphoreGiveFromISR(handle_, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+
+    bool Take(uint32_t timeout_ms) override {
+        TickType_t ticks = timeout_ms == ports::kWaitForever ? portMAX_DELAY
+                                                             : pdMS_TO_TICKS(timeout_ms);
+        return xSemaphoreTake(handle_, ticks) == pdTRUE;
+    }
+
+private:
+    StaticSemaphore_t storage_;
+    SemaphoreHandle_t handle_;
+};
+
+/**
+ * @brief Пулы объектов FreeRTOS
+ * @tparam kUsbStackWords Стек задачи USB стека (слова)
+ * @tparam kStorageStackWords Стек задачи хранилища (слова)
+ */
+template <uint32_t kUsbStackWords = 1024, uint32_t kStorageStackWords = 512>
+class FreeRtosRtos final : public ports::IRtos {
+public:
+    static constexpr uint32_t kMaxMutexes = 3 + USB_FREERTOS_EXTRA_MUTEXES;
+    static constexpr uint32_t kMaxSignals = 4 + USB_FREERTOS_EXTRA_SIGNALS;
+    static constexpr uint32_t kMaxTasks = 2;
+
+    ports::IMutex* CreateMutex() override {
+        if (mutex_count_ >= kMaxMutexes) {
+            return nullptr;
+        }
+        return new (&mutex_storage_[mutex_count_++]) FreeRtosMutex();
+    }
+
+    ports::ISignal* CreateSignal() override {
+        if (signal_count_ >= kMaxSignals) {
+            return nullptr;
+        }
+        return new (&signal_storage_[signal_count_++]) FreeRtosSignal();
+    }
+
+    bool CreateTask(const ports::TaskParams& params, ports::TaskFn fn, void* context) override {
+        if (task_count_ >= kMaxTasks) {
+            return false;
+        }
+        Task& task = tasks_[task_count_];
+        // Первая задача — USB стек, вторая — хранилище
+        StackType_t* stack = task_count_ == 0 ? usb_stack_ : storage_stack_;
+        uint32_t depth = task_count_ == 0 ? kUsbStackWords : kStorageStackWords;
+        if (params.stack_bytes > depth * sizeof(StackType_t)) {
+            return false;
+        }
+        task.fn = fn;
+        task.context = context;
+        task.handle = xTaskCreateStatic(Trampoline, params.name, depth, &task,
+                                        tskIDLE_PRIORITY + params.priority, stack, &task.tcb);
+        if (task.handle == nullptr) {
+            return false;
+        }
+        task_count_++;
+        return true;
+    }
+
+    void DelayMs(uint32_t ms) override { vTaskDelay(pdMS_TO_TICKS(ms)); }
+
+private:
+    struct Task {
+        ports::TaskFn fn = nullptr;
+        void* context = nullptr;
+        TaskHandle_t handle = nullptr;
+        StaticTask_t tcb;
+    };
+
+    /// Задача FreeRTOS не может вернуть управление — удаляем себя
+    static void Trampoline(void* arg) {
+        auto* task = static_cast<Task*>(arg);
+        task->fn(task->context);
+        vTaskDelete(nullptr);
+    }
+
+    alignas(FreeRtosMutex) uint8_t mutex_storage_[kMaxMutexes][sizeof(FreeRtosMutex)];
+    alignas(FreeRtosSignal) uint8_t signal_storage_[kMaxSignals][sizeof(FreeRtosSignal)];
+    uint32_t mutex_count_ = 0;
+    uint32_t signal_count_ = 0;
+
+    Task tasks_[kMaxTasks];
+    uint32_t task_count_ = 0;
+    StackType_t usb_stack_[kUsbStackWords];
+    StackType_t storage_stack_[kStorageStackWords];
+};
+
+}  // namespace usb::adapters
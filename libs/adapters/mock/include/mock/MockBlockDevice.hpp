@@ -6,6 +6,7 @@
 #pragma once
 
 #include "ports/IBlockDevice.hpp"
+#include <algorithm>
 #include <cstring>
 #include <vector>
 
@@ -39,6 +40,7 @@ public:
         read_count_++;
         last_read_lba_ = lba;
         last_read_count_ = count;
+        modelled_us_ += cmd_latency_us_ + static_cast<uint64_t>(count) * read_block_us_;
         
         std::memcpy(buffer, &data_[lba * block_size_], count * block_size_);
         return true;
@@ -52,6 +54,7 @@ public:
         write_count_++;
         last_write_lba_ = lba;
         last_write_count_ = count;
+        modelled_us_ += cmd_latency_us_ + static_cast<uint64_t>(count) * write_block_us_;
         
         std::memcpy(&data_[lba * block_size_], buffer, count * block_size_);
         return true;
@@ -59,6 +62,7 @@ public:
     
     bool Sync() override {
         sync_count_++;
+        modelled_us_ += cmd_latency_us_;
         return true;
     }
     
@@ -67,6 +71,21 @@ public:
     void Fill(uint8_t value) { std::fill(data_.begin(), data_.end(), value); }
     uint8_t* GetData() { return data_.data(); }
     
+    /**
+     * @brief Модель латентности (для бенчмарков)
+     * 
+     * Каждая команда добавляет cmd_us + count * block_us к модельному времени.
+     * По умолчанию всё по нулям — устройство "мгновенное".
+     */
+    void SetLatencyModel(uint32_t cmd_us, uint32_t read_block_us, uint32_t write_block_us) {
+        cmd_latency_us_ = cmd_us;
+        read_block_us_ = read_block_us;
+        write_block_us_ = write_block_us;
+    }
+    
+    /// Накопленное модельное время (мкс)
+    uint64_t GetModelledTimeUs() const { return modelled_us_; }
+    
     // Счётчики для проверок в тестах
     uint32_t GetReadCount() const { return read_count_; }
     uint32_t GetWriteCount() const { return write_count_; }
@@ -78,6 +97,7 @@ public:
         read_count_ = write_count_ = sync_count_ = 0;
         last_read_lba_ = last_write_lba_ = 0;
         last_read_count_ = last_write_count_ = 0;
+        modelled_us_ = 0;
     }
     
 private:
@@ -94,6 +114,12 @@ private:
     uint32_t last_write_lba_ = 0;
     uint32_t last_read_count_ = 0;
     uint32_t last_write_count_ = 0;
+    
+    // Модель латентности
+    uint32_t cmd_latency_us_ = 0;
+    uint32_t read_block_us_ = 0;
+    uint32_t write_block_us_ = 0;
+    uint64_t modelled_us_ = 0;
 };
 
 }  // namespace usb::mock
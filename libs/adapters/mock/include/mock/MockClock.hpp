@@ -17,30 +17,39 @@ namespace usb::mock {
 class MockClock : public ports::IClock {
 public:
     [[nodiscard]] uint32_t GetTickMs() const override {
-        return current_tick_ms_;
+        return static_cast<uint32_t>(current_tick_us_ / 1000);
+    }
+    
+    [[nodiscard]] uint32_t GetTickUs() const override {
+        return static_cast<uint32_t>(current_tick_us_);
     }
     
     void DelayMs(uint32_t ms) override {
-        current_tick_ms_ += ms;
+        current_tick_us_ += static_cast<uint64_t>(ms) * 1000;
         delay_calls_++;
         last_delay_ms_ = ms;
     }
     
     // Test helpers
-    void SetTick(uint32_t tick_ms) { current_tick_ms_ = tick_ms; }
-    void AdvanceTick(uint32_t delta_ms) { current_tick_ms_ += delta_ms; }
+    void SetTick(uint32_t tick_ms) {
+        current_tick_us_ = static_cast<uint64_t>(tick_ms) * 1000;
+    }
+    void AdvanceTick(uint32_t delta_ms) {
+        current_tick_us_ += static_cast<uint64_t>(delta_ms) * 1000;
+    }
+    void AdvanceTickUs(uint32_t delta_us) { current_tick_us_ += delta_us; }
     
     uint32_t GetDelayCallCount() const { return delay_calls_; }
     uint32_t GetLastDelayMs() const { return last_delay_ms_; }
     
     void Reset() {
-        current_tick_ms_ = 0;
+        current_tick_us_ = 0;
         delay_calls_ = 0;
         last_delay_ms_ = 0;
     }
     
 private:
-    uint32_t current_tick_ms_ = 0;
+    uint64_t current_tick_us_ = 0;
     uint32_t delay_calls_ = 0;
     uint32_t last_delay_ms_ = 0;
 };
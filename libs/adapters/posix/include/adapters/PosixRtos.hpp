@@ -0,0 +1,101 @@
+/**
+ * @file PosixRtos.hpp
+ * @brief POSIX threads реализация IRtos (native сборка, тесты)
+ *
+ * Задачи — std::thread (pthreads), мьютексы и сигналы — std::mutex /
+ * std::condition_variable. Приоритеты задач игнорируются.
+ * Деструктор дожидается завершения всех задач: функции задач
+ * должны уметь выходить (UsbDevice::StopTasks()).
+ */
+
+#pragma once
+
+#include "ports/IRtos.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace usb::adapters {
+
+class PosixMutex final : public ports::IMutex {
+public:
+    void Lock() override { mutex_.lock(); }
+    void Unlock() override { mutex_.unlock(); }
+
+private:
+    std::mutex mutex_;
+};
+
+class PosixSignal final : public ports::ISignal {
+public:
+    void Give() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            given_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    void GiveFromIsr() override { Give(); }
+
+    bool Take(uint32_t timeout_ms) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto ready = [this] { return given_; };
+        if (timeout_ms == ports::kWaitForever) {
+            cv_.wait(lock, ready);
+        } else if (!cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready)) {
+            return false;
+        }
+        given_ = false;
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool given_ = false;
+};
+
+class PosixRtos final : public ports::IRtos {
+public:
+    PosixRtos() = default;
+
+    ~PosixRtos() override {
+        for (auto& thread : threads_) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    ports::IMutex* CreateMutex() override {
+        mutexes_.push_back(std::make_unique<PosixMutex>());
+        return mutexes_.back().get();
+    }
+
+    ports::ISignal* CreateSignal() override {
+        signals_.push_back(std::make_unique<PosixSignal>());
+        return signals_.back().get();
+    }
+
+    bool CreateTask(const ports::TaskParams& params, ports::TaskFn fn, void* context) override {
+        (void)params;
+        threads_.emplace_back(fn, context);
+        return true;
+    }
+
+    void DelayMs(uint32_t ms) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+
+private:
+    std::vector<std::unique_ptr<PosixMutex>> mutexes_;
+    std::vector<std::unique_ptr<PosixSignal>> signals_;
+    std::vector<std::thread> threads_;
+};
+
+}  // namespace usb::adapters
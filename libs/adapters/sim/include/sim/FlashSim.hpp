@@ -0,0 +1,175 @@
+/**
+ * @file FlashSim.hpp
+ * @brief Host-модель внутренней flash для native тестов и бенчмарков
+ *
+ * Время операций продвигается через SimTime: стирание сектора и
+ * программирование flash word занимают заданное модельное время,
+ * Poll() видит завершение, когда SimTime дошло до конца операции,
+ * Wait() продвигает SimTime сам.
+ *
+ * Что проверяется:
+ * - одна операция одновременно (Start*() при занятой flash — false)
+ * - программирование только стёртых ячеек и только выровненными словами
+ * - данные StartProgram() читаются в момент завершения операции
+ *   (буфер, освобождённый раньше времени, даст неверные данные)
+ */
+
+#pragma once
+
+#include "ports/IFlash.hpp"
+#include "sim/SimTime.hpp"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace usb::sim {
+
+/**
+ * @brief Параметры симулируемой flash (по умолчанию — банк STM32H743)
+ */
+struct FlashSimConfig {
+    uint32_t base_address = 0x08000000;
+    uint32_t size = 1024 * 1024;
+    uint32_t sector_size = 128 * 1024;
+    uint32_t program_unit = 32;         ///< Flash word
+    uint32_t erase_us = 1000000;        ///< Стирание сектора (H7: ~1 с на 128 KB)
+    uint32_t program_unit_us = 16;      ///< Программирование flash word
+};
+
+/// Счётчики операций
+struct FlashSimStats {
+    uint32_t erases = 0;
+    uint32_t programs = 0;              ///< Вызовов StartProgram()
+    uint64_t program_bytes = 0;
+    uint32_t rejected = 0;              ///< Start*() при занятой flash / неверных аргументах
+    uint32_t errors = 0;                ///< Программирование нестёртых ячеек, инъекции
+    uint64_t busy_us = 0;               ///< Суммарное время операций
+};
+
+class FlashSim final : public ports::IFlash {
+public:
+    explicit FlashSim(const FlashSimConfig& config = FlashSimConfig{})
+        : config_(config), memory_(config.size, 0xFF) {}
+
+    [[nodiscard]] uint32_t GetBaseAddress() const override { return config_.base_address; }
+    [[nodiscard]] uint32_t GetSize() const override { return config_.size; }
+    [[nodiscard]] uint32_t GetSectorSize() const override { return config_.sector_size; }
+    [[nodiscard]] uint32_t GetProgramUnit() const override { return config_.program_unit; }
+
+    bool StartErase(uint32_t sector) override {
+        if (op_ != Op::None || sector >= config_.size / config_.sector_size) {
+            stats_.rejected++;
+            return false;
+        }
+        op_ = Op::Erase;
+        op_sector_ = sector;
+        Begin(config_.erase_us);
+        return true;
+    }
+
+    bool StartProgram(uint32_t address, const uint8_t* data, uint32_t len) override {
+        const uint32_t unit = config_.program_unit;
+        if (op_ != Op::None || len == 0 || address % unit != 0 || len % unit != 0 ||
+            address < config_.base_address ||
+            address - config_.base_address + len > config_.size) {
+            stats_.rejected++;
+            return false;
+        }
+        op_ = Op::Program;
+        op_address_ = address;
+        op_data_ = data;
+        op_len_ = len;
+        Begin(static_cast<uint64_t>(len / unit) * config_.program_unit_us);
+        return true;
+    }
+
+    ports::FlashStatus Poll() override {
+        if (op_ == Op::None) {
+            return ports::FlashStatus::Idle;
+        }
+        if (SimTime::NowUs() < op_end_us_) {
+            return ports::FlashStatus::Busy;
+        }
+        return Complete();
+    }
+
+    ports::FlashStatus Wait() override {
+        SimTime::AdvanceToUs(op_end_us_);
+        return Poll();
+    }
+
+    bool Read(uint32_t address, uint8_t* buffer, uint32_t len) override {
+        if (address < config_.base_address ||
+            address - config_.base_address + len > config_.size) {
+            return false;
+        }
+        std::memcpy(buffer, &memory_[address - config_.base_address], len);
+        return true;
+    }
+
+    // ============ Для тестов ============
+
+    const FlashSimStats& GetStats() const { return stats_; }
+    void ResetStats() { stats_ = {}; }
+
+    /// Содержимое (индекс от base_address)
+    std::vector<uint8_t>& Memory() { return memory_; }
+
+    /// Следующее стирание этого сектора завершится ошибкой
+    void FailErase(uint32_t sector) { fail_sector_ = sector; }
+
+    /// Выполняется операция
+    bool IsBusy() const { return op_ != Op::None; }
+
+private:
+    enum class Op : uint8_t { None, Erase, Program };
+
+    void Begin(uint64_t duration_us) {
+        op_end_us_ = SimTime::NowUs() + duration_us;
+        stats_.busy_us += duration_us;
+    }
+
+    ports::FlashStatus Complete() {
+        bool ok = true;
+        if (op_ == Op::Erase) {
+            stats_.erases++;
+            if (op_sector_ == fail_sector_) {
+                fail_sector_ = UINT32_MAX;
+                ok = false;
+            } else {
+                std::memset(&memory_[op_sector_ * config_.sector_size], 0xFF,
+                            config_.sector_size);
+            }
+        } else {
+            stats_.programs++;
+            stats_.program_bytes += op_len_;
+            uint8_t* cell = &memory_[op_address_ - config_.base_address];
+            for (uint32_t i = 0; i < op_len_; i++) {
+                ok = ok && cell[i] == 0xFF;  // NOR: только стёртые слова
+            }
+            if (ok) {
+                std::memcpy(cell, op_data_, op_len_);
+            }
+        }
+        op_ = Op::None;
+        if (!ok) {
+            stats_.errors++;
+            return ports::FlashStatus::Error;
+        }
+        return ports::FlashStatus::Idle;
+    }
+
+    FlashSimConfig config_;
+    std::vector<uint8_t> memory_;
+    FlashSimStats stats_{};
+
+    Op op_ = Op::None;
+    uint64_t op_end_us_ = 0;
+    uint32_t op_sector_ = 0;
+    uint32_t op_address_ = 0;
+    const uint8_t* op_data_ = nullptr;
+    uint32_t op_len_ = 0;
+    uint32_t fail_sector_ = UINT32_MAX;
+};
+
+}  // namespace usb::sim
@@ -0,0 +1,602 @@
+/**
+ * @file SdCardSim.hpp
+ * @brief Host-модель SD карты для native тестов и бенчмарков
+ *
+ * Модель не зависит от HAL: заглушка stubs/stm32h7xx_hal.h транслирует
+ * вызовы HAL_SD_* в методы SdCardSim. Время продвигается через SimTime,
+ * поэтому замеры пропускной способности воспроизводимы.
+ *
+ * Что моделируется:
+ * - латентность команды и передачи блока (1-bit шина в 4 раза медленнее)
+ * - busy после записи: равномерное распределение + редкий "хвост" (GC)
+ * - физическая страница NAND: запись программирует все затронутые страницы
+ * - FTL: запись не вперёд по открытому блоку стирания — слияние блока
+ * - CSD v1/v2 и CID
+ * - выбор карты CMD7: standby ↔ transfer без повторной идентификации
+ * - инъекция ошибок по LBA, отказ инициализации, извлечение карты
+ * - обрыв длинной передачи без DMA: CPU не успел за FIFO (RX overrun / TX underrun)
+ */
+
+#pragma once
+
+#include "sim/SimTime.hpp"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace usb::sim {
+
+/**
+ * @brief Параметры симулируемой карты
+ */
+struct SdCardSimConfig {
+    uint32_t block_count = 65536;       ///< Ёмкость в 512-байт блоках (32 MB)
+    bool high_capacity = true;          ///< true = SDHC (CSD v2), false = SDSC (CSD v1)
+    uint32_t csd_block_len = 512;       ///< READ_BL_LEN для CSD v1 (512/1024/2048)
+    uint32_t page_size = 4096;          ///< Физическая страница NAND (байт)
+
+    // Латентности (мкс)
+    uint32_t init_latency_us = 250000;  ///< Идентификация карты (CMD0..CMD7)
+    uint32_t cmd_latency_us = 30;       ///< Команда + ответ
+    uint32_t read_access_us = 100;      ///< Доступ к NAND перед первым блоком
+    uint32_t block_xfer_us = 22;        ///< 512 байт по 4-bit шине @ 24 MHz
+
+    // Busy после записи (на каждую затронутую страницу)
+    uint32_t busy_min_us = 250;
+    uint32_t busy_max_us = 750;
+    uint16_t busy_tail_permille = 0;    ///< Доля программирований с "хвостом" (‰)
+    uint32_t busy_tail_us = 20000;      ///< Длительность "хвоста" (garbage collection)
+
+    // FTL: карта дописывает открытые блоки стирания по возрастанию адресов; запись
+    // назад или в середину другого блока — слияние (копирование блока), основная
+    // цена мелких случайных записей
+    uint32_t erase_block_size = 0;      ///< Блок стирания (байт), 0 = без модели FTL
+    uint8_t open_blocks = 2;            ///< Точек дозаписи (≤ kMaxOpenBlocks)
+    uint32_t merge_us = 4000;           ///< Слияние блока стирания
+
+    uint32_t seed = 0x2545F491;         ///< Seed PRNG (детерминированный busy)
+
+    /// Эмулировать HAL, вернувший BlockNbr == 0 (проверка разбора CSD драйвером)
+    bool report_zero_block_nbr = false;
+
+    /// CSD (CSD[0] = биты 127..96, как в HAL). Все нули = сгенерировать из block_count
+    uint32_t csd[4] = {0, 0, 0, 0};
+
+    /// CID (CSD[0] = биты 127..96)
+    uint32_t cid[4] = {0x03534453, 0x53553332, 0x47801234, 0x5678014D};
+};
+
+/// Операция для инъекции ошибки
+enum class SdFaultOp : uint8_t {
+    Read,
+    Write,
+    Any,
+};
+
+/// Результат операции модели
+enum class SdSimStatus : uint8_t {
+    Ok,
+    Error,
+    Timeout,
+};
+
+/// Состояние карты (значения совпадают с HAL_SD_CARD_*)
+enum class SdSimCardState : uint32_t {
+    Standby = 3,
+    Transfer = 4,
+    Programming = 7,
+    Disconnected = 8,
+    Error = 0xFF,
+};
+
+/// Счётчики модели
+struct SdCardSimStats {
+    uint32_t init_count = 0;
+    uint32_t select_cmds = 0;         ///< CMD7 (выбор и снятие выбора)
+    uint32_t read_cmds = 0;
+    uint32_t write_cmds = 0;
+    uint64_t blocks_read = 0;
+    uint64_t blocks_written = 0;
+    uint64_t pages_programmed = 0;
+    uint64_t busy_us_total = 0;       ///< Суммарное время programming
+    uint64_t busy_wait_us_total = 0;  ///< Сколько команд ждали освобождения DAT0
+    uint32_t ftl_merges = 0;          ///< Записей со слиянием блока стирания
+    uint32_t errors_injected = 0;
+};
+
+/**
+ * @brief Симулятор SD карты
+ *
+ * Карта вставляется в "слот" SDMMC1/SDMMC2 через Attach(); HAL заглушка
+ * находит её по hsd->Instance.
+ */
+class SdCardSim {
+public:
+    static constexpr uint32_t kBlockSize = 512;
+    static constexpr uint8_t kMaxSlots = 3;
+    static constexpr uint8_t kMaxFaults = 8;
+    static constexpr uint8_t kMaxOpenBlocks = 8;
+    static constexpr uint16_t kRca = 0x1234;  ///< RCA, выданный при идентификации (CMD3)
+
+    // Коды ошибок (совпадают с SDMMC_ERROR_* из HAL)
+    static constexpr uint32_t kErrorNone = 0x00000000U;
+    static constexpr uint32_t kErrorCmdTimeout = 0x00000004U;
+    static constexpr uint32_t kErrorDataCrc = 0x00000002U;
+    static constexpr uint32_t kErrorDataTimeout = 0x00000008U;
+    static constexpr uint32_t kErrorTxUnderrun = 0x00000010U;
+    static constexpr uint32_t kErrorRxOverrun = 0x00000020U;
+    static constexpr uint32_t kErrorAddressOutOfRange = 0x00000200U;
+
+    explicit SdCardSim(const SdCardSimConfig& config = SdCardSimConfig{})
+        : config_(config), rng_(config.seed != 0 ? config.seed : 1) {
+        if (config_.csd[0] == 0 && config_.csd[1] == 0 &&
+            config_.csd[2] == 0 && config_.csd[3] == 0) {
+            BuildCsd();
+        } else {
+            std::memcpy(csd_, config_.csd, sizeof(csd_));
+        }
+    }
+
+    ~SdCardSim() { Detach(); }
+
+    SdCardSim(const SdCardSim&) = delete;
+    SdCardSim& operator=(const SdCardSim&) = delete;
+
+    // ============ Слоты ============
+
+    /// Вставить карту в слот SDMMC<index>
+    void Attach(uint8_t sdmmc_index = 1) {
+        Detach();
+        if (sdmmc_index < kMaxSlots) {
+            Slots()[sdmmc_index] = this;
+            slot_ = sdmmc_index;
+        }
+    }
+
+    /// Вынуть карту из слота
+    void Detach() {
+        if (slot_ < kMaxSlots && Slots()[slot_] == this) {
+            Slots()[slot_] = nullptr;
+        }
+        slot_ = kMaxSlots;
+    }
+
+    /// Карта в слоте (nullptr если пусто)
+    static SdCardSim* InSlot(uint8_t sdmmc_index) {
+        return sdmmc_index < kMaxSlots ? Slots()[sdmmc_index] : nullptr;
+    }
+
+    // ============ Интерфейс для HAL заглушки ============
+
+    /// Идентификация карты (HAL_SD_Init)
+    SdSimStatus Init() {
+        stats_.init_count++;
+        if (!inserted_) {
+            SimTime::AdvanceUs(config_.cmd_latency_us);
+            last_error_ = kErrorCmdTimeout;
+            return SdSimStatus::Timeout;
+        }
+        if (init_failures_ > 0) {
+            init_failures_--;
+            stats_.errors_injected++;
+            SimTime::AdvanceUs(config_.init_latency_us);
+            last_error_ = kErrorCmdTimeout;
+            return SdSimStatus::Timeout;
+        }
+        SimTime::AdvanceUs(config_.init_latency_us);
+        bus_width_ = 1;
+        busy_until_us_ = 0;
+        state_ = SdSimCardState::Transfer;
+        last_error_ = kErrorNone;
+        return SdSimStatus::Ok;
+    }
+
+    /// Сброс карты в idle (HAL_SD_DeInit)
+    void DeInit() { state_ = SdSimCardState::Standby; }
+
+    /// Переключение ширины шины (ACMD6)
+    SdSimStatus SetBusWidth(uint8_t bits) {
+        if (!CommandAccepted()) {
+            return SdSimStatus::Timeout;
+        }
+        SimTime::AdvanceUs(2ULL * config_.cmd_latency_us);
+        bus_width_ = bits;
+        return SdSimStatus::Ok;
+    }
+
+    /**
+     * @brief Выбор карты (CMD7)
+     *
+     * RCA карты — standby → transfer, 0 — снять выбор (transfer → standby).
+     * Ширина шины (ACMD6) сохраняется, пока карта не теряла питание.
+     * Неидентифицированная карта (извлечена, вставлена заново) не отвечает.
+     */
+    SdSimStatus Select(uint16_t rca) {
+        if (!CommandAccepted()) {
+            return SdSimStatus::Timeout;
+        }
+        stats_.select_cmds++;
+        SimTime::AdvanceUs(config_.cmd_latency_us);
+        if (rca == 0) {
+            if (state_ == SdSimCardState::Transfer) {
+                state_ = SdSimCardState::Standby;
+            }
+            last_error_ = kErrorNone;
+            return SdSimStatus::Ok;
+        }
+        if (rca != kRca || state_ == SdSimCardState::Error) {
+            last_error_ = kErrorCmdTimeout;
+            return SdSimStatus::Timeout;
+        }
+        state_ = SdSimCardState::Transfer;
+        last_error_ = kErrorNone;
+        return SdSimStatus::Ok;
+    }
+
+    /// Чтение блоков (CMD17/CMD18); polled — FIFO читает CPU (HAL без DMA)
+    SdSimStatus ReadBlocks(uint8_t* dst, uint32_t lba, uint32_t count, bool polled = false) {
+        if (!BeginDataCommand()) {
+            return SdSimStatus::Timeout;
+        }
+        stats_.read_cmds++;
+        if (static_cast<uint64_t>(lba) + count > config_.block_count) {
+            last_error_ = kErrorAddressOutOfRange;
+            return SdSimStatus::Error;
+        }
+        SimTime::AdvanceUs(config_.cmd_latency_us + config_.read_access_us);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (polled && ConsumePolledBurst(i)) {
+                last_error_ = kErrorRxOverrun;
+                return SdSimStatus::Error;
+            }
+            SimTime::AdvanceUs(BlockXferUs());
+            if (ConsumeFault(SdFaultOp::Read, lba + i)) {
+                last_error_ = kErrorDataCrc;
+                return SdSimStatus::Error;
+            }
+            auto it = blocks_.find(lba + i);
+            if (it != blocks_.end()) {
+                std::memcpy(dst + i * kBlockSize, it->second.data(), kBlockSize);
+            } else {
+                std::memset(dst + i * kBlockSize, 0, kBlockSize);
+            }
+            stats_.blocks_read++;
+        }
+        if (count > 1) {
+            SimTime::AdvanceUs(config_.cmd_latency_us);  // CMD12
+        }
+        last_error_ = kErrorNone;
+        return SdSimStatus::Ok;
+    }
+
+    /// Запись блоков (CMD24/CMD25), после неё карта уходит в programming;
+    /// polled — FIFO заполняет CPU (HAL без DMA)
+    SdSimStatus WriteBlocks(const uint8_t* src, uint32_t lba, uint32_t count, bool polled = false) {
+        if (!BeginDataCommand()) {
+            return SdSimStatus::Timeout;
+        }
+        stats_.write_cmds++;
+        if (static_cast<uint64_t>(lba) + count > config_.block_count) {
+            last_error_ = kErrorAddressOutOfRange;
+            return SdSimStatus::Error;
+        }
+        SimTime::AdvanceUs(config_.cmd_latency_us);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (polled && ConsumePolledBurst(i)) {
+                // Принятые блоки карта программирует после CMD12
+                StartProgramming(lba, i);
+                last_error_ = kErrorTxUnderrun;
+                return SdSimStatus::Error;
+            }
+            SimTime::AdvanceUs(BlockXferUs());
+            if (ConsumeFault(SdFaultOp::Write, lba + i)) {
+                last_error_ = kErrorDataCrc;
+                return SdSimStatus::Error;
+            }
+            std::memcpy(blocks_[lba + i].data(), src + i * kBlockSize, kBlockSize);
+            stats_.blocks_written++;
+        }
+        if (count > 1) {
+            SimTime::AdvanceUs(config_.cmd_latency_us);  // CMD12
+        }
+        StartProgramming(lba, count);
+        last_error_ = kErrorNone;
+        return SdSimStatus::Ok;
+    }
+
+    /// Текущее состояние (CMD13)
+    SdSimCardState GetCardState() {
+        if (!inserted_) {
+            return SdSimCardState::Disconnected;
+        }
+        SimTime::AdvanceUs(config_.cmd_latency_us);
+        if (state_ == SdSimCardState::Transfer && SimTime::NowUs() < busy_until_us_) {
+            return SdSimCardState::Programming;
+        }
+        return state_;
+    }
+
+    // ============ Геометрия (как её видит HAL) ============
+
+    const uint32_t* Csd() const { return csd_; }
+    const uint32_t* Cid() const { return config_.cid; }
+    bool IsHighCapacity() const { return config_.high_capacity; }
+
+    /// BlockNbr в единицах BlockSize (как HAL_SD_GetCardInfo)
+    uint32_t HalBlockNbr() const {
+        if (config_.report_zero_block_nbr) {
+            return 0;
+        }
+        return config_.block_count / (HalBlockSize() / kBlockSize);
+    }
+
+    /// BlockSize из CSD (READ_BL_LEN)
+    uint32_t HalBlockSize() const {
+        return config_.high_capacity ? kBlockSize : config_.csd_block_len;
+    }
+
+    uint32_t GetLastError() const { return last_error_; }
+    uint8_t GetBusWidth() const { return bus_width_; }
+
+    // ============ Управление тестом ============
+
+    /// Вставить/извлечь карту
+    void SetInserted(bool inserted) {
+        inserted_ = inserted;
+        if (!inserted) {
+            state_ = SdSimCardState::Disconnected;
+        }
+    }
+
+    /// Следующие n инициализаций завершатся таймаутом
+    void FailNextInits(uint32_t n) { init_failures_ = n; }
+
+    /**
+     * @brief Инъекция ошибки данных
+     * @param op Тип операции
+     * @param lba Первый LBA диапазона
+     * @param count Размер диапазона в блоках
+     * @param times Сколько раз сработать (0 = всегда)
+     * @return false если таблица ошибок заполнена
+     */
+    bool InjectFault(SdFaultOp op, uint32_t lba, uint32_t count = 1, uint32_t times = 1) {
+        for (auto& f : faults_) {
+            if (!f.active) {
+                f = Fault{true, op, lba, lba + count - 1, times};
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Обрыв передачи без DMA: CPU успевает за FIFO только blocks блоков
+     *        подряд, дальше — RX overrun / TX underrun (прерывание посреди CMD18/CMD25)
+     * @param blocks Блоков до обрыва (0 = без обрыва)
+     * @param times Сколько раз сработать (0 = всегда)
+     */
+    void FailPolledBursts(uint32_t blocks, uint32_t times = 0) {
+        polled_burst_blocks_ = blocks;
+        polled_burst_times_ = times;
+    }
+
+    void ClearFaults() {
+        for (auto& f : faults_) {
+            f.active = false;
+        }
+        polled_burst_blocks_ = 0;
+    }
+
+    const SdCardSimStats& GetStats() const { return stats_; }
+    void ResetStats() { stats_ = {}; }
+
+    /// Прямой доступ к содержимому блока (для проверок, без затрат времени)
+    void PeekBlock(uint32_t lba, uint8_t* dst) const {
+        auto it = blocks_.find(lba);
+        if (it != blocks_.end()) {
+            std::memcpy(dst, it->second.data(), kBlockSize);
+        } else {
+            std::memset(dst, 0, kBlockSize);
+        }
+    }
+
+    /// Прямая запись блока (подготовка образа, без затрат времени)
+    void PokeBlock(uint32_t lba, const uint8_t* src) {
+        std::memcpy(blocks_[lba].data(), src, kBlockSize);
+    }
+
+    const SdCardSimConfig& GetConfig() const { return config_; }
+
+private:
+    /// Точка дозаписи FTL
+    struct OpenBlock {
+        uint32_t erase_block = UINT32_MAX;
+        uint32_t next_lba = 0;
+        uint64_t last_use = 0;
+    };
+
+    struct Fault {
+        bool active = false;
+        SdFaultOp op = SdFaultOp::Any;
+        uint32_t lba_first = 0;
+        uint32_t lba_last = 0;
+        uint32_t remaining = 0;  ///< 0 = бесконечно
+    };
+
+    static std::array<SdCardSim*, kMaxSlots>& Slots() {
+        static std::array<SdCardSim*, kMaxSlots> slots{};
+        return slots;
+    }
+
+    bool CommandAccepted() {
+        if (!inserted_ || state_ == SdSimCardState::Disconnected) {
+            SimTime::AdvanceUs(config_.cmd_latency_us);
+            last_error_ = kErrorCmdTimeout;
+            return false;
+        }
+        return true;
+    }
+
+    /// Хост ждёт освобождения DAT0 перед следующей командой с данными
+    bool BeginDataCommand() {
+        if (!CommandAccepted() || state_ != SdSimCardState::Transfer) {
+            last_error_ = kErrorCmdTimeout;
+            return false;
+        }
+        if (SimTime::NowUs() < busy_until_us_) {
+            stats_.busy_wait_us_total += busy_until_us_ - SimTime::NowUs();
+            SimTime::AdvanceToUs(busy_until_us_);
+        }
+        return true;
+    }
+
+    uint32_t BlockXferUs() const {
+        return bus_width_ >= 4 ? config_.block_xfer_us : config_.block_xfer_us * 4;
+    }
+
+    bool ConsumeFault(SdFaultOp op, uint32_t lba) {
+        for (auto& f : faults_) {
+            if (!f.active || lba < f.lba_first || lba > f.lba_last) {
+                continue;
+            }
+            if (f.op != SdFaultOp::Any && f.op != op) {
+                continue;
+            }
+            if (f.remaining > 0 && --f.remaining == 0) {
+                f.active = false;
+            }
+            stats_.errors_injected++;
+            return true;
+        }
+        return false;
+    }
+
+    /// Обрыв передачи без DMA перед блоком index
+    bool ConsumePolledBurst(uint32_t index) {
+        if (polled_burst_blocks_ == 0 || index != polled_burst_blocks_) {
+            return false;
+        }
+        if (polled_burst_times_ > 0 && --polled_burst_times_ == 0) {
+            polled_burst_blocks_ = 0;
+        }
+        stats_.errors_injected++;
+        return true;
+    }
+
+    void StartProgramming(uint32_t lba, uint32_t count) {
+        uint32_t blocks_per_page = config_.page_size > kBlockSize ? config_.page_size / kBlockSize : 1;
+        uint32_t first_page = lba / blocks_per_page;
+        uint32_t last_page = (lba + count - 1) / blocks_per_page;
+        uint64_t busy = 0;
+        for (uint32_t p = first_page; p <= last_page; ++p) {
+            busy += SampleBusyUs();
+            stats_.pages_programmed++;
+        }
+        if (!FtlAppend(lba, count)) {
+            busy += config_.merge_us;
+            stats_.ftl_merges++;
+        }
+        stats_.busy_us_total += busy;
+        busy_until_us_ = SimTime::NowUs() + busy;
+    }
+
+    /**
+     * @brief Запись продолжает открытый блок стирания
+     *
+     * Вперёд от точки дозаписи в том же блоке (пропуск страниц NAND допускает)
+     * или с начала блока стирания — без слияния. Точка заменяется по LRU.
+     */
+    bool FtlAppend(uint32_t lba, uint32_t count) {
+        if (config_.erase_block_size < kBlockSize) {
+            return true;
+        }
+        const uint32_t blocks_per_erase = config_.erase_block_size / kBlockSize;
+        const uint32_t open = config_.open_blocks == 0 ? 1
+                              : config_.open_blocks < kMaxOpenBlocks ? config_.open_blocks
+                                                                     : kMaxOpenBlocks;
+        const uint32_t erase_block = lba / blocks_per_erase;
+        ftl_clock_++;
+        OpenBlock* victim = &open_[0];
+        for (uint32_t i = 0; i < open; ++i) {
+            if (open_[i].erase_block == erase_block && open_[i].next_lba <= lba) {
+                open_[i].next_lba = lba + count;
+                open_[i].last_use = ftl_clock_;
+                return true;
+            }
+            if (open_[i].last_use < victim->last_use) {
+                victim = &open_[i];
+            }
+        }
+        victim->erase_block = erase_block;
+        victim->next_lba = lba + count;
+        victim->last_use = ftl_clock_;
+        return lba % blocks_per_erase == 0;
+    }
+
+    uint32_t SampleBusyUs() {
+        uint32_t span = config_.busy_max_us > config_.busy_min_us
+                            ? config_.busy_max_us - config_.busy_min_us : 0;
+        uint32_t busy = config_.busy_min_us + (span > 0 ? NextRandom() % (span + 1) : 0);
+        if (config_.busy_tail_permille > 0 && NextRandom() % 1000 < config_.busy_tail_permille) {
+            busy += config_.busy_tail_us;
+        }
+        return busy;
+    }
+
+    /// xorshift32
+    uint32_t NextRandom() {
+        rng_ ^= rng_ << 13;
+        rng_ ^= rng_ >> 17;
+        rng_ ^= rng_ << 5;
+        return rng_;
+    }
+
+    /// Генерация CSD по ёмкости (раскладка как в HAL: CSD[0] = старшее слово)
+    void BuildCsd() {
+        std::memset(csd_, 0, sizeof(csd_));
+        if (config_.high_capacity) {
+            // CSD v2: capacity = (C_SIZE + 1) * 512 KB
+            uint32_t c_size = config_.block_count / 1024 - 1;
+            csd_[0] = (1U << 30) | 0x000E0032U;           // CSD_STRUCTURE=1, TAAC, TRAN_SPEED
+            csd_[1] = 0x5B590000U | ((c_size >> 16) & 0x3F);  // CCC, READ_BL_LEN=9
+            csd_[2] = ((c_size & 0xFFFF) << 16) | 0x7F80U;
+            csd_[3] = 0x0A400001U;
+        } else {
+            // CSD v1: capacity = (C_SIZE + 1) * 2^(C_SIZE_MULT + 2) * 2^READ_BL_LEN
+            uint32_t read_bl_len = 9;
+            while ((1U << read_bl_len) < config_.csd_block_len && read_bl_len < 11) {
+                read_bl_len++;
+            }
+            const uint32_t c_size_mult = 7;
+            uint32_t units = config_.block_count / ((1U << read_bl_len) / kBlockSize);
+            uint32_t c_size = units / (1U << (c_size_mult + 2)) - 1;
+            csd_[0] = 0x002E0032U;
+            csd_[1] = 0x5F500000U | (read_bl_len << 16) | ((c_size >> 2) & 0x3FF);
+            csd_[2] = ((c_size & 0x3) << 30) | (c_size_mult << 15) | 0x3F80U;
+            csd_[3] = 0x16800001U;
+        }
+    }
+
+    SdCardSimConfig config_;
+    uint32_t csd_[4] = {};
+    uint32_t rng_;
+    uint8_t slot_ = kMaxSlots;
+
+    bool inserted_ = true;
+    uint32_t init_failures_ = 0;
+    SdSimCardState state_ = SdSimCardState::Standby;
+    uint8_t bus_width_ = 1;
+    uint64_t busy_until_us_ = 0;
+    uint32_t last_error_ = kErrorNone;
+
+    std::array<Fault, kMaxFaults> faults_{};
+    uint32_t polled_burst_blocks_ = 0;
+    uint32_t polled_burst_times_ = 0;
+    std::array<OpenBlock, kMaxOpenBlocks> open_{};
+    uint64_t ftl_clock_ = 0;
+    std::unordered_map<uint32_t, std::array<uint8_t, kBlockSize>> blocks_;
+    SdCardSimStats stats_{};
+};
+
+}  // namespace usb::sim
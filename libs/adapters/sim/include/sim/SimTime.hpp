@@ -0,0 +1,58 @@
+/**
+ * @file SimTime.hpp
+ * @brief Виртуальное время для host-симуляторов
+ * 
+ * Все симуляторы (SD карта, HAL заглушки) продвигают одно общее время,
+ * поэтому задержки детерминированы и не зависят от загрузки хоста.
+ */
+
+#pragma once
+
+#include "ports/IClock.hpp"
+#include <cstdint>
+
+namespace usb::sim {
+
+/**
+ * @brief Глобальные виртуальные часы (микросекунды)
+ */
+class SimTime {
+public:
+    /// Текущее виртуальное время в микросекундах
+    static uint64_t NowUs() { return now_us_; }
+    
+    /// Текущее виртуальное время в миллисекундах
+    static uint32_t NowMs() { return static_cast<uint32_t>(now_us_ / 1000); }
+    
+    /// Продвинуть время
+    static void AdvanceUs(uint64_t delta_us) { now_us_ += delta_us; }
+    
+    /// Продвинуть время до момента (если он в будущем)
+    static void AdvanceToUs(uint64_t target_us) {
+        if (target_us > now_us_) {
+            now_us_ = target_us;
+        }
+    }
+    
+    /// Сброс в 0 (между тестами)
+    static void Reset() { now_us_ = 0; }
+
+private:
+    static inline uint64_t now_us_ = 0;
+};
+
+/**
+ * @brief IClock поверх виртуального времени
+ */
+class SimClock final : public ports::IClock {
+public:
+    [[nodiscard]] uint32_t GetTickMs() const override { return SimTime::NowMs(); }
+    
+    [[nodiscard]] uint32_t GetTickUs() const override {
+        return static_cast<uint32_t>(SimTime::NowUs());
+    }
+    
+    void DelayMs(uint32_t ms) override { SimTime::AdvanceUs(static_cast<uint64_t>(ms) * 1000); }
+};
+
+}  // namespace usb::sim
@@ -0,0 +1,461 @@
+/**
+ * @file TinyUsbSim.hpp
+ * @brief Host-модель стека TinyUSB и USB хоста для MSC/CDC
+ *
+ * TinyUsbSim — состояние стека за заглушкой stubs/tusb.h (mounted/suspended,
+ * CDC и vendor FIFO, конечный автомат MSC Bulk-Only Transport).
+ * MscHostSim — упрощённый USB хост: отправляет CBW и ждёт CSW, прокачивая
+ * tud_task() (или пользовательский pump, например UsbDevice::Process).
+ *
+ * Конечный автомат повторяет поведение msc_device.c из TinyUSB 0.16:
+ * - READ10/WRITE10 режутся на куски по размеру EP буфера, lba/offset
+ *   пересчитываются из числа переданных байт
+ * - callback вернул 0 — устройство занято, повтор на следующем tud_task()
+ * - callback вернул меньше запрошенного — остаток досылается следующим вызовом
+ * - ошибка (< 0) — CSW Failed, sense NOT READY / "medium not present"
+ *
+ * Стек можно прокачивать из отдельного потока (режим USB_RTOS_ENABLED):
+ * tud_task_ext() ждёт события (CBW, данные CDC от хоста), MSC и CDC FIFO
+ * защищены мьютексами, хост ждёт CSW через MscHostSim::SetPump().
+ *
+ * Vendor FIFO ограничены CFG_TUD_VENDOR_RX/TX_BUFSIZE: если RX FIFO полон,
+ * данные хоста ждут (NAK) и переходят в FIFO после tud_vendor_read(),
+ * как при перезапуске OUT транзакции в vendor_device.c.
+ *
+ * Suspend/resume: HostSuspend()/HostResume() ставят событие шины, tud_task()
+ * меняет tud_suspended() и вызывает tud_suspend_cb/tud_resume_cb.
+ *
+ * Прерывание USB моделируется вызовом обработчика SetIrqHandler()
+ * (например, UsbDevice::HandleInterrupt) в контексте хоста при приходе
+ * CBW или данных CDC — там же, где на MCU сработал бы OTG_FS_IRQHandler.
+ *
+ * DFU: при tusb_init()/tud_connect() модель читает конфигурацию
+ * (tud_descriptor_configuration_cb) и по интерфейсу DFU выбирает runtime
+ * или DFU mode. Запросы DFU_* выполняет конечный автомат dfu_device.c:
+ * DNLOAD → dfuDNLOAD_SYNC, GETSTATUS → dfuDNBUSY и tud_dfu_download_cb,
+ * tud_dfu_finish_flashing() → dfuDNLOAD_SYNC. Отличие: GETSTATUS в dfuDNBUSY /
+ * dfuMANIFEST (хост не выдержал bwPollTimeout) не STALL, а повтор состояния —
+ * тесты видят такие опросы в DfuHostStats::busy_polls. DfuHostSim — хост
+ * в духе dfu-util, время передачи по шине продвигает SimTime.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace usb::sim {
+
+/// Статус CSW
+enum class CswStatus : uint8_t {
+    Passed = 0,
+    Failed = 1,
+    PhaseError = 2,
+    Timeout = 0xFF,  ///< Устройство не ответило за отведённое число tud_task()
+};
+
+/// Запись о выполненной SCSI команде
+struct ScsiCommandRecord {
+    uint8_t opcode = 0;
+    uint32_t lba = 0;
+    uint32_t blocks = 0;
+    CswStatus status = CswStatus::Passed;
+    uint64_t latency_us = 0;     ///< От CBW до CSW
+    uint32_t callbacks = 0;      ///< Вызовов read10/write10 callback
+    uint32_t busy_retries = 0;   ///< Сколько раз callback вернул 0
+    uint32_t tud_task_calls = 0; ///< Прокачек стека до CSW
+};
+
+/// Счётчики callback'ов MSC
+struct MscSimStats {
+    uint32_t cbw_count = 0;
+    uint32_t read10_cb_calls = 0;
+    uint32_t write10_cb_calls = 0;
+    uint32_t tur_cb_calls = 0;
+    uint32_t inquiry_cb_calls = 0;
+    uint32_t capacity_cb_calls = 0;
+    uint32_t start_stop_cb_calls = 0;
+    uint32_t scsi_cb_calls = 0;
+    uint32_t busy_retries = 0;
+    uint32_t min_chunk = 0;       ///< Минимальный bufsize в read10/write10
+    uint32_t max_chunk = 0;       ///< Максимальный bufsize в read10/write10
+    uint64_t bytes_to_host = 0;
+    uint64_t bytes_from_host = 0;
+};
+
+/**
+ * @brief Состояние стека TinyUSB (синглтон, как сам TinyUSB)
+ */
+class TinyUsbSim {
+public:
+    static TinyUsbSim& Get();
+
+    using IrqHandler = void (*)(uint8_t rhport);
+
+    /// Полный сброс (между тестами)
+    void Reset();
+
+    // ============ Состояние шины ============
+
+    void SetMounted(bool mounted) { mounted_ = mounted; }
+    void SetSuspended(bool suspended) { suspended_ = suspended; }
+    bool IsMounted() const { return mounted_; }
+    bool IsSuspended() const { return suspended_; }
+    bool IsInitialized() const { return initialized_; }
+
+    /// Хост приостановил шину (3 ms без SOF): tud_suspend_cb из следующего tud_task()
+    void HostSuspend();
+    /// Хост возобновил шину: tud_resume_cb из следующего tud_task()
+    void HostResume();
+    uint32_t GetTaskCalls() const { return task_calls_; }
+
+    /// Обработчик «прерывания» USB (nullptr — без прерываний, по умолчанию)
+    void SetIrqHandler(IrqHandler handler) { irq_handler_ = handler; }
+
+    // ============ CDC (сторона хоста) ============
+
+    /// Хост отправил данные (попадают в RX FIFO, tud_cdc_rx_cb — из следующего tud_task)
+    void HostCdcSend(const uint8_t* data, uint32_t len);
+
+    /// Забрать всё, что устройство отправило (TX FIFO уходит хосту по tud_cdc_write_flush)
+    std::vector<uint8_t> HostCdcReceive();
+
+    /// SET_LINE_CODING от хоста
+    void HostSetLineCoding(uint32_t baudrate);
+
+    /// DTR (терминал открыт)
+    void HostSetDtr(bool dtr) { dtr_ = dtr; }
+
+    uint32_t GetCdcFlushCount() const { return cdc_flush_count_; }
+
+    /// Хост забирает до bytes байт TX FIFO после каждого tud_cdc_write (передача IN
+    /// завершилась посреди вывода); 0 — только по flush (по умолчанию)
+    void SetCdcTxDrain(uint32_t bytes) { cdc_tx_drain_ = bytes; }
+
+    // ============ DFU (сторона хоста) ============
+
+    /**
+     * @brief Class запрос DFU_* (dfu::kRequest*) к интерфейсу DFU
+     * @param data   Данные DNLOAD / буфер ответа UPLOAD, GETSTATUS, GETSTATE
+     * @param actual Байт в ответе (nullptr — не нужен)
+     * @return false — STALL
+     */
+    bool HostDfuRequest(uint8_t request, uint16_t value, uint8_t* data, uint16_t len,
+                        uint16_t* actual = nullptr);
+
+    /// bState / bStatus конечного автомата DFU
+    uint8_t GetDfuState() const { return dfu_state_; }
+    uint8_t GetDfuStatus() const { return dfu_status_; }
+
+    /// В текущей конфигурации интерфейс DFU runtime / DFU mode
+    bool HasDfuInterface() const { return dfu_protocol_ != 0; }
+    bool IsDfuMode() const { return dfu_protocol_ == kDfuProtocolMode; }
+
+    /// Переподключения (tud_disconnect / tud_connect)
+    uint32_t GetDisconnectCount() const { return disconnect_count_; }
+    uint32_t GetConnectCount() const { return connect_count_; }
+
+    // ============ Vendor (сторона хоста) ============
+
+    /// Хост отправил данные на bulk OUT (tud_vendor_rx_cb — из следующего tud_task)
+    void HostVendorSend(const uint8_t* data, uint32_t len);
+
+    /// Забрать всё, что устройство отправило (bulk IN, по tud_vendor_write_flush)
+    std::vector<uint8_t> HostVendorReceive();
+
+    /// Байт хоста, ещё не принятых в RX FIFO (NAK)
+    uint32_t HostVendorPending() const;
+
+    /// Ответ последнего tud_control_xfer (данные control IN)
+    std::vector<uint8_t> GetControlReply() const { return control_reply_; }
+
+    // ============ MSC ============
+
+    /// Размер EP буфера MSC (по умолчанию CFG_TUD_MSC_EP_BUFSIZE)
+    void SetMscEpBufferSize(uint32_t size);
+    uint32_t GetMscEpBufferSize() const { return static_cast<uint32_t>(msc_ep_buf_.size()); }
+
+    const MscSimStats& GetMscStats() const { return msc_stats_; }
+    void ResetMscStats() { msc_stats_ = {}; }
+
+    // ============ Сторона устройства (вызывается из tud_* заглушек) ============
+
+    struct MscRequest;
+    void MscSubmit(MscRequest* request);
+    void Task();
+    /// tud_task_ext(): ждать события не дольше timeout_ms, затем Task()
+    void TaskExt(uint32_t timeout_ms);
+    /// tud_task_event_ready(): в очереди есть события для Task()
+    bool EventReady() const {
+        return cdc_rx_event_ || vendor_rx_event_ || vendor_tx_sent_ != 0 || msc_pending_ ||
+               suspend_event_ || resume_event_;
+    }
+    void Init() {
+        initialized_ = true;
+        Enumerate();
+    }
+    bool Connect();
+    bool Disconnect();
+    void DfuFinishFlashing(uint8_t status);
+
+    bool CdcConnected() const { return mounted_ && dtr_; }
+    uint32_t CdcAvailable() const;
+    uint32_t CdcRead(uint8_t* buffer, uint32_t bufsize);
+    void CdcReadFlush();
+    uint32_t CdcWrite(const uint8_t* data, uint32_t len);
+    uint32_t CdcWriteAvailable() const;
+    void CdcWriteFlush();
+
+    uint32_t VendorAvailable() const;
+    uint32_t VendorRead(uint8_t* buffer, uint32_t bufsize);
+    uint32_t VendorWrite(const uint8_t* data, uint32_t len);
+    uint32_t VendorWriteAvailable() const;
+    void VendorWriteFlush();
+    bool ControlXfer(const void* data, uint16_t len);
+
+    void SetSense(uint8_t key, uint8_t asc, uint8_t ascq) {
+        sense_key_ = key;
+        sense_asc_ = asc;
+        sense_ascq_ = ascq;
+    }
+
+private:
+    TinyUsbSim();
+
+    void MscStep();
+    void MscBuiltin(MscRequest& req);
+    void MscFinish(CswStatus status);
+    void MscRecordChunk(uint32_t size);
+    void Notify();
+    uint32_t CdcWriteAvailableLocked() const;
+    void VendorTask();
+    void Enumerate();
+    bool DfuGetStatus(uint8_t* data, uint16_t len, uint16_t* actual);
+    bool DfuStall();
+
+    static constexpr uint8_t kDfuProtocolRuntime = 1;
+    static constexpr uint8_t kDfuProtocolMode = 2;
+
+    bool initialized_ = false;
+    bool mounted_ = true;
+    bool suspended_ = false;
+    std::atomic<bool> suspend_event_{false};
+    std::atomic<bool> resume_event_{false};
+    std::atomic<uint32_t> task_calls_{0};
+    std::atomic<IrqHandler> irq_handler_{nullptr};
+
+    // События для tud_task_ext()
+    std::mutex event_mutex_;
+    std::condition_variable event_cv_;
+    bool event_pending_ = false;
+
+    // CDC FIFO
+    mutable std::mutex cdc_mutex_;
+    std::atomic<bool> cdc_rx_event_{false};
+    std::vector<uint8_t> cdc_rx_;
+    std::vector<uint8_t> cdc_tx_;
+    std::vector<uint8_t> cdc_host_rx_;  ///< Отправлено хосту
+    bool dtr_ = false;
+    uint32_t cdc_flush_count_ = 0;
+    uint32_t cdc_tx_drain_ = 0;
+
+    // Vendor FIFO
+    mutable std::mutex vendor_mutex_;
+    std::atomic<bool> vendor_rx_event_{false};
+    std::atomic<uint32_t> vendor_tx_sent_{0};  ///< Отправлено с прошлого tud_vendor_tx_cb
+    std::vector<uint8_t> vendor_rx_;
+    std::vector<uint8_t> vendor_host_tx_;  ///< Ждут места в RX FIFO
+    std::vector<uint8_t> vendor_tx_;
+    std::vector<uint8_t> vendor_host_rx_;  ///< Отправлено хосту
+    std::vector<uint8_t> control_reply_;
+
+    // Sense (одна LUN)
+    uint8_t sense_key_ = 0;
+    uint8_t sense_asc_ = 0;
+    uint8_t sense_ascq_ = 0;
+
+    std::mutex msc_mutex_;  ///< msc_active_ и шаг конечного автомата
+    std::vector<uint8_t> msc_ep_buf_;
+    MscRequest* msc_active_ = nullptr;
+    std::atomic<bool> msc_pending_{false};  ///< Есть активный CBW (для tud_task_ext)
+    MscSimStats msc_stats_{};
+
+    // DFU (запросы и finish — из одного потока, как в тестах DfuHostSim)
+    uint8_t dfu_protocol_ = 0;     ///< 0 — нет интерфейса DFU
+    uint8_t dfu_attributes_ = 0;
+    uint8_t dfu_state_ = 0;
+    uint8_t dfu_status_ = 0;
+    bool dfu_flashing_ = false;    ///< Ждём tud_dfu_finish_flashing() после download_cb
+    bool dfu_manifesting_ = false; ///< Ждём tud_dfu_finish_flashing() после manifest_cb
+    uint16_t dfu_block_ = 0;
+    uint16_t dfu_length_ = 0;
+    std::vector<uint8_t> dfu_buf_;  ///< Буфер TinyUSB (CFG_TUD_DFU_XFER_BUFSIZE)
+    uint32_t connect_count_ = 0;
+    uint32_t disconnect_count_ = 0;
+};
+
+/// Запрос BOT (CBW + буфер данных), обрабатывается TinyUsbSim::Task()
+struct TinyUsbSim::MscRequest {
+    uint8_t lun = 0;
+    uint8_t cdb[16] = {};
+    bool dir_in = true;
+    uint8_t* data = nullptr;
+    uint32_t data_len = 0;
+
+    // Прогресс
+    uint32_t xferred = 0;
+    uint32_t ep_fill = 0;     ///< Байт в EP буфере (WRITE10)
+    uint32_t block_size = 512;
+    std::atomic<bool> done{false};  ///< CSW отправлен (ставится последним)
+    CswStatus status = CswStatus::Passed;
+    uint32_t residue = 0;
+    ScsiCommandRecord record;
+};
+
+/**
+ * @brief Модель USB хоста (Bulk-Only Transport)
+ */
+class MscHostSim {
+public:
+    using PumpFn = void (*)(void* context);
+    using TimeFn = uint64_t (*)();
+
+    explicit MscHostSim(uint8_t lun = 0) : lun_(lun) {}
+
+    /// Чем прокачивать стек (по умолчанию tud_task; при задаче USB — ожидание)
+    void SetPump(PumpFn pump, void* context = nullptr) {
+        pump_ = pump;
+        pump_context_ = context;
+    }
+
+    /// Источник времени для латентности (по умолчанию SimTime)
+    void SetTimeSource(TimeFn now_us) { now_us_ = now_us; }
+
+    /// Предел прокачек на одну команду
+    void SetMaxPumps(uint32_t max_pumps) { max_pumps_ = max_pumps; }
+
+    // ============ Команды ============
+
+    CswStatus TestUnitReady();
+    CswStatus Inquiry(uint8_t out[36]);
+    CswStatus ReadCapacity(uint32_t* last_lba, uint32_t* block_size);
+    CswStatus RequestSense(uint8_t* key, uint8_t* asc, uint8_t* ascq);
+    /// MODE SENSE(6): бит WP в device-specific parameter
+    CswStatus ModeSense6(bool* write_protected);
+    CswStatus StartStopUnit(bool start, bool load_eject);
+    /// SYNCHRONIZE CACHE(10) всего носителя
+    CswStatus SynchronizeCache10();
+    CswStatus Read10(uint32_t lba, uint16_t blocks, uint8_t* data);
+    CswStatus Write10(uint32_t lba, uint16_t blocks, const uint8_t* data);
+
+    /// Произвольная команда
+    CswStatus Execute(const uint8_t* cdb, uint8_t cdb_len, bool dir_in, uint8_t* data,
+                      uint32_t data_len);
+
+    // ============ Результаты ============
+
+    const std::vector<ScsiCommandRecord>& GetRecords() const { return records_; }
+    void ClearRecords() { records_.clear(); }
+    uint32_t GetLastResidue() const { return last_residue_; }
+    uint32_t GetBlockSize() const { return block_size_; }
+
+private:
+    uint8_t lun_;
+    uint32_t block_size_ = 512;
+    PumpFn pump_ = nullptr;
+    void* pump_context_ = nullptr;
+    TimeFn now_us_ = nullptr;
+    uint32_t max_pumps_ = 100000;
+    uint32_t last_residue_ = 0;
+    std::vector<ScsiCommandRecord> records_;
+};
+
+/// Ответ DFU_GETSTATUS
+struct DfuStatusReply {
+    uint8_t status = 0;
+    uint32_t poll_timeout_ms = 0;
+    uint8_t state = 0;
+};
+
+/// Счётчики DfuHostSim
+struct DfuHostStats {
+    uint32_t requests = 0;
+    uint32_t stalls = 0;
+    uint32_t status_polls = 0;
+    uint32_t busy_polls = 0;  ///< GETSTATUS, пока устройство в dfuDNBUSY / dfuMANIFEST
+    uint64_t bus_us = 0;      ///< Control transfer'ы на шине
+    uint64_t wait_us = 0;     ///< Ожидание bwPollTimeout
+};
+
+/**
+ * @brief Модель USB хоста DFU (как dfu-util)
+ *
+ * Каждый запрос занимает шину request_us + packet_us на пакет EP0 данных;
+ * это время, как и bwPollTimeout, продвигается в SimTime шагами step_us
+ * с прокачкой стека между шагами — устройство работает, пока хост ждёт.
+ */
+class DfuHostSim {
+public:
+    using PumpFn = void (*)(void* context);
+
+    /// Модель времени control transfer (Full Speed)
+    struct Timing {
+        uint32_t request_us = 125;  ///< SETUP + STATUS
+        uint32_t packet_us = 64;    ///< Пакет данных EP0 (64 байта)
+        uint32_t step_us = 250;     ///< Шаг прокачки стека
+    };
+
+    DfuHostSim() = default;
+    explicit DfuHostSim(const Timing& timing) : timing_(timing) {}
+
+    /// Чем прокачивать стек (по умолчанию tud_task)
+    void SetPump(PumpFn pump, void* context = nullptr) {
+        pump_ = pump;
+        pump_context_ = context;
+    }
+
+    // ============ Запросы (false — STALL) ============
+
+    bool Detach(uint16_t timeout_ms = 1000);
+    bool Download(uint16_t block, const uint8_t* data, uint16_t len);
+    bool GetStatus(DfuStatusReply* reply);
+    bool ClrStatus();
+    bool GetState(uint8_t* state);
+    bool Abort();
+    /// Блок DFU_UPLOAD: число байт или -1 (STALL)
+    int32_t Upload(uint16_t block, uint8_t* data, uint16_t len);
+
+    /// Продвинуть SimTime на us, прокачивая стек
+    void Wait(uint64_t us);
+
+    /**
+     * @brief Загрузка образа как dfu-util -D
+     *
+     * Блоки по transfer_size, после каждого GETSTATUS до выхода из dfuDNBUSY
+     * (с ожиданием bwPollTimeout), затем DNLOAD нулевой длины и GETSTATUS
+     * до dfuIDLE / dfuMANIFEST-WAIT-RESET.
+     * @param last Последний ответ GETSTATUS (причина ошибки)
+     * @return true — образ принят и манифестация прошла
+     */
+    bool DownloadImage(const uint8_t* image, uint32_t size, uint16_t transfer_size,
+                       DfuStatusReply* last = nullptr);
+
+    const DfuHostStats& GetStats() const { return stats_; }
+    void ResetStats() { stats_ = {}; }
+
+private:
+    bool Request(uint8_t request, uint16_t value, uint8_t* data, uint16_t len,
+                 uint16_t* actual = nullptr);
+    bool PollWhileBusy(DfuStatusReply* reply);
+    void Pump();
+
+    Timing timing_{};
+    PumpFn pump_ = nullptr;
+    void* pump_context_ = nullptr;
+    DfuHostStats stats_{};
+};
+
+}  // namespace usb::sim
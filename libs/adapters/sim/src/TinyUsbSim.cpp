@@ -0,0 +1,1135 @@
+/**
+ * @file TinyUsbSim.cpp
+ * @brief Реализация заглушки TinyUSB (stubs/tusb.h) для native сборки
+ */
+
+#include "sim/TinyUsbSim.hpp"
+#include "sim/SimTime.hpp"
+
+extern "C" {
+#include "tusb.h"
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace usb::sim {
+
+namespace {
+
+#ifdef CFG_TUD_MSC_EP_BUFSIZE
+constexpr uint32_t kDefaultMscEpBufSize = CFG_TUD_MSC_EP_BUFSIZE;
+#else
+constexpr uint32_t kDefaultMscEpBufSize = 512;
+#endif
+
+#ifdef CFG_TUD_CDC_TX_BUFSIZE
+constexpr uint32_t kCdcTxFifoSize = CFG_TUD_CDC_TX_BUFSIZE;
+#else
+constexpr uint32_t kCdcTxFifoSize = 512;
+#endif
+
+#ifdef CFG_TUD_VENDOR_RX_BUFSIZE
+constexpr uint32_t kVendorRxFifoSize = CFG_TUD_VENDOR_RX_BUFSIZE;
+constexpr uint32_t kVendorTxFifoSize = CFG_TUD_VENDOR_TX_BUFSIZE;
+#else
+constexpr uint32_t kVendorRxFifoSize = 512;
+constexpr uint32_t kVendorTxFifoSize = 512;
+#endif
+
+#ifdef CFG_TUD_DFU_XFER_BUFSIZE
+constexpr uint32_t kDfuXferBufSize = CFG_TUD_DFU_XFER_BUFSIZE;
+#else
+constexpr uint32_t kDfuXferBufSize = 512;
+#endif
+
+// DFU 1.1 (usb_dfu.h повторён: модель собирается и без USB_DFU_ENABLED)
+constexpr uint8_t kDfuDetach = 0;
+constexpr uint8_t kDfuDnload = 1;
+constexpr uint8_t kDfuUpload = 2;
+constexpr uint8_t kDfuGetStatus = 3;
+constexpr uint8_t kDfuClrStatus = 4;
+constexpr uint8_t kDfuGetState = 5;
+constexpr uint8_t kDfuAbort = 6;
+constexpr uint8_t kDfuAttrManifestationTolerant = 0x04;
+
+uint32_t GetBe32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+uint16_t GetBe16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+void PutBe32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+void PutBe16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v >> 8);
+    p[1] = static_cast<uint8_t>(v);
+}
+
+uint64_t DefaultNowUs() { return SimTime::NowUs(); }
+
+}  // namespace
+
+//--------------------------------------------------------------------+
+// TinyUsbSim
+//--------------------------------------------------------------------+
+
+TinyUsbSim::TinyUsbSim() : msc_ep_buf_(kDefaultMscEpBufSize), dfu_buf_(kDfuXferBufSize) {}
+
+TinyUsbSim& TinyUsbSim::Get() {
+    static TinyUsbSim instance;
+    return instance;
+}
+
+void TinyUsbSim::Reset() {
+    initialized_ = false;
+    mounted_ = true;
+    suspended_ = false;
+    suspend_event_ = false;
+    resume_event_ = false;
+    task_calls_ = 0;
+    irq_handler_ = nullptr;
+    event_pending_ = false;
+    cdc_rx_event_ = false;
+    cdc_rx_.clear();
+    cdc_tx_.clear();
+    cdc_host_rx_.clear();
+    dtr_ = false;
+    cdc_flush_count_ = 0;
+    cdc_tx_drain_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(vendor_mutex_);
+        vendor_rx_event_ = false;
+        vendor_tx_sent_ = 0;
+        vendor_rx_.clear();
+        vendor_host_tx_.clear();
+        vendor_tx_.clear();
+        vendor_host_rx_.clear();
+        control_reply_.clear();
+    }
+    sense_key_ = sense_asc_ = sense_ascq_ = 0;
+    msc_ep_buf_.assign(kDefaultMscEpBufSize, 0);
+    msc_active_ = nullptr;
+    msc_pending_ = false;
+    msc_stats_ = {};
+    connect_count_ = 0;
+    disconnect_count_ = 0;
+    Enumerate();  // Устройство подключено (mounted_): конфигурация уже прочитана
+}
+
+void TinyUsbSim::Enumerate() {
+    // Хост читает конфигурацию заново: интерфейс DFU и его bmAttributes
+    dfu_protocol_ = 0;
+    dfu_attributes_ = 0;
+    const uint8_t* config =
+        tud_descriptor_configuration_cb != nullptr ? tud_descriptor_configuration_cb(0) : nullptr;
+    if (config != nullptr) {
+        const uint16_t total = static_cast<uint16_t>(config[2] | (config[3] << 8));
+        for (uint16_t pos = 0; pos + 2 <= total && config[pos] != 0; pos += config[pos]) {
+            const uint8_t* d = config + pos;
+            if (d[1] == 0x04 && d[5] == 0xFE && d[6] == 0x01) {  // Interface: Application, DFU
+                dfu_protocol_ = d[7];
+            } else if (d[1] == 0x21 && dfu_protocol_ != 0) {  // DFU Functional
+                dfu_attributes_ = d[2];
+            }
+        }
+    }
+    dfu_state_ = IsDfuMode() ? DFU_IDLE : APP_IDLE;
+    dfu_status_ = DFU_STATUS_OK;
+    dfu_flashing_ = false;
+    dfu_manifesting_ = false;
+}
+
+bool TinyUsbSim::Connect() {
+    Enumerate();
+    mounted_ = true;
+    connect_count_++;
+    return true;
+}
+
+bool TinyUsbSim::Disconnect() {
+    mounted_ = false;
+    disconnect_count_++;
+    return true;
+}
+
+void TinyUsbSim::Notify() {
+    {
+        std::lock_guard<std::mutex> lock(event_mutex_);
+        event_pending_ = true;
+    }
+    event_cv_.notify_one();
+    IrqHandler handler = irq_handler_.load();
+    if (handler != nullptr) {
+        handler(0);  // Device стек модели — rhport 0
+    }
+}
+
+void TinyUsbSim::HostSuspend() {
+    suspend_event_ = true;
+    Notify();
+}
+
+void TinyUsbSim::HostResume() {
+    resume_event_ = true;
+    Notify();
+}
+
+void TinyUsbSim::HostCdcSend(const uint8_t* data, uint32_t len) {
+    {
+        std::lock_guard<std::mutex> lock(cdc_mutex_);
+        cdc_rx_.insert(cdc_rx_.end(), data, data + len);
+    }
+    // Как в cdc_device.c: tud_cdc_rx_cb из tud_task(), а не из контекста хоста
+    cdc_rx_event_ = true;
+    Notify();
+}
+
+std::vector<uint8_t> TinyUsbSim::HostCdcReceive() {
+    std::lock_guard<std::mutex> lock(cdc_mutex_);
+    std::vector<uint8_t> out;
+    out.swap(cdc_host_rx_);
+    return out;
+}
+
+void TinyUsbSim::CdcWriteFlush() {
+    std::lock_guard<std::mutex> lock(cdc_mutex_);
+    cdc_flush_count_++;
+    cdc_host_rx_.insert(cdc_host_rx_.end(), cdc_tx_.begin(), cdc_tx_.end());
+    cdc_tx_.clear();
+}
+
+void TinyUsbSim::HostSetLineCoding(uint32_t baudrate) {
+    cdc_line_coding_t coding = {};
+    coding.bit_rate = baudrate;
+    coding.data_bits = 8;
+    if (tud_cdc_line_coding_cb != nullptr) {
+        tud_cdc_line_coding_cb(0, &coding);
+    }
+}
+
+uint32_t TinyUsbSim::CdcAvailable() const {
+    std::lock_guard<std::mutex> lock(cdc_mutex_);
+    return static_cast<uint32_t>(cdc_rx_.size());
+}
+
+void TinyUsbSim::CdcReadFlush() {
+    std::lock_guard<std::mutex> lock(cdc_mutex_);
+    cdc_rx_.clear();
+}
+
+uint32_t TinyUsbSim::CdcRead(uint8_t* buffer, uint32_t bufsize) {
+    std::lock_guard<std::mutex> lock(cdc_mutex_);
+    uint32_t n = std::min(bufsize, static_cast<uint32_t>(cdc_rx_.size()));
+    std::memcpy(buffer, cdc_rx_.data(), n);
+    cdc_rx_.erase(cdc_rx_.begin(), cdc_rx_.begin() + n);
+    return n;
+}
+
+uint32_t TinyUsbSim::CdcWrite(const uint8_t* data, uint32_t len) {
+    std::lock_guard<std::mutex> lock(cdc_mutex_);
+    uint32_t n = std::min(len, CdcWriteAvailableLocked());
+    cdc_tx_.insert(cdc_tx_.end(), data, data + n);
+    const uint32_t drain = std::min(cdc_tx_drain_, static_cast<uint32_t>(cdc_tx_.size()));
+    cdc_host_rx_.insert(cdc_host_rx_.end(), cdc_tx_.begin(), cdc_tx_.begin() + drain);
+    cdc_tx_.erase(cdc_tx_.begin(), cdc_tx_.begin() + drain);
+    return n;
+}
+
+uint32_t TinyUsbSim::CdcWriteAvailable() const {
+    std::lock_guard<std::mutex> lock(cdc_mutex_);
+    return CdcWriteAvailableLocked();
+}
+
+uint32_t TinyUsbSim::CdcWriteAvailableLocked() const {
+    return cdc_tx_.size() >= kCdcTxFifoSize
+               ? 0 : kCdcTxFifoSize - static_cast<uint32_t>(cdc_tx_.size());
+}
+
+void TinyUsbSim::HostVendorSend(const uint8_t* data, uint32_t len) {
+    {
+        std::lock_guard<std::mutex> lock(vendor_mutex_);
+        vendor_host_tx_.insert(vendor_host_tx_.end(), data, data + len);
+    }
+    vendor_rx_event_ = true;
+    Notify();
+}
+
+std::vector<uint8_t> TinyUsbSim::HostVendorReceive() {
+    std::lock_guard<std::mutex> lock(vendor_mutex_);
+    std::vector<uint8_t> out;
+    out.swap(vendor_host_rx_);
+    return out;
+}
+
+uint32_t TinyUsbSim::HostVendorPending() const {
+    std::lock_guard<std::mutex> lock(vendor_mutex_);
+    return static_cast<uint32_t>(vendor_host_tx_.size());
+}
+
+uint32_t TinyUsbSim::VendorAvailable() const {
+    std::lock_guard<std::mutex> lock(vendor_mutex_);
+    return static_cast<uint32_t>(vendor_rx_.size());
+}
+
+uint32_t TinyUsbSim::VendorRead(uint8_t* buffer, uint32_t bufsize) {
+    bool rearm;
+    uint32_t n;
+    {
+        std::lock_guard<std::mutex> lock(vendor_mutex_);
+        n = std::min(bufsize, static_cast<uint32_t>(vendor_rx_.size()));
+        std::memcpy(buffer, vendor_rx_.data(), n);
+        vendor_rx_.erase(vendor_rx_.begin(), vendor_rx_.begin() + n);
+        rearm = n > 0 && !vendor_host_tx_.empty();
+    }
+    if (rearm) {
+        // Место в FIFO — хост досылает то, на что получил NAK
+        vendor_rx_event_ = true;
+        Notify();
+    }
+    return n;
+}
+
+uint32_t TinyUsbSim::VendorWrite(const uint8_t* data, uint32_t len) {
+    std::lock_guard<std::mutex> lock(vendor_mutex_);
+    uint32_t space = kVendorTxFifoSize - static_cast<uint32_t>(vendor_tx_.size());
+    uint32_t n = std::min(len, space);
+    vendor_tx_.insert(vendor_tx_.end(), data, data + n);
+    return n;
+}
+
+uint32_t TinyUsbSim::VendorWriteAvailable() const {
+    std::lock_guard<std::mutex> lock(vendor_mutex_);
+    return kVendorTxFifoSize - static_cast<uint32_t>(vendor_tx_.size());
+}
+
+void TinyUsbSim::VendorWriteFlush() {
+    uint32_t sent;
+    {
+        std::lock_guard<std::mutex> lock(vendor_mutex_);
+        sent = static_cast<uint32_t>(vendor_tx_.size());
+        vendor_host_rx_.insert(vendor_host_rx_.end(), vendor_tx_.begin(), vendor_tx_.end());
+        vendor_tx_.clear();
+    }
+    if (sent > 0) {
+        // Завершение bulk IN — прерывание, tud_vendor_tx_cb из tud_task()
+        vendor_tx_sent_ += sent;
+        Notify();
+    }
+}
+
+void TinyUsbSim::VendorTask() {
+    if (vendor_rx_event_.exchange(false)) {
+        bool received;
+        {
+            std::lock_guard<std::mutex> lock(vendor_mutex_);
+            uint32_t space = kVendorRxFifoSize - static_cast<uint32_t>(vendor_rx_.size());
+            uint32_t n = std::min(space, static_cast<uint32_t>(vendor_host_tx_.size()));
+            vendor_rx_.insert(vendor_rx_.end(), vendor_host_tx_.begin(),
+                              vendor_host_tx_.begin() + n);
+            vendor_host_tx_.erase(vendor_host_tx_.begin(), vendor_host_tx_.begin() + n);
+            received = n > 0;
+        }
+        if (received && tud_vendor_rx_cb != nullptr) {
+            tud_vendor_rx_cb(0);
+        }
+    }
+    uint32_t sent = vendor_tx_sent_.exchange(0);
+    if (sent > 0 && tud_vendor_tx_cb != nullptr) {
+        tud_vendor_tx_cb(0, sent);
+    }
+}
+
+bool TinyUsbSim::ControlXfer(const void* data, uint16_t len) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    control_reply_.assign(bytes, bytes + len);
+    return true;
+}
+
+bool TinyUsbSim::DfuStall() {
+    // Запрос не в своём состоянии (dfu_device.c): STALL и dfuERROR
+    dfu_state_ = DFU_ERROR;
+    dfu_status_ = DFU_STATUS_ERR_STALLEDPKT;
+    return false;
+}
+
+bool TinyUsbSim::DfuGetStatus(uint8_t* data, uint16_t len, uint16_t* actual) {
+    if (data == nullptr || len < 6) {
+        return false;
+    }
+    bool download = false;
+    bool manifest = false;
+    switch (dfu_state_) {
+        case DFU_DNLOAD_SYNC:
+            dfu_state_ = dfu_flashing_ ? DFU_DNBUSY : DFU_DNLOAD_IDLE;
+            download = dfu_flashing_;
+            break;
+        case DFU_MANIFEST_SYNC:
+            dfu_state_ = dfu_manifesting_ ? DFU_MANIFEST : DFU_IDLE;
+            manifest = dfu_manifesting_;
+            break;
+        default:
+            break;  // dfuDNBUSY / dfuMANIFEST: повтор состояния (см. заголовок)
+    }
+
+    uint32_t timeout = 0;
+    if (tud_dfu_get_timeout_cb != nullptr &&
+        (dfu_state_ == DFU_DNBUSY || dfu_state_ == DFU_MANIFEST)) {
+        timeout = tud_dfu_get_timeout_cb(0, dfu_state_);
+    }
+    data[0] = dfu_status_;
+    data[1] = static_cast<uint8_t>(timeout);
+    data[2] = static_cast<uint8_t>(timeout >> 8);
+    data[3] = static_cast<uint8_t>(timeout >> 16);
+    data[4] = dfu_state_;
+    data[5] = 0;
+    if (actual != nullptr) {
+        *actual = 6;
+    }
+
+    // Стадия ACK: callbacks после отправки ответа
+    if (download && tud_dfu_download_cb != nullptr) {
+        tud_dfu_download_cb(0, dfu_block_, dfu_buf_.data(), dfu_length_);
+    } else if (manifest && tud_dfu_manifest_cb != nullptr) {
+        tud_dfu_manifest_cb(0);
+    }
+    return true;
+}
+
+bool TinyUsbSim::HostDfuRequest(uint8_t request, uint16_t value, uint8_t* data, uint16_t len,
+                                uint16_t* actual) {
+    if (actual != nullptr) {
+        *actual = 0;
+    }
+    if (!mounted_ || dfu_protocol_ == 0) {
+        return false;
+    }
+
+    if (dfu_protocol_ == kDfuProtocolRuntime) {
+        // dfu_rt_device.c: DETACH и опрос состояния appIDLE
+        switch (request) {
+            case kDfuDetach:
+                if (tud_dfu_runtime_reboot_to_dfu_cb != nullptr) {
+                    tud_dfu_runtime_reboot_to_dfu_cb();
+                }
+                return true;
+            case kDfuGetStatus:
+                return DfuGetStatus(data, len, actual);
+            case kDfuGetState:
+                if (data == nullptr || len < 1) {
+                    return false;
+                }
+                data[0] = dfu_state_;
+                if (actual != nullptr) {
+                    *actual = 1;
+                }
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    const uint8_t state = dfu_state_;
+    switch (request) {
+        case kDfuDetach:
+            if (tud_dfu_detach_cb != nullptr) {
+                tud_dfu_detach_cb();
+            }
+            return true;
+
+        case kDfuGetStatus:
+            return DfuGetStatus(data, len, actual);
+
+        case kDfuGetState:
+            if (data == nullptr || len < 1 || state == DFU_DNBUSY || state == DFU_MANIFEST) {
+                break;
+            }
+            data[0] = state;
+            if (actual != nullptr) {
+                *actual = 1;
+            }
+            return true;
+
+        case kDfuClrStatus:
+            if (state != DFU_ERROR) {
+                break;
+            }
+            dfu_state_ = DFU_IDLE;
+            dfu_status_ = DFU_STATUS_OK;
+            return true;
+
+        case kDfuAbort:
+            if (state != DFU_IDLE && state != DFU_DNLOAD_SYNC && state != DFU_DNLOAD_IDLE &&
+                state != DFU_MANIFEST_SYNC && state != DFU_UPLOAD_IDLE) {
+                break;
+            }
+            if (tud_dfu_abort_cb != nullptr) {
+                tud_dfu_abort_cb(0);
+            }
+            dfu_state_ = DFU_IDLE;
+            dfu_flashing_ = false;
+            return true;
+
+        case kDfuDnload:
+            if (len > dfu_buf_.size() || (len > 0 && data == nullptr)) {
+                break;
+            }
+            if (len > 0 && (state == DFU_IDLE || state == DFU_DNLOAD_IDLE)) {
+                std::memcpy(dfu_buf_.data(), data, len);
+                dfu_block_ = value;
+                dfu_length_ = len;
+                dfu_flashing_ = true;
+                dfu_state_ = DFU_DNLOAD_SYNC;
+                return true;
+            }
+            if (len == 0 && state == DFU_DNLOAD_IDLE) {
+                dfu_manifesting_ = true;
+                dfu_state_ = DFU_MANIFEST_SYNC;
+                return true;
+            }
+            break;
+
+        case kDfuUpload: {
+            if ((state != DFU_IDLE && state != DFU_UPLOAD_IDLE) || data == nullptr ||
+                len > dfu_buf_.size()) {
+                break;
+            }
+            uint16_t n = 0;
+            if (tud_dfu_upload_cb != nullptr) {
+                n = tud_dfu_upload_cb(0, value, dfu_buf_.data(), len);
+            }
+            n = std::min(n, len);
+            std::memcpy(data, dfu_buf_.data(), n);
+            if (actual != nullptr) {
+                *actual = n;
+            }
+            dfu_state_ = n < len ? DFU_IDLE : DFU_UPLOAD_IDLE;  // Короткий блок — конец
+            return true;
+        }
+
+        default:
+            break;
+    }
+    return DfuStall();
+}
+
+void TinyUsbSim::DfuFinishFlashing(uint8_t status) {
+    dfu_flashing_ = false;
+    dfu_manifesting_ = false;
+    if (status != DFU_STATUS_OK) {
+        dfu_state_ = DFU_ERROR;
+        dfu_status_ = status;
+        return;
+    }
+    if (dfu_state_ == DFU_DNBUSY) {
+        dfu_state_ = DFU_DNLOAD_SYNC;
+    } else if (dfu_state_ == DFU_MANIFEST) {
+        dfu_state_ = (dfu_attributes_ & kDfuAttrManifestationTolerant) != 0
+                         ? DFU_MANIFEST_SYNC : DFU_MANIFEST_WAIT_RESET;
+    }
+}
+
+void TinyUsbSim::SetMscEpBufferSize(uint32_t size) {
+    msc_ep_buf_.assign(size, 0);
+}
+
+void TinyUsbSim::MscSubmit(MscRequest* request) {
+    {
+        std::lock_guard<std::mutex> lock(msc_mutex_);
+        msc_active_ = request;
+        msc_pending_ = request != nullptr;
+        if (request != nullptr) {
+            msc_stats_.cbw_count++;
+        }
+    }
+    if (request != nullptr) {
+        Notify();
+    }
+}
+
+void TinyUsbSim::Task() {
+    task_calls_++;
+    // Как usbd.c: флаг suspended и callback — при разборе события в tud_task()
+    if (suspend_event_.exchange(false)) {
+        suspended_ = true;
+        if (tud_suspend_cb != nullptr) {
+            tud_suspend_cb(false);
+        }
+    }
+    if (resume_event_.exchange(false)) {
+        suspended_ = false;
+        if (tud_resume_cb != nullptr) {
+            tud_resume_cb();
+        }
+    }
+    if (cdc_rx_event_.exchange(false) && tud_cdc_rx_cb != nullptr) {
+        tud_cdc_rx_cb(0);
+    }
+    VendorTask();
+    std::lock_guard<std::mutex> lock(msc_mutex_);
+    if (msc_active_ != nullptr) {
+        msc_active_->record.tud_task_calls++;
+        MscStep();
+    }
+}
+
+void TinyUsbSim::TaskExt(uint32_t timeout_ms) {
+    {
+        std::unique_lock<std::mutex> lock(event_mutex_);
+        // Busy-повтор MSC в TinyUSB — событие в очереди, ждать нечего
+        auto ready = [this] { return event_pending_ || msc_pending_; };
+        event_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+        event_pending_ = false;
+    }
+    Task();
+}
+
+void TinyUsbSim::MscFinish(CswStatus status) {
+    MscRequest& req = *msc_active_;
+    req.status = status;
+    req.residue = req.data_len > req.xferred ? req.data_len - req.xferred : 0;
+    msc_active_ = nullptr;
+    msc_pending_ = false;
+
+    // Как в msc_device.c: complete callback после отправки CSW
+    switch (req.cdb[0]) {
+        case SCSI_CMD_READ_10:
+            if (tud_msc_read10_complete_cb != nullptr) {
+                tud_msc_read10_complete_cb(req.lun);
+            }
+            break;
+        case SCSI_CMD_WRITE_10:
+            if (tud_msc_write10_complete_cb != nullptr) {
+                tud_msc_write10_complete_cb(req.lun);
+            }
+            break;
+        default:
+            if (tud_msc_scsi_complete_cb != nullptr) {
+                tud_msc_scsi_complete_cb(req.lun, req.cdb);
+            }
+            break;
+    }
+    req.done.store(true, std::memory_order_release);
+}
+
+void TinyUsbSim::MscRecordChunk(uint32_t size) {
+    if (msc_stats_.min_chunk == 0 || size < msc_stats_.min_chunk) {
+        msc_stats_.min_chunk = size;
+    }
+    msc_stats_.max_chunk = std::max(msc_stats_.max_chunk, size);
+}
+
+void TinyUsbSim::MscBuiltin(MscRequest& req) {
+    const uint8_t lun = req.lun;
+    const uint8_t* cdb = req.cdb;
+    uint8_t resp[36] = {};
+    int32_t resplen = 0;
+
+    switch (cdb[0]) {
+        case SCSI_CMD_TEST_UNIT_READY:
+            msc_stats_.tur_cb_calls++;
+            if (!tud_msc_test_unit_ready_cb(lun)) {
+                resplen = -1;
+                if (sense_key_ == 0) {
+                    SetSense(SCSI_SENSE_NOT_READY, 0x04, 0x00);
+                }
+            }
+            break;
+
+        case SCSI_CMD_START_STOP_UNIT:
+            if (tud_msc_start_stop_cb != nullptr) {
+                msc_stats_.start_stop_cb_calls++;
+                bool start = (cdb[4] & 0x01) != 0;
+                bool load_eject = (cdb[4] & 0x02) != 0;
+                if (!tud_msc_start_stop_cb(lun, cdb[4] >> 4, start, load_eject)) {
+                    resplen = -1;
+                    if (sense_key_ == 0) {
+                        SetSense(SCSI_SENSE_NOT_READY, 0x04, 0x00);
+                    }
+                }
+            }
+            break;
+
+        case SCSI_CMD_READ_CAPACITY_10:
+        case SCSI_CMD_READ_FORMAT_CAPACITY: {
+            msc_stats_.capacity_cb_calls++;
+            uint32_t block_count = 0;
+            uint16_t block_size = 0;
+            tud_msc_capacity_cb(lun, &block_count, &block_size);
+            if (block_count == 0 || block_size == 0) {
+                resplen = -1;
+                if (sense_key_ == 0) {
+                    SetSense(SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+                }
+            } else if (cdb[0] == SCSI_CMD_READ_CAPACITY_10) {
+                PutBe32(resp, block_count - 1);
+                PutBe32(resp + 4, block_size);
+                resplen = 8;
+            } else {
+                resp[3] = 8;  // capacity list length
+                PutBe32(resp + 4, block_count);
+                resp[8] = 2;  // formatted media
+                resp[9] = 0;
+                PutBe16(resp + 10, block_size);
+                resplen = 12;
+            }
+            break;
+        }
+
+        case SCSI_CMD_INQUIRY:
+            msc_stats_.inquiry_cb_calls++;
+            resp[1] = 0x80;  // removable
+            resp[2] = 2;     // version
+            resp[3] = 2;     // response data format
+            resp[4] = 31;    // additional length
+            tud_msc_inquiry_cb(lun, resp + 8, resp + 16, resp + 32);
+            resplen = 36;
+            break;
+
+        case SCSI_CMD_MODE_SENSE_6:
+            resp[0] = 3;
+            if (tud_msc_is_writable_cb != nullptr && !tud_msc_is_writable_cb(lun)) {
+                resp[2] = 0x80;  // WP
+            }
+            resplen = 4;
+            break;
+
+        case SCSI_CMD_REQUEST_SENSE:
+            resp[0] = 0x70;  // current errors, fixed format
+            resp[2] = sense_key_;
+            resp[7] = 10;    // additional sense length
+            resp[12] = sense_asc_;
+            resp[13] = sense_ascq_;
+            resplen = 18;
+            SetSense(0, 0, 0);
+            break;
+
+        default: {
+            msc_stats_.scsi_cb_calls++;
+            std::vector<uint8_t> buf(req.data_len > 0 ? req.data_len : 1);
+            resplen = tud_msc_scsi_cb(lun, cdb, buf.data(), static_cast<uint16_t>(req.data_len));
+            if (resplen < 0) {
+                if (sense_key_ == 0) {
+                    SetSense(SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+                }
+            } else if (req.dir_in && req.data != nullptr) {
+                uint32_t n = std::min(static_cast<uint32_t>(resplen), req.data_len);
+                std::memcpy(req.data, buf.data(), n);
+                req.xferred = n;
+            }
+            MscFinish(resplen < 0 ? CswStatus::Failed : CswStatus::Passed);
+            return;
+        }
+    }
+
+    if (resplen < 0) {
+        MscFinish(CswStatus::Failed);
+        return;
+    }
+    if (resplen > 0 && req.data != nullptr) {
+        uint32_t n = std::min(static_cast<uint32_t>(resplen), req.data_len);
+        std::memcpy(req.data, resp, n);
+        req.xferred = n;
+        msc_stats_.bytes_to_host += n;
+    }
+    MscFinish(CswStatus::Passed);
+}
+
+void TinyUsbSim::MscStep() {
+    MscRequest& req = *msc_active_;
+    const uint8_t opcode = req.cdb[0];
+
+    if (opcode != SCSI_CMD_READ_10 && opcode != SCSI_CMD_WRITE_10) {
+        MscBuiltin(req);
+        return;
+    }
+
+    const uint32_t start_lba = GetBe32(req.cdb + 2);
+    const uint32_t lba = start_lba + req.xferred / req.block_size;
+    const uint32_t offset = req.xferred % req.block_size;
+    const uint32_t bufsize = static_cast<uint32_t>(msc_ep_buf_.size());
+
+    if (opcode == SCSI_CMD_READ_10) {
+        uint32_t nbytes = std::min(bufsize, req.data_len - req.xferred);
+        msc_stats_.read10_cb_calls++;
+        req.record.callbacks++;
+        MscRecordChunk(nbytes);
+        int32_t result = tud_msc_read10_cb(req.lun, lba, offset, msc_ep_buf_.data(), nbytes);
+        if (result < 0) {
+            SetSense(SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+            MscFinish(CswStatus::Failed);
+            return;
+        }
+        if (result == 0) {
+            msc_stats_.busy_retries++;
+            req.record.busy_retries++;
+            return;
+        }
+        uint32_t n = std::min(static_cast<uint32_t>(result), nbytes);
+        std::memcpy(req.data + req.xferred, msc_ep_buf_.data(), n);
+        req.xferred += n;
+        msc_stats_.bytes_to_host += n;
+    } else {
+        // Как TinyUSB: защита от записи проверяется до приёма данных
+        if (req.xferred == 0 && req.ep_fill == 0 && tud_msc_is_writable_cb != nullptr &&
+            !tud_msc_is_writable_cb(req.lun)) {
+            SetSense(SCSI_SENSE_DATA_PROTECT, 0x27, 0x00);
+            MscFinish(CswStatus::Failed);
+            return;
+        }
+        if (req.ep_fill == 0) {
+            req.ep_fill = std::min(bufsize, req.data_len - req.xferred);
+            std::memcpy(msc_ep_buf_.data(), req.data + req.xferred, req.ep_fill);
+            msc_stats_.bytes_from_host += req.ep_fill;
+        }
+        msc_stats_.write10_cb_calls++;
+        req.record.callbacks++;
+        MscRecordChunk(req.ep_fill);
+        int32_t result = tud_msc_write10_cb(req.lun, lba, offset, msc_ep_buf_.data(), req.ep_fill);
+        if (result < 0) {
+            SetSense(SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+            MscFinish(CswStatus::Failed);
+            return;
+        }
+        if (result == 0) {
+            msc_stats_.busy_retries++;
+            req.record.busy_retries++;
+            return;
+        }
+        uint32_t n = std::min(static_cast<uint32_t>(result), req.ep_fill);
+        if (n < req.ep_fill) {
+            // Частичная обработка: остаток остаётся в EP буфере
+            std::memmove(msc_ep_buf_.data(), msc_ep_buf_.data() + n, req.ep_fill - n);
+        }
+        req.ep_fill -= n;
+        req.xferred += n;
+    }
+
+    if (req.xferred >= req.data_len) {
+        MscFinish(CswStatus::Passed);
+    }
+}
+
+//--------------------------------------------------------------------+
+// MscHostSim
+//--------------------------------------------------------------------+
+
+CswStatus MscHostSim::Execute(const uint8_t* cdb, uint8_t cdb_len, bool dir_in, uint8_t* data,
+                              uint32_t data_len) {
+    TimeFn now = now_us_ != nullptr ? now_us_ : DefaultNowUs;
+    TinyUsbSim& stack = TinyUsbSim::Get();
+
+    TinyUsbSim::MscRequest req;
+    req.lun = lun_;
+    std::memcpy(req.cdb, cdb, std::min<uint8_t>(cdb_len, 16));
+    req.dir_in = dir_in;
+    req.data = data;
+    req.data_len = data_len;
+    req.block_size = block_size_;
+    req.record.opcode = cdb[0];
+    if (cdb[0] == SCSI_CMD_READ_10 || cdb[0] == SCSI_CMD_WRITE_10) {
+        req.record.lba = GetBe32(cdb + 2);
+        req.record.blocks = GetBe16(cdb + 7);
+        if (req.record.blocks > 0) {
+            req.block_size = data_len / req.record.blocks;
+        }
+    }
+
+    const uint64_t start = now();
+    stack.MscSubmit(&req);
+    for (uint32_t i = 0; i < max_pumps_ && !req.done.load(std::memory_order_acquire); ++i) {
+        if (pump_ != nullptr) {
+            pump_(pump_context_);
+        } else {
+            tud_task();
+        }
+    }
+    if (!req.done.load(std::memory_order_acquire)) {
+        stack.MscSubmit(nullptr);
+        req.status = CswStatus::Timeout;
+    }
+
+    req.record.status = req.status;
+    req.record.latency_us = now() - start;
+    last_residue_ = req.residue;
+    records_.push_back(req.record);
+    return req.status;
+}
+
+CswStatus MscHostSim::TestUnitReady() {
+    const uint8_t cdb[6] = {SCSI_CMD_TEST_UNIT_READY, 0, 0, 0, 0, 0};
+    return Execute(cdb, sizeof(cdb), true, nullptr, 0);
+}
+
+CswStatus MscHostSim::Inquiry(uint8_t out[36]) {
+    const uint8_t cdb[6] = {SCSI_CMD_INQUIRY, 0, 0, 0, 36, 0};
+    return Execute(cdb, sizeof(cdb), true, out, 36);
+}
+
+CswStatus MscHostSim::ReadCapacity(uint32_t* last_lba, uint32_t* block_size) {
+    const uint8_t cdb[10] = {SCSI_CMD_READ_CAPACITY_10};
+    uint8_t resp[8] = {};
+    CswStatus status = Execute(cdb, sizeof(cdb), true, resp, sizeof(resp));
+    if (status == CswStatus::Passed) {
+        *last_lba = GetBe32(resp);
+        *block_size = GetBe32(resp + 4);
+        block_size_ = *block_size;
+    }
+    return status;
+}
+
+CswStatus MscHostSim::RequestSense(uint8_t* key, uint8_t* asc, uint8_t* ascq) {
+    const uint8_t cdb[6] = {SCSI_CMD_REQUEST_SENSE, 0, 0, 0, 18, 0};
+    uint8_t resp[18] = {};
+    CswStatus status = Execute(cdb, sizeof(cdb), true, resp, sizeof(resp));
+    *key = resp[2] & 0x0F;
+    *asc = resp[12];
+    *ascq = resp[13];
+    return status;
+}
+
+CswStatus MscHostSim::ModeSense6(bool* write_protected) {
+    const uint8_t cdb[6] = {SCSI_CMD_MODE_SENSE_6, 0, 0x3F, 0, 4, 0};
+    uint8_t resp[4] = {};
+    CswStatus status = Execute(cdb, sizeof(cdb), true, resp, sizeof(resp));
+    *write_protected = (resp[2] & 0x80) != 0;
+    return status;
+}
+
+CswStatus MscHostSim::StartStopUnit(bool start, bool load_eject) {
+    uint8_t cdb[6] = {SCSI_CMD_START_STOP_UNIT, 0, 0, 0, 0, 0};
+    cdb[4] = static_cast<uint8_t>((start ? 0x01 : 0) | (load_eject ? 0x02 : 0));
+    return Execute(cdb, sizeof(cdb), true, nullptr, 0);
+}
+
+CswStatus MscHostSim::SynchronizeCache10() {
+    const uint8_t cdb[10] = {0x35};  // LBA 0, блоков 0 — весь носитель
+    return Execute(cdb, sizeof(cdb), false, nullptr, 0);
+}
+
+CswStatus MscHostSim::Read10(uint32_t lba, uint16_t blocks, uint8_t* data) {
+    uint8_t cdb[10] = {SCSI_CMD_READ_10};
+    PutBe32(cdb + 2, lba);
+    PutBe16(cdb + 7, blocks);
+    return Execute(cdb, sizeof(cdb), true, data, static_cast<uint32_t>(blocks) * block_size_);
+}
+
+CswStatus MscHostSim::Write10(uint32_t lba, uint16_t blocks, const uint8_t* data) {
+    uint8_t cdb[10] = {SCSI_CMD_WRITE_10};
+    PutBe32(cdb + 2, lba);
+    PutBe16(cdb + 7, blocks);
+    // Данные хоста только читаются (dir_in = false)
+    return Execute(cdb, sizeof(cdb), false, const_cast<uint8_t*>(data),
+                   static_cast<uint32_t>(blocks) * block_size_);
+}
+
+//--------------------------------------------------------------------+
+// DfuHostSim
+//--------------------------------------------------------------------+
+
+void DfuHostSim::Pump() {
+    if (pump_ != nullptr) {
+        pump_(pump_context_);
+    } else {
+        tud_task();
+    }
+}
+
+void DfuHostSim::Wait(uint64_t us) {
+    while (us > 0) {
+        const uint64_t step = std::min<uint64_t>(us, timing_.step_us);
+        SimTime::AdvanceUs(step);
+        us -= step;
+        Pump();
+    }
+}
+
+bool DfuHostSim::Request(uint8_t request, uint16_t value, uint8_t* data, uint16_t len,
+                         uint16_t* actual) {
+    stats_.requests++;
+    const bool ok = TinyUsbSim::Get().HostDfuRequest(request, value, data, len, actual);
+    stats_.stalls += ok ? 0 : 1;
+
+    // Шина занята SETUP, пакетами данных и STATUS; устройство тем временем работает
+    const uint64_t bus = timing_.request_us + static_cast<uint64_t>((len + 63) / 64) *
+                                                  timing_.packet_us;
+    stats_.bus_us += bus;
+    Wait(bus);
+    return ok;
+}
+
+bool DfuHostSim::Detach(uint16_t timeout_ms) {
+    return Request(kDfuDetach, timeout_ms, nullptr, 0);
+}
+
+bool DfuHostSim::Download(uint16_t block, const uint8_t* data, uint16_t len) {
+    return Request(kDfuDnload, block, const_cast<uint8_t*>(data), len);
+}
+
+bool DfuHostSim::GetStatus(DfuStatusReply* reply) {
+    uint8_t raw[6] = {};
+    stats_.status_polls++;
+    if (!Request(kDfuGetStatus, 0, raw, sizeof(raw))) {
+        return false;
+    }
+    reply->status = raw[0];
+    reply->poll_timeout_ms = raw[1] | (raw[2] << 8) | (static_cast<uint32_t>(raw[3]) << 16);
+    reply->state = raw[4];
+    return true;
+}
+
+bool DfuHostSim::ClrStatus() { return Request(kDfuClrStatus, 0, nullptr, 0); }
+
+bool DfuHostSim::GetState(uint8_t* state) { return Request(kDfuGetState, 0, state, 1); }
+
+bool DfuHostSim::Abort() { return Request(kDfuAbort, 0, nullptr, 0); }
+
+int32_t DfuHostSim::Upload(uint16_t block, uint8_t* data, uint16_t len) {
+    uint16_t actual = 0;
+    return Request(kDfuUpload, block, data, len, &actual) ? actual : -1;
+}
+
+bool DfuHostSim::PollWhileBusy(DfuStatusReply* reply) {
+    // dfu-util: GETSTATUS, пауза bwPollTimeout, пока устройство занято
+    for (;;) {
+        if (!GetStatus(reply)) {
+            return false;
+        }
+        if (reply->state != DFU_DNBUSY && reply->state != DFU_MANIFEST &&
+            reply->state != DFU_DNLOAD_SYNC && reply->state != DFU_MANIFEST_SYNC) {
+            return true;
+        }
+        stats_.busy_polls += reply->state == DFU_DNBUSY || reply->state == DFU_MANIFEST;
+        const uint64_t wait = static_cast<uint64_t>(reply->poll_timeout_ms) * 1000;
+        stats_.wait_us += wait;
+        Wait(wait);
+    }
+}
+
+bool DfuHostSim::DownloadImage(const uint8_t* image, uint32_t size, uint16_t transfer_size,
+                               DfuStatusReply* last) {
+    DfuStatusReply reply;
+    bool ok = true;
+    uint16_t block = 0;
+    for (uint32_t offset = 0; ok && offset < size; offset += transfer_size, block++) {
+        const uint16_t len = static_cast<uint16_t>(std::min<uint32_t>(transfer_size,
+                                                                      size - offset));
+        ok = Download(block, image + offset, len) && PollWhileBusy(&reply) &&
+             reply.state == DFU_DNLOAD_IDLE;
+    }
+    if (ok) {
+        ok = Download(block, nullptr, 0) && PollWhileBusy(&reply) &&
+             (reply.state == DFU_IDLE || reply.state == DFU_MANIFEST_WAIT_RESET);
+    }
+    if (last != nullptr) {
+        *last = reply;
+    }
+    return ok && reply.status == DFU_STATUS_OK;
+}
+
+}  // namespace usb::sim
+
+//--------------------------------------------------------------------+
+// tud_* API
+//--------------------------------------------------------------------+
+
+using usb::sim::TinyUsbSim;
+
+extern "C" {
+
+bool tusb_init(void) {
+    TinyUsbSim::Get().Init();
+    return true;
+}
+
+void tud_task(void) { TinyUsbSim::Get().Task(); }
+
+void tud_task_ext(uint32_t timeout_ms, bool in_isr) {
+    (void)in_isr;
+    TinyUsbSim::Get().TaskExt(timeout_ms);
+}
+
+bool tud_task_event_ready(void) { return TinyUsbSim::Get().EventReady(); }
+
+bool tud_connected(void) { return TinyUsbSim::Get().IsMounted(); }
+
+bool tud_mounted(void) { return TinyUsbSim::Get().IsMounted(); }
+
+bool tud_ready(void) {
+    return TinyUsbSim::Get().IsMounted() && !TinyUsbSim::Get().IsSuspended();
+}
+
+bool tud_suspended(void) { return TinyUsbSim::Get().IsSuspended(); }
+
+bool tud_connect(void) { return TinyUsbSim::Get().Connect(); }
+
+bool tud_disconnect(void) { return TinyUsbSim::Get().Disconnect(); }
+
+void tud_int_handler(uint8_t rhport) { (void)rhport; }
+
+void tud_dfu_finish_flashing(uint8_t status) { TinyUsbSim::Get().DfuFinishFlashing(status); }
+
+bool tud_cdc_connected(void) { return TinyUsbSim::Get().CdcConnected(); }
+
+uint32_t tud_cdc_available(void) { return TinyUsbSim::Get().CdcAvailable(); }
+
+uint32_t tud_cdc_read(void* buffer, uint32_t bufsize) {
+    return TinyUsbSim::Get().CdcRead(static_cast<uint8_t*>(buffer), bufsize);
+}
+
+void tud_cdc_read_flush(void) { TinyUsbSim::Get().CdcReadFlush(); }
+
+uint32_t tud_cdc_write(void const* buffer, uint32_t bufsize) {
+    return TinyUsbSim::Get().CdcWrite(static_cast<const uint8_t*>(buffer), bufsize);
+}
+
+uint32_t tud_cdc_write_flush(void) {
+    TinyUsbSim::Get().CdcWriteFlush();
+    return 0;
+}
+
+uint32_t tud_cdc_write_available(void) { return TinyUsbSim::Get().CdcWriteAvailable(); }
+
+bool tud_control_xfer(uint8_t rhport, tusb_control_request_t const* request, void* buffer,
+                      uint16_t len) {
+    (void)rhport;
+    uint16_t n = len < request->wLength ? len : request->wLength;
+    return TinyUsbSim::Get().ControlXfer(buffer, n);
+}
+
+bool tud_vendor_mounted(void) { return TinyUsbSim::Get().IsMounted(); }
+
+uint32_t tud_vendor_available(void) { return TinyUsbSim::Get().VendorAvailable(); }
+
+uint32_t tud_vendor_read(void* buffer, uint32_t bufsize) {
+    return TinyUsbSim::Get().VendorRead(static_cast<uint8_t*>(buffer), bufsize);
+}
+
+uint32_t tud_vendor_write(void const* buffer, uint32_t bufsize) {
+    return TinyUsbSim::Get().VendorWrite(static_cast<const uint8_t*>(buffer), bufsize);
+}
+
+uint32_t tud_vendor_write_flush(void) {
+    TinyUsbSim::Get().VendorWriteFlush();
+    return 0;
+}
+
+uint32_t tud_vendor_write_available(void) { return TinyUsbSim::Get().VendorWriteAvailable(); }
+
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code,
+                       uint8_t add_sense_qualifier) {
+    (void)lun;
+    TinyUsbSim::Get().SetSense(sense_key, add_sense_code, add_sense_qualifier);
+    return true;
+}
+
+}  // extern "C"
@@ -0,0 +1,524 @@
+/**
+ * @file stm32h7xx_hal.h
+ * @brief Host-заглушка STM32H7 HAL для native сборки
+ *
+ * Содержит ровно ту часть HAL, которую использует библиотека
+ * (RCC/PWR/GPIO/NVIC/SDMMC/SD). Вызовы HAL_SD_* транслируются в SdCardSim,
+ * HAL_GetTick/HAL_Delay работают поверх SimTime.
+ *
+ * Подключается только в native окружении (-I libs/adapters/sim/stubs),
+ * в прошивке используется настоящий HAL.
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "stm32h7xx_hal.h (sim): только для C++ (native тесты)"
+#endif
+
+#include "sim/SdCardSim.hpp"
+#include <cstdint>
+
+//--------------------------------------------------------------------+
+// Общие типы
+//--------------------------------------------------------------------+
+
+typedef enum {
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U,
+} HAL_StatusTypeDef;
+
+//--------------------------------------------------------------------+
+// Периферия (регистры как обычная память)
+//--------------------------------------------------------------------+
+
+typedef struct {
+    volatile uint32_t MODER;
+    volatile uint32_t ODR;
+    volatile uint32_t BSRR;
+} GPIO_TypeDef;
+
+typedef struct {
+    volatile uint32_t POWER;
+    volatile uint32_t CLKCR;
+    volatile uint32_t ARG;
+    volatile uint32_t CMD;
+    volatile uint32_t RESPCMD;
+    volatile uint32_t RESP1;
+    volatile uint32_t RESP2;
+    volatile uint32_t RESP3;
+    volatile uint32_t RESP4;
+    volatile uint32_t STA;
+    volatile uint32_t ICR;
+    volatile uint32_t MASK;
+} SDMMC_TypeDef;
+
+namespace usb::sim {
+
+/// Состояние "железа" заглушки (тактирование, регистры)
+struct HalState {
+    GPIO_TypeDef gpio[8] = {};
+    SDMMC_TypeDef sdmmc[3] = {};
+    bool sdmmc_clk[3] = {false, false, false};
+    bool pll_ready = true;
+    uint32_t gpio_init_calls = 0;
+    uint32_t gpio_deinit_calls = 0;
+    bool sdmmc_irq_enabled[3] = {false, false, false};
+    uint32_t sd_dma_transfers = 0;  ///< HAL_SD_*Blocks_DMA (IDMA)
+
+    static HalState& Get() {
+        static HalState state;
+        return state;
+    }
+
+    /// Сброс между тестами
+    static void Reset() { Get() = HalState{}; }
+};
+
+}  // namespace usb::sim
+
+#define GPIOA (&usb::sim::HalState::Get().gpio[0])
+#define GPIOB (&usb::sim::HalState::Get().gpio[1])
+#define GPIOC (&usb::sim::HalState::Get().gpio[2])
+#define GPIOD (&usb::sim::HalState::Get().gpio[3])
+#define GPIOE (&usb::sim::HalState::Get().gpio[4])
+#define GPIOF (&usb::sim::HalState::Get().gpio[5])
+#define GPIOG (&usb::sim::HalState::Get().gpio[6])
+#define GPIOH (&usb::sim::HalState::Get().gpio[7])
+
+#define SDMMC1 (&usb::sim::HalState::Get().sdmmc[1])
+#define SDMMC2 (&usb::sim::HalState::Get().sdmmc[2])
+
+//--------------------------------------------------------------------+
+// NVIC
+//--------------------------------------------------------------------+
+
+typedef enum {
+    SDMMC1_IRQn = 49,
+    SDMMC2_IRQn = 124,
+} IRQn_Type;
+
+//--------------------------------------------------------------------+
+// RCC / PWR
+//--------------------------------------------------------------------+
+
+typedef struct {
+    uint32_t PLLState;
+    uint32_t PLLSource;
+    uint32_t PLLM;
+    uint32_t PLLN;
+    uint32_t PLLP;
+    uint32_t PLLQ;
+    uint32_t PLLR;
+    uint32_t PLLRGE;
+    uint32_t PLLVCOSEL;
+    uint32_t PLLFRACN;
+} RCC_PLLInitTypeDef;
+
+typedef struct {
+    uint32_t OscillatorType;
+    uint32_t HSEState;
+    uint32_t HSI48State;
+    RCC_PLLInitTypeDef PLL;
+} RCC_OscInitTypeDef;
+
+typedef struct {
+    uint32_t ClockType;
+    uint32_t SYSCLKSource;
+    uint32_t SYSCLKDivider;
+    uint32_t AHBCLKDivider;
+    uint32_t APB3CLKDivider;
+    uint32_t APB1CLKDivider;
+    uint32_t APB2CLKDivider;
+    uint32_t APB4CLKDivider;
+} RCC_ClkInitTypeDef;
+
+typedef struct {
+    uint64_t PeriphClockSelection;
+    uint32_t SdmmcClockSelection;
+    uint32_t UsbClockSelection;
+} RCC_PeriphCLKInitTypeDef;
+
+#define RCC_FLAG_PLLRDY               0x39U
+#define RCC_OSCILLATORTYPE_HSE        0x01U
+#define RCC_OSCILLATORTYPE_HSI48      0x20U
+#define RCC_HSE_OFF                   0x00U
+#define RCC_HSE_ON                    0x01U
+#define RCC_HSI48_ON                  0x01U
+#define RCC_PLL_NONE                  0x00U
+#define RCC_PLL_ON                    0x02U
+#define RCC_PLLSOURCE_HSI             0x00U
+#define RCC_PLLSOURCE_HSE             0x02U
+#define RCC_PLL1VCIRANGE_2            0x08U
+#define RCC_PLL1VCOWIDE               0x00U
+#define RCC_CLOCKTYPE_SYSCLK          0x01U
+#define RCC_CLOCKTYPE_HCLK            0x02U
+#define RCC_CLOCKTYPE_D1PCLK1         0x04U
+#define RCC_CLOCKTYPE_PCLK1           0x08U
+#define RCC_CLOCKTYPE_PCLK2           0x10U
+#define RCC_CLOCKTYPE_D3PCLK1         0x20U
+#define RCC_SYSCLKSOURCE_PLLCLK       0x03U
+#define RCC_SYSCLK_DIV1               0x00U
+#define RCC_HCLK_DIV2                 0x08U
+#define RCC_APB1_DIV2                 0x40U
+#define RCC_APB2_DIV2                 0x400U
+#define RCC_APB3_DIV2                 0x40U
+#define RCC_APB4_DIV2                 0x40U
+#define FLASH_LATENCY_4               0x04U
+#define RCC_PERIPHCLK_SDMMC           0x00010000U
+#define RCC_PERIPHCLK_USB             0x00080000U
+#define RCC_SDMMCCLKSOURCE_PLL        0x00U
+#define RCC_USBCLKSOURCE_HSI48        0x00300000U
+#define PWR_LDO_SUPPLY                0x02U
+#define PWR_REGULATOR_VOLTAGE_SCALE0  0x00U
+#define PWR_FLAG_VOSRDY               0x0DU
+
+#define __HAL_RCC_GET_FLAG(flag)            (usb::sim::HalState::Get().pll_ready ? 1U : 0U)
+#define __HAL_PWR_VOLTAGESCALING_CONFIG(x)  ((void)(x))
+#define __HAL_PWR_GET_FLAG(flag)            (1U)
+
+#define __HAL_RCC_GPIOA_CLK_ENABLE()        ((void)0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE()        ((void)0)
+#define __HAL_RCC_GPIOD_CLK_ENABLE()        ((void)0)
+
+#define __HAL_RCC_SDMMC1_CLK_ENABLE()       (usb::sim::HalState::Get().sdmmc_clk[1] = true)
+#define __HAL_RCC_SDMMC1_CLK_DISABLE()      (usb::sim::HalState::Get().sdmmc_clk[1] = false)
+#define __HAL_RCC_SDMMC1_FORCE_RESET()      ((void)0)
+#define __HAL_RCC_SDMMC1_RELEASE_RESET()    ((void)0)
+#define __HAL_RCC_SDMMC2_CLK_ENABLE()       (usb::sim::HalState::Get().sdmmc_clk[2] = true)
+#define __HAL_RCC_SDMMC2_CLK_DISABLE()      (usb::sim::HalState::Get().sdmmc_clk[2] = false)
+#define __HAL_RCC_SDMMC2_FORCE_RESET()      ((void)0)
+#define __HAL_RCC_SDMMC2_RELEASE_RESET()    ((void)0)
+
+//--------------------------------------------------------------------+
+// GPIO
+//--------------------------------------------------------------------+
+
+typedef struct {
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+typedef enum {
+    GPIO_PIN_RESET = 0U,
+    GPIO_PIN_SET = 1U,
+} GPIO_PinState;
+
+#define GPIO_PIN_11                 0x0800U
+#define GPIO_PIN_12                 0x1000U
+#define GPIO_MODE_AF_PP             0x02U
+#define GPIO_NOPULL                 0x00U
+#define GPIO_PULLUP                 0x01U
+#define GPIO_SPEED_FREQ_VERY_HIGH   0x03U
+#define GPIO_AF12_SDMMC1            0x0CU
+
+//--------------------------------------------------------------------+
+// SDMMC / SD
+//--------------------------------------------------------------------+
+
+typedef struct {
+    uint32_t ClockEdge;
+    uint32_t ClockPowerSave;
+    uint32_t BusWide;
+    uint32_t HardwareFlowControl;
+    uint32_t ClockDiv;
+} SDMMC_InitTypeDef;
+
+typedef SDMMC_InitTypeDef SD_InitTypeDef;
+
+typedef struct {
+    uint32_t CardType;
+    uint32_t CardVersion;
+    uint32_t Class;
+    uint32_t RelCardAdd;
+    uint32_t BlockNbr;
+    uint32_t BlockSize;
+    uint32_t LogBlockNbr;
+    uint32_t LogBlockSize;
+    uint32_t CardSpeed;
+} HAL_SD_CardInfoTypeDef;
+
+typedef enum {
+    HAL_SD_STATE_RESET = 0x00U,
+    HAL_SD_STATE_READY = 0x01U,
+    HAL_SD_STATE_TIMEOUT = 0x02U,
+    HAL_SD_STATE_BUSY = 0x03U,
+    HAL_SD_STATE_PROGRAMMING = 0x04U,
+    HAL_SD_STATE_RECEIVING = 0x05U,
+    HAL_SD_STATE_TRANSFER = 0x06U,
+    HAL_SD_STATE_ERROR = 0x0FU,
+} HAL_SD_StateTypeDef;
+
+typedef uint32_t HAL_SD_CardStateTypeDef;
+
+#define HAL_SD_CARD_READY           0x00000001U
+#define HAL_SD_CARD_IDENTIFICATION  0x00000002U
+#define HAL_SD_CARD_STANDBY         0x00000003U
+#define HAL_SD_CARD_TRANSFER        0x00000004U
+#define HAL_SD_CARD_SENDING         0x00000005U
+#define HAL_SD_CARD_RECEIVING       0x00000006U
+#define HAL_SD_CARD_PROGRAMMING     0x00000007U
+#define HAL_SD_CARD_DISCONNECTED    0x00000008U
+#define HAL_SD_CARD_ERROR           0x000000FFU
+
+#define HAL_SD_ERROR_NONE           0x00000000U
+#define HAL_SD_ERROR_TX_UNDERRUN    0x00000010U
+#define HAL_SD_ERROR_RX_OVERRUN     0x00000020U
+#define SDMMC_ERROR_NONE            0x00000000U
+
+#define CARD_SDSC                   0x00000000U
+#define CARD_SDHC_SDXC              0x00000001U
+#define CARD_V1_X                   0x00000000U
+#define CARD_V2_X                   0x00000001U
+
+#define SDMMC_CLOCK_EDGE_RISING                 0x00000000U
+#define SDMMC_CLOCK_POWER_SAVE_DISABLE          0x00000000U
+#define SDMMC_BUS_WIDE_1B                       0x00000000U
+#define SDMMC_BUS_WIDE_4B                       0x00004000U
+#define SDMMC_HARDWARE_FLOW_CONTROL_DISABLE     0x00000000U
+
+typedef struct {
+    SDMMC_TypeDef* Instance;
+    SD_InitTypeDef Init;
+    volatile HAL_SD_StateTypeDef State;
+    volatile uint32_t ErrorCode;
+    HAL_SD_CardInfoTypeDef SdCard;
+    uint32_t CSD[4];
+    uint32_t CID[4];
+} SD_HandleTypeDef;
+
+//--------------------------------------------------------------------+
+// Функции
+//--------------------------------------------------------------------+
+
+extern "C" {
+
+void HAL_SD_MspInit(SD_HandleTypeDef* hsd);
+void HAL_SD_MspDeInit(SD_HandleTypeDef* hsd);
+
+inline uint32_t HAL_GetTick(void) { return usb::sim::SimTime::NowMs(); }
+inline void HAL_Delay(uint32_t ms) { usb::sim::SimTime::AdvanceUs(static_cast<uint64_t>(ms) * 1000); }
+inline void HAL_IncTick(void) {}
+
+inline HAL_StatusTypeDef HAL_PWREx_ConfigSupply(uint32_t) { return HAL_OK; }
+inline void HAL_PWREx_EnableUSBVoltageDetector(void) {}
+
+inline HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef* osc) {
+    if (osc->PLL.PLLState == RCC_PLL_ON) {
+        usb::sim::HalState::Get().pll_ready = true;
+    }
+    return HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef*, uint32_t) { return HAL_OK; }
+inline HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef*) { return HAL_OK; }
+
+inline void HAL_GPIO_Init(GPIO_TypeDef*, GPIO_InitTypeDef*) {
+    usb::sim::HalState::Get().gpio_init_calls++;
+}
+
+inline void HAL_GPIO_DeInit(GPIO_TypeDef*, uint32_t) {
+    usb::sim::HalState::Get().gpio_deinit_calls++;
+}
+
+inline void HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state) {
+    if (state == GPIO_PIN_SET) {
+        port->ODR |= pin;
+    } else {
+        port->ODR &= ~static_cast<uint32_t>(pin);
+    }
+}
+
+}  // extern "C"
+
+namespace usb::sim {
+
+/// Индекс SDMMC по указателю на "регистры"
+inline uint8_t SdmmcIndex(const SDMMC_TypeDef* instance) {
+    for (uint8_t i = 1; i < 3; ++i) {
+        if (instance == &HalState::Get().sdmmc[i]) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/// Карта в слоте SDMMC (nullptr если нет карты или SDMMC без тактирования)
+inline SdCardSim* CardFor(const SDMMC_TypeDef* instance) {
+    uint8_t index = SdmmcIndex(instance);
+    if (index == 0 || !HalState::Get().sdmmc_clk[index]) {
+        return nullptr;
+    }
+    return SdCardSim::InSlot(index);
+}
+
+/// Карта, доступная через hsd
+inline SdCardSim* CardFor(const SD_HandleTypeDef* hsd) {
+    return CardFor(hsd->Instance);
+}
+
+/// Перевод статуса модели в HAL + заполнение ErrorCode/STA
+inline HAL_StatusTypeDef ToHal(SD_HandleTypeDef* hsd, SdCardSim* card, SdSimStatus status) {
+    hsd->ErrorCode = card != nullptr ? card->GetLastError() : SdCardSim::kErrorCmdTimeout;
+    hsd->Instance->STA = hsd->ErrorCode;
+    switch (status) {
+        case SdSimStatus::Ok:
+            hsd->State = HAL_SD_STATE_READY;
+            return HAL_OK;
+        case SdSimStatus::Timeout:
+            hsd->State = HAL_SD_STATE_READY;
+            return HAL_TIMEOUT;
+        default:
+            hsd->State = HAL_SD_STATE_READY;
+            return HAL_ERROR;
+    }
+}
+
+}  // namespace usb::sim
+
+extern "C" {
+
+inline HAL_StatusTypeDef HAL_SD_Init(SD_HandleTypeDef* hsd) {
+    if (hsd->State == HAL_SD_STATE_RESET) {
+        HAL_SD_MspInit(hsd);
+    }
+    hsd->State = HAL_SD_STATE_BUSY;
+    usb::sim::SdCardSim* card = usb::sim::CardFor(hsd);
+    if (card == nullptr) {
+        usb::sim::SimTime::AdvanceUs(1000);
+        hsd->ErrorCode = usb::sim::SdCardSim::kErrorCmdTimeout;
+        hsd->State = HAL_SD_STATE_READY;
+        return HAL_ERROR;
+    }
+    usb::sim::SdSimStatus status = card->Init();
+    if (status != usb::sim::SdSimStatus::Ok) {
+        usb::sim::ToHal(hsd, card, status);
+        return HAL_ERROR;
+    }
+    for (int i = 0; i < 4; ++i) {
+        hsd->CSD[i] = card->Csd()[i];
+        hsd->CID[i] = card->Cid()[i];
+    }
+    hsd->SdCard.CardType = card->IsHighCapacity() ? CARD_SDHC_SDXC : CARD_SDSC;
+    hsd->SdCard.CardVersion = CARD_V2_X;
+    hsd->SdCard.Class = (card->Csd()[1] >> 20) & 0xFFFU;
+    hsd->SdCard.RelCardAdd = usb::sim::SdCardSim::kRca;
+    hsd->SdCard.BlockNbr = card->HalBlockNbr();
+    hsd->SdCard.BlockSize = card->HalBlockSize();
+    hsd->SdCard.LogBlockNbr = hsd->SdCard.BlockNbr * (hsd->SdCard.BlockSize / 512U);
+    hsd->SdCard.LogBlockSize = 512U;
+    hsd->SdCard.CardSpeed = 0;
+    hsd->Instance->CLKCR = hsd->Init.ClockDiv;
+    return usb::sim::ToHal(hsd, card, status);
+}
+
+inline HAL_StatusTypeDef HAL_SD_DeInit(SD_HandleTypeDef* hsd) {
+    if (usb::sim::SdCardSim* card = usb::sim::CardFor(hsd)) {
+        card->DeInit();
+    }
+    HAL_SD_MspDeInit(hsd);
+    hsd->State = HAL_SD_STATE_RESET;
+    return HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_SD_GetCardInfo(SD_HandleTypeDef* hsd, HAL_SD_CardInfoTypeDef* info) {
+    *info = hsd->SdCard;
+    return HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_SD_ConfigWideBusOperation(SD_HandleTypeDef* hsd, uint32_t wide) {
+    usb::sim::SdCardSim* card = usb::sim::CardFor(hsd);
+    if (card == nullptr) {
+        return HAL_ERROR;
+    }
+    uint8_t bits = (wide == SDMMC_BUS_WIDE_4B) ? 4 : 1;
+    return usb::sim::ToHal(hsd, card, card->SetBusWidth(bits));
+}
+
+inline HAL_StatusTypeDef SDMMC_Init(SDMMC_TypeDef* instance, SDMMC_InitTypeDef init) {
+    instance->CLKCR = init.ClockDiv | init.BusWide;
+    return HAL_OK;
+}
+
+// LL: CMD7 с RCA в старших 16 битах аргумента (0 — снять выбор)
+inline uint32_t SDMMC_CmdSelDesel(SDMMC_TypeDef* instance, uint32_t addr) {
+    usb::sim::SdCardSim* card = usb::sim::CardFor(instance);
+    if (card == nullptr) {
+        return usb::sim::SdCardSim::kErrorCmdTimeout;
+    }
+    card->Select(static_cast<uint16_t>(addr >> 16));
+    return card->GetLastError();
+}
+
+inline HAL_SD_CardStateTypeDef HAL_SD_GetCardState(SD_HandleTypeDef* hsd) {
+    usb::sim::SdCardSim* card = usb::sim::CardFor(hsd);
+    if (card == nullptr) {
+        return HAL_SD_CARD_ERROR;
+    }
+    return static_cast<HAL_SD_CardStateTypeDef>(card->GetCardState());
+}
+
+inline uint32_t HAL_SD_GetError(SD_HandleTypeDef* hsd) { return hsd->ErrorCode; }
+
+inline HAL_StatusTypeDef HAL_SD_ReadBlocks(SD_HandleTypeDef* hsd, uint8_t* data,
+                                           uint32_t block_add, uint32_t blocks, uint32_t) {
+    usb::sim::SdCardSim* card = usb::sim::CardFor(hsd);
+    if (card == nullptr || data == nullptr) {
+        return HAL_ERROR;
+    }
+    return usb::sim::ToHal(hsd, card, card->ReadBlocks(data, block_add, blocks, true));
+}
+
+inline HAL_StatusTypeDef HAL_SD_WriteBlocks(SD_HandleTypeDef* hsd, const uint8_t* data,
+                                            uint32_t block_add, uint32_t blocks, uint32_t) {
+    usb::sim::SdCardSim* card = usb::sim::CardFor(hsd);
+    if (card == nullptr || data == nullptr) {
+        return HAL_ERROR;
+    }
+    return usb::sim::ToHal(hsd, card, card->WriteBlocks(data, block_add, blocks, true));
+}
+
+// IDMA: передача выполняется сразу, State == READY к возврату (как после прерывания DATAEND)
+inline HAL_StatusTypeDef HAL_SD_ReadBlocks_DMA(SD_HandleTypeDef* hsd, uint8_t* data,
+                                               uint32_t block_add, uint32_t blocks) {
+    usb::sim::HalState::Get().sd_dma_transfers++;
+    usb::sim::SdCardSim* card = usb::sim::CardFor(hsd);
+    if (card == nullptr || data == nullptr) {
+        return HAL_ERROR;
+    }
+    return usb::sim::ToHal(hsd, card, card->ReadBlocks(data, block_add, blocks));
+}
+
+inline HAL_StatusTypeDef HAL_SD_WriteBlocks_DMA(SD_HandleTypeDef* hsd, const uint8_t* data,
+                                                uint32_t block_add, uint32_t blocks) {
+    usb::sim::HalState::Get().sd_dma_transfers++;
+    usb::sim::SdCardSim* card = usb::sim::CardFor(hsd);
+    if (card == nullptr || data == nullptr) {
+        return HAL_ERROR;
+    }
+    return usb::sim::ToHal(hsd, card, card->WriteBlocks(data, block_add, blocks));
+}
+
+inline void HAL_SD_IRQHandler(SD_HandleTypeDef*) {}
+
+inline HAL_StatusTypeDef HAL_SD_Abort(SD_HandleTypeDef* hsd) {
+    hsd->State = HAL_SD_STATE_READY;
+    return HAL_OK;
+}
+
+inline void HAL_NVIC_SetPriority(IRQn_Type, uint32_t, uint32_t) {}
+
+inline void HAL_NVIC_EnableIRQ(IRQn_Type irq) {
+    usb::sim::HalState::Get().sdmmc_irq_enabled[irq == SDMMC2_IRQn ? 2 : 1] = true;
+}
+
+inline void HAL_NVIC_DisableIRQ(IRQn_Type irq) {
+    usb::sim::HalState::Get().sdmmc_irq_enabled[irq == SDMMC2_IRQn ? 2 : 1] = false;
+}
+
+}  // extern "C"
@@ -0,0 +1,230 @@
+/**
+ * @file tusb.h
+ * @brief Host-заглушка TinyUSB для native сборки
+ *
+ * Объявляет подмножество API TinyUSB 0.16, которое использует библиотека.
+ * Реализация (состояние стека, CDC и vendor FIFO, конечный автомат MSC BOT) —
+ * libs/adapters/sim/src/TinyUsbSim.cpp, управление из тестов — sim/TinyUsbSim.hpp.
+ *
+ * Заголовок совместим с C и подключается внутри extern "C" (usb_descriptors.cpp).
+ */
+
+#ifndef _TUSB_H_
+#define _TUSB_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tusb_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TU_ATTR_WEAK    __attribute__((weak))
+#define TU_ATTR_PACKED  __attribute__((packed))
+
+//--------------------------------------------------------------------+
+// Device stack
+//--------------------------------------------------------------------+
+
+bool tusb_init(void);
+void tud_task(void);
+void tud_task_ext(uint32_t timeout_ms, bool in_isr);
+bool tud_task_event_ready(void);
+bool tud_connected(void);
+bool tud_mounted(void);
+bool tud_ready(void);
+bool tud_suspended(void);
+bool tud_connect(void);
+bool tud_disconnect(void);
+void tud_int_handler(uint8_t rhport);
+
+// Suspend / resume шины (из tud_task, как DCD_EVENT_SUSPEND / DCD_EVENT_RESUME)
+TU_ATTR_WEAK void tud_suspend_cb(bool remote_wakeup_en);
+TU_ATTR_WEAK void tud_resume_cb(void);
+
+// Дескрипторы (usb_descriptors.cpp); модель перечитывает конфигурацию при подключении
+TU_ATTR_WEAK uint8_t const* tud_descriptor_configuration_cb(uint8_t index);
+
+//--------------------------------------------------------------------+
+// Control transfer
+//--------------------------------------------------------------------+
+
+enum {
+    CONTROL_STAGE_IDLE  = 0,
+    CONTROL_STAGE_SETUP = 1,
+    CONTROL_STAGE_DATA  = 2,
+    CONTROL_STAGE_ACK   = 3,
+};
+
+enum {
+    TUSB_REQ_TYPE_STANDARD = 0,
+    TUSB_REQ_TYPE_CLASS    = 1,
+    TUSB_REQ_TYPE_VENDOR   = 2,
+    TUSB_REQ_TYPE_INVALID  = 3,
+};
+
+typedef struct TU_ATTR_PACKED {
+    union {
+        struct TU_ATTR_PACKED {
+            uint8_t recipient : 5;
+            uint8_t type : 2;
+            uint8_t direction : 1;
+        } bmRequestType_bit;
+        uint8_t bmRequestType;
+    };
+    uint8_t bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} tusb_control_request_t;
+
+bool tud_control_xfer(uint8_t rhport, tusb_control_request_t const* request, void* buffer,
+                      uint16_t len);
+
+//--------------------------------------------------------------------+
+// CDC
+//--------------------------------------------------------------------+
+
+typedef struct TU_ATTR_PACKED {
+    uint32_t bit_rate;
+    uint8_t stop_bits;
+    uint8_t parity;
+    uint8_t data_bits;
+} cdc_line_coding_t;
+
+bool tud_cdc_connected(void);
+uint32_t tud_cdc_available(void);
+uint32_t tud_cdc_read(void* buffer, uint32_t bufsize);
+void tud_cdc_read_flush(void);
+uint32_t tud_cdc_write(void const* buffer, uint32_t bufsize);
+uint32_t tud_cdc_write_flush(void);
+uint32_t tud_cdc_write_available(void);
+
+TU_ATTR_WEAK void tud_cdc_rx_cb(uint8_t itf);
+TU_ATTR_WEAK void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const* p_line_coding);
+
+//--------------------------------------------------------------------+
+// Vendor
+//--------------------------------------------------------------------+
+
+bool tud_vendor_mounted(void);
+uint32_t tud_vendor_available(void);
+uint32_t tud_vendor_read(void* buffer, uint32_t bufsize);
+uint32_t tud_vendor_write(void const* buffer, uint32_t bufsize);
+uint32_t tud_vendor_write_flush(void);
+uint32_t tud_vendor_write_available(void);
+
+TU_ATTR_WEAK void tud_vendor_rx_cb(uint8_t itf);
+TU_ATTR_WEAK void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes);
+TU_ATTR_WEAK bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage,
+                                             tusb_control_request_t const* request);
+
+//--------------------------------------------------------------------+
+// DFU (dfu_device.h, dfu_rt_device.h)
+//--------------------------------------------------------------------+
+
+typedef enum {
+    APP_IDLE                = 0,
+    APP_DETACH              = 1,
+    DFU_IDLE                = 2,
+    DFU_DNLOAD_SYNC         = 3,
+    DFU_DNBUSY              = 4,
+    DFU_DNLOAD_IDLE         = 5,
+    DFU_MANIFEST_SYNC       = 6,
+    DFU_MANIFEST            = 7,
+    DFU_MANIFEST_WAIT_RESET = 8,
+    DFU_UPLOAD_IDLE         = 9,
+    DFU_ERROR               = 10,
+} dfu_state_t;
+
+typedef enum {
+    DFU_STATUS_OK               = 0x00,
+    DFU_STATUS_ERR_TARGET       = 0x01,
+    DFU_STATUS_ERR_FILE         = 0x02,
+    DFU_STATUS_ERR_WRITE        = 0x03,
+    DFU_STATUS_ERR_ERASE        = 0x04,
+    DFU_STATUS_ERR_CHECK_ERASED = 0x05,
+    DFU_STATUS_ERR_PROG         = 0x06,
+    DFU_STATUS_ERR_VERIFY       = 0x07,
+    DFU_STATUS_ERR_ADDRESS      = 0x08,
+    DFU_STATUS_ERR_NOTDONE      = 0x09,
+    DFU_STATUS_ERR_FIRMWARE     = 0x0A,
+    DFU_STATUS_ERR_VENDOR       = 0x0B,
+    DFU_STATUS_ERR_USBR         = 0x0C,
+    DFU_STATUS_ERR_POR          = 0x0D,
+    DFU_STATUS_ERR_UNKNOWN      = 0x0E,
+    DFU_STATUS_ERR_STALLEDPKT   = 0x0F,
+} dfu_status_t;
+
+void tud_dfu_finish_flashing(uint8_t status);
+
+// В TinyUSB обязательные; в модели weak — она собирается и без USB_DFU_ENABLED
+TU_ATTR_WEAK uint32_t tud_dfu_get_timeout_cb(uint8_t alt, uint8_t state);
+TU_ATTR_WEAK void tud_dfu_download_cb(uint8_t alt, uint16_t block_num, uint8_t const* data,
+                                      uint16_t length);
+TU_ATTR_WEAK void tud_dfu_manifest_cb(uint8_t alt);
+TU_ATTR_WEAK uint16_t tud_dfu_upload_cb(uint8_t alt, uint16_t block_num, uint8_t* data,
+                                        uint16_t length);
+TU_ATTR_WEAK void tud_dfu_detach_cb(void);
+TU_ATTR_WEAK void tud_dfu_abort_cb(uint8_t alt);
+TU_ATTR_WEAK void tud_dfu_runtime_reboot_to_dfu_cb(void);
+
+//--------------------------------------------------------------------+
+// MSC
+//--------------------------------------------------------------------+
+
+enum {
+    SCSI_CMD_TEST_UNIT_READY              = 0x00,
+    SCSI_CMD_REQUEST_SENSE                = 0x03,
+    SCSI_CMD_INQUIRY                      = 0x12,
+    SCSI_CMD_MODE_SELECT_6                = 0x15,
+    SCSI_CMD_MODE_SENSE_6                 = 0x1A,
+    SCSI_CMD_START_STOP_UNIT              = 0x1B,
+    SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL = 0x1E,
+    SCSI_CMD_READ_FORMAT_CAPACITY         = 0x23,
+    SCSI_CMD_READ_CAPACITY_10             = 0x25,
+    SCSI_CMD_READ_10                      = 0x28,
+    SCSI_CMD_WRITE_10                     = 0x2A,
+};
+
+enum {
+    SCSI_SENSE_NONE            = 0x00,
+    SCSI_SENSE_RECOVERED_ERROR = 0x01,
+    SCSI_SENSE_NOT_READY       = 0x02,
+    SCSI_SENSE_MEDIUM_ERROR    = 0x03,
+    SCSI_SENSE_HARDWARE_ERROR  = 0x04,
+    SCSI_SENSE_ILLEGAL_REQUEST = 0x05,
+    SCSI_SENSE_UNIT_ATTENTION  = 0x06,
+    SCSI_SENSE_DATA_PROTECT    = 0x07,
+    SCSI_SENSE_ABORTED_COMMAND = 0x0b,
+};
+
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code,
+                       uint8_t add_sense_qualifier);
+
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer,
+                          uint32_t bufsize);
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer,
+                           uint32_t bufsize);
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16],
+                        uint8_t product_rev[4]);
+bool tud_msc_test_unit_ready_cb(uint8_t lun);
+void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size);
+int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer,
+                        uint16_t bufsize);
+
+TU_ATTR_WEAK bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start,
+                                        bool load_eject);
+TU_ATTR_WEAK bool tud_msc_is_writable_cb(uint8_t lun);
+TU_ATTR_WEAK void tud_msc_read10_complete_cb(uint8_t lun);
+TU_ATTR_WEAK void tud_msc_write10_complete_cb(uint8_t lun);
+TU_ATTR_WEAK void tud_msc_scsi_complete_cb(uint8_t lun, uint8_t const scsi_cmd[16]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _TUSB_H_
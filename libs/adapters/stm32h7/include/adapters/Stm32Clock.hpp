@@ -12,16 +12,38 @@ namespace usb::adapters {
 
 /**
  * @brief STM32 HAL реализация системных часов
+ * 
+ * GetTickUs() считает по DWT CYCCNT. Счётчик тактов переполняется
+ * за ~8.9 с на 480 МГц, поэтому GetTickUs() нужно вызывать чаще.
  */
 class Stm32Clock final : public ports::IClock {
 public:
+    Stm32Clock() {
+        // Cortex-M7: включить трассировку и снять блокировку DWT
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->LAR = 0xC5ACCE55;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        last_cyccnt_ = DWT->CYCCNT;
+    }
+    
     [[nodiscard]] uint32_t GetTickMs() const override {
         return HAL_GetTick();
     }
     
+    [[nodiscard]] uint32_t GetTickUs() const override {
+        uint32_t now = DWT->CYCCNT;
+        cycles_ += now - last_cyccnt_;
+        last_cyccnt_ = now;
+        return static_cast<uint32_t>(cycles_ / (SystemCoreClock / 1000000U));
+    }
+    
     void DelayMs(uint32_t ms) override {
         HAL_Delay(ms);
     }
+    
+private:
+    mutable uint64_t cycles_ = 0;
+    mutable uint32_t last_cyccnt_ = 0;
 };
 
 }  // namespace usb::adapters
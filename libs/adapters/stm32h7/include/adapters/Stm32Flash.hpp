@@ -0,0 +1,108 @@
+/**
+ * @file Stm32Flash.hpp
+ * @brief STM32H7 HAL реализация IFlash (внутренняя flash, оба банка)
+ */
+
+#pragma once
+
+#include "ports/IFlash.hpp"
+#include "stm32h7xx_hal.h"
+#include <cstring>
+
+namespace usb::adapters {
+
+/**
+ * @brief Внутренняя flash STM32H7
+ *
+ * Стирание запускается без ожидания (FLASH_Erase_Sector), завершение —
+ * по флагу QW банка в Poll(). Программирование flash word занимает
+ * единицы микросекунд, поэтому StartProgram() пишет слова подряд и
+ * возвращается после последнего; Poll() сразу вернёт результат.
+ *
+ * Секторы нумеруются подряд по обоим банкам (H743: 0..7 — банк 1, 8..15 — банк 2).
+ */
+class Stm32Flash final : public ports::IFlash {
+public:
+    [[nodiscard]] uint32_t GetBaseAddress() const override { return FLASH_BANK1_BASE; }
+    [[nodiscard]] uint32_t GetSize() const override { return FLASH_SIZE; }
+    [[nodiscard]] uint32_t GetSectorSize() const override { return FLASH_SECTOR_SIZE; }
+    [[nodiscard]] uint32_t GetProgramUnit() const override {
+        return FLASH_NB_32BITWORD_IN_FLASHWORD * 4;
+    }
+
+    bool StartErase(uint32_t sector) override {
+        if (op_ != Op::None || sector >= FLASH_SIZE / FLASH_SECTOR_SIZE) {
+            return false;
+        }
+        HAL_FLASH_Unlock();
+        bank_ = sector < FLASH_SECTOR_TOTAL ? FLASH_BANK_1 : FLASH_BANK_2;
+        FLASH_Erase_Sector(sector % FLASH_SECTOR_TOTAL, bank_, FLASH_VOLTAGE_RANGE_3);
+        op_ = Op::Erase;
+        return true;
+    }
+
+    bool StartProgram(uint32_t address, const uint8_t* data, uint32_t len) override {
+        const uint32_t unit = GetProgramUnit();
+        if (op_ != Op::None || len == 0 || address % unit != 0 || len % unit != 0) {
+            return false;
+        }
+        HAL_FLASH_Unlock();
+        bank_ = address < FLASH_BANK2_BASE ? FLASH_BANK_1 : FLASH_BANK_2;
+        ok_ = true;
+        for (uint32_t offset = 0; offset < len && ok_; offset += unit) {
+            ok_ = HAL_FLASH_Program(FLASH_TYPEPROGRAM_FLASHWORD, address + offset,
+                                    reinterpret_cast<uint32_t>(data + offset)) == HAL_OK;
+        }
+        op_ = Op::Program;
+        return true;
+    }
+
+    ports::FlashStatus Poll() override {
+        if (op_ == Op::None) {
+            return ports::FlashStatus::Idle;
+        }
+        if (op_ == Op::Erase) {
+            const bool busy = bank_ == FLASH_BANK_1
+                                  ? __HAL_FLASH_GET_FLAG_BANK1(FLASH_FLAG_QW_BANK1)
+                                  : __HAL_FLASH_GET_FLAG_BANK2(FLASH_FLAG_QW_BANK2);
+            if (busy) {
+                return ports::FlashStatus::Busy;
+            }
+            ok_ = FLASH_WaitForLastOperation(0, bank_) == HAL_OK;
+            // Как в HAL_FLASHEx_Erase: снять SER и номер сектора
+            if (bank_ == FLASH_BANK_1) {
+                FLASH->CR1 &= ~(FLASH_CR_SER | FLASH_CR_SNB);
+            } else {
+                FLASH->CR2 &= ~(FLASH_CR_SER | FLASH_CR_SNB);
+            }
+        }
+        return Finish();
+    }
+
+    ports::FlashStatus Wait() override {
+        if (op_ == Op::Erase) {
+            FLASH_WaitForLastOperation(HAL_MAX_DELAY, bank_);
+        }
+        return Poll();
+    }
+
+    bool Read(uint32_t address, uint8_t* buffer, uint32_t len) override {
+        std::memcpy(buffer, reinterpret_cast<const void*>(address), len);
+        return true;
+    }
+
+private:
+    enum class Op : uint8_t { None, Erase, Program };
+
+    ports::FlashStatus Finish() {
+        HAL_FLASH_Lock();
+        op_ = Op::None;
+        return ok_ ? ports::FlashStatus::Idle : ports::FlashStatus::Error;
+    }
+
+    Op op_ = Op::None;
+    uint32_t bank_ = FLASH_BANK_1;
+    bool ok_ = true;
+};
+
+}  // namespace usb::adapters
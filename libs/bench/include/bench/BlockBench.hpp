@@ -0,0 +1,244 @@
+/**
+ * @file BlockBench.hpp
+ * @brief Прогон нагрузок против любого стека IBlockDevice
+ * 
+ * Метрики: MB/s, IOPS, латентность p50/p99/max, число вызовов нижнего
+ * устройства на операцию. Результаты сериализуются в JSON.
+ */
+
+#pragma once
+
+#include "bench/Workloads.hpp"
+#include "ports/IBlockDevice.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace usb::bench {
+
+/**
+ * @brief Источник времени бенчмарка (микросекунды)
+ * 
+ * Для симуляторов — виртуальное время, для реального железа/хоста — chrono.
+ */
+struct TimeSource {
+    uint64_t (*now_us)(void* context) = nullptr;
+    void* context = nullptr;
+    
+    uint64_t Now() const { return now_us != nullptr ? now_us(context) : 0; }
+};
+
+/// Реальное время хоста (steady_clock)
+inline TimeSource ChronoTimeSource() {
+    TimeSource ts;
+    ts.now_us = [](void*) -> uint64_t {
+        using namespace std::chrono;
+        return static_cast<uint64_t>(
+            duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+    };
+    return ts;
+}
+
+/**
+ * @brief Счётчик тактов для микробенчмарков
+ * 
+ * x86 — TSC, AArch64 — виртуальный таймер, иначе наносекунды steady_clock.
+ * Сравнивать только значения одной машины.
+ */
+inline uint64_t CycleCount() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    using namespace std::chrono;
+    return static_cast<uint64_t>(
+        duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+/**
+ * @brief Декоратор, считающий вызовы нижнего устройства
+ * 
+ * Ставится в самый низ стека (над "железом"), чтобы посчитать,
+ * сколько команд реально доходит до носителя.
+ */
+class CountingBlockDevice : public ports::IBlockDevice {
+public:
+    explicit CountingBlockDevice(ports::IBlockDevice& inner) : inner_(inner) {}
+    
+    [[nodiscard]] bool IsReady() const override { return inner_.IsReady(); }
+    [[nodiscard]] uint32_t GetBlockCount() const override { return inner_.GetBlockCount(); }
+    [[nodiscard]] uint32_t GetBlockSize() const override { return inner_.GetBlockSize(); }
+    
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override {
+        reads_++;
+        blocks_read_ += count;
+        return inner_.Read(lba, buffer, count);
+    }
+    
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override {
+        writes_++;
+        blocks_written_ += count;
+        return inner_.Write(lba, buffer, count);
+    }
+    
+    bool Sync() override {
+        syncs_++;
+        return inner_.Sync();
+    }
+    
+    uint64_t GetCalls() const { return reads_ + writes_ + syncs_; }
+    uint64_t GetReads() const { return reads_; }
+    uint64_t GetWrites() const { return writes_; }
+    uint64_t GetBlocksRead() const { return blocks_read_; }
+    uint64_t GetBlocksWritten() const { return blocks_written_; }
+    
+    void Reset() { reads_ = writes_ = syncs_ = blocks_read_ = blocks_written_ = 0; }
+
+private:
+    ports::IBlockDevice& inner_;
+    uint64_t reads_ = 0;
+    uint64_t writes_ = 0;
+    uint64_t syncs_ = 0;
+    uint64_t blocks_read_ = 0;
+    uint64_t blocks_written_ = 0;
+};
+
+/// Результат прогона одной нагрузки
+struct BenchResult {
+    std::string backend;
+    std::string workload;
+    uint64_t ops = 0;
+    uint64_t errors = 0;
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    uint64_t elapsed_us = 0;
+    double mb_per_s = 0.0;
+    double iops = 0.0;
+    uint64_t lat_p50_us = 0;
+    uint64_t lat_p99_us = 0;
+    uint64_t lat_max_us = 0;
+    double calls_per_op = 0.0;  ///< Вызовов нижнего устройства на операцию (0 = не измерялось)
+};
+
+/// Перцентиль по отсортированной выборке
+inline uint64_t Percentile(const std::vector<uint64_t>& sorted, double pct) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t idx = static_cast<size_t>(pct / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+/**
+ * @brief Прогнать нагрузку
+ * @param device Верх тестируемого стека
+ * @param workload Нагрузка
+ * @param time Источник времени
+ * @param counter Счётчик вызовов внизу стека (опционально)
+ * @param backend Имя стека для отчёта
+ */
+inline BenchResult RunWorkload(ports::IBlockDevice& device, const Workload& workload,
+                               const TimeSource& time, CountingBlockDevice* counter = nullptr,
+                               const char* backend = "") {
+    BenchResult r;
+    r.backend = backend;
+    r.workload = workload.name;
+    
+    const uint32_t block_size = device.GetBlockSize();
+    uint32_t max_count = 1;
+    for (const auto& op : workload.ops) {
+        max_count = std::max(max_count, op.count);
+    }
+    std::vector<uint8_t> buffer(static_cast<size_t>(max_count) * block_size);
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        buffer[i] = static_cast<uint8_t>(i * 31 + 7);
+    }
+    
+    std::vector<uint64_t> latencies;
+    latencies.reserve(workload.ops.size());
+    uint64_t calls_before = counter != nullptr ? counter->GetCalls() : 0;
+    
+    const uint64_t start = time.Now();
+    for (const auto& op : workload.ops) {
+        const uint64_t t0 = time.Now();
+        bool ok = true;
+        switch (op.kind) {
+            case IoKind::Read:
+                ok = device.Read(op.lba, buffer.data(), op.count);
+                if (ok) r.bytes_read += static_cast<uint64_t>(op.count) * block_size;
+                break;
+            case IoKind::Write:
+                ok = device.Write(op.lba, buffer.data(), op.count);
+                if (ok) r.bytes_written += static_cast<uint64_t>(op.count) * block_size;
+                break;
+            case IoKind::Sync:
+                ok = device.Sync();
+                break;
+        }
+        latencies.push_back(time.Now() - t0);
+        if (!ok) {
+            r.errors++;
+        }
+        r.ops++;
+    }
+    r.elapsed_us = time.Now() - start;
+    
+    std::sort(latencies.begin(), latencies.end());
+    r.lat_p50_us = Percentile(latencies, 50.0);
+    r.lat_p99_us = Percentile(latencies, 99.0);
+    r.lat_max_us = latencies.empty() ? 0 : latencies.back();
+    if (r.elapsed_us > 0) {
+        double seconds = static_cast<double>(r.elapsed_us) / 1e6;
+        r.mb_per_s = static_cast<double>(r.bytes_read + r.bytes_written) / (1024.0 * 1024.0) / seconds;
+        r.iops = static_cast<double>(r.ops) / seconds;
+    }
+    if (counter != nullptr && r.ops > 0) {
+        r.calls_per_op = static_cast<double>(counter->GetCalls() - calls_before) /
+                         static_cast<double>(r.ops);
+    }
+    return r;
+}
+
+/// Сериализация результата в JSON объект
+inline std::string ToJson(const BenchResult& r) {
+    char buf[512];
+    std::snprintf(buf, sizeof(buf),
+                  "{\"backend\":\"%s\",\"workload\":\"%s\",\"ops\":%llu,\"errors\":%llu,"
+                  "\"bytes_read\":%llu,\"bytes_written\":%llu,\"elapsed_us\":%llu,"
+                  "\"mb_per_s\":%.3f,\"iops\":%.1f,\"lat_p50_us\":%llu,\"lat_p99_us\":%llu,"
+                  "\"lat_max_us\":%llu,\"calls_per_op\":%.3f}",
+                  r.backend.c_str(), r.workload.c_str(),
+                  static_cast<unsigned long long>(r.ops),
+                  static_cast<unsigned long long>(r.errors),
+                  static_cast<unsigned long long>(r.bytes_read),
+                  static_cast<unsigned long long>(r.bytes_written),
+                  static_cast<unsigned long long>(r.elapsed_us), r.mb_per_s, r.iops,
+                  static_cast<unsigned long long>(r.lat_p50_us),
+                  static_cast<unsigned long long>(r.lat_p99_us),
+                  static_cast<unsigned long long>(r.lat_max_us), r.calls_per_op);
+    return buf;
+}
+
+/// Сериализация набора результатов в JSON массив
+inline std::string ToJson(const std::vector<BenchResult>& results) {
+    std::string out = "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        out += "  " + ToJson(results[i]);
+        out += (i + 1 < results.size()) ? ",\n" : "\n";
+    }
+    out += "]\n";
+    return out;
+}
+
+}  // namespace usb::bench
@@ -0,0 +1,134 @@
+/**
+ * @file TraceReplay.hpp
+ * @brief Воспроизведение трассы SCSI команд (CSV из UsbDevice::MscTraceDump)
+ *
+ * Трасса с устройства превращается в обычную Workload и прогоняется
+ * через RunWorkload() против любого стека IBlockDevice — так кэши и
+ * конвейеры настраиваются на реальном доступе хоста, а не на синтетике.
+ *
+ * Формат строки: t_us,op,lba,blocks,status,latency_us (op — hex, "0x28").
+ */
+
+#pragma once
+
+#include "bench/Workloads.hpp"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace usb::bench {
+
+/// SCSI opcode, значимые для воспроизведения
+static constexpr uint8_t kScsiRead10 = 0x28;
+static constexpr uint8_t kScsiWrite10 = 0x2A;
+static constexpr uint8_t kScsiSyncCache10 = 0x35;
+
+/// Запись трассы на стороне host
+struct TraceRecord {
+    uint32_t timestamp_us = 0;
+    uint8_t opcode = 0;
+    uint32_t lba = 0;
+    uint32_t blocks = 0;
+    bool failed = false;
+    uint32_t latency_us = 0;
+};
+
+/// Сводка по трассе
+struct TraceSummary {
+    uint32_t records = 0;
+    uint32_t reads = 0;
+    uint32_t writes = 0;
+    uint32_t other = 0;          ///< TUR, INQUIRY, ...
+    uint32_t failed = 0;
+    uint64_t blocks_read = 0;
+    uint64_t blocks_written = 0;
+    uint64_t device_latency_us = 0;  ///< Сумма латентности READ10/WRITE10 на устройстве
+};
+
+/**
+ * @brief Разбор CSV трассы (заголовок и пустые строки пропускаются)
+ */
+inline std::vector<TraceRecord> ParseTraceCsv(const std::string& text) {
+    std::vector<TraceRecord> records;
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] < '0' || line[0] > '9') {
+            continue;
+        }
+        unsigned long t = 0, lba = 0, blocks = 0, status = 0, latency = 0;
+        unsigned int op = 0;
+        if (std::sscanf(line.c_str(), "%lu,%x,%lu,%lu,%lu,%lu", &t, &op, &lba, &blocks, &status,
+                        &latency) != 6) {
+            continue;
+        }
+        TraceRecord r;
+        r.timestamp_us = static_cast<uint32_t>(t);
+        r.opcode = static_cast<uint8_t>(op);
+        r.lba = static_cast<uint32_t>(lba);
+        r.blocks = static_cast<uint32_t>(blocks);
+        r.failed = status != 0;
+        r.latency_us = static_cast<uint32_t>(latency);
+        records.push_back(r);
+    }
+    return records;
+}
+
+/// Разбор CSV трассы из файла (пустой результат, если файла нет)
+inline std::vector<TraceRecord> LoadTraceCsv(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return {};
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    return ParseTraceCsv(text.str());
+}
+
+inline TraceSummary Summarize(const std::vector<TraceRecord>& records) {
+    TraceSummary s;
+    for (const auto& r : records) {
+        s.records++;
+        s.failed += r.failed ? 1 : 0;
+        if (r.opcode == kScsiRead10) {
+            s.reads++;
+            s.blocks_read += r.blocks;
+            s.device_latency_us += r.latency_us;
+        } else if (r.opcode == kScsiWrite10) {
+            s.writes++;
+            s.blocks_written += r.blocks;
+            s.device_latency_us += r.latency_us;
+        } else {
+            s.other++;
+        }
+    }
+    return s;
+}
+
+/**
+ * @brief Трасса → нагрузка для RunWorkload()
+ *
+ * READ10/WRITE10 → Read/Write, SYNCHRONIZE CACHE → Sync.
+ * Неуспешные команды и команды без данных пропускаются.
+ */
+inline Workload TraceToWorkload(const std::vector<TraceRecord>& records,
+                                const std::string& name = "trace") {
+    Workload w;
+    w.name = name;
+    for (const auto& r : records) {
+        if (r.failed) {
+            continue;
+        }
+        if (r.opcode == kScsiRead10 && r.blocks > 0) {
+            w.ops.push_back({IoKind::Read, r.lba, r.blocks});
+        } else if (r.opcode == kScsiWrite10 && r.blocks > 0) {
+            w.ops.push_back({IoKind::Write, r.lba, r.blocks});
+        } else if (r.opcode == kScsiSyncCache10) {
+            w.ops.push_back({IoKind::Sync, 0, 0});
+        }
+    }
+    return w;
+}
+
+}  // namespace usb::bench
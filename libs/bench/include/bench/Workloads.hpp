@@ -0,0 +1,223 @@
+/**
+ * @file Workloads.hpp
+ * @brief Генераторы нагрузок для бенчмарков IBlockDevice
+ * 
+ * Каждый генератор возвращает детерминированную последовательность операций,
+ * поэтому результаты разных стеков (кэш, конвейер, SD модель) сравнимы.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace usb::bench {
+
+/// Тип операции
+enum class IoKind : uint8_t {
+    Read,
+    Write,
+    Sync,
+};
+
+/// Одна операция нагрузки
+struct IoOp {
+    IoKind kind;
+    uint32_t lba;
+    uint32_t count;  ///< Блоков (0 для Sync)
+};
+
+/// Нагрузка: имя + последовательность операций
+struct Workload {
+    std::string name;
+    std::vector<IoOp> ops;
+};
+
+/// Детерминированный PRNG (xorshift32)
+class Rng {
+public:
+    explicit Rng(uint32_t seed) : state_(seed != 0 ? seed : 1) {}
+    
+    uint32_t Next() {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 17;
+        state_ ^= state_ << 5;
+        return state_;
+    }
+    
+    /// Случайное число в [0, bound)
+    uint32_t Below(uint32_t bound) { return bound > 0 ? Next() % bound : 0; }
+
+private:
+    uint32_t state_;
+};
+
+/// Общие параметры генераторов
+struct WorkloadParams {
+    uint32_t block_count = 0;         ///< Ёмкость устройства (блоков)
+    uint32_t block_size = 512;        ///< Размер блока
+    uint64_t total_bytes = 4u << 20;  ///< Объём данных нагрузки
+    uint32_t seed = 0xC0FFEE;
+};
+
+/**
+ * @brief Последовательный доступ блоками по 64 KB (или io_bytes)
+ */
+inline Workload MakeSequential(const WorkloadParams& p, IoKind kind, uint32_t io_bytes = 64 * 1024) {
+    Workload w;
+    w.name = (kind == IoKind::Read ? "seq_read_" : "seq_write_") + std::to_string(io_bytes / 1024) + "k";
+    uint32_t blocks = io_bytes / p.block_size;
+    uint64_t ops = p.total_bytes / io_bytes;
+    uint32_t lba = 0;
+    for (uint64_t i = 0; i < ops; ++i) {
+        if (lba + blocks > p.block_count) {
+            lba = 0;
+        }
+        w.ops.push_back({kind, lba, blocks});
+        lba += blocks;
+    }
+    return w;
+}
+
+/**
+ * @brief Случайный доступ блоками по 4 KB (выровнено на 4 KB)
+ */
+inline Workload MakeRandom(const WorkloadParams& p, IoKind kind, uint32_t io_bytes = 4096) {
+    Workload w;
+    w.name = (kind == IoKind::Read ? "rand_read_" : "rand_write_") + std::to_string(io_bytes / 1024) + "k";
+    Rng rng(p.seed);
+    uint32_t blocks = io_bytes / p.block_size;
+    uint32_t slots = p.block_count / blocks;
+    uint64_t ops = p.total_bytes / io_bytes;
+    for (uint64_t i = 0; i < ops; ++i) {
+        w.ops.push_back({kind, rng.Below(slots) * blocks, blocks});
+    }
+    return w;
+}
+
+/**
+ * @brief Копирование файла на FAT32 (поведение Windows Explorer)
+ * 
+ * Данные пишутся кусками по 64 KB в кластеры подряд, каждые 1 MB
+ * обновляются сектор FAT1, его копия в FAT2 и запись каталога,
+ * в конце — FSInfo и Sync.
+ */
+inline Workload MakeFat32Copy(const WorkloadParams& p) {
+    Workload w;
+    w.name = "fat32_copy";
+    const uint32_t part_start = 2048;
+    const uint32_t reserved = 32;
+    const uint32_t fat_size = 1024;  // секторов на одну FAT
+    const uint32_t fat1 = part_start + reserved;
+    const uint32_t fat2 = fat1 + fat_size;
+    const uint32_t data_start = fat2 + fat_size;
+    const uint32_t root_dir = data_start;
+    const uint32_t chunk = 64 * 1024 / p.block_size;
+    const uint32_t flush_every = (1u << 20) / p.block_size;
+
+    uint32_t lba = data_start + 64;  // после корневого каталога
+    uint32_t since_flush = 0;
+    uint64_t chunks = p.total_bytes / (64 * 1024);
+    for (uint64_t i = 0; i < chunks; ++i) {
+        if (lba + chunk > p.block_count) {
+            lba = data_start + 64;
+        }
+        w.ops.push_back({IoKind::Write, lba, chunk});
+        lba += chunk;
+        since_flush += chunk;
+        if (since_flush >= flush_every || i + 1 == chunks) {
+            // 128 записей FAT на сектор, кластер 32 KB = 64 сектора
+            uint32_t fat_sector = ((lba - data_start) / 64 / 128) % fat_size;
+            w.ops.push_back({IoKind::Write, fat1 + fat_sector, 1});
+            w.ops.push_back({IoKind::Write, fat2 + fat_sector, 1});
+            w.ops.push_back({IoKind::Write, root_dir, 1});
+            since_flush = 0;
+        }
+    }
+    w.ops.push_back({IoKind::Write, part_start + 1, 1});  // FSInfo
+    w.ops.push_back({IoKind::Sync, 0, 0});
+    return w;
+}
+
+/**
+ * @brief Всплеск метаданных при монтировании в Windows
+ * 
+ * MBR, boot sector, FSInfo, backup boot, начало FAT, корневой каталог,
+ * повторные чтения LBA 0 и хвоста диска (проверка ёмкости).
+ */
+inline Workload MakeWindowsMount(const WorkloadParams& p) {
+    Workload w;
+    w.name = "mount_windows";
+    const uint32_t part = 2048;
+    const uint32_t last = p.block_count - 1;
+    const uint32_t fat1 = part + 32;
+    const uint32_t data = fat1 + 2 * 1024;
+    for (int pass = 0; pass < 3; ++pass) {
+        w.ops.push_back({IoKind::Read, 0, 1});
+        w.ops.push_back({IoKind::Read, part, 1});
+        w.ops.push_back({IoKind::Read, part + 1, 1});
+        w.ops.push_back({IoKind::Read, part + 6, 1});
+    }
+    w.ops.push_back({IoKind::Read, last, 1});
+    w.ops.push_back({IoKind::Read, last - 7, 8});
+    for (uint32_t i = 0; i < 16; ++i) {
+        w.ops.push_back({IoKind::Read, fat1 + i, 1});
+    }
+    for (uint32_t i = 0; i < 8; ++i) {
+        w.ops.push_back({IoKind::Read, data + i * 8, 8});
+    }
+    // System Volume Information: чтение + запись каталога
+    w.ops.push_back({IoKind::Read, data + 64, 1});
+    w.ops.push_back({IoKind::Write, data + 64, 1});
+    w.ops.push_back({IoKind::Write, fat1, 1});
+    w.ops.push_back({IoKind::Write, fat1 + 1024, 1});
+    return w;
+}
+
+/**
+ * @brief Всплеск метаданных при монтировании в macOS
+ * 
+ * Проба GPT (LBA 1..33 и резервная копия в конце диска), чтения по 4 KB
+ * вразброс (Spotlight, fseventsd), затем мелкие записи в каталоги и FAT.
+ */
+inline Workload MakeMacosMount(const WorkloadParams& p) {
+    Workload w;
+    w.name = "mount_macos";
+    Rng rng(p.seed ^ 0x5A5A);
+    const uint32_t part = 2048;
+    const uint32_t last = p.block_count - 1;
+    const uint32_t fat1 = part + 32;
+    const uint32_t data = fat1 + 2 * 1024;
+    w.ops.push_back({IoKind::Read, 0, 1});
+    w.ops.push_back({IoKind::Read, 1, 1});
+    w.ops.push_back({IoKind::Read, 2, 32});
+    w.ops.push_back({IoKind::Read, last, 1});
+    w.ops.push_back({IoKind::Read, last - 32, 32});
+    w.ops.push_back({IoKind::Read, part, 8});
+    for (uint32_t i = 0; i < 64; ++i) {
+        uint32_t span = p.block_count > data + 8 ? p.block_count - data - 8 : 1;
+        w.ops.push_back({IoKind::Read, data + (rng.Below(span) & ~7u), 8});
+    }
+    for (uint32_t i = 0; i < 16; ++i) {
+        w.ops.push_back({IoKind::Write, data + i * 64, 1});
+        w.ops.push_back({IoKind::Write, fat1 + rng.Below(1024), 1});
+    }
+    w.ops.push_back({IoKind::Sync, 0, 0});
+    return w;
+}
+
+/// Стандартный набор нагрузок
+inline std::vector<Workload> StandardWorkloads(const WorkloadParams& p) {
+    std::vector<Workload> all;
+    all.push_back(MakeSequential(p, IoKind::Read));
+    all.push_back(MakeSequential(p, IoKind::Write));
+    all.push_back(MakeRandom(p, IoKind::Read));
+    all.push_back(MakeRandom(p, IoKind::Write));
+    all.push_back(MakeFat32Copy(p));
+    all.push_back(MakeWindowsMount(p));
+    all.push_back(MakeMacosMount(p));
+    return all;
+}
+
+}  // namespace usb::bench
@@ -56,6 +56,9 @@ struct IBlockDevice {
      */
     virtual bool Sync() { return true; }
     
+    /// Носитель только для чтения: хост монтирует его без записи (MSC: бит WP)
+    [[nodiscard]] virtual bool IsWriteProtected() const { return false; }
+    
     // Запрет копирования
     IBlockDevice(const IBlockDevice&) = delete;
     IBlockDevice& operator=(const IBlockDevice&) = delete;
@@ -17,6 +17,7 @@ namespace usb::ports {
  * 
  * Контракт:
  * - GetTickMs() монотонно возрастает (с переполнением через ~49 дней)
+ * - GetTickUs() монотонно возрастает (с переполнением через ~71 минуту)
  * - DelayMs() блокирует вызывающий поток
  */
 struct IClock {
@@ -25,6 +26,10 @@ struct IClock {
     /// Получить текущее время в миллисекундах
     [[nodiscard]] virtual uint32_t GetTickMs() const = 0;
     
+    /// Получить текущее время в микросекундах (для профилирования)
+    /// По умолчанию — GetTickMs() * 1000, платформы переопределяют точным таймером
+    [[nodiscard]] virtual uint32_t GetTickUs() const { return GetTickMs() * 1000U; }
+    
     /// Блокирующая задержка в миллисекундах
     virtual void DelayMs(uint32_t ms) = 0;
     
@@ -0,0 +1,77 @@
+/**
+ * @file IFlash.hpp
+ * @brief Интерфейс внутренней flash памяти (стирание секторов, программирование)
+ *
+ * Операции неблокирующие: StartErase()/StartProgram() запускают операцию,
+ * Poll() сообщает о завершении. Пока flash занята, вызывающий код может
+ * принимать следующие данные — на этом строится конвейер записи прошивки.
+ * Не содержит HAL зависимостей — реализации в libs/adapters.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace usb::ports {
+
+/// Состояние flash после Poll()/Wait()
+enum class FlashStatus : uint8_t {
+    Idle,   ///< Операций нет (последняя завершилась успешно)
+    Busy,   ///< Операция выполняется
+    Error,  ///< Последняя операция завершилась ошибкой (сообщается один раз)
+};
+
+/**
+ * @brief Интерфейс flash памяти с секторами одного размера
+ *
+ * Контракт:
+ * - Одна операция одновременно; Start*() при занятой flash возвращает false
+ * - Программировать можно только стёртые ячейки, адрес и длина кратны GetProgramUnit()
+ * - Данные StartProgram() должны жить до завершения операции
+ */
+struct IFlash {
+    virtual ~IFlash() = default;
+
+    /// Адрес первого сектора
+    [[nodiscard]] virtual uint32_t GetBaseAddress() const = 0;
+
+    /// Размер, байт
+    [[nodiscard]] virtual uint32_t GetSize() const = 0;
+
+    /// Размер сектора (единица стирания), байт
+    [[nodiscard]] virtual uint32_t GetSectorSize() const = 0;
+
+    /// Единица программирования (STM32H7 — flash word 32 байта)
+    [[nodiscard]] virtual uint32_t GetProgramUnit() const = 0;
+
+    /**
+     * @brief Начать стирание сектора
+     * @param sector Номер сектора от GetBaseAddress()
+     * @return false — flash занята или неверный номер
+     */
+    virtual bool StartErase(uint32_t sector) = 0;
+
+    /**
+     * @brief Начать программирование
+     * @return false — flash занята, адрес/длина не выровнены или вне flash
+     */
+    virtual bool StartProgram(uint32_t address, const uint8_t* data, uint32_t len) = 0;
+
+    /// Проверить операцию без ожидания
+    virtual FlashStatus Poll() = 0;
+
+    /// Дождаться завершения операции (Idle или Error)
+    virtual FlashStatus Wait() = 0;
+
+    /// Чтение (для memory-mapped flash — memcpy)
+    virtual bool Read(uint32_t address, uint8_t* buffer, uint32_t len) = 0;
+
+    // Запрет копирования
+    IFlash(const IFlash&) = delete;
+    IFlash& operator=(const IFlash&) = delete;
+
+protected:
+    IFlash() = default;
+};
+
+}  // namespace usb::ports
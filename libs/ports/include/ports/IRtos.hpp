@@ -0,0 +1,89 @@
+/**
+ * @file IRtos.hpp
+ * @brief Интерфейс RTOS (задачи, мьютексы, сигналы)
+ *
+ * Минимальный набор примитивов для режима USB_RTOS_ENABLED:
+ * задача USB стека, задача хранилища и синхронизация между ними.
+ * Не содержит зависимостей от конкретной RTOS — реализации
+ * в libs/adapters (FreeRTOS, POSIX threads для native тестов).
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace usb::ports {
+
+/// Бесконечное ожидание
+static constexpr uint32_t kWaitForever = UINT32_MAX;
+
+/// Точка входа задачи (возврат из функции — завершение задачи)
+using TaskFn = void (*)(void* context);
+
+/// Параметры задачи
+struct TaskParams {
+    const char* name = "usb";
+    uint32_t stack_bytes = 2048;
+    uint8_t priority = 1;  ///< Относительный приоритет: больше — важнее
+};
+
+/**
+ * @brief Мьютекс (не рекурсивный)
+ */
+struct IMutex {
+    virtual ~IMutex() = default;
+
+    virtual void Lock() = 0;
+    virtual void Unlock() = 0;
+};
+
+/**
+ * @brief Двоичный сигнал (семафор 0/1)
+ *
+ * Контракт:
+ * - Give() повторно до Take() не накапливается
+ * - GiveFromIsr() можно вызывать из прерывания
+ */
+struct ISignal {
+    virtual ~ISignal() = default;
+
+    virtual void Give() = 0;
+    virtual void GiveFromIsr() = 0;
+
+    /// Ждать сигнал
+    /// @return false по таймауту
+    virtual bool Take(uint32_t timeout_ms) = 0;
+};
+
+/**
+ * @brief Фабрика примитивов и задач RTOS
+ *
+ * Объекты живут столько же, сколько реализация IRtos
+ * (статические пулы на MCU, без освобождения).
+ */
+struct IRtos {
+    virtual ~IRtos() = default;
+
+    /// Создать мьютекс
+    /// @return nullptr если пул исчерпан
+    virtual IMutex* CreateMutex() = 0;
+
+    /// Создать сигнал
+    /// @return nullptr если пул исчерпан
+    virtual ISignal* CreateSignal() = 0;
+
+    /// Создать и запустить задачу
+    virtual bool CreateTask(const TaskParams& params, TaskFn fn, void* context) = 0;
+
+    /// Задержка текущей задачи
+    virtual void DelayMs(uint32_t ms) = 0;
+
+    // Запрет копирования
+    IRtos(const IRtos&) = delete;
+    IRtos& operator=(const IRtos&) = delete;
+
+protected:
+    IRtos() = default;
+};
+
+}  // namespace usb::ports
@@ -0,0 +1,307 @@
+/**
+ * @file usb_arbiter.cpp
+ * @brief Очередь читателей/писателей над блочным устройством и учёт блоков хоста
+ */
+
+#include "usb_arbiter.h"
+
+#ifdef USB_ARBITER_ENABLED
+
+namespace usb {
+
+static constexpr uint32_t kRegions = USB_ARBITER_REGIONS;
+
+/// a раньше b (номера билетов по модулю 2^32)
+static bool TicketBefore(uint32_t a, uint32_t b) {
+    return static_cast<int32_t>(a - b) < 0;
+}
+
+//--------------------------------------------------------------------+
+// ArbitratedBlockDevice
+//--------------------------------------------------------------------+
+
+bool ArbitratedBlockDevice::IsReady() const {
+    return arbiter_.device_.IsReady();
+}
+
+uint32_t ArbitratedBlockDevice::GetBlockCount() const {
+    return arbiter_.device_.GetBlockCount();
+}
+
+uint32_t ArbitratedBlockDevice::GetBlockSize() const {
+    return arbiter_.device_.GetBlockSize();
+}
+
+bool ArbitratedBlockDevice::Read(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    return arbiter_.Transfer(client_, BlockArbiter::Op::Read, lba, buffer, count);
+}
+
+bool ArbitratedBlockDevice::Write(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    return arbiter_.Transfer(client_, BlockArbiter::Op::Write, lba, const_cast<uint8_t*>(buffer),
+                             count);
+}
+
+bool ArbitratedBlockDevice::Sync() {
+    return arbiter_.Transfer(client_, BlockArbiter::Op::Sync, 0, nullptr, 0);
+}
+
+//--------------------------------------------------------------------+
+// BlockArbiter
+//--------------------------------------------------------------------+
+
+BlockArbiter::BlockArbiter(ports::IBlockDevice& device, const ArbiterConfig& config)
+    : device_(device),
+      config_(config),
+      host_(*this, ArbiterClient::Host),
+      firmware_(*this, ArbiterClient::Firmware) {}
+
+bool BlockArbiter::SetRtos(ports::IRtos& rtos, const ports::IClock& clock) {
+    ports::IMutex* mutex = rtos.CreateMutex();
+    if (mutex == nullptr) {
+        return false;
+    }
+    for (Waiter& waiter : waiters_) {
+        waiter.signal = rtos.CreateSignal();
+        if (waiter.signal == nullptr) {
+            return false;
+        }
+    }
+    clock_ = &clock;
+    mutex_ = mutex;
+    return true;
+}
+
+bool BlockArbiter::Transfer(ArbiterClient client, Op op, uint32_t lba, uint8_t* buffer,
+                            uint32_t count) {
+    // Чтения вместе, только если устройство это допускает
+    const bool exclusive = op != Op::Read || !config_.concurrent_reads;
+    const uint32_t timeout_ms =
+        client == ArbiterClient::Host ? config_.host_timeout_ms : config_.firmware_timeout_ms;
+    if (!Acquire(exclusive, timeout_ms)) {
+        return false;
+    }
+
+    bool ok;
+    if (op == Op::Read) {
+        ok = device_.Read(lba, buffer, count);
+    } else if (op == Op::Write) {
+        ok = device_.Write(lba, buffer, count);
+    } else {
+        ok = device_.Sync();
+    }
+
+    if (Leave(exclusive, client, op, lba, count, ok) && change_callback_ != nullptr) {
+        change_callback_(change_context_);
+    }
+    return ok;
+}
+
+//--------------------------------------------------------------------+
+// Очередь
+//--------------------------------------------------------------------+
+
+bool BlockArbiter::CanEnter(bool exclusive, uint32_t ticket, bool queued) const {
+    if (writer_ || (exclusive && readers_ != 0)) {
+        return false;
+    }
+    // Раньше в очереди: писатель не пропускает никого, читатель — только писателя
+    for (const Waiter& waiter : waiters_) {
+        if (waiter.waiting && (!queued || TicketBefore(waiter.ticket, ticket)) &&
+            (exclusive || waiter.exclusive)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BlockArbiter::Enter(bool exclusive) {
+    if (exclusive) {
+        writer_ = true;
+    } else {
+        readers_++;
+    }
+}
+
+bool BlockArbiter::Acquire(bool exclusive, uint32_t timeout_ms) {
+    if (mutex_ == nullptr) {
+        return true;  // Без RTOS: один контекст
+    }
+
+    Lock();
+    if (CanEnter(exclusive, 0, false)) {
+        Enter(exclusive);
+        Unlock();
+        return true;
+    }
+
+    Waiter* self = nullptr;
+    for (Waiter& waiter : waiters_) {
+        if (!waiter.waiting) {
+            self = &waiter;
+            break;
+        }
+    }
+    stats_.contended++;
+    if (self == nullptr) {
+        stats_.timeouts++;
+        Unlock();
+        return false;
+    }
+    self->waiting = true;
+    self->exclusive = exclusive;
+    self->ticket = next_ticket_++;
+    self->signal->Take(0);  // Сброс пробуждения от прошлого ожидания
+
+    const uint32_t start = clock_->GetTickMs();
+    for (;;) {
+        const uint32_t waited = clock_->GetTickMs() - start;
+        if (CanEnter(exclusive, self->ticket, true)) {
+            self->waiting = false;
+            Enter(exclusive);
+            if (waited > stats_.max_wait_ms) {
+                stats_.max_wait_ms = waited;
+            }
+            if (!exclusive) {
+                WakeWaiters();  // Читатели за ним в очереди входят вместе
+            }
+            Unlock();
+            return true;
+        }
+        if (waited >= timeout_ms) {
+            self->waiting = false;
+            stats_.timeouts++;
+            WakeWaiters();  // Следующий в очереди мог ждать только его
+            Unlock();
+            return false;
+        }
+        Unlock();
+        self->signal->Take(timeout_ms - waited);
+        Lock();
+    }
+}
+
+bool BlockArbiter::Leave(bool exclusive, ArbiterClient client, Op op, uint32_t lba,
+                         uint32_t count, bool ok) {
+    Lock();
+    if (mutex_ != nullptr) {
+        if (exclusive) {
+            writer_ = false;
+        } else {
+            readers_--;
+        }
+        WakeWaiters();
+    }
+
+    bool changed = false;
+    if (client == ArbiterClient::Host) {
+        stats_.host_ops++;
+        if (ok && op != Op::Sync) {
+            host_any_ = MarkHost(lba, count);
+        }
+    } else {
+        stats_.firmware_ops++;
+        if (ok && op == Op::Write) {
+            if (HostSaw(lba, count)) {
+                // Хост перечитает носитель после UNIT ATTENTION
+                for (uint32_t& word : host_regions_) {
+                    word = 0;
+                }
+                host_any_ = false;
+                stats_.media_changes++;
+                changed = true;
+            } else {
+                stats_.firmware_writes_unseen++;
+            }
+        }
+    }
+    Unlock();
+    return changed;
+}
+
+void BlockArbiter::WakeWaiters() {
+    for (Waiter& waiter : waiters_) {
+        if (waiter.waiting) {
+            waiter.signal->Give();
+        }
+    }
+}
+
+//--------------------------------------------------------------------+
+// Блоки хоста
+//--------------------------------------------------------------------+
+
+bool BlockArbiter::MarkHost(uint32_t lba, uint32_t count) {
+    if (!host_any_) {
+        // Карта пуста — масштаб по текущей ёмкости (карта могла смениться)
+        const uint32_t blocks = device_.GetBlockCount();
+        region_shift_ = 0;
+        while (region_shift_ < 31 && (blocks >> region_shift_) > kRegions) {
+            region_shift_++;
+        }
+    }
+    if (count == 0) {
+        return host_any_;
+    }
+    uint32_t first = lba >> region_shift_;
+    uint32_t last = (lba + (count - 1)) >> region_shift_;
+    first = first < kRegions ? first : kRegions - 1;
+    last = last < kRegions ? last : kRegions - 1;
+    for (uint32_t region = first; region <= last; region++) {
+        host_regions_[region / 32] |= 1u << (region % 32);
+    }
+    return true;
+}
+
+bool BlockArbiter::HostSaw(uint32_t lba, uint32_t count) const {
+    if (!host_any_ || count == 0) {
+        return false;
+    }
+    uint32_t first = lba >> region_shift_;
+    uint32_t last = (lba + (count - 1)) >> region_shift_;
+    first = first < kRegions ? first : kRegions - 1;
+    last = last < kRegions ? last : kRegions - 1;
+    for (uint32_t region = first; region <= last; region++) {
+        if ((host_regions_[region / 32] >> (region % 32)) & 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BlockArbiter::ForgetHostBlocks() {
+    Lock();
+    for (uint32_t& word : host_regions_) {
+        word = 0;
+    }
+    host_any_ = false;
+    Unlock();
+}
+
+ArbiterStats BlockArbiter::GetStats() const {
+    Lock();
+    ArbiterStats stats = stats_;
+    Unlock();
+    return stats;
+}
+
+void BlockArbiter::ResetStats() {
+    Lock();
+    stats_ = ArbiterStats{};
+    Unlock();
+}
+
+void BlockArbiter::Lock() const {
+    if (mutex_ != nullptr) {
+        mutex_->Lock();
+    }
+}
+
+void BlockArbiter::Unlock() const {
+    if (mutex_ != nullptr) {
+        mutex_->Unlock();
+    }
+}
+
+}  // namespace usb
+
+#endif  // USB_ARBITER_ENABLED
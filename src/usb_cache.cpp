@@ -0,0 +1,122 @@
+/**
+ * @file usb_cache.cpp
+ * @brief Обслуживание D-cache по диапазону и регион MPU без кэша
+ */
+
+#include "usb_cache.h"
+
+#if defined(STM32H7) || defined(STM32H743xx) || defined(STM32H750xx)
+#include "stm32h7xx_hal.h"
+#define USB_CACHE_HAS_DCACHE 1
+#elif defined(STM32F7)
+#include "stm32f7xx_hal.h"
+#define USB_CACHE_HAS_DCACHE 1
+#endif
+
+namespace usb {
+namespace cache {
+
+static CacheStats g_stats;
+
+/// Начало первой строки и длина до конца последней
+static void LineRange(const void* addr, uint32_t size, uintptr_t* start, uint32_t* length) {
+    uintptr_t begin = reinterpret_cast<uintptr_t>(addr) & ~static_cast<uintptr_t>(kLineSize - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(addr) + size;
+    *start = begin;
+    *length = LineAlignUp(static_cast<uint32_t>(end - begin));
+}
+
+bool IsEnabled() {
+#ifdef USB_CACHE_HAS_DCACHE
+    return (SCB->CCR & SCB_CCR_DC_Msk) != 0;
+#else
+    return false;
+#endif
+}
+
+void Clean(const void* addr, uint32_t size) {
+    if (size == 0) {
+        return;
+    }
+    uintptr_t start;
+    uint32_t length;
+    LineRange(addr, size, &start, &length);
+    g_stats.clean++;
+    g_stats.bytes += length;
+#ifdef USB_CACHE_HAS_DCACHE
+    if (IsEnabled()) {
+        SCB_CleanDCache_by_Addr(reinterpret_cast<uint32_t*>(start), static_cast<int32_t>(length));
+    }
+#endif
+}
+
+void Invalidate(void* addr, uint32_t size) {
+    if (size == 0) {
+        return;
+    }
+    uintptr_t start;
+    uint32_t length;
+    LineRange(addr, size, &start, &length);
+    g_stats.invalidate++;
+    g_stats.bytes += length;
+#ifdef USB_CACHE_HAS_DCACHE
+    if (IsEnabled()) {
+        SCB_InvalidateDCache_by_Addr(reinterpret_cast<uint32_t*>(start),
+                                     static_cast<int32_t>(length));
+    }
+#endif
+}
+
+void CleanInvalidate(void* addr, uint32_t size) {
+    if (size == 0) {
+        return;
+    }
+    uintptr_t start;
+    uint32_t length;
+    LineRange(addr, size, &start, &length);
+    g_stats.clean_invalidate++;
+    g_stats.bytes += length;
+#ifdef USB_CACHE_HAS_DCACHE
+    if (IsEnabled()) {
+        SCB_CleanInvalidateDCache_by_Addr(reinterpret_cast<uint32_t*>(start),
+                                          static_cast<int32_t>(length));
+    }
+#endif
+}
+
+CacheStats GetCacheStats() {
+    return g_stats;
+}
+
+void ResetCacheStats() {
+    g_stats = {};
+}
+
+bool ConfigureNonCacheable(uint8_t region, uintptr_t base, uint32_t size) {
+    uint8_t size_field = MpuRegionSizeField(size);
+    if (size_field == 0 || region > 15 || (base & (size - 1)) != 0) {
+        return false;
+    }
+#ifdef USB_CACHE_HAS_DCACHE
+    MPU_Region_InitTypeDef mpu = {};
+    mpu.Enable = MPU_REGION_ENABLE;
+    mpu.Number = region;
+    mpu.BaseAddress = static_cast<uint32_t>(base);
+    mpu.Size = size_field;
+    mpu.SubRegionDisable = 0x00;
+    mpu.TypeExtField = MPU_TEX_LEVEL1;
+    mpu.AccessPermission = MPU_REGION_FULL_ACCESS;
+    mpu.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+    mpu.IsShareable = MPU_ACCESS_NOT_SHAREABLE;
+    mpu.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+    mpu.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+
+    HAL_MPU_Disable();
+    HAL_MPU_ConfigRegion(&mpu);
+    HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+#endif
+    return true;
+}
+
+}  // namespace cache
+}  // namespace usb
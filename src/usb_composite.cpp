@@ -4,6 +4,8 @@
  */
 
 #include "usb_composite.h"
+#include "usb_memory.h"
+#include "ports/IRtos.hpp"
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
@@ -16,16 +18,21 @@ extern "C" {
 // HAL для GPIO (toggle D+)
 #if defined(STM32H7) || defined(STM32H743xx) || defined(STM32H750xx)
 #include "stm32h7xx_hal.h"
+#define USB_COMPOSITE_HAS_HAL 1
 #elif defined(STM32F4)
 #include "stm32f4xx_hal.h"
+#define USB_COMPOSITE_HAS_HAL 1
 #elif defined(STM32F7)
 #include "stm32f7xx_hal.h"
+#define USB_COMPOSITE_HAS_HAL 1
 #else
-// Заглушка для других платформ
+// Заглушка для других платформ (native сборка тестов)
 #define HAL_GPIO_WritePin(port, pin, state)
 #define HAL_Delay(ms)
 #define GPIO_PIN_SET   1
 #define GPIO_PIN_RESET 0
+#include <chrono>
+#include <thread>
 #endif
 
 // Forward declarations для платформозависимых функций
@@ -33,43 +40,837 @@ extern "C" void InitUsbGpio();
 extern "C" void InitUsbClock();
 extern "C" void InitUsbOtg();
 extern "C" void InitUsbNvic();
+extern "C" bool UsbReadChipUid(uint32_t uid[3]);
+
+/// rhport текущего UsbDevice::Init() — его ядро настраивают weak Init* функции
+static uint8_t g_init_rhport = 0;
+
+#if defined(STM32H7) || defined(STM32H743xx) || defined(STM32H750xx)
+/// Базовый адрес ядра USB OTG (нумерация rhport как в TinyUSB dwc2: 0 = OTG_FS, 1 = OTG_HS)
+static uint32_t UsbOtgBase(uint8_t rhport) {
+#ifdef USB2_OTG_FS_PERIPH_BASE
+    return rhport == 1 ? USB1_OTG_HS_PERIPH_BASE : USB2_OTG_FS_PERIPH_BASE;
+#else
+    return rhport == 1 ? 0x40040000UL : 0x40080000UL;
+#endif
+}
+#endif
 
 namespace usb {
 
+/// Статические буферы библиотеки одним объектом (usb_memory.h, USB_ARENA_SECTION)
+[[maybe_unused]] static memory::Arena g_arena USB_ARENA_ATTR;
+
+/// Захват мьютекса на время области видимости (nullptr — без RTOS, пусто)
+class ScopedLock {
+public:
+    explicit ScopedLock(ports::IMutex* mutex) : mutex_(mutex) {
+        if (mutex_ != nullptr) {
+            mutex_->Lock();
+        }
+    }
+    ~ScopedLock() {
+        if (mutex_ != nullptr) {
+            mutex_->Unlock();
+        }
+    }
+    ScopedLock(const ScopedLock&) = delete;
+    ScopedLock& operator=(const ScopedLock&) = delete;
+
+private:
+    ports::IMutex* mutex_;
+};
+
+#ifdef USB_RTOS_ENABLED
+/// Состояние RTOS режима (объекты создаются в StartTasks)
+struct RtosState {
+    ports::IRtos* rtos = nullptr;
+    ports::IMutex* cdc_mutex = nullptr;       ///< CDC FIFO из любой задачи
+    ports::IMutex* callback_mutex = nullptr;  ///< Пары callback + context
+    ports::IMutex* msc_mutex = nullptr;       ///< Обращения к IBlockDevice
+    ports::ISignal* usb_exited = nullptr;
+    ports::ISignal* storage_exited = nullptr;
+    RtosConfig config{};
+    std::atomic<bool> running{false};
+    std::atomic<bool> stop{false};
+};
+
+static RtosState g_rtos;
+
+static bool TasksStarted() {
+    return g_rtos.running.load(std::memory_order_acquire);
+}
+#endif
+
 //--------------------------------------------------------------------+
-// Глобальные переменные для TinyUSB callbacks
+// Цикл событий (Process / WaitForEvent)
 //--------------------------------------------------------------------+
 
-static UsbDevice* g_usb_instance = nullptr;
+/// Счётчики EventLoopStats (пишутся из main loop и прерывания)
+struct EventLoopCounters {
+    std::atomic<uint32_t> interrupts{0};
+    std::atomic<uint32_t> process_calls{0};
+    std::atomic<uint32_t> task_runs{0};
+    std::atomic<uint32_t> wait_calls{0};
+    std::atomic<uint32_t> wait_timeouts{0};
+    std::atomic<uint32_t> user_events{0};
+    std::atomic<uint32_t> suspends{0};
+    std::atomic<uint32_t> resumes{0};
+    std::atomic<uint64_t> sleep_ms{0};
+};
 
-#ifdef USB_CDC_ENABLED
-static CdcRxCallback g_cdc_rx_callback = nullptr;
-static void* g_cdc_rx_context = nullptr;
-static CdcLineCodingCallback g_cdc_lc_callback = nullptr;
-static void* g_cdc_lc_context = nullptr;
-static DfuJumpCallback g_dfu_callback = nullptr;
-static void* g_dfu_context = nullptr;
+static void EventCount(std::atomic<uint32_t>& counter) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+}
 
-/// Флаг: терминал открыт (получен SET_LINE_CODING с baudrate != 1200)
-static volatile bool g_terminal_opened = false;
+/// Миллисекунды для таймаута WaitForEvent()
+static uint32_t EventNowMs() {
+#ifdef USB_COMPOSITE_HAS_HAL
+    return HAL_GetTick();
+#else
+    using namespace std::chrono;
+    return static_cast<uint32_t>(
+        duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
 #endif
+}
+
+//--------------------------------------------------------------------+
+// Таблица экземпляров (по rhport)
+//--------------------------------------------------------------------+
 
+/**
+ * @brief Состояние одного rhport: экземпляр UsbDevice и данные его callbacks
+ * 
+ * TinyUSB 0.16 callbacks не передают rhport (device стек один на сборку),
+ * поэтому они обращаются к порту device стека — DevicePort().
+ */
+struct PortState {
+    UsbDevice* instance = nullptr;
+    
+    // Цикл событий
+    std::atomic<bool> irq_pending{false};   ///< Прерывание с последнего Process()
+    std::atomic<uint32_t> irq_ticks{0};     ///< Первое необслуженное прерывание
+    std::atomic<bool> user_event{false};    ///< NotifyEvent(), потребляется WaitForEvent()
+    EventLoopCounters events;
+    
+    /// Suspend/resume шины (меняется и читается под CallbackMutex())
+    SuspendCallback suspend_callback = nullptr;
+    void* suspend_context = nullptr;
+    
+#ifdef USB_CDC_ENABLED
+    CdcRxCallback cdc_rx_callback = nullptr;
+    void* cdc_rx_context = nullptr;
+    CdcLineCodingCallback cdc_lc_callback = nullptr;
+    void* cdc_lc_context = nullptr;
+    DfuJumpCallback dfu_callback = nullptr;
+    void* dfu_context = nullptr;
+    /// Терминал открыт (получен SET_LINE_CODING с baudrate != 1200)
+    std::atomic<bool> terminal_opened{false};
+#ifdef USB_RPC_ENABLED
+    /// RPC сервер (RpcAttach): RX FIFO читает RpcPoll(), а не tud_cdc_rx_cb
+    rpc::Server* rpc_server = nullptr;
+#endif
+#endif
+    
+#ifdef USB_DFU_ENABLED
+    /// Приёмник образа (DfuAttach), меняется и читается под CallbackMutex()
+    DfuFlash* dfu_target = nullptr;
+    /// Запрос переключения режима из callbacks (DfuSwitch), выполняет DfuPoll()
+    std::atomic<uint8_t> dfu_switch{0};
+    /// Отключились от шины, ждём USB_DFU_RECONNECT_MS до tud_connect()
+    bool dfu_reconnecting = false;
+    uint32_t dfu_disconnect_ms = 0;
+#endif
+    
+#ifdef USB_MSC_ENABLED
+    /// Переходники и кэш геометрии подключённого устройства
+    MscBindingState msc_binding;
+    /// &msc_binding, пока устройство подключено (меняется под MscMutex(), читается из callbacks)
+    std::atomic<MscBindingState*> msc_device{nullptr};
+    std::atomic<bool> msc_ejected{false};
+    /// Носитель изменён в обход хоста: UNIT ATTENTION на следующий TEST UNIT READY
+    std::atomic<bool> msc_media_changed{false};
+    /// Eject/load от хоста (меняется и читается под CallbackMutex())
+    MscEjectCallback msc_eject_callback = nullptr;
+    void* msc_eject_context = nullptr;
+    /// Активные MSC операции (для MscIsBusy)
+    std::atomic<int> msc_ops_count{0};
+#endif
+    
+    /// Сброс при освобождении порта
+    void Reset() {
+        instance = nullptr;
+        irq_pending.store(false, std::memory_order_relaxed);
+        user_event.store(false, std::memory_order_relaxed);
+        suspend_callback = nullptr;
+        suspend_context = nullptr;
+#ifdef USB_CDC_ENABLED
+        cdc_rx_callback = nullptr;
+        cdc_rx_context = nullptr;
+        cdc_lc_callback = nullptr;
+        cdc_lc_context = nullptr;
+        dfu_callback = nullptr;
+        dfu_context = nullptr;
+        terminal_opened.store(false, std::memory_order_relaxed);
+#ifdef USB_RPC_ENABLED
+        rpc_server = nullptr;
+#endif
+#endif
+#ifdef USB_DFU_ENABLED
+        dfu_target = nullptr;
+        dfu_switch.store(0, std::memory_order_relaxed);
+        dfu_reconnecting = false;
+#endif
 #ifdef USB_MSC_ENABLED
-static IBlockDevice* g_msc_device = nullptr;
-static bool g_msc_ejected = false;
+        msc_device.store(nullptr, std::memory_order_release);
+        msc_ejected.store(false, std::memory_order_relaxed);
+        msc_media_changed.store(false, std::memory_order_relaxed);
+        msc_eject_callback = nullptr;
+        msc_eject_context = nullptr;
+#endif
+    }
+};
+
+static constexpr uint8_t kNoRhport = 0xFF;
+
+#ifdef USB_DFU_ENABLED
+/// Запрошенное переключение конфигурации (PortState::dfu_switch)
+enum DfuSwitch : uint8_t {
+    kDfuSwitchNone = 0,
+    kDfuSwitchEnter,  ///< DETACH в runtime, 1200 bps, DfuEnterMode()
+    kDfuSwitchLeave,  ///< DETACH в режиме DFU, DfuLeaveMode()
+};
+
+// Пауза между tud_disconnect() и tud_connect(): хост должен увидеть отключение
+#ifndef USB_DFU_RECONNECT_MS
+#define USB_DFU_RECONNECT_MS 20
+#endif
+#endif
+
+static PortState g_ports[kMaxRhports];
 
-/// Атомарный счётчик активных MSC операций для корректного IsBusy
-static std::atomic<int> g_msc_ops_count{0};
+/// rhport, на котором запущен device стек TinyUSB (kNoRhport — ещё нет)
+static uint8_t g_device_rhport = kNoRhport;
+
+static PortState& Port(uint8_t rhport) {
+    return g_ports[rhport < kMaxRhports ? rhport : 0];
+}
 
+/// Порт device стека — для TinyUSB callbacks
+static PortState& DevicePort() {
+    return Port(g_device_rhport);
+}
+
+/// Сон до прерывания
+static void SleepUntilInterrupt(const PortState& port) {
+#ifdef USB_COMPOSITE_HAS_HAL
+    // С PRIMASK прерывание между проверкой и WFI не теряется:
+    // WFI просыпается по ожидающему прерыванию даже при запрете
+    __disable_irq();
+    if (!port.irq_pending.load(std::memory_order_relaxed) &&
+        !port.user_event.load(std::memory_order_relaxed)) {
+        __WFI();
+    }
+    __enable_irq();
+#else
+    // native: прерываний нет, события приходят из других потоков
+    (void)port;
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+#endif
+}
+
+static ports::IMutex* CdcMutex() {
+#ifdef USB_RTOS_ENABLED
+    return g_rtos.cdc_mutex;
+#else
+    return nullptr;
+#endif
+}
+
+static ports::IMutex* CallbackMutex() {
+#ifdef USB_RTOS_ENABLED
+    return g_rtos.callback_mutex;
+#else
+    return nullptr;
+#endif
+}
+
+static ports::IMutex* MscMutex() {
+#ifdef USB_RTOS_ENABLED
+    return g_rtos.msc_mutex;
+#else
+    return nullptr;
+#endif
+}
+
+#ifdef USB_CDC_ENABLED
+/// Ожидание места в TX FIFO: прокачка стека или пауза задачи (RTOS)
+static void CdcWaitTx() {
+#ifdef USB_RTOS_ENABLED
+    if (TasksStarted()) {
+        g_rtos.rtos->DelayMs(1);
+        return;
+    }
+#endif
+    tud_task();
+}
+
+/// Запись в CDC целиком: ждём место в TX FIFO, пока хост забирает данные
+static bool CdcWriteAll(UsbDevice& usb, const uint8_t* data, uint32_t len) {
+    for (uint32_t attempt = 0; len > 0 && attempt < 1000; attempt++) {
+        uint32_t written = usb.CdcWrite(data, len);
+        data += written;
+        len -= written;
+        if (len > 0) {
+            CdcWaitTx();
+        }
+    }
+    return len == 0;
+}
+#endif
+
+#ifdef USB_VENDOR_ENABLED
+//--------------------------------------------------------------------+
+// Vendor: кольца буферов ↔ FIFO vendor класса TinyUSB
+//--------------------------------------------------------------------+
+
+using VendorRing = StreamRing<USB_VENDOR_RING_BUFFERS, USB_VENDOR_BUFFER_SIZE>;
+
+// Один набор колец — device стек TinyUSB один на сборку. Кольца в арене
+// (секция NOLOAD не обнуляется) — Clear() в UsbDevice::Init()
+static VendorRing& g_vendor_tx = g_arena.vendor_tx;
+static VendorRing& g_vendor_rx = g_arena.vendor_rx;
+
+/// Счётчики VendorStats и флаг ожидания места в кольце RX
+struct VendorCounters {
+    std::atomic<uint32_t> rx_bytes{0};
+    std::atomic<uint32_t> rx_buffers{0};
+    std::atomic<uint32_t> rx_ring_full{0};
+    std::atomic<uint32_t> tx_bytes{0};
+    std::atomic<uint32_t> tx_buffers{0};
+    std::atomic<uint32_t> tx_ring_full{0};
+    /// Данные остались в FIFO RX: кольцо было заполнено
+    std::atomic<bool> rx_waiting{false};
+};
+
+static VendorCounters g_vendor;
+
+static void VendorCount(std::atomic<uint32_t>& counter, uint32_t value = 1) {
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+/// Кольцо TX → FIFO TinyUSB (любой контекст; CdcMutex — общий для FIFO записи)
+static void VendorPumpTx() {
+    ScopedLock lock(CdcMutex());
+    bool written = false;
+    uint32_t len;
+    const uint8_t* data;
+    while ((data = g_vendor_tx.Peek(&len)) != nullptr) {
+        uint32_t n = tud_vendor_write(data, len);
+        if (n == 0) {
+            break;  // FIFO полон — продолжит tud_vendor_tx_cb
+        }
+        g_vendor_tx.Consume(n);
+        VendorCount(g_vendor.tx_bytes, n);
+        written = true;
+        if (n < len) {
+            break;
+        }
+    }
+    if (written) {
+        tud_vendor_write_flush();
+    }
+}
+
+/// FIFO TinyUSB → кольцо RX (только контекст tud_task: один производитель)
+static void VendorPumpRx() {
+    while (tud_vendor_available() > 0) {
+        uint8_t* buffer = g_vendor_rx.Acquire();
+        if (buffer == nullptr) {
+            // Данные ждут в FIFO, хост получает NAK до VendorReleaseRx()
+            if (!g_vendor.rx_waiting.exchange(true, std::memory_order_relaxed)) {
+                VendorCount(g_vendor.rx_ring_full);
+            }
+            return;
+        }
+        uint32_t n = tud_vendor_read(buffer, VendorRing::kCapacity);
+        if (n == 0) {
+            break;
+        }
+        g_vendor_rx.Commit(n);
+        VendorCount(g_vendor.rx_bytes, n);
+        VendorCount(g_vendor.rx_buffers);
+    }
+    g_vendor.rx_waiting.store(false, std::memory_order_relaxed);
+}
+
+/// Без событий USB: забрать FIFO RX, если приложение освободило буфер
+static void VendorPoll() {
+    if (g_vendor.rx_waiting.load(std::memory_order_relaxed) && !g_vendor_rx.Full()) {
+        VendorPumpRx();
+    }
+}
+#endif
+
+#ifdef USB_MSC_ENABLED
 /// RAII-guard для счётчика операций MSC
 struct MscBusyGuard {
-    MscBusyGuard() { g_msc_ops_count.fetch_add(1, std::memory_order_relaxed); }
-    ~MscBusyGuard() { g_msc_ops_count.fetch_sub(1, std::memory_order_relaxed); }
+    explicit MscBusyGuard(PortState& port) : port_(port) {
+        port_.msc_ops_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    ~MscBusyGuard() { port_.msc_ops_count.fetch_sub(1, std::memory_order_relaxed); }
     MscBusyGuard(const MscBusyGuard&) = delete;
     MscBusyGuard& operator=(const MscBusyGuard&) = delete;
+
+private:
+    PortState& port_;
 };
+
+/// Гистограмма латентности на relaxed-атомиках (один писатель — контекст tud_task)
+struct AtomicLatencyHistogram {
+    std::atomic<uint32_t> buckets[LatencyHistogram::kBuckets] = {};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> min_us{UINT32_MAX};
+    std::atomic<uint32_t> max_us{0};
+    std::atomic<uint32_t> total_lo{0};
+    std::atomic<uint32_t> total_hi{0};
+    
+    void Record(uint32_t us) {
+        buckets[LatencyHistogram::BucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+        if (us < min_us.load(std::memory_order_relaxed)) {
+            min_us.store(us, std::memory_order_relaxed);
+        }
+        if (us > max_us.load(std::memory_order_relaxed)) {
+            max_us.store(us, std::memory_order_relaxed);
+        }
+        uint32_t prev = total_lo.fetch_add(us, std::memory_order_relaxed);
+        if (prev + us < prev) {
+            total_hi.fetch_add(1, std::memory_order_relaxed);
+        }
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    void Snapshot(LatencyHistogram& out) const {
+        for (uint32_t b = 0; b < LatencyHistogram::kBuckets; b++) {
+            out.buckets[b] = buckets[b].load(std::memory_order_relaxed);
+        }
+        out.count = count.load(std::memory_order_relaxed);
+        out.min_us = out.count == 0 ? 0 : min_us.load(std::memory_order_relaxed);
+        out.max_us = max_us.load(std::memory_order_relaxed);
+        out.total_us = (static_cast<uint64_t>(total_hi.load(std::memory_order_relaxed)) << 32) |
+                       total_lo.load(std::memory_order_relaxed);
+    }
+    
+    void Reset() {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+        min_us.store(UINT32_MAX, std::memory_order_relaxed);
+        max_us.store(0, std::memory_order_relaxed);
+        total_lo.store(0, std::memory_order_relaxed);
+        total_hi.store(0, std::memory_order_relaxed);
+    }
+};
+
+/// Счётчики MSC одной LUN
+struct MscLunCounters {
+    std::atomic<uint32_t> commands{0};
+    std::atomic<uint32_t> read_commands{0};
+    std::atomic<uint32_t> write_commands{0};
+    std::atomic<uint32_t> blocks_read{0};
+    std::atomic<uint32_t> blocks_written{0};
+    std::atomic<uint32_t> sequential_reads{0};
+    std::atomic<uint32_t> random_reads{0};
+    std::atomic<uint32_t> sequential_writes{0};
+    std::atomic<uint32_t> random_writes{0};
+    std::atomic<uint32_t> read_errors{0};
+    std::atomic<uint32_t> write_errors{0};
+    std::atomic<uint32_t> not_ready{0};
+    std::atomic<uint32_t> sense_count[16] = {};
+    std::atomic<uint32_t> last_sense{0};  ///< key << 16 | asc << 8 | ascq
+    AtomicLatencyHistogram read_latency;
+    AtomicLatencyHistogram write_latency;
+    
+    // Текущая команда (только контекст tud_task, без атомиков)
+    bool in_command = false;      ///< Идёт READ10/WRITE10
+    bool command_failed = false;  ///< Callback текущей команды вернул ошибку
+    uint32_t command_start = 0;
+    uint32_t command_lba = 0;
+    uint32_t command_blocks = 0;
+    uint32_t command_timestamp = 0;
+    uint32_t next_read_lba = UINT32_MAX;
+    uint32_t next_write_lba = UINT32_MAX;
+    
+    void Reset() {
+        std::atomic<uint32_t>* counters[] = {
+            &commands, &read_commands, &write_commands, &blocks_read, &blocks_written,
+            &sequential_reads, &random_reads, &sequential_writes, &random_writes,
+            &read_errors, &write_errors, &not_ready, &last_sense
+        };
+        for (auto* counter : counters) {
+            counter->store(0, std::memory_order_relaxed);
+        }
+        for (auto& counter : sense_count) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        read_latency.Reset();
+        write_latency.Reset();
+        next_read_lba = UINT32_MAX;
+        next_write_lba = UINT32_MAX;
+    }
+};
+
+static MscLunCounters g_msc_stats[kMscLunCount];
+
+static MscLunCounters& MscCounters(uint8_t lun) {
+    return g_msc_stats[lun < kMscLunCount ? lun : 0];
+}
+
+static void MscCount(std::atomic<uint32_t>& counter, uint32_t value = 1) {
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+/// Выставить sense и учесть его в статистике
+static void MscSetSense(uint8_t lun, uint8_t key, uint8_t asc, uint8_t ascq) {
+    MscLunCounters& stats = MscCounters(lun);
+    MscCount(stats.sense_count[key & 0x0F]);
+    stats.last_sense.store((static_cast<uint32_t>(key) << 16) | (asc << 8) | ascq,
+                           std::memory_order_relaxed);
+    tud_msc_set_sense(lun, key, asc, ascq);
+}
+
+#ifdef USB_MSC_TRACE_ENABLED
+static MscTraceRing& g_msc_trace = g_arena.msc_trace;
+static uint32_t g_msc_trace_ticks = 0;
+static uint32_t g_msc_trace_time_us = 0;
+
+/// Время трассы: накопление дельт счётчика проб
+static uint32_t MscTraceNow(uint32_t ticks) {
+    g_msc_trace_time_us += ProfileTicksToUs(ticks - g_msc_trace_ticks);
+    g_msc_trace_ticks = ticks;
+    return g_msc_trace_time_us;
+}
 #endif
 
+/// Ошибка в callback текущей команды
+static void MscFail(MscLunCounters& stats, std::atomic<uint32_t>& counter) {
+    MscCount(counter);
+    stats.command_failed = true;
+}
+
+/// Запись завершённой команды в трассу
+static void MscTrace(const MscLunCounters& stats, uint8_t opcode, uint32_t latency_us) {
+#ifdef USB_MSC_TRACE_ENABLED
+    MscTraceEntry entry;
+    entry.timestamp_us = stats.command_timestamp;
+    entry.lba = stats.command_lba;
+    entry.latency_us = latency_us;
+    entry.blocks = static_cast<uint16_t>(stats.command_blocks);
+    entry.opcode = opcode;
+    entry.status = stats.command_failed ? MscTraceStatus::Failed : MscTraceStatus::Passed;
+    g_msc_trace.Push(entry);
+#else
+    (void)stats;
+    (void)opcode;
+    (void)latency_us;
+#endif
+}
+
+/// Начало READ10/WRITE10: классификация seq/random и старт таймера
+static void MscBeginCommand(uint8_t lun, bool write, uint32_t lba) {
+    MscLunCounters& stats = MscCounters(lun);
+    if (stats.in_command) {
+        return;
+    }
+    stats.in_command = true;
+    stats.command_failed = false;
+    stats.command_start = ProfileNowTicks();
+    stats.command_lba = lba;
+    stats.command_blocks = 0;
+#ifdef USB_MSC_TRACE_ENABLED
+    stats.command_timestamp = MscTraceNow(stats.command_start);
+#endif
+    if (write) {
+        MscCount(lba == stats.next_write_lba ? stats.sequential_writes : stats.random_writes);
+    } else {
+        MscCount(lba == stats.next_read_lba ? stats.sequential_reads : stats.random_reads);
+    }
+}
+
+/// Завершение READ10/WRITE10 (из *_complete_cb)
+static void MscEndCommand(uint8_t lun, bool write) {
+    MscLunCounters& stats = MscCounters(lun);
+    MscCount(stats.commands);
+    MscCount(write ? stats.write_commands : stats.read_commands);
+    if (stats.in_command) {
+        uint32_t us = ProfileTicksToUs(ProfileNowTicks() - stats.command_start);
+        (write ? stats.write_latency : stats.read_latency).Record(us);
+        MscTrace(stats, write ? SCSI_CMD_WRITE_10 : SCSI_CMD_READ_10, us);
+        stats.in_command = false;
+    }
+    stats.command_failed = false;
+}
+
+/// Завершение остальных команд (из tud_msc_scsi_complete_cb)
+static void MscEndOtherCommand(uint8_t lun, uint8_t opcode) {
+    MscLunCounters& stats = MscCounters(lun);
+    MscCount(stats.commands);
+    stats.command_lba = 0;
+    stats.command_blocks = 0;
+#ifdef USB_MSC_TRACE_ENABLED
+    stats.command_timestamp = MscTraceNow(ProfileNowTicks());
+#endif
+    MscTrace(stats, opcode, 0);
+    stats.command_failed = false;
+}
+
+/// Чтение/запись блоков подключённого устройства одним вызовом Read()/Write()
+/// @param[out] bytes Байт куска, покрытых целыми блоками
+/// @return Обработано блоков (0 — кусок меньше блока), -1 — ошибка
+static int32_t MscDeviceIo(bool write, uint32_t lba, uint8_t* buffer, uint32_t bufsize,
+                           uint32_t* bytes) {
+    ScopedLock lock(MscMutex());
+    PortState& port = DevicePort();
+    MscBindingState* device = port.msc_device.load(std::memory_order_acquire);
+    if (device == nullptr || port.msc_ejected.load(std::memory_order_relaxed)) {
+        return -1;
+    }
+    
+    // RAII-guard для отслеживания занятости
+    MscBusyGuard busy_guard(port);
+#ifdef USB_PROFILE_ENABLED
+    ProbeScope probe(write ? ProbePoint::MscWrite : ProbePoint::MscRead);
+#endif
+    
+    // Один косвенный вызов: готовность, деление на блоки и Read/Write — в переходнике
+    int32_t blocks = device->Transfer(write, lba, buffer, bufsize);
+    *bytes = blocks > 0 ? static_cast<uint32_t>(blocks) * device->BlockSize() : 0;
+    return blocks;
+}
+
+/// Сбросить отложенные записи подключённого устройства (SYNCHRONIZE CACHE, eject)
+/// @return true — устройства нет или Sync() успешен
+static bool MscDeviceSync() {
+    ScopedLock lock(MscMutex());
+    PortState& port = DevicePort();
+    MscBindingState* device = port.msc_device.load(std::memory_order_acquire);
+    if (device == nullptr) {
+        return true;
+    }
+    MscBusyGuard busy_guard(port);
+    return device->Sync();
+}
+
+#ifdef USB_RTOS_ENABLED
+/// Состояние запроса к задаче хранилища
+enum class MscIoState : uint8_t {
+    Idle,
+    Queued,
+    Done,
+    Failed,
+};
+
+/// Запрос к задаче хранилища (BOT — одна команда за раз, очередь глубины 1)
+struct MscIoRequest {
+    std::atomic<MscIoState> state{MscIoState::Idle};
+    bool write = false;
+    uint32_t lba = 0;
+    uint8_t* buffer = nullptr;       ///< EP буфер TinyUSB (не меняется до ответа callback)
+    uint32_t bufsize = 0;
+    uint32_t blocks = 0;             ///< Результат: обработано блоков
+    uint32_t bytes = 0;              ///< Результат: байт куска в этих блоках
+    ports::ISignal* request = nullptr;  ///< Задача USB → хранилище
+    ports::ISignal* done = nullptr;     ///< Хранилище → задача USB
+};
+
+static MscIoRequest g_msc_io;
+
+/**
+ * @brief Кусок READ10/WRITE10 через задачу хранилища (контекст задачи USB)
+ * 
+ * Пока операция идёт, callback возвращает 0 и TinyUSB повторяет его
+ * с теми же lba/буфером. Между повторами задача USB ждёт не дольше
+ * RtosConfig::msc_wait_ms и обслуживает остальные события (CDC, control).
+ */
+static int32_t MscWorkerTransfer(bool write, uint32_t lba, uint8_t* buffer, uint32_t bufsize,
+                                 uint32_t* bytes) {
+    MscIoRequest& io = g_msc_io;
+    MscIoState state = io.state.load(std::memory_order_acquire);
+    bool same = io.write == write && io.lba == lba && io.buffer == buffer && io.bufsize == bufsize;
+    
+    // Результат прерванной команды (сброс шины) отбрасываем
+    if (state == MscIoState::Idle || (state != MscIoState::Queued && !same)) {
+        io.write = write;
+        io.lba = lba;
+        io.buffer = buffer;
+        io.bufsize = bufsize;
+        io.blocks = 0;
+        io.bytes = 0;
+        io.state.store(MscIoState::Queued, std::memory_order_release);
+        io.request->Give();
+        state = MscIoState::Queued;
+        same = true;
+    }
+    if (state == MscIoState::Queued) {
+        io.done->Take(g_rtos.config.msc_wait_ms);
+        state = io.state.load(std::memory_order_acquire);
+    }
+    if (state == MscIoState::Queued || !same) {
+        return 0;
+    }
+    io.state.store(MscIoState::Idle, std::memory_order_relaxed);
+    *bytes = io.bytes;
+    return state == MscIoState::Done ? static_cast<int32_t>(io.blocks) : -1;
+}
+
+/// Задача хранилища: выполняет запросы g_msc_io
+static void StorageTaskMain(void* context) {
+    (void)context;
+    MscIoRequest& io = g_msc_io;
+    while (!g_rtos.stop.load(std::memory_order_acquire)) {
+        io.request->Take(ports::kWaitForever);
+        if (io.state.load(std::memory_order_acquire) != MscIoState::Queued) {
+            continue;
+        }
+        uint32_t bytes = 0;
+        int32_t blocks = MscDeviceIo(io.write, io.lba, io.buffer, io.bufsize, &bytes);
+        io.blocks = blocks > 0 ? static_cast<uint32_t>(blocks) : 0;
+        io.bytes = bytes;
+        io.state.store(blocks < 0 ? MscIoState::Failed : MscIoState::Done,
+                       std::memory_order_release);
+        io.done->Give();
+    }
+    g_rtos.storage_exited->Give();
+}
+#endif
+
+/**
+ * @brief READ10/WRITE10: кусок EP буфера — напрямую или через задачу хранилища
+ *
+ * Возвращает байты целых блоков, а не bufsize: если кусок кончается внутри
+ * блока, TinyUSB оставляет хвост в EP буфере (WRITE10) или досылает его
+ * следующим вызовом с пересчитанными lba/offset (READ10).
+ *
+ * @return Байт обработано, 0 — повторить позже, -1 — ошибка
+ */
+static int32_t MscTransfer(uint8_t lun, bool write, uint32_t lba, uint8_t* buffer,
+                           uint32_t bufsize) {
+    MscLunCounters& stats = MscCounters(lun);
+    uint32_t bytes = 0;
+#ifdef USB_RTOS_ENABLED
+    int32_t blocks = TasksStarted() ? MscWorkerTransfer(write, lba, buffer, bufsize, &bytes)
+                                    : MscDeviceIo(write, lba, buffer, bufsize, &bytes);
+#else
+    int32_t blocks = MscDeviceIo(write, lba, buffer, bufsize, &bytes);
+#endif
+    if (blocks < 0) {
+        MscFail(stats, write ? stats.write_errors : stats.read_errors);
+        return -1;
+    }
+    if (blocks == 0) {
+        return 0;
+    }
+    
+    uint32_t count = static_cast<uint32_t>(blocks);
+    MscCount(write ? stats.blocks_written : stats.blocks_read, count);
+    stats.command_blocks += count;
+    (write ? stats.next_write_lba : stats.next_read_lba) = lba + count;
+    return static_cast<int32_t>(bytes);
+}
+#endif
+
+#ifdef USB_RTOS_ENABLED
+/// Задача USB: стек TinyUSB, блокируется на очереди событий
+static void UsbTaskMain(void* context) {
+    (void)context;
+    while (!g_rtos.stop.load(std::memory_order_acquire)) {
+        tud_task_ext(g_rtos.config.usb_poll_ms, false);
+#ifdef USB_VENDOR_ENABLED
+        VendorPoll();
+#endif
+    }
+    g_rtos.usb_exited->Give();
+}
+
+/// Сброс состояния RTOS режима (после остановки задач)
+static void RtosReset() {
+    g_rtos.running.store(false, std::memory_order_release);
+    g_rtos.rtos = nullptr;
+    g_rtos.cdc_mutex = nullptr;
+    g_rtos.callback_mutex = nullptr;
+    g_rtos.msc_mutex = nullptr;
+    g_rtos.usb_exited = nullptr;
+    g_rtos.storage_exited = nullptr;
+#ifdef USB_MSC_ENABLED
+    g_msc_io.state.store(MscIoState::Idle, std::memory_order_relaxed);
+    g_msc_io.request = nullptr;
+    g_msc_io.done = nullptr;
+#endif
+}
+#endif
+
+//--------------------------------------------------------------------+
+// Строковые дескрипторы
+//--------------------------------------------------------------------+
+
+// Строки из макросов кодируются при компиляции и лежат во flash
+static constexpr auto kManufacturerString = desc::StringDescriptor(USB_STR_MANUFACTURER);
+static constexpr auto kProductString = desc::StringDescriptor(USB_STR_PRODUCT);
+static constexpr auto kSerialString = desc::StringDescriptor(USB_STR_SERIAL);
+static constexpr auto kCdcString = desc::StringDescriptor(USB_STR_CDC);
+static constexpr auto kMscString = desc::StringDescriptor(USB_STR_MSC);
+static constexpr auto kVendorString = desc::StringDescriptor(USB_STR_VENDOR);
+static constexpr auto kDfuString = desc::StringDescriptor(USB_STR_DFU);
+
+static desc::RuntimeDescriptors g_descriptors;
+
+desc::RuntimeDescriptors& desc::Runtime() {
+    return g_descriptors;
+}
+
+/// Строка из Config: совпадает с макросом (или nullptr) — flash, иначе арена
+static bool SetConfigString(uint8_t index, const char* text, const char* macro_text,
+                            const uint16_t* macro_descriptor) {
+    desc::StringTable<>& strings = g_descriptors.strings;
+    if (text == nullptr || strcmp(text, macro_text) == 0) {
+        return strings.SetStatic(index, macro_descriptor);
+    }
+    return strings.Set(index, text);
+}
+
+/// Все дескрипторы, зависящие от Config, — до tusb_init()
+static bool BuildDescriptors(const Config& config) {
+    g_descriptors.vid = config.vid;
+    g_descriptors.pid = config.pid;
+    g_descriptors.dfu_mode = false;
+    desc::StringTable<>& strings = g_descriptors.strings;
+    strings.Clear();
+    strings.SetStatic(desc::kStrLanguage, desc::kLanguageDescriptor.data());
+    strings.SetStatic(desc::kStrCdc, kCdcString.data());
+    strings.SetStatic(desc::kStrMsc, kMscString.data());
+    strings.SetStatic(desc::kStrVendor, kVendorString.data());
+    strings.SetStatic(desc::kStrDfu, kDfuString.data());
+
+    bool ok = SetConfigString(desc::kStrManufacturer, config.manufacturer,
+                              USB_STR_MANUFACTURER, kManufacturerString.data());
+    ok = SetConfigString(desc::kStrProduct, config.product, USB_STR_PRODUCT,
+                         kProductString.data()) && ok;
+
+    uint32_t uid[3] = {0, 0, 0};
+    if (config.serial != nullptr) {
+        ok = SetConfigString(desc::kStrSerial, config.serial, USB_STR_SERIAL,
+                             kSerialString.data()) && ok;
+    } else if (UsbReadChipUid(uid)) {
+        char serial[25];
+        desc::UidToSerial(uid, serial);
+        ok = strings.Set(desc::kStrSerial, serial) && ok;
+    } else {
+        strings.SetStatic(desc::kStrSerial, kSerialString.data());
+    }
+    return ok;
+}
+
 //--------------------------------------------------------------------+
 // UsbDevice реализация
 //--------------------------------------------------------------------+
@@ -78,9 +879,38 @@ bool UsbDevice::Init(const Config& config) {
     if (initialized_) {
         return true;
     }
+    if (config.rhport >= kMaxRhports) {
+        return false;
+    }
+#ifdef TUD_OPT_RHPORT
+    // Порт device стека TinyUSB 0.16 задаётся при сборке (BOARD_TUD_RHPORT)
+    if (config.rhport != TUD_OPT_RHPORT) {
+        return false;
+    }
+#endif
+    PortState& port = Port(config.rhport);
+    if (port.instance != nullptr ||
+        (g_device_rhport != kNoRhport && g_device_rhport != config.rhport)) {
+        return false;  // Порт занят или device стек уже работает на другом порту
+    }
+    
+    if (!BuildDescriptors(config)) {
+        return false;  // Строки Config не влезли в USB_DESC_STRING_ARENA
+    }
+    diagnostics_.string_arena_used = static_cast<uint32_t>(g_descriptors.strings.ArenaUsed());
     
     config_ = config;
-    g_usb_instance = this;
+    port.instance = this;
+    g_init_rhport = config.rhport;
+    
+#ifdef USB_VENDOR_ENABLED
+    g_vendor_tx.Clear();
+    g_vendor_rx.Clear();
+    g_vendor.rx_waiting.store(false, std::memory_order_relaxed);
+#endif
+#if defined(USB_MSC_ENABLED) && defined(USB_MSC_TRACE_ENABLED)
+    g_msc_trace.Clear();
+#endif
     
     // Инициализация GPIO для USB (PA11/PA12)
     InitUsbGpio();
@@ -99,21 +929,18 @@ bool UsbDevice::Init(const Config& config) {
     diagnostics_.tusb_init_ok = tusb_ok;
     
     if (!tusb_ok) {
+        port.instance = nullptr;
         return false;
     }
+    g_device_rhport = config.rhport;
     
     // Повторно применяем VBUS override (tusb_init делает сброс)
     InitUsbOtg();
     
     // Сохраняем диагностику USB регистров
 #if defined(STM32H7) || defined(STM32H743xx) || defined(STM32H750xx)
-    #ifdef USB2_OTG_FS_PERIPH_BASE
-    diagnostics_.usb_base_addr = USB2_OTG_FS_PERIPH_BASE;
-    auto* USBx = reinterpret_cast<USB_OTG_GlobalTypeDef*>(USB2_OTG_FS_PERIPH_BASE);
-    #else
-    diagnostics_.usb_base_addr = 0x40080000UL;
-    auto* USBx = reinterpret_cast<USB_OTG_GlobalTypeDef*>(0x40080000UL);
-    #endif
+    diagnostics_.usb_base_addr = UsbOtgBase(config.rhport);
+    auto* USBx = reinterpret_cast<USB_OTG_GlobalTypeDef*>(diagnostics_.usb_base_addr);
     diagnostics_.gccfg = USBx->GCCFG;
     diagnostics_.gotgctl = USBx->GOTGCTL;
 #endif
@@ -122,6 +949,22 @@ bool UsbDevice::Init(const Config& config) {
     return true;
 }
 
+UsbDevice::~UsbDevice() {
+    PortState& port = Port(config_.rhport);
+    if (port.instance != this) {
+        return;
+    }
+#ifdef USB_RTOS_ENABLED
+    StopTasks();
+#endif
+    port.Reset();
+    g_device_rhport = kNoRhport;
+}
+
+UsbDevice* UsbDevice::Instance(uint8_t rhport) {
+    return rhport < kMaxRhports ? g_ports[rhport].instance : nullptr;
+}
+
 bool UsbDevice::Start() {
     if (!initialized_) {
         return false;
@@ -138,11 +981,184 @@ void UsbDevice::Stop() {
 }
 
 void UsbDevice::Process() {
-    if (initialized_) {
-        tud_task();
+#ifdef USB_RTOS_ENABLED
+    if (TasksStarted()) {
+        return;  // Стек обслуживает задача USB
+    }
+#endif
+    if (!initialized_) {
+        return;
+    }
+    PortState& port = Port(config_.rhport);
+    EventCount(port.events.process_calls);
+    
+    // Время читается до сброса флага: новое прерывание его уже не перезапишет
+    uint32_t irq_ticks = port.irq_ticks.load(std::memory_order_relaxed);
+    bool irq = port.irq_pending.exchange(false, std::memory_order_acquire);
+    // Очередь TinyUSB пополняется и без прерывания (busy-повтор MSC),
+    // поэтому флаг — быстрый путь, а tud_task_event_ready() — истина
+    if (!irq && !tud_task_event_ready()) {
+#ifdef USB_VENDOR_ENABLED
+        VendorPoll();
+#endif
+        return;
+    }
+#ifdef USB_PROFILE_ENABLED
+    if (irq) {
+        ProfileRecord(ProbePoint::UsbWakeup, ProfileTicksToUs(ProfileNowTicks() - irq_ticks));
+    }
+#else
+    (void)irq_ticks;
+#endif
+    EventCount(port.events.task_runs);
+    USB_PROBE(TudTask);
+    tud_task();
+}
+
+bool UsbDevice::WaitForEvent(uint32_t timeout_ms) {
+    if (!initialized_) {
+        return false;
+    }
+#ifdef USB_RTOS_ENABLED
+    if (TasksStarted()) {
+        g_rtos.rtos->DelayMs(timeout_ms);  // События обрабатывает задача USB
+        return false;
+    }
+#endif
+    PortState& port = Port(config_.rhport);
+    EventCount(port.events.wait_calls);
+    const uint32_t start = EventNowMs();
+    for (;;) {
+        bool ready = port.user_event.exchange(false, std::memory_order_acquire) ||
+                     port.irq_pending.load(std::memory_order_acquire) ||
+                     tud_task_event_ready();
+        uint32_t elapsed = EventNowMs() - start;
+        if (ready || elapsed >= timeout_ms) {
+            port.events.sleep_ms.fetch_add(elapsed, std::memory_order_relaxed);
+            if (!ready) {
+                EventCount(port.events.wait_timeouts);
+            }
+            return ready;
+        }
+        SleepUntilInterrupt(port);
+    }
+}
+
+void UsbDevice::NotifyEvent() {
+    PortState& port = Port(config_.rhport);
+    EventCount(port.events.user_events);
+    port.user_event.store(true, std::memory_order_release);
+}
+
+void UsbDevice::HandleInterrupt(uint8_t rhport) {
+    tud_int_handler(rhport);
+    PortState& port = Port(rhport);
+    EventCount(port.events.interrupts);
+#ifdef USB_PROFILE_ENABLED
+    // Время первого прерывания серии: латентность до Process() считается от него
+    if (!port.irq_pending.load(std::memory_order_relaxed)) {
+        port.irq_ticks.store(ProfileNowTicks(), std::memory_order_relaxed);
     }
+#endif
+    port.irq_pending.store(true, std::memory_order_release);
 }
 
+EventLoopStats UsbDevice::GetEventLoopStats() const {
+    const EventLoopCounters& events = Port(config_.rhport).events;
+    EventLoopStats out;
+    out.interrupts = events.interrupts.load(std::memory_order_relaxed);
+    out.process_calls = events.process_calls.load(std::memory_order_relaxed);
+    out.task_runs = events.task_runs.load(std::memory_order_relaxed);
+    out.wait_calls = events.wait_calls.load(std::memory_order_relaxed);
+    out.wait_timeouts = events.wait_timeouts.load(std::memory_order_relaxed);
+    out.user_events = events.user_events.load(std::memory_order_relaxed);
+    out.suspends = events.suspends.load(std::memory_order_relaxed);
+    out.resumes = events.resumes.load(std::memory_order_relaxed);
+    out.sleep_ms = events.sleep_ms.load(std::memory_order_relaxed);
+    return out;
+}
+
+void UsbDevice::ResetEventLoopStats() {
+    EventLoopCounters& events = Port(config_.rhport).events;
+    events.interrupts.store(0, std::memory_order_relaxed);
+    events.process_calls.store(0, std::memory_order_relaxed);
+    events.task_runs.store(0, std::memory_order_relaxed);
+    events.wait_calls.store(0, std::memory_order_relaxed);
+    events.wait_timeouts.store(0, std::memory_order_relaxed);
+    events.user_events.store(0, std::memory_order_relaxed);
+    events.suspends.store(0, std::memory_order_relaxed);
+    events.resumes.store(0, std::memory_order_relaxed);
+    events.sleep_ms.store(0, std::memory_order_relaxed);
+}
+
+#ifdef USB_RTOS_ENABLED
+
+bool UsbDevice::StartTasks(ports::IRtos& rtos, const RtosConfig& config) {
+    if (!initialized_ || TasksStarted()) {
+        return false;
+    }
+    
+    g_rtos.config = config;
+    g_rtos.cdc_mutex = rtos.CreateMutex();
+    g_rtos.callback_mutex = rtos.CreateMutex();
+    g_rtos.msc_mutex = rtos.CreateMutex();
+    g_rtos.usb_exited = rtos.CreateSignal();
+    g_rtos.storage_exited = rtos.CreateSignal();
+    bool created = g_rtos.cdc_mutex != nullptr && g_rtos.callback_mutex != nullptr &&
+                   g_rtos.msc_mutex != nullptr && g_rtos.usb_exited != nullptr &&
+                   g_rtos.storage_exited != nullptr;
+#ifdef USB_MSC_ENABLED
+    g_msc_io.request = rtos.CreateSignal();
+    g_msc_io.done = rtos.CreateSignal();
+    created = created && g_msc_io.request != nullptr && g_msc_io.done != nullptr;
+#endif
+    if (!created) {
+        RtosReset();
+        return false;
+    }
+    
+    g_rtos.rtos = &rtos;
+    g_rtos.stop.store(false, std::memory_order_relaxed);
+    g_rtos.running.store(true, std::memory_order_release);
+    
+#ifdef USB_MSC_ENABLED
+    // Сначала хранилище: с running = true callbacks уже отдают ввод-вывод ему
+    if (!rtos.CreateTask(config.storage_task, StorageTaskMain, this)) {
+        RtosReset();
+        return false;
+    }
+#endif
+    if (!rtos.CreateTask(config.usb_task, UsbTaskMain, this)) {
+#ifdef USB_MSC_ENABLED
+        g_rtos.stop.store(true, std::memory_order_release);
+        g_msc_io.request->Give();
+        g_rtos.storage_exited->Take(ports::kWaitForever);
+#endif
+        RtosReset();
+        return false;
+    }
+    return true;
+}
+
+void UsbDevice::StopTasks() {
+    if (!TasksStarted()) {
+        return;
+    }
+    g_rtos.stop.store(true, std::memory_order_release);
+    g_rtos.usb_exited->Take(ports::kWaitForever);
+#ifdef USB_MSC_ENABLED
+    g_msc_io.request->Give();
+    g_rtos.storage_exited->Take(ports::kWaitForever);
+#endif
+    RtosReset();
+}
+
+bool UsbDevice::TasksRunning() const {
+    return TasksStarted();
+}
+
+#endif // USB_RTOS_ENABLED
+
 bool UsbDevice::IsConnected() const {
     return initialized_ && tud_ready();
 }
@@ -167,11 +1183,49 @@ UsbDiagnostics UsbDevice::GetDiagnostics() const {
     return diagnostics_;
 }
 
+void UsbDevice::SetSuspendCallback(SuspendCallback callback, void* context) {
+    ScopedLock lock(CallbackMutex());
+    PortState& port = Port(config_.rhport);
+    port.suspend_callback = callback;
+    port.suspend_context = context;
+}
+
+/// Suspend/resume от TinyUSB (контекст tud_task)
+static void BusSuspendChanged(bool suspended) {
+    PortState& port = DevicePort();
+    EventCount(suspended ? port.events.suspends : port.events.resumes);
+    SuspendCallback callback;
+    void* context;
+    {
+        ScopedLock lock(CallbackMutex());
+        callback = port.suspend_callback;
+        context = port.suspend_context;
+    }
+    if (callback != nullptr) {
+        // Задача хранилища не обращается к устройству, пока меняется его питание
+        ScopedLock lock(MscMutex());
+        callback(suspended, context);
+    }
+}
+
+const LatencyHistogram& UsbDevice::GetLatencyHistogram(ProbePoint point) const {
+    return ProfileGet(point);
+}
+
+void UsbDevice::ResetLatencyHistograms() {
+    ProfileReset();
+}
+
+void UsbDevice::SetProfileClock(const ports::IClock* clock) {
+    ProfileSetClock(clock);
+}
+
 void UsbDevice::ToggleDpPin() {
     if (config_.dp_toggle_pin.port == 0xFF || config_.dp_toggle_ms == 0) {
         return;
     }
     
+#ifdef USB_COMPOSITE_HAS_HAL
     // Таблица соответствия индекс → GPIO_TypeDef*
     static GPIO_TypeDef* const kPorts[] = {
         GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG, GPIOH
@@ -191,6 +1245,7 @@ void UsbDevice::ToggleDpPin() {
     // Возвращаем в нормальное состояние (AF для USB)
     // Примечание: после этого нужно переинициализировать GPIO как AF
     // Это делается автоматически при следующем tusb_init или уже сделано
+#endif
 }
 
 //--------------------------------------------------------------------+
@@ -206,8 +1261,17 @@ bool UsbDevice::CdcIsConnected() const {
 uint32_t UsbDevice::CdcWrite(const uint8_t* data, uint32_t len) {
     if (!initialized_) return 0;
     
-    uint32_t written = tud_cdc_write(data, len);
-    tud_cdc_write_flush();
+    // Запись и flush одним куском: сообщения разных задач не перемешиваются
+    ScopedLock lock(CdcMutex());
+    uint32_t written;
+    {
+        USB_PROBE(CdcWrite);
+        written = tud_cdc_write(data, len);
+    }
+    {
+        USB_PROBE(CdcFlush);
+        tud_cdc_write_flush();
+    }
     return written;
 }
 
@@ -226,53 +1290,187 @@ uint32_t UsbDevice::CdcPrintf(const char* fmt, ...) {
     return CdcWrite(reinterpret_cast<const uint8_t*>(buf), static_cast<uint32_t>(len));
 }
 
+bool UsbDevice::CdcBeginWrite() {
+    if (!initialized_) return false;
+    ports::IMutex* mutex = CdcMutex();
+    if (mutex != nullptr) {
+        mutex->Lock();
+    }
+    return true;
+}
+
+uint32_t UsbDevice::CdcPut(const char* data, uint32_t len) {
+    return tud_cdc_write(data, len);
+}
+
+void UsbDevice::CdcEndWrite() {
+    {
+        USB_PROBE(CdcFlush);
+        tud_cdc_write_flush();
+    }
+    ports::IMutex* mutex = CdcMutex();
+    if (mutex != nullptr) {
+        mutex->Unlock();
+    }
+}
+
 uint32_t UsbDevice::CdcRead(uint8_t* buffer, uint32_t max_len) {
     if (!initialized_) return 0;
+    ScopedLock lock(CdcMutex());
     return tud_cdc_read(buffer, max_len);
 }
 
 uint32_t UsbDevice::CdcAvailable() const {
     if (!initialized_) return 0;
+    ScopedLock lock(CdcMutex());
     return tud_cdc_available();
 }
 
 void UsbDevice::CdcFlushRx() {
     if (initialized_) {
+        ScopedLock lock(CdcMutex());
         tud_cdc_read_flush();
     }
 }
 
 void UsbDevice::CdcSetRxCallback(CdcRxCallback callback, void* context) {
+    ScopedLock lock(CallbackMutex());
     cdc_rx_callback_ = callback;
     cdc_rx_context_ = context;
-    g_cdc_rx_callback = callback;
-    g_cdc_rx_context = context;
+    PortState& port = Port(config_.rhport);
+    port.cdc_rx_callback = callback;
+    port.cdc_rx_context = context;
+}
+
+#ifdef USB_RPC_ENABLED
+void UsbDevice::RpcAttach(rpc::Server& server) {
+    server.SetWriter([](const uint8_t* data, uint32_t len, void* context) {
+        return CdcWriteAll(*static_cast<UsbDevice*>(context), data, len);
+    }, this);
+    ScopedLock lock(CallbackMutex());
+    Port(config_.rhport).rpc_server = &server;
+}
+
+void UsbDevice::RpcDetach() {
+    ScopedLock lock(CallbackMutex());
+    Port(config_.rhport).rpc_server = nullptr;
+}
+
+uint32_t UsbDevice::RpcPoll() {
+    if (!initialized_) return 0;
+    rpc::Server* server;
+    {
+        ScopedLock lock(CallbackMutex());
+        server = Port(config_.rhport).rpc_server;
+    }
+    if (server == nullptr) return 0;
+
+    // Кусками из FIFO прямо в декодер кадров; CdcMutex не держим во время обработки
+    uint8_t buf[64];
+    uint32_t total = 0;
+    for (;;) {
+        uint32_t count;
+        {
+            ScopedLock lock(CdcMutex());
+            count = tud_cdc_read(buf, sizeof(buf));
+        }
+        if (count == 0) {
+            break;
+        }
+        server->Feed(buf, count);
+        total += count;
+    }
+    return total;
 }
+#endif
 
 void UsbDevice::CdcSetLineCodingCallback(CdcLineCodingCallback callback, void* context) {
+    ScopedLock lock(CallbackMutex());
     cdc_lc_callback_ = callback;
     cdc_lc_context_ = context;
-    g_cdc_lc_callback = callback;
-    g_cdc_lc_context = context;
+    PortState& port = Port(config_.rhport);
+    port.cdc_lc_callback = callback;
+    port.cdc_lc_context = context;
 }
 
 void UsbDevice::CdcSetDfuCallback(DfuJumpCallback callback, void* context) {
+    ScopedLock lock(CallbackMutex());
     dfu_callback_ = callback;
     dfu_context_ = context;
-    g_dfu_callback = callback;
-    g_dfu_context = context;
+    PortState& port = Port(config_.rhport);
+    port.dfu_callback = callback;
+    port.dfu_context = context;
 }
 
 bool UsbDevice::CdcTerminalOpened() const {
-    return g_terminal_opened;
+    return Port(config_.rhport).terminal_opened.load(std::memory_order_relaxed);
 }
 
 void UsbDevice::CdcResetTerminalFlag() {
-    g_terminal_opened = false;
+    Port(config_.rhport).terminal_opened.store(false, std::memory_order_relaxed);
 }
 
 #endif // USB_CDC_ENABLED
 
+//--------------------------------------------------------------------+
+// Vendor методы
+//--------------------------------------------------------------------+
+
+#ifdef USB_VENDOR_ENABLED
+
+bool UsbDevice::VendorIsConnected() const {
+    return initialized_ && tud_vendor_mounted();
+}
+
+uint8_t* UsbDevice::VendorAcquireTx(uint32_t* capacity) {
+    *capacity = VendorRing::kCapacity;
+    uint8_t* buffer = initialized_ ? g_vendor_tx.Acquire() : nullptr;
+    if (buffer == nullptr) {
+        VendorCount(g_vendor.tx_ring_full);
+    }
+    return buffer;
+}
+
+bool UsbDevice::VendorCommitTx(uint32_t len) {
+    if (!initialized_ || !g_vendor_tx.Commit(len)) {
+        return false;
+    }
+    VendorCount(g_vendor.tx_buffers);
+    VendorPumpTx();
+    return true;
+}
+
+const uint8_t* UsbDevice::VendorPeekRx(uint32_t* len) {
+    return g_vendor_rx.Peek(len);
+}
+
+void UsbDevice::VendorReleaseRx() {
+    // Остаток FIFO заберёт Process() / задача USB (VendorPoll)
+    g_vendor_rx.Release();
+}
+
+VendorStats UsbDevice::VendorGetStats() const {
+    VendorStats s;
+    s.rx_bytes = g_vendor.rx_bytes.load(std::memory_order_relaxed);
+    s.rx_buffers = g_vendor.rx_buffers.load(std::memory_order_relaxed);
+    s.rx_ring_full = g_vendor.rx_ring_full.load(std::memory_order_relaxed);
+    s.tx_bytes = g_vendor.tx_bytes.load(std::memory_order_relaxed);
+    s.tx_buffers = g_vendor.tx_buffers.load(std::memory_order_relaxed);
+    s.tx_ring_full = g_vendor.tx_ring_full.load(std::memory_order_relaxed);
+    return s;
+}
+
+void UsbDevice::VendorResetStats() {
+    g_vendor.rx_bytes.store(0, std::memory_order_relaxed);
+    g_vendor.rx_buffers.store(0, std::memory_order_relaxed);
+    g_vendor.rx_ring_full.store(0, std::memory_order_relaxed);
+    g_vendor.tx_bytes.store(0, std::memory_order_relaxed);
+    g_vendor.tx_buffers.store(0, std::memory_order_relaxed);
+    g_vendor.tx_ring_full.store(0, std::memory_order_relaxed);
+}
+
+#endif // USB_VENDOR_ENABLED
+
 //--------------------------------------------------------------------+
 // MSC методы
 //--------------------------------------------------------------------+
@@ -280,27 +1478,245 @@ void UsbDevice::CdcResetTerminalFlag() {
 #ifdef USB_MSC_ENABLED
 
 void UsbDevice::MscAttach(IBlockDevice* device) {
-    msc_device_ = device;
-    g_msc_device = device;
-    g_msc_ejected = false;
+    if (device == nullptr) {
+        MscDetach();
+        return;
+    }
+    MscAttachBinding(MscBinding<IBlockDevice>::Bind(*device));
+}
+
+void UsbDevice::MscAttachBinding(const MscBindingState& binding) {
+    // Ждём окончания текущей операции задачи хранилища
+    ScopedLock lock(MscMutex());
+    PortState& port = Port(config_.rhport);
+    port.msc_device.store(nullptr, std::memory_order_release);
+    port.msc_binding = binding;
+    port.msc_binding.RefreshGeometry();  // Не готово — перечитается в READ CAPACITY
+    msc_device_ = binding.device;
+    port.msc_device.store(&port.msc_binding, std::memory_order_release);
+    port.msc_ejected.store(false, std::memory_order_relaxed);
+    port.msc_media_changed.store(false, std::memory_order_relaxed);
 }
 
 void UsbDevice::MscDetach() {
+    // После возврата устройство больше не используется
+    ScopedLock lock(MscMutex());
     msc_device_ = nullptr;
-    g_msc_device = nullptr;
+    Port(config_.rhport).msc_device.store(nullptr, std::memory_order_release);
 }
 
 bool UsbDevice::MscIsBusy() const {
     // Реальная проверка занятости через атомарный счётчик операций
-    return g_msc_ops_count.load(std::memory_order_relaxed) > 0;
+    return Port(config_.rhport).msc_ops_count.load(std::memory_order_relaxed) > 0;
 }
 
 void UsbDevice::MscEject() {
-    g_msc_ejected = true;
+    Port(config_.rhport).msc_ejected.store(true, std::memory_order_relaxed);
+}
+
+void UsbDevice::MscMediaChanged() {
+    Port(config_.rhport).msc_media_changed.store(true, std::memory_order_release);
+}
+
+void UsbDevice::MscInsert() {
+    PortState& port = Port(config_.rhport);
+    port.msc_media_changed.store(true, std::memory_order_release);
+    port.msc_ejected.store(false, std::memory_order_release);
+}
+
+void UsbDevice::MscSetEjectCallback(MscEjectCallback callback, void* context) {
+    ScopedLock lock(CallbackMutex());
+    PortState& port = Port(config_.rhport);
+    port.msc_eject_callback = callback;
+    port.msc_eject_context = context;
+}
+
+uint32_t MscTraceFormatCsv(const MscTraceEntry& entry, char* out, size_t out_size) {
+    int len = snprintf(out, out_size, "%lu,0x%02X,%lu,%u,%u,%lu\n",
+                       static_cast<unsigned long>(entry.timestamp_us), entry.opcode,
+                       static_cast<unsigned long>(entry.lba), entry.blocks,
+                       static_cast<unsigned>(entry.status),
+                       static_cast<unsigned long>(entry.latency_us));
+    if (len <= 0 || static_cast<size_t>(len) >= out_size) {
+        return 0;
+    }
+    return static_cast<uint32_t>(len);
+}
+
+MscStats UsbDevice::MscGetStats(uint8_t lun) const {
+    const MscLunCounters& c = MscCounters(lun);
+    auto load = [](const std::atomic<uint32_t>& v) { return v.load(std::memory_order_relaxed); };
+    
+    MscStats s;
+    s.commands = load(c.commands);
+    s.read_commands = load(c.read_commands);
+    s.write_commands = load(c.write_commands);
+    s.blocks_read = load(c.blocks_read);
+    s.blocks_written = load(c.blocks_written);
+    s.sequential_reads = load(c.sequential_reads);
+    s.random_reads = load(c.random_reads);
+    s.sequential_writes = load(c.sequential_writes);
+    s.random_writes = load(c.random_writes);
+    s.read_errors = load(c.read_errors);
+    s.write_errors = load(c.write_errors);
+    s.not_ready = load(c.not_ready);
+    for (uint32_t i = 0; i < 16; i++) {
+        s.sense_count[i] = load(c.sense_count[i]);
+    }
+    uint32_t last_sense = load(c.last_sense);
+    s.last_sense_key = static_cast<uint8_t>(last_sense >> 16);
+    s.last_sense_asc = static_cast<uint8_t>(last_sense >> 8);
+    s.last_sense_ascq = static_cast<uint8_t>(last_sense);
+    c.read_latency.Snapshot(s.read_latency);
+    c.write_latency.Snapshot(s.write_latency);
+    return s;
+}
+
+uint32_t UsbDevice::MscTraceSnapshot(MscTraceEntry* out, uint32_t max_entries) const {
+#ifdef USB_MSC_TRACE_ENABLED
+    return g_msc_trace.Snapshot(out, max_entries);
+#else
+    (void)out;
+    (void)max_entries;
+    return 0;
+#endif
+}
+
+uint32_t UsbDevice::MscTraceTotal() const {
+#ifdef USB_MSC_TRACE_ENABLED
+    return g_msc_trace.TotalCount();
+#else
+    return 0;
+#endif
+}
+
+void UsbDevice::MscTraceClear() {
+#ifdef USB_MSC_TRACE_ENABLED
+    g_msc_trace.Clear();
+#endif
+}
+
+bool UsbDevice::MscTraceDump(MscTraceWriteFn write, void* context) const {
+#ifdef USB_MSC_TRACE_ENABLED
+    if (write == nullptr) {
+        return false;
+    }
+    if (!write(kMscTraceCsvHeader, sizeof(kMscTraceCsvHeader) - 1, context)) {
+        return false;
+    }
+    
+    // По одной записи: без копии всего кольца на стеке
+    uint32_t total = g_msc_trace.TotalCount();
+    uint32_t first = total - g_msc_trace.Count();
+    char line[64];
+    for (uint32_t seq = first; seq < total; seq++) {
+        MscTraceEntry entry;
+        if (!g_msc_trace.At(seq, &entry)) {
+            continue;  // Затёрта новой командой во время выгрузки
+        }
+        uint32_t len = MscTraceFormatCsv(entry, line, sizeof(line));
+        if (!write(line, len, context)) {
+            return false;
+        }
+    }
+    return true;
+#else
+    (void)write;
+    (void)context;
+    return false;
+#endif
+}
+
+#ifdef USB_CDC_ENABLED
+bool UsbDevice::MscTraceDumpCdc() {
+    if (!initialized_) {
+        return false;
+    }
+    return MscTraceDump([](const char* data, uint32_t len, void* context) {
+        return CdcWriteAll(*static_cast<UsbDevice*>(context),
+                           reinterpret_cast<const uint8_t*>(data), len);
+    }, this);
+}
+#endif
+
+void UsbDevice::MscResetStats() {
+    for (auto& c : g_msc_stats) {
+        c.Reset();
+    }
 }
 
 #endif // USB_MSC_ENABLED
 
+#ifdef USB_DFU_ENABLED
+//--------------------------------------------------------------------+
+// DFU методы
+//--------------------------------------------------------------------+
+
+/// Приёмник образа порта device стека (для callbacks)
+static DfuFlash* DfuTarget() {
+    ScopedLock lock(CallbackMutex());
+    return DevicePort().dfu_target;
+}
+
+void UsbDevice::DfuAttach(DfuFlash& target) {
+    target.SetFinishCallback([](dfu::Status status, void*) {
+        tud_dfu_finish_flashing(static_cast<uint8_t>(status));
+    });
+    ScopedLock lock(CallbackMutex());
+    Port(config_.rhport).dfu_target = &target;
+}
+
+void UsbDevice::DfuDetach() {
+    ScopedLock lock(CallbackMutex());
+    Port(config_.rhport).dfu_target = nullptr;
+}
+
+void UsbDevice::DfuPoll() {
+    if (!initialized_) return;
+    PortState& port = Port(config_.rhport);
+    DfuFlash* target;
+    {
+        ScopedLock lock(CallbackMutex());
+        target = port.dfu_target;
+    }
+    if (target != nullptr) {
+        target->Poll();
+    }
+
+    if (port.dfu_reconnecting) {
+        if (EventNowMs() - port.dfu_disconnect_ms >= USB_DFU_RECONNECT_MS) {
+            port.dfu_reconnecting = false;
+            tud_connect();
+        }
+        return;
+    }
+    const uint8_t request = port.dfu_switch.exchange(kDfuSwitchNone, std::memory_order_acquire);
+    if (request == kDfuSwitchNone || (request == kDfuSwitchEnter) == g_descriptors.dfu_mode) {
+        return;
+    }
+    // Хост перечитает дескрипторы после переподключения: другой PID и состав интерфейсов
+    tud_disconnect();
+    g_descriptors.dfu_mode = request == kDfuSwitchEnter;
+    port.dfu_disconnect_ms = EventNowMs();
+    port.dfu_reconnecting = true;
+}
+
+void UsbDevice::DfuEnterMode() {
+    Port(config_.rhport).dfu_switch.store(kDfuSwitchEnter, std::memory_order_release);
+}
+
+void UsbDevice::DfuLeaveMode() {
+    Port(config_.rhport).dfu_switch.store(kDfuSwitchLeave, std::memory_order_release);
+}
+
+bool UsbDevice::DfuIsActive() const {
+    const PortState& port = Port(config_.rhport);
+    const uint8_t request = port.dfu_switch.load(std::memory_order_relaxed);
+    return request == kDfuSwitchNone ? g_descriptors.dfu_mode : request == kDfuSwitchEnter;
+}
+
+#endif // USB_DFU_ENABLED
+
 }  // namespace usb
 
 //--------------------------------------------------------------------+
@@ -313,14 +1729,23 @@ __attribute__((weak))
 void InitUsbGpio() {
 #if defined(STM32H7) || defined(STM32H743xx) || defined(STM32H750xx)
     GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    
+    if (g_init_rhport == 1) {
+        // OTG_HS со встроенным FS PHY: PB14 = USB_DM, PB15 = USB_DP
+        __HAL_RCC_GPIOB_CLK_ENABLE();
+        GPIO_InitStruct.Pin = GPIO_PIN_14 | GPIO_PIN_15;
+        GPIO_InitStruct.Alternate = 12;  // AF12 = OTG1_FS
+        HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+        return;
+    }
     
     __HAL_RCC_GPIOA_CLK_ENABLE();
     
     // PA11 = USB_DM, PA12 = USB_DP
     GPIO_InitStruct.Pin = GPIO_PIN_11 | GPIO_PIN_12;
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
     GPIO_InitStruct.Alternate = 10;  // AF10 = OTG_FS
     HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 #endif
@@ -345,6 +1770,17 @@ void InitUsbClock() {
     // Включаем USB Voltage Detector
     HAL_PWREx_EnableUSBVoltageDetector();
     
+    if (g_init_rhport == 1) {
+        // OTG_HS без внешнего ULPI PHY: ULPI не тактируем в sleep
+        __HAL_RCC_USB1_OTG_HS_CLK_ENABLE();
+        __HAL_RCC_USB1_OTG_HS_ULPI_CLK_SLEEP_DISABLE();
+        
+        __HAL_RCC_USB1_OTG_HS_FORCE_RESET();
+        HAL_Delay(2);
+        __HAL_RCC_USB1_OTG_HS_RELEASE_RESET();
+        return;
+    }
+    
     // Включаем тактирование USB OTG FS
     __HAL_RCC_USB2_OTG_FS_CLK_ENABLE();
     
@@ -357,11 +1793,7 @@ void InitUsbClock() {
 __attribute__((weak))
 void InitUsbOtg() {
 #if defined(STM32H7) || defined(STM32H743xx) || defined(STM32H750xx)
-    #ifdef USB2_OTG_FS_PERIPH_BASE
-    USB_OTG_GlobalTypeDef* USBx = (USB_OTG_GlobalTypeDef*)(USB2_OTG_FS_PERIPH_BASE);
-    #else
-    USB_OTG_GlobalTypeDef* USBx = (USB_OTG_GlobalTypeDef*)(0x40080000UL);
-    #endif
+    USB_OTG_GlobalTypeDef* USBx = (USB_OTG_GlobalTypeDef*)UsbOtgBase(g_init_rhport);
     
     // Disable VBUS sensing
     USBx->GCCFG &= ~USB_OTG_GCCFG_VBDEN;
@@ -378,16 +1810,33 @@ void InitUsbOtg() {
 __attribute__((weak))
 void InitUsbNvic() {
 #if defined(STM32H7) || defined(STM32H743xx) || defined(STM32H750xx)
-    HAL_NVIC_SetPriority(OTG_FS_IRQn, 5, 0);
-    HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+    IRQn_Type irq = g_init_rhport == 1 ? OTG_HS_IRQn : OTG_FS_IRQn;
+    HAL_NVIC_SetPriority(irq, 5, 0);
+    HAL_NVIC_EnableIRQ(irq);
+#endif
+}
+
+/// UID чипа (96 бит) для серийного номера; false — UID нет, серийный номер USB_STR_SERIAL
+__attribute__((weak))
+bool UsbReadChipUid(uint32_t uid[3]) {
+#if defined(STM32H7) || defined(STM32H743xx) || defined(STM32H750xx)
+    uid[0] = HAL_GetUIDw0();
+    uid[1] = HAL_GetUIDw1();
+    uid[2] = HAL_GetUIDw2();
+    return true;
+#else
+    (void)uid;
+    return false;
 #endif
 }
 
+#ifdef USB_COMPOSITE_HAS_HAL
 // SysTick Handler (weak — можно переопределить в проекте)
 __attribute__((weak))
 void SysTick_Handler(void) {
     HAL_IncTick();
 }
+#endif
 
 } // extern "C" for Init functions
 
@@ -458,22 +1907,109 @@ uint32_t board_millis(void) {
 #endif
 }
 
+// Suspend/resume шины (tud_task, DCD_EVENT_SUSPEND / DCD_EVENT_RESUME)
+void tud_suspend_cb(bool remote_wakeup_en) {
+    (void)remote_wakeup_en;
+    usb::BusSuspendChanged(true);
+}
+
+void tud_resume_cb(void) {
+    usb::BusSuspendChanged(false);
+}
+
 // USB IRQ Handlers — без weak чтобы гарантировать работу из коробки
 // Если нужно переопределить — закомментируйте USB_COMPOSITE_OWN_IRQ_HANDLERS
 #if defined(STM32H7) || defined(STM32H743xx) || defined(STM32H750xx)
 #ifndef USB_COMPOSITE_OWN_IRQ_HANDLERS
 
 void OTG_FS_IRQHandler(void) {
-    tud_int_handler(0);
+    usb::UsbDevice::HandleInterrupt(0);
 }
 
 void OTG_HS_IRQHandler(void) {
-    tud_int_handler(0);
+    usb::UsbDevice::HandleInterrupt(1);
 }
 
 #endif // USB_COMPOSITE_OWN_IRQ_HANDLERS
 #endif
 
+//--------------------------------------------------------------------+
+// Vendor Callbacks
+//--------------------------------------------------------------------+
+
+#ifdef USB_VENDOR_ENABLED
+
+void tud_vendor_rx_cb(uint8_t itf) {
+    (void)itf;
+    usb::VendorPumpRx();
+}
+
+void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes) {
+    (void)itf;
+    (void)sent_bytes;
+    usb::VendorPumpTx();
+}
+
+#endif // USB_VENDOR_ENABLED
+
+//--------------------------------------------------------------------+
+// DFU Callbacks
+//--------------------------------------------------------------------+
+
+#ifdef USB_DFU_ENABLED
+
+// DFU_DETACH в рабочей конфигурации (класс DFU runtime)
+void tud_dfu_runtime_reboot_to_dfu_cb(void) {
+    usb::DevicePort().dfu_switch.store(usb::kDfuSwitchEnter, std::memory_order_release);
+}
+
+// DFU_DETACH в режиме DFU (bitWillDetach): вернуться в рабочую конфигурацию
+void tud_dfu_detach_cb(void) {
+    usb::DevicePort().dfu_switch.store(usb::kDfuSwitchLeave, std::memory_order_release);
+}
+
+uint32_t tud_dfu_get_timeout_cb(uint8_t alt, uint8_t state) {
+    (void)alt;
+    usb::DfuFlash* target = usb::DfuTarget();
+    return target != nullptr ? target->GetPollTimeoutMs(static_cast<usb::dfu::State>(state)) : 0;
+}
+
+void tud_dfu_download_cb(uint8_t alt, uint16_t block_num, uint8_t const* data, uint16_t length) {
+    (void)alt;
+    usb::DfuFlash* target = usb::DfuTarget();
+    if (target == nullptr) {
+        tud_dfu_finish_flashing(DFU_STATUS_ERR_TARGET);
+        return;
+    }
+    target->Download(block_num, data, length);
+}
+
+void tud_dfu_manifest_cb(uint8_t alt) {
+    (void)alt;
+    usb::DfuFlash* target = usb::DfuTarget();
+    if (target == nullptr) {
+        tud_dfu_finish_flashing(DFU_STATUS_ERR_TARGET);
+        return;
+    }
+    target->Manifest();
+}
+
+uint16_t tud_dfu_upload_cb(uint8_t alt, uint16_t block_num, uint8_t* data, uint16_t length) {
+    (void)alt;
+    usb::DfuFlash* target = usb::DfuTarget();
+    return target != nullptr ? target->Upload(block_num, data, length) : 0;
+}
+
+void tud_dfu_abort_cb(uint8_t alt) {
+    (void)alt;
+    usb::DfuFlash* target = usb::DfuTarget();
+    if (target != nullptr) {
+        target->Abort();
+    }
+}
+
+#endif // USB_DFU_ENABLED
+
 //--------------------------------------------------------------------+
 // CDC Callbacks
 //--------------------------------------------------------------------+
@@ -484,12 +2020,30 @@ void tud_cdc_rx_cb(uint8_t itf) {
     (void)itf;
     
 #ifdef USB_CDC_ENABLED
-    // Вызываем callback если установлен
-    if (usb::g_cdc_rx_callback != nullptr && tud_cdc_available()) {
+    usb::CdcRxCallback callback;
+    void* context;
+    {
+        usb::ScopedLock lock(usb::CallbackMutex());
+        const usb::PortState& port = usb::DevicePort();
+        callback = port.cdc_rx_callback;
+        context = port.cdc_rx_context;
+#ifdef USB_RPC_ENABLED
+        if (port.rpc_server != nullptr) {
+            callback = nullptr;  // Данные ждут RpcPoll() в FIFO
+        }
+#endif
+    }
+    
+    // Вызываем callback если установлен (вне мьютексов — он может писать в CDC)
+    if (callback != nullptr) {
         uint8_t buf[64];
-        uint32_t count = tud_cdc_read(buf, sizeof(buf));
+        uint32_t count;
+        {
+            usb::ScopedLock lock(usb::CdcMutex());
+            count = tud_cdc_available() ? tud_cdc_read(buf, sizeof(buf)) : 0;
+        }
         if (count > 0) {
-            usb::g_cdc_rx_callback(buf, count, usb::g_cdc_rx_context);
+            callback(buf, count, context);
         }
     }
 #else
@@ -503,11 +2057,29 @@ void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const* p_line_coding)
 #ifdef USB_CDC_ENABLED
     uint32_t baudrate = p_line_coding->bit_rate;
     
+    usb::DfuJumpCallback dfu_callback;
+    void* dfu_context;
+    usb::CdcLineCodingCallback lc_callback;
+    void* lc_context;
+    usb::PortState& port = usb::DevicePort();
+    {
+        usb::ScopedLock lock(usb::CallbackMutex());
+        dfu_callback = port.dfu_callback;
+        dfu_context = port.dfu_context;
+        lc_callback = port.cdc_lc_callback;
+        lc_context = port.cdc_lc_context;
+    }
+    
     // 1200 bps = Magic baud rate для DFU
     if (baudrate == usb::kDfuBaudrate) {
-        // Вызываем DFU callback если установлен, иначе встроенный jump
-        if (usb::g_dfu_callback != nullptr) {
-            usb::g_dfu_callback(usb::g_dfu_context);
+        // Вызываем DFU callback если установлен, иначе встроенный DFU или jump
+        if (dfu_callback != nullptr) {
+            dfu_callback(dfu_context);
+#ifdef USB_DFU_ENABLED
+        } else if (usb::DfuTarget() != nullptr) {
+            // Переподключение в режиме DFU из DfuPoll() (ответ SET_LINE_CODING уйдёт раньше)
+            port.dfu_switch.store(usb::kDfuSwitchEnter, std::memory_order_release);
+#endif
         } else {
             // Встроенный переход в DFU bootloader
             #if defined(STM32H7) || defined(STM32H743xx) || defined(STM32H750xx)
@@ -516,12 +2088,12 @@ void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const* p_line_coding)
         }
     } else {
         // Любой другой baudrate = терминал открылся
-        usb::g_terminal_opened = true;
+        port.terminal_opened.store(true, std::memory_order_relaxed);
     }
     
     // Вызываем пользовательский callback (если установлен)
-    if (usb::g_cdc_lc_callback != nullptr) {
-        usb::g_cdc_lc_callback(baudrate, usb::g_cdc_lc_context);
+    if (lc_callback != nullptr) {
+        lc_callback(baudrate, lc_context);
     }
 #endif
 }
@@ -566,13 +2138,26 @@ bool tud_msc_test_unit_ready_cb(uint8_t lun) {
     (void)lun;
     
 #ifdef USB_MSC_ENABLED
-    if (usb::g_msc_ejected) {
-        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+    usb::PortState& port = usb::DevicePort();
+    if (port.msc_ejected.load(std::memory_order_relaxed)) {
+        usb::MscFail(usb::MscCounters(lun), usb::MscCounters(lun).not_ready);
+        usb::MscSetSense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+        return false;
+    }
+    
+    // UNIT ATTENTION: TinyUSB сохраняет sense, выставленный в callback TUR
+    // (ошибка READ10/WRITE10 всегда превращается в "носитель отсутствует")
+    if (port.msc_media_changed.exchange(false, std::memory_order_acq_rel)) {
+        usb::MscFail(usb::MscCounters(lun), usb::MscCounters(lun).not_ready);
+        usb::MscSetSense(lun, SCSI_SENSE_UNIT_ATTENTION, 0x28, 0x00);
         return false;
     }
     
-    if (usb::g_msc_device == nullptr || !usb::g_msc_device->IsReady()) {
-        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+    usb::ScopedLock lock(usb::MscMutex());
+    usb::MscBindingState* device = port.msc_device.load(std::memory_order_acquire);
+    if (device == nullptr || !device->IsReady()) {
+        usb::MscFail(usb::MscCounters(lun), usb::MscCounters(lun).not_ready);
+        usb::MscSetSense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
         return false;
     }
     
@@ -584,19 +2169,24 @@ bool tud_msc_test_unit_ready_cb(uint8_t lun) {
 
 void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size) {
 #ifdef USB_MSC_ENABLED
-    if (usb::g_msc_device != nullptr && usb::g_msc_device->IsReady()) {
-        *block_count = usb::g_msc_device->GetBlockCount();
-        *block_size = static_cast<uint16_t>(usb::g_msc_device->GetBlockSize());
+    usb::ScopedLock lock(usb::MscMutex());
+    usb::MscBindingState* device = usb::DevicePort().msc_device.load(std::memory_order_acquire);
+    // Хост читает ёмкость после смены носителя — обновляем кэш геометрии
+    if (device != nullptr && device->RefreshGeometry()) {
+        *block_count = device->block_count;
+        *block_size = static_cast<uint16_t>(device->block_size);
         
         // Дополнительная проверка: если block_count == 0, это ошибка
         if (*block_count == 0) {
-            tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+            usb::MscCounters(lun).command_failed = true;
+            usb::MscSetSense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
         }
     } else {
         // Устройство не готово - устанавливаем sense для корректной обработки Windows
         *block_count = 0;
         *block_size = 512;
-        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+        usb::MscCounters(lun).command_failed = true;
+        usb::MscSetSense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
     }
 #else
     (void)lun;
@@ -612,35 +2202,51 @@ bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition,
     
 #ifdef USB_MSC_ENABLED
     if (load_eject) {
-        usb::g_msc_ejected = !start;
+        // Извлечение: отложенные записи (журнал) — на носитель до ответа хосту
+        if (!start && !usb::MscDeviceSync()) {
+            usb::MscFail(usb::MscCounters(lun), usb::MscCounters(lun).write_errors);
+            usb::MscSetSense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+            return false;
+        }
+        usb::MscEjectCallback callback;
+        void* context;
+        {
+            usb::ScopedLock lock(usb::CallbackMutex());
+            usb::PortState& port = usb::DevicePort();
+            port.msc_ejected.store(!start, std::memory_order_relaxed);
+            callback = port.msc_eject_callback;
+            context = port.msc_eject_context;
+        }
+        if (callback != nullptr) {
+            callback(start, context);
+        }
     }
 #endif
     
     return true;
 }
 
+// TinyUSB: бит WP в MODE SENSE, WRITE10 отвечается DATA PROTECT без вызова write10_cb
+bool tud_msc_is_writable_cb(uint8_t lun) {
+    (void)lun;
+    
+#ifdef USB_MSC_ENABLED
+    usb::ScopedLock lock(usb::MscMutex());
+    usb::MscBindingState* device = usb::DevicePort().msc_device.load(std::memory_order_acquire);
+    return device == nullptr || device->IsWritable();
+#else
+    return true;
+#endif
+}
+
 int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, 
                           void* buffer, uint32_t bufsize) {
     (void)lun;
     (void)offset;
     
 #ifdef USB_MSC_ENABLED
-    if (usb::g_msc_device == nullptr || !usb::g_msc_device->IsReady() || usb::g_msc_ejected) {
-        return -1;
-    }
-    
-    // RAII-guard для отслеживания занятости
-    usb::MscBusyGuard busy_guard;
-    
-    uint32_t block_size = usb::g_msc_device->GetBlockSize();
-    uint32_t block_count = bufsize / block_size;
-    if (block_count == 0) return 0;
-    
-    if (!usb::g_msc_device->Read(lba, static_cast<uint8_t*>(buffer), block_count)) {
-        return -1;
-    }
-    
-    return static_cast<int32_t>(bufsize);
+    usb::MscBeginCommand(lun, false, lba);
+    return usb::MscTransfer(lun, false, lba, static_cast<uint8_t*>(buffer), bufsize);
 #else
     return -1;
 #endif
@@ -652,22 +2258,8 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
     (void)offset;
     
 #ifdef USB_MSC_ENABLED
-    if (usb::g_msc_device == nullptr || !usb::g_msc_device->IsReady() || usb::g_msc_ejected) {
-        return -1;
-    }
-    
-    // RAII-guard для отслеживания занятости
-    usb::MscBusyGuard busy_guard;
-    
-    uint32_t block_size = usb::g_msc_device->GetBlockSize();
-    uint32_t block_count = bufsize / block_size;
-    if (block_count == 0) return 0;
-    
-    if (!usb::g_msc_device->Write(lba, buffer, block_count)) {
-        return -1;
-    }
-    
-    return static_cast<int32_t>(bufsize);
+    usb::MscBeginCommand(lun, true, lba);
+    return usb::MscTransfer(lun, true, lba, buffer, bufsize);
 #else
     return -1;
 #endif
@@ -678,10 +2270,41 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16],
     (void)buffer;
     (void)bufsize;
     
+#ifdef USB_MSC_ENABLED
+    // SYNCHRONIZE CACHE (10): Windows и Linux шлют перед извлечением и по fsync
+    constexpr uint8_t kSynchronizeCache10 = 0x35;
+    if (scsi_cmd[0] == kSynchronizeCache10) {
+        if (usb::MscDeviceSync()) {
+            return 0;
+        }
+        usb::MscFail(usb::MscCounters(lun), usb::MscCounters(lun).write_errors);
+        usb::MscSetSense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+        return -1;
+    }
+    usb::MscCounters(lun).command_failed = true;
+    usb::MscSetSense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+#else
+    (void)scsi_cmd;
     tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+#endif
     return -1;
 }
 
+#ifdef USB_MSC_ENABLED
+// Завершение команд (после CSW) — учёт в статистике и трассе
+void tud_msc_read10_complete_cb(uint8_t lun) {
+    usb::MscEndCommand(lun, false);
+}
+
+void tud_msc_write10_complete_cb(uint8_t lun) {
+    usb::MscEndCommand(lun, true);
+}
+
+void tud_msc_scsi_complete_cb(uint8_t lun, uint8_t const scsi_cmd[16]) {
+    usb::MscEndOtherCommand(lun, scsi_cmd[0]);
+}
+#endif
+
 #endif // CFG_TUD_MSC
 
 } // extern "C"
@@ -0,0 +1,178 @@
+/**
+ * @file usb_descriptors.cpp
+ * @brief USB дескрипторы для Composite Device (CDC + MSC + Vendor)
+ * 
+ * Дескрипторы собираются при компиляции (usb_descriptors.h) в зависимости от флагов:
+ * - USB_CDC_ENABLED: добавляет CDC интерфейсы
+ * - USB_MSC_ENABLED: добавляет MSC интерфейс
+ * - USB_VENDOR_ENABLED: добавляет vendor интерфейс, BOS и набор MS OS 2.0
+ * - USB_DFU_ENABLED: добавляет интерфейс DFU runtime и отдельную конфигурацию
+ *   DFU mode (только интерфейс DFU, PID USB_DFU_PID) — её отдают callbacks,
+ *   пока usb::desc::Runtime().dfu_mode (UsbDevice::DfuEnterMode())
+ * 
+ * Номера интерфейсов и endpoint'ов назначает билдер, бюджет endpoint'ов
+ * и FIFO проверяется static_assert. VID/PID и строки берутся из
+ * usb::desc::Runtime() — их заполняет UsbDevice::Init() из usb::Config.
+ */
+
+#include "usb_descriptors.h"
+
+#ifdef USB_DFU_ENABLED
+#include "usb_dfu.h"
+#endif
+
+extern "C" {
+#include "tusb.h"
+}
+
+namespace desc = usb::desc;
+
+//--------------------------------------------------------------------+
+// Состав конфигурации
+//--------------------------------------------------------------------+
+
+#ifdef USB_CDC_ENABLED
+using CdcFunction = desc::Cdc<desc::kStrCdc>;
+#else
+using CdcFunction = desc::None;
+#endif
+
+#ifdef USB_MSC_ENABLED
+using MscFunction = desc::Msc<desc::kStrMsc>;
+#else
+using MscFunction = desc::None;
+#endif
+
+#ifdef USB_VENDOR_ENABLED
+using VendorFunction = desc::Vendor<desc::kStrVendor, CFG_TUD_VENDOR_EPSIZE>;
+#else
+using VendorFunction = desc::None;
+#endif
+
+#ifdef USB_DFU_ENABLED
+static constexpr uint8_t kDfuAttributes =
+    usb::dfu::kAttrCanDownload | usb::dfu::kAttrCanUpload |
+    usb::dfu::kAttrManifestationTolerant | usb::dfu::kAttrWillDetach;
+
+using DfuRuntimeFunction = desc::Dfu<desc::kStrDfu, desc::kDfuProtocolRuntime, kDfuAttributes,
+                                     USB_DFU_TRANSFER_SIZE>;
+using DfuModeFunction = desc::Dfu<desc::kStrDfu, desc::kDfuProtocolMode, kDfuAttributes,
+                                  USB_DFU_TRANSFER_SIZE>;
+#else
+using DfuRuntimeFunction = desc::None;
+#endif
+
+using Composite =
+    desc::Configuration<CdcFunction, MscFunction, VendorFunction, DfuRuntimeFunction>;
+
+static constexpr desc::DeviceParams MakeDeviceParams() {
+    desc::DeviceParams params;
+    params.vid = USB_VID;
+    params.pid = USB_PID;
+    params.bcd_usb = USB_BCD;
+    params.ep0_size = CFG_TUD_ENDPOINT0_SIZE;
+    return params;
+}
+
+//--------------------------------------------------------------------+
+// Device и Configuration дескрипторы (flash)
+//--------------------------------------------------------------------+
+
+static constexpr auto kDeviceDescriptor = desc::BuildDevice<Composite>(MakeDeviceParams());
+static constexpr auto kConfigDescriptor = Composite::Build();
+
+#ifdef USB_DFU_ENABLED
+// Режим DFU: один интерфейс, bcdUSB 2.0 (без BOS — WinUSB для DFU ставит Zadig/libwdi)
+using DfuMode = desc::Configuration<DfuModeFunction>;
+
+static constexpr desc::DeviceParams MakeDfuDeviceParams() {
+    desc::DeviceParams params = MakeDeviceParams();
+    params.pid = USB_DFU_PID;
+    params.bcd_usb = 0x0200;
+    return params;
+}
+
+static constexpr auto kDfuDeviceDescriptor = desc::BuildDevice<DfuMode>(MakeDfuDeviceParams());
+static constexpr auto kDfuConfigDescriptor = DfuMode::Build();
+#endif
+
+#ifdef USB_VENDOR_ENABLED
+//--------------------------------------------------------------------+
+// BOS и Microsoft OS 2.0 (WinUSB без INF)
+//--------------------------------------------------------------------+
+
+static_assert(USB_BCD >= 0x0210, "BOS requires bcdUSB 2.1 (USB_BCD)");
+static_assert(desc::IsGuidString(USB_VENDOR_GUID), "USB_VENDOR_GUID: {XXXXXXXX-XXXX-...}");
+
+static constexpr size_t kVendorFunction = 2;  // Индекс VendorFunction в Composite
+using VendorMsOs20 = desc::MsOs20Set<Composite, kVendorFunction>;
+
+static constexpr auto kMsOs20Set = VendorMsOs20::Build(USB_VENDOR_GUID);
+static constexpr auto kBosDescriptor =
+    desc::BuildBos(static_cast<uint16_t>(VendorMsOs20::kLength), USB_MS_VENDOR_CODE);
+#endif
+
+extern "C" {
+
+uint8_t const* tud_descriptor_device_cb(void) {
+    // VID/PID из usb::Config (UsbDevice::Init)
+    static std::array<uint8_t, desc::kDeviceLength> device{};
+    const desc::RuntimeDescriptors& runtime = desc::Runtime();
+#ifdef USB_DFU_ENABLED
+    if (runtime.dfu_mode) {
+        // VID из Config, PID режима DFU — из сборки
+        device = desc::WithIds(kDfuDeviceDescriptor, runtime.vid, USB_DFU_PID);
+        return device.data();
+    }
+#endif
+    device = desc::WithIds(kDeviceDescriptor, runtime.vid, runtime.pid);
+    return device.data();
+}
+
+uint8_t const* tud_descriptor_configuration_cb(uint8_t index) {
+    (void)index;
+#ifdef USB_DFU_ENABLED
+    if (desc::Runtime().dfu_mode) {
+        return kDfuConfigDescriptor.data();
+    }
+#endif
+    return kConfigDescriptor.data();
+}
+
+#ifdef USB_VENDOR_ENABLED
+uint8_t const* tud_descriptor_bos_cb(void) {
+#ifdef USB_DFU_ENABLED
+    if (desc::Runtime().dfu_mode) {
+        return nullptr;  // bcdUSB 2.0 в режиме DFU: BOS не запрашивается
+    }
+#endif
+    return kBosDescriptor.data();
+}
+
+// Vendor запрос набора MS OS 2.0; остальные vendor запросы — STALL
+bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage,
+                                tusb_control_request_t const* request) {
+    if (stage != CONTROL_STAGE_SETUP) {
+        return true;
+    }
+    if (request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR &&
+        request->bRequest == USB_MS_VENDOR_CODE &&
+        request->wIndex == desc::kMsOs20DescriptorIndex) {
+        return tud_control_xfer(rhport, request, const_cast<uint8_t*>(kMsOs20Set.data()),
+                                static_cast<uint16_t>(kMsOs20Set.size()));
+    }
+    return false;
+}
+#endif
+
+//--------------------------------------------------------------------+
+// String Descriptors
+//--------------------------------------------------------------------+
+
+// Дескрипторы готовы заранее (UsbDevice::Init), здесь только выбор по индексу
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    (void)langid;
+    return desc::Runtime().strings.Get(index);
+}
+
+}  // extern "C"
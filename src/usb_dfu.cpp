@@ -0,0 +1,222 @@
+/**
+ * @file usb_dfu.cpp
+ * @brief Приём образа DFU и двойная буферизация записи во flash
+ */
+
+#include "usb_dfu.h"
+
+#ifdef USB_DFU_ENABLED
+
+#include <cstring>
+
+namespace usb {
+
+//--------------------------------------------------------------------+
+// DfuFlash: приём блоков
+//--------------------------------------------------------------------+
+
+DfuFlash::DfuFlash(ports::IFlash& flash, const DfuConfig& config)
+    : flash_(flash), config_(config), writer_(flash) {
+    ready_ = writer_.CheckRegion(&config_.app_address, &config_.app_size);
+}
+
+void DfuFlash::Download(uint16_t block, const uint8_t* data, uint16_t len) {
+    Lock();
+    pending_ = Pending::Block;
+    pending_block_ = block;
+    pending_data_ = data;
+    pending_len_ = len;
+    TryPending();
+    if (pending_ == Pending::Block) {
+        stats_.buffer_waits++;  // Оба буфера заняты: finish придёт из Poll()
+    }
+    Unlock();
+    Deliver();
+}
+
+void DfuFlash::Manifest() {
+    Lock();
+    if (!session_) {
+        Finish(dfu::Status::ErrNotDone);
+    } else {
+        pending_ = Pending::Manifest;
+        TryPending();
+    }
+    Unlock();
+    Deliver();
+}
+
+uint16_t DfuFlash::Upload(uint16_t block, uint8_t* data, uint16_t len) {
+    Lock();
+    writer_.Drain();  // Читать то, что уже подтверждено хосту
+    const uint64_t offset = static_cast<uint64_t>(block) * len;
+    uint16_t count = 0;
+    if (ready_ && offset < config_.app_size) {
+        const uint64_t left = config_.app_size - offset;
+        count = static_cast<uint16_t>(left < len ? left : len);
+        if (!flash_.Read(config_.app_address + static_cast<uint32_t>(offset), data, count)) {
+            count = 0;
+        }
+    }
+    stats_.uploads++;
+    Unlock();
+    return count;
+}
+
+void DfuFlash::Abort() {
+    Lock();
+    writer_.Reset();
+    pending_ = Pending::None;
+    session_ = false;
+    tail_ = false;
+    stats_.aborts++;
+    Unlock();
+}
+
+void DfuFlash::Poll() {
+    Lock();
+    TryPending();
+    Unlock();
+    Deliver();
+}
+
+uint32_t DfuFlash::GetPollTimeoutMs(dfu::State state) const {
+    if (state == dfu::State::Manifest) {
+        return IsBusy() ? config_.busy_timeout_ms : config_.poll_timeout_ms;
+    }
+    // Блок займёт свободный буфер сразу или будет ждать программирования/стирания
+    return writer_.IsFull() ? config_.busy_timeout_ms : config_.poll_timeout_ms;
+}
+
+bool DfuFlash::Accept(uint16_t block, const uint8_t* data, uint16_t len, dfu::Status* status) {
+    if (!ready_) {
+        *status = dfu::Status::ErrTarget;
+        return true;
+    }
+    if (block == 0) {
+        // Новый образ: блоки прошлого уже подтверждены хосту — сначала дописать их
+        if (!writer_.IsIdle()) {
+            return false;
+        }
+        StartSession();
+    }
+    if (writer_.HasFailed()) {
+        *status = Failure();
+        return true;
+    }
+    if (!session_ || block != next_block_ || tail_ || len == 0 ||
+        len > config_.app_size - offset_) {
+        stats_.sequence_errors++;
+        *status = dfu::Status::ErrAddress;
+        return true;
+    }
+    const uint32_t program_unit = writer_.GetProgramUnit();
+    const uint32_t size = (len + program_unit - 1) / program_unit * program_unit;
+    uint8_t* buffer = writer_.Push(config_.app_address + offset_, size);
+    if (buffer == nullptr) {
+        return false;  // Оба буфера заняты
+    }
+    std::memcpy(buffer, data, len);
+    std::memset(buffer + len, 0xFF, size - len);
+
+    offset_ += len;
+    next_block_ = static_cast<uint16_t>(block + 1);
+    tail_ = len % program_unit != 0;  // Короткий блок — только последним
+    stats_.blocks++;
+    stats_.bytes += len;
+
+    writer_.Pump();  // Запустить flash до ответа: хост уже передаёт следующий блок
+    *status = dfu::Status::Ok;
+    return true;
+}
+
+void DfuFlash::TryPending() {
+    writer_.Pump();
+    if (pending_ == Pending::Block) {
+        dfu::Status status;
+        if (Accept(pending_block_, pending_data_, pending_len_, &status)) {
+            pending_ = Pending::None;
+            Finish(status);
+        }
+    } else if (pending_ == Pending::Manifest) {
+        if (writer_.HasFailed()) {
+            pending_ = Pending::None;
+            Finish(Failure());
+        } else if (writer_.IsIdle()) {
+            pending_ = Pending::None;
+            session_ = false;
+            manifest_done_ = true;
+            Finish(dfu::Status::Ok);
+        }
+    }
+}
+
+void DfuFlash::StartSession() {
+    session_ = true;
+    tail_ = false;
+    next_block_ = 0;
+    offset_ = 0;
+    writer_.NewSession();
+}
+
+dfu::Status DfuFlash::Failure() const {
+    switch (writer_.GetFailure()) {
+        case FlashWriter::Op::None:    return dfu::Status::Ok;
+        case FlashWriter::Op::Erase:   return dfu::Status::ErrErase;
+        case FlashWriter::Op::Program: return dfu::Status::ErrProg;
+    }
+    return dfu::Status::ErrUnknown;
+}
+
+void DfuFlash::Finish(dfu::Status status) {
+    finished_ = true;
+    finished_status_ = status;
+}
+
+void DfuFlash::Deliver() {
+    Lock();
+    const bool finished = finished_;
+    const dfu::Status status = finished_status_;
+    const bool complete = manifest_done_;
+    finished_ = false;
+    manifest_done_ = false;
+    Unlock();
+
+    // Вне мьютекса: tud_dfu_finish_flashing и переход в приложение
+    if (finished && finish_callback_ != nullptr) {
+        finish_callback_(status, finish_context_);
+    }
+    if (complete && complete_callback_ != nullptr) {
+        complete_callback_(complete_context_);
+    }
+}
+
+DfuStats DfuFlash::GetStats() const {
+    DfuStats stats = stats_;
+    const FlashWriterStats flash = writer_.GetStats();
+    stats.sectors_erased = flash.sectors_erased;
+    stats.programs = flash.programs;
+    stats.flash_errors = flash.flash_errors;
+    return stats;
+}
+
+void DfuFlash::ResetStats() {
+    stats_ = DfuStats{};
+    writer_.ResetStats();
+}
+
+void DfuFlash::Lock() {
+    if (mutex_ != nullptr) {
+        mutex_->Lock();
+    }
+}
+
+void DfuFlash::Unlock() {
+    if (mutex_ != nullptr) {
+        mutex_->Unlock();
+    }
+}
+
+}  // namespace usb
+
+#endif  // USB_DFU_ENABLED
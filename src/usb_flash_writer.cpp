@@ -0,0 +1,186 @@
+/**
+ * @file usb_flash_writer.cpp
+ * @brief Конвейер записи во flash: стирание по требованию и наперёд, программирование
+ */
+
+#include "usb_flash_writer.h"
+
+#if (defined(USB_MSC_ENABLED) && defined(USB_UF2_ENABLED)) || defined(USB_DFU_ENABLED)
+
+#include <cstring>
+
+namespace usb {
+
+FlashWriter::FlashWriter(ports::IFlash& flash, uint32_t chunk_size, Chunk* ring, uint32_t depth,
+                         uint32_t* erased, uint32_t max_sectors)
+    : flash_(flash), chunk_size_(chunk_size), max_sectors_(max_sectors), ring_(ring),
+      depth_(depth), erased_(erased) {
+    flash_base_ = flash_.GetBaseAddress();
+    sector_size_ = flash_.GetSectorSize();
+    program_unit_ = flash_.GetProgramUnit();
+}
+
+bool FlashWriter::CheckRegion(uint32_t* address, uint32_t* size) const {
+    const uint32_t flash_end = flash_base_ + flash_.GetSize();
+    if (*address == 0) {
+        *address = flash_base_;
+    }
+    if (*size == 0 && *address < flash_end) {
+        *size = flash_end - *address;
+    }
+
+    // Область прошивки — целые секторы: стирание не заденет загрузчик и данные за ней
+    return sector_size_ != 0 && program_unit_ != 0 && chunk_size_ % program_unit_ == 0 &&
+           *address >= flash_base_ && *size != 0 && *size <= flash_end - *address &&
+           (*address - flash_base_) % sector_size_ == 0 && *size % sector_size_ == 0 &&
+           flash_.GetSize() / sector_size_ <= max_sectors_;
+}
+
+uint8_t* FlashWriter::Push(uint32_t address, uint32_t size) {
+    if (failure_ != Op::None || count_ == depth_ || size == 0 || size > chunk_size_) {
+        return nullptr;
+    }
+    Chunk& chunk = ring_[(head_ + count_) % depth_];
+    chunk.address = address;
+    chunk.size = size;
+    count_++;
+    return chunk.data;
+}
+
+void FlashWriter::SetEraseAhead(uint32_t first, uint32_t last) {
+    ahead_ = true;
+    ahead_first_ = first;
+    ahead_last_ = last;
+}
+
+void FlashWriter::NewSession() {
+    failure_ = Op::None;
+    std::memset(erased_, 0, (max_sectors_ + 31) / 32 * sizeof(uint32_t));
+}
+
+void FlashWriter::Reset() {
+    if (op_ != Op::None) {
+        flash_.Wait();
+        op_ = Op::None;
+    }
+    head_ = 0;
+    count_ = 0;
+    ahead_ = false;
+    NewSession();
+}
+
+bool FlashWriter::StartNext() {
+    if (failure_ != Op::None) {
+        return false;
+    }
+
+    bool ahead = false;
+    uint32_t erase = UINT32_MAX;
+    if (count_ > 0) {
+        // Кусок может задеть два сектора, если сектор не кратен куску
+        const Chunk& chunk = ring_[head_];
+        const uint32_t first = SectorOf(chunk.address);
+        const uint32_t last = SectorOf(chunk.address + chunk.size - 1);
+        for (uint32_t sector = first; sector <= last; sector++) {
+            if (!SectorErased(sector)) {
+                erase = sector;
+                break;
+            }
+        }
+        if (erase == UINT32_MAX) {
+            if (!flash_.StartProgram(chunk.address, chunk.data, chunk.size)) {
+                Fail(Op::Program);
+                return false;
+            }
+            op_ = Op::Program;
+            return true;
+        }
+    } else if (ahead_) {
+        // Flash простаивает в ожидании хоста — стереть следующий сектор образа
+        for (uint32_t sector = ahead_first_; sector <= ahead_last_; sector++) {
+            if (!SectorErased(sector)) {
+                erase = sector;
+                ahead = true;
+                break;
+            }
+        }
+    }
+
+    if (erase == UINT32_MAX) {
+        return false;
+    }
+    if (!flash_.StartErase(erase)) {
+        Fail(Op::Erase);
+        return false;
+    }
+    op_ = Op::Erase;
+    op_sector_ = erase;
+    op_ahead_ = ahead;
+    return true;
+}
+
+void FlashWriter::CompleteOp(ports::FlashStatus status) {
+    if (op_ == Op::None || status == ports::FlashStatus::Busy) {
+        return;
+    }
+    const Op op = op_;
+    op_ = Op::None;
+    if (status == ports::FlashStatus::Error) {
+        Fail(op);
+        return;
+    }
+    if (op == Op::Erase) {
+        erased_[op_sector_ / 32] |= 1u << (op_sector_ % 32);
+        stats_.sectors_erased++;
+        stats_.erase_ahead += op_ahead_ ? 1 : 0;
+    } else {
+        head_ = (head_ + 1) % depth_;
+        count_--;
+        stats_.programs++;
+    }
+}
+
+void FlashWriter::Fail(Op op) {
+    failure_ = op;
+    stats_.flash_errors++;
+    head_ = 0;
+    count_ = 0;  // Остаток образа не пишется: владелец сообщит об ошибке хосту
+}
+
+void FlashWriter::Pump() {
+    for (;;) {
+        if (op_ != Op::None) {
+            const ports::FlashStatus status = flash_.Poll();
+            if (status == ports::FlashStatus::Busy) {
+                return;
+            }
+            CompleteOp(status);
+        }
+        if (!StartNext()) {
+            return;
+        }
+    }
+}
+
+bool FlashWriter::Step() {
+    if (op_ == Op::None && !StartNext()) {
+        return false;
+    }
+    CompleteOp(flash_.Wait());
+    return failure_ == Op::None;
+}
+
+bool FlashWriter::Drain() {
+    while (failure_ == Op::None) {
+        if (op_ != Op::None) {
+            CompleteOp(flash_.Wait());
+        } else if (count_ == 0 || !StartNext()) {
+            break;
+        }
+    }
+    return failure_ == Op::None;
+}
+
+}  // namespace usb
+
+#endif  // (USB_MSC_ENABLED && USB_UF2_ENABLED) || USB_DFU_ENABLED
@@ -0,0 +1,534 @@
+/**
+ * @file usb_journal.cpp
+ * @brief Кольцевой журнал записи, таблица "блок → слот" и перенос на место
+ */
+
+#include "usb_journal.h"
+
+#ifdef USB_JOURNAL_ENABLED
+
+#include <cstring>
+
+namespace usb {
+
+/// Заголовок разметки (последний блок устройства)
+static constexpr char kMagic[8] = {'U', 'S', 'B', 'J', 'R', 'N', 'L', '1'};
+static constexpr uint32_t kHeaderBlocks = 1;
+
+/// Описатель записи: блок перед её данными
+static constexpr char kRecordMagic[8] = {'U', 'S', 'B', 'J', 'R', 'E', 'C', '1'};
+/// Блоков данных в записи: описатель и данные собираются в copy_
+static constexpr uint32_t kRecordBlocks = USB_JOURNAL_COPY_BLOCKS - 1;
+/// Байт описателя под его контрольной суммой
+static constexpr uint32_t kRecordBytes = 36;
+
+/// Поля описателя
+struct Record {
+    uint32_t seq;
+    uint32_t lba;
+    uint32_t count;      ///< 0 — отметка хвоста без данных
+    uint32_t checksum;   ///< Данных
+    uint32_t tail;       ///< Хвост журнала после этой записи
+    uint32_t tail_seq;
+};
+
+static void Put32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+static uint32_t Get32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/// FNV-1a: недописанная запись не совпадёт с описателем
+static uint32_t Checksum(const uint8_t* data, uint32_t size) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/// Описатель в блоке слота slot; false — в слоте данные или мусор
+static bool ParseRecord(const uint8_t* block, uint32_t slot, uint32_t capacity,
+                        uint32_t data_count, Record* record) {
+    if (std::memcmp(block, kRecordMagic, sizeof(kRecordMagic)) != 0 ||
+        Get32(block + 12) != slot || Get32(block + kRecordBytes) != Checksum(block, kRecordBytes)) {
+        return false;
+    }
+    record->seq = Get32(block + 8);
+    record->lba = Get32(block + 16);
+    record->count = Get32(block + 20);
+    record->checksum = Get32(block + 24);
+    record->tail = Get32(block + 28);
+    record->tail_seq = Get32(block + 32);
+    return record->count <= kRecordBlocks && record->tail < capacity &&
+           (record->count == 0 ||
+            (record->lba < data_count && record->count <= data_count - record->lba));
+}
+
+bool JournalBlockDevice::Layout() {
+    const uint32_t blocks =
+        config_.journal_blocks < kMaxSlots ? config_.journal_blocks : kMaxSlots;
+    if (!device_.IsReady() || device_.GetBlockSize() != kBlockSize || blocks == 0 ||
+        device_.GetBlockCount() <= blocks + kHeaderBlocks) {
+        return false;
+    }
+    if (config_.compact_blocks == 0 || config_.compact_blocks > USB_JOURNAL_BATCH) {
+        config_.compact_blocks = USB_JOURNAL_BATCH;
+    }
+    // Запись с описателями и запасом под отметку — в половину журнала
+    const uint32_t direct_max = blocks / 2 != 0 ? blocks / 2 : 1;
+    if (config_.direct_blocks == 0 || config_.direct_blocks > direct_max) {
+        config_.direct_blocks = direct_max;
+    }
+    data_count_ = device_.GetBlockCount() - blocks - kHeaderBlocks;
+    capacity_ = blocks;
+    head_ = 0;
+    tail_ = 0;
+    used_ = 0;
+    seq_ = 0;
+    tail_seq_ = 0;
+    stale_ = 0;
+    head_unsure_ = false;
+    map_.Clear();
+    return true;
+}
+
+void JournalBlockDevice::BuildHeader() {
+    std::memset(copy_, 0, kBlockSize);
+    std::memcpy(copy_, kMagic, sizeof(kMagic));
+    Put32(copy_ + 8, device_.GetBlockCount());
+    Put32(copy_ + 12, data_count_);
+    Put32(copy_ + 16, capacity_);
+}
+
+bool JournalBlockDevice::Open() {
+    Lock();
+    opened_ = false;
+    bool ok = Layout();
+    if (ok) {
+        // Ожидаемый заголовок — первый блок copy_, прочитанный — второй
+        BuildHeader();
+        ok = device_.Read(data_count_ + capacity_, copy_ + kBlockSize, 1) &&
+             std::memcmp(copy_, copy_ + kBlockSize, kBlockSize) == 0 && Replay();
+    }
+    opened_ = ok;
+    Unlock();
+    return ok;
+}
+
+bool JournalBlockDevice::Format() {
+    Lock();
+    opened_ = false;
+    bool ok = Layout();
+    if (ok) {
+        // Описатели прежней разметки Open() принял бы за записи
+        std::memset(copy_, 0, sizeof(copy_));
+        for (uint32_t first = 0; ok && first < capacity_; first += USB_JOURNAL_COPY_BLOCKS) {
+            const uint32_t n = capacity_ - first < USB_JOURNAL_COPY_BLOCKS
+                                   ? capacity_ - first : USB_JOURNAL_COPY_BLOCKS;
+            ok = device_.Write(data_count_ + first, copy_, n);
+        }
+        BuildHeader();
+        ok = ok && device_.Write(data_count_ + capacity_, copy_, 1) && device_.Sync();
+    }
+    opened_ = ok;
+    Unlock();
+    return ok;
+}
+
+bool JournalBlockDevice::Replay() {
+    // Самая новая запись знает хвост: записи от него до неё идут подряд
+    Record newest{};
+    bool found = false;
+    for (uint32_t first = 0; first < capacity_; first += USB_JOURNAL_COPY_BLOCKS) {
+        const uint32_t n = capacity_ - first < USB_JOURNAL_COPY_BLOCKS
+                               ? capacity_ - first : USB_JOURNAL_COPY_BLOCKS;
+        if (!device_.Read(data_count_ + first, copy_, n)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            Record record;
+            if (ParseRecord(copy_ + i * kBlockSize, first + i, capacity_, data_count_, &record) &&
+                (!found || record.seq > newest.seq)) {
+                newest = record;
+                found = true;
+            }
+        }
+    }
+    if (!found) {
+        return true;  // Журнал пуст с Format()
+    }
+
+    head_ = newest.tail;
+    tail_ = newest.tail;
+    seq_ = newest.tail_seq;
+    tail_seq_ = newest.tail_seq;
+    for (;;) {
+        Record record;
+        if (!device_.Read(data_count_ + head_, copy_, 1)) {
+            return false;
+        }
+        if (!ParseRecord(copy_, head_, capacity_, data_count_, &record) || record.seq != seq_ ||
+            record.count >= capacity_ - used_) {
+            return true;  // Конец цепочки: дальше слоты прежних кругов
+        }
+        const uint32_t data_slot = (head_ + 1) % capacity_;
+        if (record.count != 0 &&
+            !ReadSlots(data_slot, copy_ + kBlockSize, record.count)) {
+            return false;
+        }
+        if (Checksum(copy_ + kBlockSize, record.count * kBlockSize) != record.checksum) {
+            return true;  // Недописанная запись: хост не получил по ней GOOD
+        }
+        slot_lba_[head_] = kDescriptor;
+        Commit(record.lba, record.count, data_slot);
+        head_ = (head_ + 1 + record.count) % capacity_;
+        used_ += 1 + record.count;
+        seq_++;
+    }
+}
+
+//--------------------------------------------------------------------+
+// IBlockDevice
+//--------------------------------------------------------------------+
+
+bool JournalBlockDevice::Read(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    if (!opened_ || lba >= data_count_ || count > data_count_ - lba) {
+        return false;
+    }
+    Lock();
+    if (used_ == 0) {
+        const bool ok = device_.Read(lba, buffer, count);
+        Unlock();
+        return ok;
+    }
+
+    // Серии подряд из одного источника — одной командой
+    const bool ok = map_.ReadRuns(lba, count, [&](uint32_t i, uint32_t slot, uint32_t run) {
+        const uint32_t from = slot == kNone ? lba + i : data_count_ + slot;
+        return device_.Read(from, buffer + i * kBlockSize, run);
+    });
+    Unlock();
+    return ok;
+}
+
+bool JournalBlockDevice::Write(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    if (!opened_ || lba >= data_count_ || count > data_count_ - lba) {
+        return false;
+    }
+    Lock();
+    bool ok;
+    if (count >= config_.direct_blocks) {
+        ok = WriteDirect(lba, buffer, count);
+    } else {
+        // Данные и описатель на каждые kRecordBlocks блоков; слот про запас — под отметку
+        const uint32_t slots = count + (count + kRecordBlocks - 1) / kRecordBlocks;
+        ok = true;
+        while (ok && capacity_ - used_ < slots + 2) {
+            stats_.foreground_compactions++;
+            ok = Compact(config_.compact_blocks);
+        }
+        // Слоты перенесённых записей занимаются после отметки с новым хвостом:
+        // недописанная запись не порвёт цепочку, от которой начнёт Open()
+        if (ok && capacity_ - used_ - stale_ < slots + 1) {
+            ok = Checkpoint();
+        }
+        ok = ok && Append(lba, buffer, count);
+    }
+    if (!ok) {
+        stats_.errors++;
+    }
+    Unlock();
+    return ok;
+}
+
+bool JournalBlockDevice::Sync() {
+    if (!opened_) {
+        return false;
+    }
+    Lock();
+    bool ok = true;
+    while (ok && used_ != 0) {
+        ok = Compact(config_.compact_blocks);
+    }
+    // Отметка: Open() не станет повторять перенесённое
+    if (ok && (stale_ != 0 || head_unsure_)) {
+        ok = Checkpoint();
+    }
+    ok = ok && device_.Sync();
+    if (!ok) {
+        stats_.errors++;
+    }
+    Unlock();
+    return ok;
+}
+
+bool JournalBlockDevice::Poll() {
+    if (!opened_) {
+        return true;
+    }
+    Lock();
+    if (used_ != 0 && used_ * 100 >= capacity_ * config_.compact_percent &&
+        !Compact(config_.compact_blocks)) {
+        stats_.errors++;
+    }
+    const bool empty = used_ == 0;
+    Unlock();
+    return empty;
+}
+
+//--------------------------------------------------------------------+
+// Запись
+//--------------------------------------------------------------------+
+
+bool JournalBlockDevice::ReadSlots(uint32_t slot, uint8_t* buffer, uint32_t count) {
+    const uint32_t first = count < capacity_ - slot ? count : capacity_ - slot;
+    return device_.Read(data_count_ + slot, buffer, first) &&
+           (first == count ||
+            device_.Read(data_count_, buffer + first * kBlockSize, count - first));
+}
+
+bool JournalBlockDevice::WriteSlots(uint32_t slot, const uint8_t* buffer, uint32_t count) {
+    const uint32_t first = count < capacity_ - slot ? count : capacity_ - slot;
+    return device_.Write(data_count_ + slot, buffer, first) &&
+           (first == count ||
+            device_.Write(data_count_, buffer + first * kBlockSize, count - first));
+}
+
+void JournalBlockDevice::Commit(uint32_t lba, uint32_t count, uint32_t slot) {
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t to = (slot + i) % capacity_;
+        Entry* entry = map_.Find(lba + i);
+        if (entry->lba == lba + i) {
+            slot_lba_[entry->slot] = kNone;  // Старая копия остаётся в журнале до хвоста
+        }
+        entry->lba = lba + i;
+        entry->slot = to;
+        slot_lba_[to] = lba + i;
+    }
+}
+
+bool JournalBlockDevice::Journaled(uint32_t lba, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (map_.SlotOf(lba + i) != kNone) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JournalBlockDevice::Replayable(uint32_t lba, uint32_t count) const {
+    // Перенесённые слоты хранят LBA до следующей записи
+    const uint32_t first = (tail_ + capacity_ - stale_) % capacity_;
+    for (uint32_t i = 0; i < stale_; i++) {
+        if (slot_lba_[(first + i) % capacity_] - lba < count) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JournalBlockDevice::WriteRecord(uint32_t lba, const uint8_t* data, uint32_t count) {
+    // Перенесённые данные — на носитель раньше описателя, который их отпускает
+    if (stale_ != 0 && !device_.Sync()) {
+        return false;
+    }
+    // Отметка в пустом журнале сразу за хвостом: Open() начнёт после неё
+    const bool consumed = count == 0 && used_ == 0;
+
+    std::memset(copy_, 0, kBlockSize);
+    std::memcpy(copy_, kRecordMagic, sizeof(kRecordMagic));
+    Put32(copy_ + 8, seq_);
+    Put32(copy_ + 12, head_);
+    Put32(copy_ + 16, lba);
+    Put32(copy_ + 20, count);
+    Put32(copy_ + 24, Checksum(data, count * kBlockSize));
+    Put32(copy_ + 28, consumed ? (head_ + 1) % capacity_ : tail_);
+    Put32(copy_ + 32, consumed ? seq_ + 1 : tail_seq_);
+    Put32(copy_ + kRecordBytes, Checksum(copy_, kRecordBytes));
+    if (count != 0) {
+        std::memcpy(copy_ + kBlockSize, data, count * kBlockSize);
+    }
+    // Описатель и данные — одной командой (голова у конца кольца — двумя)
+    if (!WriteSlots(head_, copy_, 1 + count)) {
+        head_unsure_ = true;
+        return false;  // Слоты не заняты, таблица прежняя
+    }
+
+    slot_lba_[head_] = kDescriptor;
+    Commit(lba, count, (head_ + 1) % capacity_);
+    head_ = (head_ + 1 + count) % capacity_;
+    seq_++;
+    if (consumed) {
+        tail_ = head_;
+        tail_seq_ = seq_;
+    } else {
+        used_ += 1 + count;
+    }
+    stale_ = 0;
+    head_unsure_ = false;
+    return true;
+}
+
+bool JournalBlockDevice::Checkpoint() {
+    return WriteRecord(0, nullptr, 0);
+}
+
+bool JournalBlockDevice::Append(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    uint32_t done = 0;
+    while (done < count) {
+        const uint32_t run = count - done < kRecordBlocks ? count - done : kRecordBlocks;
+        if (!WriteRecord(lba + done, buffer + done * kBlockSize, run)) {
+            return false;
+        }
+        done += run;
+    }
+    stats_.journal_writes++;
+    stats_.journal_blocks += count;
+    return true;
+}
+
+bool JournalBlockDevice::WriteDirect(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    // Старые копии — сначала на место, а хвост на носителе — за ними:
+    // иначе Open() после сброса восстановит их поверх этой записи
+    while (used_ != 0 && Journaled(lba, count)) {
+        stats_.foreground_compactions++;
+        if (!Compact(config_.compact_blocks)) {
+            return false;
+        }
+    }
+    if ((head_unsure_ || Replayable(lba, count)) && !Checkpoint()) {
+        return false;
+    }
+    if (!device_.Write(lba, buffer, count)) {
+        return false;
+    }
+    stats_.direct_writes++;
+    return true;
+}
+
+//--------------------------------------------------------------------+
+// Перенос
+//--------------------------------------------------------------------+
+
+bool JournalBlockDevice::Compact(uint32_t max_slots) {
+    // Целые записи: хвост в заголовке всегда на описателе
+    uint32_t slots = 0;
+    uint32_t records = 0;
+    uint32_t live = 0;
+    while (slots < used_) {
+        uint32_t length = 1;
+        while (slots + length < used_ &&
+               slot_lba_[(tail_ + slots + length) % capacity_] != kDescriptor) {
+            length++;
+        }
+        if (records != 0 && slots + length > max_slots) {
+            break;
+        }
+
+        // Живые слоты порции, сортировка вставками по LBA
+        for (uint32_t i = slots + 1; i < slots + length; i++) {
+            const uint32_t slot = (tail_ + i) % capacity_;
+            const uint32_t lba = slot_lba_[slot];
+            if (lba == kNone) {
+                continue;
+            }
+            uint32_t pos = live++;
+            while (pos > 0 && batch_[pos - 1].lba > lba) {
+                batch_[pos] = batch_[pos - 1];
+                pos--;
+            }
+            batch_[pos].lba = lba;
+            batch_[pos].slot = slot;
+        }
+        slots += length;
+        records++;
+    }
+
+    if (!WriteBack(batch_, live)) {
+        return false;  // Хвост на месте, повтор с той же порции
+    }
+
+    // Хвост на носитель несёт следующая запись; до неё Open() повторит эти — те же данные
+    for (uint32_t i = 0; i < live; i++) {
+        map_.Erase(map_.Find(batch_[i].lba));
+    }
+    tail_ = (tail_ + slots) % capacity_;
+    tail_seq_ += records;
+    stale_ += slots;
+    used_ -= slots;  // Голова не сбрасывается: дозапись продолжает открытый блок стирания
+    stats_.compactions++;
+    stats_.compacted_blocks += live;
+    stats_.superseded_blocks += slots - records - live;
+    return true;
+}
+
+bool JournalBlockDevice::WriteBack(const Entry* batch, uint32_t count) {
+    uint32_t i = 0;
+    while (i < count) {
+        // Соседние LBA — одна запись на место; слоты подряд — одно чтение журнала
+        uint32_t run = 1;
+        while (i + run < count && run < USB_JOURNAL_COPY_BLOCKS &&
+               batch[i + run].lba == batch[i].lba + run) {
+            run++;
+        }
+        uint32_t k = 0;
+        while (k < run) {
+            uint32_t chunk = 1;
+            while (k + chunk < run && batch[i + k + chunk].slot == batch[i + k].slot + chunk) {
+                chunk++;
+            }
+            if (!device_.Read(data_count_ + batch[i + k].slot, copy_ + k * kBlockSize, chunk)) {
+                return false;
+            }
+            k += chunk;
+        }
+        if (!device_.Write(batch[i].lba, copy_, run)) {
+            return false;
+        }
+        i += run;
+    }
+    return true;
+}
+
+uint32_t JournalBlockDevice::GetJournalUsed() const {
+    Lock();
+    const uint32_t used = used_;
+    Unlock();
+    return used;
+}
+
+JournalStats JournalBlockDevice::GetStats() const {
+    Lock();
+    JournalStats stats = stats_;
+    Unlock();
+    return stats;
+}
+
+void JournalBlockDevice::ResetStats() {
+    Lock();
+    stats_ = JournalStats{};
+    Unlock();
+}
+
+void JournalBlockDevice::Lock() const {
+    if (mutex_ != nullptr) {
+        mutex_->Lock();
+    }
+}
+
+void JournalBlockDevice::Unlock() const {
+    if (mutex_ != nullptr) {
+        mutex_->Unlock();
+    }
+}
+
+}  // namespace usb
+
+#endif  // USB_JOURNAL_ENABLED
@@ -0,0 +1,253 @@
+/**
+ * @file usb_partition.cpp
+ * @brief Разбор MBR/GPT и синтезированный MBR вида раздела
+ */
+
+#include "usb_partition.h"
+
+#ifdef USB_PARTITION_ENABLED
+
+#include <cstring>
+
+namespace usb {
+
+static void Put32(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+    p[2] = static_cast<uint8_t>(value >> 16);
+    p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+static uint32_t Get32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint64_t Get64(const uint8_t* p) {
+    return Get32(p) | (static_cast<uint64_t>(Get32(p + 4)) << 32);
+}
+
+/// CRC-32 (IEEE 802.3, отражённый) — только заголовок GPT в Open(), без таблицы
+static uint32_t Crc32(const uint8_t* data, uint32_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static bool HasBootSignature(const uint8_t* sector) {
+    return sector[part::kMbrBootSignatureOffset] == 0x55 &&
+           sector[part::kMbrBootSignatureOffset + 1] == 0xAA;
+}
+
+//--------------------------------------------------------------------+
+// Open: разбор таблицы
+//--------------------------------------------------------------------+
+
+bool PartitionBlockDevice::Open() {
+    Close();
+    info_ = PartitionInfo{};
+    if (!device_.IsReady() || device_.GetBlockSize() != kBlockSize) {
+        return false;
+    }
+
+    alignas(4) uint8_t sector[kBlockSize];
+    if (config_.block_count != 0) {
+        info_.first_lba = config_.first_lba;
+        info_.block_count = config_.block_count;
+    } else if (!FindPartition(sector)) {
+        return false;
+    }
+
+    const uint32_t device_count = device_.GetBlockCount();
+    if (info_.block_count == 0 || info_.first_lba >= device_count ||
+        info_.block_count > device_count - info_.first_lba) {
+        return false;
+    }
+
+    if (config_.view == PartitionView::Mbr) {
+        if (config_.view_offset == 0 || info_.block_count > UINT32_MAX - config_.view_offset) {
+            return false;
+        }
+        if (config_.mbr_type != 0) {
+            info_.mbr_type = config_.mbr_type;
+        } else if (info_.mbr_type == 0) {
+            info_.mbr_type = DetectType(sector);  // GPT или явные границы
+        }
+        data_lba_ = config_.view_offset;
+    } else {
+        data_lba_ = 0;
+    }
+
+    delta_ = info_.first_lba - data_lba_;
+    view_count_ = data_lba_ + info_.block_count;
+    opened_ = true;
+    return true;
+}
+
+bool PartitionBlockDevice::FindPartition(uint8_t* sector) {
+    if (!device_.Read(0, sector, 1) || !HasBootSignature(sector)) {
+        return false;
+    }
+
+    // Загрузочный сектор тома без таблицы тоже кончается 55 AA: у MBR флаг
+    // активности каждой записи — 0x00 или 0x80
+    bool gpt = false;
+    for (uint32_t i = 0; i < part::kMbrEntryCount; i++) {
+        const uint8_t* entry = sector + part::kMbrEntriesOffset + i * part::kMbrEntrySize;
+        if ((entry[0] & 0x7F) != 0) {
+            return false;
+        }
+        gpt |= entry[4] == part::kTypeGptProtective;
+    }
+    return gpt ? ParseGpt(sector) : ParseMbr(sector);
+}
+
+bool PartitionBlockDevice::ParseMbr(const uint8_t* sector) {
+    if (config_.index >= part::kMbrEntryCount) {
+        return false;
+    }
+    const uint8_t* entry =
+        sector + part::kMbrEntriesOffset + config_.index * part::kMbrEntrySize;
+    const uint8_t type = entry[4];
+    // Расширенный раздел — контейнер логических, не том
+    if (type == part::kTypeEmpty || type == 0x05 || type == 0x0F || type == 0x85) {
+        return false;
+    }
+    info_.scheme = PartitionScheme::Mbr;
+    info_.first_lba = Get32(entry + 8);
+    info_.block_count = Get32(entry + 12);
+    info_.mbr_type = type;
+    return true;
+}
+
+bool PartitionBlockDevice::ParseGpt(uint8_t* sector) {
+    if (!device_.Read(part::kGptHeaderLba, sector, 1) ||
+        std::memcmp(sector, "EFI PART", 8) != 0) {
+        return false;
+    }
+    const uint32_t header_size = Get32(sector + 12);
+    if (header_size < part::kGptHeaderMinSize || header_size > kBlockSize) {
+        return false;
+    }
+    const uint32_t header_crc = Get32(sector + 16);
+    Put32(sector + 16, 0);
+    if (Crc32(sector, header_size) != header_crc) {
+        return false;
+    }
+
+    const uint64_t entries_lba = Get64(sector + 72);
+    const uint32_t entry_count = Get32(sector + 80);
+    const uint32_t entry_size = Get32(sector + 84);
+    // Запись не пересекает границу блока: 128 * 2^n, не больше блока
+    if (entry_size < part::kGptEntryMinSize || entry_size > kBlockSize ||
+        kBlockSize % entry_size != 0 || config_.index >= entry_count) {
+        return false;
+    }
+    const uint32_t byte = config_.index * entry_size;
+    const uint64_t lba = entries_lba + byte / kBlockSize;
+    if (lba >= device_.GetBlockCount() || !device_.Read(static_cast<uint32_t>(lba), sector, 1)) {
+        return false;
+    }
+
+    const uint8_t* entry = sector + byte % kBlockSize;
+    bool used = false;
+    for (uint32_t i = 0; i < 16; i++) {
+        used |= entry[i] != 0;  // Нулевой GUID типа — пустая запись
+    }
+    const uint64_t first = Get64(entry + 32);
+    const uint64_t last = Get64(entry + 40);
+    if (!used || last < first || last > UINT32_MAX) {
+        return false;
+    }
+    info_.scheme = PartitionScheme::Gpt;
+    info_.first_lba = static_cast<uint32_t>(first);
+    info_.block_count = static_cast<uint32_t>(last - first + 1);
+    return true;
+}
+
+uint8_t PartitionBlockDevice::DetectType(uint8_t* sector) {
+    // Тип записи по загрузочному сектору тома; неформатированный — FAT32 LBA
+    if (!device_.Read(info_.first_lba, sector, 1) || !HasBootSignature(sector)) {
+        return part::kTypeFat32Lba;
+    }
+    if (std::memcmp(sector + 3, "EXFAT   ", 8) == 0 || std::memcmp(sector + 3, "NTFS    ", 8) == 0) {
+        return part::kTypeExfat;
+    }
+    if (std::memcmp(sector + 82, "FAT32", 5) == 0) {
+        return part::kTypeFat32Lba;
+    }
+    if (std::memcmp(sector + 54, "FAT12", 5) == 0) {
+        return part::kTypeFat12;
+    }
+    if (std::memcmp(sector + 54, "FAT", 3) == 0) {
+        return part::kTypeFat16Lba;
+    }
+    return part::kTypeFat32Lba;
+}
+
+//--------------------------------------------------------------------+
+// Синтезированная область вида Mbr
+//--------------------------------------------------------------------+
+
+void PartitionBlockDevice::HeaderSector(uint32_t lba, uint8_t* out) const {
+    std::memset(out, 0, kBlockSize);
+    if (lba != 0) {
+        return;  // Зазор до раздела
+    }
+    Put32(out + part::kMbrDiskSignatureOffset, config_.disk_signature);
+
+    // CHS не используются (FE FF FF — "только LBA")
+    uint8_t* entry = out + part::kMbrEntriesOffset;
+    entry[1] = 0xFE;
+    entry[2] = 0xFF;
+    entry[3] = 0xFF;
+    entry[4] = info_.mbr_type;
+    entry[5] = 0xFE;
+    entry[6] = 0xFF;
+    entry[7] = 0xFF;
+    Put32(entry + 8, data_lba_);
+    Put32(entry + 12, info_.block_count);
+
+    out[part::kMbrBootSignatureOffset] = 0x55;
+    out[part::kMbrBootSignatureOffset + 1] = 0xAA;
+}
+
+bool PartitionBlockDevice::ReadHeader(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    const uint32_t left = data_lba_ - lba;
+    const uint32_t header = count < left ? count : left;
+    for (uint32_t i = 0; i < header; i++) {
+        HeaderSector(lba + i, buffer + i * kBlockSize);
+    }
+    stats_.header_reads++;
+    if (header == count) {
+        return true;
+    }
+    return device_.Read(info_.first_lba, buffer + header * kBlockSize, count - header);
+}
+
+bool PartitionBlockDevice::WriteHeader(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    const uint32_t left = data_lba_ - lba;
+    const uint32_t header = count < left ? count : left;
+    alignas(4) uint8_t expected[kBlockSize];
+    for (uint32_t i = 0; i < header; i++) {
+        HeaderSector(lba + i, expected);
+        if (std::memcmp(buffer + i * kBlockSize, expected, kBlockSize) != 0) {
+            stats_.rejected_writes++;
+            return false;
+        }
+    }
+    stats_.header_writes++;
+    if (header == count) {
+        return true;
+    }
+    return device_.Write(info_.first_lba, buffer + header * kBlockSize, count - header);
+}
+
+}  // namespace usb
+
+#endif  // USB_PARTITION_ENABLED
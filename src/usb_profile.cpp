@@ -0,0 +1,95 @@
+/**
+ * @file usb_profile.cpp
+ * @brief Профилирование горячего пути USB — гистограммы и источник времени
+ */
+
+#include "usb_profile.h"
+
+#if defined(STM32H7) || defined(STM32H743xx) || defined(STM32H750xx)
+#include "stm32h7xx_hal.h"
+#define USB_PROFILE_HAS_DWT 1
+#else
+#include <chrono>
+#endif
+
+namespace usb {
+
+static LatencyHistogram g_histograms[kProbePointCount];
+static const ports::IClock* g_profile_clock = nullptr;
+
+#ifdef USB_PROFILE_HAS_DWT
+static bool g_dwt_enabled = false;
+
+/// Включение счётчика тактов DWT (Cortex-M7 требует снять блокировку LAR)
+static void EnableDwt() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    g_dwt_enabled = true;
+}
+#endif
+
+const char* ProbePointName(ProbePoint point) {
+    switch (point) {
+        case ProbePoint::MscRead:   return "msc_read10";
+        case ProbePoint::MscWrite:  return "msc_write10";
+        case ProbePoint::SdRead:    return "sd_read";
+        case ProbePoint::SdWrite:   return "sd_write";
+        case ProbePoint::TudTask:   return "tud_task";
+        case ProbePoint::CdcWrite:  return "cdc_write";
+        case ProbePoint::CdcFlush:  return "cdc_flush";
+        case ProbePoint::UsbWakeup: return "usb_wakeup";
+        default:                    return "?";
+    }
+}
+
+void ProfileSetClock(const ports::IClock* clock) {
+    g_profile_clock = clock;
+}
+
+uint32_t ProfileNowTicks() {
+    if (g_profile_clock != nullptr) {
+        return g_profile_clock->GetTickUs();
+    }
+#ifdef USB_PROFILE_HAS_DWT
+    if (!g_dwt_enabled) {
+        EnableDwt();
+    }
+    return DWT->CYCCNT;
+#else
+    using namespace std::chrono;
+    static const steady_clock::time_point origin = steady_clock::now();
+    return static_cast<uint32_t>(duration_cast<microseconds>(steady_clock::now() - origin).count());
+#endif
+}
+
+uint32_t ProfileTicksToUs(uint32_t ticks) {
+#ifdef USB_PROFILE_HAS_DWT
+    if (g_profile_clock == nullptr) {
+        uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+        return cycles_per_us == 0 ? ticks : ticks / cycles_per_us;
+    }
+#endif
+    return ticks;
+}
+
+void ProfileRecord(ProbePoint point, uint32_t us) {
+    uint32_t index = static_cast<uint32_t>(point);
+    if (index < kProbePointCount) {
+        g_histograms[index].Record(us);
+    }
+}
+
+const LatencyHistogram& ProfileGet(ProbePoint point) {
+    uint32_t index = static_cast<uint32_t>(point);
+    return g_histograms[index < kProbePointCount ? index : 0];
+}
+
+void ProfileReset() {
+    for (auto& histogram : g_histograms) {
+        histogram.Reset();
+    }
+}
+
+}  // namespace usb
@@ -0,0 +1,478 @@
+/**
+ * @file usb_rpc.cpp
+ * @brief Бинарный RPC: COBS кадры, CRC-16, диспетчер запросов
+ */
+
+#include "usb_rpc.h"
+
+#ifdef USB_RPC_ENABLED
+
+namespace usb::rpc {
+
+//--------------------------------------------------------------------+
+// CRC-16/CCITT-FALSE
+//--------------------------------------------------------------------+
+
+struct CrcTable {
+    uint16_t value[256];
+};
+
+static constexpr CrcTable MakeCrcTable() {
+    CrcTable table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint16_t crc = static_cast<uint16_t>(i << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021)
+                                 : static_cast<uint16_t>(crc << 1);
+        }
+        table.value[i] = crc;
+    }
+    return table;
+}
+
+static constexpr CrcTable kCrcTable = MakeCrcTable();
+
+static inline uint16_t CrcStep(uint16_t crc, uint8_t byte) {
+    return static_cast<uint16_t>((crc << 8) ^ kCrcTable.value[(crc >> 8) ^ byte]);
+}
+
+uint16_t Crc16(uint16_t crc, const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        crc = CrcStep(crc, data[i]);
+    }
+    return crc;
+}
+
+//--------------------------------------------------------------------+
+// FrameDecoder
+//--------------------------------------------------------------------+
+
+void FrameDecoder::Reset() {
+    length_ = 0;
+    crc_ = 0xFFFF;
+    block_left_ = 0;
+    zero_pending_ = false;
+    started_ = false;
+}
+
+void FrameDecoder::Emit(uint8_t byte) {
+    crc_ = CrcStep(crc_, byte);
+    if (length_ < capacity_) {
+        buffer_[length_] = byte;
+    }
+    length_++;
+}
+
+void FrameDecoder::Finish(FrameFn on_frame, void* context) {
+    if (!started_) {
+        return;  // 0x00 подряд — пустой кадр
+    }
+
+    Frame frame;
+    FrameResult result = FrameResult::Ok;
+    // block_left_ != 0 — разделитель посреди блока: байты потеряны
+    if (block_left_ != 0 || length_ < kOverhead || crc_ != 0) {
+        result = FrameResult::CrcError;
+    } else {
+        frame.id = static_cast<uint16_t>(buffer_[0] | (buffer_[1] << 8));
+        frame.method = buffer_[2];
+        frame.status = buffer_[3];
+        if (length_ > capacity_) {
+            result = FrameResult::TooLarge;
+        } else {
+            frame.payload = buffer_ + kHeaderSize;
+            frame.length = length_ - kOverhead;
+        }
+    }
+
+    Reset();
+    on_frame(frame, result, context);
+}
+
+void FrameDecoder::Feed(const uint8_t* data, uint32_t len, FrameFn on_frame, void* context) {
+    for (uint32_t i = 0; i < len; i++) {
+        const uint8_t byte = data[i];
+        if (byte == 0) {
+            Finish(on_frame, context);
+        } else if (block_left_ == 0) {
+            // Код нового блока: ноль, закрывший предыдущий блок, теперь известен
+            if (zero_pending_) {
+                Emit(0);
+            }
+            block_left_ = static_cast<uint8_t>(byte - 1);
+            zero_pending_ = byte != 0xFF;
+            started_ = true;
+        } else {
+            Emit(byte);
+            block_left_--;
+        }
+    }
+}
+
+//--------------------------------------------------------------------+
+// FrameWriter
+//--------------------------------------------------------------------+
+
+static constexpr uint32_t kCobsBlock = 254;
+
+void FrameWriter::Flush(bool delimiter) {
+    block_[0] = static_cast<uint8_t>(count_ + 1);
+    uint32_t len = count_ + 1;
+    if (delimiter) {
+        block_[len++] = 0x00;
+    }
+    if (ok_ && !write_(block_, len, context_)) {
+        ok_ = false;
+    }
+    bytes_out_ += len;
+    count_ = 0;
+}
+
+void FrameWriter::Put(uint8_t byte) {
+    if (byte == 0) {
+        Flush(false);
+        return;
+    }
+    block_[1 + count_++] = byte;
+    if (count_ == kCobsBlock) {
+        Flush(false);  // Код 0xFF: блок без завершающего нуля
+    }
+}
+
+bool FrameWriter::Begin(uint16_t id, uint8_t method, uint8_t status) {
+    if (write_ == nullptr) {
+        return false;
+    }
+    active_ = true;
+    ok_ = true;
+    count_ = 0;
+    crc_ = 0xFFFF;
+    const uint8_t header[kHeaderSize] = {static_cast<uint8_t>(id & 0xFF),
+                                         static_cast<uint8_t>(id >> 8), method, status};
+    return Write(header, kHeaderSize);
+}
+
+bool FrameWriter::Write(const void* data, uint32_t len) {
+    if (!active_) {
+        return false;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (uint32_t i = 0; i < len; i++) {
+        crc_ = CrcStep(crc_, bytes[i]);
+        Put(bytes[i]);
+    }
+    return ok_;
+}
+
+bool FrameWriter::End() {
+    if (!active_) {
+        return false;
+    }
+    Put(static_cast<uint8_t>(crc_ >> 8));
+    Put(static_cast<uint8_t>(crc_ & 0xFF));
+    Flush(true);
+    active_ = false;
+    return ok_;
+}
+
+void FrameWriter::Abort() {
+    if (!active_) {
+        return;
+    }
+    // Инверсный CRC: остаток у приёмника гарантированно не ноль
+    const uint16_t bad = static_cast<uint16_t>(~crc_);
+    Put(static_cast<uint8_t>(bad >> 8));
+    Put(static_cast<uint8_t>(bad & 0xFF));
+    Flush(true);
+    active_ = false;
+}
+
+//--------------------------------------------------------------------+
+// Responder
+//--------------------------------------------------------------------+
+
+void Responder::Reset(uint16_t id, uint8_t method) {
+    id_ = id;
+    method_ = method;
+    started_ = false;
+    done_ = false;
+}
+
+bool Responder::Open(Status status) {
+    started_ = true;
+    if (this == &server_->responder_ && server_->in_handler_) {
+        server_->handler_tx_.store(true);
+    }
+    if (!server_->writer_.Begin(id_, method_, static_cast<uint8_t>(status))) {
+        server_->stats_.tx_errors++;
+        return false;
+    }
+    return true;
+}
+
+bool Responder::Write(const void* data, uint32_t len) {
+    if (done_) {
+        return false;
+    }
+    if (!started_) {
+        if (!server_->LockTx()) {
+            return false;
+        }
+        if (!Open(Status::Ok)) {
+            return false;
+        }
+    }
+    if (!server_->writer_.Write(data, len)) {
+        server_->stats_.tx_errors++;
+        return false;
+    }
+    return true;
+}
+
+bool Responder::End() {
+    return Finish(Status::Ok);
+}
+
+bool Responder::Finish(Status status) {
+    if (done_) {
+        return false;
+    }
+    done_ = true;
+
+    if (!started_) {
+        // Пустой ответ: заголовок со статусом и CRC
+        if (!server_->LockTx()) {
+            return false;
+        }
+        if (!Open(status)) {
+            server_->UnlockTx();
+            return false;
+        }
+    } else if (status != Status::Ok) {
+        // Данные уже ушли со статусом Ok — оборвать кадр
+        server_->writer_.Abort();
+        server_->stats_.aborted++;
+        server_->UnlockTx();
+        return false;
+    }
+
+    const bool ok = server_->writer_.End();
+    if (ok) {
+        server_->stats_.responses++;
+    } else {
+        server_->stats_.tx_errors++;
+    }
+    server_->UnlockTx();
+    return ok;
+}
+
+//--------------------------------------------------------------------+
+// Server
+//--------------------------------------------------------------------+
+
+static Status PingHandler(const Request& request, Responder& response, void* /*context*/) {
+    return response.Write(request.payload, request.length) ? Status::Ok : Status::Failed;
+}
+
+Server::Server() : decoder_(frame_, kMaxFrame) {
+    responder_.server_ = this;
+    deferred_responder_.server_ = this;
+    deferred_responder_.done_ = true;
+}
+
+bool Server::Register(uint8_t method, Handler handler, void* context) {
+    if (method == kMethodPing || handler == nullptr) {
+        return false;
+    }
+    Entry* free_entry = nullptr;
+    for (Entry& entry : entries_) {
+        if (entry.handler != nullptr && entry.method == method) {
+            free_entry = &entry;
+            break;
+        }
+        if (entry.handler == nullptr && free_entry == nullptr) {
+            free_entry = &entry;
+        }
+    }
+    if (free_entry == nullptr) {
+        return false;
+    }
+    free_entry->method = method;
+    free_entry->handler = handler;
+    free_entry->context = context;
+    return true;
+}
+
+void Server::SetWriter(WriteFn write, void* context) {
+    writer_.SetSink(write, context);
+}
+
+const Server::Entry* Server::Find(uint8_t method) const {
+    for (const Entry& entry : entries_) {
+        if (entry.handler != nullptr && entry.method == method) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool Server::LockTx() {
+    if (mutex_ != nullptr) {
+        mutex_->Lock();
+    } else if (tx_busy_) {
+        return false;
+    }
+    tx_busy_ = true;
+    return true;
+}
+
+void Server::UnlockTx() {
+    tx_busy_ = false;
+    handler_tx_.store(false);
+    if (mutex_ != nullptr) {
+        mutex_->Unlock();
+    }
+}
+
+void Server::Feed(const uint8_t* data, uint32_t len) {
+    decoder_.Feed(data, len, &Server::OnFrame, this);
+}
+
+void Server::OnFrame(const Frame& frame, FrameResult result, void* context) {
+    Server* self = static_cast<Server*>(context);
+    switch (result) {
+        case FrameResult::Ok:
+            self->Dispatch(frame);
+            break;
+        case FrameResult::TooLarge:
+            self->stats_.too_large++;
+            self->Reply(frame.id, frame.method, Status::TooLarge);
+            break;
+        case FrameResult::CrcError:
+            self->stats_.crc_errors++;
+            break;
+    }
+}
+
+void Server::Reply(uint16_t id, uint8_t method, Status status) {
+    responder_.Reset(id, method);
+    responder_.Finish(status);
+}
+
+void Server::Dispatch(const Frame& frame) {
+    stats_.requests++;
+
+    Handler handler = nullptr;
+    void* handler_context = nullptr;
+    if (frame.method == kMethodPing) {
+        handler = &PingHandler;
+    } else if (const Entry* entry = Find(frame.method)) {
+        handler = entry->handler;
+        handler_context = entry->context;
+    } else {
+        stats_.unknown_method++;
+        Reply(frame.id, frame.method, Status::UnknownMethod);
+        return;
+    }
+
+    Request request;
+    request.id = frame.id;
+    request.method = frame.method;
+    request.payload = frame.payload;
+    request.length = frame.length;
+
+    responder_.Reset(frame.id, frame.method);
+    in_handler_ = true;
+    const Status status = handler(request, responder_, handler_context);
+    in_handler_ = false;
+
+    if (status != Status::Deferred) {
+        if (!responder_.done_) {
+            responder_.Finish(status);
+        }
+        return;
+    }
+
+    if (responder_.started_) {
+        responder_.Finish(Status::Failed);  // Deferred после начала ответа — оборвать
+        return;
+    }
+
+    if (Enqueue(frame.id, frame.method)) {
+        stats_.deferred++;
+    } else {
+        stats_.busy++;
+        Reply(frame.id, frame.method, Status::Busy);
+    }
+}
+
+bool Server::Enqueue(uint16_t id, uint8_t method) {
+    for (Pending& pending : pending_) {
+        Slot expected = Slot::Free;
+        if (pending.slot.compare_exchange_strong(expected, Slot::Claimed)) {
+            pending.id = id;
+            pending.method = method;
+            pending.slot.store(Slot::Queued);
+            return true;
+        }
+    }
+    return false;
+}
+
+Responder* Server::BeginDeferred(uint16_t id, Status status) {
+    // Обработчик уже пишет свой ответ: ждать TX — ждать самого себя
+    if (status == Status::Deferred || handler_tx_.load() || !LockTx()) {
+        return nullptr;
+    }
+
+    Pending* found = nullptr;
+    for (Pending& pending : pending_) {
+        Slot expected = Slot::Queued;
+        if (!pending.slot.compare_exchange_strong(expected, Slot::Claimed)) {
+            continue;
+        }
+        if (pending.id == id) {
+            found = &pending;
+            break;
+        }
+        pending.slot.store(Slot::Queued);
+    }
+    if (found == nullptr) {
+        UnlockTx();
+        return nullptr;
+    }
+    const uint8_t method = found->method;
+    found->slot.store(Slot::Free);
+
+    deferred_responder_.Reset(id, method);
+    if (!deferred_responder_.Open(status)) {
+        deferred_responder_.done_ = true;
+        UnlockTx();
+        return nullptr;
+    }
+    return &deferred_responder_;
+}
+
+bool Server::RespondDeferred(uint16_t id, Status status, const void* data, uint32_t len) {
+    Responder* response = BeginDeferred(id, status);
+    if (response == nullptr) {
+        return false;
+    }
+    if (len > 0 && !response->Write(data, len)) {
+        response->Finish(Status::Failed);
+        return false;
+    }
+    return response->End();
+}
+
+uint32_t Server::PendingCount() {
+    uint32_t count = 0;
+    for (const Pending& pending : pending_) {
+        count += pending.slot.load() == Slot::Queued ? 1 : 0;
+    }
+    return count;
+}
+
+}  // namespace usb::rpc
+
+#endif  // USB_RPC_ENABLED
@@ -6,18 +6,24 @@
  */
 
 #include "usb_sdmmc.h"
+#include "usb_cache.h"
+#include "usb_profile.h"
 
 #if defined(USB_MSC_ENABLED) && defined(USB_SDMMC_ENABLED)
 
 #include "stm32h7xx_hal.h"
 #include <cstring>
+#include <new>
 
 namespace usb {
 
 // ============ Константы ============
 
-static constexpr uint32_t kMaxPhysBlockSize = 2048;
+static constexpr uint32_t kMaxPhysBlockSize = SdmmcBlockDevice::kMaxPhysBlockSize;
 static constexpr uint32_t kLogBlockSize = SdmmcBlockDevice::kBlockSize;
+static constexpr uint32_t kBounceBlocks = kMaxPhysBlockSize / kLogBlockSize;
+static_assert(SdmmcBlockDevice::kImplAlign % cache::kLineSize == 0,
+              "SDMMC buffers must start on a cache line");
 
 // ============ pImpl структура (HAL детали внутри!) ============
 
@@ -27,10 +33,11 @@ struct SdmmcImpl {
     SdmmcState state = SdmmcState::NotInitialized;
     SdmmcCardInfo card_info = {};
     uint32_t phys_block_size = 512;
+    SDMMC_InitTypeDef bus = {};   ///< Ширина шины и делитель после Init (для Resume)
     
-    // Буферы (теперь члены класса, не глобальные!)
-    uint8_t phys_buffer[kMaxPhysBlockSize] __attribute__((aligned(4)));
-    uint8_t cache_buffer[kMaxPhysBlockSize] __attribute__((aligned(4)));
+    // Буферы (в объекте SdmmcBlockDevice, не глобальные и не в куче)
+    alignas(SdmmcBlockDevice::kImplAlign) uint8_t phys_buffer[kMaxPhysBlockSize];
+    alignas(SdmmcBlockDevice::kImplAlign) uint8_t cache_buffer[kMaxPhysBlockSize];
     uint32_t cached_phys_lba = UINT32_MAX;
     bool cache_dirty = false;
     
@@ -40,12 +47,24 @@ struct SdmmcImpl {
     SDMMC_TypeDef* GetSdmmcInstance(uint8_t index);
     void InitGpio();
     void DeInitGpio();
+    void GateClock(bool enable);
+    IRQn_Type GetIrq() const;
     bool WaitReady(uint32_t timeout_ms);
+    bool WaitDma(uint32_t timeout_ms);
+    bool ReadBlocks(uint32_t block, uint8_t* data, uint32_t count);
+    bool WriteBlocks(uint32_t block, uint8_t* data, uint32_t count);
+    bool FifoRetry(uint32_t count);
     bool ReadDirect(uint32_t lba, uint8_t* buffer, uint32_t count);
     bool WriteDirect(uint32_t lba, const uint8_t* buffer, uint32_t count);
+    bool DmaDirect(const uint8_t* data, uint32_t count) const;
     bool FlushCache();
 };
 
+static_assert(sizeof(SdmmcImpl) <= SdmmcBlockDevice::kImplStorageSize,
+              "SdmmcImpl does not fit SdmmcBlockDevice::kImplStorageSize");
+static_assert(alignof(SdmmcImpl) <= SdmmcBlockDevice::kImplAlign,
+              "SdmmcImpl alignment exceeds SdmmcBlockDevice::kImplAlign");
+
 // ============ SdmmcImpl вспомогательные методы ============
 
 GPIO_TypeDef* SdmmcImpl::GetGpioPort(uint8_t port_index) {
@@ -68,13 +87,80 @@ SDMMC_TypeDef* SdmmcImpl::GetSdmmcInstance(uint8_t index) {
     return SDMMC1;
 }
 
+IRQn_Type SdmmcImpl::GetIrq() const {
+#ifdef SDMMC2
+    if (hsd.Instance == SDMMC2) return SDMMC2_IRQn;
+#endif
+    return SDMMC1_IRQn;
+}
+
+/// Тактирование SDMMC в RCC: регистры сохраняются, CK на карту не идёт
+void SdmmcImpl::GateClock(bool enable) {
+    if (hsd.Instance == SDMMC1) {
+        if (enable) {
+            __HAL_RCC_SDMMC1_CLK_ENABLE();
+        } else {
+            __HAL_RCC_SDMMC1_CLK_DISABLE();
+        }
+    }
+#ifdef SDMMC2
+    else if (hsd.Instance == SDMMC2) {
+        if (enable) {
+            __HAL_RCC_SDMMC2_CLK_ENABLE();
+        } else {
+            __HAL_RCC_SDMMC2_CLK_DISABLE();
+        }
+    }
+#endif
+}
+
+/// Область памяти STM32H7 и доступ к ней IDMA (RM0433, матрица шин)
+struct DmaRegion {
+    uintptr_t begin;
+    uintptr_t end;
+    bool sdmmc1;  ///< IDMA SDMMC1 (матрица AXI, домен D1)
+    bool sdmmc2;  ///< IDMA SDMMC2 (матрица AHB D2, в D1 — через AXI)
+};
+
+static constexpr DmaRegion kDmaRegions[] = {
+    {0x00000000U, 0x00010000U, false, false},  // ITCM
+    {0x08000000U, 0x08200000U, true, true},    // Flash (источник записи)
+    {0x20000000U, 0x20020000U, false, false},  // DTCM
+    {0x24000000U, 0x24080000U, true, true},    // AXI SRAM
+    {0x30000000U, 0x30048000U, false, true},   // SRAM1-3 (D2)
+    {0x38000000U, 0x38010000U, false, false},  // SRAM4 (D3)
+    {0x60000000U, 0xA0000000U, true, true},    // FMC, QUADSPI
+    {0xC0000000U, 0xE0000000U, true, true},    // FMC SDRAM
+};
+
+/// Буфер целиком в памяти, доступной IDMA этого SDMMC, и целыми строками
+/// кэша; иначе — через phys_buffer
+bool SdmmcImpl::DmaDirect(const uint8_t* data, uint32_t count) const {
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(data);
+    const uintptr_t end = begin + static_cast<uintptr_t>(count) * kLogBlockSize;
+    if (!cache::IsLineAligned(data, count * kLogBlockSize)) {
+        return false;
+    }
+    for (const DmaRegion& region : kDmaRegions) {
+        if (begin < region.end && end > region.begin) {
+            const bool allowed = hsd.Instance == SDMMC1 ? region.sdmmc1 : region.sdmmc2;
+            return allowed && begin >= region.begin && end <= region.end;
+        }
+    }
+#if defined(__arm__)
+    return false;  // Вне карты памяти (резерв, периферия)
+#else
+    return true;   // native: память хоста
+#endif
+}
+
 // ============ Реализация SdmmcBlockDevice ============
 
-SdmmcBlockDevice::SdmmcBlockDevice() : impl_(new SdmmcImpl{}) {}
+SdmmcBlockDevice::SdmmcBlockDevice() : impl_(new (impl_storage_) SdmmcImpl{}) {}
 
 SdmmcBlockDevice::~SdmmcBlockDevice() {
     DeInit();
-    delete impl_;
+    impl_->~SdmmcImpl();
 }
 
 bool SdmmcBlockDevice::Init(const SdmmcConfig& config) {
@@ -89,8 +175,8 @@ bool SdmmcBlockDevice::Init(const SdmmcConfig& config) {
     
     // 1. Если PLL не готов - настраиваем автоматически
     if (!__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY)) {
-        RCC_OscInitTypeDef RCC_OscInit = {0};
-        RCC_ClkInitTypeDef RCC_ClkInit = {0};
+        RCC_OscInitTypeDef RCC_OscInit = {};
+        RCC_ClkInitTypeDef RCC_ClkInit = {};
         
         HAL_PWREx_ConfigSupply(PWR_LDO_SUPPLY);
         __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE0);
@@ -145,7 +231,7 @@ bool SdmmcBlockDevice::Init(const SdmmcConfig& config) {
     }
     
     // 2. Настраиваем SDMMC clock
-    RCC_PeriphCLKInitTypeDef PeriphClkInit = {0};
+    RCC_PeriphCLKInitTypeDef PeriphClkInit = {};
     PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_SDMMC;
     PeriphClkInit.SdmmcClockSelection = RCC_SDMMCCLKSOURCE_PLL;
     HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit);
@@ -189,6 +275,13 @@ bool SdmmcBlockDevice::Init(const SdmmcConfig& config) {
         impl_->state = SdmmcState::Error;
         return false;
     }
+    impl_->bus = impl_->hsd.Init;
+    
+    // 7a. Прерывание SDMMC для завершения IDMA передач
+    if (config.use_dma) {
+        HAL_NVIC_SetPriority(impl_->GetIrq(), config.dma_irq_priority, 0);
+        HAL_NVIC_EnableIRQ(impl_->GetIrq());
+    }
     
     // 8. Получаем информацию о карте
     HAL_SD_CardInfoTypeDef hal_info;
@@ -197,12 +290,12 @@ bool SdmmcBlockDevice::Init(const SdmmcConfig& config) {
         return false;
     }
     
-    // 9. Парсим CSD если нужно
+    // 9. Парсим CSD если нужно (HAL: CSD[0] = биты 127..96)
     if (hal_info.BlockNbr == 0) {
-        uint32_t csd_struct = (impl_->hsd.CSD[3] >> 30) & 0x03;
+        uint32_t csd_struct = (impl_->hsd.CSD[0] >> 30) & 0x03;
         if (csd_struct == 1) {
-            uint32_t c_size = ((impl_->hsd.CSD[2] & 0x3F) << 16) | 
-                              ((impl_->hsd.CSD[1] >> 16) & 0xFFFF);
+            uint32_t c_size = ((impl_->hsd.CSD[1] & 0x3F) << 16) | 
+                              ((impl_->hsd.CSD[2] >> 16) & 0xFFFF);
             uint64_t capacity = (static_cast<uint64_t>(c_size) + 1) * 512 * 1024;
             hal_info.BlockNbr = capacity / kLogBlockSize;
         }
@@ -221,6 +314,7 @@ bool SdmmcBlockDevice::Init(const SdmmcConfig& config) {
             init.HardwareFlowControl = SDMMC_HARDWARE_FLOW_CONTROL_DISABLE;
             init.ClockDiv = config.normal_clock_div;
             SDMMC_Init(impl_->hsd.Instance, init);
+            impl_->bus = init;
         }
     }
     
@@ -245,20 +339,17 @@ void SdmmcBlockDevice::DeInit() {
     if (impl_->state == SdmmcState::NotInitialized) {
         return;
     }
+    if (impl_->state == SdmmcState::Suspended) {
+        impl_->GateClock(true);  // HAL_SD_DeInit пишет регистры SDMMC
+    }
     
     impl_->FlushCache();
+    if (impl_->config.use_dma) {
+        HAL_NVIC_DisableIRQ(impl_->GetIrq());
+    }
     HAL_SD_DeInit(&impl_->hsd);
     impl_->DeInitGpio();
-    
-    SDMMC_TypeDef* sdmmc = impl_->GetSdmmcInstance(impl_->config.sdmmc_index);
-    if (sdmmc == SDMMC1) {
-        __HAL_RCC_SDMMC1_CLK_DISABLE();
-    }
-#ifdef SDMMC2
-    else if (sdmmc == SDMMC2) {
-        __HAL_RCC_SDMMC2_CLK_DISABLE();
-    }
-#endif
+    impl_->GateClock(false);
     
     impl_->state = SdmmcState::NotInitialized;
     impl_->card_info = {};
@@ -321,28 +412,114 @@ bool SdmmcImpl::WaitReady(uint32_t timeout_ms) {
     return false;
 }
 
-bool SdmmcImpl::ReadDirect(uint32_t lba, uint8_t* buffer, uint32_t count) {
-    for (uint32_t i = 0; i < count; ++i) {
-        if (HAL_SD_ReadBlocks(&hsd, phys_buffer, lba + i, 1, config.rw_timeout_ms) != HAL_OK) {
+/// Конец IDMA передачи: State выходит из BUSY в прерывании (DATAEND или ошибка)
+bool SdmmcImpl::WaitDma(uint32_t timeout_ms) {
+    uint32_t start = HAL_GetTick();
+    while (hsd.State == HAL_SD_STATE_BUSY) {
+        if ((HAL_GetTick() - start) >= timeout_ms) {
+            HAL_SD_Abort(&hsd);
+            return false;
+        }
+    }
+    return hsd.ErrorCode == HAL_SD_ERROR_NONE;
+}
+
+/**
+ * @brief Ошибка FIFO без DMA: оборвать команду, чтобы повторить её по блоку
+ *
+ * FIFO обслуживает CPU: прерывание посреди CMD18/CMD25 даёт RXOVERR/TXUNDERR.
+ * Один блок (512 байт) CPU успевает; длинные куски надёжны только с use_dma.
+ * @return true — команда оборвана (CMD12 в HAL_SD_Abort), карта в TRANSFER
+ */
+bool SdmmcImpl::FifoRetry(uint32_t count) {
+    const uint32_t fifo_errors = HAL_SD_ERROR_RX_OVERRUN | HAL_SD_ERROR_TX_UNDERRUN;
+    if (count == 1 || (hsd.ErrorCode & fifo_errors) == 0) {
+        return false;
+    }
+    HAL_SD_Abort(&hsd);
+    return WaitReady(config.rw_timeout_ms);
+}
+
+/// Один CMD17/CMD18 (CMD12 после нескольких блоков шлёт HAL) и ожидание TRANSFER
+bool SdmmcImpl::ReadBlocks(uint32_t block, uint8_t* data, uint32_t count) {
+    const uint32_t bytes = count * kLogBlockSize;
+    if (config.use_dma) {
+        cache::PrepareRx(data, bytes);
+        if (HAL_SD_ReadBlocks_DMA(&hsd, data, block, count) != HAL_OK) {
+            return false;
+        }
+        if (!WaitDma(config.rw_timeout_ms)) {
+            return false;
+        }
+        cache::CompleteRx(data, bytes);
+    } else if (HAL_SD_ReadBlocks(&hsd, data, block, count, config.rw_timeout_ms) != HAL_OK) {
+        if (!FifoRetry(count)) {
             return false;
         }
-        if (!WaitReady(config.rw_timeout_ms)) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (!ReadBlocks(block + i, data + i * kLogBlockSize, 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return WaitReady(config.rw_timeout_ms);
+}
+
+/// Один CMD24/CMD25; busy программирования ждём один раз на команду
+bool SdmmcImpl::WriteBlocks(uint32_t block, uint8_t* data, uint32_t count) {
+    if (config.use_dma) {
+        cache::PrepareTx(data, count * kLogBlockSize);
+        if (HAL_SD_WriteBlocks_DMA(&hsd, data, block, count) != HAL_OK) {
+            return false;
+        }
+        if (!WaitDma(config.rw_timeout_ms)) {
             return false;
         }
-        memcpy(buffer + i * kLogBlockSize, phys_buffer, kLogBlockSize);
+    } else if (HAL_SD_WriteBlocks(&hsd, data, block, count, config.rw_timeout_ms) != HAL_OK) {
+        if (!FifoRetry(count)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (!WriteBlocks(block + i, data + i * kLogBlockSize, 1)) {
+                return false;
+            }
+        }
+        return true;
     }
-    return true;
+    return WaitReady(config.rw_timeout_ms);
 }
 
-bool SdmmcImpl::WriteDirect(uint32_t lba, const uint8_t* buffer, uint32_t count) {
-    for (uint32_t i = 0; i < count; ++i) {
-        memcpy(phys_buffer, buffer + i * kLogBlockSize, kLogBlockSize);
-        if (HAL_SD_WriteBlocks(&hsd, phys_buffer, lba + i, 1, config.rw_timeout_ms) != HAL_OK) {
+bool SdmmcImpl::ReadDirect(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    USB_PROBE(SdRead);
+    // FIFO читает CPU — в любой буфер; IDMA — в доступный ей целыми строками кэша
+    if (!config.use_dma || DmaDirect(buffer, count)) {
+        return ReadBlocks(lba, buffer, count);
+    }
+    for (uint32_t done = 0; done < count;) {
+        uint32_t n = count - done < kBounceBlocks ? count - done : kBounceBlocks;
+        if (!ReadBlocks(lba + done, phys_buffer, n)) {
             return false;
         }
-        if (!WaitReady(config.rw_timeout_ms)) {
+        memcpy(buffer + done * kLogBlockSize, phys_buffer, n * kLogBlockSize);
+        done += n;
+    }
+    return true;
+}
+
+bool SdmmcImpl::WriteDirect(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    USB_PROBE(SdWrite);
+    if (!config.use_dma || DmaDirect(buffer, count)) {
+        // HAL принимает не-const указатель; FIFO и IDMA буфер только читают
+        return WriteBlocks(lba, const_cast<uint8_t*>(buffer), count);
+    }
+    for (uint32_t done = 0; done < count;) {
+        uint32_t n = count - done < kBounceBlocks ? count - done : kBounceBlocks;
+        memcpy(phys_buffer, buffer + done * kLogBlockSize, n * kLogBlockSize);
+        if (!WriteBlocks(lba + done, phys_buffer, n)) {
             return false;
         }
+        done += n;
     }
     return true;
 }
@@ -351,10 +528,7 @@ bool SdmmcImpl::FlushCache() {
     if (!cache_dirty || cached_phys_lba == UINT32_MAX) {
         return true;
     }
-    if (HAL_SD_WriteBlocks(&hsd, cache_buffer, cached_phys_lba, 1, config.rw_timeout_ms) != HAL_OK) {
-        return false;
-    }
-    if (!WaitReady(config.rw_timeout_ms)) {
+    if (!WriteBlocks(cached_phys_lba, cache_buffer, 1)) {
         return false;
     }
     cache_dirty = false;
@@ -371,7 +545,10 @@ bool SdmmcBlockDevice::IsCardInserted() const {
 }
 
 bool SdmmcBlockDevice::IsReady() const {
-    return impl_->state == SdmmcState::Ready && impl_->card_info.is_ready;
+    // Suspended — тоже готово: Read()/Write() будят карту
+    bool awake_or_asleep = impl_->state == SdmmcState::Ready ||
+                           impl_->state == SdmmcState::Suspended;
+    return awake_or_asleep && impl_->card_info.is_ready;
 }
 
 uint32_t SdmmcBlockDevice::GetBlockCount() const {
@@ -399,11 +576,72 @@ SdmmcDiagnostics SdmmcBlockDevice::GetDiagnostics() const {
     return diag;
 }
 
+void SdmmcBlockDevice::HandleInterrupt() {
+    HAL_SD_IRQHandler(&impl_->hsd);
+}
+
 bool SdmmcBlockDevice::Sync() {
     return impl_->FlushCache();
 }
 
+bool SdmmcBlockDevice::Suspend() {
+    if (impl_->state == SdmmcState::Suspended) {
+        return true;
+    }
+    if (impl_->state != SdmmcState::Ready || !impl_->FlushCache()) {
+        return false;
+    }
+    // Карта не вышла в transfer (программирует дольше таймаута, вынута) —
+    // не снимать выбор и не гасить тактирование посреди busy
+    if (!impl_->WaitReady(impl_->config.ready_timeout_ms)) {
+        return false;
+    }
+    SDMMC_CmdSelDesel(impl_->hsd.Instance, 0);
+    if (impl_->config.use_dma) {
+        HAL_NVIC_DisableIRQ(impl_->GetIrq());
+    }
+    impl_->GateClock(false);
+    impl_->state = SdmmcState::Suspended;
+    return true;
+}
+
+bool SdmmcBlockDevice::Resume() {
+    if (impl_->state != SdmmcState::Suspended) {
+        return impl_->state == SdmmcState::Ready;
+    }
+    impl_->GateClock(true);
+    SDMMC_Init(impl_->hsd.Instance, impl_->bus);
+    uint32_t rca = impl_->hsd.SdCard.RelCardAdd << 16;
+    if (SDMMC_CmdSelDesel(impl_->hsd.Instance, rca) == SDMMC_ERROR_NONE) {
+        if (impl_->config.use_dma) {
+            HAL_NVIC_EnableIRQ(impl_->GetIrq());
+        }
+        impl_->state = SdmmcState::Ready;
+        return true;
+    }
+    // Карта не отвечает на свой RCA (заменена, теряла питание): идентификация заново
+    SdmmcConfig config = impl_->config;
+    impl_->state = SdmmcState::Ready;
+    DeInit();
+    return Init(config);
+}
+
+void SdmmcBlockDevice::UsbSuspendHook(bool suspended, void* context) {
+    SdmmcBlockDevice* sd = static_cast<SdmmcBlockDevice*>(context);
+    if (sd == nullptr) {
+        return;
+    }
+    if (suspended) {
+        sd->Suspend();
+    } else {
+        sd->Resume();
+    }
+}
+
 bool SdmmcBlockDevice::Read(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    if (impl_->state == SdmmcState::Suspended && !Resume()) {
+        return false;
+    }
     if (impl_->state != SdmmcState::Ready || buffer == nullptr || count == 0) {
         return false;
     }
@@ -411,6 +649,9 @@ bool SdmmcBlockDevice::Read(uint32_t lba, uint8_t* buffer, uint32_t count) {
 }
 
 bool SdmmcBlockDevice::Write(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    if (impl_->state == SdmmcState::Suspended && !Resume()) {
+        return false;
+    }
     if (impl_->state != SdmmcState::Ready || buffer == nullptr || count == 0) {
         return false;
     }
@@ -0,0 +1,336 @@
+/**
+ * @file usb_snapshot.cpp
+ * @brief Таблица переадресации записей прошивки и перенос снимка на носитель
+ */
+
+#include "usb_snapshot.h"
+
+#ifdef USB_SNAPSHOT_ENABLED
+
+namespace usb {
+
+//--------------------------------------------------------------------+
+// SnapshotBlockDevice
+//--------------------------------------------------------------------+
+
+bool SnapshotBlockDevice::IsReady() const {
+    if (host_ && overlay_.GetState() != SnapshotState::Frozen) {
+        return false;  // Снимка нет или идёт перенос — хосту NOT READY
+    }
+    return overlay_.device_.IsReady();
+}
+
+uint32_t SnapshotBlockDevice::GetBlockCount() const {
+    return overlay_.device_.GetBlockCount();
+}
+
+uint32_t SnapshotBlockDevice::GetBlockSize() const {
+    return overlay_.device_.GetBlockSize();
+}
+
+bool SnapshotBlockDevice::Read(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    if (!host_) {
+        return overlay_.ReadFirmware(lba, buffer, count);
+    }
+    overlay_.Lock();
+    // Записи прошивки в слотах: носитель под снимком не меняется
+    const bool ok = overlay_.GetState() == SnapshotState::Frozen &&
+                    overlay_.device_.Read(lba, buffer, count);
+    overlay_.Unlock();
+    return ok;
+}
+
+bool SnapshotBlockDevice::Write(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    if (!host_) {
+        return overlay_.WriteFirmware(lba, buffer, count);
+    }
+    overlay_.Lock();
+    overlay_.stats_.host_write_rejects++;
+    overlay_.Unlock();
+    return false;
+}
+
+bool SnapshotBlockDevice::Sync() {
+    if (host_) {
+        return true;
+    }
+    overlay_.Lock();
+    const bool ok = overlay_.redirect_.Sync() && overlay_.device_.Sync();
+    overlay_.Unlock();
+    return ok;
+}
+
+//--------------------------------------------------------------------+
+// SnapshotOverlay
+//--------------------------------------------------------------------+
+
+SnapshotOverlay::SnapshotOverlay(ports::IBlockDevice& device, ports::IBlockDevice& redirect,
+                                 const SnapshotConfig& config)
+    : device_(device),
+      redirect_(redirect),
+      config_(config),
+      host_(*this, true),
+      firmware_(*this, false) {
+    if (config_.commit_blocks == 0) {
+        config_.commit_blocks = 1;
+    }
+}
+
+bool SnapshotOverlay::Freeze() {
+    Lock();
+    const SnapshotState state = state_.load(std::memory_order_relaxed);
+    if (state != SnapshotState::Live) {
+        Unlock();
+        return state == SnapshotState::Frozen;
+    }
+    const uint32_t block_size = device_.GetBlockSize();
+    if (!device_.IsReady() || !redirect_.IsReady() || block_size == 0 ||
+        redirect_.GetBlockSize() != block_size || block_size > USB_SNAPSHOT_COPY_BYTES) {
+        Unlock();
+        return false;
+    }
+    const uint32_t slots = redirect_.GetBlockCount();
+    capacity_ = slots < kMaxSlots ? slots : kMaxSlots;
+    ClearMap();
+    state_.store(SnapshotState::Frozen, std::memory_order_release);
+    Unlock();
+    return true;
+}
+
+void SnapshotOverlay::OnEject(bool loaded) {
+    if (loaded) {
+        load_pending_.store(true, std::memory_order_release);
+    } else {
+        eject_pending_.store(true, std::memory_order_release);
+    }
+}
+
+void SnapshotOverlay::Poll() {
+    if (eject_pending_.exchange(false, std::memory_order_acq_rel)) {
+        load_pending_.store(false, std::memory_order_relaxed);  // Eject отменяет прошлый load
+        SnapshotState expected = SnapshotState::Frozen;
+        Lock();
+        state_.compare_exchange_strong(expected, SnapshotState::Committing,
+                                       std::memory_order_acq_rel);
+        Unlock();
+    }
+
+    switch (GetState()) {
+    case SnapshotState::Committing:
+        if (CommitStep() && rotate_callback_ != nullptr) {
+            rotate_callback_(rotate_context_);
+        }
+        break;
+    case SnapshotState::Live:
+        // Хост загрузил носитель после переноса без rotate
+        if (load_pending_.exchange(false, std::memory_order_acq_rel)) {
+            Freeze();
+        }
+        break;
+    case SnapshotState::Frozen:
+        load_pending_.store(false, std::memory_order_relaxed);
+        break;
+    }
+}
+
+//--------------------------------------------------------------------+
+// Вид прошивки
+//--------------------------------------------------------------------+
+
+bool SnapshotOverlay::ReadFirmware(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    Lock();
+    if (used_slots_ == 0) {
+        const bool ok = device_.Read(lba, buffer, count);
+        Unlock();
+        return ok;
+    }
+
+    // Серии подряд идущих блоков из одного источника — одним вызовом
+    const uint32_t block_size = device_.GetBlockSize();
+    const bool ok = map_.ReadRuns(lba, count, [&](uint32_t i, uint32_t slot, uint32_t run) {
+        uint8_t* out = buffer + i * block_size;
+        return slot == kNone ? device_.Read(lba + i, out, run) : redirect_.Read(slot, out, run);
+    });
+    Unlock();
+    return ok;
+}
+
+bool SnapshotOverlay::WriteFirmware(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    Lock();
+    bool ok;
+    if (lba >= device_.GetBlockCount() || count > device_.GetBlockCount() - lba) {
+        ok = false;
+    } else if (state_.load(std::memory_order_relaxed) == SnapshotState::Frozen) {
+        ok = WriteRedirected(lba, buffer, count);
+    } else {
+        ok = WriteThrough(lba, buffer, count);
+    }
+    Unlock();
+    return ok;
+}
+
+bool SnapshotOverlay::WriteRedirected(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    // Места на всю запись — до изменения таблицы
+    uint32_t fresh = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        fresh += map_.SlotOf(lba + i) == kNone ? 1 : 0;
+    }
+    if (fresh > capacity_ - used_slots_) {
+        stats_.redirect_full++;
+        return false;
+    }
+
+    const uint32_t block_size = device_.GetBlockSize();
+    uint32_t i = 0;
+    while (i < count) {
+        uint32_t slot = map_.SlotOf(lba + i);
+        if (slot == kNone) {
+            // Новые блоки получают слоты подряд: серия пишется одним вызовом
+            slot = used_slots_;
+            uint32_t run = 0;
+            while (i + run < count && map_.SlotOf(lba + i + run) == kNone) {
+                Entry* entry = map_.Find(lba + i + run);
+                entry->lba = lba + i + run;
+                entry->slot = used_slots_;
+                slot_lba_[used_slots_++] = entry->lba;
+                run++;
+            }
+            if (!redirect_.Write(slot, buffer + i * block_size, run)) {
+                for (uint32_t k = 0; k < run; k++) {
+                    map_.Erase(map_.Find(lba + i + k));
+                }
+                used_slots_ -= run;
+                return false;
+            }
+            stats_.redirected_blocks += run;
+            i += run;
+        } else {
+            uint32_t run = 1;
+            while (i + run < count && map_.SlotOf(lba + i + run) == slot + run) {
+                run++;
+            }
+            if (!redirect_.Write(slot, buffer + i * block_size, run)) {
+                return false;
+            }
+            stats_.redirected_blocks += run;
+            i += run;
+        }
+    }
+    return true;
+}
+
+bool SnapshotOverlay::WriteThrough(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    if (!device_.Write(lba, buffer, count)) {
+        return false;
+    }
+    if (used_slots_ == 0) {
+        return true;
+    }
+    // Идёт перенос: новые данные уже на носителе, слот переносить нельзя
+    for (uint32_t i = 0; i < count; i++) {
+        Entry* entry = map_.Find(lba + i);
+        if (entry->lba != kNone && entry->slot != kNone) {
+            slot_lba_[entry->slot] = kNone;
+            entry->slot = kNone;
+        }
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------+
+// Перенос
+//--------------------------------------------------------------------+
+
+bool SnapshotOverlay::CommitStep() {
+    Lock();
+    const uint32_t block_size = device_.GetBlockSize();
+    const uint32_t copy_blocks = USB_SNAPSHOT_COPY_BYTES / block_size;
+    uint32_t budget = config_.commit_blocks;
+
+    while (budget > 0 && commit_slot_ < used_slots_) {
+        const uint32_t target = slot_lba_[commit_slot_];
+        if (target == kNone) {
+            commit_slot_++;
+            continue;
+        }
+        // Слоты подряд с блоками подряд — одна запись на носитель
+        uint32_t run = 1;
+        while (run < copy_blocks && run < budget && commit_slot_ + run < used_slots_ &&
+               slot_lba_[commit_slot_ + run] == target + run) {
+            run++;
+        }
+        if (!redirect_.Read(commit_slot_, copy_, run) || !device_.Write(target, copy_, run)) {
+            stats_.commit_errors++;
+            Unlock();
+            return false;
+        }
+        stats_.committed_blocks += run;
+        commit_slot_ += run;
+        budget -= run;
+    }
+
+    if (commit_slot_ < used_slots_) {
+        Unlock();
+        return false;
+    }
+    if (!device_.Sync()) {
+        stats_.commit_errors++;
+        Unlock();
+        return false;
+    }
+    ClearMap();
+    stats_.commits++;
+    const bool rotate = config_.rotate;
+    state_.store(rotate ? SnapshotState::Frozen : SnapshotState::Live, std::memory_order_release);
+    Unlock();
+    return rotate;
+}
+
+void SnapshotOverlay::ClearMap() {
+    map_.Clear();
+    used_slots_ = 0;
+    commit_slot_ = 0;
+}
+
+uint32_t SnapshotOverlay::GetRedirectedCount() const {
+    Lock();
+    const uint32_t used = used_slots_;
+    Unlock();
+    return used;
+}
+
+uint32_t SnapshotOverlay::GetCapacity() const {
+    Lock();
+    const uint32_t capacity = capacity_;
+    Unlock();
+    return capacity;
+}
+
+SnapshotStats SnapshotOverlay::GetStats() const {
+    Lock();
+    SnapshotStats stats = stats_;
+    Unlock();
+    return stats;
+}
+
+void SnapshotOverlay::ResetStats() {
+    Lock();
+    stats_ = SnapshotStats{};
+    Unlock();
+}
+
+void SnapshotOverlay::Lock() const {
+    if (mutex_ != nullptr) {
+        mutex_->Lock();
+    }
+}
+
+void SnapshotOverlay::Unlock() const {
+    if (mutex_ != nullptr) {
+        mutex_->Unlock();
+    }
+}
+
+}  // namespace usb
+
+#endif  // USB_SNAPSHOT_ENABLED
@@ -0,0 +1,408 @@
+/**
+ * @file usb_uf2.cpp
+ * @brief Виртуальный FAT16 том UF2 и конвейер записи во flash
+ */
+
+#include "usb_uf2.h"
+
+#if defined(USB_MSC_ENABLED) && defined(USB_UF2_ENABLED)
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+namespace usb {
+
+//--------------------------------------------------------------------+
+// Разметка тома
+//--------------------------------------------------------------------+
+
+static constexpr uint32_t kSectorSize = 512;
+static constexpr uint32_t kReservedSectors = 1;
+static constexpr uint32_t kFatCount = 2;
+static constexpr uint32_t kRootEntries = 64;
+static constexpr uint32_t kRootSectors = kRootEntries * 32 / kSectorSize;
+static constexpr uint32_t kMinClusters = 4200;   // FAT16 — от 4085 кластеров
+static constexpr uint32_t kMaxClusters = 65524;
+static constexpr uint32_t kFreeSlack = 64;       // Кластеров сверх места под файл хоста
+
+// Файлы тома: кластер 2 — INFO_UF2.TXT, 3 — INDEX.HTM, с 4 — CURRENT.UF2
+static constexpr uint32_t kInfoCluster = 2;
+static constexpr uint32_t kIndexCluster = 3;
+static constexpr uint32_t kCurrentCluster = 4;
+
+static constexpr uint16_t kFatDate = ((2026 - 1980) << 9) | (1 << 5) | 1;  // 2026-01-01
+
+static void Put16(uint8_t* p, uint16_t value) {
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static void Put32(uint8_t* p, uint32_t value) {
+    Put16(p, static_cast<uint16_t>(value));
+    Put16(p + 2, static_cast<uint16_t>(value >> 16));
+}
+
+static uint32_t Get32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+namespace uf2 {
+
+bool IsBlock(const uint8_t* sector) {
+    return Get32(sector) == kMagicStart0 && Get32(sector + 4) == kMagicStart1 &&
+           Get32(sector + kBlockSize - 4) == kMagicEnd;
+}
+
+}  // namespace uf2
+
+/// Запись каталога 8.3
+static void DirEntry(uint8_t* entry, const char* name11, uint8_t attr, uint16_t cluster,
+                     uint32_t size) {
+    std::memcpy(entry, name11, 11);
+    entry[11] = attr;
+    Put16(entry + 16, kFatDate);  // Создан
+    Put16(entry + 18, kFatDate);  // Доступ
+    Put16(entry + 24, kFatDate);  // Изменён
+    Put16(entry + 26, cluster);
+    Put32(entry + 28, size);
+}
+
+//--------------------------------------------------------------------+
+// Uf2Disk: том
+//--------------------------------------------------------------------+
+
+Uf2Disk::Uf2Disk(ports::IFlash& flash, const Uf2Config& config)
+    : flash_(flash), config_(config), writer_(flash) {
+    ready_ = writer_.CheckRegion(&config_.app_address, &config_.app_size) &&
+             config_.app_size % uf2::kPayloadSize == 0;
+
+    app_blocks_ = config_.app_size / uf2::kPayloadSize;
+    clusters_ = kCurrentCluster - 2 + app_blocks_ * 2 + kFreeSlack;
+    if (clusters_ < kMinClusters) {
+        clusters_ = kMinClusters;
+    }
+    ready_ = ready_ && clusters_ <= kMaxClusters;
+
+    fat_sectors_ = ((clusters_ + 2) * 2 + kSectorSize - 1) / kSectorSize;
+    total_sectors_ = kReservedSectors + kFatCount * fat_sectors_ + kRootSectors + clusters_;
+}
+
+uint32_t Uf2Disk::InfoText(char* out, uint32_t size) const {
+    int len = std::snprintf(out, size, "UF2 Bootloader\r\nModel: %s\r\nBoard-ID: %s\r\n",
+                            config_.model, config_.board_id);
+    return len < 0 ? 0 : (static_cast<uint32_t>(len) < size ? len : size - 1);
+}
+
+uint32_t Uf2Disk::IndexText(char* out, uint32_t size) const {
+    int len = std::snprintf(out, size,
+                            "<!doctype html>\n<html><body><script>\n"
+                            "location.replace(\"%s\");\n</script></body></html>\n",
+                            config_.index_url);
+    return len < 0 ? 0 : (static_cast<uint32_t>(len) < size ? len : size - 1);
+}
+
+void Uf2Disk::BootSector(uint8_t* out) const {
+    static const uint8_t kJump[3] = {0xEB, 0x3C, 0x90};
+    std::memcpy(out, kJump, 3);
+    std::memcpy(out + 3, "UF2 UF2 ", 8);
+    Put16(out + 11, kSectorSize);
+    out[13] = 1;  // Секторов в кластере
+    Put16(out + 14, kReservedSectors);
+    out[16] = kFatCount;
+    Put16(out + 17, kRootEntries);
+    if (total_sectors_ < 0x10000) {
+        Put16(out + 19, static_cast<uint16_t>(total_sectors_));
+    } else {
+        Put32(out + 32, total_sectors_);
+    }
+    out[21] = 0xF8;  // Несъёмный носитель
+    Put16(out + 22, static_cast<uint16_t>(fat_sectors_));
+    Put16(out + 24, 1);  // Секторов на дорожке
+    Put16(out + 26, 1);  // Головок
+    out[36] = 0x80;      // Номер диска
+    out[38] = 0x29;      // Расширенная сигнатура
+    Put32(out + 39, config_.family_id);  // Серийный номер тома
+    std::memcpy(out + 43, "UF2BOOT    ", 11);
+    std::memcpy(out + 54, "FAT16   ", 8);
+    out[510] = 0x55;
+    out[511] = 0xAA;
+}
+
+void Uf2Disk::FatSector(uint32_t index, uint8_t* out) const {
+    const uint32_t last_current = kCurrentCluster + app_blocks_ - 1;
+    for (uint32_t i = 0; i < kSectorSize / 2; i++) {
+        const uint32_t cluster = index * (kSectorSize / 2) + i;
+        uint16_t value = 0;
+        if (cluster == 0) {
+            value = 0xFFF8;
+        } else if (cluster == 1 || cluster == kInfoCluster || cluster == kIndexCluster ||
+                   cluster == last_current) {
+            value = 0xFFFF;  // Конец цепочки
+        } else if (cluster >= kCurrentCluster && cluster < last_current) {
+            value = static_cast<uint16_t>(cluster + 1);
+        }
+        Put16(out + i * 2, value);
+    }
+}
+
+void Uf2Disk::RootSector(uint32_t index, uint8_t* out) const {
+    if (index != 0) {
+        return;
+    }
+    char text[kSectorSize];
+    DirEntry(out, "UF2BOOT    ", 0x08, 0, 0);
+    DirEntry(out + 32, "INFO_UF2TXT", 0x01, kInfoCluster, InfoText(text, sizeof(text)));
+    DirEntry(out + 64, "INDEX   HTM", 0x01, kIndexCluster, IndexText(text, sizeof(text)));
+    DirEntry(out + 96, "CURRENT UF2", 0x00, kCurrentCluster, app_blocks_ * uf2::kBlockSize);
+}
+
+void Uf2Disk::DataSector(uint32_t cluster, uint8_t* out) {
+    if (cluster == kInfoCluster) {
+        InfoText(reinterpret_cast<char*>(out), kSectorSize);
+        return;
+    }
+    if (cluster == kIndexCluster) {
+        IndexText(reinterpret_cast<char*>(out), kSectorSize);
+        return;
+    }
+    if (cluster < kCurrentCluster || cluster - kCurrentCluster >= app_blocks_) {
+        return;
+    }
+
+    // CURRENT.UF2: блок с текущим содержимым flash
+    const uint32_t block_no = cluster - kCurrentCluster;
+    const uint32_t address = config_.app_address + block_no * uf2::kPayloadSize;
+    Put32(out, uf2::kMagicStart0);
+    Put32(out + 4, uf2::kMagicStart1);
+    Put32(out + 8, uf2::kFlagFamilyId);
+    Put32(out + 12, address);
+    Put32(out + 16, uf2::kPayloadSize);
+    Put32(out + 20, block_no);
+    Put32(out + 24, app_blocks_);
+    Put32(out + 28, config_.family_id);
+    flash_.Read(address, out + 32, uf2::kPayloadSize);
+    Put32(out + uf2::kBlockSize - 4, uf2::kMagicEnd);
+}
+
+void Uf2Disk::ReadSector(uint32_t lba, uint8_t* out) {
+    std::memset(out, 0, kSectorSize);
+    const uint32_t fat_start = kReservedSectors;
+    const uint32_t root_start = fat_start + kFatCount * fat_sectors_;
+    const uint32_t data_start = root_start + kRootSectors;
+
+    if (lba == 0) {
+        BootSector(out);
+    } else if (lba < root_start) {
+        FatSector((lba - fat_start) % fat_sectors_, out);
+    } else if (lba < data_start) {
+        RootSector(lba - root_start, out);
+    } else {
+        DataSector(lba - data_start + 2, out);
+    }
+}
+
+bool Uf2Disk::Read(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    if (!ready_ || lba + count > total_sectors_) {
+        return false;
+    }
+    Lock();
+    for (uint32_t i = 0; i < count; i++) {
+        ReadSector(lba + i, buffer + i * kSectorSize);
+    }
+    Unlock();
+    return true;
+}
+
+//--------------------------------------------------------------------+
+// Uf2Disk: приём блоков
+//--------------------------------------------------------------------+
+
+bool Uf2Disk::Write(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    if (!ready_ || lba + count > total_sectors_) {
+        return false;
+    }
+    Lock();
+    bool ok = true;
+    for (uint32_t i = 0; i < count && ok; i++) {
+        const uint8_t* sector = buffer + i * kSectorSize;
+        if (uf2::IsBlock(sector)) {
+            ok = HandleBlock(sector);
+        } else {
+            stats_.other_writes++;  // FAT и каталог файла хоста
+        }
+    }
+    writer_.Pump();
+    CheckComplete();
+    Unlock();
+    return ok;
+}
+
+bool Uf2Disk::HandleBlock(const uint8_t* sector) {
+    uf2::Block header;
+    std::memcpy(&header, sector, offsetof(uf2::Block, data));
+
+    if ((header.flags & (uf2::kFlagNotMainFlash | uf2::kFlagFileContainer)) != 0 ||
+        ((header.flags & uf2::kFlagFamilyId) != 0 && header.family_id != config_.family_id)) {
+        stats_.blocks_skipped++;
+        return true;
+    }
+    if (writer_.HasFailed()) {
+        return false;
+    }
+
+    const uint32_t program_unit = writer_.GetProgramUnit();
+    const uint32_t app_end = config_.app_address + config_.app_size;
+    if (header.payload_size == 0 || header.payload_size > uf2::kPayloadSize ||
+        header.payload_size % program_unit != 0 || header.target_addr % program_unit != 0 ||
+        header.target_addr < config_.app_address || header.target_addr >= app_end ||
+        header.payload_size > app_end - header.target_addr ||
+        header.num_blocks == 0 || header.num_blocks > USB_UF2_MAX_BLOCKS ||
+        header.block_no >= header.num_blocks) {
+        stats_.blocks_invalid++;
+        return true;
+    }
+
+    if (!session_ || header.num_blocks != num_blocks_) {
+        if (!StartSession(header)) {
+            return false;
+        }
+    }
+    uint32_t& word = received_[header.block_no / 32];
+    const uint32_t bit = 1u << (header.block_no % 32);
+    if ((word & bit) != 0) {
+        stats_.blocks_duplicate++;  // Хост перезаписал уже принятый кластер
+        return true;
+    }
+
+    // Очередь заполнена — дождаться flash (единственное место, где Write() ждёт)
+    while (writer_.IsFull()) {
+        stats_.queue_full_waits++;
+        if (!writer_.Step()) {
+            return false;
+        }
+    }
+
+    uint8_t* slot = writer_.Push(header.target_addr, header.payload_size);
+    if (slot == nullptr) {
+        return false;
+    }
+    std::memcpy(slot, sector + offsetof(uf2::Block, data), header.payload_size);
+
+    word |= bit;
+    blocks_seen_++;
+    stats_.blocks_received++;
+
+    const uint32_t first = writer_.SectorOf(header.target_addr);
+    const uint32_t last = writer_.SectorOf(header.target_addr + header.payload_size - 1);
+    first_sector_ = first < first_sector_ ? first : first_sector_;
+    last_sector_ = last > last_sector_ ? last : last_sector_;
+    UpdateEraseAhead();
+
+    if (blocks_seen_ == num_blocks_) {
+        return writer_.Drain();  // Последний блок: дописать очередь до ответа хосту
+    }
+    return true;
+}
+
+bool Uf2Disk::StartSession(const uf2::Block& header) {
+    // Остаток прошлого файла дописывается: данные в очереди уже подтверждены хосту
+    writer_.Drain();
+    writer_.NewSession();
+    session_ = true;
+    complete_ = false;
+    num_blocks_ = header.num_blocks;
+    blocks_seen_ = 0;
+    std::memset(received_, 0, sizeof(received_));
+
+    // Границы образа по первому блоку (блоки подряд от blockNo 0), в пределах области
+    const uint64_t offset = static_cast<uint64_t>(header.block_no) * header.payload_size;
+    const uint64_t length = static_cast<uint64_t>(header.num_blocks) * header.payload_size;
+    const uint64_t app_end = static_cast<uint64_t>(config_.app_address) + config_.app_size;
+    uint64_t start = header.target_addr >= offset ? header.target_addr - offset : 0;
+    start = start < config_.app_address ? config_.app_address : start;
+    uint64_t end = start + length;
+    end = end > app_end ? app_end : end;
+    first_sector_ = writer_.SectorOf(static_cast<uint32_t>(start));
+    last_sector_ = writer_.SectorOf(static_cast<uint32_t>(end - 1));
+    UpdateEraseAhead();
+    return true;
+}
+
+void Uf2Disk::UpdateEraseAhead() {
+    if (config_.erase_ahead && session_ && blocks_seen_ < num_blocks_) {
+        writer_.SetEraseAhead(first_sector_, last_sector_);
+    } else {
+        writer_.StopEraseAhead();
+    }
+}
+
+//--------------------------------------------------------------------+
+// Uf2Disk: завершение и сессия
+//--------------------------------------------------------------------+
+
+void Uf2Disk::CheckComplete() {
+    if (!session_ || complete_ || writer_.HasFailed() || blocks_seen_ != num_blocks_ ||
+        !writer_.IsIdle()) {
+        return;
+    }
+    complete_ = true;
+    if (complete_callback_ != nullptr) {
+        complete_callback_(complete_context_);
+    }
+}
+
+void Uf2Disk::Poll() {
+    Lock();
+    writer_.Pump();
+    CheckComplete();
+    Unlock();
+}
+
+bool Uf2Disk::Sync() {
+    Lock();
+    bool ok = writer_.Drain();
+    CheckComplete();
+    Unlock();
+    return ok;
+}
+
+void Uf2Disk::Reset() {
+    Lock();
+    writer_.Reset();
+    writer_.ResetStats();
+    session_ = false;
+    complete_ = false;
+    num_blocks_ = 0;
+    blocks_seen_ = 0;
+    std::memset(received_, 0, sizeof(received_));
+    stats_ = Uf2Stats{};
+    Unlock();
+}
+
+Uf2Stats Uf2Disk::GetStats() const {
+    Uf2Stats stats = stats_;
+    const FlashWriterStats flash = writer_.GetStats();
+    stats.sectors_erased = flash.sectors_erased;
+    stats.erase_ahead = flash.erase_ahead;
+    stats.blocks_programmed = flash.programs;
+    stats.flash_errors = flash.flash_errors;
+    return stats;
+}
+
+void Uf2Disk::Lock() {
+    if (mutex_ != nullptr) {
+        mutex_->Lock();
+    }
+}
+
+void Uf2Disk::Unlock() {
+    if (mutex_ != nullptr) {
+        mutex_->Unlock();
+    }
+}
+
+}  // namespace usb
+
+#endif  // USB_MSC_ENABLED && USB_UF2_ENABLED
@@ -0,0 +1,386 @@
+/**
+ * @file test_arbiter.cpp
+ * @brief Unit тесты BlockArbiter (очередь прошивка/хост, UNIT ATTENTION) на POSIX threads
+ */
+
+#include <unity.h>
+#include "usb_arbiter.h"
+#include "usb_composite.h"
+#include "adapters/PosixRtos.hpp"
+#include "mock/MockBlockDevice.hpp"
+#include "sim/TinyUsbSim.hpp"
+#include "tusb.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using usb::ArbiterConfig;
+using usb::ArbiterStats;
+using usb::BlockArbiter;
+using usb::UsbDevice;
+using usb::adapters::PosixRtos;
+using usb::mock::MockBlockDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::TinyUsbSim;
+
+static constexpr uint32_t kBlock = 512;
+static constexpr uint32_t kBlocks = 4096;
+
+/// Реальное время для ожидания очереди (потоки, не SimTime)
+class SteadyClock final : public usb::ports::IClock {
+public:
+    uint32_t GetTickMs() const override {
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         std::chrono::steady_clock::now().time_since_epoch())
+                                         .count());
+    }
+    void DelayMs(uint32_t ms) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+};
+
+/**
+ * Проверяет правила очереди: запись только в одиночку, чтения — без записи.
+ * Операции длятся op_us; запись можно задержать до Release().
+ */
+class CheckedBlockDevice : public MockBlockDevice {
+public:
+    CheckedBlockDevice() : MockBlockDevice(kBlocks, kBlock) {}
+
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override {
+        readers_++;
+        max_readers_ = std::max<uint32_t>(max_readers_, readers_);
+        if (writers_ != 0) {
+            violations_++;
+        }
+        Hold(false);
+        bool ok = MockBlockDevice::Read(lba, buffer, count);
+        readers_--;
+        return ok;
+    }
+
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override {
+        if (++writers_ != 1 || readers_ != 0) {
+            violations_++;
+        }
+        in_write_ = true;
+        Hold(true);
+        bool ok = MockBlockDevice::Write(lba, buffer, count);
+        in_write_ = false;
+        writers_--;
+        writes_done_++;
+        return ok;
+    }
+
+    void SetOpUs(uint32_t us) { op_us_ = us; }
+    void Gate() { gated_ = true; }
+    void Release() { gated_ = false; }
+
+    bool InWrite() const { return in_write_; }
+    uint32_t Violations() const { return violations_; }
+    uint32_t MaxReaders() const { return max_readers_; }
+    uint32_t WritesDone() const { return writes_done_; }
+
+private:
+    void Hold(bool write) {
+        while (write && gated_) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (op_us_ != 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(op_us_));
+        }
+    }
+
+    std::atomic<uint32_t> readers_{0};
+    std::atomic<uint32_t> writers_{0};
+    std::atomic<uint32_t> max_readers_{0};
+    std::atomic<uint32_t> violations_{0};
+    std::atomic<uint32_t> writes_done_{0};
+    std::atomic<bool> in_write_{false};
+    std::atomic<bool> gated_{false};
+    std::atomic<uint32_t> op_us_{0};
+};
+
+static UsbDevice g_usb;
+static SteadyClock g_clock;
+
+template <typename Predicate>
+static bool WaitFor(Predicate predicate, uint32_t timeout_ms = 2000) {
+    for (uint32_t i = 0; i < timeout_ms; i++) {
+        if (predicate()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return predicate();
+}
+
+static void MediaChanged(void* context) {
+    static_cast<UsbDevice*>(context)->MscMediaChanged();
+}
+
+static void CountChange(void* context) {
+    (*static_cast<uint32_t*>(context))++;
+}
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_usb.Init();
+    g_usb.MscResetStats();
+}
+
+void tearDown() {
+    g_usb.MscDetach();
+}
+
+void test_change_only_for_blocks_host_saw() {
+    CheckedBlockDevice disk;
+    BlockArbiter arbiter(disk);  // Без RTOS: один контекст
+    uint32_t changes = 0;
+    arbiter.SetChangeCallback(CountChange, &changes);
+
+    uint8_t buf[8 * kBlock];
+    std::memset(buf, 0x11, sizeof(buf));
+    TEST_ASSERT_TRUE(arbiter.Host().Read(0, buf, 8));
+    TEST_ASSERT_TRUE(arbiter.Host().Write(100, buf, 8));
+
+    // Журнал прошивки в блоках, которых хост не видел
+    TEST_ASSERT_TRUE(arbiter.Firmware().Write(3000, buf, 8));
+    TEST_ASSERT_TRUE(arbiter.Firmware().Read(0, buf, 8));  // Чтение не меняет носитель
+    TEST_ASSERT_EQUAL_UINT32(0, changes);
+
+    TEST_ASSERT_TRUE(arbiter.Firmware().Write(104, buf, 1));  // Хост писал 100..107
+    TEST_ASSERT_EQUAL_UINT32(1, changes);
+
+    // Хост перечитает носитель: карта блоков хоста пуста
+    TEST_ASSERT_TRUE(arbiter.Firmware().Write(0, buf, 8));
+    TEST_ASSERT_EQUAL_UINT32(1, changes);
+
+    ArbiterStats stats = arbiter.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(2, stats.host_ops);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.firmware_ops);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.firmware_writes_unseen);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.media_changes);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.contended);
+}
+
+void test_failed_firmware_write_is_not_a_change() {
+    CheckedBlockDevice disk;
+    BlockArbiter arbiter(disk);
+    uint32_t changes = 0;
+    arbiter.SetChangeCallback(CountChange, &changes);
+
+    uint8_t buf[kBlock] = {0};
+    TEST_ASSERT_TRUE(arbiter.Host().Read(10, buf, 1));
+    disk.SetReady(false);
+    TEST_ASSERT_FALSE(arbiter.Firmware().Write(10, buf, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, changes);
+
+    disk.SetReady(true);
+    arbiter.ForgetHostBlocks();  // Например, после MscAttach()
+    TEST_ASSERT_TRUE(arbiter.Firmware().Write(10, buf, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, changes);
+}
+
+void test_unit_attention_on_next_test_unit_ready() {
+    CheckedBlockDevice disk;
+    BlockArbiter arbiter(disk);
+    arbiter.SetChangeCallback(MediaChanged, &g_usb);
+    g_usb.MscAttach(arbiter.Host());
+
+    MscHostSim host;
+    uint8_t buf[8 * kBlock];
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 8, buf));
+
+    std::memset(buf, 0x66, sizeof(buf));
+    TEST_ASSERT_TRUE(arbiter.Firmware().Write(2048, buf, 8));  // Хост не видел
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+
+    TEST_ASSERT_TRUE(arbiter.Firmware().Write(2, buf, 1));     // FAT, которую хост читал
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.TestUnitReady());
+    uint8_t key = 0;
+    uint8_t asc = 0;
+    uint8_t ascq = 0;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.RequestSense(&key, &asc, &ascq));
+    TEST_ASSERT_EQUAL_HEX8(SCSI_SENSE_UNIT_ATTENTION, key);
+    TEST_ASSERT_EQUAL_HEX8(0x28, asc);
+    TEST_ASSERT_EQUAL_HEX8(0x00, ascq);
+
+    // Один раз: хост перечитывает том
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 8, buf));
+    TEST_ASSERT_EQUAL_HEX8(0x66, buf[2 * kBlock]);
+    TEST_ASSERT_EQUAL_UINT32(1, g_usb.MscGetStats().sense_count[SCSI_SENSE_UNIT_ATTENTION]);
+}
+
+void test_writer_excludes_host() {
+    PosixRtos rtos;
+    CheckedBlockDevice disk;
+    BlockArbiter arbiter(disk);
+    TEST_ASSERT_TRUE(arbiter.SetRtos(rtos, g_clock));
+
+    disk.Gate();
+    std::atomic<bool> firmware_done{false};
+    std::thread firmware([&] {
+        uint8_t data[kBlock];
+        std::memset(data, 0xF0, sizeof(data));
+        arbiter.Firmware().Write(5, data, 1);
+        firmware_done = true;
+    });
+    TEST_ASSERT_TRUE(WaitFor([&] { return disk.InWrite(); }));
+
+    std::atomic<bool> host_done{false};
+    uint8_t seen[kBlock] = {0};
+    std::thread host([&] {
+        arbiter.Host().Read(5, seen, 1);
+        host_done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    TEST_ASSERT_FALSE(host_done.load());  // Ждёт окончания записи
+
+    disk.Release();
+    firmware.join();
+    host.join();
+    TEST_ASSERT_TRUE(firmware_done.load());
+    TEST_ASSERT_EQUAL_HEX8(0xF0, seen[0]);  // Чтение после записи целиком
+    TEST_ASSERT_EQUAL_UINT32(0, disk.Violations());
+    TEST_ASSERT_EQUAL_UINT32(1, arbiter.GetStats().contended);
+}
+
+void test_wait_is_bounded_by_timeout() {
+    PosixRtos rtos;
+    CheckedBlockDevice disk;
+    ArbiterConfig cfg;
+    cfg.host_timeout_ms = 30;
+    BlockArbiter arbiter(disk, cfg);
+    TEST_ASSERT_TRUE(arbiter.SetRtos(rtos, g_clock));
+
+    disk.Gate();
+    std::thread firmware([&] {
+        uint8_t data[kBlock] = {0};
+        arbiter.Firmware().Write(0, data, 1);
+    });
+    TEST_ASSERT_TRUE(WaitFor([&] { return disk.InWrite(); }));
+
+    uint8_t buf[kBlock];
+    auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_FALSE(arbiter.Host().Read(0, buf, 1));
+    auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    TEST_ASSERT_TRUE(waited >= 30);
+    TEST_ASSERT_TRUE(waited < 500);
+    TEST_ASSERT_EQUAL_UINT32(1, arbiter.GetStats().timeouts);
+
+    disk.Release();
+    firmware.join();
+    TEST_ASSERT_TRUE(arbiter.Host().Read(0, buf, 1));  // Очередь снова свободна
+}
+
+void test_writer_not_starved_by_readers() {
+    PosixRtos rtos;
+    CheckedBlockDevice disk;
+    disk.SetOpUs(500);
+    ArbiterConfig cfg;
+    cfg.concurrent_reads = true;
+    cfg.firmware_timeout_ms = 200;
+    BlockArbiter arbiter(disk, cfg);
+    TEST_ASSERT_TRUE(arbiter.SetRtos(rtos, g_clock));
+
+    // Два читателя без пауз: чтения перекрываются, очередь не пустеет
+    std::atomic<bool> stop{false};
+    auto reader = [&](usb::IBlockDevice& client, uint32_t lba) {
+        uint8_t buf[kBlock];
+        while (!stop) {
+            client.Read(lba, buf, 1);
+        }
+    };
+    std::thread host(reader, std::ref(arbiter.Host()), 0);
+    std::thread firmware_reader(reader, std::ref(arbiter.Firmware()), 1);
+    TEST_ASSERT_TRUE(WaitFor([&] { return disk.MaxReaders() >= 2; }));
+
+    uint8_t data[kBlock] = {0};
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < 20; i++) {
+        written += arbiter.Firmware().Write(100 + i, data, 1) ? 1 : 0;
+    }
+    stop = true;
+    host.join();
+    firmware_reader.join();
+
+    ArbiterStats stats = arbiter.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(20, written);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.timeouts);
+    TEST_ASSERT_TRUE(stats.max_wait_ms < 50);  // Писатель ждёт только чтения впереди
+    TEST_ASSERT_EQUAL_UINT32(0, disk.Violations());
+}
+
+void test_host_and_firmware_interleave_through_msc() {
+    PosixRtos rtos;
+    CheckedBlockDevice disk;
+    disk.SetOpUs(50);
+    BlockArbiter arbiter(disk);
+    TEST_ASSERT_TRUE(arbiter.SetRtos(rtos, g_clock));
+    arbiter.SetChangeCallback(MediaChanged, &g_usb);
+    g_usb.MscAttach(arbiter.Host());
+
+    // Прошивка пишет журнал в конец карты, хост копирует файлы в начало
+    std::atomic<bool> stop{false};
+    std::atomic<uint32_t> firmware_errors{0};
+    std::atomic<uint32_t> firmware_writes{0};
+    std::thread firmware([&] {
+        uint8_t data[4 * kBlock];
+        uint32_t lba = 3072;
+        while (!stop) {
+            std::memset(data, static_cast<int>(lba), sizeof(data));
+            if (!arbiter.Firmware().Write(lba, data, 4)) {
+                firmware_errors++;
+            }
+            firmware_writes++;
+            lba = lba + 4 < kBlocks ? lba + 4 : 3072;
+        }
+    });
+
+    MscHostSim host;
+    std::vector<uint8_t> out(32 * kBlock);
+    std::vector<uint8_t> in(32 * kBlock);
+    uint32_t host_failures = 0;
+    for (uint32_t round = 0; round < 20; round++) {
+        for (uint32_t i = 0; i < out.size(); i++) {
+            out[i] = static_cast<uint8_t>(round * 31 + i);
+        }
+        const uint32_t lba = round * 32;
+        host_failures += host.Write10(lba, 32, out.data()) == CswStatus::Passed ? 0 : 1;
+        host_failures += host.Read10(lba, 32, in.data()) == CswStatus::Passed ? 0 : 1;
+        TEST_ASSERT_EQUAL_MEMORY(out.data(), in.data(), out.size());
+    }
+    stop = true;
+    firmware.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, host_failures);
+    TEST_ASSERT_EQUAL_UINT32(0, firmware_errors.load());
+    TEST_ASSERT_TRUE(firmware_writes.load() > 0);
+    TEST_ASSERT_EQUAL_UINT32(0, disk.Violations());
+    // Журнал не пересекался с блоками хоста — кэш хоста действителен
+    TEST_ASSERT_EQUAL_UINT32(0, arbiter.GetStats().media_changes);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_change_only_for_blocks_host_saw);
+    RUN_TEST(test_failed_firmware_write_is_not_a_change);
+    RUN_TEST(test_unit_attention_on_next_test_unit_ready);
+    RUN_TEST(test_writer_excludes_host);
+    RUN_TEST(test_wait_is_bounded_by_timeout);
+    RUN_TEST(test_writer_not_starved_by_readers);
+    RUN_TEST(test_host_and_firmware_interleave_through_msc);
+
+    return UNITY_END();
+}
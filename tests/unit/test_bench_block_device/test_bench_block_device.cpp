@@ -0,0 +1,128 @@
+/**
+ * @file test_bench_block_device.cpp
+ * @brief Бенчмарк стандартных нагрузок для стеков IBlockDevice
+ * 
+ * Запуск: pio test -e bench
+ * Результаты печатаются в JSON (между маркерами BENCH_JSON_BEGIN/END).
+ */
+
+#include <unity.h>
+#include "bench/BlockBench.hpp"
+#include "mock/MockBlockDevice.hpp"
+#include "sim/SdCardSim.hpp"
+#include "usb_sdmmc.h"
+#include "stm32h7xx_hal.h"
+
+#include <cstdio>
+
+using namespace usb::bench;
+using usb::mock::MockBlockDevice;
+using usb::sim::SdCardSim;
+using usb::sim::SdCardSimConfig;
+using usb::sim::SimTime;
+
+static constexpr uint32_t kBlockCount = 65536;  // 32 MB
+
+static std::vector<BenchResult> g_results;
+
+void setUp() {
+    SimTime::Reset();
+    usb::sim::HalState::Reset();
+}
+
+void tearDown() {
+}
+
+static TimeSource SimTimeSource() {
+    TimeSource ts;
+    ts.now_us = [](void*) -> uint64_t { return SimTime::NowUs(); };
+    return ts;
+}
+
+static TimeSource MockTimeSource(MockBlockDevice& device) {
+    TimeSource ts;
+    ts.now_us = [](void* ctx) -> uint64_t {
+        return static_cast<MockBlockDevice*>(ctx)->GetModelledTimeUs();
+    };
+    ts.context = &device;
+    return ts;
+}
+
+static WorkloadParams Params() {
+    WorkloadParams p;
+    p.block_count = kBlockCount;
+    p.total_bytes = 2u << 20;
+    return p;
+}
+
+static void CheckResult(const BenchResult& r) {
+    TEST_ASSERT_EQUAL_UINT64(0, r.errors);
+    TEST_ASSERT_GREATER_THAN(0, r.ops);
+    TEST_ASSERT_GREATER_THAN(0, r.elapsed_us);
+    TEST_ASSERT_LESS_OR_EQUAL(r.lat_max_us, r.lat_p99_us);
+    TEST_ASSERT_LESS_OR_EQUAL(r.lat_p99_us, r.lat_p50_us);
+}
+
+void test_workloads_stay_within_device() {
+    for (const auto& w : StandardWorkloads(Params())) {
+        TEST_ASSERT_GREATER_THAN(0, w.ops.size());
+        for (const auto& op : w.ops) {
+            TEST_ASSERT_LESS_OR_EQUAL(kBlockCount, op.lba + op.count);
+        }
+    }
+}
+
+void test_bench_mock_latency_model() {
+    MockBlockDevice device(kBlockCount, 512);
+    device.SetLatencyModel(200, 25, 60);
+    CountingBlockDevice counter(device);
+    
+    for (const auto& w : StandardWorkloads(Params())) {
+        BenchResult r = RunWorkload(counter, w, MockTimeSource(device), &counter, "mock");
+        CheckResult(r);
+        TEST_ASSERT_DOUBLE_WITHIN(1e-9, 1.0, r.calls_per_op);
+        g_results.push_back(r);
+    }
+}
+
+void test_bench_sdmmc_on_sd_simulator() {
+    SdCardSimConfig cfg;
+    cfg.block_count = kBlockCount;
+    cfg.busy_tail_permille = 5;
+    SdCardSim card(cfg);
+    card.Attach(1);
+    
+    usb::SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    CountingBlockDevice counter(sd);
+    
+    for (const auto& w : StandardWorkloads(Params())) {
+        BenchResult r = RunWorkload(counter, w, SimTimeSource(), &counter, "sdmmc_sim");
+        CheckResult(r);
+        g_results.push_back(r);
+    }
+}
+
+void test_bench_results_serialize_to_json() {
+    BenchResult r;
+    r.backend = "x";
+    r.workload = "y";
+    r.ops = 3;
+    std::string json = ToJson(r);
+    TEST_ASSERT_TRUE(json.find("\"backend\":\"x\"") != std::string::npos);
+    TEST_ASSERT_TRUE(json.find("\"ops\":3") != std::string::npos);
+    TEST_ASSERT_TRUE(json.front() == '{' && json.back() == '}');
+}
+
+int main() {
+    UNITY_BEGIN();
+    
+    RUN_TEST(test_workloads_stay_within_device);
+    RUN_TEST(test_bench_mock_latency_model);
+    RUN_TEST(test_bench_sdmmc_on_sd_simulator);
+    RUN_TEST(test_bench_results_serialize_to_json);
+    
+    std::printf("BENCH_JSON_BEGIN\n%sBENCH_JSON_END\n", ToJson(g_results).c_str());
+    
+    return UNITY_END();
+}
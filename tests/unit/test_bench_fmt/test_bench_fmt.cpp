@@ -0,0 +1,172 @@
+/**
+ * @file test_bench_fmt.cpp
+ * @brief Такты на строку: vsnprintf (CdcPrintf) против usb::fmt (CdcFormat)
+ *
+ * Запуск: pio test -e bench
+ * Строки типичного отладочного вывода:
+ * - ints — счётчики и знаковая ошибка
+ * - hex — регистры с нулями
+ * - fixed — напряжение и ток с 3 и 2 знаками после точки
+ * Пути пишут в буфер 128 байт: vsnprintf через va_list, как CdcPrintf(), и
+ * fmt::FormatTo(). Вывод обоих путей сверяется.
+ * Результаты печатаются в JSON (между маркерами BENCH_JSON_BEGIN/END).
+ */
+
+#include <unity.h>
+#include "bench/BlockBench.hpp"
+#include "usb_fmt.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using usb::bench::CycleCount;
+using usb::fmt::FormatTo;
+
+static constexpr uint32_t kIterations = 100000;
+static constexpr int kRepeats = 5;
+static constexpr uint32_t kLineSize = 128;
+
+struct CycleResult {
+    std::string line;
+    std::string path;
+    double cycles_per_line = 0.0;
+};
+
+static std::vector<CycleResult> g_results;
+static char g_line[kLineSize];
+
+/// Как CdcPrintf(): разбор формата во время выполнения
+__attribute__((noinline)) static int Printf(char* out, uint32_t size, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(out, size, fmt, args);
+    va_end(args);
+    return len;
+}
+
+__attribute__((noinline)) static uint32_t IntsPrintf(uint32_t i) {
+    return static_cast<uint32_t>(Printf(g_line, kLineSize, "t=%lu ch=%u adc=%u err=%d\r\n",
+                                        static_cast<unsigned long>(i * 1000u + 17u), i & 7u,
+                                        i % 4096u, static_cast<int>(i % 200u) - 100));
+}
+
+__attribute__((noinline)) static uint32_t IntsFmt(uint32_t i) {
+    return FormatTo(g_line, kLineSize, USB_FMT("t={} ch={} adc={} err={}\r\n"), i * 1000u + 17u,
+                    i & 7u, i % 4096u, static_cast<int>(i % 200u) - 100);
+}
+
+__attribute__((noinline)) static uint32_t HexPrintf(uint32_t i) {
+    return static_cast<uint32_t>(Printf(g_line, kLineSize, "reg[%02X]=0x%08lX flags=%04x\r\n",
+                                        i & 0xFFu, static_cast<unsigned long>(i * 2654435761u),
+                                        i & 0x3FFu));
+}
+
+__attribute__((noinline)) static uint32_t HexFmt(uint32_t i) {
+    return FormatTo(g_line, kLineSize, USB_FMT("reg[{:02X}]=0x{:08X} flags={:04x}\r\n"),
+                    i & 0xFFu, i * 2654435761u, i & 0x3FFu);
+}
+
+__attribute__((noinline)) static uint32_t FixedPrintf(uint32_t i) {
+    return static_cast<uint32_t>(Printf(g_line, kLineSize, "v=%.3f i=%.2f\r\n",
+                                        static_cast<double>(i % 5000u) * 0.001 + 0.0004,
+                                        static_cast<double>(i % 300u) * 0.01 - 1.0));
+}
+
+__attribute__((noinline)) static uint32_t FixedFmt(uint32_t i) {
+    return FormatTo(g_line, kLineSize, USB_FMT("v={:.3} i={:.2}\r\n"),
+                    static_cast<double>(i % 5000u) * 0.001 + 0.0004,
+                    static_cast<double>(i % 300u) * 0.01 - 1.0);
+}
+
+/// Минимум тактов на строку по kRepeats прогонам
+template <typename Line>
+static void MeasureCycles(const char* line, const char* path, Line format,
+                          double* cycles_per_line) {
+    double best = 0.0;
+    for (int r = 0; r < kRepeats; r++) {
+        uint64_t bytes = 0;
+        uint64_t start = CycleCount();
+        for (uint32_t i = 0; i < kIterations; i++) {
+            bytes += format(i);
+        }
+        uint64_t cycles = CycleCount() - start;
+        TEST_ASSERT_TRUE(bytes > kIterations);
+        double per_line = static_cast<double>(cycles) / kIterations;
+        if (r == 0 || per_line < best) {
+            best = per_line;
+        }
+    }
+    g_results.push_back({line, path, best});
+    *cycles_per_line = best;
+}
+
+/// Оба пути дают одинаковые строки
+template <typename A, typename B>
+static void AssertSameOutput(A printf_path, B fmt_path) {
+    char expected[kLineSize];
+    for (uint32_t i = 0; i < 5000; i += 7) {
+        const uint32_t len = printf_path(i);
+        std::memcpy(expected, g_line, kLineSize);
+        TEST_ASSERT_EQUAL_UINT32(len, fmt_path(i));
+        TEST_ASSERT_EQUAL_STRING(expected, g_line);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_paths_agree_on_output() {
+    AssertSameOutput(IntsPrintf, IntsFmt);
+    AssertSameOutput(HexPrintf, HexFmt);
+    AssertSameOutput(FixedPrintf, FixedFmt);
+}
+
+void test_bench_format_lines() {
+    struct Line {
+        const char* name;
+        uint32_t (*printf_path)(uint32_t);
+        uint32_t (*fmt_path)(uint32_t);
+    };
+    const Line lines[] = {
+        {"ints", IntsPrintf, IntsFmt},
+        {"hex", HexPrintf, HexFmt},
+        {"fixed", FixedPrintf, FixedFmt},
+    };
+    for (const Line& line : lines) {
+        double printf_cycles = 0.0;
+        double fmt_cycles = 0.0;
+        MeasureCycles(line.name, "vsnprintf", line.printf_path, &printf_cycles);
+        MeasureCycles(line.name, "usb_fmt", line.fmt_path, &fmt_cycles);
+        std::printf("  %-6s vsnprintf %8.1f  usb_fmt %8.1f cycles/line\n", line.name,
+                    printf_cycles, fmt_cycles);
+        TEST_ASSERT_TRUE(fmt_cycles < printf_cycles);
+    }
+}
+
+static std::string ToJson(const std::vector<CycleResult>& results) {
+    std::string out = "[\n";
+    char line[160];
+    for (size_t i = 0; i < results.size(); i++) {
+        std::snprintf(line, sizeof(line),
+                      "  {\"line\":\"%s\",\"path\":\"%s\",\"cycles_per_line\":%.1f}%s\n",
+                      results[i].line.c_str(), results[i].path.c_str(),
+                      results[i].cycles_per_line, i + 1 < results.size() ? "," : "");
+        out += line;
+    }
+    out += "]\n";
+    return out;
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_paths_agree_on_output);
+    RUN_TEST(test_bench_format_lines);
+
+    std::printf("BENCH_JSON_BEGIN\n%sBENCH_JSON_END\n", ToJson(g_results).c_str());
+
+    return UNITY_END();
+}
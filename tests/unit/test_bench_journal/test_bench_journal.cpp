@@ -0,0 +1,162 @@
+/**
+ * @file test_bench_journal.cpp
+ * @brief Бенчмарк JournalBlockDevice: мелкие случайные записи на SD с моделью FTL
+ *
+ * Запуск: pio test -e bench
+ * Карта SdCardSim с блоком стирания 4 MB и двумя точками дозаписи: запись
+ * назад или в чужой блок — слияние блока (merge_us). Бэкенды:
+ * - sdmmc_ftl — SdmmcBlockDevice напрямую
+ * - journal_ftl — JournalBlockDevice поверх него; "<нагрузка>" — только
+ *   время хоста (поглощение всплеска, перенос ещё впереди), затем
+ *   "<нагрузка>+drain" — с переносом всего журнала (Sync()): пропускная
+ *   способность, сравнимая с sdmmc_ftl
+ * Результаты печатаются в JSON (между маркерами BENCH_JSON_BEGIN/END).
+ */
+
+#include <unity.h>
+#include "bench/BlockBench.hpp"
+#include "sim/SdCardSim.hpp"
+#include "usb_journal.h"
+#include "usb_sdmmc.h"
+#include "stm32h7xx_hal.h"
+
+#include <cstdio>
+
+using namespace usb::bench;
+using usb::JournalBlockDevice;
+using usb::JournalConfig;
+using usb::sim::SdCardSim;
+using usb::sim::SdCardSimConfig;
+using usb::sim::SimTime;
+
+static constexpr uint32_t kCardBlocks = 65536;    // 32 MB
+static constexpr uint32_t kJournalBlocks = 768;   // 384 KB
+static constexpr uint32_t kHotBlocks = 2048;      // FAT и каталоги: первый 1 MB
+
+static std::vector<BenchResult> g_results;
+
+void setUp() {
+    SimTime::Reset();
+    usb::sim::HalState::Reset();
+}
+
+void tearDown() {
+}
+
+static TimeSource SimTimeSource() {
+    TimeSource ts;
+    ts.now_us = [](void*) -> uint64_t { return SimTime::NowUs(); };
+    return ts;
+}
+
+static SdCardSimConfig FtlCard() {
+    SdCardSimConfig cfg;
+    cfg.block_count = kCardBlocks;
+    cfg.erase_block_size = 4u << 20;
+    cfg.open_blocks = 2;
+    cfg.merge_us = 20000;  // Бюджетная карта: копирование блока стирания
+    return cfg;
+}
+
+static WorkloadParams Params(uint32_t block_count, uint32_t total_bytes = 1u << 20) {
+    WorkloadParams p;
+    p.block_count = block_count;
+    p.total_bytes = total_bytes;
+    return p;
+}
+
+/// Нагрузки одинаковы для обоих бэкендов: адреса в пределах тома журнала
+static std::vector<Workload> JournalWorkloads() {
+    const uint32_t data_blocks = kCardBlocks - kJournalBlocks - 1;  // Журнал и заголовок
+    std::vector<Workload> all;
+    // Всплеск меньше журнала: хост не ждёт переноса
+    all.push_back(MakeRandom(Params(data_blocks, 256u << 10), IoKind::Write));
+    Workload hot = MakeRandom(Params(kHotBlocks), IoKind::Write);
+    hot.name = "rand_write_4k_hot";
+    all.push_back(hot);
+    Workload fat = MakeMacosMount(Params(data_blocks));
+    all.push_back(fat);
+    all.push_back(MakeFat32Copy(Params(data_blocks)));
+    return all;
+}
+
+static void RunPlain(const Workload& w, BenchResult* plain, uint32_t* merges) {
+    SimTime::Reset();
+    SdCardSim card(FtlCard());
+    card.Attach(1);
+    usb::SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    *plain = RunWorkload(sd, w, SimTimeSource(), nullptr, "sdmmc_ftl");
+    TEST_ASSERT_EQUAL_UINT64(0, plain->errors);
+    *merges = card.GetStats().ftl_merges;
+    std::printf("  sdmmc_ftl   %-20s %8.3f MB/s  merges=%u\n", w.name.c_str(), plain->mb_per_s,
+                static_cast<unsigned>(*merges));
+}
+
+/// Время хоста (всплеск) и время с переносом журнала (пропускная способность)
+static void RunJournal(const Workload& w, BenchResult* host, BenchResult* total,
+                       uint32_t* merges) {
+    SimTime::Reset();
+    SdCardSim card(FtlCard());
+    card.Attach(1);
+    usb::SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    JournalConfig cfg;
+    cfg.journal_blocks = kJournalBlocks;
+    JournalBlockDevice journal(sd, cfg);
+    TEST_ASSERT_TRUE(journal.Format());
+
+    *host = RunWorkload(journal, w, SimTimeSource(), nullptr, "journal_ftl");
+    TEST_ASSERT_EQUAL_UINT64(0, host->errors);
+
+    const uint64_t start = SimTime::NowUs();
+    TEST_ASSERT_TRUE(journal.Sync());
+    *total = *host;
+    total->workload = w.name + "+drain";
+    total->elapsed_us = host->elapsed_us + (SimTime::NowUs() - start);
+    const double seconds = static_cast<double>(total->elapsed_us) / 1e6;
+    total->mb_per_s =
+        static_cast<double>(total->bytes_read + total->bytes_written) / (1024.0 * 1024.0) / seconds;
+    total->iops = static_cast<double>(total->ops) / seconds;
+
+    *merges = card.GetStats().ftl_merges;
+    std::printf("  journal_ftl %-20s %8.3f MB/s  burst %8.3f MB/s  merges=%u  superseded=%u\n",
+                w.name.c_str(), total->mb_per_s, host->mb_per_s, static_cast<unsigned>(*merges),
+                static_cast<unsigned>(journal.GetStats().superseded_blocks));
+}
+
+void test_bench_random_writes_with_journal() {
+    for (const Workload& w : JournalWorkloads()) {
+        BenchResult plain;
+        uint32_t plain_merges = 0;
+        RunPlain(w, &plain, &plain_merges);
+        BenchResult host;
+        BenchResult total;
+        uint32_t journal_merges = 0;
+        RunJournal(w, &host, &total, &journal_merges);
+        g_results.push_back(plain);
+        g_results.push_back(host);
+        g_results.push_back(total);
+
+        if (w.name == "rand_write_4k_hot") {
+            // Перезаписи схлопываются в журнале, перенос идёт по возрастанию LBA
+            TEST_ASSERT_LESS_THAN(plain_merges / 2, journal_merges);
+        }
+        if (w.name == "rand_write_4k") {
+            // С переносом: меньше слияний, чем напрямую
+            TEST_ASSERT_GREATER_THAN(plain.mb_per_s, total.mb_per_s);
+            // Всплеск меньше журнала хост не ждёт слияний
+            TEST_ASSERT_GREATER_THAN(plain.mb_per_s * 2.0, host.mb_per_s);
+        }
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_bench_random_writes_with_journal);
+
+    std::printf("BENCH_JSON_BEGIN\n%sBENCH_JSON_END\n", ToJson(g_results).c_str());
+
+    return UNITY_END();
+}
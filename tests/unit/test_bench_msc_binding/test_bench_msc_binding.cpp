@@ -0,0 +1,195 @@
+/**
+ * @file test_bench_msc_binding.cpp
+ * @brief Такты на кусок MSC: IBlockDevice (vtable) против MscBinding<Device>
+ *
+ * Запуск: pio test -e bench
+ * Пути:
+ * - legacy — прежний MscDeviceIo(): IsReady(), GetBlockSize(), Read() через vtable
+ * - binding_virtual — MscBinding<IBlockDevice>: переходник + 2 виртуальных вызова
+ * - binding_static — MscBinding<Device>: переходник, вызовы устройства встроены
+ * Устройство null — только диспетчеризация, ram — плюс memcpy куска 4 KB.
+ * Результаты печатаются в JSON (между маркерами BENCH_JSON_BEGIN/END).
+ */
+
+#include <unity.h>
+#include "bench/BlockBench.hpp"
+#include "usb_msc_binding.h"
+#include "ports/IBlockDevice.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using usb::MscBinding;
+using usb::MscBindingState;
+using usb::bench::CycleCount;
+using usb::ports::IBlockDevice;
+
+static constexpr uint32_t kChunkBytes = 4096;  // CFG_TUD_MSC_EP_BUFSIZE
+static constexpr uint32_t kIterations = 100000;
+static constexpr int kRepeats = 5;
+
+/// Ничего не копирует — остаётся стоимость вызовов
+class NullDisk final : public IBlockDevice {
+public:
+    static constexpr uint32_t kBlockSize = 512;
+
+    [[nodiscard]] bool IsReady() const override { return ready_; }
+    [[nodiscard]] uint32_t GetBlockCount() const override { return 1u << 20; }
+    [[nodiscard]] uint32_t GetBlockSize() const override { return kBlockSize; }
+
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override {
+        buffer[0] = static_cast<uint8_t>(lba + count);
+        return true;
+    }
+
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override {
+        last_ = buffer[0] + lba + count;
+        return true;
+    }
+
+    bool ready_ = true;
+    uint32_t last_ = 0;
+};
+
+/// RAM диск: memcpy куска
+class RamDisk final : public IBlockDevice {
+public:
+    static constexpr uint32_t kBlockSize = 512;
+    static constexpr uint32_t kBlocks = 64;
+
+    [[nodiscard]] bool IsReady() const override { return true; }
+    [[nodiscard]] uint32_t GetBlockCount() const override { return kBlocks; }
+    [[nodiscard]] uint32_t GetBlockSize() const override { return kBlockSize; }
+
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override {
+        std::memcpy(buffer, data_ + (lba % kBlocks / 8 * 8) * kBlockSize, count * kBlockSize);
+        return true;
+    }
+
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override {
+        std::memcpy(data_ + (lba % kBlocks / 8 * 8) * kBlockSize, buffer, count * kBlockSize);
+        return true;
+    }
+
+private:
+    uint8_t data_[kBlocks * kBlockSize] = {};
+};
+
+/// Прежний путь callbacks (до MscBinding)
+__attribute__((noinline)) static int32_t LegacyIo(IBlockDevice* device, uint32_t lba,
+                                                  uint8_t* buffer, uint32_t bufsize) {
+    if (!device->IsReady()) {
+        return -1;
+    }
+    uint32_t block_count = bufsize / device->GetBlockSize();
+    if (block_count == 0) {
+        return 0;
+    }
+    return device->Read(lba, buffer, block_count) ? static_cast<int32_t>(block_count) : -1;
+}
+
+__attribute__((noinline)) static int32_t BindingIo(MscBindingState& state, uint32_t lba,
+                                                   uint8_t* buffer, uint32_t bufsize) {
+    return state.Transfer(false, lba, buffer, bufsize);
+}
+
+struct CycleResult {
+    std::string path;
+    std::string device;
+    double cycles_per_chunk = 0.0;
+};
+
+static std::vector<CycleResult> g_results;
+static uint8_t g_buffer[kChunkBytes];
+
+/// Минимум тактов на кусок по kRepeats прогонам
+template <typename Io>
+static void MeasureCycles(const char* path, const char* device, Io io) {
+    double best = 0.0;
+    for (int r = 0; r < kRepeats; r++) {
+        uint64_t blocks = 0;
+        uint64_t start = CycleCount();
+        for (uint32_t i = 0; i < kIterations; i++) {
+            blocks += static_cast<uint64_t>(io(i * 8));
+        }
+        uint64_t cycles = CycleCount() - start;
+        TEST_ASSERT_EQUAL_UINT64(static_cast<uint64_t>(kIterations) * 8, blocks);
+        double per_chunk = static_cast<double>(cycles) / kIterations;
+        if (r == 0 || per_chunk < best) {
+            best = per_chunk;
+        }
+    }
+    g_results.push_back({path, device, best});
+}
+
+template <typename Device>
+static void BenchDevice(Device& device, const char* name) {
+    IBlockDevice* base = &device;
+    MscBindingState fallback = MscBinding<IBlockDevice>::Bind(*base);
+    MscBindingState direct = MscBinding<Device>::Bind(device);
+    TEST_ASSERT_TRUE(fallback.RefreshGeometry());
+    TEST_ASSERT_TRUE(direct.RefreshGeometry());
+
+    MeasureCycles("legacy", name, [base](uint32_t lba) {
+        return LegacyIo(base, lba, g_buffer, kChunkBytes);
+    });
+    MeasureCycles("binding_virtual", name, [&fallback](uint32_t lba) {
+        return BindingIo(fallback, lba, g_buffer, kChunkBytes);
+    });
+    MeasureCycles("binding_static", name, [&direct](uint32_t lba) {
+        return BindingIo(direct, lba, g_buffer, kChunkBytes);
+    });
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_bench_dispatch_null_device() {
+    static NullDisk disk;
+    BenchDevice(disk, "null");
+}
+
+void test_bench_dispatch_ram_device() {
+    static RamDisk disk;
+    BenchDevice(disk, "ram");
+}
+
+void test_paths_agree_on_results() {
+    NullDisk disk;
+    MscBindingState direct = MscBinding<NullDisk>::Bind(disk);
+    for (uint32_t bufsize : {1000u, 100u, 4096u}) {
+        TEST_ASSERT_EQUAL_INT32(LegacyIo(&disk, 0, g_buffer, bufsize),
+                                direct.Transfer(false, 0, g_buffer, bufsize));
+    }
+    disk.ready_ = false;
+    TEST_ASSERT_EQUAL_INT32(LegacyIo(&disk, 0, g_buffer, 512),
+                            direct.Transfer(false, 0, g_buffer, 512));
+}
+
+static std::string ToJson(const std::vector<CycleResult>& results) {
+    std::string out = "[\n";
+    char line[160];
+    for (size_t i = 0; i < results.size(); i++) {
+        std::snprintf(line, sizeof(line),
+                      "  {\"path\":\"%s\",\"device\":\"%s\",\"cycles_per_chunk\":%.1f}%s\n",
+                      results[i].path.c_str(), results[i].device.c_str(),
+                      results[i].cycles_per_chunk, i + 1 < results.size() ? "," : "");
+        out += line;
+    }
+    out += "]\n";
+    return out;
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_paths_agree_on_results);
+    RUN_TEST(test_bench_dispatch_null_device);
+    RUN_TEST(test_bench_dispatch_ram_device);
+
+    std::printf("BENCH_JSON_BEGIN\n%sBENCH_JSON_END\n", ToJson(g_results).c_str());
+
+    return UNITY_END();
+}
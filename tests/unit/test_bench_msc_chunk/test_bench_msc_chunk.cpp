@@ -0,0 +1,213 @@
+/**
+ * @file test_bench_msc_chunk.cpp
+ * @brief Пропускная способность MSC от размера EP буфера (CFG_TUD_MSC_EP_BUFSIZE)
+ *
+ * Запуск: pio test -e bench
+ * Хост MscHostSim → модель TinyUSB → tud_msc_read10_cb/write10_cb →
+ * SdmmcBlockDevice → SdCardSim. Кусок EP буфера — один Read()/Write() и одна
+ * команда SD (CMD18/CMD25). Время — виртуальное время карты и драйвера;
+ * шина USB не моделируется (на FS она ограничит всё ~1 MB/s, матрица
+ * показывает запас устройства для HS).
+ * Нагрузки:
+ * - seq_read / seq_write — 1 MB командами по 64 KB
+ * - rand_read_4k — 256 чтений по 4 KB по случайным адресам
+ * Результаты печатаются в JSON (между маркерами BENCH_JSON_BEGIN/END).
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_sdmmc.h"
+#include "sim/SdCardSim.hpp"
+#include "sim/TinyUsbSim.hpp"
+#include "stm32h7xx_hal.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using usb::SdmmcBlockDevice;
+using usb::UsbDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::SdCardSim;
+using usb::sim::SimTime;
+using usb::sim::TinyUsbSim;
+
+static constexpr uint32_t kChunks[] = {512, 4096, 8192, 16384, 32768, 65024};
+static constexpr uint32_t kChunkCount = sizeof(kChunks) / sizeof(kChunks[0]);
+static constexpr uint32_t kSeqBytes = 1u << 20;
+static constexpr uint16_t kCommandBlocks = 128;  // 64 KB на команду
+static constexpr uint32_t kRandomOps = 256;
+static constexpr uint32_t kBlockSize = 512;
+
+enum class Workload : uint8_t {
+    SeqRead,
+    SeqWrite,
+    RandRead4k,
+};
+
+struct ChunkResult {
+    std::string workload;
+    uint32_t chunk = 0;
+    double mb_per_s = 0.0;
+    double callbacks_per_mb = 0.0;
+    double sd_cmds_per_mb = 0.0;
+};
+
+static std::vector<ChunkResult> g_results;
+static uint8_t g_data[kSeqBytes];
+static uint8_t g_readback[kSeqBytes];
+
+void setUp() {}
+void tearDown() {}
+
+static void PumpUsb(void* context) {
+    static_cast<UsbDevice*>(context)->Process();
+}
+
+static const char* WorkloadName(Workload workload) {
+    switch (workload) {
+        case Workload::SeqRead:    return "seq_read";
+        case Workload::SeqWrite:   return "seq_write";
+        case Workload::RandRead4k: return "rand_read_4k";
+    }
+    return "?";
+}
+
+static void FillPattern(uint8_t* buf, uint32_t len, uint8_t seed) {
+    for (uint32_t i = 0; i < len; i++) {
+        buf[i] = static_cast<uint8_t>(seed + i * 13 + (i >> 9));
+    }
+}
+
+/// Одна нагрузка на свежей карте с EP буфером chunk байт
+static void RunChunk(Workload workload, uint32_t chunk, ChunkResult* result) {
+    SimTime::Reset();
+    usb::sim::HalState::Reset();
+    TinyUsbSim::Get().Reset();
+
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    UsbDevice usb;
+    TEST_ASSERT_TRUE(usb.Init());
+    usb.MscAttach(&sd);
+    TinyUsbSim::Get().SetMscEpBufferSize(chunk);
+
+    MscHostSim host;
+    host.SetPump(PumpUsb, &usb);
+
+    FillPattern(g_data, kSeqBytes, static_cast<uint8_t>(chunk >> 9));
+    if (workload != Workload::SeqWrite) {
+        for (uint32_t lba = 0; lba < kSeqBytes / kBlockSize; lba++) {
+            card.PokeBlock(lba, g_data + lba * kBlockSize);
+        }
+    }
+    card.ResetStats();
+    TinyUsbSim::Get().ResetMscStats();
+
+    uint32_t bytes = 0;
+    const uint64_t start = SimTime::NowUs();
+    if (workload == Workload::RandRead4k) {
+        uint32_t state = 0x9E3779B9u;
+        for (uint32_t i = 0; i < kRandomOps; i++) {
+            state = state * 1664525u + 1013904223u;
+            uint32_t lba = (state >> 8) % (kSeqBytes / kBlockSize / 8) * 8;
+            TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(lba, 8, g_readback));
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(g_data + lba * kBlockSize, g_readback, 8 * kBlockSize);
+            bytes += 8 * kBlockSize;
+        }
+    } else {
+        const uint32_t step = kCommandBlocks * kBlockSize;
+        for (uint32_t offset = 0; offset < kSeqBytes; offset += step) {
+            uint32_t lba = offset / kBlockSize;
+            CswStatus status = workload == Workload::SeqRead
+                                   ? host.Read10(lba, kCommandBlocks, g_readback + offset)
+                                   : host.Write10(lba, kCommandBlocks, g_data + offset);
+            TEST_ASSERT_EQUAL(CswStatus::Passed, status);
+            bytes += step;
+        }
+        if (workload == Workload::SeqRead) {
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(g_data, g_readback, kSeqBytes);
+        } else {
+            uint8_t peek[kBlockSize];
+            card.PeekBlock(kSeqBytes / kBlockSize - 1, peek);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(g_data + kSeqBytes - kBlockSize, peek, kBlockSize);
+        }
+    }
+    const uint64_t elapsed_us = SimTime::NowUs() - start;
+
+    const auto& msc = TinyUsbSim::Get().GetMscStats();
+    const auto& sd_stats = card.GetStats();
+    const double mb = static_cast<double>(bytes) / (1u << 20);
+    result->workload = WorkloadName(workload);
+    result->chunk = chunk;
+    result->mb_per_s = elapsed_us == 0 ? 0.0 : static_cast<double>(bytes) / elapsed_us;
+    result->callbacks_per_mb = (msc.read10_cb_calls + msc.write10_cb_calls) / mb;
+    result->sd_cmds_per_mb = (sd_stats.read_cmds + sd_stats.write_cmds) / mb;
+    g_results.push_back(*result);
+}
+
+/// Матрица размеров куска для одной нагрузки
+static void RunMatrix(Workload workload, ChunkResult* results) {
+    for (uint32_t i = 0; i < kChunkCount; i++) {
+        RunChunk(workload, kChunks[i], &results[i]);
+        std::printf("  %-13s chunk %5u  %7.2f MB/s  %7.1f cb/MB  %7.1f sd_cmd/MB\n",
+                    results[i].workload.c_str(), static_cast<unsigned>(kChunks[i]),
+                    results[i].mb_per_s, results[i].callbacks_per_mb,
+                    results[i].sd_cmds_per_mb);
+    }
+}
+
+void test_bench_seq_read_by_chunk() {
+    ChunkResult results[kChunkCount];
+    RunMatrix(Workload::SeqRead, results);
+    // Кусок — одна команда SD
+    TEST_ASSERT_EQUAL_DOUBLE(results[1].callbacks_per_mb, results[1].sd_cmds_per_mb);
+    TEST_ASSERT_TRUE(results[1].mb_per_s > 2.0 * results[0].mb_per_s);
+    TEST_ASSERT_TRUE(results[4].mb_per_s > results[1].mb_per_s);
+}
+
+void test_bench_seq_write_by_chunk() {
+    ChunkResult results[kChunkCount];
+    RunMatrix(Workload::SeqWrite, results);
+    TEST_ASSERT_TRUE(results[1].mb_per_s > 2.0 * results[0].mb_per_s);
+    TEST_ASSERT_TRUE(results[4].mb_per_s > results[1].mb_per_s);
+}
+
+void test_bench_random_read_by_chunk() {
+    ChunkResult results[kChunkCount];
+    RunMatrix(Workload::RandRead4k, results);
+    // Команда 4 KB целиком в куске от 4 KB: выше выигрыша нет
+    TEST_ASSERT_TRUE(results[1].mb_per_s > 2.0 * results[0].mb_per_s);
+    TEST_ASSERT_EQUAL_DOUBLE(results[1].mb_per_s, results[5].mb_per_s);
+}
+
+static std::string ToJson(const std::vector<ChunkResult>& results) {
+    std::string out = "[\n";
+    char line[200];
+    for (size_t i = 0; i < results.size(); i++) {
+        std::snprintf(line, sizeof(line),
+                      "  {\"workload\":\"%s\",\"chunk\":%u,\"mb_per_s\":%.3f,"
+                      "\"callbacks_per_mb\":%.1f,\"sd_cmds_per_mb\":%.1f}%s\n",
+                      results[i].workload.c_str(), static_cast<unsigned>(results[i].chunk),
+                      results[i].mb_per_s, results[i].callbacks_per_mb,
+                      results[i].sd_cmds_per_mb, i + 1 < results.size() ? "," : "");
+        out += line;
+    }
+    out += "]\n";
+    return out;
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_bench_seq_read_by_chunk);
+    RUN_TEST(test_bench_seq_write_by_chunk);
+    RUN_TEST(test_bench_random_read_by_chunk);
+
+    std::printf("BENCH_JSON_BEGIN\n%sBENCH_JSON_END\n", ToJson(g_results).c_str());
+
+    return UNITY_END();
+}
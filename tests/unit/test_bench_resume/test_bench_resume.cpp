@@ -0,0 +1,180 @@
+/**
+ * @file test_bench_resume.cpp
+ * @brief Латентность от resume шины до первого READ10 для политик suspend
+ *
+ * Запуск: pio test -e bench
+ * Хост MscHostSim приостанавливает шину, затем возобновляет её и сразу
+ * читает 4 KB; время — от HostResume() до CSW (tud_resume_cb и команда
+ * идут в одном Process()). Политики:
+ * - awake — suspend игнорируется, карта и SDMMC под питанием
+ * - reprobe — DeInit() в suspend, Init() в resume (идентификация карты)
+ * - fast — SdmmcBlockDevice::UsbSuspendHook (CMD7, восстановление из кэша)
+ * Результаты печатаются в JSON (между маркерами BENCH_JSON_BEGIN/END).
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_sdmmc.h"
+#include "sim/SdCardSim.hpp"
+#include "sim/TinyUsbSim.hpp"
+#include "stm32h7xx_hal.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using usb::SdmmcBlockDevice;
+using usb::UsbDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::SdCardSim;
+using usb::sim::SimTime;
+using usb::sim::TinyUsbSim;
+
+static constexpr uint32_t kCycles = 16;
+static constexpr uint16_t kReadBlocks = 8;
+
+enum class Policy : uint8_t {
+    Awake,
+    Reprobe,
+    Fast,
+};
+
+struct ResumeResult {
+    std::string policy;
+    double resume_to_read_us = 0.0;  ///< Среднее от HostResume() до CSW
+    double max_us = 0.0;
+    uint32_t card_inits = 0;         ///< Идентификаций карты за все циклы
+    bool clock_gated = false;        ///< SDMMC без тактирования в suspend
+};
+
+static std::vector<ResumeResult> g_results;
+static uint8_t g_data[kReadBlocks * 512];
+static uint8_t g_readback[kReadBlocks * 512];
+
+void setUp() {}
+void tearDown() {}
+
+static void PumpUsb(void* context) {
+    static_cast<UsbDevice*>(context)->Process();
+}
+
+static const char* PolicyName(Policy policy) {
+    switch (policy) {
+        case Policy::Awake:   return "awake";
+        case Policy::Reprobe: return "reprobe";
+        case Policy::Fast:    return "fast";
+    }
+    return "?";
+}
+
+/// Полная переинициализация: так ведёт себя прошивка без сохранения состояния
+static void ReprobeHook(bool suspended, void* context) {
+    SdmmcBlockDevice* sd = static_cast<SdmmcBlockDevice*>(context);
+    if (suspended) {
+        sd->DeInit();
+    } else {
+        sd->Init();
+    }
+}
+
+static void RunPolicy(Policy policy, ResumeResult* result) {
+    SimTime::Reset();
+    usb::sim::HalState::Reset();
+    TinyUsbSim::Get().Reset();
+
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    UsbDevice usb;
+    TEST_ASSERT_TRUE(usb.Init());
+    usb.MscAttach(sd);
+    if (policy == Policy::Reprobe) {
+        usb.SetSuspendCallback(ReprobeHook, &sd);
+    } else if (policy == Policy::Fast) {
+        usb.SetSuspendCallback(SdmmcBlockDevice::UsbSuspendHook, &sd);
+    }
+
+    MscHostSim host;
+    host.SetPump(PumpUsb, &usb);
+    for (uint32_t i = 0; i < sizeof(g_data); i++) {
+        g_data[i] = static_cast<uint8_t>(i * 31 + 7);
+    }
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(64, kReadBlocks, g_data));
+    card.ResetStats();
+
+    uint64_t total_us = 0;
+    uint64_t max_us = 0;
+    bool gated = true;
+    for (uint32_t cycle = 0; cycle < kCycles; cycle++) {
+        TinyUsbSim::Get().HostSuspend();
+        usb.Process();
+        TEST_ASSERT_EQUAL(usb::State::Suspended, usb.GetState());
+        gated = gated && !usb::sim::HalState::Get().sdmmc_clk[1];
+        SimTime::AdvanceUs(100000);  // Хост спит
+
+        const uint64_t start = SimTime::NowUs();
+        TinyUsbSim::Get().HostResume();
+        TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(64, kReadBlocks, g_readback));
+        const uint64_t elapsed = SimTime::NowUs() - start;
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(g_data, g_readback, sizeof(g_data));
+        total_us += elapsed;
+        max_us = elapsed > max_us ? elapsed : max_us;
+    }
+
+    result->policy = PolicyName(policy);
+    result->resume_to_read_us = static_cast<double>(total_us) / kCycles;
+    result->max_us = static_cast<double>(max_us);
+    result->card_inits = card.GetStats().init_count;
+    result->clock_gated = gated;
+    g_results.push_back(*result);
+    std::printf("  %-8s resume→read %10.1f us (max %10.1f)  inits %2u  clock gated %s\n",
+                result->policy.c_str(), result->resume_to_read_us, result->max_us,
+                static_cast<unsigned>(result->card_inits), gated ? "yes" : "no");
+}
+
+void test_bench_resume_to_first_read() {
+    ResumeResult awake;
+    ResumeResult reprobe;
+    ResumeResult fast;
+    RunPolicy(Policy::Awake, &awake);
+    RunPolicy(Policy::Reprobe, &reprobe);
+    RunPolicy(Policy::Fast, &fast);
+
+    TEST_ASSERT_FALSE(awake.clock_gated);
+    TEST_ASSERT_TRUE(reprobe.clock_gated);
+    TEST_ASSERT_TRUE(fast.clock_gated);
+    TEST_ASSERT_EQUAL_UINT32(kCycles, reprobe.card_inits);
+    TEST_ASSERT_EQUAL_UINT32(0, fast.card_inits);
+    // Быстрый resume — одна команда CMD7 сверх чтения
+    TEST_ASSERT_TRUE(fast.resume_to_read_us < reprobe.resume_to_read_us / 100.0);
+    TEST_ASSERT_TRUE(fast.resume_to_read_us < awake.resume_to_read_us + 100.0);
+}
+
+static std::string ToJson(const std::vector<ResumeResult>& results) {
+    std::string out = "[\n";
+    char line[200];
+    for (size_t i = 0; i < results.size(); i++) {
+        std::snprintf(line, sizeof(line),
+                      "  {\"policy\":\"%s\",\"resume_to_read_us\":%.1f,\"max_us\":%.1f,"
+                      "\"card_inits\":%u,\"clock_gated\":%s}%s\n",
+                      results[i].policy.c_str(), results[i].resume_to_read_us,
+                      results[i].max_us, static_cast<unsigned>(results[i].card_inits),
+                      results[i].clock_gated ? "true" : "false",
+                      i + 1 < results.size() ? "," : "");
+        out += line;
+    }
+    out += "]\n";
+    return out;
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_bench_resume_to_first_read);
+
+    std::printf("BENCH_JSON_BEGIN\n%sBENCH_JSON_END\n", ToJson(g_results).c_str());
+
+    return UNITY_END();
+}
@@ -0,0 +1,173 @@
+/**
+ * @file test_bench_rpc.cpp
+ * @brief Пропускная способность RPC в петле: кадров/с и MB/s по размеру данных
+ *
+ * Запуск: pio test -e bench
+ * Транспорты:
+ * - memory — Server::Feed() пачки из kPipeline запросов, ответы в память
+ *   (стоимость COBS + CRC + диспетчера)
+ * - cdc — через UsbDevice и модель TinyUSB: HostCdcSend → Process → RpcPoll
+ * Запрос — ping (эхо), MB/s считается по данным в обе стороны.
+ * Результаты печатаются в JSON (между маркерами BENCH_JSON_BEGIN/END).
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_rpc.h"
+#include "sim/TinyUsbSim.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using usb::UsbDevice;
+using usb::sim::TinyUsbSim;
+
+namespace rpc = usb::rpc;
+
+static constexpr uint32_t kPipeline = 32;  // Запросов в пачке без ожидания ответов
+static constexpr uint32_t kMinFrames = 20000;
+static constexpr int kRepeats = 3;
+
+struct RpcResult {
+    std::string transport;
+    uint32_t payload = 0;
+    double frames_per_s = 0.0;
+    double mb_per_s = 0.0;
+};
+
+static std::vector<RpcResult> g_results;
+
+/// Ответы: только счёт байт и разделителей
+struct CountSink {
+    uint64_t bytes = 0;
+    uint64_t frames = 0;
+};
+
+static bool CountWrite(const uint8_t* data, uint32_t len, void* context) {
+    auto* sink = static_cast<CountSink*>(context);
+    sink->bytes += len;
+    sink->frames += data[len - 1] == 0 ? 1 : 0;
+    return true;
+}
+
+static bool AppendWrite(const uint8_t* data, uint32_t len, void* context) {
+    auto* out = static_cast<std::vector<uint8_t>*>(context);
+    out->insert(out->end(), data, data + len);
+    return true;
+}
+
+/// kPipeline закодированных ping запросов подряд
+static std::vector<uint8_t> EncodeBatch(uint32_t payload) {
+    std::vector<uint8_t> data(payload);
+    for (uint32_t i = 0; i < payload; i++) {
+        data[i] = static_cast<uint8_t>(i * 7);  // Нули каждые 256 байт
+    }
+    std::vector<uint8_t> stream;
+    rpc::FrameWriter writer(&AppendWrite, &stream);
+    for (uint32_t i = 0; i < kPipeline; i++) {
+        writer.Begin(static_cast<uint16_t>(i), rpc::kMethodPing, 0);
+        writer.Write(data.data(), payload);
+        writer.End();
+    }
+    return stream;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void Record(const char* transport, uint32_t payload, uint64_t frames, double seconds) {
+    RpcResult result;
+    result.transport = transport;
+    result.payload = payload;
+    result.frames_per_s = static_cast<double>(frames) / seconds;
+    result.mb_per_s = result.frames_per_s * payload * 2 / 1e6;
+    g_results.push_back(result);
+}
+
+static const uint32_t kPayloads[] = {0, 16, 64, 256, rpc::kMaxPayload};
+
+void setUp() {}
+void tearDown() {}
+
+void test_bench_memory_loopback() {
+    for (uint32_t payload : kPayloads) {
+        const std::vector<uint8_t> batch = EncodeBatch(payload);
+        double best = 0.0;
+        uint64_t frames = 0;
+        for (int r = 0; r < kRepeats; r++) {
+            rpc::Server server;
+            CountSink sink;
+            server.SetWriter(&CountWrite, &sink);
+            auto start = std::chrono::steady_clock::now();
+            while (sink.frames < kMinFrames) {
+                server.Feed(batch.data(), static_cast<uint32_t>(batch.size()));
+            }
+            double seconds = Seconds(start);
+            TEST_ASSERT_EQUAL_UINT32(0, server.GetStats().crc_errors);
+            TEST_ASSERT_EQUAL_UINT64(sink.frames, server.GetStats().responses);
+            if (r == 0 || seconds < best) {
+                best = seconds;
+                frames = sink.frames;
+            }
+        }
+        Record("memory", payload, frames, best);
+    }
+}
+
+void test_bench_cdc_loopback() {
+    static UsbDevice usb;
+    for (uint32_t payload : kPayloads) {
+        TinyUsbSim::Get().Reset();
+        usb.Init();
+        rpc::Server server;
+        usb.RpcAttach(server);
+
+        const std::vector<uint8_t> batch = EncodeBatch(payload);
+        uint64_t frames = 0;
+        uint64_t received = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (frames < kMinFrames / 4) {
+            TinyUsbSim::Get().HostCdcSend(batch.data(), static_cast<uint32_t>(batch.size()));
+            usb.Process();
+            usb.RpcPoll();
+            received += TinyUsbSim::Get().HostCdcReceive().size();
+            frames += kPipeline;
+        }
+        double seconds = Seconds(start);
+        usb.RpcDetach();
+
+        TEST_ASSERT_EQUAL_UINT64(frames, server.GetStats().responses);
+        TEST_ASSERT_TRUE(received >= frames * (payload + rpc::kOverhead));
+        Record("cdc", payload, frames, seconds);
+    }
+}
+
+static std::string ToJson(const std::vector<RpcResult>& results) {
+    std::string out = "[\n";
+    char line[192];
+    for (size_t i = 0; i < results.size(); i++) {
+        std::snprintf(line, sizeof(line),
+                      "  {\"transport\":\"%s\",\"payload\":%u,\"frames_per_s\":%.0f,"
+                      "\"mb_per_s\":%.2f}%s\n",
+                      results[i].transport.c_str(), results[i].payload,
+                      results[i].frames_per_s, results[i].mb_per_s,
+                      i + 1 < results.size() ? "," : "");
+        out += line;
+    }
+    out += "]\n";
+    return out;
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_bench_memory_loopback);
+    RUN_TEST(test_bench_cdc_loopback);
+
+    std::printf("BENCH_JSON_BEGIN\n%sBENCH_JSON_END\n", ToJson(g_results).c_str());
+
+    return UNITY_END();
+}
@@ -0,0 +1,150 @@
+/**
+ * @file test_bench_trace_replay.cpp
+ * @brief Воспроизведение трассы SCSI команд против стеков IBlockDevice
+ *
+ * Запуск: pio test -e bench
+ * Трасса с реального устройства: MSC_TRACE=trace.csv pio test -e bench
+ * Результаты печатаются в JSON (между маркерами BENCH_JSON_BEGIN/END).
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "bench/BlockBench.hpp"
+#include "bench/TraceReplay.hpp"
+#include "mock/MockBlockDevice.hpp"
+#include "sim/TinyUsbSim.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace usb::bench;
+using usb::UsbDevice;
+using usb::mock::MockBlockDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::TinyUsbSim;
+
+static constexpr uint32_t kBlockCount = 65536;  // 32 MB
+
+static UsbDevice g_usb;
+static std::vector<TraceRecord> g_trace;
+static std::vector<BenchResult> g_results;
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_usb.Init();
+    g_usb.MscTraceClear();
+}
+
+void tearDown() {
+    g_usb.MscDetach();
+}
+
+static TimeSource MockTimeSource(MockBlockDevice& device) {
+    TimeSource ts;
+    ts.now_us = [](void* ctx) -> uint64_t {
+        return static_cast<MockBlockDevice*>(ctx)->GetModelledTimeUs();
+    };
+    ts.context = &device;
+    return ts;
+}
+
+/// Прогон нагрузки через MSC хоста (SYNC в BOT не моделируется)
+static void HostRun(MscHostSim& host, const Workload& w) {
+    std::vector<uint8_t> buf;
+    for (const auto& op : w.ops) {
+        if (op.kind == IoKind::Sync) {
+            continue;
+        }
+        buf.resize(op.count * 512);
+        CswStatus status = op.kind == IoKind::Read
+                               ? host.Read10(op.lba, static_cast<uint16_t>(op.count), buf.data())
+                               : host.Write10(op.lba, static_cast<uint16_t>(op.count), buf.data());
+        TEST_ASSERT_EQUAL(CswStatus::Passed, status);
+    }
+}
+
+static size_t DataOps(const Workload& w) {
+    size_t n = 0;
+    for (const auto& op : w.ops) {
+        n += op.kind != IoKind::Sync ? 1 : 0;
+    }
+    return n;
+}
+
+void test_capture_trace_over_cdc() {
+    MockBlockDevice disk(kBlockCount, 512);
+    g_usb.MscAttach(&disk);
+
+    WorkloadParams p;
+    p.block_count = kBlockCount;
+    p.total_bytes = 512u << 10;  // трасса должна поместиться в кольцо
+    Workload mount = MakeMacosMount(p);
+    Workload copy = MakeFat32Copy(p);
+
+    MscHostSim host;
+    HostRun(host, mount);
+    HostRun(host, copy);
+    const size_t expected = DataOps(mount) + DataOps(copy);
+    TEST_ASSERT_LESS_OR_EQUAL(usb::kMscTraceDepth, expected);
+
+    TEST_ASSERT_TRUE(g_usb.MscTraceDumpCdc());
+    auto received = TinyUsbSim::Get().HostCdcReceive();
+    g_trace = ParseTraceCsv(std::string(received.begin(), received.end()));
+
+    TraceSummary s = Summarize(g_trace);
+    TEST_ASSERT_EQUAL_UINT32(expected, s.records);
+    TEST_ASSERT_EQUAL_UINT32(0, s.failed);
+    TEST_ASSERT_GREATER_THAN(0, s.blocks_written);
+}
+
+void test_replay_trace_on_mock() {
+    TEST_ASSERT_GREATER_THAN(0, g_trace.size());
+    Workload w = TraceToWorkload(g_trace, "trace_macos_fat32");
+
+    MockBlockDevice device(kBlockCount, 512);
+    device.SetLatencyModel(200, 25, 60);
+    CountingBlockDevice counter(device);
+
+    BenchResult r = RunWorkload(counter, w, MockTimeSource(device), &counter, "mock");
+    TEST_ASSERT_EQUAL_UINT64(0, r.errors);
+    TEST_ASSERT_EQUAL_UINT64(w.ops.size(), r.ops);
+    TEST_ASSERT_GREATER_THAN(0, r.elapsed_us);
+    g_results.push_back(r);
+}
+
+void test_replay_trace_file_from_env() {
+    const char* path = std::getenv("MSC_TRACE");
+    if (path == nullptr) {
+        TEST_IGNORE();
+    }
+    auto records = LoadTraceCsv(path);
+    TEST_ASSERT_GREATER_THAN(0, records.size());
+
+    uint32_t max_lba = 0;
+    for (const auto& rec : records) {
+        if (rec.lba + rec.blocks > max_lba) {
+            max_lba = rec.lba + rec.blocks;
+        }
+    }
+    MockBlockDevice device(max_lba > kBlockCount ? max_lba : kBlockCount, 512);
+    device.SetLatencyModel(200, 25, 60);
+    CountingBlockDevice counter(device);
+
+    BenchResult r = RunWorkload(counter, TraceToWorkload(records, path), MockTimeSource(device),
+                                &counter, "mock");
+    TEST_ASSERT_EQUAL_UINT64(0, r.errors);
+    g_results.push_back(r);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_capture_trace_over_cdc);
+    RUN_TEST(test_replay_trace_on_mock);
+    RUN_TEST(test_replay_trace_file_from_env);
+
+    std::printf("BENCH_JSON_BEGIN\n%sBENCH_JSON_END\n", ToJson(g_results).c_str());
+
+    return UNITY_END();
+}
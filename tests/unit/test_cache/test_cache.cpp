@@ -0,0 +1,248 @@
+/**
+ * @file test_cache.cpp
+ * @brief Unit тесты usb_cache.h и SdmmcBlockDevice в режиме IDMA
+ */
+
+#include <unity.h>
+#include "usb_cache.h"
+#include "usb_sdmmc.h"
+#include "sim/SdCardSim.hpp"
+#include "stm32h7xx_hal.h"
+
+#include <cstring>
+#include <sys/mman.h>
+
+using usb::SdmmcBlockDevice;
+using usb::SdmmcConfig;
+using usb::cache::CacheStats;
+using usb::cache::DmaBuffer;
+using usb::sim::SdCardSim;
+using usb::sim::SdFaultOp;
+using usb::sim::SimTime;
+
+namespace cache = usb::cache;
+
+void setUp() {
+    SimTime::Reset();
+    usb::sim::HalState::Reset();
+    cache::ResetCacheStats();
+}
+
+void tearDown() {
+}
+
+static void FillPattern(uint8_t* buf, uint32_t len, uint8_t seed) {
+    for (uint32_t i = 0; i < len; i++) {
+        buf[i] = static_cast<uint8_t>(seed + i * 7);
+    }
+}
+
+static SdmmcConfig DmaConfig() {
+    SdmmcConfig config;
+    config.use_dma = true;
+    return config;
+}
+
+void test_dma_buffer_occupies_whole_lines() {
+    DmaBuffer<64> a;
+    DmaBuffer<512> b;
+    TEST_ASSERT_EQUAL_UINT32(64, sizeof(a));
+    TEST_ASSERT_EQUAL_UINT32(512, DmaBuffer<512>::Size());
+    TEST_ASSERT_EQUAL_UINT32(cache::kLineSize, alignof(DmaBuffer<512>));
+    TEST_ASSERT_TRUE(cache::IsLineAligned(a.data, sizeof(a.data)));
+    TEST_ASSERT_TRUE(cache::IsLineAligned(b.data, sizeof(b.data)));
+    TEST_ASSERT_FALSE(cache::IsLineAligned(b.data + 4, 32));
+    TEST_ASSERT_FALSE(cache::IsLineAligned(b.data, 48));
+    TEST_ASSERT_EQUAL_UINT32(0, cache::LineAlignUp(0));
+    TEST_ASSERT_EQUAL_UINT32(32, cache::LineAlignUp(1));
+    TEST_ASSERT_EQUAL_UINT32(64, cache::LineAlignUp(33));
+}
+
+void test_range_widens_to_cache_lines() {
+    DmaBuffer<128> buf = {};
+    cache::Clean(buf.data, 64);
+    TEST_ASSERT_EQUAL_UINT32(64, cache::GetCacheStats().bytes);
+
+    // 1 байт на стыке строк — две строки
+    cache::ResetCacheStats();
+    cache::Invalidate(buf.data + 31, 2);
+    TEST_ASSERT_EQUAL_UINT32(64, cache::GetCacheStats().bytes);
+
+    cache::ResetCacheStats();
+    cache::CleanInvalidate(buf.data + 8, 100);
+    TEST_ASSERT_EQUAL_UINT32(128, cache::GetCacheStats().bytes);
+
+    cache::ResetCacheStats();
+    cache::Clean(buf.data, 0);
+    TEST_ASSERT_EQUAL_UINT32(0, cache::GetCacheStats().clean);
+}
+
+void test_dma_helpers_map_to_cache_operations() {
+    DmaBuffer<32> buf = {};
+    cache::PrepareTx(buf.data, sizeof(buf.data));
+    cache::PrepareRx(buf.data, sizeof(buf.data));
+    cache::CompleteRx(buf.data, sizeof(buf.data));
+    CacheStats stats = cache::GetCacheStats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.clean);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.clean_invalidate);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.invalidate);
+    TEST_ASSERT_FALSE(cache::IsEnabled());
+}
+
+void test_mpu_region_size_field() {
+    static_assert(cache::MpuRegionSizeField(32) == 4, "32 B");
+    TEST_ASSERT_EQUAL_UINT8(4, cache::MpuRegionSizeField(32));
+    TEST_ASSERT_EQUAL_UINT8(9, cache::MpuRegionSizeField(1024));
+    TEST_ASSERT_EQUAL_UINT8(17, cache::MpuRegionSizeField(256 * 1024));
+    TEST_ASSERT_EQUAL_UINT8(30, cache::MpuRegionSizeField(0x80000000U));
+    TEST_ASSERT_EQUAL_UINT8(0, cache::MpuRegionSizeField(16));
+    TEST_ASSERT_EQUAL_UINT8(0, cache::MpuRegionSizeField(288 * 1024));
+}
+
+void test_mpu_rejects_unaligned_regions() {
+    TEST_ASSERT_TRUE(cache::ConfigureNonCacheable(0, 0x30000000U, 256 * 1024));
+    TEST_ASSERT_TRUE(cache::ConfigureNonCacheable(15, 0x30040000U, 32 * 1024));
+    TEST_ASSERT_FALSE(cache::ConfigureNonCacheable(0, 0x30020000U, 256 * 1024));
+    TEST_ASSERT_FALSE(cache::ConfigureNonCacheable(0, 0x30000000U, 288 * 1024));
+    TEST_ASSERT_FALSE(cache::ConfigureNonCacheable(16, 0x30000000U, 1024));
+}
+
+void test_sdmmc_dma_roundtrip_maintains_cache() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init(DmaConfig()));
+    TEST_ASSERT_TRUE(usb::sim::HalState::Get().sdmmc_irq_enabled[1]);
+
+    DmaBuffer<4 * 512> wbuf;
+    DmaBuffer<4 * 512> rbuf;
+    FillPattern(wbuf.data, sizeof(wbuf.data), 0x21);
+    cache::ResetCacheStats();
+
+    TEST_ASSERT_TRUE(sd.Write(200, wbuf.data, 4));
+    TEST_ASSERT_TRUE(sd.Read(200, rbuf.data, 4));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(wbuf.data, rbuf.data, sizeof(wbuf.data));
+    TEST_ASSERT_EQUAL_UINT32(2, usb::sim::HalState::Get().sd_dma_transfers);
+
+    // По операции на команду, буферы пользователя — без копии через phys_buffer
+    CacheStats stats = cache::GetCacheStats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.clean);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.clean_invalidate);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.invalidate);
+    TEST_ASSERT_EQUAL_UINT32(3 * 4 * 512, stats.bytes);
+
+    sd.DeInit();
+    TEST_ASSERT_FALSE(usb::sim::HalState::Get().sdmmc_irq_enabled[1]);
+}
+
+void test_sdmmc_dma_unaligned_buffer_goes_through_phys_buffer() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init(DmaConfig()));
+
+    DmaBuffer<6 * 512 + 32> wbuf;
+    DmaBuffer<6 * 512 + 32> rbuf;
+    uint8_t* src = wbuf.data + 4;
+    uint8_t* dst = rbuf.data + 4;
+    FillPattern(src, 6 * 512, 0x42);
+
+    TEST_ASSERT_TRUE(sd.Write(7, src, 6));
+    TEST_ASSERT_TRUE(sd.Read(7, dst, 6));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(src, dst, 6 * 512);
+
+    uint8_t peek[512];
+    card.PeekBlock(12, peek);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(src + 5 * 512, peek, 512);
+    // Куски по 4 блока (phys_buffer 2 KB): 4 + 2 на запись и на чтение
+    TEST_ASSERT_EQUAL_UINT32(4, usb::sim::HalState::Get().sd_dma_transfers);
+}
+
+/// Буфер IDMA по адресу SRAM D2: страница хоста на 0x30000000
+static uint8_t* MapD2Sram(size_t size) {
+    void* addr = mmap(reinterpret_cast<void*>(0x30000000U), size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    return addr == reinterpret_cast<void*>(0x30000000U) ? static_cast<uint8_t*>(addr) : nullptr;
+}
+
+/// Записать и прочитать 6 блоков из SRAM D2 через SDMMC index, число передач IDMA
+static void D2SramRoundtrip(uint8_t index, uint8_t* buf, uint32_t* transfers) {
+    usb::sim::HalState::Reset();
+    SdCardSim card;
+    card.Attach(index);
+    SdmmcBlockDevice sd;
+    SdmmcConfig config = DmaConfig();
+    config.sdmmc_index = index;
+    TEST_ASSERT_TRUE(sd.Init(config));
+
+    FillPattern(buf, 6 * 512, static_cast<uint8_t>(0x60 + index));
+    TEST_ASSERT_TRUE(sd.Write(40, buf, 6));
+    std::memset(buf, 0, 6 * 512);
+    TEST_ASSERT_TRUE(sd.Read(40, buf, 6));
+    uint8_t expected[6 * 512];
+    FillPattern(expected, sizeof(expected), static_cast<uint8_t>(0x60 + index));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, buf, sizeof(expected));
+    *transfers = usb::sim::HalState::Get().sd_dma_transfers;
+}
+
+void test_sdmmc1_dma_bounces_d2_sram_buffer() {
+    const size_t size = 4096 * 2;
+    uint8_t* d2 = MapD2Sram(size);
+    if (d2 == nullptr) {
+        TEST_IGNORE();  // Адрес занят на этом хосте
+    }
+    // SDMMC1 не видит SRAM D2: куски по 4 блока через phys_buffer (4 + 2 на
+    // запись и на чтение); SDMMC2 пишет и читает её напрямую
+    uint32_t sdmmc1 = 0;
+    uint32_t sdmmc2 = 0;
+    D2SramRoundtrip(1, d2, &sdmmc1);
+    D2SramRoundtrip(2, d2, &sdmmc2);
+    munmap(d2, size);
+    TEST_ASSERT_EQUAL_UINT32(4, sdmmc1);
+    TEST_ASSERT_EQUAL_UINT32(2, sdmmc2);
+}
+
+void test_sdmmc_dma_read_error_is_reported() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init(DmaConfig()));
+    TEST_ASSERT_TRUE(card.InjectFault(SdFaultOp::Read, 10, 1, 1));
+
+    DmaBuffer<512> buf;
+    TEST_ASSERT_FALSE(sd.Read(10, buf.data, 1));
+    TEST_ASSERT_EQUAL_UINT32(SdCardSim::kErrorDataCrc, sd.GetDiagnostics().hal_error);
+    TEST_ASSERT_TRUE(sd.Read(10, buf.data, 1));
+}
+
+void test_sdmmc_polling_mode_skips_cache_maintenance() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    TEST_ASSERT_FALSE(usb::sim::HalState::Get().sdmmc_irq_enabled[1]);
+
+    DmaBuffer<512> buf;
+    FillPattern(buf.data, sizeof(buf.data), 0x05);
+    TEST_ASSERT_TRUE(sd.Write(3, buf.data, 1));
+    TEST_ASSERT_TRUE(sd.Read(3, buf.data, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, usb::sim::HalState::Get().sd_dma_transfers);
+    TEST_ASSERT_EQUAL_UINT32(0, cache::GetCacheStats().bytes);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_dma_buffer_occupies_whole_lines);
+    RUN_TEST(test_range_widens_to_cache_lines);
+    RUN_TEST(test_dma_helpers_map_to_cache_operations);
+    RUN_TEST(test_mpu_region_size_field);
+    RUN_TEST(test_mpu_rejects_unaligned_regions);
+    RUN_TEST(test_sdmmc_dma_roundtrip_maintains_cache);
+    RUN_TEST(test_sdmmc_dma_unaligned_buffer_goes_through_phys_buffer);
+    RUN_TEST(test_sdmmc1_dma_bounces_d2_sram_buffer);
+    RUN_TEST(test_sdmmc_dma_read_error_is_reported);
+    RUN_TEST(test_sdmmc_polling_mode_skips_cache_maintenance);
+
+    return UNITY_END();
+}
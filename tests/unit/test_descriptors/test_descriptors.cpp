@@ -0,0 +1,293 @@
+/**
+ * @file test_descriptors.cpp
+ * @brief Unit тесты constexpr сборки USB дескрипторов и строк из Config (usb_descriptors.h)
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_descriptors.h"
+#include "sim/TinyUsbSim.hpp"
+
+#include <string>
+
+using usb::UsbDevice;
+using usb::sim::TinyUsbSim;
+
+namespace desc = usb::desc;
+
+using CdcMsc = desc::Configuration<desc::Cdc<4>, desc::Msc<5>>;
+using CdcMscVendor = desc::Configuration<desc::Cdc<4>, desc::Msc<5>, desc::Vendor<6>>;
+using MscOnly = desc::Configuration<desc::None, desc::Msc<5>>;
+
+// Собирается целиком при компиляции
+static constexpr auto kCdcMsc = CdcMsc::Build();
+static_assert(kCdcMsc.size() == 98, "CDC + MSC layout changed");
+static_assert(CdcMsc::Interface<1>() == 2 && CdcMsc::Endpoint<1>() == 3, "MSC numbering");
+
+// UID чипа для native сборки (weak UsbReadChipUid() возвращает false)
+static bool g_uid_available = true;
+
+extern "C" bool UsbReadChipUid(uint32_t uid[3]) {
+    uid[0] = 0x00350041;
+    uid[1] = 0x3138510B;
+    uid[2] = 0x37363830;
+    return g_uid_available;
+}
+
+/// Строковый дескриптор → UTF-8 (только ASCII и кириллица для проверок)
+static std::string Decode(const uint16_t* descriptor) {
+    std::string text;
+    const size_t chars = ((descriptor[0] & 0xFF) - 2) / 2;
+    for (size_t i = 1; i <= chars; i++) {
+        const uint16_t c = descriptor[i];
+        if (c < 0x80) {
+            text += static_cast<char>(c);
+        } else {
+            text += static_cast<char>(0xC0 | (c >> 6));
+            text += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return text;
+}
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_uid_available = true;
+}
+
+void tearDown() {}
+
+void test_cdc_msc_matches_tinyusb_layout() {
+    // Байт в байт с прежними TUD_CONFIG/TUD_CDC/TUD_MSC_DESCRIPTOR
+    static const uint8_t expected[98] = {
+        9, 2, 98, 0, 3, 1, 0, 0x80, 50,
+        // IAD + CDC control (itf 0, notify EP 0x81)
+        8, 11, 0, 2, 2, 2, 0, 0,
+        9, 4, 0, 0, 1, 2, 2, 0, 4,
+        5, 36, 0, 0x20, 0x01,
+        5, 36, 1, 0, 1,
+        4, 36, 2, 6,
+        5, 36, 6, 0, 1,
+        7, 5, 0x81, 3, 8, 0, 16,
+        // CDC data (itf 1, EP 0x02/0x82)
+        9, 4, 1, 0, 2, 10, 0, 0, 0,
+        7, 5, 0x02, 2, 64, 0, 0,
+        7, 5, 0x82, 2, 64, 0, 0,
+        // MSC (itf 2, EP 0x03/0x83)
+        9, 4, 2, 0, 2, 8, 6, 0x50, 5,
+        7, 5, 0x03, 2, 64, 0, 0,
+        7, 5, 0x83, 2, 64, 0, 0,
+    };
+    TEST_ASSERT_EQUAL_UINT32(sizeof(expected), kCdcMsc.size());
+    TEST_ASSERT_EQUAL_MEMORY(expected, kCdcMsc.data(), sizeof(expected));
+}
+
+void test_vendor_function_is_numbered_after_msc() {
+    constexpr auto config = CdcMscVendor::Build();
+    TEST_ASSERT_EQUAL_UINT32(98 + 23, config.size());
+    TEST_ASSERT_EQUAL_UINT8(4, config[4]);  // bNumInterfaces
+    TEST_ASSERT_EQUAL_UINT8(3, CdcMscVendor::Interface<2>());
+    TEST_ASSERT_EQUAL_UINT8(4, CdcMscVendor::Endpoint<2>());
+
+    const uint8_t* vendor = config.data() + 98;
+    TEST_ASSERT_EQUAL_UINT8(3, vendor[2]);     // bInterfaceNumber
+    TEST_ASSERT_EQUAL_UINT8(0xFF, vendor[5]);  // bInterfaceClass
+    TEST_ASSERT_EQUAL_UINT8(6, vendor[8]);     // iInterface
+    TEST_ASSERT_EQUAL_UINT8(0x04, vendor[9 + 2]);
+    TEST_ASSERT_EQUAL_UINT8(0x84, vendor[16 + 2]);
+}
+
+void test_dfu_runtime_interface_after_msc() {
+    using WithDfu = desc::Configuration<desc::Cdc<4>, desc::Msc<5>,
+                                        desc::Dfu<7, desc::kDfuProtocolRuntime, 0x0D, 1024>>;
+    constexpr auto config = WithDfu::Build();
+    TEST_ASSERT_EQUAL_UINT32(98 + 18, config.size());
+    TEST_ASSERT_EQUAL_UINT8(4, config[4]);  // bNumInterfaces
+    TEST_ASSERT_EQUAL_UINT8(3, WithDfu::Interface<2>());
+
+    const uint8_t* dfu = config.data() + 98;
+    TEST_ASSERT_EQUAL_UINT8(0, dfu[4]);      // Без endpoint'ов: только EP0
+    TEST_ASSERT_EQUAL_UINT8(0xFE, dfu[5]);   // Application Specific
+    TEST_ASSERT_EQUAL_UINT8(0x01, dfu[6]);   // DFU
+    TEST_ASSERT_EQUAL_UINT8(0x01, dfu[7]);   // Runtime
+    TEST_ASSERT_EQUAL_UINT8(7, dfu[8]);
+    TEST_ASSERT_EQUAL_UINT8(0x21, dfu[9 + 1]);
+    TEST_ASSERT_EQUAL_UINT8(0x0D, dfu[9 + 2]);
+    TEST_ASSERT_EQUAL_UINT8(0x00, dfu[9 + 5]);  // wTransferSize 1024
+    TEST_ASSERT_EQUAL_UINT8(0x04, dfu[9 + 6]);
+    TEST_ASSERT_EQUAL_UINT8(0x10, dfu[9 + 7]);  // bcdDFUVersion 1.1
+    TEST_ASSERT_EQUAL_UINT8(0x01, dfu[9 + 8]);
+
+    using DfuMode = desc::Configuration<desc::Dfu<7, desc::kDfuProtocolMode, 0x0D, 1024>>;
+    constexpr auto mode = DfuMode::Build();
+    TEST_ASSERT_EQUAL_UINT32(9 + 18, mode.size());
+    TEST_ASSERT_EQUAL_UINT8(0x02, mode[9 + 7]);
+    constexpr auto device = desc::BuildDevice<DfuMode>(desc::DeviceParams{});
+    TEST_ASSERT_EQUAL_UINT8(0, device[4]);  // Класс задаёт интерфейс
+}
+
+void test_none_removes_function() {
+    constexpr auto config = MscOnly::Build();
+    TEST_ASSERT_EQUAL_UINT32(9 + 23, config.size());
+    TEST_ASSERT_EQUAL_UINT8(1, config[4]);
+    TEST_ASSERT_EQUAL_UINT8(0, MscOnly::Interface<1>());
+    TEST_ASSERT_EQUAL_UINT8(1, MscOnly::Endpoint<1>());
+    TEST_ASSERT_EQUAL_UINT8(0x01, config[9 + 9 + 2]);
+    TEST_ASSERT_EQUAL_UINT8(0x81, config[9 + 16 + 2]);
+}
+
+void test_device_class_follows_composition() {
+    constexpr auto composite = desc::BuildDevice<CdcMsc>(desc::DeviceParams{});
+    TEST_ASSERT_EQUAL_UINT8(18, composite[0]);
+    TEST_ASSERT_EQUAL_UINT8(0xEF, composite[4]);
+    TEST_ASSERT_EQUAL_UINT8(0x02, composite[5]);
+    TEST_ASSERT_EQUAL_UINT8(0x01, composite[6]);
+    TEST_ASSERT_EQUAL_UINT8(0x83, composite[8]);  // VID 0x0483, little-endian
+    TEST_ASSERT_EQUAL_UINT8(0x04, composite[9]);
+
+    desc::DeviceParams params;
+    params.pid = 0x1234;
+    constexpr auto single = desc::BuildDevice<MscOnly>(desc::DeviceParams{});
+    TEST_ASSERT_EQUAL_UINT8(0, single[4]);  // Класс задаёт интерфейс
+    auto custom = desc::BuildDevice<MscOnly>(params);
+    TEST_ASSERT_EQUAL_UINT8(0x34, custom[10]);
+    TEST_ASSERT_EQUAL_UINT8(0x12, custom[11]);
+}
+
+void test_config_params_and_budget() {
+    desc::ConfigParams params;
+    params.attributes = 0x20;
+    params.power_ma = 500;
+    auto config = CdcMsc::Build(params);
+    TEST_ASSERT_EQUAL_UINT8(0xA0, config[7]);
+    TEST_ASSERT_EQUAL_UINT8(250, config[8]);
+
+    TEST_ASSERT_EQUAL_UINT8(3, CdcMsc::kInterfaceCount);
+    TEST_ASSERT_EQUAL_UINT8(3, CdcMsc::kEndpointNumbers);
+    TEST_ASSERT_TRUE(CdcMsc::kUsesIad);
+    TEST_ASSERT_FALSE(MscOnly::kUsesIad);
+    // RX: 15 + 2 * 16 + 2 * 4 слов; TX: EP0 + notify + CDC IN + MSC IN
+    TEST_ASSERT_EQUAL_UINT32((15 + 32 + 8) * 4 + 64 + 8 + 64 + 64, CdcMsc::kFifoUsage);
+    TEST_ASSERT_TRUE(CdcMscVendor::kFifoUsage <= desc::kFifoBytes);
+}
+
+void test_macro_strings_are_compile_time() {
+    static constexpr auto kProduct = desc::StringDescriptor("USB Composite");
+    static_assert(kProduct[0] == ((0x03 << 8) | (2 * 13 + 2)), "bLength / bDescriptorType");
+    static_assert(kProduct[1] == 'U' && kProduct[13] == 'e', "UTF-16 characters");
+    TEST_ASSERT_EQUAL_STRING("USB Composite", Decode(kProduct.data()).c_str());
+
+    // UTF-8: 2 байта на символ в литерале, 1 символ UTF-16 в дескрипторе
+    static constexpr auto kRussian = desc::StringDescriptor("Диск");
+    TEST_ASSERT_EQUAL_HEX16(0x030A, kRussian[0]);
+    TEST_ASSERT_EQUAL_HEX16(0x0414, kRussian[1]);
+    TEST_ASSERT_EQUAL_STRING("Диск", Decode(kRussian.data()).c_str());
+
+    uint16_t out[4] = {0};
+    TEST_ASSERT_EQUAL_UINT32(3, desc::EncodeUtf16("a\xF0\x9F\x98\x80" "b", out, 4));
+    TEST_ASSERT_EQUAL_HEX16('?', out[1]);  // Вне BMP
+    TEST_ASSERT_EQUAL_HEX16('b', out[2]);
+}
+
+void test_string_table_arena() {
+    desc::StringTable<16> table;
+    TEST_ASSERT_NULL(table.Get(1));
+    TEST_ASSERT_TRUE(table.Set(1, "Vendor"));
+    TEST_ASSERT_EQUAL_UINT32(7, table.ArenaUsed());
+    TEST_ASSERT_EQUAL_STRING("Vendor", Decode(table.Get(1)).c_str());
+
+    // Не влезает — слот не меняется, арена тоже
+    TEST_ASSERT_FALSE(table.Set(2, "0123456789"));
+    TEST_ASSERT_NULL(table.Get(2));
+    TEST_ASSERT_EQUAL_UINT32(7, table.ArenaUsed());
+    TEST_ASSERT_FALSE(table.Set(desc::kStringSlots, "x"));
+    TEST_ASSERT_NULL(table.Get(desc::kStringSlots));
+
+    TEST_ASSERT_TRUE(table.SetStatic(0, desc::kLanguageDescriptor.data()));
+    TEST_ASSERT_EQUAL_HEX16(0x0409, table.Get(0)[1]);
+    table.Clear();
+    TEST_ASSERT_NULL(table.Get(0));
+    TEST_ASSERT_EQUAL_UINT32(0, table.ArenaUsed());
+
+    // Длинная строка обрезается до kMaxStringChars
+    desc::StringTable<256> big;
+    std::string longest(200, 'x');
+    TEST_ASSERT_TRUE(big.Set(1, longest.c_str()));
+    TEST_ASSERT_EQUAL_HEX16(0x03FE, big.Get(1)[0]);
+}
+
+void test_init_applies_config_strings() {
+    usb::Config cfg;
+    cfg.vid = 0x1209;
+    cfg.pid = 0x0001;
+    cfg.manufacturer = "Acme";
+    cfg.product = "Логгер";
+    cfg.serial = "SN-42";
+    UsbDevice usb;
+    TEST_ASSERT_TRUE(usb.Init(cfg));
+
+    const desc::RuntimeDescriptors& rt = desc::Runtime();
+    TEST_ASSERT_EQUAL_HEX16(0x1209, rt.vid);
+    TEST_ASSERT_EQUAL_HEX16(0x0001, rt.pid);
+    TEST_ASSERT_EQUAL_STRING("Acme", Decode(rt.strings.Get(desc::kStrManufacturer)).c_str());
+    TEST_ASSERT_EQUAL_STRING("Логгер", Decode(rt.strings.Get(desc::kStrProduct)).c_str());
+    TEST_ASSERT_EQUAL_STRING("SN-42", Decode(rt.strings.Get(desc::kStrSerial)).c_str());
+    TEST_ASSERT_EQUAL_STRING(USB_STR_CDC, Decode(rt.strings.Get(desc::kStrCdc)).c_str());
+    TEST_ASSERT_EQUAL_HEX16(0x0409, rt.strings.Get(desc::kStrLanguage)[1]);
+    TEST_ASSERT_EQUAL_STRING(USB_STR_VENDOR, Decode(rt.strings.Get(desc::kStrVendor)).c_str());
+    TEST_ASSERT_EQUAL_STRING(USB_STR_DFU, Decode(rt.strings.Get(desc::kStrDfu)).c_str());
+    TEST_ASSERT_NULL(rt.strings.Get(desc::kStringSlots));
+    TEST_ASSERT_EQUAL_UINT32(5 + 7 + 6, usb.GetDiagnostics().string_arena_used);
+
+    // Повторный запрос — тот же готовый дескриптор
+    TEST_ASSERT_EQUAL_PTR(rt.strings.Get(desc::kStrProduct), rt.strings.Get(desc::kStrProduct));
+}
+
+void test_default_strings_stay_in_flash_and_serial_from_uid() {
+    UsbDevice usb;
+    TEST_ASSERT_TRUE(usb.Init());
+    const desc::RuntimeDescriptors& rt = desc::Runtime();
+    TEST_ASSERT_EQUAL_HEX16(USB_VID, rt.vid);
+    TEST_ASSERT_EQUAL_STRING(USB_STR_PRODUCT, Decode(rt.strings.Get(desc::kStrProduct)).c_str());
+    TEST_ASSERT_EQUAL_STRING("003500413138510B37363830",
+                             Decode(rt.strings.Get(desc::kStrSerial)).c_str());
+    TEST_ASSERT_EQUAL_UINT32(25, usb.GetDiagnostics().string_arena_used);  // Только UID
+}
+
+void test_serial_without_uid_and_oversized_strings() {
+    g_uid_available = false;
+    {
+        UsbDevice usb;
+        TEST_ASSERT_TRUE(usb.Init());
+        TEST_ASSERT_EQUAL_STRING(USB_STR_SERIAL,
+                                 Decode(desc::Runtime().strings.Get(desc::kStrSerial)).c_str());
+        TEST_ASSERT_EQUAL_UINT32(0, usb.GetDiagnostics().string_arena_used);
+    }
+
+    std::string product(desc::kMaxStringChars, 'p');
+    std::string manufacturer(desc::kMaxStringChars, 'm');
+    usb::Config cfg;
+    cfg.product = product.c_str();
+    cfg.manufacturer = manufacturer.c_str();
+    UsbDevice usb;
+    TEST_ASSERT_FALSE(usb.Init(cfg));  // 2 * 127 слов > USB_DESC_STRING_ARENA
+    TEST_ASSERT_NULL(UsbDevice::Instance(0));
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_cdc_msc_matches_tinyusb_layout);
+    RUN_TEST(test_vendor_function_is_numbered_after_msc);
+    RUN_TEST(test_dfu_runtime_interface_after_msc);
+    RUN_TEST(test_none_removes_function);
+    RUN_TEST(test_device_class_follows_composition);
+    RUN_TEST(test_config_params_and_budget);
+    RUN_TEST(test_macro_strings_are_compile_time);
+    RUN_TEST(test_string_table_arena);
+    RUN_TEST(test_init_applies_config_strings);
+    RUN_TEST(test_default_strings_stay_in_flash_and_serial_from_uid);
+    RUN_TEST(test_serial_without_uid_and_oversized_strings);
+
+    return UNITY_END();
+}
@@ -0,0 +1,377 @@
+/**
+ * @file test_dfu.cpp
+ * @brief Unit тесты DFU: DfuFlash (двойная буферизация), конечный автомат
+ *        TinyUSB и переключение runtime ↔ DFU mode через UsbDevice
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_dfu.h"
+#include "sim/FlashSim.hpp"
+#include "sim/TinyUsbSim.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using usb::DfuConfig;
+using usb::DfuFlash;
+using usb::DfuStats;
+using usb::UsbDevice;
+using usb::sim::DfuHostSim;
+using usb::sim::DfuHostStats;
+using usb::sim::DfuStatusReply;
+using usb::sim::FlashSim;
+using usb::sim::FlashSimConfig;
+using usb::sim::SimTime;
+using usb::sim::TinyUsbSim;
+
+namespace dfu = usb::dfu;
+
+static constexpr uint32_t kFlashBase = 0x08000000;
+static constexpr uint32_t kSectorSize = 16 * 1024;
+static constexpr uint32_t kAppAddress = kFlashBase + kSectorSize;  // Сектор 0 — загрузчик
+static constexpr uint16_t kBlock = DfuFlash::kTransferSize;
+
+static UsbDevice g_usb;
+
+static uint8_t State(dfu::State state) { return static_cast<uint8_t>(state); }
+static uint8_t Status(dfu::Status status) { return static_cast<uint8_t>(status); }
+
+/// 256 KB, секторы по 16 KB, стирание 20 мс
+static FlashSimConfig SmallFlash() {
+    FlashSimConfig cfg;
+    cfg.size = 256 * 1024;
+    cfg.sector_size = kSectorSize;
+    cfg.erase_us = 20000;
+    return cfg;
+}
+
+static DfuConfig AppConfig() {
+    DfuConfig cfg;
+    cfg.app_address = kAppAddress;
+    return cfg;
+}
+
+static std::vector<uint8_t> MakeImage(uint32_t len, uint8_t seed) {
+    std::vector<uint8_t> image(len);
+    for (uint32_t i = 0; i < len; i++) {
+        image[i] = static_cast<uint8_t>(seed + i * 7 + (i >> 8));
+    }
+    return image;
+}
+
+/// Main loop устройства между шагами хоста
+static void PumpDevice(void*) {
+    g_usb.Process();
+    g_usb.DfuPoll();
+}
+
+/// DfuPoll() с реальными паузами, пока не пройдёт переподключение (USB_DFU_RECONNECT_MS)
+static bool WaitReconnect(uint32_t connects) {
+    for (int i = 0; i < 200 && TinyUsbSim::Get().GetConnectCount() < connects; i++) {
+        g_usb.DfuPoll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return TinyUsbSim::Get().GetConnectCount() >= connects;
+}
+
+/// UsbDevice::Init() однократный: вернуть рабочую конфигурацию для следующего теста
+static void LeaveDfuMode() {
+    g_usb.DfuDetach();  // DfuFlash теста уже разрушен
+    if (g_usb.DfuIsActive()) {
+        g_usb.DfuLeaveMode();
+        WaitReconnect(TinyUsbSim::Get().GetConnectCount() + 1);
+    }
+}
+
+static uint32_t g_complete_calls = 0;
+
+void setUp() {
+    SimTime::Reset();
+    TinyUsbSim::Get().Reset();
+    g_usb.Init();
+    g_complete_calls = 0;
+}
+
+void tearDown() {
+    LeaveDfuMode();
+}
+
+void test_download_programs_image_and_manifests() {
+    FlashSim flash(SmallFlash());
+    // Старая прошивка: ячейки не стёрты
+    std::memset(&flash.Memory()[kAppAddress - kFlashBase], 0x00, 3 * kSectorSize);
+    DfuFlash target(flash, AppConfig());
+    TEST_ASSERT_TRUE(target.IsReady());
+    target.SetCompleteCallback([](void*) { g_complete_calls++; });
+    g_usb.DfuAttach(target);
+    g_usb.DfuEnterMode();
+    TEST_ASSERT_TRUE(WaitReconnect(1));
+    TEST_ASSERT_TRUE(TinyUsbSim::Get().IsDfuMode());
+
+    DfuHostSim host;
+    host.SetPump(PumpDevice);
+    std::vector<uint8_t> image = MakeImage(40 * 1024 + 100, 11);  // 2.5 сектора, хвост
+    DfuStatusReply last;
+    TEST_ASSERT_TRUE(host.DownloadImage(image.data(), static_cast<uint32_t>(image.size()),
+                                        kBlock, &last));
+    TEST_ASSERT_EQUAL_UINT8(State(dfu::State::Idle), last.state);  // Manifestation tolerant
+    TEST_ASSERT_EQUAL_UINT32(1, g_complete_calls);
+    TEST_ASSERT_FALSE(target.IsBusy());
+    TEST_ASSERT_FALSE(flash.IsBusy());
+
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), &flash.Memory()[kAppAddress - kFlashBase],
+                             image.size());
+    // Хвост дополнен 0xFF до flash word, загрузчик не тронут
+    TEST_ASSERT_EQUAL_HEX8(0xFF, flash.Memory()[kAppAddress - kFlashBase + image.size()]);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, flash.Memory()[0]);
+
+    DfuStats s = target.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(41, s.blocks);
+    TEST_ASSERT_EQUAL_UINT32(image.size(), s.bytes);
+    TEST_ASSERT_EQUAL_UINT32(41, s.programs);
+    TEST_ASSERT_EQUAL_UINT32(3, s.sectors_erased);
+    TEST_ASSERT_EQUAL_UINT32(3, flash.GetStats().erases);
+    TEST_ASSERT_EQUAL_UINT32(0, flash.GetStats().errors);
+}
+
+void test_programming_overlaps_transfer() {
+    FlashSim flash(SmallFlash());
+    DfuFlash target(flash, AppConfig());
+    g_usb.DfuAttach(target);
+    g_usb.DfuEnterMode();
+    TEST_ASSERT_TRUE(WaitReconnect(1));
+
+    DfuHostSim host;
+    host.SetPump(PumpDevice);
+    std::vector<uint8_t> image = MakeImage(4 * kSectorSize, 1);
+    const uint64_t start = SimTime::NowUs();
+    TEST_ASSERT_TRUE(host.DownloadImage(image.data(), static_cast<uint32_t>(image.size()),
+                                        kBlock));
+    const uint64_t elapsed = SimTime::NowUs() - start;
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), &flash.Memory()[kAppAddress - kFlashBase],
+                             image.size());
+
+    const DfuHostStats& bus = host.GetStats();
+    const uint64_t flash_us = flash.GetStats().busy_us;
+    const uint64_t erase_us = static_cast<uint64_t>(flash.GetStats().erases) * 20000;
+    TEST_ASSERT_EQUAL_UINT32(4, flash.GetStats().erases);
+    TEST_ASSERT_TRUE(target.GetStats().buffer_waits > 0);  // Стирание задержало хост
+    TEST_ASSERT_TRUE(bus.busy_polls > 0);
+
+    // Последовательно было бы шина + вся работа flash; программирование скрыто
+    // за передачей — сверх шины остаётся не больше времени стирания
+    TEST_ASSERT_TRUE(elapsed > flash_us);
+    TEST_ASSERT_TRUE(elapsed < bus.bus_us + erase_us);
+    TEST_ASSERT_TRUE(elapsed < (bus.bus_us + flash_us) * 4 / 5);
+}
+
+void test_sequence_and_range_errors_then_clrstatus() {
+    FlashSim flash(SmallFlash());
+    DfuConfig cfg = AppConfig();
+    cfg.app_size = 2 * kSectorSize;
+    DfuFlash target(flash, cfg);
+    g_usb.DfuAttach(target);
+    g_usb.DfuEnterMode();
+    TEST_ASSERT_TRUE(WaitReconnect(1));
+
+    DfuHostSim host;
+    host.SetPump(PumpDevice);
+    std::vector<uint8_t> image = MakeImage(3 * kSectorSize, 4);
+    DfuStatusReply last;
+
+    // Больше области прошивки
+    TEST_ASSERT_FALSE(host.DownloadImage(image.data(), static_cast<uint32_t>(image.size()),
+                                         kBlock, &last));
+    TEST_ASSERT_EQUAL_UINT8(State(dfu::State::Error), last.state);
+    TEST_ASSERT_EQUAL_UINT8(Status(dfu::Status::ErrAddress), last.status);
+    TEST_ASSERT_TRUE(host.ClrStatus());
+    TEST_ASSERT_EQUAL_UINT8(State(dfu::State::Idle), TinyUsbSim::Get().GetDfuState());
+
+    // Пропущен блок 1
+    TEST_ASSERT_TRUE(host.Download(0, image.data(), kBlock));
+    TEST_ASSERT_TRUE(host.GetStatus(&last));
+    TEST_ASSERT_TRUE(host.GetStatus(&last));
+    TEST_ASSERT_EQUAL_UINT8(State(dfu::State::DnloadIdle), last.state);
+    TEST_ASSERT_TRUE(host.Download(2, image.data(), kBlock));
+    TEST_ASSERT_TRUE(host.GetStatus(&last));  // dfuDNBUSY: download_cb после ответа
+    TEST_ASSERT_TRUE(host.GetStatus(&last));
+    TEST_ASSERT_EQUAL_UINT8(State(dfu::State::Error), last.state);
+    TEST_ASSERT_EQUAL_UINT8(Status(dfu::Status::ErrAddress), last.status);
+    TEST_ASSERT_EQUAL_UINT32(2, target.GetStats().sequence_errors);
+
+    // Запрос не в своём состоянии — STALL
+    TEST_ASSERT_FALSE(host.Download(1, nullptr, 0));
+    TEST_ASSERT_TRUE(host.ClrStatus());
+    TEST_ASSERT_FALSE(host.Download(0, nullptr, 0));  // Манифестация без образа
+    TEST_ASSERT_EQUAL_UINT8(Status(dfu::Status::ErrStalledPacket), TinyUsbSim::Get().GetDfuStatus());
+    TEST_ASSERT_TRUE(host.ClrStatus());
+
+    // Новая сессия с блока 0 проходит
+    std::vector<uint8_t> small = MakeImage(2 * kSectorSize, 8);
+    TEST_ASSERT_TRUE(host.DownloadImage(small.data(), static_cast<uint32_t>(small.size()),
+                                        kBlock));
+    TEST_ASSERT_EQUAL_MEMORY(small.data(), &flash.Memory()[kAppAddress - kFlashBase],
+                             small.size());
+}
+
+void test_erase_failure_reports_err_erase() {
+    FlashSim flash(SmallFlash());
+    flash.FailErase(2);  // Второй сектор образа
+    DfuFlash target(flash, AppConfig());
+    g_usb.DfuAttach(target);
+    g_usb.DfuEnterMode();
+    TEST_ASSERT_TRUE(WaitReconnect(1));
+
+    DfuHostSim host;
+    host.SetPump(PumpDevice);
+    std::vector<uint8_t> image = MakeImage(3 * kSectorSize, 6);
+    DfuStatusReply last;
+    TEST_ASSERT_FALSE(host.DownloadImage(image.data(), static_cast<uint32_t>(image.size()),
+                                         kBlock, &last));
+    TEST_ASSERT_EQUAL_UINT8(State(dfu::State::Error), last.state);
+    TEST_ASSERT_EQUAL_UINT8(Status(dfu::Status::ErrErase), last.status);
+    TEST_ASSERT_TRUE(target.HasFailed());
+    TEST_ASSERT_EQUAL_UINT32(1, target.GetStats().flash_errors);
+
+    // CLRSTATUS → abort_cb: сессия сброшена, повтор проходит
+    TEST_ASSERT_TRUE(host.ClrStatus());
+    TEST_ASSERT_TRUE(host.Abort());
+    TEST_ASSERT_FALSE(target.HasFailed());
+    TEST_ASSERT_TRUE(host.DownloadImage(image.data(), static_cast<uint32_t>(image.size()),
+                                        kBlock));
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), &flash.Memory()[kAppAddress - kFlashBase],
+                             image.size());
+}
+
+void test_upload_reads_app_region() {
+    FlashSim flash(SmallFlash());
+    std::vector<uint8_t> image = MakeImage(256 * 1024 - kSectorSize, 13);
+    std::memcpy(&flash.Memory()[kAppAddress - kFlashBase], image.data(), image.size());
+    DfuFlash target(flash, AppConfig());
+    g_usb.DfuAttach(target);
+    g_usb.DfuEnterMode();
+    TEST_ASSERT_TRUE(WaitReconnect(1));
+
+    DfuHostSim host;
+    host.SetPump(PumpDevice);
+    std::vector<uint8_t> read(image.size() + kBlock);
+    uint32_t total = 0;
+    for (uint16_t block = 0;; block++) {
+        const int32_t n = host.Upload(block, &read[total], kBlock);
+        TEST_ASSERT_TRUE(n >= 0);
+        total += static_cast<uint32_t>(n);
+        if (n < kBlock) {
+            break;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(image.size(), total);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), read.data(), image.size());
+    TEST_ASSERT_EQUAL_UINT8(State(dfu::State::Idle), TinyUsbSim::Get().GetDfuState());  // Короткий блок
+}
+
+void test_detach_switches_configuration() {
+    FlashSim flash(SmallFlash());
+    DfuFlash target(flash, AppConfig());
+    g_usb.DfuAttach(target);
+
+    // Рабочая конфигурация: интерфейс DFU runtime
+    TinyUsbSim& sim = TinyUsbSim::Get();
+    TEST_ASSERT_TRUE(sim.HasDfuInterface());
+    TEST_ASSERT_FALSE(sim.IsDfuMode());
+    TEST_ASSERT_EQUAL_UINT8(State(dfu::State::AppIdle), sim.GetDfuState());
+
+    DfuHostSim host;
+    host.SetPump(PumpDevice);
+    TEST_ASSERT_TRUE(host.Detach());
+    TEST_ASSERT_TRUE(g_usb.DfuIsActive());
+    TEST_ASSERT_TRUE(WaitReconnect(1));
+    TEST_ASSERT_EQUAL_UINT32(1, sim.GetDisconnectCount());
+    TEST_ASSERT_TRUE(sim.IsDfuMode());
+    TEST_ASSERT_EQUAL_UINT8(State(dfu::State::Idle), sim.GetDfuState());
+
+    // DFU_DETACH в режиме DFU — обратно в рабочую конфигурацию
+    TEST_ASSERT_TRUE(host.Detach());
+    TEST_ASSERT_TRUE(WaitReconnect(2));
+    TEST_ASSERT_FALSE(g_usb.DfuIsActive());
+    TEST_ASSERT_FALSE(sim.IsDfuMode());
+    TEST_ASSERT_TRUE(sim.HasDfuInterface());
+
+    // 1200 bps без пользовательского callback — тоже режим DFU
+    sim.HostSetLineCoding(1200);
+    TEST_ASSERT_TRUE(WaitReconnect(3));
+    TEST_ASSERT_TRUE(sim.IsDfuMode());
+}
+
+void test_abort_drops_session() {
+    FlashSim flash(SmallFlash());
+    DfuFlash target(flash, AppConfig());
+    g_usb.DfuAttach(target);
+    g_usb.DfuEnterMode();
+    TEST_ASSERT_TRUE(WaitReconnect(1));
+
+    DfuHostSim host;
+    host.SetPump(PumpDevice);
+    std::vector<uint8_t> image = MakeImage(4 * kBlock, 17);
+    DfuStatusReply status;
+    for (uint16_t block = 0; block < 2; block++) {
+        TEST_ASSERT_TRUE(host.Download(block, &image[block * kBlock], kBlock));
+        TEST_ASSERT_TRUE(host.GetStatus(&status));
+        TEST_ASSERT_TRUE(host.GetStatus(&status));
+    }
+    TEST_ASSERT_TRUE(host.Abort());
+    TEST_ASSERT_FALSE(target.IsBusy());
+    TEST_ASSERT_FALSE(flash.IsBusy());
+    TEST_ASSERT_EQUAL_UINT32(1, target.GetStats().aborts);
+    TEST_ASSERT_EQUAL_UINT8(State(dfu::State::Idle), TinyUsbSim::Get().GetDfuState());
+
+    // Продолжение прерванной сессии — ошибка, манифестация недоступна
+    TEST_ASSERT_TRUE(host.Download(2, &image[2 * kBlock], kBlock));
+    TEST_ASSERT_TRUE(host.GetStatus(&status));
+    TEST_ASSERT_TRUE(host.GetStatus(&status));
+    TEST_ASSERT_EQUAL_UINT8(State(dfu::State::Error), status.state);
+    TEST_ASSERT_EQUAL_UINT8(Status(dfu::Status::ErrAddress), status.status);
+}
+
+void test_invalid_region_reports_err_target() {
+    FlashSim flash(SmallFlash());
+    DfuConfig cfg = AppConfig();
+    cfg.app_address = kAppAddress + 256;  // Не с начала сектора
+    DfuFlash target(flash, cfg);
+    TEST_ASSERT_FALSE(target.IsReady());
+
+    // Конец не на границе сектора: стирание последнего задело бы данные за областью
+    DfuConfig tail_cfg = AppConfig();
+    tail_cfg.app_size = 2 * kSectorSize + 1024;
+    DfuFlash tail(flash, tail_cfg);
+    TEST_ASSERT_FALSE(tail.IsReady());
+
+    g_usb.DfuAttach(target);
+    g_usb.DfuEnterMode();
+    TEST_ASSERT_TRUE(WaitReconnect(1));
+
+    DfuHostSim host;
+    host.SetPump(PumpDevice);
+    std::vector<uint8_t> image = MakeImage(kBlock, 2);
+    DfuStatusReply last;
+    TEST_ASSERT_FALSE(host.DownloadImage(image.data(), kBlock, kBlock, &last));
+    TEST_ASSERT_EQUAL_UINT8(Status(dfu::Status::ErrTarget), last.status);
+    TEST_ASSERT_EQUAL_UINT32(0, flash.GetStats().erases);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_download_programs_image_and_manifests);
+    RUN_TEST(test_programming_overlaps_transfer);
+    RUN_TEST(test_sequence_and_range_errors_then_clrstatus);
+    RUN_TEST(test_erase_failure_reports_err_erase);
+    RUN_TEST(test_upload_reads_app_region);
+    RUN_TEST(test_detach_switches_configuration);
+    RUN_TEST(test_abort_drops_session);
+    RUN_TEST(test_invalid_region_reports_err_target);
+
+    return UNITY_END();
+}
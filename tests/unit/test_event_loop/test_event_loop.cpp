@@ -0,0 +1,221 @@
+/**
+ * @file test_event_loop.cpp
+ * @brief Unit тесты цикла событий (Process без событий, WaitForEvent, латентность пробуждения)
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "mock/MockBlockDevice.hpp"
+#include "sim/SimTime.hpp"
+#include "sim/TinyUsbSim.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using usb::ProbePoint;
+using usb::UsbDevice;
+using usb::mock::MockBlockDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::SimClock;
+using usb::sim::SimTime;
+using usb::sim::TinyUsbSim;
+
+static UsbDevice g_usb;
+static SimClock g_sim_clock;
+
+void setUp() {
+    SimTime::Reset();
+    TinyUsbSim::Get().Reset();
+    TinyUsbSim::Get().SetIrqHandler(UsbDevice::HandleInterrupt);
+    g_usb.Init();
+    g_usb.ResetEventLoopStats();
+    usb::ProfileReset();
+}
+
+void tearDown() {
+    usb::ProfileSetClock(nullptr);
+    g_usb.MscDetach();
+    g_usb.CdcSetRxCallback(nullptr);
+    g_usb.SetSuspendCallback(nullptr);
+    g_usb.WaitForEvent(0);  // Сбросить несъеденное пользовательское событие
+}
+
+static void PumpProcess(void*) {
+    g_usb.Process();
+}
+
+void test_process_without_events_skips_tud_task() {
+    const uint32_t before = TinyUsbSim::Get().GetTaskCalls();
+    for (int i = 0; i < 1000; i++) {
+        g_usb.Process();
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, TinyUsbSim::Get().GetTaskCalls());
+
+    usb::EventLoopStats s = g_usb.GetEventLoopStats();
+    TEST_ASSERT_EQUAL_UINT32(1000, s.process_calls);
+    TEST_ASSERT_EQUAL_UINT32(0, s.task_runs);
+    TEST_ASSERT_EQUAL_UINT32(0, s.interrupts);
+}
+
+void test_msc_throughput_unchanged_with_event_process() {
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+    uint8_t buf[16 * 512];
+
+    MscHostSim polled;  // tud_task() на каждой прокачке
+    TEST_ASSERT_EQUAL(CswStatus::Passed, polled.Read10(0, 16, buf));
+
+    MscHostSim evented;
+    evented.SetPump(PumpProcess);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, evented.Read10(0, 16, buf));
+
+    // Столько же прокачек стека на команду: пропускаются только пустые вызовы
+    TEST_ASSERT_EQUAL_UINT32(polled.GetRecords()[0].tud_task_calls,
+                             evented.GetRecords()[0].tud_task_calls);
+    usb::EventLoopStats s = g_usb.GetEventLoopStats();
+    TEST_ASSERT_EQUAL_UINT32(2, s.interrupts);  // По CBW на команду
+    TEST_ASSERT_EQUAL_UINT32(evented.GetRecords()[0].tud_task_calls, s.task_runs);
+}
+
+static uint32_t g_rx_bytes = 0;
+
+static void CountRx(const uint8_t*, uint32_t len, void*) {
+    g_rx_bytes += len;
+}
+
+void test_wakeup_latency_recorded() {
+    usb::ProfileSetClock(&g_sim_clock);
+    g_rx_bytes = 0;
+    g_usb.CdcSetRxCallback(CountRx);
+
+    SimTime::AdvanceUs(100);
+    const uint8_t first[2] = {'a', 'b'};
+    TinyUsbSim::Get().HostCdcSend(first, sizeof(first));
+    SimTime::AdvanceUs(250);
+    const uint8_t second[1] = {'c'};
+    TinyUsbSim::Get().HostCdcSend(second, sizeof(second));  // Та же серия прерываний
+    SimTime::AdvanceUs(100);
+    g_usb.Process();
+    TEST_ASSERT_EQUAL_UINT32(3, g_rx_bytes);
+
+    const auto& wakeup = g_usb.GetLatencyHistogram(ProbePoint::UsbWakeup);
+    TEST_ASSERT_EQUAL_UINT32(1, wakeup.count);
+    TEST_ASSERT_EQUAL_UINT32(350, wakeup.max_us);  // От первого прерывания
+
+    g_usb.Process();  // Событий нет — новых измерений тоже
+    TEST_ASSERT_EQUAL_UINT32(1, wakeup.count);
+    TEST_ASSERT_EQUAL_STRING("usb_wakeup", usb::ProbePointName(ProbePoint::UsbWakeup));
+}
+
+void test_wait_for_event_times_out() {
+    auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_FALSE(g_usb.WaitForEvent(5));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    TEST_ASSERT_TRUE(elapsed >= std::chrono::milliseconds(4));
+
+    usb::EventLoopStats s = g_usb.GetEventLoopStats();
+    TEST_ASSERT_EQUAL_UINT32(1, s.wait_calls);
+    TEST_ASSERT_EQUAL_UINT32(1, s.wait_timeouts);
+    TEST_ASSERT_TRUE(s.sleep_ms >= 5);
+
+    TEST_ASSERT_FALSE(g_usb.WaitForEvent(0));
+}
+
+void test_wait_for_event_wakes_on_host_data() {
+    g_rx_bytes = 0;
+    g_usb.CdcSetRxCallback(CountRx);
+
+    std::thread host([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const uint8_t cmd[3] = {'c', 'm', 'd'};
+        TinyUsbSim::Get().HostCdcSend(cmd, sizeof(cmd));
+    });
+    TEST_ASSERT_TRUE(g_usb.WaitForEvent(2000));
+    host.join();
+    g_usb.Process();
+    TEST_ASSERT_EQUAL_UINT32(3, g_rx_bytes);
+
+    usb::EventLoopStats s = g_usb.GetEventLoopStats();
+    TEST_ASSERT_EQUAL_UINT32(0, s.wait_timeouts);
+    TEST_ASSERT_TRUE(s.sleep_ms < 2000);
+    TEST_ASSERT_EQUAL_UINT32(1, s.task_runs);
+}
+
+void test_notify_event_wakes_once() {
+    std::thread user([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        g_usb.NotifyEvent();
+    });
+    TEST_ASSERT_TRUE(g_usb.WaitForEvent(2000));
+    user.join();
+    TEST_ASSERT_FALSE(g_usb.WaitForEvent(0));  // Событие потреблено
+
+    usb::EventLoopStats s = g_usb.GetEventLoopStats();
+    TEST_ASSERT_EQUAL_UINT32(1, s.user_events);
+    TEST_ASSERT_EQUAL_UINT32(0, s.task_runs);  // USB событий не было
+}
+
+struct SuspendLog {
+    uint32_t calls = 0;
+    bool last = false;
+    usb::State state_in_callback = usb::State::NotInitialized;
+};
+
+static void RecordSuspend(bool suspended, void* context) {
+    SuspendLog* log = static_cast<SuspendLog*>(context);
+    log->calls++;
+    log->last = suspended;
+    log->state_in_callback = g_usb.GetState();
+}
+
+void test_bus_suspend_and_resume_reach_callback() {
+    SuspendLog log;
+    g_usb.SetSuspendCallback(RecordSuspend, &log);
+
+    TinyUsbSim::Get().HostSuspend();
+    TEST_ASSERT_EQUAL_UINT32(0, log.calls);  // Из tud_task(), не из прерывания
+    g_usb.Process();
+    TEST_ASSERT_EQUAL_UINT32(1, log.calls);
+    TEST_ASSERT_TRUE(log.last);
+    TEST_ASSERT_EQUAL(usb::State::Suspended, log.state_in_callback);
+
+    TinyUsbSim::Get().HostResume();
+    g_usb.Process();
+    TEST_ASSERT_EQUAL_UINT32(2, log.calls);
+    TEST_ASSERT_FALSE(log.last);
+    TEST_ASSERT_EQUAL(usb::State::Configured, g_usb.GetState());
+
+    usb::EventLoopStats s = g_usb.GetEventLoopStats();
+    TEST_ASSERT_EQUAL_UINT32(1, s.suspends);
+    TEST_ASSERT_EQUAL_UINT32(1, s.resumes);
+    TEST_ASSERT_EQUAL_UINT32(2, s.interrupts);
+
+    // Без callback события только считаются
+    g_usb.SetSuspendCallback(nullptr);
+    TinyUsbSim::Get().HostSuspend();
+    g_usb.Process();
+    TEST_ASSERT_EQUAL_UINT32(2, log.calls);
+    TEST_ASSERT_EQUAL_UINT32(2, g_usb.GetEventLoopStats().suspends);
+}
+
+void test_wait_for_event_not_initialized() {
+    UsbDevice not_initialized;
+    TEST_ASSERT_FALSE(not_initialized.WaitForEvent(10));
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_process_without_events_skips_tud_task);
+    RUN_TEST(test_msc_throughput_unchanged_with_event_process);
+    RUN_TEST(test_wakeup_latency_recorded);
+    RUN_TEST(test_wait_for_event_times_out);
+    RUN_TEST(test_wait_for_event_wakes_on_host_data);
+    RUN_TEST(test_notify_event_wakes_once);
+    RUN_TEST(test_bus_suspend_and_resume_reach_callback);
+    RUN_TEST(test_wait_for_event_not_initialized);
+
+    return UNITY_END();
+}
@@ -0,0 +1,158 @@
+/**
+ * @file test_fmt.cpp
+ * @brief Unit тесты форматирования usb_fmt.h и UsbDevice::CdcFormat()
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_fmt.h"
+#include "sim/TinyUsbSim.hpp"
+
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+using usb::UsbDevice;
+using usb::fmt::FormatTo;
+using usb::fmt::SpanSink;
+using usb::sim::TinyUsbSim;
+
+static UsbDevice g_usb;
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_usb.Init();
+}
+
+void tearDown() {
+}
+
+/// Результат FormatTo строкой (буфер с запасом)
+#define FORMATTED(...)                                         \
+    ([&] {                                                     \
+        char buf[128];                                         \
+        const uint32_t len = FormatTo(buf, sizeof(buf), __VA_ARGS__); \
+        return std::string(buf, len < sizeof(buf) ? len : sizeof(buf) - 1); \
+    }())
+
+void test_fmt_literals_and_escapes() {
+    TEST_ASSERT_EQUAL_STRING("", FORMATTED(USB_FMT("")).c_str());
+    TEST_ASSERT_EQUAL_STRING("hello", FORMATTED(USB_FMT("hello")).c_str());
+    TEST_ASSERT_EQUAL_STRING("{x} }", FORMATTED(USB_FMT("{{x}} }}")).c_str());
+    TEST_ASSERT_EQUAL_STRING("a{7}b", FORMATTED(USB_FMT("a{{{}}}b"), 7).c_str());
+}
+
+void test_fmt_integers() {
+    TEST_ASSERT_EQUAL_STRING("0 42 -42", FORMATTED(USB_FMT("{} {} {}"), 0, 42u, -42).c_str());
+    TEST_ASSERT_EQUAL_STRING("-2147483648 4294967295",
+                             FORMATTED(USB_FMT("{} {}"), INT32_MIN, UINT32_MAX).c_str());
+    TEST_ASSERT_EQUAL_STRING("-9223372036854775808 18446744073709551615",
+                             FORMATTED(USB_FMT("{} {}"), INT64_MIN, UINT64_MAX).c_str());
+    TEST_ASSERT_EQUAL_STRING("10000000000 1000000000",
+                             FORMATTED(USB_FMT("{} {}"), 10000000000ull, 1000000000u).c_str());
+    const int8_t small = -128;
+    const uint16_t half = 65535;
+    TEST_ASSERT_EQUAL_STRING("-128 65535", FORMATTED(USB_FMT("{} {}"), small, half).c_str());
+}
+
+void test_fmt_hex_and_binary() {
+    TEST_ASSERT_EQUAL_STRING("1a2b 1A2B", FORMATTED(USB_FMT("{:x} {:X}"), 0x1A2B, 0x1A2Bu).c_str());
+    TEST_ASSERT_EQUAL_STRING("0x00ff", FORMATTED(USB_FMT("0x{:04x}"), 255).c_str());
+    TEST_ASSERT_EQUAL_STRING("ffffffff ff", FORMATTED(USB_FMT("{:x} {:x}"), -1,
+                                                      static_cast<int8_t>(-1)).c_str());
+    TEST_ASSERT_EQUAL_STRING("00000101", FORMATTED(USB_FMT("{:08b}"), 5).c_str());
+    TEST_ASSERT_EQUAL_STRING("ffffffffffffffff", FORMATTED(USB_FMT("{:x}"), UINT64_MAX).c_str());
+}
+
+void test_fmt_width_and_alignment() {
+    TEST_ASSERT_EQUAL_STRING("[   42]", FORMATTED(USB_FMT("[{:5}]"), 42).c_str());
+    TEST_ASSERT_EQUAL_STRING("[42   ]", FORMATTED(USB_FMT("[{:<5}]"), 42).c_str());
+    TEST_ASSERT_EQUAL_STRING("[-0042]", FORMATTED(USB_FMT("[{:05}]"), -42).c_str());
+    TEST_ASSERT_EQUAL_STRING("[ok  |]", FORMATTED(USB_FMT("[{:<4}|]"), "ok").c_str());
+    TEST_ASSERT_EQUAL_STRING("[  abc]", FORMATTED(USB_FMT("[{:5s}]"), "abc").c_str());
+    TEST_ASSERT_EQUAL_STRING("123456", FORMATTED(USB_FMT("{:3}"), 123456).c_str());
+    std::string wide = FORMATTED(USB_FMT("{:40}"), 1);
+    TEST_ASSERT_EQUAL_UINT32(40, wide.size());
+    TEST_ASSERT_EQUAL_INT('1', wide.back());
+}
+
+void test_fmt_fixed_point_integers() {
+    TEST_ASSERT_EQUAL_STRING("3.300", FORMATTED(USB_FMT("{:.3}"), 3300).c_str());
+    TEST_ASSERT_EQUAL_STRING("-0.005", FORMATTED(USB_FMT("{:.3}"), -5).c_str());
+    TEST_ASSERT_EQUAL_STRING("0.0", FORMATTED(USB_FMT("{:.1}"), 0).c_str());
+    TEST_ASSERT_EQUAL_STRING("  12.5", FORMATTED(USB_FMT("{:6.1}"), 125).c_str());
+    TEST_ASSERT_EQUAL_STRING("18446744073.709551615",
+                             FORMATTED(USB_FMT("{:.9}"), UINT64_MAX).c_str());
+}
+
+void test_fmt_floats() {
+    TEST_ASSERT_EQUAL_STRING("3.14", FORMATTED(USB_FMT("{:.2}"), 3.14159).c_str());
+    TEST_ASSERT_EQUAL_STRING("-0.50", FORMATTED(USB_FMT("{:.2}"), -0.499f).c_str());
+    TEST_ASSERT_EQUAL_STRING("2.000000", FORMATTED(USB_FMT("{}"), 2.0).c_str());
+    TEST_ASSERT_EQUAL_STRING("1", FORMATTED(USB_FMT("{:.0}"), 0.5).c_str());
+    TEST_ASSERT_EQUAL_STRING("-01.5", FORMATTED(USB_FMT("{:05.1}"), -1.5).c_str());
+    TEST_ASSERT_EQUAL_STRING("nan inf -inf ovf",
+                             FORMATTED(USB_FMT("{} {} {} {}"), NAN, INFINITY, -INFINITY,
+                                       1e30).c_str());
+}
+
+void test_fmt_chars_bools_strings() {
+    const char* none = nullptr;
+    TEST_ASSERT_EQUAL_STRING("A 65 B true false (null)",
+                             FORMATTED(USB_FMT("{} {:d} {:c} {} {} {}"), 'A', 'A', 66, true,
+                                       false, none).c_str());
+    char name[] = "sd0";
+    TEST_ASSERT_EQUAL_STRING("dev=sd0 lit", FORMATTED(USB_FMT("dev={} {}"), name, "lit").c_str());
+}
+
+void test_fmt_truncates_like_snprintf() {
+    char buf[8];
+    TEST_ASSERT_EQUAL_UINT32(10, FormatTo(buf, sizeof(buf), USB_FMT("value={}"), 1234));
+    TEST_ASSERT_EQUAL_STRING("value=1", buf);
+    TEST_ASSERT_EQUAL_UINT32(3, FormatTo(buf, 0, USB_FMT("{}"), 100));
+
+    char raw[4];
+    SpanSink sink(raw, sizeof(raw));
+    usb::fmt::Format(sink, USB_FMT("{}-{}"), 12, 34);
+    TEST_ASSERT_TRUE(sink.Truncated());
+    TEST_ASSERT_EQUAL_UINT32(4, sink.Size());
+    TEST_ASSERT_EQUAL_UINT32(5, sink.Length());
+    TEST_ASSERT_EQUAL_MEMORY("12-3", raw, 4);
+}
+
+void test_cdc_format_writes_to_host() {
+    TEST_ASSERT_EQUAL_UINT32(21, g_usb.CdcFormat(USB_FMT("t={} v={:.3} r={:02X}\r\n"), 1500u,
+                                                 3300, 0xAu));
+    auto received = TinyUsbSim::Get().HostCdcReceive();
+    TEST_ASSERT_EQUAL_STRING("t=1500 v=3.300 r=0A\r\n",
+                             std::string(received.begin(), received.end()).c_str());
+}
+
+void test_cdc_format_stops_at_first_short_write() {
+    // Передача IN освобождает FIFO посреди вывода: хвост строки не должен
+    // дописаться после отброшенной середины
+    TinyUsbSim::Get().SetCdcTxDrain(64);
+    const std::string line(600, 'x');
+    TEST_ASSERT_EQUAL_UINT32(512, g_usb.CdcFormat(USB_FMT("{}|tail\r\n"), line.c_str()));
+    auto received = TinyUsbSim::Get().HostCdcReceive();
+    TEST_ASSERT_EQUAL_STRING(line.substr(0, 512).c_str(),
+                             std::string(received.begin(), received.end()).c_str());
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_fmt_literals_and_escapes);
+    RUN_TEST(test_fmt_integers);
+    RUN_TEST(test_fmt_hex_and_binary);
+    RUN_TEST(test_fmt_width_and_alignment);
+    RUN_TEST(test_fmt_fixed_point_integers);
+    RUN_TEST(test_fmt_floats);
+    RUN_TEST(test_fmt_chars_bools_strings);
+    RUN_TEST(test_fmt_truncates_like_snprintf);
+    RUN_TEST(test_cdc_format_writes_to_host);
+    RUN_TEST(test_cdc_format_stops_at_first_short_write);
+
+    return UNITY_END();
+}
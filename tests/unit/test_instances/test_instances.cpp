@@ -0,0 +1,106 @@
+/**
+ * @file test_instances.cpp
+ * @brief Unit тесты таблицы экземпляров UsbDevice (по rhport)
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "mock/MockBlockDevice.hpp"
+#include "sim/TinyUsbSim.hpp"
+
+using usb::UsbDevice;
+using usb::mock::MockBlockDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::TinyUsbSim;
+
+static usb::Config PortConfig(uint8_t rhport) {
+    usb::Config cfg;
+    cfg.rhport = rhport;
+    return cfg;
+}
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+}
+
+void tearDown() {}
+
+void test_init_registers_instance_by_rhport() {
+    TEST_ASSERT_NULL(UsbDevice::Instance(0));
+    {
+        UsbDevice usb;
+        TEST_ASSERT_TRUE(usb.Init());
+        TEST_ASSERT_EQUAL_PTR(&usb, UsbDevice::Instance(0));
+        TEST_ASSERT_NULL(UsbDevice::Instance(1));
+        TEST_ASSERT_EQUAL_UINT8(0, usb.GetRhport());
+    }
+    // Деструктор освобождает порт
+    TEST_ASSERT_NULL(UsbDevice::Instance(0));
+    TEST_ASSERT_NULL(UsbDevice::Instance(usb::kMaxRhports));
+}
+
+void test_second_instance_on_busy_port_is_rejected() {
+    UsbDevice first;
+    UsbDevice second;
+    TEST_ASSERT_TRUE(first.Init());
+    TEST_ASSERT_FALSE(second.Init());
+    TEST_ASSERT_FALSE(second.IsInitialized());
+
+    // Device стек уже работает на rhport 0
+    UsbDevice hs;
+    TEST_ASSERT_FALSE(hs.Init(PortConfig(1)));
+    TEST_ASSERT_EQUAL_PTR(&first, UsbDevice::Instance(0));
+}
+
+void test_invalid_rhport_is_rejected() {
+    UsbDevice usb;
+    TEST_ASSERT_FALSE(usb.Init(PortConfig(usb::kMaxRhports)));
+    TEST_ASSERT_NULL(UsbDevice::Instance(0));
+}
+
+void test_callbacks_follow_device_port() {
+    MockBlockDevice disk;
+    UsbDevice hs;
+    TEST_ASSERT_TRUE(hs.Init(PortConfig(1)));
+    TEST_ASSERT_EQUAL_PTR(&hs, UsbDevice::Instance(1));
+    hs.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t buf[512];
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 1, buf));
+    TEST_ASSERT_EQUAL_UINT32(1, hs.MscGetStats().read_commands);
+
+    // Прерывание другого ядра не будит этот экземпляр
+    UsbDevice::HandleInterrupt(0);
+    TEST_ASSERT_EQUAL_UINT32(0, hs.GetEventLoopStats().interrupts);
+    UsbDevice::HandleInterrupt(1);
+    TEST_ASSERT_EQUAL_UINT32(1, hs.GetEventLoopStats().interrupts);
+}
+
+void test_destroyed_instance_leaves_no_stale_device() {
+    MockBlockDevice disk;
+    {
+        UsbDevice usb;
+        TEST_ASSERT_TRUE(usb.Init());
+        usb.MscAttach(&disk);
+    }
+    UsbDevice next;
+    TEST_ASSERT_TRUE(next.Init());
+    TEST_ASSERT_FALSE(next.MscIsAttached());
+
+    MscHostSim host;
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.TestUnitReady());
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_init_registers_instance_by_rhport);
+    RUN_TEST(test_second_instance_on_busy_port_is_rejected);
+    RUN_TEST(test_invalid_rhport_is_rejected);
+    RUN_TEST(test_callbacks_follow_device_port);
+    RUN_TEST(test_destroyed_instance_leaves_no_stale_device);
+
+    return UNITY_END();
+}
@@ -0,0 +1,458 @@
+/**
+ * @file test_journal.cpp
+ * @brief Unit тесты JournalBlockDevice (журнал, таблица "блок → слот", перенос)
+ */
+
+#include <unity.h>
+#include "usb_journal.h"
+#include "usb_sdmmc.h"
+#include "bench/Workloads.hpp"
+#include "mock/MockBlockDevice.hpp"
+#include "sim/SdCardSim.hpp"
+#include "stm32h7xx_hal.h"
+
+#include <cstring>
+#include <vector>
+
+using usb::JournalBlockDevice;
+using usb::JournalConfig;
+using usb::JournalStats;
+using usb::bench::Rng;
+using usb::mock::MockBlockDevice;
+using usb::sim::SdCardSim;
+using usb::sim::SdCardSimConfig;
+using usb::sim::SimTime;
+
+static constexpr uint32_t kBlock = 512;
+static constexpr uint32_t kDiskBlocks = 8192;
+
+void setUp() {
+    SimTime::Reset();
+    usb::sim::HalState::Reset();
+}
+
+void tearDown() {
+}
+
+static void FillBlocks(uint8_t* buf, uint32_t lba, uint32_t count, uint8_t tag) {
+    for (uint32_t i = 0; i < count; i++) {
+        std::memset(buf + i * kBlock, static_cast<uint8_t>(tag + lba + i), kBlock);
+    }
+}
+
+/// Запись через журнал и в эталон
+static void WriteBoth(usb::ports::IBlockDevice& device, std::vector<uint8_t>& reference,
+                      uint32_t lba, uint32_t count, uint8_t tag) {
+    FillBlocks(&reference[lba * kBlock], lba, count, tag);
+    TEST_ASSERT_TRUE(device.Write(lba, &reference[lba * kBlock], count));
+}
+
+/// Разметить журнал на чистом диске; счётчики диска — с нуля
+static void Format(JournalBlockDevice& journal, MockBlockDevice& disk) {
+    TEST_ASSERT_TRUE(journal.Format());
+    disk.ResetCounters();
+}
+
+static JournalConfig SmallJournal(uint32_t blocks) {
+    JournalConfig cfg;
+    cfg.journal_blocks = blocks;
+    return cfg;
+}
+
+void test_open_reserves_journal_at_device_end() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalBlockDevice journal(disk, SmallJournal(256));
+    TEST_ASSERT_FALSE(journal.IsReady());
+    TEST_ASSERT_TRUE(journal.Format());
+    TEST_ASSERT_EQUAL_UINT32(kDiskBlocks - 257, journal.GetBlockCount());
+    TEST_ASSERT_EQUAL_UINT32(kDiskBlocks - 257, journal.GetJournalLba());
+
+    uint8_t buf[kBlock] = {0};
+    TEST_ASSERT_FALSE(journal.Write(kDiskBlocks - 257, buf, 1));  // Журнал хосту не виден
+
+    MockBlockDevice tiny(128, kBlock);
+    JournalBlockDevice too_small(tiny, SmallJournal(256));
+    TEST_ASSERT_FALSE(too_small.Format());
+
+    MockBlockDevice large_blocks(kDiskBlocks, 4096);
+    JournalBlockDevice wrong_size(large_blocks, SmallJournal(256));
+    TEST_ASSERT_FALSE(wrong_size.Format());
+}
+
+void test_open_requires_journal_header() {
+    // Карта без разметки журнала (том до конца) не открывается и не меняется
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    disk.Fill(0x5A);
+    JournalBlockDevice foreign(disk, SmallJournal(256));
+    TEST_ASSERT_FALSE(foreign.Open());
+    TEST_ASSERT_FALSE(foreign.IsReady());
+    TEST_ASSERT_EQUAL_UINT32(0, foreign.GetBlockCount());
+    TEST_ASSERT_EQUAL_UINT32(0, disk.GetWriteCount());
+
+    uint8_t buf[kBlock];
+    std::memset(buf, 0x11, sizeof(buf));
+    TEST_ASSERT_FALSE(foreign.Write(10, buf, 1));
+    TEST_ASSERT_EQUAL_HEX8(0x5A, disk.GetData()[(kDiskBlocks - 1) * kBlock]);
+
+    // После Format() — открывается заново, другой journal_blocks — нет
+    TEST_ASSERT_TRUE(foreign.Format());
+    JournalBlockDevice reopened(disk, SmallJournal(256));
+    TEST_ASSERT_TRUE(reopened.Open());
+    TEST_ASSERT_EQUAL_UINT32(kDiskBlocks - 257, reopened.GetBlockCount());
+    JournalBlockDevice other(disk, SmallJournal(128));
+    TEST_ASSERT_FALSE(other.Open());
+}
+
+void test_small_writes_append_to_journal() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalBlockDevice journal(disk, SmallJournal(256));
+    Format(journal, disk);
+    const uint32_t journal_lba = journal.GetJournalLba();
+
+    // Запись — описатель и 8 блоков данных одной командой
+    uint8_t buf[8 * kBlock];
+    const uint32_t lbas[] = {5000, 100, 7};
+    for (uint32_t i = 0; i < 3; i++) {
+        FillBlocks(buf, lbas[i], 8, 0x10);
+        TEST_ASSERT_TRUE(journal.Write(lbas[i], buf, 8));
+        TEST_ASSERT_EQUAL_UINT32(journal_lba + i * 9, disk.GetLastWriteLba());
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, disk.GetWriteCount());
+    TEST_ASSERT_EQUAL_HEX8(0x00, disk.GetData()[100 * kBlock]);  // На месте ещё пусто
+
+    // Чтение через таблицу: 96..111 — носитель, слоты, носитель
+    uint8_t out[16 * kBlock];
+    const uint32_t reads = disk.GetReadCount();
+    TEST_ASSERT_TRUE(journal.Read(96, out, 16));
+    TEST_ASSERT_EQUAL_UINT32(reads + 3, disk.GetReadCount());
+    TEST_ASSERT_EQUAL_HEX8(0x00, out[3 * kBlock]);
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x10 + 100), out[4 * kBlock]);
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x10 + 107), out[11 * kBlock]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, out[12 * kBlock]);
+    TEST_ASSERT_EQUAL_UINT32(27, journal.GetJournalUsed());
+}
+
+void test_compaction_sorts_and_drops_superseded_copies() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalBlockDevice journal(disk, SmallJournal(256));
+    Format(journal, disk);
+
+    // FAT: одиночные блоки в обратном порядке, 15 перезаписан трижды
+    uint8_t buf[kBlock];
+    for (uint32_t lba = 19; lba >= 10; lba--) {
+        FillBlocks(buf, lba, 1, 0x20);
+        TEST_ASSERT_TRUE(journal.Write(lba, buf, 1));
+    }
+    for (uint8_t tag = 0x30; tag <= 0x31; tag++) {
+        FillBlocks(buf, 15, 1, tag);
+        TEST_ASSERT_TRUE(journal.Write(15, buf, 1));
+    }
+
+    // 10..19 одной записью, затем отметка хвоста за 12 записями журнала
+    const uint32_t writes = disk.GetWriteCount();
+    TEST_ASSERT_TRUE(journal.Sync());
+    TEST_ASSERT_EQUAL_UINT32(writes + 2, disk.GetWriteCount());
+    TEST_ASSERT_EQUAL_UINT32(journal.GetJournalLba() + 24, disk.GetLastWriteLba());
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x31 + 15), disk.GetData()[15 * kBlock]);
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x20 + 19), disk.GetData()[19 * kBlock]);
+    TEST_ASSERT_EQUAL_UINT32(0, journal.GetJournalUsed());
+    TEST_ASSERT_EQUAL_UINT32(2, disk.GetSyncCount());  // Данные до отметки и Sync()
+
+    JournalStats stats = journal.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(12, stats.journal_blocks);
+    TEST_ASSERT_EQUAL_UINT32(10, stats.compacted_blocks);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.superseded_blocks);
+}
+
+void test_long_write_goes_home_after_journal_copy() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalBlockDevice journal(disk, SmallJournal(256));
+    Format(journal, disk);
+
+    uint8_t buf[32 * kBlock];
+    FillBlocks(buf, 200, 1, 0x40);
+    TEST_ASSERT_TRUE(journal.Write(200, buf, 1));
+
+    FillBlocks(buf, 192, 32, 0x50);
+    TEST_ASSERT_TRUE(journal.Write(192, buf, 32));
+    TEST_ASSERT_EQUAL_UINT32(192, disk.GetLastWriteLba());
+
+    uint8_t out[kBlock];
+    TEST_ASSERT_TRUE(journal.Read(200, out, 1));
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x50 + 200), out[0]);
+
+    // Старая копия перенесена до записи на место и не затирает новые данные
+    TEST_ASSERT_EQUAL_UINT32(0, journal.GetJournalUsed());
+    TEST_ASSERT_TRUE(journal.Sync());
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x50 + 200), disk.GetData()[200 * kBlock]);
+    JournalStats stats = journal.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.direct_writes);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.compacted_blocks);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.foreground_compactions);
+}
+
+void test_full_journal_compacts_inside_write() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalConfig cfg = SmallJournal(38);
+    cfg.compact_blocks = 8;
+    JournalBlockDevice journal(disk, cfg);
+    Format(journal, disk);
+
+    uint8_t buf[8 * kBlock];
+    for (uint32_t i = 0; i < 4; i++) {
+        FillBlocks(buf, i * 100, 8, 0x60);
+        TEST_ASSERT_TRUE(journal.Write(i * 100, buf, 8));
+    }
+    TEST_ASSERT_EQUAL_UINT32(36, journal.GetJournalUsed());
+    TEST_ASSERT_EQUAL_UINT32(0, journal.GetStats().foreground_compactions);
+
+    // Запись длиннее порции переносится целиком; отметка хвоста и новая запись
+    FillBlocks(buf, 1000, 4, 0x60);
+    TEST_ASSERT_TRUE(journal.Write(1000, buf, 4));
+    TEST_ASSERT_EQUAL_UINT32(1, journal.GetStats().foreground_compactions);
+    TEST_ASSERT_EQUAL_UINT32(33, journal.GetJournalUsed());
+    TEST_ASSERT_EQUAL_HEX8(0x60, disk.GetData()[0]);  // Старейшая порция на месте
+
+    // Poll() — по порции, пока журнал не опустеет
+    uint32_t polls = 0;
+    while (!journal.Poll()) {
+        polls++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, polls);
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x60 + 1003), disk.GetData()[1003 * kBlock]);
+}
+
+void test_compact_percent_defers_background_work() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalConfig cfg = SmallJournal(64);
+    cfg.compact_percent = 50;
+    JournalBlockDevice journal(disk, cfg);
+    Format(journal, disk);
+
+    uint8_t buf[8 * kBlock] = {0};
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(journal.Write(i * 8, buf, 8));
+    }
+    TEST_ASSERT_FALSE(journal.Poll());
+    TEST_ASSERT_EQUAL_UINT32(27, journal.GetJournalUsed());
+
+    TEST_ASSERT_TRUE(journal.Write(24, buf, 8));
+    TEST_ASSERT_TRUE(journal.Poll());
+}
+
+void test_failed_write_keeps_previous_data() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalBlockDevice journal(disk, SmallJournal(64));
+    Format(journal, disk);
+
+    uint8_t buf[kBlock];
+    FillBlocks(buf, 50, 1, 0x70);
+    TEST_ASSERT_TRUE(journal.Write(50, buf, 1));
+
+    disk.SetReady(false);
+    FillBlocks(buf, 50, 1, 0x71);
+    TEST_ASSERT_FALSE(journal.Write(50, buf, 1));
+    TEST_ASSERT_FALSE(journal.Sync());
+    TEST_ASSERT_EQUAL_UINT32(2, journal.GetStats().errors);
+
+    disk.SetReady(true);
+    uint8_t out[kBlock];
+    TEST_ASSERT_TRUE(journal.Read(50, out, 1));
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x70 + 50), out[0]);
+    TEST_ASSERT_TRUE(journal.Sync());
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x70 + 50), disk.GetData()[50 * kBlock]);
+}
+
+void test_matches_plain_device_under_random_io() {
+    // Малый журнал: перенос внутри записи, кольцо и удаление из таблицы
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalConfig cfg = SmallJournal(48);
+    cfg.compact_blocks = 8;
+    cfg.direct_blocks = 20;
+    JournalBlockDevice journal(disk, cfg);
+    Format(journal, disk);
+    const uint32_t blocks = journal.GetBlockCount();
+    std::vector<uint8_t> reference(static_cast<size_t>(blocks) * kBlock, 0);
+
+    Rng rng(0x1234567);
+    std::vector<uint8_t> buf(24 * kBlock);
+    std::vector<uint8_t> out(24 * kBlock);
+    for (uint32_t op = 0; op < 4000; op++) {
+        const uint32_t count = 1 + rng.Below(24);
+        const uint32_t lba = rng.Below(96) * 4 + rng.Below(4);  // Тесный диапазон: перезаписи
+        const uint32_t kind = rng.Below(10);
+        if (kind < 6) {
+            for (uint32_t i = 0; i < count * kBlock; i++) {
+                buf[i] = static_cast<uint8_t>(rng.Next());
+            }
+            TEST_ASSERT_TRUE(journal.Write(lba, buf.data(), count));
+            std::memcpy(&reference[lba * kBlock], buf.data(), count * kBlock);
+        } else if (kind < 9) {
+            TEST_ASSERT_TRUE(journal.Read(lba, out.data(), count));
+            TEST_ASSERT_EQUAL_MEMORY(&reference[lba * kBlock], out.data(), count * kBlock);
+        } else {
+            journal.Poll();
+        }
+    }
+
+    TEST_ASSERT_TRUE(journal.Sync());
+    TEST_ASSERT_EQUAL_MEMORY(reference.data(), disk.GetData(), reference.size());
+    JournalStats stats = journal.GetStats();
+    TEST_ASSERT_GREATER_THAN(0, stats.foreground_compactions);
+    TEST_ASSERT_GREATER_THAN(0, stats.superseded_blocks);
+    TEST_ASSERT_GREATER_THAN(0, stats.direct_writes);
+}
+
+void test_open_replays_unsynced_writes() {
+    // Перезапись, запись из двух записей журнала, перенос и переход кольца
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalConfig cfg = SmallJournal(64);
+    cfg.compact_blocks = 8;
+    cfg.direct_blocks = 24;
+    JournalBlockDevice journal(disk, cfg);
+    Format(journal, disk);
+    std::vector<uint8_t> reference(1024 * kBlock, 0);
+
+    WriteBoth(journal, reference, 40, 1, 0x10);
+    WriteBoth(journal, reference, 300, 8, 0x20);
+    WriteBoth(journal, reference, 40, 1, 0x30);
+    WriteBoth(journal, reference, 500, 19, 0x40);
+    journal.Poll();
+    WriteBoth(journal, reference, 700, 20, 0x50);
+    WriteBoth(journal, reference, 900, 12, 0x60);
+    TEST_ASSERT_GREATER_THAN(0, journal.GetStats().foreground_compactions);
+
+    // Сброс без Sync(): новый объект над тем же диском
+    JournalBlockDevice reopened(disk, cfg);
+    TEST_ASSERT_TRUE(reopened.Open());
+    TEST_ASSERT_EQUAL_UINT32(journal.GetJournalUsed(), reopened.GetJournalUsed());
+    std::vector<uint8_t> out(reference.size());
+    TEST_ASSERT_TRUE(reopened.Read(0, out.data(), 1024));
+    TEST_ASSERT_EQUAL_MEMORY(reference.data(), out.data(), reference.size());
+
+    TEST_ASSERT_TRUE(reopened.Sync());
+    TEST_ASSERT_EQUAL_MEMORY(reference.data(), disk.GetData(), reference.size());
+}
+
+void test_open_drops_torn_record() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalBlockDevice journal(disk, SmallJournal(64));
+    Format(journal, disk);
+
+    uint8_t buf[4 * kBlock];
+    FillBlocks(buf, 10, 4, 0x10);
+    TEST_ASSERT_TRUE(journal.Write(10, buf, 4));
+    FillBlocks(buf, 20, 4, 0x10);
+    TEST_ASSERT_TRUE(journal.Write(20, buf, 4));
+
+    // Вторая запись (описатель в слоте 5) дописана не до конца
+    disk.GetData()[(journal.GetJournalLba() + 8) * kBlock] ^= 0xFF;
+
+    JournalBlockDevice reopened(disk, SmallJournal(64));
+    TEST_ASSERT_TRUE(reopened.Open());
+    TEST_ASSERT_EQUAL_UINT32(5, reopened.GetJournalUsed());
+    uint8_t out[kBlock];
+    TEST_ASSERT_TRUE(reopened.Read(13, out, 1));
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x10 + 13), out[0]);
+    TEST_ASSERT_TRUE(reopened.Read(20, out, 1));
+    TEST_ASSERT_EQUAL_HEX8(0x00, out[0]);
+}
+
+void test_open_does_not_replay_copy_moved_before_direct_write() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalBlockDevice journal(disk, SmallJournal(64));
+    Format(journal, disk);
+
+    uint8_t buf[32 * kBlock];
+    FillBlocks(buf, 200, 1, 0x40);
+    TEST_ASSERT_TRUE(journal.Write(200, buf, 1));
+    FillBlocks(buf, 192, 32, 0x50);
+    TEST_ASSERT_TRUE(journal.Write(192, buf, 32));
+
+    JournalBlockDevice reopened(disk, SmallJournal(64));
+    TEST_ASSERT_TRUE(reopened.Open());
+    TEST_ASSERT_EQUAL_UINT32(0, reopened.GetJournalUsed());
+    uint8_t out[kBlock];
+    TEST_ASSERT_TRUE(reopened.Read(200, out, 1));
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x50 + 200), out[0]);
+}
+
+void test_format_drops_previous_journal() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    JournalBlockDevice journal(disk, SmallJournal(64));
+    Format(journal, disk);
+
+    uint8_t buf[kBlock];
+    FillBlocks(buf, 50, 1, 0x10);
+    TEST_ASSERT_TRUE(journal.Write(50, buf, 1));
+    FillBlocks(buf, 60, 1, 0x10);
+    TEST_ASSERT_TRUE(journal.Write(60, buf, 1));
+
+    // Новая разметка обнуляет слоты: запись 60 не восстанавливается
+    JournalBlockDevice formatted(disk, SmallJournal(64));
+    TEST_ASSERT_TRUE(formatted.Format());
+    FillBlocks(buf, 70, 1, 0x20);
+    TEST_ASSERT_TRUE(formatted.Write(70, buf, 1));
+
+    JournalBlockDevice reopened(disk, SmallJournal(64));
+    TEST_ASSERT_TRUE(reopened.Open());
+    TEST_ASSERT_EQUAL_UINT32(2, reopened.GetJournalUsed());
+    uint8_t out[kBlock];
+    TEST_ASSERT_TRUE(reopened.Read(60, out, 1));
+    TEST_ASSERT_EQUAL_HEX8(0x00, out[0]);
+    TEST_ASSERT_TRUE(reopened.Read(70, out, 1));
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(0x20 + 70), out[0]);
+}
+
+void test_journal_on_sd_card_survives_reset() {
+    SdCardSimConfig card_cfg;
+    card_cfg.block_count = 8192;
+    SdCardSim card(card_cfg);
+    card.Attach(1);
+    std::vector<uint8_t> reference(512 * kBlock, 0);
+
+    {
+        usb::SdmmcBlockDevice sd;
+        TEST_ASSERT_TRUE(sd.Init());
+        JournalBlockDevice journal(sd, SmallJournal(128));
+        TEST_ASSERT_TRUE(journal.Format());
+        WriteBoth(journal, reference, 2, 1, 0x10);
+        WriteBoth(journal, reference, 100, 8, 0x20);
+        WriteBoth(journal, reference, 2, 1, 0x30);
+        TEST_ASSERT_EQUAL_UINT32(13, journal.GetJournalUsed());
+    }
+
+    // На месте данных ещё нет: хост получил GOOD только за журнал
+    uint8_t peek[kBlock];
+    card.PeekBlock(100, peek);
+    TEST_ASSERT_EQUAL_HEX8(0x00, peek[0]);
+
+    usb::SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    JournalBlockDevice journal(sd, SmallJournal(128));
+    TEST_ASSERT_TRUE(journal.Open());
+    std::vector<uint8_t> out(reference.size());
+    TEST_ASSERT_TRUE(journal.Read(0, out.data(), 512));
+    TEST_ASSERT_EQUAL_MEMORY(reference.data(), out.data(), reference.size());
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_open_reserves_journal_at_device_end);
+    RUN_TEST(test_open_requires_journal_header);
+    RUN_TEST(test_small_writes_append_to_journal);
+    RUN_TEST(test_compaction_sorts_and_drops_superseded_copies);
+    RUN_TEST(test_long_write_goes_home_after_journal_copy);
+    RUN_TEST(test_full_journal_compacts_inside_write);
+    RUN_TEST(test_compact_percent_defers_background_work);
+    RUN_TEST(test_failed_write_keeps_previous_data);
+    RUN_TEST(test_matches_plain_device_under_random_io);
+    RUN_TEST(test_open_replays_unsynced_writes);
+    RUN_TEST(test_open_drops_torn_record);
+    RUN_TEST(test_open_does_not_replay_copy_moved_before_direct_write);
+    RUN_TEST(test_format_drops_previous_journal);
+    RUN_TEST(test_journal_on_sd_card_survives_reset);
+
+    return UNITY_END();
+}
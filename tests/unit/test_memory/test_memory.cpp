@@ -0,0 +1,97 @@
+/**
+ * @file test_memory.cpp
+ * @brief Unit тесты отчёта о статической памяти и SdmmcBlockDevice без кучи
+ */
+
+#include <unity.h>
+#include "usb_memory.h"
+#include "sim/SdCardSim.hpp"
+#include "stm32h7xx_hal.h"
+
+#include <cstdlib>
+#include <new>
+
+using usb::SdmmcBlockDevice;
+using usb::sim::SdCardSim;
+using usb::sim::SimTime;
+
+namespace memory = usb::memory;
+
+// Счётчик выделений кучи во всём тесте
+static uint32_t g_allocations = 0;
+
+void* operator new(std::size_t size) {
+    g_allocations++;
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void setUp() {
+    SimTime::Reset();
+    usb::sim::HalState::Reset();
+}
+
+void tearDown() {
+}
+
+void test_footprint_sums_to_total() {
+    uint32_t sum = 0;
+    for (const memory::Footprint& f : memory::kFootprint) {
+        sum += f.bytes;
+    }
+    TEST_ASSERT_EQUAL_UINT32(memory::kTotalBytes, sum);
+    TEST_ASSERT_EQUAL_UINT32(memory::kVendorRingBytes + memory::kMscTraceBytes,
+                             memory::kArenaBytes);
+}
+
+void test_footprint_follows_tinyusb_config() {
+    TEST_ASSERT_EQUAL_UINT32(CFG_TUD_CDC_RX_BUFSIZE + CFG_TUD_CDC_TX_BUFSIZE + 2 * 64,
+                             memory::kCdcBytes);
+    TEST_ASSERT_EQUAL_UINT32(CFG_TUD_MSC_EP_BUFSIZE, memory::kMscBytes);
+    TEST_ASSERT_EQUAL_UINT32(USB_DFU_TRANSFER_SIZE, memory::kDfuBytes);
+    TEST_ASSERT_TRUE(memory::kVendorRingBytes >=
+                     2 * USB_VENDOR_RING_BUFFERS * USB_VENDOR_BUFFER_SIZE);
+    TEST_ASSERT_TRUE(memory::kMscTraceBytes >= usb::kMscTraceDepth * sizeof(usb::MscTraceEntry));
+}
+
+void test_sdmmc_holds_impl_in_object() {
+    TEST_ASSERT_EQUAL_UINT32(sizeof(SdmmcBlockDevice), memory::kSdmmcBytes);
+    TEST_ASSERT_TRUE(sizeof(SdmmcBlockDevice) >= 2 * SdmmcBlockDevice::kMaxPhysBlockSize);
+    TEST_ASSERT_EQUAL_UINT32(0, alignof(SdmmcBlockDevice) % SdmmcBlockDevice::kImplAlign);
+}
+
+void test_sdmmc_does_not_allocate() {
+    SdCardSim card;
+    card.Attach(1);
+
+    const uint32_t before = g_allocations;
+    {
+        SdmmcBlockDevice sd;
+        TEST_ASSERT_TRUE(sd.Init());
+        TEST_ASSERT_TRUE(sd.IsReady());
+        sd.DeInit();
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, g_allocations);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_footprint_sums_to_total);
+    RUN_TEST(test_footprint_follows_tinyusb_config);
+    RUN_TEST(test_sdmmc_holds_impl_in_object);
+    RUN_TEST(test_sdmmc_does_not_allocate);
+
+    return UNITY_END();
+}
@@ -78,6 +78,21 @@ void test_mock_device_sync_increments_counter() {
     TEST_ASSERT_EQUAL_UINT32(1, device.GetSyncCount());
 }
 
+void test_mock_device_latency_model_accumulates_time() {
+    MockBlockDevice device(16, 512);
+    device.SetLatencyModel(100, 10, 50);
+    
+    uint8_t buf[4 * 512] = {0};
+    TEST_ASSERT_TRUE(device.Read(0, buf, 4));
+    TEST_ASSERT_EQUAL_UINT64(140, device.GetModelledTimeUs());
+    
+    TEST_ASSERT_TRUE(device.Write(0, buf, 2));
+    TEST_ASSERT_EQUAL_UINT64(340, device.GetModelledTimeUs());
+    
+    device.ResetCounters();
+    TEST_ASSERT_EQUAL_UINT64(0, device.GetModelledTimeUs());
+}
+
 int main() {
     UNITY_BEGIN();
     
@@ -88,6 +103,7 @@ int main() {
     RUN_TEST(test_mock_device_fails_on_out_of_bounds_read);
     RUN_TEST(test_mock_device_fails_when_not_ready);
     RUN_TEST(test_mock_device_sync_increments_counter);
+    RUN_TEST(test_mock_device_latency_model_accumulates_time);
     
     return UNITY_END();
 }
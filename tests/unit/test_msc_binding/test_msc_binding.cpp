@@ -0,0 +1,207 @@
+/**
+ * @file test_msc_binding.cpp
+ * @brief Unit тесты MscBinding<Device> (MSC без виртуальных вызовов, кэш геометрии)
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "mock/MockBlockDevice.hpp"
+#include "sim/TinyUsbSim.hpp"
+
+#include <cstring>
+#include <vector>
+
+using usb::MscBinding;
+using usb::MscBindingState;
+using usb::UsbDevice;
+using usb::mock::MockBlockDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::TinyUsbSim;
+
+/// RAM диск без виртуальных методов, размер блока известен при компиляции
+class RamDisk {
+public:
+    static constexpr uint32_t kBlockSize = 512;
+
+    explicit RamDisk(uint32_t blocks) : data_(blocks * kBlockSize, 0), blocks_(blocks) {}
+
+    bool IsReady() const { return ready_; }
+    uint32_t GetBlockCount() const {
+        geometry_calls_++;
+        return blocks_;
+    }
+
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) {
+        reads_++;
+        std::memcpy(buffer, &data_[lba * kBlockSize], count * kBlockSize);
+        return true;
+    }
+
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+        writes_++;
+        std::memcpy(&data_[lba * kBlockSize], buffer, count * kBlockSize);
+        return true;
+    }
+
+    void SetReady(bool ready) { ready_ = ready; }
+    void Resize(uint32_t blocks) {
+        blocks_ = blocks;
+        data_.resize(blocks * kBlockSize);
+    }
+
+    std::vector<uint8_t> data_;
+    uint32_t blocks_;
+    bool ready_ = true;
+    uint32_t reads_ = 0;
+    uint32_t writes_ = 0;
+    mutable uint32_t geometry_calls_ = 0;
+};
+
+/// Наследник переопределяет Read — привязка к базовому типу его не видит
+class TracingMock : public MockBlockDevice {
+public:
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override {
+        overridden_reads++;
+        return MockBlockDevice::Read(lba, buffer, count);
+    }
+    uint32_t overridden_reads = 0;
+};
+
+static UsbDevice g_usb;
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_usb.Init();
+    g_usb.MscResetStats();
+}
+
+void tearDown() {
+    g_usb.MscDetach();
+}
+
+void test_static_block_size_detection() {
+    TEST_ASSERT_EQUAL_UINT32(512, MscBinding<RamDisk>::kBlockSize);
+    TEST_ASSERT_EQUAL_UINT32(0, MscBinding<MockBlockDevice>::kBlockSize);
+    TEST_ASSERT_EQUAL_UINT32(0, MscBinding<usb::IBlockDevice>::kBlockSize);
+    // Одна таблица переходников на тип
+    RamDisk a(8);
+    RamDisk b(8);
+    TEST_ASSERT_EQUAL_PTR(MscBinding<RamDisk>::Bind(a).ops, MscBinding<RamDisk>::Bind(b).ops);
+}
+
+void test_concrete_device_io_through_host() {
+    RamDisk disk(256);
+    g_usb.MscAttach(disk);
+    TEST_ASSERT_TRUE(g_usb.MscIsAttached());
+
+    MscHostSim host;
+    uint8_t out[8 * 512];
+    uint8_t in[8 * 512] = {0};
+    for (uint32_t i = 0; i < sizeof(out); i++) {
+        out[i] = static_cast<uint8_t>(i * 13);
+    }
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(32, 8, out));
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(32, 8, in));
+    TEST_ASSERT_EQUAL_MEMORY(out, in, sizeof(out));
+    TEST_ASSERT_EQUAL_MEMORY(out, &disk.data_[32 * 512], sizeof(out));
+    TEST_ASSERT_TRUE(disk.reads_ > 0);
+
+    usb::MscStats s = g_usb.MscGetStats();
+    TEST_ASSERT_EQUAL_UINT32(8, s.blocks_read);
+    TEST_ASSERT_EQUAL_UINT32(8, s.blocks_written);
+}
+
+void test_geometry_cached_and_refreshed_by_read_capacity() {
+    RamDisk disk(100);
+    g_usb.MscAttach(disk);
+    TEST_ASSERT_EQUAL_UINT32(1, disk.geometry_calls_);  // При подключении
+
+    MscHostSim host;
+    uint8_t buf[4 * 512];
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 4, buf));
+    TEST_ASSERT_EQUAL_UINT32(1, disk.geometry_calls_);  // Не на каждом куске
+
+    disk.Resize(200);  // Смена носителя
+    uint32_t last_lba = 0;
+    uint32_t block_size = 0;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.ReadCapacity(&last_lba, &block_size));
+    TEST_ASSERT_EQUAL_UINT32(199, last_lba);
+    TEST_ASSERT_EQUAL_UINT32(512, block_size);
+}
+
+void test_not_ready_at_attach_then_ready() {
+    MockBlockDevice disk(64, 512);
+    disk.SetReady(false);
+    g_usb.MscAttach(disk);  // По ссылке: MscBinding<MockBlockDevice>
+
+    MscHostSim host;
+    uint8_t buf[512];
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.TestUnitReady());
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.Read10(0, 1, buf));
+
+    // Кэш размера блока пуст — читается на первом куске после готовности
+    disk.SetReady(true);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 1, buf));
+    TEST_ASSERT_EQUAL_UINT32(1, disk.GetReadCount());
+}
+
+void test_virtual_fallback_and_detach() {
+    TracingMock disk;
+    g_usb.MscAttach(static_cast<usb::IBlockDevice*>(&disk));  // vtable
+    MscHostSim host;
+    uint8_t buf[512];
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 1, buf));
+    TEST_ASSERT_EQUAL_UINT32(1, disk.overridden_reads);
+
+    g_usb.MscAttach(disk);  // Настоящий тип — TracingMock::Read напрямую
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 1, buf));
+    TEST_ASSERT_EQUAL_UINT32(2, disk.overridden_reads);
+
+    g_usb.MscAttach(static_cast<usb::IBlockDevice*>(nullptr));
+    TEST_ASSERT_FALSE(g_usb.MscIsAttached());
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.TestUnitReady());
+}
+
+void test_binding_transfer_splits_by_block() {
+    RamDisk disk(16);
+    MscBindingState state = MscBinding<RamDisk>::Bind(disk);
+    TEST_ASSERT_EQUAL_UINT32(0, state.block_count);  // Bind() геометрию не читает
+    TEST_ASSERT_TRUE(state.RefreshGeometry());
+    TEST_ASSERT_EQUAL_UINT32(16, state.block_count);
+    TEST_ASSERT_EQUAL_UINT32(512, state.block_size);
+
+    uint8_t buf[1024 + 100];
+    TEST_ASSERT_EQUAL_INT32(2, state.Transfer(false, 0, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_INT32(0, state.Transfer(false, 0, buf, 100));
+    disk.SetReady(false);
+    TEST_ASSERT_EQUAL_INT32(-1, state.Transfer(true, 0, buf, 512));
+    TEST_ASSERT_FALSE(state.RefreshGeometry());
+}
+
+void test_binding_sync_is_optional() {
+    // Без Sync() у типа сбрасывать нечего
+    RamDisk ram(16);
+    TEST_ASSERT_FALSE(usb::HasSync<RamDisk>::value);
+    TEST_ASSERT_TRUE(MscBinding<RamDisk>::Bind(ram).Sync());
+
+    MockBlockDevice disk;
+    MscBindingState state = MscBinding<MockBlockDevice>::Bind(disk);
+    TEST_ASSERT_TRUE(state.Sync());
+    TEST_ASSERT_EQUAL_UINT32(1, disk.GetSyncCount());
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_static_block_size_detection);
+    RUN_TEST(test_concrete_device_io_through_host);
+    RUN_TEST(test_geometry_cached_and_refreshed_by_read_capacity);
+    RUN_TEST(test_not_ready_at_attach_then_ready);
+    RUN_TEST(test_virtual_fallback_and_detach);
+    RUN_TEST(test_binding_transfer_splits_by_block);
+    RUN_TEST(test_binding_sync_is_optional);
+
+    return UNITY_END();
+}
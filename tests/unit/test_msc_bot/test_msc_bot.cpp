@@ -0,0 +1,388 @@
+/**
+ * @file test_msc_bot.cpp
+ * @brief Сквозные тесты MSC Bulk-Only Transport: хост → TinyUSB модель → tud_msc_* → IBlockDevice
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_journal.h"
+#include "usb_sdmmc.h"
+#include "mock/MockBlockDevice.hpp"
+#include "sim/SdCardSim.hpp"
+#include "sim/TinyUsbSim.hpp"
+#include "stm32h7xx_hal.h"
+
+extern "C" {
+#include "tusb.h"
+}
+
+#include <cstring>
+#include <vector>
+
+using usb::UsbDevice;
+using usb::mock::MockBlockDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::SimTime;
+using usb::sim::TinyUsbSim;
+
+void setUp() {
+    SimTime::Reset();
+    usb::sim::HalState::Reset();
+    TinyUsbSim::Get().Reset();
+}
+
+void tearDown() {
+}
+
+static void FillPattern(uint8_t* buf, uint32_t len, uint8_t seed) {
+    for (uint32_t i = 0; i < len; i++) {
+        buf[i] = static_cast<uint8_t>(seed + i * 13);
+    }
+}
+
+static void PumpUsb(void* context) {
+    static_cast<UsbDevice*>(context)->Process();
+}
+
+/// Декоратор: запоминает MscIsBusy() изнутри callback'а
+class BusyProbeDevice : public usb::IBlockDevice {
+public:
+    BusyProbeDevice(usb::IBlockDevice& inner, const UsbDevice& usb) : inner_(inner), usb_(usb) {}
+
+    [[nodiscard]] bool IsReady() const override { return inner_.IsReady(); }
+    [[nodiscard]] uint32_t GetBlockCount() const override { return inner_.GetBlockCount(); }
+    [[nodiscard]] uint32_t GetBlockSize() const override { return inner_.GetBlockSize(); }
+
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override {
+        busy_seen_ = busy_seen_ || usb_.MscIsBusy();
+        return inner_.Read(lba, buffer, count);
+    }
+
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override {
+        busy_seen_ = busy_seen_ || usb_.MscIsBusy();
+        return inner_.Write(lba, buffer, count);
+    }
+
+    bool busy_seen_ = false;
+
+private:
+    usb::IBlockDevice& inner_;
+    const UsbDevice& usb_;
+};
+
+void test_bot_inquiry_reports_scsi_strings() {
+    MockBlockDevice disk;
+    UsbDevice usb;
+    TEST_ASSERT_TRUE(usb.Init());
+    usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t inquiry[36] = {0};
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Inquiry(inquiry));
+    TEST_ASSERT_EQUAL_HEX8(0x80, inquiry[1]);
+    TEST_ASSERT_EQUAL_MEMORY("USB     ", inquiry + 8, 8);
+    TEST_ASSERT_EQUAL_MEMORY("Mass Storage    ", inquiry + 16, 16);
+    TEST_ASSERT_EQUAL_UINT32(1, TinyUsbSim::Get().GetMscStats().inquiry_cb_calls);
+}
+
+void test_bot_read_capacity_matches_device() {
+    MockBlockDevice disk(2048);
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint32_t last_lba = 0;
+    uint32_t block_size = 0;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.ReadCapacity(&last_lba, &block_size));
+    TEST_ASSERT_EQUAL_UINT32(2047, last_lba);
+    TEST_ASSERT_EQUAL_UINT32(512, block_size);
+}
+
+void test_bot_test_unit_ready_storm_counts_callbacks() {
+    MockBlockDevice disk;
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&disk);
+
+    MscHostSim host;
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, TinyUsbSim::Get().GetMscStats().tur_cb_calls);
+    TEST_ASSERT_EQUAL_UINT32(100, TinyUsbSim::Get().GetMscStats().cbw_count);
+    TEST_ASSERT_EQUAL_UINT32(100, host.GetRecords().size());
+}
+
+void test_bot_read10_is_chunked_by_ep_buffer() {
+    MockBlockDevice disk;
+    FillPattern(disk.GetData(), 16 * 512, 0x21);
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t buf[8 * 512] = {0};
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(4, 8, buf));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(disk.GetData() + 4 * 512, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_UINT32(0, host.GetLastResidue());
+
+    // EP буфер 512 байт — один callback на блок
+    const auto& stats = TinyUsbSim::Get().GetMscStats();
+    TEST_ASSERT_EQUAL_UINT32(8, stats.read10_cb_calls);
+    TEST_ASSERT_EQUAL_UINT32(512, stats.max_chunk);
+    TEST_ASSERT_EQUAL_UINT32(8, disk.GetReadCount());
+    TEST_ASSERT_EQUAL_UINT32(8, host.GetRecords().back().callbacks);
+}
+
+void test_bot_larger_ep_buffer_reduces_callbacks() {
+    MockBlockDevice disk;
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&disk);
+    TinyUsbSim::Get().SetMscEpBufferSize(4096);
+
+    MscHostSim host;
+    uint8_t buf[16 * 512];
+    FillPattern(buf, sizeof(buf), 0x42);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(32, 16, buf));
+    TEST_ASSERT_EQUAL_UINT32(2, TinyUsbSim::Get().GetMscStats().write10_cb_calls);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(buf, disk.GetData() + 32 * 512, sizeof(buf));
+}
+
+void test_bot_chunk_is_one_multi_block_sd_command() {
+    usb::sim::SdCardSim card;
+    card.Attach(1);
+    usb::SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&sd);
+    TinyUsbSim::Get().SetMscEpBufferSize(8192);
+    card.ResetStats();
+
+    // 20 блоков: куски 16 + 4, последний кончается раньше EP буфера
+    MscHostSim host;
+    host.SetPump(PumpUsb, &usb);
+    uint8_t wbuf[20 * 512];
+    uint8_t rbuf[20 * 512] = {0};
+    FillPattern(wbuf, sizeof(wbuf), 0x17);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(300, 20, wbuf));
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(300, 20, rbuf));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(wbuf, rbuf, sizeof(wbuf));
+
+    TEST_ASSERT_EQUAL_UINT32(2, TinyUsbSim::Get().GetMscStats().read10_cb_calls);
+    TEST_ASSERT_EQUAL_UINT32(2, card.GetStats().write_cmds);
+    TEST_ASSERT_EQUAL_UINT32(2, card.GetStats().read_cmds);
+}
+
+void test_bot_read10_chunk_ending_inside_block() {
+    // Блок 1 KB, EP буфер 1.5 KB: callback берёт целый блок, хвост куска — следующим
+    MockBlockDevice disk(64, 1024);
+    FillPattern(disk.GetData(), 16 * 1024, 0x33);
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&disk);
+    TinyUsbSim::Get().SetMscEpBufferSize(1536);
+
+    MscHostSim host;
+    uint32_t last_lba = 0;
+    uint32_t block_size = 0;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.ReadCapacity(&last_lba, &block_size));
+    TEST_ASSERT_EQUAL_UINT32(1024, block_size);
+
+    uint8_t buf[4 * 1024] = {0};
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(2, 4, buf));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(disk.GetData() + 2 * 1024, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_UINT32(0, host.GetLastResidue());
+    TEST_ASSERT_EQUAL_UINT32(4, disk.GetReadCount());
+    TEST_ASSERT_EQUAL_UINT32(5, disk.GetLastReadLba());
+}
+
+void test_bot_write_read_roundtrip_on_sd_card() {
+    usb::sim::SdCardSim card;
+    card.Attach(1);
+    usb::SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&sd);
+
+    MscHostSim host;
+    host.SetPump(PumpUsb, &usb);
+
+    uint8_t wbuf[4 * 512];
+    uint8_t rbuf[4 * 512] = {0};
+    FillPattern(wbuf, sizeof(wbuf), 0x5A);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(200, 4, wbuf));
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(200, 4, rbuf));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(wbuf, rbuf, sizeof(wbuf));
+
+    // Латентность в виртуальном времени симулятора
+    const auto& records = host.GetRecords();
+    TEST_ASSERT_EQUAL_UINT32(2, records.size());
+    TEST_ASSERT_GREATER_THAN_UINT32(0, static_cast<uint32_t>(records[0].latency_us));
+    TEST_ASSERT_GREATER_THAN_UINT32(0, static_cast<uint32_t>(records[1].latency_us));
+}
+
+void test_bot_busy_guard_active_inside_callback() {
+    MockBlockDevice disk;
+    UsbDevice usb;
+    usb.Init();
+    BusyProbeDevice probe(disk, usb);
+    usb.MscAttach(&probe);
+
+    MscHostSim host;
+    uint8_t buf[512] = {0};
+    TEST_ASSERT_FALSE(usb.MscIsBusy());
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 1, buf));
+    TEST_ASSERT_TRUE(probe.busy_seen_);
+    TEST_ASSERT_FALSE(usb.MscIsBusy());
+}
+
+void test_bot_not_ready_sets_medium_not_present_sense() {
+    MockBlockDevice disk;
+    disk.SetReady(false);
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&disk);
+
+    MscHostSim host;
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.TestUnitReady());
+
+    uint8_t key = 0, asc = 0, ascq = 0;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.RequestSense(&key, &asc, &ascq));
+    TEST_ASSERT_EQUAL_HEX8(SCSI_SENSE_NOT_READY, key);
+    TEST_ASSERT_EQUAL_HEX8(0x3A, asc);
+
+    // REQUEST SENSE очищает sense
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.RequestSense(&key, &asc, &ascq));
+    TEST_ASSERT_EQUAL_HEX8(SCSI_SENSE_NONE, key);
+}
+
+void test_bot_read_error_fails_csw_with_residue() {
+    usb::sim::SdCardSim card;
+    card.Attach(1);
+    usb::SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&sd);
+
+    TEST_ASSERT_TRUE(card.InjectFault(usb::sim::SdFaultOp::Read, 10, 1, 1));
+
+    MscHostSim host;
+    uint8_t buf[4 * 512];
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.Read10(8, 4, buf));
+    TEST_ASSERT_EQUAL_UINT32(2 * 512, host.GetLastResidue());
+
+    uint8_t key = 0, asc = 0, ascq = 0;
+    host.RequestSense(&key, &asc, &ascq);
+    TEST_ASSERT_EQUAL_HEX8(SCSI_SENSE_NOT_READY, key);
+    TEST_ASSERT_EQUAL_HEX8(0x3A, asc);
+}
+
+void test_bot_eject_via_start_stop_unit() {
+    MockBlockDevice disk;
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&disk);
+
+    MscHostSim host;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.StartStopUnit(false, true));
+    TEST_ASSERT_EQUAL_UINT32(1, disk.GetSyncCount());
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.TestUnitReady());
+
+    uint8_t buf[512];
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.Read10(0, 1, buf));
+    TEST_ASSERT_EQUAL_UINT32(0, disk.GetReadCount());
+
+    // Повторное подключение снимает eject
+    usb.MscAttach(&disk);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+}
+
+void test_bot_unknown_command_is_illegal_request() {
+    MockBlockDevice disk;
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&disk);
+
+    MscHostSim host;
+    const uint8_t cdb[10] = {0x2F};  // VERIFY (10)
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.Execute(cdb, sizeof(cdb), true, nullptr, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, TinyUsbSim::Get().GetMscStats().scsi_cb_calls);
+
+    uint8_t key = 0, asc = 0, ascq = 0;
+    host.RequestSense(&key, &asc, &ascq);
+    TEST_ASSERT_EQUAL_HEX8(SCSI_SENSE_ILLEGAL_REQUEST, key);
+    TEST_ASSERT_EQUAL_HEX8(0x20, asc);
+}
+
+void test_bot_synchronize_cache_syncs_device() {
+    MockBlockDevice disk;
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&disk);
+
+    MscHostSim host;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.SynchronizeCache10());
+    TEST_ASSERT_EQUAL_UINT32(1, disk.GetSyncCount());
+    TEST_ASSERT_EQUAL_UINT32(1, TinyUsbSim::Get().GetMscStats().scsi_cb_calls);
+}
+
+void test_bot_synchronize_cache_drains_journal() {
+    MockBlockDevice disk(8192, 512);
+    usb::JournalConfig cfg;
+    cfg.journal_blocks = 64;
+    usb::JournalBlockDevice journal(disk, cfg);
+    TEST_ASSERT_TRUE(journal.Format());
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(journal);
+
+    MscHostSim host;
+    uint8_t buf[512];
+    FillPattern(buf, sizeof(buf), 0x21);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(10, 1, buf));
+    TEST_ASSERT_EQUAL_UINT32(2, journal.GetJournalUsed());
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.SynchronizeCache10());
+    TEST_ASSERT_EQUAL_UINT32(0, journal.GetJournalUsed());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(buf, disk.GetData() + 10 * 512, sizeof(buf));
+
+    // Перенос не удался — хост узнаёт об этом, а не теряет данные молча
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(11, 1, buf));
+    disk.SetReady(false);
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.SynchronizeCache10());
+    uint8_t key = 0, asc = 0, ascq = 0;
+    host.RequestSense(&key, &asc, &ascq);
+    TEST_ASSERT_EQUAL_HEX8(SCSI_SENSE_MEDIUM_ERROR, key);
+    TEST_ASSERT_EQUAL_HEX8(0x0C, asc);
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.StartStopUnit(false, true));
+    TEST_ASSERT_EQUAL_UINT32(2, journal.GetJournalUsed());
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_bot_inquiry_reports_scsi_strings);
+    RUN_TEST(test_bot_read_capacity_matches_device);
+    RUN_TEST(test_bot_test_unit_ready_storm_counts_callbacks);
+    RUN_TEST(test_bot_read10_is_chunked_by_ep_buffer);
+    RUN_TEST(test_bot_larger_ep_buffer_reduces_callbacks);
+    RUN_TEST(test_bot_chunk_is_one_multi_block_sd_command);
+    RUN_TEST(test_bot_read10_chunk_ending_inside_block);
+    RUN_TEST(test_bot_write_read_roundtrip_on_sd_card);
+    RUN_TEST(test_bot_busy_guard_active_inside_callback);
+    RUN_TEST(test_bot_not_ready_sets_medium_not_present_sense);
+    RUN_TEST(test_bot_read_error_fails_csw_with_residue);
+    RUN_TEST(test_bot_eject_via_start_stop_unit);
+    RUN_TEST(test_bot_unknown_command_is_illegal_request);
+    RUN_TEST(test_bot_synchronize_cache_syncs_device);
+    RUN_TEST(test_bot_synchronize_cache_drains_journal);
+
+    return UNITY_END();
+}
@@ -0,0 +1,167 @@
+/**
+ * @file test_msc_stats.cpp
+ * @brief Unit тесты статистики MSC (UsbDevice::MscGetStats)
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "mock/MockBlockDevice.hpp"
+#include "mock/MockClock.hpp"
+#include "sim/TinyUsbSim.hpp"
+
+extern "C" {
+#include "tusb.h"
+}
+
+#include <type_traits>
+
+using usb::MscStats;
+using usb::UsbDevice;
+using usb::mock::MockBlockDevice;
+using usb::mock::MockClock;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::TinyUsbSim;
+
+static_assert(std::is_trivially_copyable<MscStats>::value, "MscStats must be a POD snapshot");
+
+/// Устройство, на каждый блок продвигающее часы профилировщика
+class TimedBlockDevice : public MockBlockDevice {
+public:
+    TimedBlockDevice(MockClock& clock, uint32_t us_per_block)
+        : clock_(clock), us_per_block_(us_per_block) {}
+
+    bool Read(uint32_t lba, uint8_t* buffer, uint32_t count) override {
+        clock_.AdvanceTickUs(us_per_block_ * count);
+        return MockBlockDevice::Read(lba, buffer, count);
+    }
+
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override {
+        clock_.AdvanceTickUs(us_per_block_ * count);
+        return MockBlockDevice::Write(lba, buffer, count);
+    }
+
+private:
+    MockClock& clock_;
+    uint32_t us_per_block_;
+};
+
+static MockClock g_clock;
+static UsbDevice g_usb;
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_clock.Reset();
+    g_usb.Init();
+    g_usb.SetProfileClock(&g_clock);
+    g_usb.MscResetStats();
+}
+
+void tearDown() {
+    g_usb.MscDetach();
+    g_usb.SetProfileClock(nullptr);
+}
+
+void test_stats_count_blocks_and_commands() {
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t buf[8 * 512] = {0};
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(0, 8, buf));
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 4, buf));
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(4, 4, buf));
+
+    MscStats s = g_usb.MscGetStats();
+    TEST_ASSERT_EQUAL_UINT32(4, s.commands);
+    TEST_ASSERT_EQUAL_UINT32(2, s.read_commands);
+    TEST_ASSERT_EQUAL_UINT32(1, s.write_commands);
+    TEST_ASSERT_EQUAL_UINT32(8, s.blocks_read);
+    TEST_ASSERT_EQUAL_UINT32(8, s.blocks_written);
+}
+
+void test_stats_classify_sequential_and_random() {
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t buf[2 * 512];
+    host.Read10(100, 2, buf);  // первая — random
+    host.Read10(102, 2, buf);  // продолжение — sequential
+    host.Read10(104, 2, buf);  // sequential
+    host.Read10(10, 2, buf);   // random
+    host.Write10(50, 1, buf);  // random
+    host.Write10(51, 1, buf);  // sequential
+
+    MscStats s = g_usb.MscGetStats();
+    TEST_ASSERT_EQUAL_UINT32(2, s.sequential_reads);
+    TEST_ASSERT_EQUAL_UINT32(2, s.random_reads);
+    TEST_ASSERT_EQUAL_UINT32(1, s.sequential_writes);
+    TEST_ASSERT_EQUAL_UINT32(1, s.random_writes);
+}
+
+void test_stats_latency_histogram_per_operation() {
+    TimedBlockDevice disk(g_clock, 300);
+    g_usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t buf[4 * 512];
+    host.Read10(0, 4, buf);   // 4 × 300 мкс
+    host.Write10(0, 1, buf);  // 300 мкс
+
+    MscStats s = g_usb.MscGetStats();
+    TEST_ASSERT_EQUAL_UINT32(1, s.read_latency.count);
+    TEST_ASSERT_EQUAL_UINT32(1200, s.read_latency.max_us);
+    TEST_ASSERT_EQUAL_UINT32(1, s.write_latency.count);
+    TEST_ASSERT_EQUAL_UINT32(300, s.write_latency.min_us);
+    TEST_ASSERT_EQUAL_UINT32(1, s.write_latency.buckets[usb::LatencyHistogram::BucketOf(300)]);
+}
+
+void test_stats_track_errors_and_sense() {
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+    disk.SetReady(false);
+
+    MscHostSim host;
+    uint8_t buf[512];
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.TestUnitReady());
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.Read10(0, 1, buf));
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.Write10(0, 1, buf));
+
+    MscStats s = g_usb.MscGetStats();
+    TEST_ASSERT_EQUAL_UINT32(1, s.not_ready);
+    TEST_ASSERT_EQUAL_UINT32(1, s.read_errors);
+    TEST_ASSERT_EQUAL_UINT32(1, s.write_errors);
+    TEST_ASSERT_EQUAL_UINT32(1, s.sense_count[SCSI_SENSE_NOT_READY]);
+    TEST_ASSERT_EQUAL_HEX8(SCSI_SENSE_NOT_READY, s.last_sense_key);
+    TEST_ASSERT_EQUAL_HEX8(0x3A, s.last_sense_asc);
+}
+
+void test_stats_reset() {
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t buf[512];
+    host.Read10(0, 1, buf);
+    TEST_ASSERT_EQUAL_UINT32(1, g_usb.MscGetStats().read_commands);
+
+    g_usb.MscResetStats();
+    MscStats s = g_usb.MscGetStats();
+    TEST_ASSERT_EQUAL_UINT32(0, s.read_commands);
+    TEST_ASSERT_EQUAL_UINT32(0, s.read_latency.count);
+    TEST_ASSERT_EQUAL_UINT32(0, s.read_latency.min_us);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_stats_count_blocks_and_commands);
+    RUN_TEST(test_stats_classify_sequential_and_random);
+    RUN_TEST(test_stats_latency_histogram_per_operation);
+    RUN_TEST(test_stats_track_errors_and_sense);
+    RUN_TEST(test_stats_reset);
+
+    return UNITY_END();
+}
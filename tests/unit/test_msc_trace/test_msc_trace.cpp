@@ -0,0 +1,152 @@
+/**
+ * @file test_msc_trace.cpp
+ * @brief Unit тесты трассы SCSI команд (usb_msc_trace.h) и разбора CSV (TraceReplay.hpp)
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "mock/MockBlockDevice.hpp"
+#include "mock/MockClock.hpp"
+#include "sim/TinyUsbSim.hpp"
+#include "bench/TraceReplay.hpp"
+
+#include <string>
+
+using usb::MscTraceEntry;
+using usb::MscTraceStatus;
+using usb::UsbDevice;
+using usb::mock::MockBlockDevice;
+using usb::mock::MockClock;
+using usb::sim::MscHostSim;
+using usb::sim::TinyUsbSim;
+
+static MockClock g_clock;
+static UsbDevice g_usb;
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_clock.Reset();
+    g_usb.Init();
+    g_usb.SetProfileClock(&g_clock);
+    g_usb.MscTraceClear();
+}
+
+void tearDown() {
+    g_usb.MscDetach();
+    g_usb.SetProfileClock(nullptr);
+}
+
+static bool AppendToString(const char* data, uint32_t len, void* context) {
+    static_cast<std::string*>(context)->append(data, len);
+    return true;
+}
+
+void test_trace_records_read_write_commands() {
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t buf[8 * 512] = {0};
+    host.Write10(40, 8, buf);
+    g_clock.AdvanceTickUs(1000);
+    host.Read10(40, 2, buf);
+
+    MscTraceEntry entries[4];
+    TEST_ASSERT_EQUAL_UINT32(2, g_usb.MscTraceSnapshot(entries, 4));
+    TEST_ASSERT_EQUAL_HEX8(0x2A, entries[0].opcode);
+    TEST_ASSERT_EQUAL_UINT32(40, entries[0].lba);
+    TEST_ASSERT_EQUAL_UINT16(8, entries[0].blocks);
+    TEST_ASSERT_EQUAL_HEX8(0x28, entries[1].opcode);
+    TEST_ASSERT_EQUAL_UINT16(2, entries[1].blocks);
+    TEST_ASSERT_EQUAL_UINT32(1000, entries[1].timestamp_us - entries[0].timestamp_us);
+    TEST_ASSERT_EQUAL(MscTraceStatus::Passed, entries[1].status);
+}
+
+void test_trace_marks_failed_commands() {
+    MockBlockDevice disk;
+    disk.SetReady(false);
+    g_usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t buf[512];
+    host.TestUnitReady();
+    host.Read10(0, 1, buf);
+
+    MscTraceEntry entries[2];
+    TEST_ASSERT_EQUAL_UINT32(2, g_usb.MscTraceSnapshot(entries, 2));
+    TEST_ASSERT_EQUAL_HEX8(0x00, entries[0].opcode);
+    TEST_ASSERT_EQUAL(MscTraceStatus::Failed, entries[0].status);
+    TEST_ASSERT_EQUAL(MscTraceStatus::Failed, entries[1].status);
+}
+
+void test_trace_ring_keeps_newest_entries() {
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t buf[512];
+    const uint32_t total = usb::kMscTraceDepth + 10;
+    for (uint32_t i = 0; i < total; i++) {
+        host.Read10(i, 1, buf);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(total, g_usb.MscTraceTotal());
+    MscTraceEntry first;
+    TEST_ASSERT_EQUAL_UINT32(1, g_usb.MscTraceSnapshot(&first, 1));
+    TEST_ASSERT_EQUAL_UINT32(total - 1, first.lba);  // Snapshot отдаёт самые новые
+}
+
+void test_trace_dump_csv_roundtrip() {
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t buf[4 * 512] = {0};
+    host.TestUnitReady();
+    host.Read10(7, 4, buf);
+    host.Write10(100, 1, buf);
+
+    std::string csv;
+    TEST_ASSERT_TRUE(g_usb.MscTraceDump(AppendToString, &csv));
+    TEST_ASSERT_EQUAL_INT(0, csv.find("t_us,op,lba"));
+
+    auto records = usb::bench::ParseTraceCsv(csv);
+    TEST_ASSERT_EQUAL_UINT32(3, records.size());
+    TEST_ASSERT_EQUAL_HEX8(0x28, records[1].opcode);
+    TEST_ASSERT_EQUAL_UINT32(7, records[1].lba);
+    TEST_ASSERT_EQUAL_UINT32(4, records[1].blocks);
+
+    auto workload = usb::bench::TraceToWorkload(records);
+    TEST_ASSERT_EQUAL_UINT32(2, workload.ops.size());
+    TEST_ASSERT_EQUAL(usb::bench::IoKind::Write, workload.ops[1].kind);
+}
+
+void test_trace_dump_over_cdc() {
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+
+    MscHostSim host;
+    uint8_t buf[512];
+    for (uint32_t i = 0; i < 50; i++) {
+        host.Read10(i * 8, 1, buf);
+    }
+
+    TEST_ASSERT_TRUE(g_usb.MscTraceDumpCdc());
+    auto received = TinyUsbSim::Get().HostCdcReceive();
+    std::string csv(received.begin(), received.end());
+    auto summary = usb::bench::Summarize(usb::bench::ParseTraceCsv(csv));
+    TEST_ASSERT_EQUAL_UINT32(50, summary.reads);
+    TEST_ASSERT_EQUAL_UINT32(50, summary.blocks_read);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_trace_records_read_write_commands);
+    RUN_TEST(test_trace_marks_failed_commands);
+    RUN_TEST(test_trace_ring_keeps_newest_entries);
+    RUN_TEST(test_trace_dump_csv_roundtrip);
+    RUN_TEST(test_trace_dump_over_cdc);
+
+    return UNITY_END();
+}
@@ -0,0 +1,397 @@
+/**
+ * @file test_partition.cpp
+ * @brief Unit тесты PartitionBlockDevice (разбор MBR/GPT, смещение LBA, синтезированный MBR)
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_partition.h"
+#include "mock/MockBlockDevice.hpp"
+#include "sim/TinyUsbSim.hpp"
+
+#include <cstring>
+#include <vector>
+
+using usb::PartitionBlockDevice;
+using usb::PartitionConfig;
+using usb::PartitionInfo;
+using usb::PartitionScheme;
+using usb::PartitionStats;
+using usb::PartitionView;
+using usb::UsbDevice;
+using usb::mock::MockBlockDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::TinyUsbSim;
+
+static constexpr uint32_t kBlock = 512;
+static constexpr uint32_t kDiskBlocks = 8192;  // 4 MB
+static constexpr uint32_t kLogFirst = 2048;    // Раздел 0 — журнал прошивки
+static constexpr uint32_t kLogCount = 2048;
+static constexpr uint32_t kUserFirst = 4096;   // Раздел 1 — данные пользователя
+static constexpr uint32_t kUserCount = 4096;
+
+static UsbDevice g_usb;
+
+static void Put32(uint8_t* p, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static void Put64(uint8_t* p, uint64_t value) {
+    Put32(p, static_cast<uint32_t>(value));
+    Put32(p + 4, static_cast<uint32_t>(value >> 32));
+}
+
+static uint32_t Get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint32_t Crc32(const uint8_t* data, uint32_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+static void PutMbrEntry(uint8_t* mbr, uint32_t index, uint8_t type, uint32_t first,
+                        uint32_t count) {
+    uint8_t* entry = mbr + 446 + index * 16;
+    entry[4] = type;
+    Put32(entry + 8, first);
+    Put32(entry + 12, count);
+    mbr[510] = 0x55;
+    mbr[511] = 0xAA;
+}
+
+/// Два раздела в MBR: журнал (0x83) и FAT32
+static void FormatMbr(MockBlockDevice& disk) {
+    uint8_t* mbr = disk.GetData();
+    PutMbrEntry(mbr, 0, 0x83, kLogFirst, kLogCount);
+    PutMbrEntry(mbr, 1, 0x0C, kUserFirst, kUserCount);
+}
+
+/// Защитный MBR, заголовок GPT в LBA 1, записи по 128 байт с LBA 2
+static void FormatGpt(MockBlockDevice& disk, bool corrupt_header = false) {
+    uint8_t* data = disk.GetData();
+    PutMbrEntry(data, 0, 0xEE, 1, kDiskBlocks - 1);
+
+    uint8_t* entries = data + 2 * kBlock;
+    const uint32_t firsts[2] = {kLogFirst, kUserFirst};
+    const uint32_t counts[2] = {kLogCount, kUserCount};
+    for (uint32_t i = 0; i < 2; i++) {
+        uint8_t* entry = entries + i * 128;
+        std::memset(entry, 0xA0 + i, 16);  // GUID типа
+        std::memset(entry + 16, 0x10 + i, 16);
+        Put64(entry + 32, firsts[i]);
+        Put64(entry + 40, firsts[i] + counts[i] - 1);
+    }
+
+    uint8_t* header = data + kBlock;
+    std::memcpy(header, "EFI PART", 8);
+    Put32(header + 8, 0x00010000);
+    Put32(header + 12, 92);
+    Put64(header + 24, 1);
+    Put64(header + 32, kDiskBlocks - 1);
+    Put64(header + 40, 34);
+    Put64(header + 48, kDiskBlocks - 34);
+    Put64(header + 72, 2);
+    Put32(header + 80, 128);
+    Put32(header + 84, 128);
+    Put32(header + 88, Crc32(entries, 128 * 128));
+    Put32(header + 16, Crc32(header, 92));
+    if (corrupt_header) {
+        header[48] ^= 1;
+    }
+}
+
+static void FillPattern(MockBlockDevice& disk, uint32_t first, uint32_t count, uint8_t seed) {
+    for (uint32_t i = 0; i < count * kBlock; i++) {
+        disk.GetData()[first * kBlock + i] = static_cast<uint8_t>(seed + i * 7 + (i >> 9));
+    }
+}
+
+static PartitionConfig VolumeConfig(uint8_t index) {
+    PartitionConfig cfg;
+    cfg.index = index;
+    cfg.view = PartitionView::Volume;
+    return cfg;
+}
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_usb.Init();
+}
+
+void tearDown() {
+    g_usb.MscDetach();
+}
+
+void test_mbr_volume_view_is_offset_add() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    FormatMbr(disk);
+    FillPattern(disk, kUserFirst, 8, 0x31);
+
+    PartitionBlockDevice user(disk, VolumeConfig(1));
+    TEST_ASSERT_FALSE(user.IsReady());  // До Open()
+    TEST_ASSERT_TRUE(user.Open());
+    TEST_ASSERT_TRUE(user.IsReady());
+    TEST_ASSERT_EQUAL_UINT32(kUserCount, user.GetBlockCount());
+    TEST_ASSERT_EQUAL_UINT32(0, user.GetDataLba());
+
+    PartitionInfo info = user.GetInfo();
+    TEST_ASSERT_EQUAL(PartitionScheme::Mbr, info.scheme);
+    TEST_ASSERT_EQUAL_UINT32(kUserFirst, info.first_lba);
+    TEST_ASSERT_EQUAL_UINT32(kUserCount, info.block_count);
+    TEST_ASSERT_EQUAL_HEX8(0x0C, info.mbr_type);
+
+    uint8_t buf[8 * kBlock];
+    disk.ResetCounters();
+    TEST_ASSERT_TRUE(user.Read(0, buf, 8));
+    TEST_ASSERT_EQUAL_MEMORY(disk.GetData() + kUserFirst * kBlock, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_UINT32(1, disk.GetReadCount());  // Один вызов, без разбиения
+    TEST_ASSERT_EQUAL_UINT32(kUserFirst, disk.GetLastReadLba());
+
+    std::memset(buf, 0x5A, sizeof(buf));
+    TEST_ASSERT_TRUE(user.Write(kUserCount - 8, buf, 8));
+    TEST_ASSERT_EQUAL_UINT32(kUserFirst + kUserCount - 8, disk.GetLastWriteLba());
+    TEST_ASSERT_EQUAL_MEMORY(buf, disk.GetData() + (kUserFirst + kUserCount - 8) * kBlock,
+                             sizeof(buf));
+}
+
+void test_range_checked_against_partition() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    FormatMbr(disk);
+
+    PartitionBlockDevice log(disk, VolumeConfig(0));
+    TEST_ASSERT_TRUE(log.Open());
+    TEST_ASSERT_EQUAL_UINT32(kLogCount, log.GetBlockCount());
+
+    // Последний блок журнала — можно, дальше начинается раздел пользователя
+    uint8_t buf[2 * kBlock] = {0};
+    disk.ResetCounters();
+    TEST_ASSERT_TRUE(log.Write(kLogCount - 1, buf, 1));
+    TEST_ASSERT_FALSE(log.Write(kLogCount - 1, buf, 2));
+    TEST_ASSERT_FALSE(log.Read(kLogCount, buf, 1));
+    TEST_ASSERT_FALSE(log.Read(0xFFFFFFFF, buf, 2));  // Без переполнения lba + count
+    TEST_ASSERT_EQUAL_UINT32(1, disk.GetWriteCount());
+    TEST_ASSERT_EQUAL_UINT32(0, disk.GetReadCount());
+    TEST_ASSERT_EQUAL_UINT32(3, log.GetStats().range_errors);
+
+    log.Close();
+    TEST_ASSERT_FALSE(log.IsReady());
+    TEST_ASSERT_EQUAL_UINT32(0, log.GetBlockCount());
+    TEST_ASSERT_FALSE(log.Read(0, buf, 1));
+}
+
+void test_synthesized_mbr_view() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    FormatMbr(disk);
+    FillPattern(disk, kUserFirst, 2, 0x77);
+
+    PartitionConfig cfg;
+    cfg.index = 1;
+    PartitionBlockDevice user(disk, cfg);
+    TEST_ASSERT_TRUE(user.Open());
+    TEST_ASSERT_EQUAL_UINT32(2048, user.GetDataLba());
+    TEST_ASSERT_EQUAL_UINT32(2048 + kUserCount, user.GetBlockCount());
+
+    uint8_t mbr[kBlock];
+    TEST_ASSERT_TRUE(user.Read(0, mbr, 1));
+    TEST_ASSERT_EQUAL_HEX8(0x55, mbr[510]);
+    TEST_ASSERT_EQUAL_HEX8(0xAA, mbr[511]);
+    TEST_ASSERT_EQUAL_HEX32(cfg.disk_signature, Get32(mbr + 440));
+    TEST_ASSERT_EQUAL_HEX8(0x0C, mbr[446 + 4]);
+    TEST_ASSERT_EQUAL_UINT32(2048, Get32(mbr + 446 + 8));
+    TEST_ASSERT_EQUAL_UINT32(kUserCount, Get32(mbr + 446 + 12));
+    for (uint32_t i = 462; i < 510; i++) {
+        TEST_ASSERT_EQUAL_HEX8(0, mbr[i]);  // Одна запись: раздел журнала не виден
+    }
+
+    // Чтение через границу: зазор нулями, затем первый блок раздела
+    uint8_t buf[3 * kBlock];
+    std::memset(buf, 0xCC, sizeof(buf));
+    TEST_ASSERT_TRUE(user.Read(2047, buf, 3));
+    for (uint32_t i = 0; i < kBlock; i++) {
+        TEST_ASSERT_EQUAL_HEX8(0, buf[i]);
+    }
+    TEST_ASSERT_EQUAL_MEMORY(disk.GetData() + kUserFirst * kBlock, buf + kBlock, 2 * kBlock);
+    TEST_ASSERT_EQUAL_UINT32(kUserFirst, disk.GetLastReadLba());
+    TEST_ASSERT_EQUAL_UINT32(2, user.GetStats().header_reads);
+}
+
+void test_header_writes_only_if_unchanged() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    FormatMbr(disk);
+    PartitionConfig cfg;
+    cfg.index = 1;
+    PartitionBlockDevice user(disk, cfg);
+    TEST_ASSERT_TRUE(user.Open());
+
+    uint8_t mbr[kBlock];
+    TEST_ASSERT_TRUE(user.Read(0, mbr, 1));
+    disk.ResetCounters();
+    TEST_ASSERT_TRUE(user.Write(0, mbr, 1));  // ОС переписала MBR как есть
+
+    mbr[446 + 4] = 0x07;
+    TEST_ASSERT_FALSE(user.Write(0, mbr, 1));
+    uint8_t gap[kBlock];
+    std::memset(gap, 0xE5, sizeof(gap));
+    TEST_ASSERT_FALSE(user.Write(100, gap, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, disk.GetWriteCount());  // Таблица карты не тронута
+
+    PartitionStats stats = user.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.header_writes);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.rejected_writes);
+    TEST_ASSERT_EQUAL_HEX8(0x83, disk.GetData()[446 + 4]);
+}
+
+void test_gpt_partition() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    FormatGpt(disk);
+
+    PartitionBlockDevice user(disk, VolumeConfig(1));
+    TEST_ASSERT_TRUE(user.Open());
+    PartitionInfo info = user.GetInfo();
+    TEST_ASSERT_EQUAL(PartitionScheme::Gpt, info.scheme);
+    TEST_ASSERT_EQUAL_UINT32(kUserFirst, info.first_lba);
+    TEST_ASSERT_EQUAL_UINT32(kUserCount, info.block_count);
+
+    // Пустая запись массива
+    PartitionBlockDevice empty(disk, VolumeConfig(5));
+    TEST_ASSERT_FALSE(empty.Open());
+    PartitionBlockDevice outside(disk, VolumeConfig(200));
+    TEST_ASSERT_FALSE(outside.Open());
+}
+
+void test_gpt_header_crc_checked() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    FormatGpt(disk, true);
+    PartitionBlockDevice user(disk, VolumeConfig(1));
+    TEST_ASSERT_FALSE(user.Open());
+    TEST_ASSERT_FALSE(user.IsReady());
+}
+
+void test_gpt_type_detected_from_volume() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    FormatGpt(disk);
+    uint8_t* boot = disk.GetData() + kUserFirst * kBlock;
+    std::memcpy(boot + 3, "EXFAT   ", 8);
+    boot[510] = 0x55;
+    boot[511] = 0xAA;
+
+    PartitionConfig cfg;
+    cfg.index = 1;
+    PartitionBlockDevice user(disk, cfg);
+    TEST_ASSERT_TRUE(user.Open());
+    TEST_ASSERT_EQUAL_HEX8(0x07, user.GetInfo().mbr_type);
+
+    cfg.mbr_type = 0x0C;  // Явный тип важнее
+    PartitionBlockDevice forced(disk, cfg);
+    TEST_ASSERT_TRUE(forced.Open());
+    uint8_t mbr[kBlock];
+    TEST_ASSERT_TRUE(forced.Read(0, mbr, 1));
+    TEST_ASSERT_EQUAL_HEX8(0x0C, mbr[446 + 4]);
+}
+
+void test_volume_boot_sector_is_not_a_table() {
+    // Карта без таблицы: загрузочный сектор FAT32 в LBA 0 (код в области записей)
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    uint8_t* boot = disk.GetData();
+    boot[0] = 0xEB;
+    boot[1] = 0x58;
+    boot[2] = 0x90;
+    std::memset(boot + 90, 0x8E, 420);
+    boot[510] = 0x55;
+    boot[511] = 0xAA;
+
+    PartitionBlockDevice view(disk, VolumeConfig(0));
+    TEST_ASSERT_FALSE(view.Open());
+
+    // Явные границы: таблица не читается
+    PartitionConfig cfg = VolumeConfig(0);
+    cfg.first_lba = 1024;
+    cfg.block_count = 1024;
+    PartitionBlockDevice fixed(disk, cfg);
+    TEST_ASSERT_TRUE(fixed.Open());
+    TEST_ASSERT_EQUAL(PartitionScheme::None, fixed.GetInfo().scheme);
+    TEST_ASSERT_EQUAL_UINT32(1024, fixed.GetBlockCount());
+
+    cfg.block_count = kDiskBlocks;  // За концом устройства
+    PartitionBlockDevice too_big(disk, cfg);
+    TEST_ASSERT_FALSE(too_big.Open());
+}
+
+void test_open_requires_ready_512_byte_device() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    FormatMbr(disk);
+    disk.SetReady(false);
+    PartitionBlockDevice user(disk, VolumeConfig(1));
+    TEST_ASSERT_FALSE(user.Open());
+    disk.SetReady(true);
+    TEST_ASSERT_TRUE(user.Open());
+    disk.SetReady(false);
+    TEST_ASSERT_FALSE(user.IsReady());  // Готовность — от нижнего устройства
+
+    MockBlockDevice big_blocks(1024, 4096);
+    PartitionBlockDevice view(big_blocks, VolumeConfig(0));
+    TEST_ASSERT_FALSE(view.Open());
+}
+
+void test_host_sees_only_user_partition() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    FormatMbr(disk);
+    PartitionConfig cfg;
+    cfg.index = 1;
+    PartitionBlockDevice user(disk, cfg);
+    PartitionBlockDevice log(disk, VolumeConfig(0));
+    TEST_ASSERT_TRUE(user.Open());
+    TEST_ASSERT_TRUE(log.Open());
+    g_usb.MscAttach(user);  // Конкретный тип: без vtable вида
+
+    MscHostSim host;
+    uint32_t last_lba = 0;
+    uint32_t block_size = 0;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.ReadCapacity(&last_lba, &block_size));
+    TEST_ASSERT_EQUAL_UINT32(2048 + kUserCount - 1, last_lba);
+    TEST_ASSERT_EQUAL_UINT32(512, block_size);
+
+    uint8_t mbr[kBlock];
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 1, mbr));
+    TEST_ASSERT_EQUAL_UINT32(2048, Get32(mbr + 446 + 8));
+
+    // Хост пишет в раздел, прошивка — в журнал, одновременно
+    uint8_t host_data[16 * kBlock];
+    uint8_t log_data[16 * kBlock];
+    std::memset(host_data, 0x48, sizeof(host_data));
+    std::memset(log_data, 0x4C, sizeof(log_data));
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(2048, 16, host_data));
+    TEST_ASSERT_TRUE(log.Write(0, log_data, 16));
+    TEST_ASSERT_EQUAL_MEMORY(host_data, disk.GetData() + kUserFirst * kBlock, sizeof(host_data));
+    TEST_ASSERT_EQUAL_MEMORY(log_data, disk.GetData() + kLogFirst * kBlock, sizeof(log_data));
+
+    // Запись хоста в конец вида не доходит до чужих блоков
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.Write10(2048 + kUserCount - 8, 16, host_data));
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_mbr_volume_view_is_offset_add);
+    RUN_TEST(test_range_checked_against_partition);
+    RUN_TEST(test_synthesized_mbr_view);
+    RUN_TEST(test_header_writes_only_if_unchanged);
+    RUN_TEST(test_gpt_partition);
+    RUN_TEST(test_gpt_header_crc_checked);
+    RUN_TEST(test_gpt_type_detected_from_volume);
+    RUN_TEST(test_volume_boot_sector_is_not_a_table);
+    RUN_TEST(test_open_requires_ready_512_byte_device);
+    RUN_TEST(test_host_sees_only_user_partition);
+
+    return UNITY_END();
+}
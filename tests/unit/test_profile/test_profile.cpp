@@ -0,0 +1,136 @@
+/**
+ * @file test_profile.cpp
+ * @brief Unit тесты проб латентности (usb_profile.h)
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_sdmmc.h"
+#include "mock/MockClock.hpp"
+#include "sim/SdCardSim.hpp"
+#include "sim/TinyUsbSim.hpp"
+#include "stm32h7xx_hal.h"
+
+using usb::LatencyHistogram;
+using usb::ProbePoint;
+using usb::UsbDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::SimClock;
+using usb::sim::SimTime;
+using usb::sim::TinyUsbSim;
+
+static SimClock g_sim_clock;
+
+void setUp() {
+    SimTime::Reset();
+    usb::sim::HalState::Reset();
+    TinyUsbSim::Get().Reset();
+    usb::ProfileReset();
+    usb::ProfileSetClock(&g_sim_clock);
+}
+
+void tearDown() {
+    usb::ProfileSetClock(nullptr);
+}
+
+static void PumpUsb(void* context) {
+    static_cast<UsbDevice*>(context)->Process();
+}
+
+void test_histogram_buckets_are_log2() {
+    TEST_ASSERT_EQUAL_UINT32(0, LatencyHistogram::BucketOf(0));
+    TEST_ASSERT_EQUAL_UINT32(1, LatencyHistogram::BucketOf(1));
+    TEST_ASSERT_EQUAL_UINT32(2, LatencyHistogram::BucketOf(3));
+    TEST_ASSERT_EQUAL_UINT32(10, LatencyHistogram::BucketOf(1000));
+    TEST_ASSERT_EQUAL_UINT32(LatencyHistogram::kBuckets - 1, LatencyHistogram::BucketOf(UINT32_MAX));
+    TEST_ASSERT_EQUAL_UINT32(1023, LatencyHistogram::BucketUpperUs(10));
+}
+
+void test_histogram_percentiles_and_extremes() {
+    LatencyHistogram h;
+    for (int i = 0; i < 99; i++) {
+        h.Record(100);
+    }
+    h.Record(5000);
+
+    TEST_ASSERT_EQUAL_UINT32(100, h.count);
+    TEST_ASSERT_EQUAL_UINT32(100, h.min_us);
+    TEST_ASSERT_EQUAL_UINT32(5000, h.max_us);
+    TEST_ASSERT_EQUAL_UINT32(149, h.MeanUs());
+    TEST_ASSERT_EQUAL_UINT32(127, h.PercentileUs(500));
+    TEST_ASSERT_EQUAL_UINT32(127, h.PercentileUs(990));
+    TEST_ASSERT_EQUAL_UINT32(5000, h.PercentileUs(1000));
+}
+
+void test_probes_record_msc_and_sd_path() {
+    usb::sim::SdCardSim card;
+    card.Attach(1);
+    usb::SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+
+    UsbDevice usb;
+    usb.Init();
+    usb.MscAttach(&sd);
+    usb.ResetLatencyHistograms();
+
+    MscHostSim host;
+    host.SetPump(PumpUsb, &usb);
+    uint8_t buf[4 * 512];
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 4, buf));
+
+    const auto& msc = usb.GetLatencyHistogram(ProbePoint::MscRead);
+    const auto& sd_read = usb.GetLatencyHistogram(ProbePoint::SdRead);
+    TEST_ASSERT_EQUAL_UINT32(4, msc.count);
+    TEST_ASSERT_EQUAL_UINT32(4, sd_read.count);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, msc.min_us);
+    TEST_ASSERT_TRUE(msc.total_us >= sd_read.total_us);
+    TEST_ASSERT_EQUAL_UINT32(4, usb.GetLatencyHistogram(ProbePoint::TudTask).count);
+    TEST_ASSERT_EQUAL_UINT32(0, usb.GetLatencyHistogram(ProbePoint::MscWrite).count);
+}
+
+void test_probes_record_cdc_write_and_flush() {
+    UsbDevice usb;
+    usb.Init();
+    usb.CdcWrite("hello");
+    usb.CdcWrite("world");
+
+    TEST_ASSERT_EQUAL_UINT32(2, usb.GetLatencyHistogram(ProbePoint::CdcWrite).count);
+    TEST_ASSERT_EQUAL_UINT32(2, usb.GetLatencyHistogram(ProbePoint::CdcFlush).count);
+}
+
+void test_reset_clears_histograms() {
+    usb::ProfileRecord(ProbePoint::SdWrite, 42);
+    TEST_ASSERT_EQUAL_UINT32(1, usb::ProfileGet(ProbePoint::SdWrite).count);
+    usb::ProfileReset();
+    TEST_ASSERT_EQUAL_UINT32(0, usb::ProfileGet(ProbePoint::SdWrite).count);
+    TEST_ASSERT_EQUAL_STRING("sd_write", usb::ProbePointName(ProbePoint::SdWrite));
+}
+
+void test_clock_reports_microseconds() {
+    usb::mock::MockClock clock;
+    clock.SetTick(2);
+    clock.AdvanceTickUs(250);
+    TEST_ASSERT_EQUAL_UINT32(2250, clock.GetTickUs());
+    TEST_ASSERT_EQUAL_UINT32(2, clock.GetTickMs());
+
+    usb::ProfileSetClock(&clock);
+    {
+        usb::ProbeScope probe(ProbePoint::CdcWrite);
+        clock.AdvanceTickUs(37);
+    }
+    TEST_ASSERT_EQUAL_UINT32(37, usb::ProfileGet(ProbePoint::CdcWrite).max_us);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_histogram_buckets_are_log2);
+    RUN_TEST(test_histogram_percentiles_and_extremes);
+    RUN_TEST(test_probes_record_msc_and_sd_path);
+    RUN_TEST(test_probes_record_cdc_write_and_flush);
+    RUN_TEST(test_reset_clears_histograms);
+    RUN_TEST(test_clock_reports_microseconds);
+
+    return UNITY_END();
+}
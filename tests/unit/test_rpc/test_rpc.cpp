@@ -0,0 +1,496 @@
+/**
+ * @file test_rpc.cpp
+ * @brief Unit тесты RPC: CRC, COBS кадры, диспетчер, отложенные ответы, обмен через CDC
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_rpc.h"
+#include "sim/TinyUsbSim.hpp"
+
+#include <cstring>
+#include <vector>
+
+using usb::UsbDevice;
+using usb::sim::TinyUsbSim;
+
+namespace rpc = usb::rpc;
+
+//--------------------------------------------------------------------+
+// Сторона хоста: кодирование запросов и разбор ответов
+//--------------------------------------------------------------------+
+
+/// Приёмник байт FrameWriter
+struct Sink {
+    std::vector<uint8_t> bytes;
+    uint32_t writes = 0;
+    uint32_t max_write = 0;
+    bool fail = false;
+};
+
+static bool SinkWrite(const uint8_t* data, uint32_t len, void* context) {
+    auto* sink = static_cast<Sink*>(context);
+    if (sink->fail) {
+        return false;
+    }
+    sink->bytes.insert(sink->bytes.end(), data, data + len);
+    sink->writes++;
+    sink->max_write = len > sink->max_write ? len : sink->max_write;
+    return true;
+}
+
+/// Закодированный кадр
+static std::vector<uint8_t> Encode(uint16_t id, uint8_t method, const uint8_t* payload,
+                                   uint32_t len, uint8_t status = 0) {
+    Sink sink;
+    rpc::FrameWriter writer(&SinkWrite, &sink);
+    writer.Begin(id, method, status);
+    writer.Write(payload, len);
+    writer.End();
+    return sink.bytes;
+}
+
+/// Принятый кадр (копия)
+struct Decoded {
+    rpc::FrameResult result;
+    uint16_t id;
+    uint8_t method;
+    uint8_t status;
+    std::vector<uint8_t> payload;
+};
+
+static void CollectFrame(const rpc::Frame& frame, rpc::FrameResult result, void* context) {
+    auto* out = static_cast<std::vector<Decoded>*>(context);
+    Decoded decoded{result, frame.id, frame.method, frame.status, {}};
+    if (frame.payload != nullptr) {
+        decoded.payload.assign(frame.payload, frame.payload + frame.length);
+    }
+    out->push_back(decoded);
+}
+
+static std::vector<Decoded> DecodeAll(const std::vector<uint8_t>& stream) {
+    static uint8_t buffer[16384];
+    rpc::FrameDecoder decoder(buffer, sizeof(buffer));
+    std::vector<Decoded> frames;
+    decoder.Feed(stream.data(), static_cast<uint32_t>(stream.size()), &CollectFrame, &frames);
+    return frames;
+}
+
+static std::vector<uint8_t> Pattern(uint32_t len, uint8_t zero_every) {
+    std::vector<uint8_t> data(len);
+    for (uint32_t i = 0; i < len; i++) {
+        data[i] = (zero_every != 0 && i % zero_every == 0) ? 0 : static_cast<uint8_t>(1 + i % 251);
+    }
+    return data;
+}
+
+//--------------------------------------------------------------------+
+// Обработчики
+//--------------------------------------------------------------------+
+
+static constexpr uint8_t kMethodSum = 0x10;
+static constexpr uint8_t kMethodDefer = 0x11;
+static constexpr uint8_t kMethodStream = 0x12;
+static constexpr uint8_t kMethodBroken = 0x13;
+static constexpr uint8_t kMethodFlush = 0x14;
+
+/// Сумма байт запроса (uint32 LE)
+static rpc::Status SumHandler(const rpc::Request& request, rpc::Responder& response, void*) {
+    if (request.length == 0) {
+        return rpc::Status::BadRequest;
+    }
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < request.length; i++) {
+        sum += request.payload[i];
+    }
+    const uint8_t out[4] = {static_cast<uint8_t>(sum), static_cast<uint8_t>(sum >> 8),
+                            static_cast<uint8_t>(sum >> 16), static_cast<uint8_t>(sum >> 24)};
+    response.Write(out, sizeof(out));
+    return rpc::Status::Ok;
+}
+
+static rpc::Status DeferHandler(const rpc::Request&, rpc::Responder&, void*) {
+    return rpc::Status::Deferred;
+}
+
+/// Ответ 4096 байт кусками по 100
+static rpc::Status StreamHandler(const rpc::Request&, rpc::Responder& response, void*) {
+    const std::vector<uint8_t> data = Pattern(4096, 7);
+    for (uint32_t offset = 0; offset < data.size(); offset += 100) {
+        uint32_t len = static_cast<uint32_t>(data.size()) - offset;
+        response.Write(data.data() + offset, len < 100 ? len : 100);
+    }
+    return rpc::Status::Ok;
+}
+
+/// Ошибка после начала ответа
+static rpc::Status BrokenHandler(const rpc::Request&, rpc::Responder& response, void*) {
+    const uint8_t part[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    response.Write(part, sizeof(part));
+    return rpc::Status::Failed;
+}
+
+/// Не рекурсивный мьютекс: повторный Lock() из того же потока — взаимоблокировка
+struct CheckedMutex : usb::ports::IMutex {
+    bool locked = false;
+    uint32_t deadlocks = 0;
+
+    void Lock() override {
+        deadlocks += locked ? 1 : 0;
+        locked = true;
+    }
+    void Unlock() override { locked = false; }
+};
+
+/// Начинает свой ответ, затем пытается ответить на отложенный id 1
+static rpc::Status FlushHandler(const rpc::Request&, rpc::Responder& response, void* context) {
+    auto* server = static_cast<rpc::Server*>(context);
+    const uint32_t before = server->PendingCount();
+    response.Write(&before, 1);
+    const bool deferred = server->RespondDeferred(1, rpc::Status::Ok, nullptr, 0);
+    const uint8_t out[2] = {static_cast<uint8_t>(server->PendingCount()),
+                            static_cast<uint8_t>(deferred)};
+    response.Write(out, sizeof(out));
+    return rpc::Status::Ok;
+}
+
+static UsbDevice g_usb;
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_usb.Init();
+}
+
+void tearDown() {
+    g_usb.RpcDetach();
+}
+
+//--------------------------------------------------------------------+
+// Кадры
+//--------------------------------------------------------------------+
+
+void test_crc16_check_value() {
+    const char* check = "123456789";
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, rpc::Crc16(0xFFFF, reinterpret_cast<const uint8_t*>(check), 9));
+}
+
+void test_cobs_round_trip_edge_payloads() {
+    // Пустой, одни нули, границы блока 254 без нулей, нули на стыках
+    const std::vector<std::vector<uint8_t>> payloads = {
+        {},
+        std::vector<uint8_t>(10, 0),
+        Pattern(249, 0),   // С заголовком — ровно 253 байта до CRC
+        Pattern(250, 0),   // Блок 254 байта
+        Pattern(251, 0),
+        Pattern(508, 0),
+        Pattern(1000, 254),
+        Pattern(777, 3),
+    };
+
+    for (const auto& payload : payloads) {
+        std::vector<uint8_t> encoded =
+            Encode(0xBEEF, 0x42, payload.data(), static_cast<uint32_t>(payload.size()));
+        // Ноль в потоке — только разделитель
+        for (size_t i = 0; i + 1 < encoded.size(); i++) {
+            TEST_ASSERT_TRUE(encoded[i] != 0);
+        }
+        TEST_ASSERT_EQUAL_UINT8(0, encoded.back());
+
+        std::vector<Decoded> frames = DecodeAll(encoded);
+        TEST_ASSERT_EQUAL_UINT32(1, frames.size());
+        TEST_ASSERT_TRUE(frames[0].result == rpc::FrameResult::Ok);
+        TEST_ASSERT_EQUAL_UINT16(0xBEEF, frames[0].id);
+        TEST_ASSERT_EQUAL_UINT8(0x42, frames[0].method);
+        TEST_ASSERT_EQUAL_UINT32(payload.size(), frames[0].payload.size());
+        if (!payload.empty()) {
+            TEST_ASSERT_EQUAL_MEMORY(payload.data(), frames[0].payload.data(), payload.size());
+        }
+    }
+}
+
+void test_decoder_byte_by_byte_and_resync() {
+    const std::vector<uint8_t> payload = Pattern(300, 5);
+    std::vector<uint8_t> stream = {0x13, 0x37, 0x00, 0x00};  // Мусор и пустые кадры
+    std::vector<uint8_t> frame = Encode(1, 2, payload.data(), 300);
+    stream.insert(stream.end(), frame.begin(), frame.end());
+
+    uint8_t buffer[512];
+    rpc::FrameDecoder decoder(buffer, sizeof(buffer));
+    std::vector<Decoded> frames;
+    for (uint8_t byte : stream) {
+        decoder.Feed(&byte, 1, &CollectFrame, &frames);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(2, frames.size());
+    TEST_ASSERT_TRUE(frames[0].result == rpc::FrameResult::CrcError);
+    TEST_ASSERT_TRUE(frames[1].result == rpc::FrameResult::Ok);
+    TEST_ASSERT_EQUAL_MEMORY(payload.data(), frames[1].payload.data(), 300);
+}
+
+//--------------------------------------------------------------------+
+// Сервер
+//--------------------------------------------------------------------+
+
+void test_dispatch_ping_sum_and_unknown_method() {
+    rpc::Server server;
+    Sink sink;
+    server.SetWriter(&SinkWrite, &sink);
+    TEST_ASSERT_TRUE(server.Register(kMethodSum, &SumHandler));
+    TEST_ASSERT_FALSE(server.Register(rpc::kMethodPing, &SumHandler));
+
+    const uint8_t data[5] = {1, 2, 3, 0, 250};
+    std::vector<uint8_t> stream = Encode(7, rpc::kMethodPing, data, 5);
+    std::vector<uint8_t> sum = Encode(8, kMethodSum, data, 5);
+    std::vector<uint8_t> empty_sum = Encode(9, kMethodSum, nullptr, 0);
+    std::vector<uint8_t> unknown = Encode(10, 0x7E, data, 5);
+    stream.insert(stream.end(), sum.begin(), sum.end());
+    stream.insert(stream.end(), empty_sum.begin(), empty_sum.end());
+    stream.insert(stream.end(), unknown.begin(), unknown.end());
+    server.Feed(stream.data(), static_cast<uint32_t>(stream.size()));
+
+    std::vector<Decoded> replies = DecodeAll(sink.bytes);
+    TEST_ASSERT_EQUAL_UINT32(4, replies.size());
+
+    TEST_ASSERT_EQUAL_UINT16(7, replies[0].id);
+    TEST_ASSERT_EQUAL_UINT8(0, replies[0].status);
+    TEST_ASSERT_EQUAL_UINT32(5, replies[0].payload.size());
+    TEST_ASSERT_EQUAL_MEMORY(data, replies[0].payload.data(), 5);
+
+    TEST_ASSERT_EQUAL_UINT16(8, replies[1].id);
+    TEST_ASSERT_EQUAL_UINT8(kMethodSum, replies[1].method);
+    TEST_ASSERT_EQUAL_UINT32(4, replies[1].payload.size());
+    TEST_ASSERT_EQUAL_UINT8(0x00, replies[1].payload[0]);  // 256 = 0x100
+    TEST_ASSERT_EQUAL_UINT8(0x01, replies[1].payload[1]);
+
+    TEST_ASSERT_EQUAL_UINT16(9, replies[2].id);
+    TEST_ASSERT_EQUAL_UINT8(static_cast<uint8_t>(rpc::Status::BadRequest), replies[2].status);
+    TEST_ASSERT_EQUAL_UINT32(0, replies[2].payload.size());
+
+    TEST_ASSERT_EQUAL_UINT16(10, replies[3].id);
+    TEST_ASSERT_EQUAL_UINT8(static_cast<uint8_t>(rpc::Status::UnknownMethod), replies[3].status);
+
+    rpc::RpcStats stats = server.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(4, stats.requests);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.responses);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.unknown_method);
+}
+
+void test_crc_error_dropped_and_too_large_answered() {
+    rpc::Server server;
+    Sink sink;
+    server.SetWriter(&SinkWrite, &sink);
+
+    const uint8_t data[4] = {9, 8, 7, 6};
+    std::vector<uint8_t> corrupt = Encode(1, rpc::kMethodPing, data, 4);
+    corrupt[5] ^= 0x01;  // Байт данных (не код блока)
+    server.Feed(corrupt.data(), static_cast<uint32_t>(corrupt.size()));
+    TEST_ASSERT_EQUAL_UINT32(0, sink.bytes.size());
+
+    const std::vector<uint8_t> big = Pattern(rpc::kMaxPayload + 1, 0);
+    std::vector<uint8_t> large = Encode(0x1234, rpc::kMethodPing, big.data(),
+                                        static_cast<uint32_t>(big.size()));
+    server.Feed(large.data(), static_cast<uint32_t>(large.size()));
+
+    std::vector<Decoded> replies = DecodeAll(sink.bytes);
+    TEST_ASSERT_EQUAL_UINT32(1, replies.size());
+    TEST_ASSERT_EQUAL_UINT16(0x1234, replies[0].id);
+    TEST_ASSERT_EQUAL_UINT8(static_cast<uint8_t>(rpc::Status::TooLarge), replies[0].status);
+
+    // Максимальный запрос проходит
+    sink.bytes.clear();
+    std::vector<uint8_t> max = Encode(2, rpc::kMethodPing, big.data(), rpc::kMaxPayload);
+    server.Feed(max.data(), static_cast<uint32_t>(max.size()));
+    replies = DecodeAll(sink.bytes);
+    TEST_ASSERT_EQUAL_UINT32(1, replies.size());
+    TEST_ASSERT_EQUAL_UINT32(rpc::kMaxPayload, replies[0].payload.size());
+
+    rpc::RpcStats stats = server.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.crc_errors);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.too_large);
+}
+
+void test_pipelined_deferred_replies_out_of_order() {
+    rpc::Server server;
+    Sink sink;
+    server.SetWriter(&SinkWrite, &sink);
+    server.Register(kMethodDefer, &DeferHandler);
+
+    // Пять запросов без ожидания: четыре ждут, пятый — Busy
+    std::vector<uint8_t> stream;
+    for (uint16_t id = 1; id <= USB_RPC_MAX_PENDING + 1; id++) {
+        std::vector<uint8_t> frame = Encode(id, kMethodDefer, nullptr, 0);
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+    server.Feed(stream.data(), static_cast<uint32_t>(stream.size()));
+    TEST_ASSERT_EQUAL_UINT32(USB_RPC_MAX_PENDING, server.PendingCount());
+
+    const uint8_t three[3] = {3, 3, 3};
+    TEST_ASSERT_TRUE(server.RespondDeferred(3, rpc::Status::Ok, three, 3));
+    TEST_ASSERT_TRUE(server.RespondDeferred(1, rpc::Status::Failed, nullptr, 0));
+    TEST_ASSERT_FALSE(server.RespondDeferred(1, rpc::Status::Ok, nullptr, 0));  // Уже отвечен
+
+    rpc::Responder* response = server.BeginDeferred(2);
+    TEST_ASSERT_NOT_NULL(response);
+    TEST_ASSERT_NULL(server.BeginDeferred(4));  // TX занят ответом на 2
+    TEST_ASSERT_TRUE(response->Write("ab", 2));
+    TEST_ASSERT_TRUE(response->Write("cd", 2));
+    TEST_ASSERT_TRUE(response->End());
+    TEST_ASSERT_EQUAL_UINT32(1, server.PendingCount());
+
+    std::vector<Decoded> replies = DecodeAll(sink.bytes);
+    TEST_ASSERT_EQUAL_UINT32(4, replies.size());
+    TEST_ASSERT_EQUAL_UINT16(USB_RPC_MAX_PENDING + 1, replies[0].id);
+    TEST_ASSERT_EQUAL_UINT8(static_cast<uint8_t>(rpc::Status::Busy), replies[0].status);
+    TEST_ASSERT_EQUAL_UINT16(3, replies[1].id);
+    TEST_ASSERT_EQUAL_MEMORY(three, replies[1].payload.data(), 3);
+    TEST_ASSERT_EQUAL_UINT16(1, replies[2].id);
+    TEST_ASSERT_EQUAL_UINT8(static_cast<uint8_t>(rpc::Status::Failed), replies[2].status);
+    TEST_ASSERT_EQUAL_UINT16(2, replies[3].id);
+    TEST_ASSERT_EQUAL_UINT8(kMethodDefer, replies[3].method);
+    TEST_ASSERT_EQUAL_MEMORY("abcd", replies[3].payload.data(), 4);
+
+    rpc::RpcStats stats = server.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(USB_RPC_MAX_PENDING, stats.deferred);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.busy);
+}
+
+void test_handler_with_started_response_cannot_deadlock() {
+    rpc::Server server;
+    Sink sink;
+    CheckedMutex mutex;
+    server.SetWriter(&SinkWrite, &sink);
+    server.SetMutex(&mutex);
+    server.Register(kMethodDefer, &DeferHandler);
+    server.Register(kMethodFlush, &FlushHandler, &server);
+
+    std::vector<uint8_t> stream = Encode(1, kMethodDefer, nullptr, 0);
+    std::vector<uint8_t> flush = Encode(2, kMethodFlush, nullptr, 0);
+    stream.insert(stream.end(), flush.begin(), flush.end());
+    server.Feed(stream.data(), static_cast<uint32_t>(stream.size()));
+
+    // Свой ответ держит TX: отложенный ответ отклонён, PendingCount() без мьютекса
+    TEST_ASSERT_EQUAL_UINT32(0, mutex.deadlocks);
+    TEST_ASSERT_FALSE(mutex.locked);
+    std::vector<Decoded> replies = DecodeAll(sink.bytes);
+    TEST_ASSERT_EQUAL_UINT32(1, replies.size());
+    TEST_ASSERT_EQUAL_UINT16(2, replies[0].id);
+    const uint8_t expected[3] = {1, 1, 0};
+    TEST_ASSERT_EQUAL_UINT32(3, replies[0].payload.size());
+    TEST_ASSERT_EQUAL_MEMORY(expected, replies[0].payload.data(), 3);
+
+    // После возврата обработчика — обычный путь
+    TEST_ASSERT_TRUE(server.RespondDeferred(1, rpc::Status::Ok, nullptr, 0));
+    TEST_ASSERT_EQUAL_UINT32(0, server.PendingCount());
+    TEST_ASSERT_EQUAL_UINT32(0, mutex.deadlocks);
+}
+
+void test_large_response_streamed_in_blocks() {
+    rpc::Server server;
+    Sink sink;
+    server.SetWriter(&SinkWrite, &sink);
+    server.Register(kMethodStream, &StreamHandler);
+
+    std::vector<uint8_t> request = Encode(77, kMethodStream, nullptr, 0);
+    server.Feed(request.data(), static_cast<uint32_t>(request.size()));
+
+    // Ответ 8x больше буфера кадра уходит блоками COBS, не собираясь в памяти
+    TEST_ASSERT_TRUE(sink.writes > 16);
+    TEST_ASSERT_TRUE(sink.max_write <= 256);
+
+    std::vector<Decoded> replies = DecodeAll(sink.bytes);
+    TEST_ASSERT_EQUAL_UINT32(1, replies.size());
+    TEST_ASSERT_TRUE(replies[0].result == rpc::FrameResult::Ok);
+    const std::vector<uint8_t> expected = Pattern(4096, 7);
+    TEST_ASSERT_EQUAL_UINT32(4096, replies[0].payload.size());
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), replies[0].payload.data(), 4096);
+}
+
+void test_error_after_streaming_aborts_frame() {
+    rpc::Server server;
+    Sink sink;
+    server.SetWriter(&SinkWrite, &sink);
+    server.Register(kMethodBroken, &BrokenHandler);
+
+    std::vector<uint8_t> request = Encode(5, kMethodBroken, nullptr, 0);
+    server.Feed(request.data(), static_cast<uint32_t>(request.size()));
+
+    std::vector<Decoded> replies = DecodeAll(sink.bytes);
+    TEST_ASSERT_EQUAL_UINT32(1, replies.size());
+    TEST_ASSERT_TRUE(replies[0].result == rpc::FrameResult::CrcError);
+    TEST_ASSERT_EQUAL_UINT32(1, server.GetStats().aborted);
+
+    // TX освобождён: следующий запрос отвечается
+    sink.bytes.clear();
+    request = Encode(6, rpc::kMethodPing, nullptr, 0);
+    server.Feed(request.data(), static_cast<uint32_t>(request.size()));
+    replies = DecodeAll(sink.bytes);
+    TEST_ASSERT_EQUAL_UINT32(1, replies.size());
+    TEST_ASSERT_TRUE(replies[0].result == rpc::FrameResult::Ok);
+}
+
+//--------------------------------------------------------------------+
+// UsbDevice + CDC
+//--------------------------------------------------------------------+
+
+static uint32_t g_cdc_rx_calls = 0;
+
+static void CountCdcRx(const uint8_t*, uint32_t, void*) {
+    g_cdc_rx_calls++;
+}
+
+void test_rpc_over_cdc_end_to_end() {
+    rpc::Server server;
+    server.Register(kMethodSum, &SumHandler);
+    g_cdc_rx_calls = 0;
+    g_usb.CdcSetRxCallback(&CountCdcRx);
+    g_usb.RpcAttach(server);
+
+    // Два запроса подряд, второй — крупнее TX FIFO в ответе (эхо 480 байт)
+    const std::vector<uint8_t> big = Pattern(480, 9);
+    const uint8_t data[3] = {100, 100, 100};
+    std::vector<uint8_t> stream = Encode(1, kMethodSum, data, 3);
+    std::vector<uint8_t> ping = Encode(2, rpc::kMethodPing, big.data(), 480);
+    stream.insert(stream.end(), ping.begin(), ping.end());
+
+    // Кусками, как приходят пакеты OUT
+    for (size_t offset = 0; offset < stream.size(); offset += 64) {
+        size_t len = stream.size() - offset < 64 ? stream.size() - offset : 64;
+        TinyUsbSim::Get().HostCdcSend(stream.data() + offset, static_cast<uint32_t>(len));
+        g_usb.Process();
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, g_cdc_rx_calls);  // FIFO отдан RPC
+    TEST_ASSERT_EQUAL_UINT32(stream.size(), g_usb.RpcPoll());
+    TEST_ASSERT_EQUAL_UINT32(0, g_usb.RpcPoll());
+
+    std::vector<Decoded> replies = DecodeAll(TinyUsbSim::Get().HostCdcReceive());
+    TEST_ASSERT_EQUAL_UINT32(2, replies.size());
+    TEST_ASSERT_EQUAL_UINT16(1, replies[0].id);
+    TEST_ASSERT_EQUAL_UINT8(44, replies[0].payload[0]);  // 300 = 0x12C
+    TEST_ASSERT_EQUAL_UINT8(1, replies[0].payload[1]);
+    TEST_ASSERT_EQUAL_UINT16(2, replies[1].id);
+    TEST_ASSERT_EQUAL_MEMORY(big.data(), replies[1].payload.data(), 480);
+
+    // После отключения CDC снова отдаёт данные callback'у
+    g_usb.RpcDetach();
+    TinyUsbSim::Get().HostCdcSend(data, 3);
+    g_usb.Process();
+    TEST_ASSERT_EQUAL_UINT32(1, g_cdc_rx_calls);
+    g_usb.CdcSetRxCallback(nullptr);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_crc16_check_value);
+    RUN_TEST(test_cobs_round_trip_edge_payloads);
+    RUN_TEST(test_decoder_byte_by_byte_and_resync);
+    RUN_TEST(test_dispatch_ping_sum_and_unknown_method);
+    RUN_TEST(test_crc_error_dropped_and_too_large_answered);
+    RUN_TEST(test_pipelined_deferred_replies_out_of_order);
+    RUN_TEST(test_handler_with_started_response_cannot_deadlock);
+    RUN_TEST(test_large_response_streamed_in_blocks);
+    RUN_TEST(test_error_after_streaming_aborts_frame);
+    RUN_TEST(test_rpc_over_cdc_end_to_end);
+
+    return UNITY_END();
+}
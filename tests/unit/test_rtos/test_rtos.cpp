@@ -0,0 +1,259 @@
+/**
+ * @file test_rtos.cpp
+ * @brief Unit тесты RTOS режима (UsbDevice::StartTasks) на POSIX threads
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "adapters/PosixRtos.hpp"
+#include "mock/MockBlockDevice.hpp"
+#include "sim/TinyUsbSim.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using usb::UsbDevice;
+using usb::adapters::PosixRtos;
+using usb::mock::MockBlockDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::TinyUsbSim;
+
+/// Запись блокируется до Release() — модель медленной записи на SD
+class GatedBlockDevice : public MockBlockDevice {
+public:
+    bool Write(uint32_t lba, const uint8_t* buffer, uint32_t count) override {
+        in_write_ = true;
+        while (!released_) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        bool ok = MockBlockDevice::Write(lba, buffer, count);
+        writes_done_++;
+        in_write_ = false;
+        return ok;
+    }
+
+    void Release() { released_ = true; }
+    bool InWrite() const { return in_write_; }
+    uint32_t WritesDone() const { return writes_done_; }
+
+private:
+    std::atomic<bool> in_write_{false};
+    std::atomic<bool> released_{false};
+    std::atomic<uint32_t> writes_done_{0};
+};
+
+static UsbDevice g_usb;
+static std::unique_ptr<PosixRtos> g_rtos;  // Деструктор ждёт выхода задач (после StopTasks)
+
+/// Хост не прокачивает стек — это делает задача USB
+static void WaitForUsbTask(void*) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+template <typename Predicate>
+static bool WaitFor(Predicate predicate, uint32_t timeout_ms = 2000) {
+    for (uint32_t i = 0; i < timeout_ms; i++) {
+        if (predicate()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return predicate();
+}
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_usb.Init();
+    g_usb.MscResetStats();
+    g_rtos = std::make_unique<PosixRtos>();
+}
+
+void tearDown() {
+    g_usb.StopTasks();
+    g_rtos.reset();
+    g_usb.MscDetach();
+    g_usb.CdcSetRxCallback(nullptr);
+}
+
+void test_start_requires_init_and_runs_once() {
+    UsbDevice not_initialized;
+    TEST_ASSERT_FALSE(not_initialized.StartTasks(*g_rtos));
+
+    TEST_ASSERT_TRUE(g_usb.StartTasks(*g_rtos));
+    TEST_ASSERT_TRUE(g_usb.TasksRunning());
+    TEST_ASSERT_FALSE(g_usb.StartTasks(*g_rtos));
+
+    g_usb.StopTasks();
+    TEST_ASSERT_FALSE(g_usb.TasksRunning());
+}
+
+void test_msc_io_through_storage_task() {
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+    TEST_ASSERT_TRUE(g_usb.StartTasks(*g_rtos));
+
+    MscHostSim host;
+    host.SetPump(WaitForUsbTask);
+    uint8_t out[8 * 512];
+    uint8_t in[8 * 512] = {0};
+    for (uint32_t i = 0; i < sizeof(out); i++) {
+        out[i] = static_cast<uint8_t>(i * 7);
+    }
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(16, 8, out));
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(16, 8, in));
+    TEST_ASSERT_EQUAL_MEMORY(out, in, sizeof(out));
+
+    usb::MscStats s = g_usb.MscGetStats();
+    TEST_ASSERT_EQUAL_UINT32(8, s.blocks_written);
+    TEST_ASSERT_EQUAL_UINT32(8, s.blocks_read);
+    TEST_ASSERT_EQUAL_UINT32(0, s.write_errors);
+}
+
+void test_msc_error_from_storage_task() {
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+    TEST_ASSERT_TRUE(g_usb.StartTasks(*g_rtos));
+
+    MscHostSim host;
+    host.SetPump(WaitForUsbTask);
+    uint8_t buf[512];
+    disk.SetReady(false);
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.Read10(0, 1, buf));
+    TEST_ASSERT_EQUAL_UINT32(1, g_usb.MscGetStats().read_errors);
+
+    disk.SetReady(true);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 1, buf));
+}
+
+static std::atomic<uint32_t> g_rx_bytes{0};
+
+static void CountRx(const uint8_t*, uint32_t len, void*) {
+    g_rx_bytes += len;
+}
+
+void test_slow_write_does_not_block_cdc() {
+    GatedBlockDevice disk;
+    g_usb.MscAttach(&disk);
+    g_rx_bytes = 0;
+    g_usb.CdcSetRxCallback(CountRx);
+    TEST_ASSERT_TRUE(g_usb.StartTasks(*g_rtos));
+
+    std::atomic<CswStatus> status{CswStatus::Timeout};
+    std::thread host_thread([&status] {
+        MscHostSim host;
+        host.SetPump(WaitForUsbTask);
+        uint8_t buf[4 * 512] = {0};
+        status = host.Write10(0, 4, buf);
+    });
+
+    TEST_ASSERT_TRUE(WaitFor([&disk] { return disk.InWrite(); }));
+
+    // Запись висит в задаче хранилища, а CDC работает в обе стороны
+    TEST_ASSERT_EQUAL_UINT32(5, g_usb.CdcWrite("alive"));
+    auto received = TinyUsbSim::Get().HostCdcReceive();
+    TEST_ASSERT_EQUAL_STRING("alive", std::string(received.begin(), received.end()).c_str());
+    const uint8_t cmd[3] = {'c', 'm', 'd'};
+    TinyUsbSim::Get().HostCdcSend(cmd, sizeof(cmd));
+    TEST_ASSERT_TRUE(WaitFor([] { return g_rx_bytes.load() == 3; }));
+    TEST_ASSERT_TRUE(disk.InWrite());
+    TEST_ASSERT_TRUE(g_usb.MscIsBusy());
+
+    disk.Release();
+    host_thread.join();
+    TEST_ASSERT_EQUAL(CswStatus::Passed, status.load());
+    TEST_ASSERT_EQUAL_UINT32(4, disk.WritesDone());  // По куску на EP буфер
+}
+
+void test_cdc_write_from_many_tasks_keeps_messages_whole() {
+    TEST_ASSERT_TRUE(g_usb.StartTasks(*g_rtos));
+
+    constexpr int kTasks = 4;
+    constexpr int kLines = 200;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < kTasks; t++) {
+        writers.emplace_back([t] {
+            for (int n = 0; n < kLines; n++) {
+                g_usb.CdcPrintf("task%d line%03d\n", t, n);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    auto received = TinyUsbSim::Get().HostCdcReceive();
+    std::string text(received.begin(), received.end());
+    int next[kTasks] = {0};
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        TEST_ASSERT_TRUE(end != std::string::npos);
+        int t = -1;
+        int n = -1;
+        TEST_ASSERT_EQUAL_INT(2, std::sscanf(text.c_str() + pos, "task%d line%d", &t, &n));
+        TEST_ASSERT_TRUE(t >= 0 && t < kTasks);
+        TEST_ASSERT_EQUAL_INT(next[t], n);  // Строки одной задачи — по порядку и целиком
+        next[t]++;
+        pos = end + 1;
+    }
+    for (int t = 0; t < kTasks; t++) {
+        TEST_ASSERT_EQUAL_INT(kLines, next[t]);
+    }
+}
+
+void test_detach_waits_for_storage_io() {
+    GatedBlockDevice disk;
+    g_usb.MscAttach(&disk);
+    TEST_ASSERT_TRUE(g_usb.StartTasks(*g_rtos));
+
+    std::thread host_thread([] {
+        MscHostSim host;
+        host.SetPump(WaitForUsbTask);
+        uint8_t buf[512] = {0};
+        host.Write10(0, 1, buf);
+    });
+    TEST_ASSERT_TRUE(WaitFor([&disk] { return disk.InWrite(); }));
+
+    std::thread releaser([&disk] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        disk.Release();
+    });
+    g_usb.MscDetach();
+    // После MscDetach() устройство не используется — запись уже закончилась
+    TEST_ASSERT_EQUAL_UINT32(1, disk.WritesDone());
+
+    releaser.join();
+    host_thread.join();
+}
+
+void test_process_after_stop_tasks() {
+    TEST_ASSERT_TRUE(g_usb.StartTasks(*g_rtos));
+    g_usb.StopTasks();
+
+    MockBlockDevice disk;
+    g_usb.MscAttach(&disk);
+    MscHostSim host;  // Снова прокачка tud_task() из вызывающего потока
+    uint8_t buf[512];
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 1, buf));
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_start_requires_init_and_runs_once);
+    RUN_TEST(test_msc_io_through_storage_task);
+    RUN_TEST(test_msc_error_from_storage_task);
+    RUN_TEST(test_slow_write_does_not_block_cdc);
+    RUN_TEST(test_cdc_write_from_many_tasks_keeps_messages_whole);
+    RUN_TEST(test_detach_waits_for_storage_io);
+    RUN_TEST(test_process_after_stop_tasks);
+
+    return UNITY_END();
+}
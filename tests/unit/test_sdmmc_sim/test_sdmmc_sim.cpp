@@ -0,0 +1,354 @@
+/**
+ * @file test_sdmmc_sim.cpp
+ * @brief Unit тесты SdmmcBlockDevice на симуляторе SD карты
+ */
+
+#include <unity.h>
+#include "usb_sdmmc.h"
+#include "sim/SdCardSim.hpp"
+#include "stm32h7xx_hal.h"
+
+using usb::SdmmcBlockDevice;
+using usb::SdmmcState;
+using usb::sim::SdCardSim;
+using usb::sim::SdCardSimConfig;
+using usb::sim::SdFaultOp;
+using usb::sim::SimTime;
+
+void setUp() {
+    SimTime::Reset();
+    usb::sim::HalState::Reset();
+}
+
+void tearDown() {
+}
+
+static void FillPattern(uint8_t* buf, uint32_t len, uint8_t seed) {
+    for (uint32_t i = 0; i < len; i++) {
+        buf[i] = static_cast<uint8_t>(seed + i * 7);
+    }
+}
+
+void test_sdmmc_init_reports_geometry_from_card() {
+    SdCardSimConfig cfg;
+    cfg.block_count = 8192;
+    SdCardSim card(cfg);
+    card.Attach(1);
+
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    TEST_ASSERT_TRUE(sd.IsReady());
+    TEST_ASSERT_EQUAL_UINT32(8192, sd.GetBlockCount());
+    TEST_ASSERT_EQUAL_UINT32(512, sd.GetBlockSize());
+    TEST_ASSERT_EQUAL_UINT32(4, card.GetBusWidth());
+    TEST_ASSERT_EQUAL_UINT32(CARD_SDHC_SDXC, sd.GetCardInfo().card_type);
+}
+
+void test_sdmmc_init_parses_csd_when_hal_reports_zero_blocks() {
+    SdCardSimConfig cfg;
+    cfg.block_count = 16384;
+    cfg.report_zero_block_nbr = true;
+    SdCardSim card(cfg);
+    card.Attach(1);
+
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    TEST_ASSERT_EQUAL_UINT32(16384, sd.GetBlockCount());
+}
+
+void test_sdmmc_init_scales_large_csd_block_len() {
+    SdCardSimConfig cfg;
+    cfg.high_capacity = false;
+    cfg.csd_block_len = 1024;
+    cfg.block_count = 8192;
+    SdCardSim card(cfg);
+    card.Attach(1);
+
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    TEST_ASSERT_EQUAL_UINT32(8192, sd.GetBlockCount());
+}
+
+void test_sdmmc_init_fails_without_card() {
+    SdCardSim card;
+    card.Attach(1);
+    card.SetInserted(false);
+
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_FALSE(sd.Init());
+    TEST_ASSERT_EQUAL(SdmmcState::Error, sd.GetState());
+    TEST_ASSERT_FALSE(sd.IsReady());
+}
+
+void test_sdmmc_write_read_roundtrip() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+
+    uint8_t wbuf[4 * 512];
+    uint8_t rbuf[4 * 512] = {0};
+    FillPattern(wbuf, sizeof(wbuf), 0x11);
+
+    TEST_ASSERT_TRUE(sd.Write(100, wbuf, 4));
+    TEST_ASSERT_TRUE(sd.Read(100, rbuf, 4));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(wbuf, rbuf, sizeof(wbuf));
+
+    uint8_t peek[512];
+    card.PeekBlock(103, peek);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(wbuf + 3 * 512, peek, 512);
+}
+
+void test_sdmmc_write_waits_for_programming_busy() {
+    SdCardSimConfig cfg;
+    cfg.busy_min_us = 3000;
+    cfg.busy_max_us = 3000;
+    cfg.page_size = 512;
+    SdCardSim card(cfg);
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+
+    uint8_t buf[512] = {0};
+    uint64_t start = SimTime::NowUs();
+    TEST_ASSERT_TRUE(sd.Write(0, buf, 1));
+
+    // Драйвер дожидается TRANSFER после записи
+    TEST_ASSERT_GREATER_OR_EQUAL(3000, SimTime::NowUs() - start);
+    TEST_ASSERT_EQUAL_UINT32(1, card.GetStats().pages_programmed);
+}
+
+void test_sim_programs_every_touched_page() {
+    SdCardSimConfig cfg;
+    cfg.page_size = 4096;
+    SdCardSim card(cfg);
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    card.ResetStats();
+
+    // 8 блоков по одному: каждый программирует страницу 4 KB целиком
+    uint8_t buf[512] = {0};
+    for (uint32_t lba = 0; lba < 8; lba++) {
+        TEST_ASSERT_TRUE(sd.Write(lba, buf, 1));
+    }
+    TEST_ASSERT_EQUAL_UINT32(8, card.GetStats().write_cmds);
+    TEST_ASSERT_EQUAL_UINT32(8, card.GetStats().pages_programmed);
+}
+
+void test_sim_merges_writes_outside_open_erase_blocks() {
+    SdCardSimConfig cfg;
+    cfg.erase_block_size = 64 * 1024;  // 128 блоков
+    cfg.open_blocks = 2;
+    SdCardSim card(cfg);
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    card.ResetStats();
+
+    uint8_t buf[8 * 512] = {0};
+    // Подряд с начала блока и вторая точка дозаписи — без слияний
+    for (uint32_t lba = 0; lba < 64; lba += 8) {
+        TEST_ASSERT_TRUE(sd.Write(lba, buf, 8));
+        TEST_ASSERT_TRUE(sd.Write(1024 + lba, buf, 8));
+    }
+    // Вперёд с пропуском внутри открытого блока — тоже дозапись
+    TEST_ASSERT_TRUE(sd.Write(100, buf, 1));
+    TEST_ASSERT_TRUE(sd.Write(1024 + 100, buf, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, card.GetStats().ftl_merges);
+
+    // Назад по открытому блоку; чужой блок вытесняет точку, возврат к вытесненному
+    TEST_ASSERT_TRUE(sd.Write(1024 + 64, buf, 8));
+    TEST_ASSERT_EQUAL_UINT32(1, card.GetStats().ftl_merges);
+    TEST_ASSERT_TRUE(sd.Write(300, buf, 1));
+    TEST_ASSERT_TRUE(sd.Write(1024 + 101, buf, 8));
+    TEST_ASSERT_TRUE(sd.Write(101, buf, 8));
+    TEST_ASSERT_EQUAL_UINT32(3, card.GetStats().ftl_merges);
+}
+
+void test_sdmmc_read_fails_on_injected_error() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+
+    TEST_ASSERT_TRUE(card.InjectFault(SdFaultOp::Read, 50, 1, 1));
+
+    uint8_t buf[2 * 512];
+    TEST_ASSERT_FALSE(sd.Read(49, buf, 2));
+    TEST_ASSERT_EQUAL_UINT32(SdCardSim::kErrorDataCrc, sd.GetDiagnostics().hal_error);
+
+    // Ошибка одноразовая — повтор проходит
+    TEST_ASSERT_TRUE(sd.Read(49, buf, 2));
+    TEST_ASSERT_EQUAL_UINT32(1, card.GetStats().errors_injected);
+}
+
+void test_sdmmc_retries_per_block_on_fifo_overrun() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+
+    // Без DMA CPU теряет FIFO после двух блоков подряд
+    card.FailPolledBursts(2);
+
+    uint8_t wr[8 * 512];
+    uint8_t rd[8 * 512] = {0};
+    FillPattern(wr, sizeof(wr), 0x5A);
+    card.ResetStats();
+    TEST_ASSERT_TRUE(sd.Write(100, wr, 8));
+    TEST_ASSERT_EQUAL_UINT32(1 + 8, card.GetStats().write_cmds);
+    TEST_ASSERT_TRUE(sd.Read(100, rd, 8));
+    TEST_ASSERT_EQUAL_UINT32(1 + 8, card.GetStats().read_cmds);
+    TEST_ASSERT_EQUAL_MEMORY(wr, rd, sizeof(wr));
+    TEST_ASSERT_EQUAL_UINT32(2, card.GetStats().errors_injected);
+
+    // Команды не длиннее предела идут одним куском
+    card.ResetStats();
+    TEST_ASSERT_TRUE(sd.Read(100, rd, 2));
+    TEST_ASSERT_EQUAL_UINT32(1, card.GetStats().read_cmds);
+}
+
+void test_sdmmc_write_fails_when_card_removed() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+
+    card.SetInserted(false);
+    uint8_t buf[512] = {0};
+    TEST_ASSERT_FALSE(sd.Write(0, buf, 1));
+    TEST_ASSERT_FALSE(sd.IsCardInserted());
+}
+
+void test_sdmmc_deinit_gates_sdmmc_clock() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    TEST_ASSERT_TRUE(usb::sim::HalState::Get().sdmmc_clk[1]);
+
+    sd.DeInit();
+    TEST_ASSERT_FALSE(usb::sim::HalState::Get().sdmmc_clk[1]);
+    TEST_ASSERT_EQUAL(SdmmcState::NotInitialized, sd.GetState());
+}
+
+void test_sdmmc_suspend_deselects_card_and_gates_clock() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    uint8_t buf[512];
+    FillPattern(buf, sizeof(buf), 0x11);
+    TEST_ASSERT_TRUE(sd.Write(10, buf, 1));
+
+    TEST_ASSERT_TRUE(sd.Suspend());
+    TEST_ASSERT_EQUAL(SdmmcState::Suspended, sd.GetState());
+    TEST_ASSERT_FALSE(usb::sim::HalState::Get().sdmmc_clk[1]);
+    TEST_ASSERT_EQUAL_UINT32(1, card.GetStats().select_cmds);
+    // Программирование закончилось до снятия выбора
+    TEST_ASSERT_EQUAL(usb::sim::SdSimCardState::Standby, card.GetCardState());
+    TEST_ASSERT_TRUE(sd.IsReady());
+    TEST_ASSERT_TRUE(sd.Suspend());  // Повтор ничего не делает
+    TEST_ASSERT_EQUAL_UINT32(1, card.GetStats().select_cmds);
+}
+
+void test_sdmmc_suspend_keeps_card_selected_when_not_ready() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+
+    // Карта не отвечает на CMD13: ожидание transfer истекает
+    card.SetInserted(false);
+    TEST_ASSERT_FALSE(sd.Suspend());
+    TEST_ASSERT_EQUAL(SdmmcState::Ready, sd.GetState());
+    TEST_ASSERT_TRUE(usb::sim::HalState::Get().sdmmc_clk[1]);
+    TEST_ASSERT_EQUAL_UINT32(0, card.GetStats().select_cmds);
+}
+
+void test_sdmmc_resume_restores_bus_without_identification() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    const uint32_t clkcr = SDMMC1->CLKCR;
+    TEST_ASSERT_TRUE(sd.Suspend());
+    SDMMC1->CLKCR = 0;  // Регистры потеряны (Stop режим с отключённым доменом)
+
+    const uint64_t start = SimTime::NowUs();
+    TEST_ASSERT_TRUE(sd.Resume());
+    const uint64_t resume_us = SimTime::NowUs() - start;
+
+    TEST_ASSERT_EQUAL(SdmmcState::Ready, sd.GetState());
+    TEST_ASSERT_EQUAL_UINT32(1, card.GetStats().init_count);
+    TEST_ASSERT_EQUAL_UINT32(clkcr, SDMMC1->CLKCR);
+    TEST_ASSERT_EQUAL_UINT8(4, card.GetBusWidth());
+    TEST_ASSERT_TRUE(resume_us < 1000);  // Одна команда CMD7 вместо идентификации
+
+    uint8_t buf[512];
+    TEST_ASSERT_TRUE(sd.Read(0, buf, 1));
+}
+
+void test_sdmmc_read_wakes_suspended_card() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    uint8_t wbuf[1024];
+    uint8_t rbuf[1024];
+    FillPattern(wbuf, sizeof(wbuf), 0x33);
+    TEST_ASSERT_TRUE(sd.Write(20, wbuf, 2));
+    TEST_ASSERT_TRUE(sd.Suspend());
+
+    TEST_ASSERT_TRUE(sd.Read(20, rbuf, 2));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(wbuf, rbuf, sizeof(wbuf));
+    TEST_ASSERT_EQUAL(SdmmcState::Ready, sd.GetState());
+    TEST_ASSERT_TRUE(usb::sim::HalState::Get().sdmmc_clk[1]);
+}
+
+void test_sdmmc_resume_reidentifies_replaced_card() {
+    SdCardSim card;
+    card.Attach(1);
+    SdmmcBlockDevice sd;
+    TEST_ASSERT_TRUE(sd.Init());
+    TEST_ASSERT_TRUE(sd.Suspend());
+
+    // Карту вынули и вставили: без идентификации она не отвечает на CMD7
+    card.SetInserted(false);
+    card.SetInserted(true);
+    TEST_ASSERT_TRUE(sd.Resume());
+    TEST_ASSERT_EQUAL(SdmmcState::Ready, sd.GetState());
+    TEST_ASSERT_EQUAL_UINT32(2, card.GetStats().init_count);
+    TEST_ASSERT_EQUAL_UINT8(4, card.GetBusWidth());
+
+    // Карты нет вовсе — Resume() сообщает ошибку
+    TEST_ASSERT_TRUE(sd.Suspend());
+    card.SetInserted(false);
+    TEST_ASSERT_FALSE(sd.Resume());
+    TEST_ASSERT_EQUAL(SdmmcState::Error, sd.GetState());
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_sdmmc_init_reports_geometry_from_card);
+    RUN_TEST(test_sdmmc_init_parses_csd_when_hal_reports_zero_blocks);
+    RUN_TEST(test_sdmmc_init_scales_large_csd_block_len);
+    RUN_TEST(test_sdmmc_init_fails_without_card);
+    RUN_TEST(test_sdmmc_write_read_roundtrip);
+    RUN_TEST(test_sdmmc_write_waits_for_programming_busy);
+    RUN_TEST(test_sim_programs_every_touched_page);
+    RUN_TEST(test_sim_merges_writes_outside_open_erase_blocks);
+    RUN_TEST(test_sdmmc_read_fails_on_injected_error);
+    RUN_TEST(test_sdmmc_retries_per_block_on_fifo_overrun);
+    RUN_TEST(test_sdmmc_write_fails_when_card_removed);
+    RUN_TEST(test_sdmmc_deinit_gates_sdmmc_clock);
+    RUN_TEST(test_sdmmc_suspend_deselects_card_and_gates_clock);
+    RUN_TEST(test_sdmmc_suspend_keeps_card_selected_when_not_ready);
+    RUN_TEST(test_sdmmc_resume_restores_bus_without_identification);
+    RUN_TEST(test_sdmmc_read_wakes_suspended_card);
+    RUN_TEST(test_sdmmc_resume_reidentifies_replaced_card);
+
+    return UNITY_END();
+}
@@ -0,0 +1,339 @@
+/**
+ * @file test_snapshot.cpp
+ * @brief Unit тесты SnapshotOverlay (снимок хоста, переадресация, перенос по eject)
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_snapshot.h"
+#include "mock/MockBlockDevice.hpp"
+#include "sim/TinyUsbSim.hpp"
+#include "tusb.h"
+
+#include <cstring>
+
+using usb::SnapshotConfig;
+using usb::SnapshotOverlay;
+using usb::SnapshotState;
+using usb::SnapshotStats;
+using usb::UsbDevice;
+using usb::mock::MockBlockDevice;
+using usb::sim::CswStatus;
+using usb::sim::MscHostSim;
+using usb::sim::TinyUsbSim;
+
+static constexpr uint32_t kBlock = 512;
+static constexpr uint32_t kDiskBlocks = 4096;
+static constexpr uint32_t kRedirectBlocks = 64;
+
+static UsbDevice g_usb;
+
+static void Insert(void* context) {
+    static_cast<UsbDevice*>(context)->MscInsert();
+}
+
+static void OnEject(bool loaded, void* context) {
+    static_cast<SnapshotOverlay*>(context)->OnEject(loaded);
+}
+
+static bool PollUntil(SnapshotOverlay& overlay, SnapshotState state, uint32_t max_polls = 100) {
+    for (uint32_t i = 0; i < max_polls; i++) {
+        overlay.Poll();
+        if (overlay.GetState() == state) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_usb.Init();
+    g_usb.MscResetStats();
+}
+
+void tearDown() {
+    g_usb.MscDetach();
+    g_usb.MscSetEjectCallback(nullptr);
+}
+
+void test_host_reads_frozen_image() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    MockBlockDevice redirect(kRedirectBlocks, kBlock);
+    disk.Fill(0x11);
+    SnapshotOverlay overlay(disk, redirect);
+
+    // До Freeze() снимка нет: хосту NOT READY, прошивка пишет на носитель
+    TEST_ASSERT_FALSE(overlay.Host().IsReady());
+    uint8_t buf[4 * kBlock];
+    std::memset(buf, 0x22, sizeof(buf));
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(0, buf, 1));
+    TEST_ASSERT_EQUAL_HEX8(0x22, disk.GetData()[0]);
+
+    TEST_ASSERT_TRUE(overlay.Freeze());
+    TEST_ASSERT_TRUE(overlay.Host().IsReady());
+    std::memset(buf, 0x33, sizeof(buf));
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(10, buf, 4));
+    TEST_ASSERT_EQUAL_HEX8(0x11, disk.GetData()[10 * kBlock]);  // Носитель не тронут
+
+    uint8_t seen[4 * kBlock];
+    TEST_ASSERT_TRUE(overlay.Host().Read(10, seen, 4));
+    TEST_ASSERT_EQUAL_HEX8(0x11, seen[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x11, seen[3 * kBlock]);
+
+    // Прошивка видит свои данные; серия 8..15 собрана из носителя и слотов
+    uint8_t mixed[8 * kBlock];
+    TEST_ASSERT_TRUE(overlay.Firmware().Read(8, mixed, 8));
+    TEST_ASSERT_EQUAL_HEX8(0x11, mixed[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x33, mixed[2 * kBlock]);
+    TEST_ASSERT_EQUAL_HEX8(0x33, mixed[5 * kBlock + kBlock - 1]);
+    TEST_ASSERT_EQUAL_HEX8(0x11, mixed[6 * kBlock]);
+
+    // Запись хоста в снимок — ошибка
+    TEST_ASSERT_FALSE(overlay.Host().Write(10, seen, 1));
+    TEST_ASSERT_EQUAL_UINT32(1, overlay.GetStats().host_write_rejects);
+}
+
+void test_host_view_is_write_protected_over_msc() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    MockBlockDevice redirect(kRedirectBlocks, kBlock);
+    disk.Fill(0x11);
+    SnapshotOverlay overlay(disk, redirect);
+    TEST_ASSERT_TRUE(overlay.Freeze());
+    TEST_ASSERT_TRUE(overlay.Host().IsWriteProtected());
+    TEST_ASSERT_FALSE(overlay.Firmware().IsWriteProtected());
+    g_usb.MscAttach(overlay.Host());
+
+    // Хост видит WP и монтирует том только для чтения
+    MscHostSim host;
+    bool write_protected = false;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.ModeSense6(&write_protected));
+    TEST_ASSERT_TRUE(write_protected);
+
+    // WRITE10 отклоняется TinyUSB до данных: DATA PROTECT, устройство не вызывается
+    uint8_t buf[kBlock];
+    std::memset(buf, 0x55, sizeof(buf));
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.Write10(0, 1, buf));
+    uint8_t key = 0;
+    uint8_t asc = 0;
+    uint8_t ascq = 0;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.RequestSense(&key, &asc, &ascq));
+    TEST_ASSERT_EQUAL_HEX8(SCSI_SENSE_DATA_PROTECT, key);
+    TEST_ASSERT_EQUAL_HEX8(0x27, asc);
+    TEST_ASSERT_EQUAL_UINT32(0, TinyUsbSim::Get().GetMscStats().write10_cb_calls);
+    TEST_ASSERT_EQUAL_UINT32(0, overlay.GetStats().host_write_rejects);
+    TEST_ASSERT_EQUAL_HEX8(0x11, disk.GetData()[0]);
+
+    // Обычное устройство записываемо
+    g_usb.MscAttach(disk);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.ModeSense6(&write_protected));
+    TEST_ASSERT_FALSE(write_protected);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(0, 1, buf));
+    TEST_ASSERT_EQUAL_HEX8(0x55, disk.GetData()[0]);
+}
+
+void test_redirected_runs_are_single_calls() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    MockBlockDevice redirect(kRedirectBlocks, kBlock);
+    SnapshotOverlay overlay(disk, redirect);
+    TEST_ASSERT_TRUE(overlay.Freeze());
+
+    uint8_t buf[8 * kBlock];
+    std::memset(buf, 0x44, sizeof(buf));
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(100, buf, 8));  // Слоты 0..7
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(200, buf, 2));  // Слоты 8..9
+    TEST_ASSERT_EQUAL_UINT32(2, redirect.GetWriteCount());
+
+    // Перезапись уже переадресованных блоков — на месте, без новых слотов
+    std::memset(buf, 0x55, sizeof(buf));
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(102, buf, 4));
+    TEST_ASSERT_EQUAL_UINT32(10, overlay.GetRedirectedCount());
+    TEST_ASSERT_EQUAL_UINT32(3, redirect.GetWriteCount());
+
+    const uint32_t reads = redirect.GetReadCount();
+    uint8_t out[8 * kBlock];
+    TEST_ASSERT_TRUE(overlay.Firmware().Read(100, out, 8));
+    TEST_ASSERT_EQUAL_UINT32(reads + 1, redirect.GetReadCount());
+    TEST_ASSERT_EQUAL_HEX8(0x44, out[kBlock]);
+    TEST_ASSERT_EQUAL_HEX8(0x55, out[2 * kBlock]);
+    TEST_ASSERT_EQUAL_HEX8(0x44, out[6 * kBlock]);
+    TEST_ASSERT_EQUAL_UINT32(14, overlay.GetStats().redirected_blocks);
+}
+
+void test_full_redirect_area_rejects_whole_write() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    MockBlockDevice redirect(8, kBlock);
+    disk.Fill(0x11);
+    SnapshotOverlay overlay(disk, redirect);
+    TEST_ASSERT_TRUE(overlay.Freeze());
+    TEST_ASSERT_EQUAL_UINT32(8, overlay.GetCapacity());
+
+    uint8_t buf[8 * kBlock];
+    std::memset(buf, 0x66, sizeof(buf));
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(0, buf, 6));
+    TEST_ASSERT_FALSE(overlay.Firmware().Write(6, buf, 3));  // Нужно 3, свободно 2
+    TEST_ASSERT_EQUAL_UINT32(6, overlay.GetRedirectedCount());
+    TEST_ASSERT_EQUAL_UINT32(1, overlay.GetStats().redirect_full);
+
+    uint8_t out[kBlock];
+    TEST_ASSERT_TRUE(overlay.Firmware().Read(6, out, 1));
+    TEST_ASSERT_EQUAL_HEX8(0x11, out[0]);  // Отклонённая запись не видна
+
+    // Перезапись занятых блоков места не требует
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(2, buf, 4));
+
+    // Ошибка области: слоты серии освобождаются
+    redirect.SetReady(false);
+    TEST_ASSERT_FALSE(overlay.Firmware().Write(6, buf, 2));
+    TEST_ASSERT_EQUAL_UINT32(6, overlay.GetRedirectedCount());
+    redirect.SetReady(true);
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(6, buf, 2));
+    TEST_ASSERT_EQUAL_UINT32(8, overlay.GetRedirectedCount());
+}
+
+void test_eject_commits_and_rotates_snapshot() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    MockBlockDevice redirect(kRedirectBlocks, kBlock);
+    disk.Fill(0x11);
+    SnapshotConfig cfg;
+    cfg.commit_blocks = 2;
+    SnapshotOverlay overlay(disk, redirect, cfg);
+    overlay.SetRotateCallback(Insert, &g_usb);
+    g_usb.MscSetEjectCallback(OnEject, &overlay);
+    TEST_ASSERT_TRUE(overlay.Freeze());
+    g_usb.MscAttach(overlay.Host());
+
+    MscHostSim host;
+    uint8_t buf[4 * kBlock];
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+    std::memset(buf, 0x77, sizeof(buf));
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(40, buf, 4));
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(40, 4, buf));
+    TEST_ASSERT_EQUAL_HEX8(0x11, buf[0]);
+
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.StartStopUnit(false, true));
+    overlay.Poll();  // Половина слотов
+    TEST_ASSERT_EQUAL(SnapshotState::Committing, overlay.GetState());
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.TestUnitReady());  // Извлечён до конца переноса
+
+    TEST_ASSERT_TRUE(PollUntil(overlay, SnapshotState::Frozen));
+    TEST_ASSERT_EQUAL_HEX8(0x77, disk.GetData()[43 * kBlock]);
+    TEST_ASSERT_EQUAL_UINT32(0, overlay.GetRedirectedCount());
+    TEST_ASSERT_EQUAL_UINT32(1, disk.GetSyncCount());
+
+    // Новый снимок: UNIT ATTENTION один раз, затем данные прошивки
+    TEST_ASSERT_EQUAL(CswStatus::Failed, host.TestUnitReady());
+    uint8_t key = 0;
+    uint8_t asc = 0;
+    uint8_t ascq = 0;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.RequestSense(&key, &asc, &ascq));
+    TEST_ASSERT_EQUAL_HEX8(SCSI_SENSE_UNIT_ATTENTION, key);
+    TEST_ASSERT_EQUAL_HEX8(0x28, asc);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(40, 4, buf));
+    TEST_ASSERT_EQUAL_HEX8(0x77, buf[0]);
+
+    SnapshotStats stats = overlay.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.commits);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.committed_blocks);
+}
+
+void test_firmware_write_during_commit_wins() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    MockBlockDevice redirect(kRedirectBlocks, kBlock);
+    SnapshotConfig cfg;
+    cfg.commit_blocks = 2;
+    SnapshotOverlay overlay(disk, redirect, cfg);
+    TEST_ASSERT_TRUE(overlay.Freeze());
+
+    uint8_t buf[8 * kBlock];
+    std::memset(buf, 0x88, sizeof(buf));
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(0, buf, 8));
+
+    overlay.OnEject(false);
+    overlay.Poll();  // Перенесены блоки 0..1
+    TEST_ASSERT_EQUAL(SnapshotState::Committing, overlay.GetState());
+    TEST_ASSERT_FALSE(overlay.Host().IsReady());
+
+    // Во время переноса — напрямую на носитель, слот блока 6 отменён
+    std::memset(buf, 0x99, kBlock);
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(6, buf, 1));
+    uint8_t out[kBlock];
+    TEST_ASSERT_TRUE(overlay.Firmware().Read(6, out, 1));
+    TEST_ASSERT_EQUAL_HEX8(0x99, out[0]);
+
+    TEST_ASSERT_TRUE(PollUntil(overlay, SnapshotState::Frozen));
+    TEST_ASSERT_EQUAL_HEX8(0x88, disk.GetData()[5 * kBlock]);
+    TEST_ASSERT_EQUAL_HEX8(0x99, disk.GetData()[6 * kBlock]);
+    TEST_ASSERT_EQUAL_HEX8(0x88, disk.GetData()[7 * kBlock]);
+    TEST_ASSERT_EQUAL_UINT32(7, overlay.GetStats().committed_blocks);
+}
+
+void test_commit_error_retries_next_poll() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    MockBlockDevice redirect(kRedirectBlocks, kBlock);
+    SnapshotOverlay overlay(disk, redirect);
+    TEST_ASSERT_TRUE(overlay.Freeze());
+
+    uint8_t buf[kBlock];
+    std::memset(buf, 0xAB, sizeof(buf));
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(9, buf, 1));
+    overlay.OnEject(false);
+    disk.SetReady(false);
+    overlay.Poll();
+    TEST_ASSERT_EQUAL(SnapshotState::Committing, overlay.GetState());
+    TEST_ASSERT_EQUAL_UINT32(1, overlay.GetStats().commit_errors);
+
+    disk.SetReady(true);
+    overlay.Poll();
+    TEST_ASSERT_EQUAL(SnapshotState::Frozen, overlay.GetState());
+    TEST_ASSERT_EQUAL_HEX8(0xAB, disk.GetData()[9 * kBlock]);
+}
+
+void test_without_rotate_waits_for_host_load() {
+    MockBlockDevice disk(kDiskBlocks, kBlock);
+    MockBlockDevice redirect(kRedirectBlocks, kBlock);
+    SnapshotConfig cfg;
+    cfg.rotate = false;
+    SnapshotOverlay overlay(disk, redirect, cfg);
+    uint32_t rotations = 0;
+    overlay.SetRotateCallback([](void* count) { (*static_cast<uint32_t*>(count))++; },
+                              &rotations);
+    g_usb.MscSetEjectCallback(OnEject, &overlay);
+    TEST_ASSERT_TRUE(overlay.Freeze());
+    g_usb.MscAttach(overlay.Host());
+
+    MscHostSim host;
+    uint8_t buf[kBlock];
+    std::memset(buf, 0x5A, sizeof(buf));
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(3, buf, 1));
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.StartStopUnit(false, true));
+    TEST_ASSERT_TRUE(PollUntil(overlay, SnapshotState::Live));
+    TEST_ASSERT_EQUAL_UINT32(0, rotations);
+    TEST_ASSERT_EQUAL_HEX8(0x5A, disk.GetData()[3 * kBlock]);
+
+    // Live: прошивка пишет напрямую, слоты не расходуются
+    TEST_ASSERT_TRUE(overlay.Firmware().Write(4, buf, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, overlay.GetRedirectedCount());
+
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.StartStopUnit(true, true));
+    TEST_ASSERT_TRUE(PollUntil(overlay, SnapshotState::Frozen));
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.TestUnitReady());
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(4, 1, buf));
+    TEST_ASSERT_EQUAL_HEX8(0x5A, buf[0]);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_host_reads_frozen_image);
+    RUN_TEST(test_host_view_is_write_protected_over_msc);
+    RUN_TEST(test_redirected_runs_are_single_calls);
+    RUN_TEST(test_full_redirect_area_rejects_whole_write);
+    RUN_TEST(test_eject_commits_and_rotates_snapshot);
+    RUN_TEST(test_firmware_write_during_commit_wins);
+    RUN_TEST(test_commit_error_retries_next_poll);
+    RUN_TEST(test_without_rotate_waits_for_host_load);
+
+    return UNITY_END();
+}
@@ -0,0 +1,356 @@
+/**
+ * @file test_uf2.cpp
+ * @brief Unit тесты Uf2Disk (виртуальный FAT16 том, конвейер записи во flash)
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_uf2.h"
+#include "sim/FlashSim.hpp"
+#include "sim/TinyUsbSim.hpp"
+
+#include <cstring>
+#include <vector>
+
+using usb::Uf2Config;
+using usb::Uf2Disk;
+using usb::Uf2Stats;
+using usb::UsbDevice;
+using usb::sim::CswStatus;
+using usb::sim::FlashSim;
+using usb::sim::FlashSimConfig;
+using usb::sim::MscHostSim;
+using usb::sim::SimTime;
+using usb::sim::TinyUsbSim;
+
+static constexpr uint32_t kFlashBase = 0x08000000;
+static constexpr uint32_t kSectorSize = 16 * 1024;
+static constexpr uint32_t kAppAddress = kFlashBase + kSectorSize;  // Сектор 0 — загрузчик
+static constexpr uint32_t kChunkSectors = 8;                       // 4 KB на Write()
+static constexpr uint32_t kChunkUs = 4000;                         // ~1 MB/s по USB
+static constexpr uint32_t kPollUs = 250;                           // Период main loop
+
+static UsbDevice g_usb;
+
+/// 256 KB, секторы по 16 KB, стирание 20 мс
+static FlashSimConfig SmallFlash() {
+    FlashSimConfig cfg;
+    cfg.size = 256 * 1024;
+    cfg.sector_size = kSectorSize;
+    cfg.erase_us = 20000;
+    return cfg;
+}
+
+static Uf2Config AppConfig(bool erase_ahead = true) {
+    Uf2Config cfg;
+    cfg.app_address = kAppAddress;
+    cfg.erase_ahead = erase_ahead;
+    return cfg;
+}
+
+static std::vector<uint8_t> MakeImage(uint32_t len, uint8_t seed) {
+    std::vector<uint8_t> image(len);
+    for (uint32_t i = 0; i < len; i++) {
+        image[i] = static_cast<uint8_t>(seed + i * 7 + (i >> 8));
+    }
+    return image;
+}
+
+static void PutBlock(uint8_t* out, uint32_t flags, uint32_t address, const uint8_t* data,
+                     uint32_t block_no, uint32_t num_blocks,
+                     uint32_t family = USB_UF2_FAMILY_ID) {
+    usb::uf2::Block block{};
+    block.magic_start0 = usb::uf2::kMagicStart0;
+    block.magic_start1 = usb::uf2::kMagicStart1;
+    block.flags = flags;
+    block.target_addr = address;
+    block.payload_size = usb::uf2::kPayloadSize;
+    block.block_no = block_no;
+    block.num_blocks = num_blocks;
+    block.family_id = family;
+    std::memcpy(block.data, data, usb::uf2::kPayloadSize);
+    block.magic_end = usb::uf2::kMagicEnd;
+    std::memcpy(out, &block, sizeof(block));
+}
+
+/// UF2 файл образа (как uf2conv.py -f)
+static std::vector<uint8_t> MakeUf2(uint32_t address, const std::vector<uint8_t>& image) {
+    const uint32_t blocks = static_cast<uint32_t>(image.size()) / usb::uf2::kPayloadSize;
+    std::vector<uint8_t> file(blocks * usb::uf2::kBlockSize);
+    for (uint32_t i = 0; i < blocks; i++) {
+        PutBlock(&file[i * usb::uf2::kBlockSize], usb::uf2::kFlagFamilyId,
+                 address + i * usb::uf2::kPayloadSize, &image[i * usb::uf2::kPayloadSize], i,
+                 blocks);
+    }
+    return file;
+}
+
+/// Передача файла кусками: время USB на кусок, main loop вызывает Poll() во время передачи
+static bool Stream(Uf2Disk& disk, const std::vector<uint8_t>& file, uint32_t lba) {
+    const uint32_t sectors = static_cast<uint32_t>(file.size()) / 512;
+    bool ok = true;
+    for (uint32_t i = 0; i < sectors && ok; i += kChunkSectors) {
+        const uint32_t count = sectors - i < kChunkSectors ? sectors - i : kChunkSectors;
+        for (uint32_t t = 0; t < kChunkUs; t += kPollUs) {
+            SimTime::AdvanceUs(kPollUs);
+            disk.Poll();
+        }
+        ok = disk.Write(lba + i, &file[i * 512], count);
+    }
+    return ok;
+}
+
+static uint16_t Get16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t Get32(const uint8_t* p) {
+    return Get16(p) | (static_cast<uint32_t>(Get16(p + 2)) << 16);
+}
+
+static uint32_t g_complete_calls = 0;
+
+void setUp() {
+    SimTime::Reset();
+    TinyUsbSim::Get().Reset();
+    g_usb.Init();
+    g_complete_calls = 0;
+}
+
+void tearDown() {
+    g_usb.MscDetach();
+}
+
+void test_volume_is_fat16_with_files() {
+    FlashSim flash(SmallFlash());
+    Uf2Disk disk(flash, AppConfig());
+    TEST_ASSERT_TRUE(disk.IsReady());
+    TEST_ASSERT_TRUE(disk.GetClusterCount() >= 4085);  // Иначе хост увидит FAT12
+
+    uint8_t boot[512];
+    TEST_ASSERT_TRUE(disk.Read(0, boot, 1));
+    TEST_ASSERT_EQUAL_HEX8(0x55, boot[510]);
+    TEST_ASSERT_EQUAL_HEX8(0xAA, boot[511]);
+    TEST_ASSERT_EQUAL_UINT16(512, Get16(boot + 11));
+    TEST_ASSERT_EQUAL_UINT8(2, boot[16]);
+    TEST_ASSERT_EQUAL_UINT32(disk.GetBlockCount(), Get16(boot + 19));
+    TEST_ASSERT_EQUAL_MEMORY("FAT16   ", boot + 54, 8);
+
+    const uint32_t fat_sectors = Get16(boot + 22);
+    const uint32_t root_lba = 1 + 2 * fat_sectors;
+    uint8_t root[512];
+    TEST_ASSERT_TRUE(disk.Read(root_lba, root, 1));
+    TEST_ASSERT_EQUAL_MEMORY("INFO_UF2TXT", root + 32, 11);
+    TEST_ASSERT_EQUAL_MEMORY("INDEX   HTM", root + 64, 11);
+    TEST_ASSERT_EQUAL_MEMORY("CURRENT UF2", root + 96, 11);
+    const uint32_t app_blocks = (256 * 1024 - kSectorSize) / 256;
+    TEST_ASSERT_EQUAL_UINT32(app_blocks * 512, Get32(root + 96 + 28));
+
+    // Обе копии FAT: цепочка CURRENT.UF2 4 -> 5 -> ... -> конец
+    uint8_t fat[512];
+    TEST_ASSERT_TRUE(disk.Read(1 + fat_sectors, fat, 1));
+    TEST_ASSERT_EQUAL_HEX16(0xFFF8, Get16(fat));
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, Get16(fat + 2 * 2));
+    TEST_ASSERT_EQUAL_UINT16(5, Get16(fat + 4 * 2));
+
+    // INFO_UF2.TXT в кластере 2
+    uint8_t info[512];
+    TEST_ASSERT_TRUE(disk.Read(root_lba + 4, info, 1));
+    TEST_ASSERT_EQUAL_MEMORY("UF2 Bootloader", info, 14);
+    TEST_ASSERT_NOT_NULL(std::strstr(reinterpret_cast<char*>(info), USB_UF2_BOARD_ID));
+    TEST_ASSERT_FALSE(disk.Read(disk.GetBlockCount(), info, 1));
+}
+
+void test_current_uf2_reads_flash() {
+    FlashSim flash(SmallFlash());
+    std::vector<uint8_t> image = MakeImage(1024, 3);
+    std::memcpy(&flash.Memory()[kAppAddress - kFlashBase], image.data(), image.size());
+    Uf2Disk disk(flash, AppConfig());
+
+    uint8_t boot[512];
+    TEST_ASSERT_TRUE(disk.Read(0, boot, 1));
+    const uint32_t data_lba = 1 + 2 * Get16(boot + 22) + 4;
+
+    uint8_t block[512];
+    TEST_ASSERT_TRUE(disk.Read(data_lba + 2 + 3, block, 1));  // Кластер 4 + блок 3
+    TEST_ASSERT_TRUE(usb::uf2::IsBlock(block));
+    TEST_ASSERT_EQUAL_HEX32(kAppAddress + 3 * 256, Get32(block + 12));
+    TEST_ASSERT_EQUAL_UINT32(3, Get32(block + 20));
+    TEST_ASSERT_EQUAL_HEX32(USB_UF2_FAMILY_ID, Get32(block + 28));
+    TEST_ASSERT_EQUAL_MEMORY(&image[3 * 256], block + 32, 256);
+}
+
+void test_streamed_file_programs_image() {
+    FlashSim flash(SmallFlash());
+    // Старая прошивка: ячейки не стёрты
+    std::memset(&flash.Memory()[kAppAddress - kFlashBase], 0x00, 3 * kSectorSize);
+    Uf2Disk disk(flash, AppConfig());
+    disk.SetCompleteCallback([](void*) { g_complete_calls++; });
+
+    std::vector<uint8_t> image = MakeImage(40 * 1024, 11);  // 2.5 сектора
+    std::vector<uint8_t> file = MakeUf2(kAppAddress, image);
+
+    uint8_t fat[512] = {0xF8, 0xFF, 0xFF, 0xFF};
+    TEST_ASSERT_TRUE(disk.Write(1, fat, 1));  // FAT хоста — игнорируется
+    TEST_ASSERT_TRUE(Stream(disk, file, 600));
+    TEST_ASSERT_TRUE(disk.IsComplete());
+    TEST_ASSERT_EQUAL_UINT32(1, g_complete_calls);
+    TEST_ASSERT_FALSE(flash.IsBusy());
+
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), &flash.Memory()[kAppAddress - kFlashBase],
+                             image.size());
+    TEST_ASSERT_EQUAL_HEX8(0xFF, flash.Memory()[kAppAddress - kFlashBase + image.size()]);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, flash.Memory()[0]);  // Загрузчик не тронут
+
+    Uf2Stats s = disk.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(160, s.blocks_received);
+    TEST_ASSERT_EQUAL_UINT32(160, s.blocks_programmed);
+    TEST_ASSERT_EQUAL_UINT32(3, s.sectors_erased);
+    TEST_ASSERT_EQUAL_UINT32(1, s.other_writes);
+    TEST_ASSERT_EQUAL_UINT32(3, flash.GetStats().erases);
+    TEST_ASSERT_EQUAL_UINT32(160, flash.GetStats().programs);
+    TEST_ASSERT_EQUAL_UINT32(0, flash.GetStats().errors);
+
+    TEST_ASSERT_TRUE(disk.Sync());
+    TEST_ASSERT_EQUAL_UINT32(1, g_complete_calls);
+}
+
+void test_duplicate_foreign_and_invalid_blocks() {
+    FlashSim flash(SmallFlash());
+    Uf2Disk disk(flash, AppConfig());
+    std::vector<uint8_t> image = MakeImage(2048, 5);
+    std::vector<uint8_t> file = MakeUf2(kAppAddress, image);
+
+    TEST_ASSERT_TRUE(disk.Write(600, &file[0], 4));
+    TEST_ASSERT_TRUE(disk.Write(600, &file[0], 4));  // Хост повторил кластеры
+
+    uint8_t other[512];
+    PutBlock(other, usb::uf2::kFlagFamilyId, kAppAddress, image.data(), 0, 8, 0x12345678);
+    TEST_ASSERT_TRUE(disk.Write(700, other, 1));
+    PutBlock(other, usb::uf2::kFlagNotMainFlash, kAppAddress, image.data(), 0, 8);
+    TEST_ASSERT_TRUE(disk.Write(700, other, 1));
+    PutBlock(other, 0, kFlashBase, image.data(), 0, 8);  // Загрузчик
+    TEST_ASSERT_TRUE(disk.Write(700, other, 1));
+    PutBlock(other, 0, kAppAddress + 16, image.data(), 0, 8);  // Не кратно flash word
+    TEST_ASSERT_TRUE(disk.Write(700, other, 1));
+    PutBlock(other, 0, kAppAddress, image.data(), 9, 8);
+    TEST_ASSERT_TRUE(disk.Write(700, other, 1));
+
+    TEST_ASSERT_TRUE(disk.Write(604, &file[4 * 512], 4));
+    TEST_ASSERT_TRUE(disk.IsComplete());
+
+    Uf2Stats s = disk.GetStats();
+    TEST_ASSERT_EQUAL_UINT32(8, s.blocks_received);
+    TEST_ASSERT_EQUAL_UINT32(4, s.blocks_duplicate);
+    TEST_ASSERT_EQUAL_UINT32(2, s.blocks_skipped);
+    TEST_ASSERT_EQUAL_UINT32(3, s.blocks_invalid);
+    TEST_ASSERT_EQUAL_UINT32(8, flash.GetStats().programs);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), &flash.Memory()[kAppAddress - kFlashBase],
+                             image.size());
+    TEST_ASSERT_EQUAL_HEX8(0xFF, flash.Memory()[0]);
+}
+
+void test_erase_failure_rejects_writes_until_reset() {
+    FlashSim flash(SmallFlash());
+    flash.FailErase(1);
+    Uf2Disk disk(flash, AppConfig());
+    std::vector<uint8_t> image = MakeImage(4096, 9);
+    std::vector<uint8_t> file = MakeUf2(kAppAddress, image);
+
+    TEST_ASSERT_FALSE(Stream(disk, file, 600));
+    TEST_ASSERT_TRUE(disk.HasFailed());
+    TEST_ASSERT_FALSE(disk.IsComplete());
+    TEST_ASSERT_EQUAL_UINT32(1, disk.GetStats().flash_errors);
+    TEST_ASSERT_EQUAL_UINT32(0, flash.GetStats().programs);
+
+    disk.Reset();
+    TEST_ASSERT_FALSE(disk.HasFailed());
+    TEST_ASSERT_TRUE(Stream(disk, file, 600));
+    TEST_ASSERT_TRUE(disk.IsComplete());
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), &flash.Memory()[kAppAddress - kFlashBase],
+                             image.size());
+}
+
+void test_erase_ahead_overlaps_transfer() {
+    std::vector<uint8_t> image = MakeImage(4 * kSectorSize, 1);
+    std::vector<uint8_t> file = MakeUf2(kAppAddress, image);
+    const uint64_t usb_us = (file.size() / 512 / kChunkSectors) * kChunkUs;
+
+    uint64_t elapsed[2] = {0, 0};
+    uint64_t flash_us = 0;
+    for (int ahead = 0; ahead < 2; ahead++) {
+        SimTime::Reset();
+        FlashSim flash(SmallFlash());
+        Uf2Disk disk(flash, AppConfig(ahead != 0));
+        TEST_ASSERT_TRUE(Stream(disk, file, 600));
+        TEST_ASSERT_TRUE(disk.IsComplete());
+        TEST_ASSERT_EQUAL_MEMORY(image.data(), &flash.Memory()[kAppAddress - kFlashBase],
+                                 image.size());
+        TEST_ASSERT_EQUAL_UINT32(4, flash.GetStats().erases);
+        TEST_ASSERT_EQUAL_UINT32(ahead != 0 ? 3 : 0, disk.GetStats().erase_ahead);
+        elapsed[ahead] = SimTime::NowUs();
+        flash_us = flash.GetStats().busy_us;
+    }
+
+    // Обе схемы перекрывают flash с передачей; стирание наперёд — больше
+    TEST_ASSERT_TRUE(elapsed[0] < usb_us + flash_us);
+    TEST_ASSERT_TRUE(elapsed[1] < elapsed[0]);
+}
+
+void test_end_to_end_through_msc() {
+    FlashSim flash(SmallFlash());
+    Uf2Disk disk(flash, AppConfig());
+    disk.SetCompleteCallback([](void*) { g_complete_calls++; });
+    g_usb.MscAttach(disk);
+
+    MscHostSim host;
+    uint32_t last_lba = 0;
+    uint32_t block_size = 0;
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.ReadCapacity(&last_lba, &block_size));
+    TEST_ASSERT_EQUAL_UINT32(disk.GetBlockCount() - 1, last_lba);
+    TEST_ASSERT_EQUAL_UINT32(512, block_size);
+
+    uint8_t boot[512];
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Read10(0, 1, boot));
+    TEST_ASSERT_EQUAL_MEMORY("FAT16   ", boot + 54, 8);
+
+    std::vector<uint8_t> image = MakeImage(8192, 21);
+    std::vector<uint8_t> file = MakeUf2(kAppAddress, image);
+    const uint16_t sectors = static_cast<uint16_t>(file.size() / 512);
+    TEST_ASSERT_EQUAL(CswStatus::Passed, host.Write10(900, sectors, file.data()));
+    TEST_ASSERT_TRUE(disk.IsComplete());
+    TEST_ASSERT_EQUAL_UINT32(1, g_complete_calls);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), &flash.Memory()[kAppAddress - kFlashBase],
+                             image.size());
+}
+
+void test_invalid_region_not_ready() {
+    FlashSim flash(SmallFlash());
+    Uf2Config cfg;
+    cfg.app_address = kAppAddress + 256;  // Не с начала сектора
+    Uf2Disk disk(flash, cfg);
+    TEST_ASSERT_FALSE(disk.IsReady());
+    uint8_t buf[512];
+    TEST_ASSERT_FALSE(disk.Read(0, buf, 1));
+
+    // Конец не на границе сектора: стирание последнего задело бы чужие данные
+    cfg.app_address = kAppAddress;
+    cfg.app_size = 2 * kSectorSize + 256;
+    Uf2Disk tail(flash, cfg);
+    TEST_ASSERT_FALSE(tail.IsReady());
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_volume_is_fat16_with_files);
+    RUN_TEST(test_current_uf2_reads_flash);
+    RUN_TEST(test_streamed_file_programs_image);
+    RUN_TEST(test_duplicate_foreign_and_invalid_blocks);
+    RUN_TEST(test_erase_failure_rejects_writes_until_reset);
+    RUN_TEST(test_erase_ahead_overlaps_transfer);
+    RUN_TEST(test_end_to_end_through_msc);
+    RUN_TEST(test_invalid_region_not_ready);
+
+    return UNITY_END();
+}
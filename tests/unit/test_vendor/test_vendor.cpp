@@ -0,0 +1,262 @@
+/**
+ * @file test_vendor.cpp
+ * @brief Unit тесты vendor интерфейса: BOS / MS OS 2.0, кольцо буферов, обмен с хостом
+ */
+
+#include <unity.h>
+#include "usb_composite.h"
+#include "usb_descriptors.h"
+#include "usb_vendor.h"
+#include "sim/TinyUsbSim.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using usb::StreamRing;
+using usb::UsbDevice;
+using usb::sim::TinyUsbSim;
+
+namespace desc = usb::desc;
+
+using CdcMscVendor = desc::Configuration<desc::Cdc<4>, desc::Msc<5>, desc::Vendor<6>>;
+using VendorOnly = desc::Configuration<desc::Vendor<6>>;
+
+static constexpr char kGuid[] = "{7A1C3E52-9B4D-4F08-A6E3-2D5B8C901F47}";
+
+static uint16_t Le16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t Le32(const uint8_t* p) {
+    return static_cast<uint32_t>(Le16(p)) | (static_cast<uint32_t>(Le16(p + 2)) << 16);
+}
+
+/// ASCII из UTF-16LE (chars символов)
+static std::string Utf16Ascii(const uint8_t* p, size_t chars) {
+    std::string text;
+    for (size_t i = 0; i < chars; i++) {
+        text += static_cast<char>(Le16(p + 2 * i));
+    }
+    return text;
+}
+
+static UsbDevice g_usb;
+
+void setUp() {
+    TinyUsbSim::Get().Reset();
+    g_usb.Init();
+    g_usb.VendorResetStats();
+}
+
+void tearDown() {}
+
+void test_bos_platform_capability() {
+    constexpr auto bos = desc::BuildBos(178, 0x01);
+    static_assert(bos.size() == desc::kBosLength, "BOS length");
+    const uint8_t kUuid[16] = {0xDF, 0x60, 0xDD, 0xD8, 0x89, 0x45, 0xC7, 0x4C,
+                               0x9C, 0xD2, 0x65, 0x9D, 0x9E, 0x64, 0x8A, 0x9F};
+
+    TEST_ASSERT_EQUAL_UINT8(5, bos[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x0F, bos[1]);
+    TEST_ASSERT_EQUAL_UINT16(33, Le16(&bos[2]));
+    TEST_ASSERT_EQUAL_UINT8(1, bos[4]);
+    TEST_ASSERT_EQUAL_UINT8(28, bos[5]);
+    TEST_ASSERT_EQUAL_UINT8(0x10, bos[6]);
+    TEST_ASSERT_EQUAL_UINT8(0x05, bos[7]);
+    TEST_ASSERT_EQUAL_MEMORY(kUuid, &bos[9], sizeof(kUuid));
+    TEST_ASSERT_EQUAL_UINT32(0x06030000, Le32(&bos[25]));
+    TEST_ASSERT_EQUAL_UINT16(178, Le16(&bos[29]));
+    TEST_ASSERT_EQUAL_UINT8(0x01, bos[31]);
+    TEST_ASSERT_EQUAL_UINT8(0, bos[32]);
+}
+
+void test_ms_os20_set_for_composite_device() {
+    using Set = desc::MsOs20Set<CdcMscVendor, 2>;
+    constexpr auto set = Set::Build(kGuid);
+    static_assert(Set::kSubsets && Set::kLength == 178, "10 + 8 + 8 + 20 + 132");
+
+    // Заголовок набора
+    TEST_ASSERT_EQUAL_UINT16(10, Le16(&set[0]));
+    TEST_ASSERT_EQUAL_UINT16(0x0000, Le16(&set[2]));
+    TEST_ASSERT_EQUAL_UINT32(0x06030000, Le32(&set[4]));
+    TEST_ASSERT_EQUAL_UINT16(178, Le16(&set[8]));
+    // Подмножество конфигурации — до конца набора
+    TEST_ASSERT_EQUAL_UINT16(0x0001, Le16(&set[12]));
+    TEST_ASSERT_EQUAL_UINT16(168, Le16(&set[16]));
+    // Подмножество функции: vendor после CDC (0, 1) и MSC (2)
+    TEST_ASSERT_EQUAL_UINT16(0x0002, Le16(&set[20]));
+    TEST_ASSERT_EQUAL_UINT8(3, set[22]);
+    TEST_ASSERT_EQUAL_UINT16(160, Le16(&set[24]));
+    // Compatible ID
+    TEST_ASSERT_EQUAL_UINT16(20, Le16(&set[26]));
+    TEST_ASSERT_EQUAL_UINT16(0x0003, Le16(&set[28]));
+    TEST_ASSERT_EQUAL_MEMORY("WINUSB\0\0", &set[30], 8);
+    // DeviceInterfaceGUIDs (REG_MULTI_SZ, двойной нуль в конце)
+    TEST_ASSERT_EQUAL_UINT16(132, Le16(&set[46]));
+    TEST_ASSERT_EQUAL_UINT16(0x0004, Le16(&set[48]));
+    TEST_ASSERT_EQUAL_UINT16(0x0007, Le16(&set[50]));
+    TEST_ASSERT_EQUAL_UINT16(42, Le16(&set[52]));
+    TEST_ASSERT_EQUAL_STRING("DeviceInterfaceGUIDs", Utf16Ascii(&set[54], 20).c_str());
+    TEST_ASSERT_EQUAL_UINT16(80, Le16(&set[96]));
+    TEST_ASSERT_EQUAL_STRING(kGuid, Utf16Ascii(&set[98], 38).c_str());
+    TEST_ASSERT_EQUAL_UINT32(0, Le32(&set[174]));
+}
+
+void test_ms_os20_set_single_function_has_no_subsets() {
+    using Set = desc::MsOs20Set<VendorOnly, 0>;
+    constexpr auto set = Set::Build(kGuid);
+    static_assert(!Set::kSubsets && Set::kLength == 162, "10 + 20 + 132");
+
+    TEST_ASSERT_EQUAL_UINT16(162, Le16(&set[8]));
+    TEST_ASSERT_EQUAL_UINT16(0x0003, Le16(&set[12]));  // Сразу Compatible ID
+
+    // Устройство с одним интерфейсом — класс задаёт интерфейс, IAD нет
+    constexpr auto device = desc::BuildDevice<VendorOnly>(desc::DeviceParams{});
+    TEST_ASSERT_EQUAL_UINT8(0, device[4]);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, VendorOnly::Build()[14]);  // bInterfaceClass
+}
+
+void test_guid_string_validation() {
+    static_assert(desc::IsGuidString(USB_VENDOR_GUID), "default GUID");
+    TEST_ASSERT_TRUE(desc::IsGuidString(kGuid));
+    TEST_ASSERT_TRUE(desc::IsGuidString("{7a1c3e52-9b4d-4f08-a6e3-2d5b8c901f47}"));
+    TEST_ASSERT_FALSE(desc::IsGuidString("{7A1C3E52-9B4D-4F08-A6E3-2D5B8C901F4G}"));
+    TEST_ASSERT_FALSE(desc::IsGuidString("{7A1C3E52 9B4D-4F08-A6E3-2D5B8C901F47}"));
+    TEST_ASSERT_FALSE(desc::IsGuidString("7A1C3E52-9B4D-4F08-A6E3-2D5B8C901F47}}"));
+    TEST_ASSERT_EQUAL_UINT16(0x0210, USB_BCD);  // BOS требует USB 2.1
+}
+
+void test_ring_fill_wrap_and_partial_consume() {
+    StreamRing<4, 64> ring;
+    uint32_t len = 0;
+    TEST_ASSERT_NULL(ring.Peek(&len));
+    TEST_ASSERT_EQUAL_UINT32(0, len);
+
+    for (uint32_t round = 0; round < 3; round++) {  // Индексы проходят через границу кольца
+        for (uint8_t i = 0; i < 4; i++) {
+            uint8_t* buffer = ring.Acquire();
+            TEST_ASSERT_NOT_NULL(buffer);
+            buffer[0] = static_cast<uint8_t>(round * 4 + i);
+            TEST_ASSERT_TRUE(ring.Commit(10 + i));
+        }
+        TEST_ASSERT_TRUE(ring.Full());
+        TEST_ASSERT_NULL(ring.Acquire());
+        TEST_ASSERT_FALSE(ring.Commit(1));
+
+        for (uint8_t i = 0; i < 4; i++) {
+            const uint8_t* data = ring.Peek(&len);
+            TEST_ASSERT_EQUAL_UINT32(10 + i, len);
+            TEST_ASSERT_EQUAL_UINT8(round * 4 + i, data[0]);
+            ring.Consume(4);  // Частично — буфер остаётся первым
+            TEST_ASSERT_EQUAL_PTR(data + 4, ring.Peek(&len));
+            TEST_ASSERT_EQUAL_UINT32(6 + i, len);
+            ring.Consume(100);  // Больше остатка — буфер освобождается
+        }
+        TEST_ASSERT_TRUE(ring.Empty());
+    }
+
+    TEST_ASSERT_NOT_NULL(ring.Acquire());
+    TEST_ASSERT_FALSE(ring.Commit(0));
+    TEST_ASSERT_FALSE(ring.Commit(65));
+    TEST_ASSERT_TRUE(ring.Commit(64));
+    ring.Release();
+    TEST_ASSERT_TRUE(ring.Empty());
+}
+
+void test_ring_buffers_cache_aligned() {
+    static StreamRing<4, 96> ring;
+    for (int i = 0; i < 4; i++) {
+        uint8_t* buffer = ring.Acquire();
+        TEST_ASSERT_EQUAL_UINT32(0, reinterpret_cast<uintptr_t>(buffer) % usb::kCacheLineSize);
+        TEST_ASSERT_TRUE(ring.Commit(1));
+    }
+}
+
+void test_host_round_trip_through_rings() {
+    TEST_ASSERT_TRUE(g_usb.VendorIsConnected());
+    const uint16_t* name = desc::Runtime().strings.Get(desc::kStrVendor);
+    TEST_ASSERT_NOT_NULL(name);
+    TEST_ASSERT_EQUAL_UINT16(2 + 2 * 6, name[0] & 0xFF);
+
+    std::vector<uint8_t> out(700);
+    for (size_t i = 0; i < out.size(); i++) {
+        out[i] = static_cast<uint8_t>(i * 7);
+    }
+    TinyUsbSim::Get().HostVendorSend(out.data(), static_cast<uint32_t>(out.size()));
+
+    // Эхо: принятые буферы копируются в буферы TX без промежуточных массивов
+    // (700 байт не влезают в FIFO 512 — хост досылает остаток после чтения)
+    for (int pass = 0; pass < 4; pass++) {
+        g_usb.Process();
+        uint32_t len = 0;
+        const uint8_t* rx;
+        while ((rx = g_usb.VendorPeekRx(&len)) != nullptr) {
+            uint32_t capacity = 0;
+            uint8_t* tx = g_usb.VendorAcquireTx(&capacity);
+            TEST_ASSERT_NOT_NULL(tx);
+            TEST_ASSERT_EQUAL_UINT32(USB_VENDOR_BUFFER_SIZE, capacity);
+            std::memcpy(tx, rx, len);
+            TEST_ASSERT_TRUE(g_usb.VendorCommitTx(len));
+            g_usb.VendorReleaseRx();
+        }
+    }
+
+    std::vector<uint8_t> in = TinyUsbSim::Get().HostVendorReceive();
+    TEST_ASSERT_EQUAL_UINT32(out.size(), in.size());
+    TEST_ASSERT_EQUAL_MEMORY(out.data(), in.data(), out.size());
+
+    usb::VendorStats s = g_usb.VendorGetStats();
+    TEST_ASSERT_EQUAL_UINT32(700, s.rx_bytes);
+    TEST_ASSERT_EQUAL_UINT32(700, s.tx_bytes);
+    TEST_ASSERT_EQUAL_UINT32(s.rx_buffers, s.tx_buffers);
+    TEST_ASSERT_EQUAL_UINT32(0, s.rx_ring_full);
+}
+
+void test_rx_backpressure_when_ring_full() {
+    // Больше, чем вмещают кольцо и FIFO TinyUSB вместе
+    const uint32_t total = (USB_VENDOR_RING_BUFFERS + 3) * USB_VENDOR_BUFFER_SIZE;
+    std::vector<uint8_t> out(total);
+    for (uint32_t i = 0; i < total; i++) {
+        out[i] = static_cast<uint8_t>(i ^ (i >> 8));
+    }
+    TinyUsbSim::Get().HostVendorSend(out.data(), total);
+    for (int pass = 0; pass < 8; pass++) {
+        g_usb.Process();  // По FIFO (512 байт) за проход, пока кольцо не заполнится
+    }
+    uint32_t first = 0;
+    TEST_ASSERT_NOT_NULL(g_usb.VendorPeekRx(&first));
+    TEST_ASSERT_EQUAL_UINT32(USB_VENDOR_BUFFER_SIZE, first);
+
+    TEST_ASSERT_EQUAL_UINT32(1, g_usb.VendorGetStats().rx_ring_full);
+    TEST_ASSERT_TRUE(TinyUsbSim::Get().HostVendorPending() > 0);  // Хост получает NAK
+
+    std::vector<uint8_t> in;
+    for (int guard = 0; guard < 100 && in.size() < total; guard++) {
+        uint32_t len = 0;
+        const uint8_t* rx = g_usb.VendorPeekRx(&len);
+        if (rx != nullptr) {
+            in.insert(in.end(), rx, rx + len);
+            g_usb.VendorReleaseRx();
+        }
+        g_usb.Process();  // Без событий: VendorPoll забирает FIFO в освобождённый буфер
+    }
+    TEST_ASSERT_EQUAL_UINT32(total, in.size());
+    TEST_ASSERT_EQUAL_MEMORY(out.data(), in.data(), total);
+    TEST_ASSERT_EQUAL_UINT32(0, TinyUsbSim::Get().HostVendorPending());
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_bos_platform_capability);
+    RUN_TEST(test_ms_os20_set_for_composite_device);
+    RUN_TEST(test_ms_os20_set_single_function_has_no_subsets);
+    RUN_TEST(test_guid_string_validation);
+    RUN_TEST(test_ring_fill_wrap_and_partial_consume);
+    RUN_TEST(test_ring_buffers_cache_aligned);
+    RUN_TEST(test_host_round_trip_through_rings);
+    RUN_TEST(test_rx_backpressure_when_ring_full);
+
+    return UNITY_END();
+}